@@ -22,6 +22,15 @@
 /* Defined if pselect() is available. */
 #cmakedefine HAVE_PSELECT
 
+/* Defined if epoll_create1() is available. */
+#cmakedefine HAVE_EPOLL
+
+/* Defined if eventfd() is available. */
+#cmakedefine HAVE_EVENTFD
+
+/* Defined if shm_open() is available. */
+#cmakedefine HAVE_SHM_OPEN
+
 /* Defined if linux/serial.h is available. */
 #cmakedefine HAVE_LINUX_SERIAL
 
@@ -31,6 +40,9 @@
 /* Defined if pthread_setname_np is available. */
 #cmakedefine HAVE_PTHREAD_SETNAME_NP
 
+/* Defined if pthread_setaffinity_np is available. */
+#cmakedefine HAVE_PTHREAD_SETAFFINITY_NP
+
 /* The name of package. */
 #cmakedefine PACKAGE "${PACKAGE_NAME}"
 
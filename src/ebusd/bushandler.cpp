@@ -22,7 +22,10 @@
 
 #include "ebusd/bushandler.h"
 #include <iomanip>
+#include <algorithm>
+#include "ebusd/request.h"
 #include "lib/utils/log.h"
+#include "lib/utils/memusage.h"
 
 namespace ebusd {
 
@@ -63,16 +66,33 @@ const char* getStateCode(BusState state) {
 }
 
 result_t PollRequest::prepare(symbol_t ownMasterAddress) {
+  if (m_busHandler) {
+    m_message = m_busHandler->findRefreshMessage(m_circuit, m_name, m_key);
+    if (!m_message) {
+      return RESULT_ERR_NOTFOUND;
+    }
+  }
+  if (m_index == 0) {
+    m_startMillis = clockGetMillis();
+    m_lastChangeVersion = m_message->getChangeVersion();
+  }
   istringstream input;
   result_t result = m_message->prepareMaster(m_index, ownMasterAddress, SYN, UI_FIELD_SEPARATOR, &input, &m_master);
   if (result == RESULT_OK) {
-    string str = m_master.getStr();
-    logInfo(lf_bus, "poll cmd: %s", str.c_str());
+    logInfo(lf_bus, "%s cmd: %s", m_busHandler ? "refresh" : "poll", m_master.getStr().c_str());
   }
   return result;
 }
 
 bool PollRequest::notify(result_t result, const SlaveSymbolString& slave) {
+  if (m_busHandler) {
+    m_message = m_busHandler->findRefreshMessage(m_circuit, m_name, m_key);
+    if (!m_message) {
+      logNotice(lf_bus, "refresh %s %s dropped: message no longer available", m_circuit.c_str(), m_name.c_str());
+      m_busHandler->setRefreshFinished(m_key);
+      return false;
+    }
+  }
   if (result == RESULT_OK) {
     result = m_message->storeLastData(m_index, slave);
     if (result >= RESULT_OK && m_index+1 < m_message->getCount()) {
@@ -81,11 +101,17 @@ bool PollRequest::notify(result_t result, const SlaveSymbolString& slave) {
       if (result >= RESULT_OK) {
         return true;
       }
+    } else if (result >= RESULT_OK) {
+      m_message->setPolled(m_message->getChangeVersion() != m_lastChangeVersion,
+          static_cast<unsigned int>(clockGetMillis() - m_startMillis));
     }
   }
   if (result < RESULT_OK) {
-    logError(lf_bus, "poll %s %s failed: %s", m_message->getCircuit().c_str(), m_message->getName().c_str(),
-        getResultCode(result));
+    logError(lf_bus, "%s %s %s failed: %s", m_busHandler ? "refresh" : "poll", m_message->getCircuit().c_str(),
+        m_message->getName().c_str(), getResultCode(result));
+  }
+  if (m_busHandler) {
+    m_busHandler->setRefreshFinished(m_key);
   }
   return false;
 }
@@ -99,8 +125,7 @@ result_t ScanRequest::prepare(symbol_t ownMasterAddress) {
   istringstream input;
   m_result = m_message->prepareMaster(m_index, ownMasterAddress, dstAddress, UI_FIELD_SEPARATOR, &input, &m_master);
   if (m_result >= RESULT_OK) {
-    string str = m_master.getStr();
-    logInfo(lf_bus, "scan %2.2x cmd: %s", dstAddress, str.c_str());
+    logInfo(lf_bus, "scan %2.2x cmd: %s", dstAddress, m_master.getStr().c_str());
   }
   return m_result;
 }
@@ -183,8 +208,7 @@ bool ScanRequest::notify(result_t result, const SlaveSymbolString& slave) {
 
 bool ActiveBusRequest::notify(result_t result, const SlaveSymbolString& slave) {
   if (result == RESULT_OK) {
-    string str = slave.getStr();
-    logDebug(lf_bus, "read res: %s", str.c_str());
+    logDebug(lf_bus, "read res: %s", slave.getStr().c_str());
   }
   m_result = result;
   *m_slave = slave;
@@ -193,12 +217,84 @@ bool ActiveBusRequest::notify(result_t result, const SlaveSymbolString& slave) {
 
 
 void GrabbedMessage::setLastData(const MasterSymbolString& master, const SlaveSymbolString& slave) {
-  time(&m_lastTime);
-  m_lastMaster = master;
-  m_lastSlave = slave;
+  grabbedTelegram_t& telegram = m_telegrams[m_next];
+  time(&telegram.time);
+  telegram.master = master;
+  telegram.slave = slave;
+  m_next = (m_next + 1) % m_telegrams.size();
+  if (m_size < m_telegrams.size()) {
+    m_size++;
+  }
   m_count++;
 }
 
+size_t GrabbedMessage::getMemoryUsage() const {
+  size_t ret = sizeof(GrabbedMessage) + m_telegrams.capacity()*sizeof(grabbedTelegram_t);
+  for (const auto& telegram : m_telegrams) {
+    ret += telegram.master.getHeapSize() + telegram.slave.getHeapSize();
+  }
+  return ret;
+}
+
+
+void GrabbedMessageMap::add(uint64_t key, const MasterSymbolString& master, const SlaveSymbolString& slave) {
+  lock();
+  m_telegramCount++;
+  auto it = m_index.find(key);
+  if (it != m_index.end()) {
+    m_messages.splice(m_messages.begin(), m_messages, it->second);  // now the most recently seen one
+  } else {
+    if (m_index.size() >= m_capacity) {
+      // drop the least recently seen one
+      m_index.erase(m_messages.back().first);
+      m_messages.pop_back();
+      m_evictedCount++;
+    }
+    m_messages.emplace_front(key, GrabbedMessage(m_historySize));
+    m_index[key] = m_messages.begin();
+  }
+  m_messages.front().second.setLastData(master, slave);
+  unlock();
+}
+
+void GrabbedMessageMap::clear() {
+  lock();
+  m_index.clear();
+  m_messages.clear();
+  m_telegramCount = 0;
+  m_evictedCount = 0;
+  unlock();
+}
+
+size_t GrabbedMessageMap::getMemoryUsage() const {
+  lock();
+  size_t ret = m_index.bucket_count()*sizeof(void*) + m_index.size()*memUsageNode(sizeof(*m_index.begin()));
+  for (const auto& it : m_messages) {
+    ret += memUsageNode(sizeof(it.first)) + it.second.getMemoryUsage();
+  }
+  unlock();
+  return ret;
+}
+
+void GrabbedMessageMap::findAll(time_t since, time_t until, vector<const GrabbedMessage*>* messages) const {
+  vector<pair<uint64_t, const GrabbedMessage*>> found;
+  for (const auto& it : m_messages) {
+    time_t lastTime = it.second.getLastTime();
+    if (since > 0 && lastTime < since) {
+      break;  // all further ones were received even earlier
+    }
+    if (until > 0 && lastTime >= until) {
+      continue;
+    }
+    found.emplace_back(it.first, &it.second);
+  }
+  std::sort(found.begin(), found.end());
+  messages->reserve(messages->size() + found.size());
+  for (const auto& it : found) {
+    messages->push_back(it.second);
+  }
+}
+
 
 /**
  * Decode the input @a SymbolString with the specified @a DataType and length.
@@ -255,7 +351,10 @@ bool decodeType(const DataType* type, const SymbolString& input, size_t length,
 
 bool GrabbedMessage::dump(bool unknown, MessageMap* messages, bool first, OutputFormat outputFormat,
     ostringstream* output, bool isDirectMode) const {
-  Message* message = messages->find(m_lastMaster);
+  const grabbedTelegram_t& last = getTelegram(0);
+  const MasterSymbolString& lastMaster = last.master;
+  const SlaveSymbolString& lastSlave = last.slave;
+  Message* message = messages->find(lastMaster);
   if (unknown && message) {
     return false;
   }
@@ -266,12 +365,12 @@ bool GrabbedMessage::dump(bool unknown, MessageMap* messages, bool first, Output
       *output << endl;
     }
   }
-  symbol_t dstAddress = m_lastMaster[1];
+  symbol_t dstAddress = lastMaster[1];
   if (outputFormat & OF_JSON) {
     if (outputFormat & OF_SHORT) {
-      *output << '"' << m_lastMaster.getStr() << '/';
+      *output << '"' << lastMaster.getStr() << '/';
       if (dstAddress != BROADCAST && !isMaster(dstAddress)) {
-        *output << m_lastSlave.getStr();
+        *output << lastSlave.getStr();
       }
       *output << '/' << static_cast<unsigned>(m_count);
       if (message) {
@@ -281,29 +380,49 @@ bool GrabbedMessage::dump(bool unknown, MessageMap* messages, bool first, Output
       return true;
     }
     *output << "\n{";
-    if (m_lastMaster.dumpJson(false, output)) {
+    if (lastMaster.dumpJson(false, output)) {
       *output << ", ";
-      if (dstAddress != BROADCAST && !isMaster(dstAddress) && m_lastSlave.dumpJson(false, output)) {
+      if (dstAddress != BROADCAST && !isMaster(dstAddress) && lastSlave.dumpJson(false, output)) {
         *output << ", ";
       }
     }
     *output << "\"count\": " << static_cast<unsigned>(m_count);
-    *output << ", \"lastup\": " << setw(0) << dec << m_lastTime;
+    *output << ", \"lastup\": " << setw(0) << dec << last.time;
+    if (m_size > 1) {
+      *output << ", \"history\": [";
+      for (size_t age = 1; age < m_size; age++) {
+        const grabbedTelegram_t& telegram = getTelegram(age);
+        *output << (age > 1 ? ", " : "") << "{\"time\": " << telegram.time
+                << ", \"master\": \"" << telegram.master.getStr() << "\"";
+        if (dstAddress != BROADCAST && !isMaster(dstAddress)) {
+          *output << ", \"slave\": \"" << telegram.slave.getStr() << "\"";
+        }
+        *output << "}";
+      }
+      *output << "]";
+    }
     if (message) {
       *output << ", \"circuit\": \"" << message->getCircuit() << "\""
               << ", \"name\": \"" << message->getName() << "\"";
     }
     *output << "}";
   } else {
-    *output << m_lastMaster.getStr();
+    *output << lastMaster.getStr();
     if (dstAddress != BROADCAST && !isMaster(dstAddress)) {
-      *output << (isDirectMode ? " " : " / ") << m_lastSlave.getStr();
+      *output << (isDirectMode ? " " : " / ") << lastSlave.getStr();
     }
     if (!isDirectMode) {
       *output << " = " << m_count;
       if (message) {
         *output << ": " << message->getCircuit() << " " << message->getName();
       }
+      for (size_t age = 1; age < m_size; age++) {
+        const grabbedTelegram_t& telegram = getTelegram(age);
+        *output << endl << "  " << telegram.master.getStr();
+        if (dstAddress != BROADCAST && !isMaster(dstAddress)) {
+          *output << " / " << telegram.slave.getStr();
+        }
+      }
     }
   }
   if (!(outputFormat & OF_DEFINITION) || (outputFormat & OF_JSON)) {
@@ -313,8 +432,8 @@ bool GrabbedMessage::dump(bool unknown, MessageMap* messages, bool first, Output
   if (!types) {
     return true;
   }
-  bool master = isMaster(dstAddress) || dstAddress == BROADCAST || m_lastSlave.getDataSize() <= 0;
-  size_t remain = master ? m_lastMaster.getDataSize() : m_lastSlave.getDataSize();
+  bool master = isMaster(dstAddress) || dstAddress == BROADCAST || lastSlave.getDataSize() <= 0;
+  size_t remain = master ? lastMaster.getDataSize() : lastSlave.getDataSize();
   if (remain == 0) {
     return true;
   }
@@ -334,9 +453,9 @@ bool GrabbedMessage::dump(bool unknown, MessageMap* messages, bool first, Output
         const DataType* type = types->get(baseType->getId(), length);
         bool decoded;
         if (master) {
-          decoded = decodeType(type, m_lastMaster, length, remain-length, firstOnly, output);
+          decoded = decodeType(type, lastMaster, length, remain-length, firstOnly, output);
         } else {
-          decoded = decodeType(type, m_lastSlave, length, remain-length, firstOnly, output);
+          decoded = decodeType(type, lastSlave, length, remain-length, firstOnly, output);
         }
         if (decoded && firstOnly) {
           break;  // only a single offset with maximum length when adjustable maximum size is at least 8 bytes
@@ -344,9 +463,9 @@ bool GrabbedMessage::dump(bool unknown, MessageMap* messages, bool first, Output
       }
     } else if (maxLength > 0) {
       if (master) {
-        decodeType(baseType, m_lastMaster, maxLength, remain-maxLength, false, output);
+        decodeType(baseType, lastMaster, maxLength, remain-maxLength, false, output);
       } else {
-        decodeType(baseType, m_lastSlave, maxLength, remain-maxLength, false, output);
+        decodeType(baseType, lastSlave, maxLength, remain-maxLength, false, output);
       }
     }
   }
@@ -355,23 +474,297 @@ bool GrabbedMessage::dump(bool unknown, MessageMap* messages, bool first, Output
 
 
 void BusHandler::clear() {
-  memset(m_seenAddresses, 0, sizeof(m_seenAddresses));
+  for (auto& seen : m_seenAddresses) {
+    seen = 0;
+  }
   m_masterCount = 1;
   m_scanResults.clear();
+  m_queuedScanConfigs.clear();
+  m_slaveAvailabilityMutex.lock();
+  m_slaveAvailability.clear();
+  m_slaveAvailabilityMutex.unlock();
+}
+
+void BusHandler::initMetrics(const string& labels) {
+  m_metricLabels = labels;
+  Metrics* metrics = Metrics::getInstance();
+  m_symbolLatencyMetric = metrics->getHistogram("ebusd_bus_symbol_latency_seconds",
+      "Latency between sending a symbol and receiving it back",
+      {1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000}, labels);
+  m_symbolJitterMetric = metrics->getHistogram("ebusd_bus_symbol_jitter_seconds",
+      "Delay of handling a symbol received back-to-back beyond its nominal duration",
+      {100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000}, labels);
+  m_arbitrationDelayMetric = metrics->getHistogram("ebusd_bus_arbitration_delay_seconds",
+      "Delay between the received SYN and the sent own master address",
+      {50, 100, 200, 500, 1000, 2000, 5000, 10000}, labels);
+  m_findMetric = metrics->getHistogram("ebusd_message_find_seconds",
+      "Time for finding the message definition of a received telegram",
+      {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 10000}, labels);
+  m_decodeMetric = metrics->getHistogram("ebusd_message_decode_seconds",
+      "Time for storing and decoding the data of a received telegram",
+      {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 10000}, labels);
+  m_telegramMetric = metrics->getCounter("ebusd_bus_telegrams_total", "Number of completed telegrams on the bus",
+      labels);
+  m_unknownTelegramMetric = metrics->getCounter("ebusd_bus_unknown_telegrams_total",
+      "Number of completed telegrams on the bus without a message definition", labels);
+  m_unchangedTelegramMetric = metrics->getCounter("ebusd_bus_unchanged_telegrams_total",
+      "Number of completed passive telegrams identical to the last data of their message skipping the decoding",
+      labels);
+  m_decodedTelegramMetric = metrics->getCounter("ebusd_bus_decoded_telegrams_total",
+      "Number of completed telegrams successfully decoded and stored for their message definition", labels);
+  m_symbolRateMetric = metrics->getGauge("ebusd_bus_symbol_rate", "Number of received symbols per second", labels);
+  m_slaveDownMetric = metrics->getCounter("ebusd_bus_slave_down_skipped_total",
+      "Number of requests and polls to slaves considered down that were skipped", labels);
+}
+
+void BusHandler::addOtherBus(BusHandler* other) {
+  other->m_primary = this;
+  m_otherBuses.push_back(other);
+  // the metrics of the other bus segment are distinguished by the device name
+  string name = other->m_device->getName();
+  string label;
+  for (const auto ch : name) {
+    if (ch == '"' || ch == '\\') {
+      label.push_back('\\');
+    }
+    label.push_back(ch);
+  }
+  other->initMetrics("bus=\"" + label + "\"");
+}
+
+bool BusHandler::hasSeenAddress(symbol_t address) const {
+  if ((m_seenAddresses[address]&SEEN) != 0) {
+    return true;
+  }
+  symbol_t master = isMaster(address) ? SYN : getMasterAddress(address);
+  return master != SYN && (m_seenAddresses[master]&SEEN) != 0;
+}
+
+BusHandler* BusHandler::getBusFor(symbol_t address) {
+  if (address != BROADCAST && address != SYN) {
+    for (const auto other : m_otherBuses) {
+      if (other->hasSeenAddress(address)) {
+        return other;
+      }
+    }
+  }
+  return this;
+}
+
+bool BusHandler::checkSlaveAvailable(symbol_t address, bool* probe) {
+  *probe = false;
+  m_slaveAvailabilityMutex.lock();
+  const auto it = m_slaveAvailability.find(address);
+  if (it == m_slaveAvailability.end() || it->second.backoff == 0) {
+    m_slaveAvailabilityMutex.unlock();
+    return true;
+  }
+  time_t now;
+  time(&now);
+  slaveAvailability_t& availability = it->second;
+  if (now < availability.nextProbe) {
+    m_slaveAvailabilityMutex.unlock();
+    m_slaveDownMetric->add();
+    return false;
+  }
+  // let this one through as probe and hold back all others until it is finished or the backoff elapsed again
+  availability.nextProbe = now + availability.backoff;
+  m_slaveAvailabilityMutex.unlock();
+  *probe = true;
+  logInfo(lf_bus, "probe down slave %2.2x", address);
+  return true;
+}
+
+void BusHandler::updateSlaveAvailability(symbol_t address, result_t result) {
+  m_slaveAvailabilityMutex.lock();
+  auto it = m_slaveAvailability.find(address);
+  if (result != RESULT_ERR_TIMEOUT) {
+    if (result == RESULT_OK && it != m_slaveAvailability.end()) {
+      if (it->second.backoff > 0) {
+        logNotice(lf_bus, "slave %2.2x is available again", address);
+      }
+      m_slaveAvailability.erase(it);
+    }
+    m_slaveAvailabilityMutex.unlock();
+    return;
+  }
+  if (it == m_slaveAvailability.end()) {
+    it = m_slaveAvailability.emplace(address, slaveAvailability_t{0, 0, 0}).first;
+  }
+  slaveAvailability_t& availability = it->second;
+  availability.failures++;
+  bool probed = availability.backoff > 0;
+  if (probed) {
+    availability.backoff = std::min(availability.backoff*2, (unsigned int)SLAVE_DOWN_BACKOFF_MAX);
+  } else if (availability.failures >= SLAVE_DOWN_FAILURES) {
+    availability.backoff = SLAVE_DOWN_BACKOFF_MIN;
+  } else {
+    m_slaveAvailabilityMutex.unlock();
+    return;
+  }
+  time(&availability.nextProbe);
+  availability.nextProbe += availability.backoff;
+  unsigned int failures = availability.failures, backoff = availability.backoff;
+  m_slaveAvailabilityMutex.unlock();
+  if (probed) {
+    logInfo(lf_bus, "probe of down slave %2.2x unanswered, next probe in %d s", address, backoff);
+  } else {
+    logNotice(lf_bus, "slave %2.2x considered down after %d unanswered requests, next probe in %d s", address,
+        failures, backoff);
+  }
+}
+
+result_t BusHandler::sendAndWait(const MasterSymbolString& master, SlaveSymbolString* slave,
+    size_t coalesceLength, RequestPriority priority) {
+  if (master.size() <= 1 || m_otherBuses.empty()) {
+    return sendAndWaitOnBus(master, slave, coalesceLength, priority);
+  }
+  BusHandler* bus = getBusFor(master[1]);
+  if (bus != this) {
+    return bus->sendAndWaitOnBus(master, slave, coalesceLength, priority);
+  }
+  result_t result = sendAndWaitOnBus(master, slave, coalesceLength, priority);
+  return sendAndWaitOnOtherBuses(master, slave, priority, result);
+}
+
+result_t BusHandler::sendAndWaitOnOtherBuses(const MasterSymbolString& master, SlaveSymbolString* slave,
+    RequestPriority priority, result_t result) {
+  if (m_otherBuses.empty() || master.size() <= 1 || master[1] == BROADCAST || hasSeenAddress(master[1])
+      || (result != RESULT_ERR_TIMEOUT && result != RESULT_ERR_NO_SIGNAL)) {
+    return result;
+  }
+  // target not seen on any bus segment yet: try the other ones
+  for (const auto other : m_otherBuses) {
+    result_t otherResult = other->sendAndWaitOnBus(master, slave, 0, priority);
+    if (otherResult != RESULT_ERR_TIMEOUT && otherResult != RESULT_ERR_NO_SIGNAL) {
+      return otherResult;
+    }
+  }
+  return result;
+}
+
+result_t BusHandler::addActiveRequest(ActiveBusRequest* request, size_t coalesceLength) {
+  const MasterSymbolString& master = request->m_master;
+  string masterStr = master.getStr();
+  m_activeRequestsMutex.lock();
+  if (request->m_priority == rp_interactiveWrite) {
+    invalidateActiveResults(master);  // the write is likely to change what the destination answers
+  } else if (isReusable(master)) {
+    const auto it = m_lastActiveResults.find(masterStr);
+    if (it != m_lastActiveResults.end() && clockGetMillis() - it->second.time <= REQUEST_REUSE_TIME) {
+      *request->m_slave = it->second.slave;
+      m_activeRequestsMutex.unlock();
+      logInfo(lf_bus, "reuse message result: %s", masterStr.c_str());
+      return RESULT_OK;
+    }
+  }
+  for (auto active : m_activeRequests) {
+    if (active->m_master.compareTo(master) == 0) {
+      // identical message is being sent already: wait for its result instead of arbitrating separately
+      active->m_joined.push_back(request);
+      m_activeRequestsMutex.unlock();
+      logInfo(lf_bus, "join message: %s", masterStr.c_str());
+      return RESULT_EMPTY;
+    }
+  }
+  if (coalesceLength > 0 && m_writeCoalesce > 0) {
+    request->m_coalesceKey = masterStr.substr(0, coalesceLength*2);
+    for (auto it = m_activeRequests.begin(); it != m_activeRequests.end(); it++) {
+      ActiveBusRequest* active = *it;
+      if (active->m_coalesceKey != request->m_coalesceKey || !m_nextRequests.remove(active)) {
+        continue;  // other message or already being sent
+      }
+      // older write not sent yet: let it wait for the result of this one instead
+      BusRequest* started = active;
+      m_startedRequest.compare_exchange_strong(started, nullptr);  // arbitration continues for the next one
+      logInfo(lf_bus, "coalesce message: %s", active->m_master.getStr().c_str());
+      active->m_coalesced = true;
+      request->m_joined.push_back(active);
+      request->m_joined.insert(request->m_joined.end(), active->m_joined.begin(), active->m_joined.end());
+      active->m_joined.clear();
+      m_activeRequests.erase(it);
+      break;  // there is at most one older write per message
+    }
+  }
+  m_activeRequests.push_back(request);
+  m_activeRequestsMutex.unlock();
+  logInfo(lf_bus, "send message: %s", masterStr.c_str());
+  return RESULT_CONTINUE;
 }
 
-result_t BusHandler::sendAndWait(const MasterSymbolString& master, SlaveSymbolString* slave) {
+void BusHandler::invalidateActiveResults(const MasterSymbolString& master) {
+  if (master.size() <= 1 || m_lastActiveResults.empty()) {
+    return;
+  }
+  string dstStr = master.getStr().substr(2, 2);
+  for (auto it = m_lastActiveResults.begin(); it != m_lastActiveResults.end(); ) {
+    if (it->first.compare(2, 2, dstStr) == 0) {
+      it = m_lastActiveResults.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+void BusHandler::removeActiveRequest(ActiveBusRequest* request, result_t result) {
+  m_activeRequestsMutex.lock();
+  for (auto it = m_activeRequests.begin(); it != m_activeRequests.end(); it++) {
+    if (*it == request) {
+      m_activeRequests.erase(it);
+      break;
+    }
+  }
+  if (request->m_priority == rp_interactiveWrite) {
+    invalidateActiveResults(request->m_master);  // drop reads completed while the write was pending
+  } else if (result == RESULT_OK && isReusable(request->m_master)) {
+    uint64_t now = clockGetMillis();
+    for (auto it = m_lastActiveResults.begin(); it != m_lastActiveResults.end(); ) {
+      if (now - it->second.time > REQUEST_REUSE_TIME) {
+        it = m_lastActiveResults.erase(it);
+      } else {
+        it++;
+      }
+    }
+    activeResult_t& last = m_lastActiveResults[request->m_master.getStr()];
+    last.slave = *request->m_slave;
+    last.time = now;
+  }
+  for (auto joined : request->m_joined) {
+    joined->m_result = result;
+    *joined->m_slave = *request->m_slave;
+    m_finishedRequests.push(joined);
+  }
+  request->m_joined.clear();
+  m_activeRequestsMutex.unlock();
+}
+
+result_t BusHandler::sendAndWaitOnBus(const MasterSymbolString& master, SlaveSymbolString* slave,
+    size_t coalesceLength, RequestPriority priority) {
   if (m_state == bs_noSignal) {
     return RESULT_ERR_NO_SIGNAL;  // don't wait when there is no signal
   }
+  bool probe = false;
+  if (master.size() > 1 && !checkSlaveAvailable(master[1], &probe)) {
+    logInfo(lf_bus, "skip message to down slave %2.2x: %s", master[1], master.getStr().c_str());
+    return RESULT_ERR_TIMEOUT;
+  }
   result_t result = RESULT_ERR_NO_SIGNAL;
   slave->clear();
-  ActiveBusRequest request(master, slave);
-  logInfo(lf_bus, "send message: %s", master.getStr().c_str());
-
-  for (int sendRetries = m_failedSendRetries + 1; sendRetries > 0; sendRetries--) {
-    m_nextRequests.push(&request);
+  ActiveBusRequest request(master, slave, priority);
+  result = addActiveRequest(&request, coalesceLength);
+  if (result == RESULT_OK) {
+    return result;  // reused
+  }
+  if (result == RESULT_EMPTY) {
+    m_finishedRequests.remove(&request, true);
+    return request.m_result;  // joined
+  }
+  for (int sendRetries = probe ? 1 : m_failedSendRetries + 1; sendRetries > 0; sendRetries--) {
+    queueRequest(&request);
     bool success = m_finishedRequests.remove(&request, true);
+    if (request.m_coalesced) {
+      return request.m_result;  // superseded while queued and already removed from the active ones
+    }
     result = success ? request.m_result : RESULT_ERR_TIMEOUT;
     if (result == RESULT_OK) {
       break;
@@ -383,6 +776,7 @@ result_t BusHandler::sendAndWait(const MasterSymbolString& master, SlaveSymbolSt
     logError(lf_bus, "send to %2.2x: %s%s", master[1], getResultCode(result), sendRetries > 1 ? ", retry" : "");
     request.m_busLostRetries = 0;
   }
+  removeActiveRequest(&request, result);
   return result;
 }
 
@@ -400,7 +794,9 @@ result_t BusHandler::readFromBus(Message* message, const string& inputStr, symbo
       break;
     }
     // send message
-    ret = sendAndWait(master, &slave);
+    ret = sendAndWait(master, &slave, message->isWrite() && message->getCount() == 1
+      ? 5 + message->getIdLength() : 0,  // QQ ZZ PB SB NN and further ID bytes
+      message->isWrite() ? rp_interactiveWrite : rp_interactiveRead);
     if (ret != RESULT_OK) {
       logError(lf_bus, "send message part %d: %s", index, getResultCode(ret));
       break;
@@ -414,6 +810,166 @@ result_t BusHandler::readFromBus(Message* message, const string& inputStr, symbo
   return ret;
 }
 
+result_t BusHandler::readFromBus(const vector<Message*>& messages) {
+  if (messages.empty()) {
+    return RESULT_OK;
+  }
+  if (m_state == bs_noSignal) {
+    return RESULT_ERR_NO_SIGNAL;
+  }
+  /** the state of a single @a Message read within the batch. */
+  typedef struct {
+    Message* message;  //!< the @a Message to read
+    size_t index;  //!< the current part index
+    unsigned int retries;  //!< the remaining number of send retries of the current part
+    bool done;  //!< whether reading the @a Message was finished (successfully or not)
+    MasterSymbolString master;  //!< the master data of the current part
+    SlaveSymbolString slave;  //!< the received slave data of the current part
+    BusHandler* bus;  //!< the @a BusHandler of the bus segment the current part is sent on
+    ActiveBusRequest* request;  //!< the request of the current part, or nullptr
+    result_t added;  //!< the result of @a addActiveRequest() for @a request
+  } batchRead_t;
+  result_t overallResult = RESULT_OK;
+  vector<batchRead_t> reads(messages.size());  // not resized anymore as the requests refer to the master data
+  for (size_t pos = 0; pos < messages.size(); pos++) {
+    reads[pos].message = messages[pos];
+    reads[pos].index = 0;
+    reads[pos].retries = m_failedSendRetries;
+    reads[pos].done = false;
+    reads[pos].bus = nullptr;
+    reads[pos].request = nullptr;
+    reads[pos].added = RESULT_EMPTY;
+    symbol_t dstAddress = messages[pos]->getDstAddress();
+    bool probe = false;
+    if (!getBusFor(dstAddress)->checkSlaveAvailable(dstAddress, &probe)) {
+      logInfo(lf_bus, "skip %s %s to down slave %2.2x", messages[pos]->getCircuit().c_str(),
+          messages[pos]->getName().c_str(), dstAddress);
+      reads[pos].done = true;
+      overallResult = RESULT_ERR_TIMEOUT;
+    } else if (probe) {
+      reads[pos].retries = 0;
+    }
+  }
+  logInfo(lf_bus, "read %d messages in batch", reads.size());
+  vector<batchRead_t*> sent;
+  do {
+    // queue the next part (or the retry of the current one) of all messages not finished yet at once
+    sent.clear();
+    for (auto& read : reads) {
+      if (read.done) {
+        continue;
+      }
+      if (read.request) {
+        read.request->m_busLostRetries = 0;
+        read.bus->queueRequest(read.request);
+        sent.push_back(&read);
+        continue;
+      }
+      istringstream input;
+      result_t result = read.message->prepareMaster(read.index, m_ownMasterAddress, SYN, UI_FIELD_SEPARATOR, &input,
+          &read.master);
+      if (result != RESULT_OK) {
+        logError(lf_bus, "prepare %s %s part %d: %s", read.message->getCircuit().c_str(),
+            read.message->getName().c_str(), read.index, getResultCode(result));
+        read.done = true;
+        overallResult = result;
+        continue;
+      }
+      read.slave.clear();
+      read.bus = getBusFor(read.master[1]);
+      read.request = new ActiveBusRequest(read.master, &read.slave, rp_instruction);
+      // same reuse and join handling as for single requests
+      read.added = read.bus->addActiveRequest(read.request, 0);
+      if (read.added == RESULT_CONTINUE) {
+        read.bus->queueRequest(read.request);
+      }
+      sent.push_back(&read);
+    }
+    // then wait for all of them
+    for (auto read : sent) {
+      bool success = true;
+      result_t result = RESULT_OK;  // reused
+      if (read->added != RESULT_OK) {
+        success = read->bus->m_finishedRequests.remove(read->request, true);
+        result = success ? read->request->m_result : RESULT_ERR_TIMEOUT;
+      }
+      if (result != RESULT_OK && read->added == RESULT_CONTINUE && success && read->retries > 0
+          && result != RESULT_ERR_NO_SIGNAL && result != RESULT_ERR_SEND && result != RESULT_ERR_DEVICE) {
+        logError(lf_bus, "send to %2.2x: %s, retry", read->master[1], getResultCode(result));
+        read->retries--;
+        continue;  // queued again with the next round
+      }
+      if (read->added == RESULT_CONTINUE) {
+        read->bus->removeActiveRequest(read->request, result);
+      }
+      delete read->request;
+      read->request = nullptr;
+      if (result != RESULT_OK && read->bus == this) {
+        result = sendAndWaitOnOtherBuses(read->master, &read->slave, rp_instruction, result);
+      }
+      if (result == RESULT_OK) {
+        result = read->message->storeLastData(read->index, read->slave);
+        if (result >= RESULT_OK && ++read->index < read->message->getCount()) {
+          read->retries = m_failedSendRetries;
+          continue;  // next part with the next round
+        }
+        read->done = true;
+        if (result < RESULT_OK) {
+          logError(lf_bus, "store %s %s part %d: %s", read->message->getCircuit().c_str(),
+              read->message->getName().c_str(), read->index, getResultCode(result));
+          overallResult = result;
+        }
+        continue;
+      }
+      logError(lf_bus, "send to %2.2x: %s, give up", read->master[1], getResultCode(result));
+      read->done = true;
+      overallResult = result;
+    }
+  } while (!sent.empty());
+  return overallResult;
+}
+
+result_t BusHandler::refreshInBackground(Message* message) {
+  if (message->isPassive() || message->isWrite() || message->getDstAddress() == SYN) {
+    return RESULT_ERR_INVALID_ARG;
+  }
+  if (m_state == bs_noSignal) {
+    return RESULT_ERR_NO_SIGNAL;
+  }
+  bool probe;
+  if (!getBusFor(message->getDstAddress())->checkSlaveAvailable(message->getDstAddress(), &probe)) {
+    return RESULT_ERR_TIMEOUT;
+  }
+  uint64_t key = message->getKey();
+  m_pendingRefreshesMutex.lock();
+  bool added = m_pendingRefreshes.insert(key).second;
+  m_pendingRefreshesMutex.unlock();
+  if (!added) {
+    return RESULT_ERR_DUPLICATE;
+  }
+  auto request = new PollRequest(message, this);
+  result_t ret = request->prepare(m_ownMasterAddress);
+  if (ret != RESULT_OK) {
+    delete request;
+    setRefreshFinished(key);
+    return ret;
+  }
+  logInfo(lf_bus, "refresh %s %s in background", message->getCircuit().c_str(), message->getName().c_str());
+  getBusFor(message->getDstAddress())->queueRequest(request);
+  return RESULT_OK;
+}
+
+void BusHandler::setRefreshFinished(uint64_t key) {
+  m_pendingRefreshesMutex.lock();
+  m_pendingRefreshes.erase(key);
+  m_pendingRefreshesMutex.unlock();
+}
+
+Message* BusHandler::findRefreshMessage(const string& circuit, const string& name, uint64_t key) const {
+  Message* message = m_messages->find(circuit, name, "*", false);
+  return message && message->getKey() == key ? message : nullptr;
+}
+
 void BusHandler::run() {
   unsigned int symCount = 0;
   time_t now, lastTime;
@@ -431,6 +987,7 @@ void BusHandler::run() {
       }
       if (now > lastTime) {
         m_symPerSec = symCount / (unsigned int)(now-lastTime);
+        m_symbolRateMetric->set(m_symPerSec);
         if (m_symPerSec > m_maxSymPerSec) {
           m_maxSymPerSec = m_symPerSec;
           if (m_maxSymPerSec > 100) {
@@ -458,6 +1015,8 @@ void BusHandler::run() {
       }
       symCount = 0;
       m_symbolLatencyMin = m_symbolLatencyMax = m_arbitrationDelayMin = m_arbitrationDelayMax = -1;
+      m_symbolJitterMax = -1;
+      m_symbolJitterSum = m_symbolJitterCount = 0;
       time(&lastTime);
       lastTime += 2;
     }
@@ -472,6 +1031,19 @@ void BusHandler::run() {
 #endif
 #endif
 
+BusRequest* BusHandler::takeStartedRequest() {
+  BusRequest* request = m_startedRequest.exchange(nullptr);
+  // a more urgent request might have been queued while arbitrating for the started one
+  if (request != nullptr && m_nextRequests.remove(request)) {
+    return request;
+  }
+  request = m_nextRequests.peek();
+  if (request != nullptr && m_nextRequests.remove(request)) {
+    return request;
+  }
+  return nullptr;
+}
+
 result_t BusHandler::handleSymbol() {
   unsigned int timeout = SYN_TIMEOUT;
   symbol_t sendSymbol = ESC;
@@ -495,30 +1067,46 @@ result_t BusHandler::handleSymbol() {
       if (startRequest == nullptr && m_pollInterval > 0) {  // check for poll/scan
         time_t now;
         time(&now);
+        Message* message = nullptr;
         if (m_lastPoll == 0 || difftime(now, m_lastPoll) > m_pollInterval) {
-          Message* message = m_messages->getNextPoll();
-          if (message != nullptr) {
-            m_lastPoll = now;
-            if (difftime(now, message->getLastUpdateTime()) > m_pollInterval) {
-              // only poll this message if it was not updated already by other means within the interval
-              auto request = new PollRequest(message);
-              result_t ret = request->prepare(m_ownMasterAddress);
-              if (ret != RESULT_OK) {
-                logError(lf_bus, "prepare poll message: %s", getResultCode(ret));
-                delete request;
-              } else {
-                startRequest = request;
-                m_nextRequests.push(request);
-              }
-            }
+          m_lastPoll = now;
+          message = m_messages->getNextPoll(now, m_pollInterval);
+        } else if (m_idleSynCount >= POLL_IDLE_SYN_COUNT) {
+          // bus was idle for a while: fill the gap with a poll that is due anyway
+          m_idleSynCount = 0;
+          message = m_messages->getNextPoll(now, m_pollInterval, true);
+        }
+        bool probe;
+        for (size_t skipped = 0; message != nullptr
+            && !getBusFor(message->getDstAddress())->checkSlaveAvailable(message->getDstAddress(), &probe);
+            skipped++) {
+          // slave considered down: use the time for another due message instead
+          logDebug(lf_bus, "skip poll %s %s to down slave %2.2x", message->getCircuit().c_str(),
+              message->getName().c_str(), message->getDstAddress());
+          message = skipped < POLL_DOWN_SKIP_COUNT ? m_messages->getNextPoll(now, m_pollInterval, true) : nullptr;
+        }
+        if (message != nullptr) {
+          auto request = new PollRequest(message);
+          result_t ret = request->prepare(m_ownMasterAddress);
+          BusHandler* bus = ret == RESULT_OK ? getBusFor(message->getDstAddress()) : this;
+          if (ret != RESULT_OK) {
+            logError(lf_bus, "prepare poll message: %s", getResultCode(ret));
+            delete request;
+          } else if (bus != this) {
+            bus->queueRequest(request);  // arbitration is started by the other bus
+          } else {
+            startRequest = request;
+            queueRequest(request);
           }
         }
       }
       if (startRequest != nullptr) {  // initiate arbitration
         logDebug(lf_bus, "start request %2.2x", startRequest->m_master[0]);
+        clockGettime(&m_requestStartTime);
         result_t ret = m_device->startArbitration(startRequest->m_master[0]);
         if (ret == RESULT_OK) {
           logDebug(lf_bus, "arbitration start with %2.2x", startRequest->m_master[0]);
+          m_startedRequest = startRequest;
         } else {
           logError(lf_bus, "arbitration start: %s", getResultCode(ret));
           m_nextRequests.remove(startRequest);
@@ -602,7 +1190,11 @@ result_t BusHandler::handleSymbol() {
   // send symbol if necessary
   result_t result;
   struct timespec sentTime, recvTime;
+  bool preSent = false;
   if (sending) {
+    // only after arbitration was won (i.e. the source address was sent) or when sending the answer
+    bool burstStart = m_burstSend && m_burstRemain == 0 && !m_escape
+      && ((m_state == bs_sendCmd && m_currentRequest != nullptr && m_nextSendPos > 0) || m_state == bs_sendRes);
     if (m_state != bs_sendSyn && (sendSymbol == ESC || sendSymbol == SYN)) {
       if (m_escape) {
         sendSymbol = (symbol_t)(sendSymbol == ESC ? 0x00 : 0x01);
@@ -611,7 +1203,16 @@ result_t BusHandler::handleSymbol() {
         sendSymbol = ESC;
       }
     }
-    result = m_device->send(sendSymbol);
+    if (m_burstRemain > 0) {
+      // already sent at once, only the echo is to be checked
+      m_burstRemain--;
+      preSent = true;
+      result = RESULT_OK;
+    } else if (burstStart) {
+      result = sendBurst();
+    } else {
+      result = m_device->send(sendSymbol);
+    }
     clockGettime(&sentTime);
     if (result == RESULT_OK) {
       if (m_state == bs_ready) {
@@ -670,11 +1271,9 @@ result_t BusHandler::handleSymbol() {
     case as_lost:
     case as_timeout:
       logDebug(lf_bus, arbitrationState == as_lost ? "arbitration lost" : "arbitration lost (timed out)");
+      traceArbitration(arbitrationState == as_lost ? "lost" : "timeout");
       if (m_currentRequest == nullptr) {
-        BusRequest *startRequest = m_nextRequests.peek();
-        if (startRequest != nullptr && m_nextRequests.remove(startRequest)) {
-          m_currentRequest = startRequest;  // force the failed request to be notified
-        }
+        m_currentRequest = takeStartedRequest();  // force the failed request to be notified
       }
       setState(m_state, RESULT_ERR_BUS_LOST);
       break;
@@ -683,8 +1282,8 @@ result_t BusHandler::handleSymbol() {
         logNotice(lf_bus, "arbitration won while handling another request");
         setState(bs_ready, RESULT_OK);  // force the current request to be notified
       } else {
-        BusRequest *startRequest = m_nextRequests.peek();
-        if (m_state != bs_ready || startRequest == nullptr || !m_nextRequests.remove(startRequest)) {
+        BusRequest *startRequest = m_state == bs_ready ? takeStartedRequest() : nullptr;
+        if (startRequest == nullptr) {
           logNotice(lf_bus, "arbitration won in invalid state %s", getStateCode(m_state));
           setState(bs_ready, RESULT_ERR_TIMEOUT);
         } else {
@@ -699,12 +1298,10 @@ result_t BusHandler::handleSymbol() {
       break;
     case as_error:
       logError(lf_bus, "arbitration start error");
+      traceArbitration("error");
       // cancel request
       if (!m_currentRequest) {
-        BusRequest *startRequest = m_nextRequests.peek();
-        if (startRequest && m_nextRequests.remove(startRequest)) {
-          m_currentRequest = startRequest;
-        }
+        m_currentRequest = takeStartedRequest();
       }
       if (m_currentRequest) {
         setState(m_state, RESULT_ERR_BUS_LOST);
@@ -719,6 +1316,7 @@ result_t BusHandler::handleSymbol() {
   time_t now;
   time(&now);
   if (result != RESULT_OK) {
+    m_lastSymbolTimeValid = false;
     if ((m_generateSynInterval != SYN_TIMEOUT && difftime(now, m_lastReceive) > 1)
       // at least one full second has passed since last received symbol
       || m_state == bs_noSignal) {
@@ -728,6 +1326,11 @@ result_t BusHandler::handleSymbol() {
   }
 
   m_lastReceive = now;
+  if (sending) {
+    m_lastSymbolTimeValid = false;
+  } else {
+    measureJitter(recvSymbol);
+  }
   if ((recvSymbol == SYN) && (m_state != bs_sendSyn)) {
     if (!sending && m_remainLockCount > 0 && m_command.size() != 1) {
       m_remainLockCount--;
@@ -735,6 +1338,11 @@ result_t BusHandler::handleSymbol() {
       m_remainLockCount = 1;  // wait for next AUTO-SYN after SYN / address / SYN (bus locked for own priority)
     }
     clockGettime(&m_lastSynReceiveTime);
+    if (m_state == bs_ready && !sending) {
+      m_idleSynCount++;  // nothing happened since the previous SYN
+    } else {
+      m_idleSynCount = 0;
+    }
     return setState(bs_ready, m_state == bs_skip ? RESULT_OK : RESULT_ERR_SYN);
   }
 
@@ -742,7 +1350,9 @@ result_t BusHandler::handleSymbol() {
     if (recvSymbol != sendSymbol) {
       return setState(bs_skip, RESULT_ERR_SYMBOL);
     }
-    measureLatency(&sentTime, &recvTime);
+    if (!preSent) {
+      measureLatency(&sentTime, &recvTime);
+    }
   }
 
   switch (m_state) {
@@ -787,12 +1397,14 @@ result_t BusHandler::handleSymbol() {
     if (m_currentRequest != nullptr && sending) {
       // check arbitration
       if (recvSymbol == sendSymbol) {  // arbitration successful
+        traceArbitration("won", &recvTime);
         // measure arbitration delay
         int64_t latencyLong = (sentTime.tv_sec*1000000000 + sentTime.tv_nsec
         - m_lastSynReceiveTime.tv_sec*1000000000 - m_lastSynReceiveTime.tv_nsec)/1000;
         if (latencyLong >= 0 && latencyLong <= 10000) {  // skip clock skew or out of reasonable range
           auto latency = static_cast<int>(latencyLong);
           logDebug(lf_bus, "arbitration delay %d micros", latency);
+          m_arbitrationDelayMetric->observe(static_cast<uint64_t>(latency));
           if (m_arbitrationDelayMin < 0 || (latency < m_arbitrationDelayMin || latency > m_arbitrationDelayMax)) {
             if (m_arbitrationDelayMin == -1 || latency < m_arbitrationDelayMin) {
               m_arbitrationDelayMin = latency;
@@ -808,6 +1420,7 @@ result_t BusHandler::handleSymbol() {
         return setState(bs_sendCmd, RESULT_OK);
       }
       // arbitration lost. if same priority class found, try again after next AUTO-SYN
+      traceArbitration("lost", &recvTime);
       m_remainLockCount = isMaster(recvSymbol) ? 2 : 1;  // number of SYN to wait for before next send try
       if ((recvSymbol & 0x0f) != (sendSymbol & 0x0f) && m_lockCount > m_remainLockCount) {
         // if different priority class found, try again after N AUTO-SYN symbols (at least next AUTO-SYN)
@@ -1043,20 +1656,51 @@ result_t BusHandler::handleSymbol() {
 }
 
 result_t BusHandler::setState(BusState state, result_t result, bool firstRepetition) {
+  if (result < RESULT_OK && state != m_state && (state == bs_ready || state == bs_skip || state == bs_sendSyn)) {
+    // aborted telegram
+    const MasterSymbolString& master = m_currentRequest ? m_currentRequest->m_master : m_command;
+    if (master.size() > 0 && (m_currentRequest == nullptr || m_state != bs_ready)) {
+      addRawTelegram(master, m_response, result);
+    }
+  }
   if (m_currentRequest != nullptr) {
     if (result == RESULT_ERR_BUS_LOST && m_currentRequest->m_busLostRetries < m_busLostRetries) {
       logDebug(lf_bus, "%s during %s, retry", getResultCode(result), getStateCode(m_state));
       m_currentRequest->m_busLostRetries++;
-      m_nextRequests.push(m_currentRequest);  // repeat
+      queueRequest(m_currentRequest);  // repeat
       m_currentRequest = nullptr;
     } else if (state == bs_sendSyn || (result != RESULT_OK && !firstRepetition)) {
       logDebug(lf_bus, "notify request: %s", getResultCode(result));
-      bool restart = m_currentRequest->notify(
-        result == RESULT_ERR_SYN && (m_state == bs_recvCmdAck || m_state == bs_recvRes)
-        ? RESULT_ERR_TIMEOUT : result, m_response);
+      result_t notifyResult = result == RESULT_ERR_SYN && (m_state == bs_recvCmdAck || m_state == bs_recvRes)
+        ? RESULT_ERR_TIMEOUT : result;
+      if (m_requestStartTime.tv_sec != 0) {
+        auto it = m_transactionMetrics.find(notifyResult);
+        if (it == m_transactionMetrics.end()) {
+          it = m_transactionMetrics.emplace(notifyResult, Metrics::getInstance()->getHistogram(
+              "ebusd_bus_transaction_seconds", "Time from starting the arbitration until the end of a request",
+              {10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000, 5000000},
+              (m_metricLabels.empty() ? "" : m_metricLabels + ",") + "result=\"" + getResultCode(notifyResult)
+              + "\"")).first;
+        }
+        it->second->observeSince(m_requestStartTime);
+        m_requestStartTime.tv_sec = 0;
+      }
+      traceRequest(m_currentRequest, notifyResult);
+      const MasterSymbolString& master = m_currentRequest->m_master;
+      if (master.size() > 1 && master[1] != BROADCAST && !isMaster(master[1])) {
+        // only a request without any answer at all says that the slave might be down
+        result_t availability = notifyResult;
+        if (m_state == bs_recvCmdAck || (m_state == bs_recvRes && m_response.size() == 0)) {
+          availability = notifyResult == RESULT_ERR_TIMEOUT ? RESULT_ERR_TIMEOUT : RESULT_OK;
+        } else if (m_state == bs_recvRes || m_state == bs_recvResCrc || m_state == bs_sendResAck) {
+          availability = RESULT_OK;
+        }
+        updateSlaveAvailability(master[1], availability);
+      }
+      bool restart = m_currentRequest->notify(notifyResult, m_response);
       if (restart) {
         m_currentRequest->m_busLostRetries = 0;
-        m_nextRequests.push(m_currentRequest);
+        queueRequest(m_currentRequest);
       } else if (m_currentRequest->m_deleteOnFinish) {
         delete m_currentRequest;
       } else {
@@ -1071,11 +1715,13 @@ result_t BusHandler::setState(BusState state, result_t result, bool firstRepetit
 
   if (state == bs_noSignal) {  // notify all requests
     m_response.clear();  // notify with empty response
+    m_startedRequest = nullptr;
     while ((m_currentRequest = m_nextRequests.pop()) != nullptr) {
+      traceRequest(m_currentRequest, RESULT_ERR_NO_SIGNAL);
       bool restart = m_currentRequest->notify(RESULT_ERR_NO_SIGNAL, m_response);
       if (restart) {  // should not occur with no signal
         m_currentRequest->m_busLostRetries = 0;
-        m_nextRequests.push(m_currentRequest);
+        queueRequest(m_currentRequest);
       } else if (m_currentRequest->m_deleteOnFinish) {
         delete m_currentRequest;
       } else {
@@ -1085,6 +1731,9 @@ result_t BusHandler::setState(BusState state, result_t result, bool firstRepetit
   }
 
   m_escape = 0;
+  if (state != bs_sendCmd && state != bs_sendCmdCrc && state != bs_sendRes && state != bs_sendResCrc) {
+    m_burstRemain = 0;
+  }
   if (state == m_state) {
     return result;
   }
@@ -1106,6 +1755,15 @@ result_t BusHandler::setState(BusState state, result_t result, bool firstRepetit
       logNotice(lf_bus, "signal acquired");
     }
   }
+  if (m_tracer->isEnabled()) {
+    struct timespec now;
+    clockGettime(&now);
+    if (m_stateStartTime.tv_sec != 0) {
+      m_tracer->complete(tl_state, getStateCode(m_state), m_stateStartTime, now,
+          result == RESULT_OK ? nullptr : getResultCode(result));
+    }
+    m_stateStartTime = now;
+  }
   m_state = state;
 
   if (state == bs_ready || state == bs_skip) {
@@ -1121,6 +1779,55 @@ result_t BusHandler::setState(BusState state, result_t result, bool firstRepetit
   return result;
 }
 
+void BusHandler::traceArbitration(const char* result, const struct timespec* time) {
+  if (!m_tracer->isEnabled() || m_requestStartTime.tv_sec == 0) {
+    return;
+  }
+  struct timespec now;
+  if (!time) {
+    clockGettime(&now);
+    time = &now;
+  }
+  m_tracer->complete(tl_arbitration, "arbitration", m_requestStartTime, *time, result);
+}
+
+void BusHandler::traceRequest(BusRequest* request, result_t result) {
+  if (!m_tracer->isEnabled()) {
+    return;
+  }
+  struct timespec now;
+  clockGettime(&now);
+  auto id = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(request));
+  string master = request->m_master.getStr();
+  m_tracer->async(tl_request, "request", id, true, request->m_traceStartTime, nullptr, master.c_str());
+  m_tracer->async(tl_request, "request", id, false, now, getResultCode(result));
+  request->m_traceStartTime = now;
+}
+
+result_t BusHandler::sendBurst() {
+  const SymbolString& str = m_state == bs_sendCmd ? static_cast<const SymbolString&>(m_currentRequest->m_master)
+    : static_cast<const SymbolString&>(m_response);
+  symbol_t buf[BURST_CHUNK_LEN];
+  size_t len = 0;
+  for (size_t pos = m_nextSendPos; pos <= str.size(); pos++) {
+    symbol_t value = pos < str.size() ? str[pos] : str.calcCrc();
+    bool escape = value == ESC || value == SYN;
+    if (len + (escape ? 2 : 1) > BURST_CHUNK_LEN) {
+      break;  // next chunk is sent after checking the echo of this one
+    }
+    if (escape) {
+      buf[len++] = ESC;
+      value = value == ESC ? 0x00 : 0x01;
+    }
+    buf[len++] = value;
+  }
+  result_t result = m_device->sendBurst(buf, len);
+  if (result == RESULT_OK) {
+    m_burstRemain = len-1;  // the first one is handled right now
+  }
+  return result;
+}
+
 void BusHandler::measureLatency(struct timespec* sentTime, struct timespec* recvTime) {
   int64_t latencyLong = (recvTime->tv_sec*1000000000 + recvTime->tv_nsec
       - sentTime->tv_sec*1000000000 - sentTime->tv_nsec)/1000000;
@@ -1129,6 +1836,8 @@ void BusHandler::measureLatency(struct timespec* sentTime, struct timespec* recv
   }
   auto latency = static_cast<int>(latencyLong);
   logDebug(lf_bus, "send/receive symbol latency %d ms", latency);
+  m_symbolLatencyMetric->observe(static_cast<uint64_t>((recvTime->tv_sec*1000000000 + recvTime->tv_nsec
+      - sentTime->tv_sec*1000000000 - sentTime->tv_nsec)/1000));
   if (m_symbolLatencyMin >= 0 && (latency >= m_symbolLatencyMin && latency <= m_symbolLatencyMax)) {
     return;
   }
@@ -1141,6 +1850,29 @@ void BusHandler::measureLatency(struct timespec* sentTime, struct timespec* recv
   logInfo(lf_bus, "send/receive symbol latency %d - %d ms", m_symbolLatencyMin, m_symbolLatencyMax);
 }
 
+void BusHandler::measureJitter(symbol_t recvSymbol) {
+  struct timespec recvTime;
+  clockGettime(&recvTime);
+  if (m_lastSymbolTimeValid && (m_state == bs_recvCmd || m_state == bs_recvCmdCrc)) {
+    int64_t jitter = (recvTime.tv_sec*1000000000 + recvTime.tv_nsec
+        - m_lastSymbolTime.tv_sec*1000000000 - m_lastSymbolTime.tv_nsec)/1000 - NOMINAL_SYMBOL_MICROS;
+    if (jitter < 0) {
+      jitter = 0;  // read from the device buffer together with the previous one
+    }
+    if (jitter <= 1000000) {  // otherwise out of reasonable range
+      m_symbolJitterMetric->observe(static_cast<uint64_t>(jitter));
+      m_symbolJitterSum += static_cast<uint64_t>(jitter);
+      m_symbolJitterCount++;
+      if (jitter > m_symbolJitterMax) {
+        m_symbolJitterMax = static_cast<int>(jitter);
+        logInfo(lf_bus, "max. symbol jitter %d us", m_symbolJitterMax);
+      }
+    }
+  }
+  m_lastSymbolTime = recvTime;
+  m_lastSymbolTimeValid = recvSymbol != SYN;
+}
+
 bool BusHandler::addSeenAddress(symbol_t address) {
   if (!isValidAddress(address, false)) {
     return false;
@@ -1154,6 +1886,9 @@ bool BusHandler::addSeenAddress(symbol_t address) {
       }
     }
     m_seenAddresses[address] |= SEEN;
+    if (m_primary) {
+      m_primary->m_seenAddresses[address] |= SEEN;  // for scanning from the primary bus
+    }
     address = getMasterAddress(address);
     if (address == SYN) {
       return m_addressConflict && !hadConflict;
@@ -1173,6 +1908,9 @@ bool BusHandler::addSeenAddress(symbol_t address) {
       logNotice(lf_bus, "new master %2.2x, master count %d", address, m_masterCount);
     }
     m_seenAddresses[address] |= SEEN;
+    if (m_primary) {
+      m_primary->m_seenAddresses[address] |= SEEN;
+    }
   }
   return m_addressConflict && !hadConflict;
 }
@@ -1190,8 +1928,12 @@ void BusHandler::messageCompleted() {
   if (!m_currentAnswering) {
     addSeenAddress(dstAddress);
   }
+  addRawTelegram(command, response, RESULT_OK);
 
   bool master = isMaster(dstAddress);
+  if (!m_currentRequest && !master && dstAddress != BROADCAST) {
+    updateSlaveAvailability(dstAddress, RESULT_OK);  // answered to another master, so it is not down
+  }
   if (dstAddress == BROADCAST) {
     logInfo(lf_update, "%s BC cmd: %s", prefix, command.getStr().c_str());
     if (command.getDataSize() >= 10 && command[2] == 0x07 && command[3] == 0x04) {
@@ -1243,7 +1985,11 @@ void BusHandler::messageCompleted() {
       }
     }
   }
+  struct timespec findStart;
+  clockGettime(&findStart);
   Message* message = m_messages->find(command);
+  m_findMetric->observeSince(findStart);
+  m_telegramMetric->add();
   if (m_grabMessages) {
     uint64_t key;
     if (message) {
@@ -1251,9 +1997,10 @@ void BusHandler::messageCompleted() {
     } else {
       key = Message::createKey(command, command[1] == BROADCAST ? 1 : 4);  // up to 4 DD bytes (1 for broadcast)
     }
-    m_grabbedMessages[key].setLastData(command, response);
+    m_grabbedMessages.add(key, command, response);
   }
   if (message == nullptr) {
+    m_unknownTelegramMetric->add();
     if (dstAddress == BROADCAST) {
       logNotice(lf_update, "%s unknown BC cmd: %s", prefix, command.getStr().c_str());
     } else if (master) {
@@ -1262,6 +2009,13 @@ void BusHandler::messageCompleted() {
       logNotice(lf_update, "%s unknown MS cmd: %s / %s", prefix, command.getStr().c_str(),
         response.getStr().c_str());
     }
+  } else if (!m_currentRequest && message->isLastData(command, response)) {
+    // repeated passive telegram: only update the last update time and skip invalidating, decoding, and notifying
+    message->storeLastData(command, response);
+    message->setPassiveUpdate(message->getLastUpdateTime());
+    notifyUnchanged(message);
+    m_unchangedTelegramMetric->add();
+    logInfo(lf_update, "%s unchanged %s %s", prefix, message->getCircuit().c_str(), message->getName().c_str());
   } else {
     m_messages->invalidateCache(message);
     string circuit = message->getCircuit();
@@ -1270,11 +2024,23 @@ void BusHandler::messageCompleted() {
       : message->isPassive() ? message->isWrite() ? "update-write" : "update-read"
       : message->getPollPriority() > 0 ? message->isWrite() ? "poll-write" : "poll-read"
       : message->isWrite() ? "write" : "read";
+    struct timespec decodeStart;
+    clockGettime(&decodeStart);
     result_t result = message->storeLastData(command, response);
     ostringstream output;
     if (result == RESULT_OK) {
+      m_decodedTelegramMetric->add();
+      if (!m_currentRequest) {
+        message->setPassiveUpdate(message->getLastUpdateTime());
+      }
+      notifyStored(message);
+      if (!NEEDS_LOG(lf_update, ll_error)) {
+        m_decodeMetric->observeSince(decodeStart);
+        return;  // decoding is only needed for the log
+      }
       result = message->decodeLastData(false, nullptr, -1, OF_NONE, &output);
     }
+    m_decodeMetric->observeSince(decodeStart);
     if (result < RESULT_OK) {
       logError(lf_update, "unable to parse %s %s %s from %s / %s: %s", mode, circuit.c_str(), name.c_str(),
           command.getStr().c_str(), response.getStr().c_str(), getResultCode(result));
@@ -1301,6 +2067,55 @@ void BusHandler::messageCompleted() {
   }
 }
 
+void BusHandler::addStoreListener(StoreListener* listener) {
+  m_storeListenersMutex.lock();
+  m_storeListeners.push_back(listener);
+  m_storeListenersMutex.unlock();
+}
+
+void BusHandler::removeStoreListener(StoreListener* listener) {
+  m_storeListenersMutex.lock();
+  m_storeListeners.erase(std::remove(m_storeListeners.begin(), m_storeListeners.end(), listener),
+      m_storeListeners.end());
+  m_storeListenersMutex.unlock();
+}
+
+void BusHandler::notifyStored(const Message* message) {
+  if (m_primary) {
+    m_primary->notifyStored(message);
+    return;
+  }
+  m_storeListenersMutex.lock();
+  for (const auto listener : m_storeListeners) {
+    listener->notifyStored(message);
+  }
+  m_storeListenersMutex.unlock();
+}
+
+void BusHandler::notifyUnchanged(const Message* message) {
+  if (m_primary) {
+    m_primary->notifyUnchanged(message);
+    return;
+  }
+  m_storeListenersMutex.lock();
+  for (const auto listener : m_storeListeners) {
+    listener->notifyUnchanged(message);
+  }
+  m_storeListenersMutex.unlock();
+}
+
+void BusHandler::addRawTelegram(const MasterSymbolString& master, const SlaveSymbolString& slave,
+    result_t result) {
+  BroadcastRing<rawTelegram_t>* ring = getRawTelegrams();
+  rawTelegram_t* telegram = ring->beginWrite();
+  clockGettime(&telegram->time);
+  telegram->master = master;
+  telegram->slave = slave;
+  telegram->result = result;
+  telegram->sent = m_currentRequest != nullptr;
+  ring->endWrite();
+}
+
 result_t BusHandler::prepareScan(symbol_t slave, bool full, const string& levels, bool* reload,
     ScanRequest** request) {
   Message* scanMessage = m_messages->getScanMessage();
@@ -1377,7 +2192,7 @@ result_t BusHandler::startScan(bool full, const string& levels) {
   }
   m_scanResults.clear();
   m_runningScans++;
-  m_nextRequests.push(request);
+  queueRequest(request);
   return RESULT_OK;
 }
 
@@ -1448,7 +2263,16 @@ void BusHandler::formatSeenInfo(ostringstream* output) const {
   symbol_t address = 0;
   for (int index = 0; index < 256; index++, address++) {
     bool ownAddress = !m_device->isReadOnly() && (address == m_ownMasterAddress || address == m_ownSlaveAddress);
-    if (!isValidAddress(address, false) || ((m_seenAddresses[address]&SEEN) == 0 && !ownAddress)) {
+    unsigned int downFailures = 0;
+    if (!ownAddress) {
+      m_slaveAvailabilityMutex.lock();
+      const auto it = m_slaveAvailability.find(address);
+      if (it != m_slaveAvailability.end() && it->second.backoff > 0) {
+        downFailures = it->second.failures;
+      }
+      m_slaveAvailabilityMutex.unlock();
+    }
+    if (!isValidAddress(address, false) || ((m_seenAddresses[address]&SEEN) == 0 && !ownAddress && downFailures == 0)) {
       continue;
     }
     *output << endl << "address " << setfill('0') << setw(2) << hex << static_cast<unsigned>(address);
@@ -1471,6 +2295,8 @@ void BusHandler::formatSeenInfo(ostringstream* output) const {
       if (m_addressConflict && (m_seenAddresses[address]&SEEN) != 0) {
         *output << ", conflict";
       }
+    } else if (downFailures > 0) {
+      *output << ", down (" << dec << downFailures << " unanswered)";
     }
     if ((m_seenAddresses[address]&SCAN_DONE) != 0) {
       *output << ", scanned";
@@ -1523,15 +2349,19 @@ void BusHandler::formatUpdateInfo(ostringstream* output) const {
     size_t unknownCnt = 0;
     *output << ",\"gm\":[";
     bool first = true;
-    for (auto it : m_grabbedMessages) {
-      if (it.second.dump(false, m_messages, first, OF_JSON|OF_SHORT, output)) {
+    vector<const GrabbedMessage*> grabbed;
+    m_grabbedMessages.lock();
+    m_grabbedMessages.findAll(0, 0, &grabbed);
+    for (const auto grabbedMessage : grabbed) {
+      if (grabbedMessage->dump(false, m_messages, first, OF_JSON|OF_SHORT, output)) {
         first = false;
       }
-      Message* message = m_messages->find(it.second.getLastMasterData());
+      Message* message = m_messages->find(grabbedMessage->getLastMasterData());
       if (!message) {
         unknownCnt++;
       }
     }
+    m_grabbedMessages.unlock();
     *output << "],\"gu\":" << unknownCnt;
   }
   if (!m_messages->getPreferLanguage().empty()) {
@@ -1626,8 +2456,9 @@ result_t BusHandler::scanAndWait(symbol_t dstAddress, bool loadScanConfig, bool
       m_scanResults[dstAddress].resize(1);
     }
     m_runningScans++;
-    m_nextRequests.push(request);
-    requestExecuted = m_finishedRequests.remove(request, true);
+    BusHandler* bus = getBusFor(dstAddress);
+    bus->queueRequest(request);
+    requestExecuted = bus->m_finishedRequests.remove(request, true);
     result = requestExecuted ? request->m_result : RESULT_ERR_TIMEOUT;
     delete request;
     request = nullptr;
@@ -1636,7 +2467,22 @@ result_t BusHandler::scanAndWait(symbol_t dstAddress, bool loadScanConfig, bool
     string file;
     bool timedOut = result == RESULT_ERR_TIMEOUT;
     bool loadFailed = false;
-    if (timedOut || result == RESULT_OK) {
+    if ((timedOut || result == RESULT_OK) && m_scanHelper->hasScanConfigLoader()) {
+      if (m_queuedScanConfigs.find(dstAddress) != m_queuedScanConfigs.end()) {
+        return result;  // already being loaded
+      }
+      // resolve, retrieve and read the file in the background, merged in finishScanConfigFiles()
+      result_t queued = m_scanHelper->queueScanConfigFile(dstAddress);  // even if one message timed out
+      if (queued == RESULT_OK) {
+        m_queuedScanConfigs[dstAddress] = hasAdditionalScanMessages;
+        setScanConfigLoaded(dstAddress, "");  // load initiated
+        return result;
+      }
+      loadFailed = true;
+      if (!timedOut) {
+        result = queued;
+      }
+    } else if (timedOut || result == RESULT_OK) {
       result = m_scanHelper->loadScanConfigFile(dstAddress, &file);  // try to load even if one message timed out
       loadFailed = result != RESULT_OK;
       if (timedOut && loadFailed) {
@@ -1669,7 +2515,7 @@ bool BusHandler::enableGrab(bool enable) {
 }
 
 void BusHandler::formatGrabResult(bool unknown, OutputFormat outputFormat, ostringstream* output, bool isDirectMode,
-    time_t since, time_t until) const {
+    time_t since, time_t until, ResultStreamer* streamer) const {
   if (!m_grabMessages) {
     if (!isDirectMode && !(outputFormat & OF_JSON)) {
       *output << "grab disabled";
@@ -1677,13 +2523,21 @@ void BusHandler::formatGrabResult(bool unknown, OutputFormat outputFormat, ostri
     return;
   }
   bool first = true;
-  for (const auto& it : m_grabbedMessages) {
-    if ((since > 0 && it.second.getLastTime() < since)
-    || (until > 0 && it.second.getLastTime() >= until)) {
-      continue;
-    }
-    if (it.second.dump(unknown, m_messages, first, outputFormat, output, isDirectMode)) {
+  vector<const GrabbedMessage*> grabbed;
+  vector<GrabbedMessage> copies;  // formatted and passed to the client without blocking the bus thread
+  m_grabbedMessages.lock();
+  m_grabbedMessages.findAll(since, until, &grabbed);
+  copies.reserve(grabbed.size());
+  for (const auto grabbedMessage : grabbed) {
+    copies.push_back(*grabbedMessage);
+  }
+  m_grabbedMessages.unlock();
+  for (const auto& grabbedMessage : copies) {
+    if (grabbedMessage.dump(unknown, m_messages, first, outputFormat, output, isDirectMode)) {
       first = false;
+      if (streamer) {
+        streamer->flush(output);
+      }
     }
   }
   if (isDirectMode && !first) {
@@ -1691,6 +2545,76 @@ void BusHandler::formatGrabResult(bool unknown, OutputFormat outputFormat, ostri
   }
 }
 
+void BusHandler::formatGrabInfo(ostringstream* output) const {
+  if (!m_grabMessages) {
+    *output << "grab: disabled";
+    return;
+  }
+  m_grabbedMessages.lock();
+  *output << "grab: " << m_grabbedMessages.size() << " of " << m_grabbedMessages.getCapacity() << " messages, "
+          << m_grabbedMessages.getTelegramCount() << " telegrams, " << m_grabbedMessages.getEvictedCount()
+          << " dropped";
+  m_grabbedMessages.unlock();
+}
+
+void BusHandler::formatState(ostream* output) const {
+  for (unsigned int address = 0; address < 256; address++) {
+    symbol_t state = m_seenAddresses[address] & (SEEN|SCAN_INIT|SCAN_DONE);
+    if (state == 0) {
+      continue;
+    }
+    *output << "a," << hex << setw(2) << setfill('0') << address << "," << static_cast<unsigned>(state) << dec
+            << "\n";
+    const auto it = m_scanResults.find(static_cast<symbol_t>(address));
+    if (it == m_scanResults.end()) {
+      continue;
+    }
+    for (size_t index = 0; index < it->second.size(); index++) {
+      if (!it->second[index].empty()) {
+        *output << "s," << hex << setw(2) << setfill('0') << address << "," << dec << index << ","
+                << it->second[index] << "\n";
+      }
+    }
+  }
+}
+
+bool BusHandler::restoreState(const string& line) {
+  // a,XX,STATE or s,XX,INDEX,RESULT
+  if (line.length() < 6 || line[1] != ',' || line[4] != ',' || (line[0] != 'a' && line[0] != 's')) {
+    return false;
+  }
+  result_t result;
+  symbol_t address = (symbol_t)parseInt(line.substr(2, 2).c_str(), 16, 0, 0xff, &result);
+  if (result != RESULT_OK || !isValidAddress(address, false)) {
+    return false;
+  }
+  if (line[0] == 'a') {
+    symbol_t state = (symbol_t)parseInt(line.substr(5).c_str(), 16, 0, 0xff, &result);
+    if (result != RESULT_OK) {
+      return false;
+    }
+    if ((state & SEEN) != 0 && address != m_ownMasterAddress && address != m_ownSlaveAddress) {
+      addSeenAddress(address);
+    }
+    m_seenAddresses[address] |= state & (SCAN_INIT|SCAN_DONE);
+    return true;
+  }
+  size_t pos = line.find(',', 5);
+  if (pos == string::npos || isMaster(address)) {
+    return false;
+  }
+  size_t index = parseInt(line.substr(5, pos - 5).c_str(), 10, 0, 0xff, &result);
+  if (result != RESULT_OK) {
+    return false;
+  }
+  vector<string>& scanResult = m_scanResults[address];
+  if (index >= scanResult.size()) {
+    scanResult.resize(index + 1);
+  }
+  scanResult[index] = line.substr(pos + 1);
+  return true;
+}
+
 symbol_t BusHandler::getNextScanAddress(symbol_t lastAddress, bool withUnfinished) const {
   if (lastAddress == SYN) {
     return SYN;
@@ -1715,6 +2639,30 @@ symbol_t BusHandler::getNextScanAddress(symbol_t lastAddress, bool withUnfinishe
   return SYN;
 }
 
+void BusHandler::finishScanConfigFiles() {
+  symbol_t address;
+  string file;
+  result_t result;
+  while (m_scanHelper->takeScanConfigFile(&address, &file, &result)) {
+    const auto it = m_queuedScanConfigs.find(address);
+    bool hadAdditionalScanMessages = it == m_queuedScanConfigs.end() || it->second;
+    if (it != m_queuedScanConfigs.end()) {
+      m_queuedScanConfigs.erase(it);
+    }
+    if (result != RESULT_OK) {
+      logError(lf_main, "scan config %2.2x: %s", address, getResultCode(result));
+      continue;
+    }
+    m_scanHelper->executeInstructions(this);
+    setScanConfigLoaded(address, file);
+    if (!hadAdditionalScanMessages && m_messages->hasAdditionalScanMessages()) {
+      // additional scan messages now available
+      scanAndWait(address, false, false);
+    }
+    file.clear();
+  }
+}
+
 void BusHandler::setScanConfigLoaded(symbol_t address, const string& file) {
   m_seenAddresses[address] |= LOAD_INIT;
   if (!file.empty()) {
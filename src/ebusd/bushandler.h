@@ -21,10 +21,15 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <deque>
+#include <list>
+#include <unordered_map>
+#include <utility>
 #include "ebusd/scan.h"
 #include "lib/ebus/message.h"
 #include "lib/ebus/data.h"
@@ -33,6 +38,9 @@
 #include "lib/ebus/device.h"
 #include "lib/utils/queue.h"
 #include "lib/utils/thread.h"
+#include "lib/utils/metrics.h"
+#include "lib/utils/trace.h"
+#include "lib/utils/clock.h"
 
 namespace ebusd {
 
@@ -45,6 +53,10 @@ namespace ebusd {
  */
 
 using std::string;
+using std::list;
+using std::pair;
+using std::unordered_map;
+using std::set;
 
 /** the default time [ms] for retrieving a symbol from an addressed slave. */
 #define SLAVE_RECV_TIMEOUT 15
@@ -55,6 +67,31 @@ using std::string;
 /** the time [ms] for determining bus signal availability (AUTO-SYN timeout * 5). */
 #define SIGNAL_TIMEOUT 250
 
+/** the number of consecutive empty AUTO-SYN slots (roughly one second) after which a due poll may fill the gap. */
+#define POLL_IDLE_SYN_COUNT 20
+
+/** the time [ms] for which the result of a completed master-slave request is reused for an identical request. */
+#define REQUEST_REUSE_TIME 250
+
+/** the number of consecutive unanswered requests after which a slave is considered down. */
+#define SLAVE_DOWN_FAILURES 3
+
+/** the initial time [s] until a slave considered down is probed again (doubled with each unanswered probe). */
+#define SLAVE_DOWN_BACKOFF_MIN 10
+
+/** the maximum time [s] between two probes of a slave considered down. */
+#define SLAVE_DOWN_BACKOFF_MAX 640
+
+/** the maximum number of due poll messages to slaves considered down that are skipped for a single poll. */
+#define POLL_DOWN_SKIP_COUNT 8
+
+/** the time [ms] after which a queued request is treated like one of the next more urgent @a RequestPriority. */
+#define REQUEST_PRIORITY_AGING 1000
+
+/** the maximum number of escaped symbols handed to the device at once in burst mode (limits the symbols still
+ * sent after an echo mismatch as the next chunk is only sent once all echoes of the previous one were checked). */
+#define BURST_CHUNK_LEN 8
+
 /** the maximum duration [us] of a single symbol (Start+8Bit+Stop+Extra @ 2400Bd-2*1,2%). */
 #define SYMBOL_DURATION_MICROS 4700
 
@@ -84,6 +121,15 @@ enum BusState {
   bs_sendSyn,     //!< send SYN for completed transfer [active set+get]
 };
 
+/** the priority classes of @a BusRequest instances (most urgent first). */
+enum RequestPriority {
+  rp_interactiveWrite,  //!< write requested by a client
+  rp_interactiveRead,   //!< read requested by a client
+  rp_instruction,       //!< read for resolving conditions or executing instructions
+  rp_poll,              //!< poll or background refresh
+  rp_scan,              //!< scan
+};
+
 /** bit for the seen state: seen. */
 #define SEEN 0x01
 
@@ -99,7 +145,20 @@ enum BusState {
 /** bit for the seen state: configuration loaded. */
 #define LOAD_DONE 0x10
 
+/** the number of telegrams kept in the raw telegram ring. */
+#define RAW_TELEGRAM_RING_SIZE 1024
+
+/** a completed or aborted telegram seen on the bus as kept in the raw telegram ring. */
+typedef struct rawTelegram {
+  struct timespec time;  //!< the time the telegram ended
+  MasterSymbolString master;  //!< the master part (incomplete for an aborted telegram)
+  SlaveSymbolString slave;  //!< the slave part (empty for broadcast, master-master, or aborted telegrams)
+  result_t result;  //!< @a RESULT_OK for a completed telegram, or the error that aborted it
+  bool sent;  //!< whether the completed telegram was sent by ebusd
+} rawTelegram_t;
+
 class BusHandler;
+class ResultStreamer;
 
 /**
  * Generic request for sending to and receiving from the bus.
@@ -112,10 +171,13 @@ class BusRequest {
    * Constructor.
    * @param master the master data @a MasterSymbolString to send.
    * @param deleteOnFinish whether to automatically delete this @a BusRequest when finished.
+   * @param priority the @a RequestPriority.
    */
-  BusRequest(const MasterSymbolString& master, bool deleteOnFinish)
+  BusRequest(const MasterSymbolString& master, bool deleteOnFinish, RequestPriority priority)
     : m_master(master), m_busLostRetries(0),
-      m_deleteOnFinish(deleteOnFinish) {}
+      m_deleteOnFinish(deleteOnFinish), m_priority(priority) {
+    clockGettime(&m_traceStartTime);
+  }
 
   /**
    * Destructor.
@@ -140,6 +202,12 @@ class BusRequest {
 
   /** whether to automatically delete this @a BusRequest when finished. */
   const bool m_deleteOnFinish;
+
+  /** the @a RequestPriority. */
+  const RequestPriority m_priority;
+
+  /** the time of creation or of the last notification for tracing the lifecycle. */
+  struct timespec m_traceStartTime;
 };
 
 
@@ -153,9 +221,12 @@ class PollRequest : public BusRequest {
   /**
    * Constructor.
    * @param message the associated @a Message.
+   * @param busHandler the @a BusHandler instance to notify when finished a background refresh, or nullptr for a poll.
    */
-  explicit PollRequest(Message* message)
-    : BusRequest(m_master, true), m_message(message), m_index(0) {}
+  explicit PollRequest(Message* message, BusHandler* busHandler = nullptr)
+    : BusRequest(m_master, true, rp_poll), m_message(message), m_busHandler(busHandler),
+      m_key(message->getKey()), m_circuit(busHandler ? message->getCircuit() : ""),
+      m_name(busHandler ? message->getName() : ""), m_index(0), m_startMillis(0), m_lastChangeVersion(0) {}
 
   /**
    * Destructor.
@@ -180,8 +251,26 @@ class PollRequest : public BusRequest {
   /** the associated @a Message. */
   Message* m_message;
 
+  /** the @a BusHandler instance to notify when finished a background refresh, or nullptr for a poll. */
+  BusHandler* m_busHandler;
+
+  /** the key of @a m_message when created. */
+  const uint64_t m_key;
+
+  /** the circuit name for looking up @a m_message again (background refresh only). */
+  const string m_circuit;
+
+  /** the message name for looking up @a m_message again (background refresh only). */
+  const string m_name;
+
   /** the current part index in @a m_message. */
   size_t m_index;
+
+  /** the system time in milliseconds when the first part was prepared. */
+  uint64_t m_startMillis;
+
+  /** the change version of @a m_message when the first part was prepared. */
+  unsigned int m_lastChangeVersion;
 };
 
 
@@ -203,7 +292,7 @@ class ScanRequest : public BusRequest {
    */
   ScanRequest(bool deleteOnFinish, MessageMap* messageMap, const deque<Message*>& messages,
       const deque<symbol_t>& slaves, BusHandler* busHandler, size_t notifyIndex = 0)
-    : BusRequest(m_master, deleteOnFinish), m_messageMap(messageMap), m_index(0), m_allMessages(messages),
+    : BusRequest(m_master, deleteOnFinish, rp_scan), m_messageMap(messageMap), m_index(0), m_allMessages(messages),
       m_messages(messages), m_slaves(slaves), m_busHandler(busHandler), m_notifyIndex(notifyIndex),
       m_result(RESULT_ERR_NO_SIGNAL) {
     m_message = m_messages.front();
@@ -270,9 +359,11 @@ class ActiveBusRequest : public BusRequest {
    * Constructor.
    * @param master the master data @a MasterSymbolString to send.
    * @param slave reference to @a SlaveSymbolString for filling in the received slave data.
+   * @param priority the @a RequestPriority.
    */
-  ActiveBusRequest(const MasterSymbolString& master, SlaveSymbolString* slave)
-    : BusRequest(master, false), m_result(RESULT_ERR_NO_SIGNAL), m_slave(slave) {}
+  ActiveBusRequest(const MasterSymbolString& master, SlaveSymbolString* slave,
+      RequestPriority priority = rp_interactiveRead)
+    : BusRequest(master, false, priority), m_result(RESULT_ERR_NO_SIGNAL), m_slave(slave), m_coalesced(false) {}
 
   /**
    * Destructor.
@@ -289,9 +380,26 @@ class ActiveBusRequest : public BusRequest {
 
   /** reference to @a SlaveSymbolString for filling in the received slave data. */
   SlaveSymbolString* m_slave;
+
+  /** the identical @a ActiveBusRequest instances waiting for the result of this one instead of being sent. */
+  vector<ActiveBusRequest*> m_joined;
+
+  /** the hex master data prefix identifying the written message for coalescing, or empty. */
+  string m_coalesceKey;
+
+  /** whether the request was superseded by a newer one and only waits for its result. */
+  bool m_coalesced;
 };
 
 
+/** a single grabbed telegram. */
+typedef struct grabbedTelegram {
+  time_t time;  //!< the receive time
+  MasterSymbolString master;  //!< the master data
+  SlaveSymbolString slave;  //!< the slave data
+} grabbedTelegram_t;
+
+
 /**
  * Helper class for keeping track of grabbed messages.
  */
@@ -299,17 +407,10 @@ class GrabbedMessage {
  public:
   /**
    * Construct a new instance.
+   * @param historySize the number of last received telegrams to keep (at least 1).
    */
-  GrabbedMessage() : m_lastTime(0), m_count(0) {}
-
-  /**
-   * Copy constructor.
-   * @param other the @a GrabbedMessage to copy from.
-   */
-  GrabbedMessage(const GrabbedMessage& other) : m_count(other.m_count) {
-    m_lastMaster = other.m_lastMaster;
-    m_lastSlave = other.m_lastSlave;
-  }
+  explicit GrabbedMessage(size_t historySize = 1)
+    : m_telegrams(historySize < 1 ? 1 : historySize), m_next(0), m_size(0), m_count(0) {}
 
   /**
    * Set the last received data.
@@ -322,13 +423,13 @@ class GrabbedMessage {
    * Get the last received time.
    * @return the last received time.
    */
-  time_t getLastTime() const { return m_lastTime; }
+  time_t getLastTime() const { return m_size == 0 ? 0 : getTelegram(0).time; }
 
   /**
    * Get the last @a MasterSymbolString.
    * @return the last @a MasterSymbolString.
    */
-  MasterSymbolString& getLastMasterData() { return m_lastMaster; }
+  const MasterSymbolString& getLastMasterData() const { return getTelegram(0).master; }
 
   /**
    * Dump the last received data and message count to the output.
@@ -343,22 +444,162 @@ class GrabbedMessage {
   bool dump(bool unknown, MessageMap* messages, bool first, OutputFormat outputFormat, ostringstream* output,
       bool isDirectMode = false) const;
 
+  /**
+   * @return the number of bytes allocated by this instance including the kept telegrams.
+   */
+  size_t getMemoryUsage() const;
+
 
  private:
-  /** the last received time. */
-  time_t m_lastTime;
+  /**
+   * Get a kept telegram.
+   * @param age the age of the telegram (0 for the last received one, up to @a m_size-1).
+   * @return the @a grabbedTelegram_t.
+   */
+  const grabbedTelegram_t& getTelegram(size_t age) const {
+    return m_telegrams[(m_next + m_telegrams.size() - 1 - age) % m_telegrams.size()];
+  }
+
+  /** the ring of last received telegrams. */
+  vector<grabbedTelegram_t> m_telegrams;
 
-  /** the last @a MasterSymbolString. */
-  MasterSymbolString m_lastMaster;
+  /** the position in @a m_telegrams to store the next received telegram at. */
+  size_t m_next;
 
-  /** the last @a SlaveSymbolString. */
-  SlaveSymbolString m_lastSlave;
+  /** the number of valid telegrams in @a m_telegrams. */
+  size_t m_size;
 
   /** the number of times this message was seen. */
   unsigned int m_count;
 };
 
 
+/**
+ * A map of @a GrabbedMessage instances by key with limited capacity dropping the least recently seen one when full.
+ */
+class GrabbedMessageMap {
+ public:
+  /**
+   * Construct a new instance.
+   * @param capacity the maximum number of @a GrabbedMessage instances to keep.
+   * @param historySize the number of last received telegrams to keep per @a GrabbedMessage.
+   */
+  GrabbedMessageMap(size_t capacity, size_t historySize)
+    : m_capacity(capacity < 1 ? 1 : capacity), m_historySize(historySize), m_telegramCount(0), m_evictedCount(0) {
+    m_index.reserve(m_capacity);
+  }
+
+  /**
+   * Add a received telegram.
+   * @param key the key of the message.
+   * @param master the received @a MasterSymbolString.
+   * @param slave the received @a SlaveSymbolString.
+   */
+  void add(uint64_t key, const MasterSymbolString& master, const SlaveSymbolString& slave);
+
+  /**
+   * Remove all @a GrabbedMessage instances.
+   */
+  void clear();
+
+  /**
+   * Collect the @a GrabbedMessage instances last received within a time range.
+   * Note: the caller has to hold the lock while using the collected instances.
+   * @param since the start time from which to add received messages (inclusive), or 0 for all.
+   * @param until the end time to which to add received messages (exclusive), or 0 for all.
+   * @param messages the vector to add the @a GrabbedMessage instances to (ordered by key).
+   */
+  void findAll(time_t since, time_t until, vector<const GrabbedMessage*>* messages) const;
+
+  /**
+   * Lock access to this instance.
+   */
+  void lock() const { m_mutex.lock(); }
+
+  /**
+   * Unlock access to this instance.
+   */
+  void unlock() const { m_mutex.unlock(); }
+
+  /**
+   * Get the number of @a GrabbedMessage instances.
+   * @return the number of @a GrabbedMessage instances.
+   */
+  size_t size() const { return m_index.size(); }
+
+  /**
+   * Get the maximum number of @a GrabbedMessage instances.
+   * @return the maximum number of @a GrabbedMessage instances.
+   */
+  size_t getCapacity() const { return m_capacity; }
+
+  /**
+   * Get the number of telegrams added since the last clear.
+   * @return the number of telegrams added since the last clear.
+   */
+  size_t getTelegramCount() const { return m_telegramCount; }
+
+  /**
+   * Get the number of @a GrabbedMessage instances dropped due to the capacity since the last clear.
+   * @return the number of dropped @a GrabbedMessage instances.
+   */
+  size_t getEvictedCount() const { return m_evictedCount; }
+
+  /**
+   * @return the number of bytes allocated by the @a GrabbedMessage instances and the index.
+   */
+  size_t getMemoryUsage() const;
+
+
+ private:
+  /** the maximum number of @a GrabbedMessage instances. */
+  const size_t m_capacity;
+
+  /** the number of last received telegrams to keep per @a GrabbedMessage. */
+  const size_t m_historySize;
+
+  /** the @a GrabbedMessage instances by key, ordered by time of last receipt (most recent first). */
+  list<pair<uint64_t, GrabbedMessage>> m_messages;
+
+  /** the entries in @a m_messages by key. */
+  unordered_map<uint64_t, list<pair<uint64_t, GrabbedMessage>>::iterator> m_index;
+
+  /** the number of telegrams added since the last clear. */
+  size_t m_telegramCount;
+
+  /** the number of @a GrabbedMessage instances dropped due to the capacity since the last clear. */
+  size_t m_evictedCount;
+
+  /** the @a Mutex for access to the instance. */
+  mutable Mutex m_mutex;
+};
+
+
+/**
+ * Interface for getting notified directly by the bus handling thread about newly stored @a Message data.
+ */
+class StoreListener {
+ public:
+  /**
+   * Destructor.
+   */
+  virtual ~StoreListener() {}
+
+  /**
+   * Called by the bus handling thread after the data of a @a Message was stored. Should return quickly.
+   * @param message the @a Message with the newly stored data.
+   */
+  virtual void notifyStored(const Message* message) = 0;
+
+  /**
+   * Called by the bus handling thread instead of @a notifyStored() when a @a Message was received again with
+   * unchanged data and only its last update time was updated. Should return quickly.
+   * @param message the @a Message with the updated last update time.
+   */
+  virtual void notifyUnchanged(const Message* message) {}
+};
+
+
 /**
  * Handles input from and output to the bus with respect to the eBUS protocol.
  */
@@ -378,14 +619,21 @@ class BusHandler : public WaitThread {
    * @param lockCount the number of AUTO-SYN symbols before sending is allowed after lost arbitration, or 0 for auto detection.
    * @param generateSyn whether to enable AUTO-SYN symbol generation.
    * @param pollInterval the interval in seconds in which poll messages are cycled, or 0 if disabled.
+   * @param grabSize the maximum number of distinct grabbed messages to keep.
+   * @param grabHistory the number of last received telegrams to keep per grabbed message.
+   * @param burstSend whether to send the remainder of a telegram at once if supported by the device.
+   * @param writeCoalesce the time in milliseconds data sources wait for superseding writes of the same message, or 0
+   * to disable coalescing of writes.
    */
   BusHandler(Device* device, MessageMap* messages, ScanHelper* scanHelper,
       symbol_t ownAddress, bool answer,
       unsigned int busLostRetries, unsigned int failedSendRetries,
       unsigned int busAcquireTimeout, unsigned int slaveRecvTimeout,
       unsigned int lockCount, bool generateSyn,
-      unsigned int pollInterval)
-    : WaitThread(), m_device(device), m_reconnect(false), m_messages(messages), m_scanHelper(scanHelper),
+      unsigned int pollInterval, size_t grabSize, size_t grabHistory, bool burstSend = false,
+      unsigned int writeCoalesce = 0)
+    : WaitThread(), m_device(device), m_primary(nullptr), m_reconnect(false), m_messages(messages),
+      m_scanHelper(scanHelper),
       m_ownMasterAddress(ownAddress), m_ownSlaveAddress(getSlaveAddress(ownAddress)),
       m_answer(answer), m_addressConflict(false),
       m_busLostRetries(busLostRetries), m_failedSendRetries(failedSendRetries),
@@ -394,14 +642,27 @@ class BusHandler : public WaitThread {
       m_lockCount(lockCount <= 3 ? 3 : lockCount), m_remainLockCount(m_autoLockCount ? 1 : 0),
       m_generateSynInterval(generateSyn ? SYN_TIMEOUT*getMasterNumber(ownAddress)+SYMBOL_DURATION : 0),
       m_pollInterval(pollInterval), m_symbolLatencyMin(-1), m_symbolLatencyMax(-1), m_arbitrationDelayMin(-1),
-      m_arbitrationDelayMax(-1), m_lastReceive(0), m_lastPoll(0),
+      m_arbitrationDelayMax(-1), m_lastReceive(0), m_lastPoll(0), m_idleSynCount(0),
+      m_nextRequests(REQUEST_PRIORITY_AGING), m_startedRequest(nullptr),
       m_currentRequest(nullptr), m_currentAnswering(false), m_runningScans(0), m_nextSendPos(0),
+      m_burstSend(burstSend && device->supportsBurstSend()), m_burstRemain(0), m_writeCoalesce(writeCoalesce),
       m_symPerSec(0), m_maxSymPerSec(0),
       m_state(bs_noSignal), m_escape(0), m_crc(0), m_crcValid(false), m_repeat(false),
-      m_grabMessages(true) {
-    memset(m_seenAddresses, 0, sizeof(m_seenAddresses));
+      m_grabMessages(true), m_grabbedMessages(grabSize, grabHistory), m_rawTelegrams(RAW_TELEGRAM_RING_SIZE) {
+    for (auto& seen : m_seenAddresses) {
+      seen = 0;
+    }
     m_lastSynReceiveTime.tv_sec = 0;
     m_lastSynReceiveTime.tv_nsec = 0;
+    m_requestStartTime.tv_sec = 0;
+    m_requestStartTime.tv_nsec = 0;
+    m_stateStartTime.tv_sec = 0;
+    m_stateStartTime.tv_nsec = 0;
+    m_symbolJitterMax = -1;
+    m_symbolJitterSum = m_symbolJitterCount = 0;
+    m_lastSymbolTimeValid = false;
+    m_tracer = Tracer::getInstance();
+    initMetrics("");
   }
 
   /**
@@ -430,6 +691,39 @@ class BusHandler : public WaitThread {
    */
   const Device* getDevice() const { return m_device; }
 
+  /**
+   * Add the @a BusHandler of another bus segment sharing the same @a MessageMap. Active requests, scans, and polls
+   * for addresses seen on the other bus are routed to it. The other bus must not poll by itself.
+   * @param other the @a BusHandler of the other bus segment.
+   */
+  void addOtherBus(BusHandler* other);
+
+  /**
+   * @return the @a BusHandler instances of the other bus segments.
+   */
+  const vector<BusHandler*>& getOtherBuses() const { return m_otherBuses; }
+
+  /**
+   * Add a @a StoreListener to notify about stored @a Message data received on any bus segment.
+   * @param listener the @a StoreListener to add.
+   */
+  void addStoreListener(StoreListener* listener);
+
+  /**
+   * Remove a previously added @a StoreListener.
+   * @param listener the @a StoreListener to remove.
+   */
+  void removeStoreListener(StoreListener* listener);
+
+  /**
+   * Get the ring of raw telegrams seen on all bus segments, from which any number of consumers can read with their
+   * own cursor.
+   * @return the @a BroadcastRing of @a rawTelegram_t.
+   */
+  BroadcastRing<rawTelegram_t>* getRawTelegrams() {
+    return m_primary ? m_primary->getRawTelegrams() : &m_rawTelegrams;
+  }
+
   /**
    * Clear stored values (e.g. scan results).
    */
@@ -452,9 +746,13 @@ class BusHandler : public WaitThread {
    * Send a message on the bus and wait for the answer.
    * @param master the @a MasterSymbolString with the master data to send.
    * @param slave the @a SlaveSymbolString that will be filled with retrieved slave data.
+   * @param coalesceLength the number of master symbols identifying a written message for coalescing with
+   * superseding writes, or 0 to not coalesce.
+   * @param priority the @a RequestPriority.
    * @return the result code.
    */
-  result_t sendAndWait(const MasterSymbolString& master, SlaveSymbolString* slave);
+  result_t sendAndWait(const MasterSymbolString& master, SlaveSymbolString* slave, size_t coalesceLength = 0,
+      RequestPriority priority = rp_interactiveRead);
 
   /**
    * Prepare the master part for the @a Message, send it to the bus and wait for the answer.
@@ -467,6 +765,39 @@ class BusHandler : public WaitThread {
   result_t readFromBus(Message* message, const string& inputStr, symbol_t dstAddress = SYN,
       symbol_t srcAddress = SYN);
 
+  /**
+   * Read several @a Message instances without input from the bus in a batch, i.e. queue the requests for all of
+   * them at once and wait for all answers instead of doing one round trip after the other.
+   * @param messages the @a Message instances to read (without duplicates).
+   * @return @a RESULT_OK when all were read successfully, or the last error code.
+   */
+  result_t readFromBus(const vector<Message*>& messages);
+
+  /**
+   * Queue a read of the @a Message without input in the background without waiting for the answer.
+   * Only a single refresh per @a Message is queued at a time.
+   * @param message the @a Message instance.
+   * @return @a RESULT_OK on success, @a RESULT_ERR_DUPLICATE if a refresh of the @a Message is already pending, or
+   * an error code.
+   */
+  result_t refreshInBackground(Message* message);
+
+  /**
+   * Called from @a PollRequest upon completion of a background refresh.
+   * @param key the key of the refreshed @a Message.
+   */
+  void setRefreshFinished(uint64_t key);
+
+  /**
+   * Look up the @a Message of a background refresh again as the instance might have been replaced or removed by
+   * reloading the configuration in the meantime.
+   * @param circuit the circuit name.
+   * @param name the message name.
+   * @param key the key of the @a Message when the refresh was queued.
+   * @return the current @a Message instance, or nullptr if no longer available.
+   */
+  Message* findRefreshMessage(const string& circuit, const string& name, uint64_t key) const;
+
   /**
    * Main thread entry.
    */
@@ -514,6 +845,19 @@ class BusHandler : public WaitThread {
    */
   void formatScanResult(ostringstream* output) const;
 
+  /**
+   * Format the seen addresses and scan results for persisting them.
+   * @param output the @a ostream to append one line per seen address and per scan result to.
+   */
+  void formatState(ostream* output) const;
+
+  /**
+   * Restore a seen address or scan result from a line formatted by @a formatState() without touching the bus.
+   * @param line the line to parse.
+   * @return true when the line was valid.
+   */
+  bool restoreState(const string& line);
+
   /**
    * Format information about seen participants to the @a ostringstream.
    * @param output the @a ostringstream to append the info to.
@@ -556,9 +900,21 @@ class BusHandler : public WaitThread {
    * @param isDirectMode true for direct mode, false for grab command.
    * @param since the start time from which to add received messages (inclusive), or 0 for all.
    * @param until the end time to which to add received messages (exclusive), or 0 for all.
+   * @param streamer the optional @a ResultStreamer for passing large results in parts.
    */
   void formatGrabResult(bool unknown, OutputFormat outputFormat, ostringstream* output, bool isDirectMode = false,
-      time_t since = 0, time_t until = 0) const;
+      time_t since = 0, time_t until = 0, ResultStreamer* streamer = nullptr) const;
+
+  /**
+   * Format the grab counters to the @a ostringstream.
+   * @param output the @a ostringstream to format the counters to.
+   */
+  void formatGrabInfo(ostringstream* output) const;
+
+  /**
+   * @return the number of bytes allocated for the grabbed messages.
+   */
+  size_t getGrabMemoryUsage() const { return m_grabbedMessages.getMemoryUsage(); }
 
   /**
    * Return true when a signal on the bus is available.
@@ -566,6 +922,11 @@ class BusHandler : public WaitThread {
    */
   bool hasSignal() const { return m_state != bs_noSignal; }
 
+  /**
+   * @return the time in milliseconds data sources wait for superseding writes of the same message, or 0 if disabled.
+   */
+  unsigned int getWriteCoalesce() const { return m_writeCoalesce; }
+
   /**
    * Reconnect the device.
    */
@@ -607,6 +968,20 @@ class BusHandler : public WaitThread {
    */
   int getMaxArbitrationDelay() const { return m_arbitrationDelayMax; }
 
+  /**
+   * Return the average measured wakeup jitter for symbols received back-to-back from another master.
+   * @return the average measured wakeup jitter in microseconds, -1 if not yet known.
+   */
+  int getAvgSymbolJitter() const {
+    return m_symbolJitterCount == 0 ? -1 : static_cast<int>(m_symbolJitterSum / m_symbolJitterCount);
+  }
+
+  /**
+   * Return the maximal measured wakeup jitter for symbols received back-to-back from another master.
+   * @return the maximal measured wakeup jitter in microseconds, -1 if not yet known.
+   */
+  int getMaxSymbolJitter() const { return m_symbolJitterMax; }
+
   /**
    * Return the number of masters already seen.
    * @return the number of masters already seen (including ebusd itself).
@@ -628,8 +1003,97 @@ class BusHandler : public WaitThread {
    */
   void setScanConfigLoaded(symbol_t address, const string& file);
 
+  /**
+   * Merge the scan config files loaded in the background so far and execute their instructions.
+   */
+  void finishScanConfigFiles();
+
+  /**
+   * @return whether scan config files are still being loaded in the background.
+   */
+  bool hasQueuedScanConfigFiles() const { return !m_queuedScanConfigs.empty(); }
+
 
  private:
+  /**
+   * Get the metric instances of this bus segment.
+   * @param labels the labels distinguishing this bus segment from the primary one without enclosing braces, or empty.
+   */
+  void initMetrics(const string& labels);
+
+  /**
+   * Send a message on this bus segment only and wait for the answer.
+   * @param master the @a MasterSymbolString with the master data to send.
+   * @param slave the @a SlaveSymbolString that will be filled with retrieved slave data.
+   * @param coalesceLength the number of master symbols identifying a written message for coalescing with
+   * superseding writes, or 0 to not coalesce.
+   * @param priority the @a RequestPriority.
+   * @return the result code.
+   */
+  result_t sendAndWaitOnBus(const MasterSymbolString& master, SlaveSymbolString* slave, size_t coalesceLength = 0,
+      RequestPriority priority = rp_interactiveRead);
+
+  /**
+   * Send a message on the other bus segments when the target was not seen yet on any of them and sending on
+   * this one failed.
+   * @param master the @a MasterSymbolString with the master data to send.
+   * @param slave the @a SlaveSymbolString that will be filled with retrieved slave data.
+   * @param priority the @a RequestPriority.
+   * @param result the result code of sending on this bus segment.
+   * @return the result code of the first other bus segment reaching the target, or @a result.
+   */
+  result_t sendAndWaitOnOtherBuses(const MasterSymbolString& master, SlaveSymbolString* slave,
+      RequestPriority priority, result_t result);
+
+  /**
+   * @param master the @a MasterSymbolString with the master data.
+   * @return whether the result of the master-slave request may be reused for an identical one (as the response
+   * can't be seen on the bus otherwise).
+   */
+  static bool isReusable(const MasterSymbolString& master) {
+    return master.size() > 1 && master[1] != BROADCAST && !isMaster(master[1]);
+  }
+
+  /**
+   * Add an @a ActiveBusRequest to the ones being sent on this bus segment, unless the recent result of an identical
+   * request can be reused or an identical request is being sent already.
+   * @param request the @a ActiveBusRequest to add.
+   * @param coalesceLength the number of master symbols identifying a written message for coalescing with
+   * superseding writes, or 0 to not coalesce.
+   * @return @a RESULT_OK when a recent result was reused and stored in the slave data already, @a RESULT_EMPTY when
+   * the request joined an identical one and only has to wait for being finished, or @a RESULT_CONTINUE when the
+   * request was added and has to be queued.
+   */
+  result_t addActiveRequest(ActiveBusRequest* request, size_t coalesceLength);
+
+  /**
+   * Remove an @a ActiveBusRequest added by @a addActiveRequest(), remember its result for reuse, and finish the
+   * requests joined to it.
+   * @param request the @a ActiveBusRequest to remove.
+   * @param result the result code.
+   */
+  void removeActiveRequest(ActiveBusRequest* request, result_t result);
+
+  /**
+   * Drop the recent results of master-slave requests to the destination of the master data (with
+   * @a m_activeRequestsMutex locked).
+   * @param master the @a MasterSymbolString with the destination address.
+   */
+  void invalidateActiveResults(const MasterSymbolString& master);
+
+  /**
+   * Queue a @a BusRequest for being sent according to its @a RequestPriority.
+   * @param request the @a BusRequest to queue.
+   */
+  void queueRequest(BusRequest* request) { m_nextRequests.push(request, request->m_priority); }
+
+  /**
+   * Take the @a BusRequest from the queue that the arbitration was started for, or the most urgent one if that is
+   * not queued anymore.
+   * @return the @a BusRequest removed from the queue, or nullptr.
+   */
+  BusRequest* takeStartedRequest();
+
   /**
    * Handle the next symbol on the bus.
    * @return RESULT_OK on success, or an error code.
@@ -652,6 +1116,51 @@ class BusHandler : public WaitThread {
    */
   bool addSeenAddress(symbol_t address);
 
+  /**
+   * Return whether the address (or the master address corresponding to the slave address) was seen on this bus.
+   * @param address the bus address.
+   * @return whether the address was seen on this bus.
+   */
+  bool hasSeenAddress(symbol_t address) const;
+
+  /**
+   * Check whether a request to the slave is to be sent or failed right away as the slave is considered down. When
+   * the next probe of a slave considered down is due, the request is let through as probe.
+   * @param address the destination address.
+   * @param probe set to whether the request is let through as probe, i.e. is to be sent without retries.
+   * @return true when the request is to be sent, false when the slave is considered down.
+   */
+  bool checkSlaveAvailable(symbol_t address, bool* probe);
+
+  /**
+   * Update the availability of a slave after a request to it was finished.
+   * @param address the destination address.
+   * @param result @a RESULT_OK when the slave answered, @a RESULT_ERR_TIMEOUT when it did not answer at all, or any
+   * other value when the result says nothing about its availability.
+   */
+  void updateSlaveAvailability(symbol_t address, result_t result);
+
+  /**
+   * Get the @a BusHandler responsible for the bus segment the destination address was seen on.
+   * @param address the destination address.
+   * @return the @a BusHandler of the other bus segment the address was seen on, or this.
+   */
+  BusHandler* getBusFor(symbol_t address);
+
+  /**
+   * Trace the end of an arbitration attempt for the current request.
+   * @param result the result of the arbitration.
+   * @param time the end time, or nullptr for now.
+   */
+  void traceArbitration(const char* result, const struct timespec* time = nullptr);
+
+  /**
+   * Trace the lifecycle of a @a BusRequest from creation (or last notification) up to now.
+   * @param request the @a BusRequest being notified.
+   * @param result the result of the request.
+   */
+  void traceRequest(BusRequest* request, result_t result);
+
   /**
    * Called to measure the latency between send and receive of a symbol.
    * @param sentTime the time the symbol was sent.
@@ -659,11 +1168,45 @@ class BusHandler : public WaitThread {
    */
   void measureLatency(struct timespec* sentTime, struct timespec* recvTime);
 
+  /**
+   * Called to measure the wakeup jitter for a received symbol, i.e. how much later than its nominal duration after
+   * the previous one it was handled when both were sent back-to-back by another master.
+   * @param recvSymbol the received symbol.
+   */
+  void measureJitter(symbol_t recvSymbol);
+
+  /**
+   * Send the next chunk of up to @a BURST_CHUNK_LEN escaped symbols of the command or response including the CRC at
+   * once starting at @a m_nextSendPos.
+   * @return the result_t code.
+   */
+  result_t sendBurst();
+
   /**
    * Called when a message sending or reception was successfully completed.
    */
   void messageCompleted();
 
+  /**
+   * Add a completed or aborted telegram to the raw telegram ring.
+   * @param master the master part.
+   * @param slave the slave part.
+   * @param result @a RESULT_OK for a completed telegram, or the error that aborted it.
+   */
+  void addRawTelegram(const MasterSymbolString& master, const SlaveSymbolString& slave, result_t result);
+
+  /**
+   * Notify the @a StoreListener instances about stored @a Message data.
+   * @param message the @a Message with the newly stored data.
+   */
+  void notifyStored(const Message* message);
+
+  /**
+   * Notify the @a StoreListener instances about a @a Message received again with unchanged data.
+   * @param message the @a Message with the updated last update time.
+   */
+  void notifyUnchanged(const Message* message);
+
   /**
    * Prepare a @a ScanRequest.
    * @param slave the single slave address to scan, or @a SYN for multiple.
@@ -678,6 +1221,12 @@ class BusHandler : public WaitThread {
   /** the @a Device instance for accessing the bus. */
   Device* m_device;
 
+  /** the @a BusHandler of the primary bus segment when this is another bus segment, or nullptr. */
+  BusHandler* m_primary;
+
+  /** the @a BusHandler instances of the other bus segments. */
+  vector<BusHandler*> m_otherBuses;
+
   /** set to @p true when the device shall be reconnected. */
   bool m_reconnect;
 
@@ -747,17 +1296,83 @@ class BusHandler : public WaitThread {
    */
   int m_arbitrationDelayMax;
 
+  /** the maximal measured wakeup jitter of received symbols in microseconds, -1 if not yet known. */
+  int m_symbolJitterMax;
+
+  /** the sum of measured wakeup jitter of received symbols in microseconds. */
+  uint64_t m_symbolJitterSum;
+
+  /** the number of measured wakeup jitter values. */
+  uint64_t m_symbolJitterCount;
+
+  /** the time the last symbol was received. */
+  struct timespec m_lastSymbolTime;
+
+  /** whether @a m_lastSymbolTime belongs to a symbol within a telegram. */
+  bool m_lastSymbolTimeValid;
+
   /** the time of the last received SYN symbol, or 0 for never. */
   struct timespec m_lastSynReceiveTime;
 
+  /** the time when the arbitration for the current request was started, or 0. */
+  struct timespec m_requestStartTime;
+
+  /** the time when the current @a BusState was entered (only while tracing), or 0. */
+  struct timespec m_stateStartTime;
+
+  /** the @a Tracer for recording state transitions, arbitrations, and request lifecycles. */
+  Tracer* m_tracer;
+
+  /** the @a MetricHistogram of the symbol latency. */
+  MetricHistogram* m_symbolLatencyMetric;
+
+  /** the @a MetricHistogram of the wakeup jitter of received symbols. */
+  MetricHistogram* m_symbolJitterMetric;
+
+  /** the @a MetricHistogram of the arbitration delay. */
+  MetricHistogram* m_arbitrationDelayMetric;
+
+  /** the @a MetricHistogram of the time for finding the @a Message of a received telegram. */
+  MetricHistogram* m_findMetric;
+
+  /** the @a MetricHistogram of the time for storing and decoding the data of a received telegram. */
+  MetricHistogram* m_decodeMetric;
+
+  /** the labels of the metrics of this bus segment without enclosing braces, or empty for the primary one. */
+  string m_metricLabels;
+
+  /** the @a MetricHistogram instances of the bus transaction time by result code. */
+  map<result_t, MetricHistogram*> m_transactionMetrics;
+
+  /** the @a MetricCounter of completed telegrams. */
+  MetricCounter* m_telegramMetric;
+
+  /** the @a MetricCounter of completed telegrams without a @a Message. */
+  MetricCounter* m_unknownTelegramMetric;
+
+  /** the @a MetricCounter of completed passive telegrams identical to the last data of their @a Message. */
+  MetricCounter* m_unchangedTelegramMetric;
+
+  /** the @a MetricCounter of completed telegrams successfully stored for their @a Message. */
+  MetricCounter* m_decodedTelegramMetric;
+
+  /** the @a MetricGauge of the symbol rate. */
+  MetricGauge* m_symbolRateMetric;
+
   /** the time of the last received symbol, or 0 for never. */
   time_t m_lastReceive;
 
   /** the time of the last poll, or 0 for never. */
   time_t m_lastPoll;
 
-  /** the queue of @a BusRequests that shall be handled. */
-  Queue<BusRequest*> m_nextRequests;
+  /** the number of consecutive AUTO-SYN symbols without any other traffic in between. */
+  unsigned int m_idleSynCount;
+
+  /** the queue of @a BusRequests that shall be handled by @a RequestPriority. */
+  PriorityQueue<BusRequest*> m_nextRequests;
+
+  /** the @a BusRequest the arbitration was started for, or nullptr (reset when it left @a m_nextRequests). */
+  std::atomic<BusRequest*> m_startedRequest;
 
   /** the currently handled BusRequest, or nullptr. */
   BusRequest* m_currentRequest;
@@ -768,6 +1383,27 @@ class BusHandler : public WaitThread {
   /** the queue of @a BusRequests that are already finished. */
   Queue<BusRequest*> m_finishedRequests;
 
+  /** @a Mutex for accessing @a m_activeRequests and @a m_lastActiveResults. */
+  Mutex m_activeRequestsMutex;
+
+  /** the @a ActiveBusRequest instances currently being sent on the bus (see @a addActiveRequest()). */
+  vector<ActiveBusRequest*> m_activeRequests;
+
+  /** @a Mutex for accessing @a m_pendingRefreshes. */
+  Mutex m_pendingRefreshesMutex;
+
+  /** the keys of the @a Message instances with a pending background refresh (see @a refreshInBackground()). */
+  set<uint64_t> m_pendingRefreshes;
+
+  /** a recent result of a master-slave request. */
+  typedef struct {
+    SlaveSymbolString slave;  //!< the received slave data
+    uint64_t time;  //!< the system time in milliseconds when the request was completed
+  } activeResult_t;
+
+  /** the recent results of master-slave requests by master data string (see @a REQUEST_REUSE_TIME). */
+  map<string, activeResult_t> m_lastActiveResults;
+
   /** the number of scan requests currently running. */
   unsigned int m_runningScans;
 
@@ -775,6 +1411,15 @@ class BusHandler : public WaitThread {
    * (only relevant if m_request is set and state is @a bs_command or @a bs_response). */
   size_t m_nextSendPos;
 
+  /** whether to send the remainder of the command or response in chunks of @a BURST_CHUNK_LEN symbols. */
+  const bool m_burstSend;
+
+  /** the number of escaped symbols already sent at once for which the send is to be skipped. */
+  size_t m_burstRemain;
+
+  /** the time in milliseconds data sources wait for superseding writes of the same message, or 0 to disable. */
+  const unsigned int m_writeCoalesce;
+
   /** the number of received symbols in the last second. */
   unsigned int m_symPerSec;
 
@@ -802,17 +1447,46 @@ class BusHandler : public WaitThread {
   /** the received response @a SlaveSymbolString or response to send. */
   SlaveSymbolString m_response;
 
-  /** the participating bus addresses seen so far (0 if not seen yet, or combination of @a SEEN bits). */
-  symbol_t m_seenAddresses[256];
+  /** the participating bus addresses seen so far (0 if not seen yet, or combination of @a SEEN bits, also updated
+   * by the other bus segments). */
+  std::atomic<symbol_t> m_seenAddresses[256];
+
+  /** the availability of a slave that did not answer recently. */
+  typedef struct {
+    unsigned int failures;  //!< the number of consecutive unanswered requests
+    unsigned int backoff;  //!< the current time [s] between probes while considered down, or 0 when not down
+    time_t nextProbe;  //!< the time from which on the next probe is let through while considered down
+  } slaveAvailability_t;
+
+  /** @a Mutex for accessing @a m_slaveAvailability. */
+  mutable Mutex m_slaveAvailabilityMutex;
+
+  /** the availability of slaves that did not answer recently by slave address. */
+  map<symbol_t, slaveAvailability_t> m_slaveAvailability;
+
+  /** the @a MetricCounter of requests and polls skipped for slaves considered down. */
+  MetricCounter* m_slaveDownMetric;
 
   /** the scan results by slave address and index. */
   map<symbol_t, vector<string>> m_scanResults;
 
+  /** whether additional scan messages were available before queueing the scan config file, by slave address. */
+  map<symbol_t, bool> m_queuedScanConfigs;
+
   /** whether to grab messages. */
   bool m_grabMessages;
 
   /** the grabbed messages by key.*/
-  map<uint64_t, GrabbedMessage> m_grabbedMessages;
+  GrabbedMessageMap m_grabbedMessages;
+
+  /** the ring of raw telegrams (only used in the primary bus segment). */
+  BroadcastRing<rawTelegram_t> m_rawTelegrams;
+
+  /** the @a StoreListener instances (only used in the primary bus segment). */
+  vector<StoreListener*> m_storeListeners;
+
+  /** @a Mutex for accessing @a m_storeListeners. */
+  Mutex m_storeListenersMutex;
 };
 
 }  // namespace ebusd
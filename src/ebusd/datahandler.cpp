@@ -27,6 +27,11 @@
 #ifdef HAVE_KNX
 #  include "ebusd/knxhandler.h"
 #endif
+#ifdef HAVE_SHM_OPEN
+#  include "ebusd/shmhandler.h"
+#endif
+#include "lib/utils/clock.h"
+#include "lib/utils/memusage.h"
 
 namespace ebusd {
 
@@ -42,6 +47,9 @@ static struct argp_child g_argp_children[
 #ifdef HAVE_KNX
             +1
 #endif
+#ifdef HAVE_SHM_OPEN
+            +1
+#endif
 ];
 
 const struct argp_child* datahandler_getargs() {
@@ -51,6 +59,9 @@ const struct argp_child* datahandler_getargs() {
 #endif
 #ifdef HAVE_KNX
   g_argp_children[count++] = *knxhandler_getargs();
+#endif
+#ifdef HAVE_SHM_OPEN
+  g_argp_children[count++] = *shmhandler_getargs();
 #endif
   if (count > 0) {
     g_argp_children[count] = g_last_argp_child;
@@ -71,13 +82,88 @@ bool datahandler_register(UserInfo* userInfo, BusHandler* busHandler, MessageMap
   if (!knxhandler_register(userInfo, busHandler, messages, handlers)) {
     success = false;
   }
+#endif
+#ifdef HAVE_SHM_OPEN
+  if (!shmhandler_register(userInfo, busHandler, messages, handlers)) {
+    success = false;
+  }
 #endif
   return success;
 }
 
+size_t DataSink::getUpdatesMemoryUsage() {
+  m_updatesMutex.lock();
+  size_t ret = m_updatedMessages.size()*memUsageNode(sizeof(*m_updatedMessages.begin()));
+  m_updatesMutex.unlock();
+  return ret;
+}
+
+size_t DataSource::getDeferredWritesMemoryUsage() const {
+  size_t ret = 0;
+  for (const auto& it : m_deferredWrites) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first.first) + memUsage(it.first.second)
+      + memUsage(it.second.input);
+  }
+  return ret;
+}
+
+bool DataSource::deferWrite(Message* message, const string& input) {
+  unsigned int coalesce = m_busHandler->getWriteCoalesce();
+  if (coalesce == 0) {
+    return false;
+  }
+  auto id = std::make_pair(message->getCircuit(), message->getName());
+  auto it = m_deferredWrites.find(id);
+  if (it != m_deferredWrites.end() && it->second.key == message->getKey()) {
+    it->second.input = input;  // keep the original due time in order to not delay forever
+    return true;
+  }
+  m_deferredWrites[id] = {message->getKey(), input, clockGetMillis() + coalesce};
+  return true;
+}
+
+int DataSource::writeDeferred(MessageMap* messages) {
+  int untilNext = -1;
+  uint64_t now = clockGetMillis();
+  for (auto it = m_deferredWrites.begin(); it != m_deferredWrites.end(); ) {
+    if (it->second.due > now) {
+      auto remain = static_cast<int>(it->second.due - now);
+      if (untilNext < 0 || remain < untilNext) {
+        untilNext = remain;
+      }
+      ++it;
+      continue;
+    }
+    const string circuit = it->first.first;
+    const string name = it->first.second;
+    deferredWrite_t write = it->second;
+    it = m_deferredWrites.erase(it);
+    // look the message up again as the instance might have been replaced by a reload in the meantime
+    Message* message = nullptr;
+    messages->lockShared();
+    const vector<Message*>* found = messages->getByKey(write.key);
+    if (found) {
+      for (const auto candidate : *found) {
+        if (candidate->isWrite() && candidate->getCircuit() == circuit && candidate->getName() == name) {
+          message = candidate;
+          break;
+        }
+      }
+    }
+    messages->unlockShared();
+    if (message) {
+      result_t result = m_busHandler->readFromBus(message, write.input);
+      notifyDeferredWrite(message, write.input, result);
+    }
+  }
+  return untilNext;
+}
+
 void DataSink::notifyUpdate(Message* message) {
   if (message && message->hasLevel(m_levels)) {
+    m_updatesMutex.lock();
     m_updatedMessages[message->getKey()]++;
+    m_updatesMutex.unlock();
   }
 }
 
@@ -23,6 +23,7 @@
 #include <map>
 #include <list>
 #include <string>
+#include <utility>
 #include "ebusd/bushandler.h"
 #include "lib/ebus/message.h"
 
@@ -36,6 +37,7 @@ namespace ebusd {
 
 using std::list;
 using std::map;
+using std::pair;
 
 class UserInfo;
 class DataHandler;
@@ -131,6 +133,12 @@ class DataHandler {
    * @return whether this is a @a DataSource instance.
    */
   virtual bool isDataSource() const { return false; }
+
+  /**
+   * Get the estimated memory used by the state of this handler.
+   * @return the estimated number of bytes.
+   */
+  virtual size_t getMemoryUsage() const { return 0; }
 };
 
 
@@ -162,6 +170,13 @@ class DataSink : virtual public DataHandler {
    */
   virtual void notifyUpdate(Message* message);
 
+  /**
+   * Return whether the sink is only interested in changed messages, i.e. @a notifyUpdate() is not called for
+   * messages received again with unchanged data.
+   * @return whether the sink is only interested in changed messages.
+   */
+  virtual bool isChangesOnly() const { return false; }
+
   /**
    * Notify the sink of the latest update check result.
    * @param checkResult a string describing available updates, or empty if no update is available.
@@ -175,11 +190,20 @@ class DataSink : virtual public DataHandler {
   virtual void notifyScanStatus(scanStatus_t scanStatus) {}
 
  protected:
+  /**
+   * Get the estimated memory used by the updated @p Message keys.
+   * @return the estimated number of bytes.
+   */
+  size_t getUpdatesMemoryUsage();
+
   /** the allowed access levels. */
   string m_levels;
 
   /** a map of updated @p Message keys. */
   map<uint64_t, int> m_updatedMessages;
+
+  /** @a Mutex for access to @a m_updatedMessages (taken after the shared lock of the @a MessageMap if needed). */
+  Mutex m_updatesMutex;
 };
 
 
@@ -205,8 +229,56 @@ class DataSource : virtual public DataHandler {
 
 
  protected:
+  /**
+   * Defer writing a @a Message for the write coalescing time of the @a BusHandler, replacing the input of an already
+   * deferred write of the same @a Message. Only to be called from the thread calling @a writeDeferred().
+   * @param message the @a Message to write.
+   * @param input the input @a string from which to read the master values.
+   * @return true when the write was deferred, false when coalescing is disabled and the caller has to write directly.
+   */
+  bool deferWrite(Message* message, const string& input);
+
+  /**
+   * Write the deferred @a Message instances whose coalescing time elapsed.
+   * @param messages the @a MessageMap for looking up the deferred @a Message instances again (in case of a reload).
+   * @return the number of milliseconds until the next deferred write is due, or -1 if there is none.
+   */
+  int writeDeferred(MessageMap* messages);
+
+  /**
+   * @return whether there are deferred writes pending.
+   */
+  bool hasDeferredWrites() const { return !m_deferredWrites.empty(); }
+
+  /**
+   * Get the estimated memory used by the deferred writes. Only to be called from the thread calling
+   * @a writeDeferred().
+   * @return the estimated number of bytes.
+   */
+  size_t getDeferredWritesMemoryUsage() const;
+
+  /**
+   * Called by @a writeDeferred() after a deferred @a Message was written.
+   * @param message the written @a Message.
+   * @param input the input @a string from which the master values were read.
+   * @param result the result code of the write.
+   */
+  virtual void notifyDeferredWrite(Message* message, const string& input, result_t result) {}
+
   /** the @a BusHandler instance. */
   BusHandler* m_busHandler;
+
+
+ private:
+  /** a write deferred for coalescing. */
+  typedef struct {
+    uint64_t key;  //!< the key of the @a Message for looking it up again when due
+    string input;  //!< the input string of the most recent write
+    uint64_t due;  //!< the system time in milliseconds when the write is due
+  } deferredWrite_t;
+
+  /** the deferred writes by circuit and name of the @a Message (instead of the instance replaced by a reload). */
+  map<pair<string, string>, deferredWrite_t> m_deferredWrites;
 };
 
 }  // namespace ebusd
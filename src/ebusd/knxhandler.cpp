@@ -27,7 +27,9 @@
 #include <cmath>
 #include <csignal>
 #include <deque>
+#include "lib/utils/clock.h"
 #include "lib/utils/log.h"
+#include "lib/utils/memusage.h"
 #include "lib/ebus/symbol.h"
 
 #ifndef POLLRDHUP
@@ -50,6 +52,7 @@ using std::dec;
 #define O_AGW (O_AGR-1)
 #define O_INT (O_AGW-1)
 #define O_VAR (O_INT-1)
+#define O_RAT (O_VAR-1)
 
 /** the definition of the KNX arguments. */
 static const struct argp_option g_knx_argp_options[] = {
@@ -65,6 +68,8 @@ static const struct argp_option g_knx_argp_options[] = {
                                      " (0=disable), [99999999]", 0 },
   {"knxint", O_INT, "FILE",       0, "Read KNX integration settings from FILE [/etc/ebusd/knx.cfg]", 0 },
   {"knxvar", O_VAR, "NAME=VALUE[,...]", 0, "Add variable(s) to the read KNX integration settings", 0 },
+  {"knxrate", O_RAT, "COUNT",     0, "Maximum number of group value writes per second for updated message fields"
+                                     " (0=unlimited) [20]", 0 },
 
   {nullptr,      0, nullptr,      0, nullptr, 0 },
 };
@@ -76,6 +81,7 @@ static unsigned int g_maxReadAge = 5;  //!< max age in seconds for using the las
 static unsigned int g_maxWriteAge = 99999999;
 static const char* g_integrationFile = nullptr;  //!< the integration settings file
 static vector<string>* g_integrationVars = nullptr;  //!< the integration settings variables
+static unsigned int g_maxSendRate = 20;  //!< max number of group value writes per second for updates, 0 for unlimited
 
 /**
  * The KNX argument parsing function.
@@ -142,6 +148,19 @@ static error_t knx_parse_opt(int key, char *arg, struct argp_state *state) {
     break;
   }
 
+  case O_RAT:  // --knxrate=20
+    if (arg == nullptr || arg[0] == 0) {
+      argp_error(state, "invalid knxrate value");
+      return EINVAL;
+    }
+    value = parseInt(arg, 10, 0, 1000, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid knxrate");
+      return EINVAL;
+    }
+    g_maxSendRate = value;
+    break;
+
   default:
     return ARGP_ERR_UNKNOWN;
   }
@@ -167,8 +186,9 @@ bool knxhandler_register(UserInfo* userInfo, BusHandler* busHandler, MessageMap*
 
 KnxHandler::KnxHandler(UserInfo* userInfo, BusHandler* busHandler, MessageMap* messages)
   : DataSink(userInfo, "knx"), DataSource(busHandler), WaitThread(), m_messages(messages),
-    m_start(0), m_lastUpdateCheckResult("."),
-    m_lastScanStatus(SCAN_STATUS_NONE), m_scanFinishReceived(false), m_lastErrorLogTime(0) {
+    m_groupTable(GROUP_TABLE_SIZE, 0), m_sendAllowance(0), m_sendAllowanceTime(0), m_start(0),
+    m_lastUpdateCheckResult("."), m_lastScanStatus(SCAN_STATUS_NONE), m_scanFinishReceived(false),
+    m_lastErrorLogTime(0), m_memoryUsage(0) {
   m_con = KnxConnection::create(g_url);
   if (g_integrationFile != nullptr) {
     if (!m_replacers.parseFile(g_integrationFile)) {
@@ -219,6 +239,10 @@ KnxHandler::KnxHandler(UserInfo* userInfo, BusHandler* busHandler, MessageMap* m
     if (key.substr(0, 7) != "global/") {
       messageCnt++;
       m_messageFieldGroupAddress[key] = dest;
+      // remember all potential "circuit/message" prefixes for quickly skipping unassigned messages
+      for (pos = key.find('/'); pos != string::npos; pos = key.find('/', pos+1)) {
+        m_messageGroupNames.insert(key.substr(0, pos));
+      }
       continue;
     }
     key = key.substr(7);
@@ -242,13 +266,16 @@ KnxHandler::KnxHandler(UserInfo* userInfo, BusHandler* busHandler, MessageMap* m
       logOtherError("knx", "invalid assignment global/%s to %s", key.c_str(), val.c_str());
       continue;
     }
-    m_subscribedGlobals[index] = dest|FLAG_READ;
-    groupInfo_t grpInfo;
+    groupInfo_t grpInfo = {};
     grpInfo.messageKey = 0;
     grpInfo.globalIndex = index;
     grpInfo.lengthFlag = lengthFlag;
-    m_subscribedGroups[dest|FLAG_READ] = grpInfo;
-    globalCnt++;
+    grpInfo.destFlags = dest|FLAG_READ;
+    size_t slot = setGroup(grpInfo);
+    if (slot) {
+      m_subscribedGlobals[index] = &m_groups[slot-1];
+      globalCnt++;
+    }
   }
   logOtherInfo("knx", "parsed %d global and %d message assignments", globalCnt, messageCnt);
 }
@@ -361,10 +388,15 @@ const SingleDataField *field) const {
   if (!m_con || !m_con->isConnected() || !m_con->getAddress()) {
     return RESULT_EMPTY;
   }
-  uint8_t data[] = {0, 0, 0, 0, 0, 0};
-  data[0] = static_cast<uint8_t>(apci>>8);
-  data[1] = static_cast<uint8_t>(apci&0xff);
-  int len = 2;
+  result_t ret = convertGroupValue(lengthFlag, value, field, &value);
+  if (ret != RESULT_OK) {
+    return ret;
+  }
+  return sendConvertedGroupValue(dest, apci, lengthFlag, value);
+}
+
+result_t KnxHandler::convertGroupValue(const dtlf_t& lengthFlag, unsigned int value, const SingleDataField *field,
+unsigned int* converted) {
   // convert value to dpt
   if (lengthFlag.isFloat || lengthFlag.hasDivisor) {
     if (!field) {
@@ -394,11 +426,22 @@ const SingleDataField *field) const {
     }
   }
   // else signed values: fine as long as length is identical
+  *converted = value;
+  return RESULT_OK;
+}
+
+result_t KnxHandler::sendConvertedGroupValue(knx_addr_t dest, apci_t apci, dtlf_t& lengthFlag,
+unsigned int value) const {
+  if (!m_con || !m_con->isConnected() || !m_con->getAddress()) {
+    return RESULT_EMPTY;
+  }
   if (apci == APCI_GROUPVALUE_WRITE && lengthFlag.lastValueSent && lengthFlag.lastValue == value) {
     return RESULT_EMPTY;  // no need to send the same group value again
   }
-  lengthFlag.lastValue = value;
-  lengthFlag.lastValueSent = true;
+  uint8_t data[] = {0, 0, 0, 0, 0, 0};
+  data[0] = static_cast<uint8_t>(apci>>8);
+  data[1] = static_cast<uint8_t>(apci&0xff);
+  int len = 2;
   switch (lengthFlag.length) {
     case 0:  // short value <= 6 bit
       data[1] |= static_cast<uint8_t>(value&0x3f);
@@ -427,6 +470,8 @@ const SingleDataField *field) const {
                   dest, len);
     return RESULT_ERR_SEND;
   }
+  lengthFlag.lastValue = value;
+  lengthFlag.lastValueSent = true;
   logOtherDebug("knx", "sent %s, dest %4.4x, len %d",
                apci == APCI_GROUPVALUE_WRITE ? "write" : apci == APCI_GROUPVALUE_READ ? "read" : "response",
                dest, len);
@@ -441,13 +486,106 @@ void KnxHandler::sendGlobalValue(global_t index, unsigned int value, bool respon
   if (vit == m_subscribedGlobals.cend()) {
     return;
   }
-  auto git = m_subscribedGroups.find(vit->second);
-  if (git == m_subscribedGroups.end()) {
+  groupInfo_t& grpInfo = *vit->second;
+  sendGroupValue(static_cast<knx_addr_t>(grpInfo.destFlags&0xffff),
+                 response ? APCI_GROUPVALUE_RESPONSE : APCI_GROUPVALUE_WRITE,
+                 grpInfo.lengthFlag, value);
+}
+
+size_t KnxHandler::setGroup(const groupInfo_t& grpInfo) {
+  uint16_t& slot = m_groupTable[(grpInfo.destFlags&0xffff) | ((grpInfo.destFlags&FLAG_WRITE) ? 0x10000 : 0)];
+  if (slot) {
+    groupInfo_t& existing = m_groups[slot-1];
+    bool pending = existing.pending;
+    existing = grpInfo;
+    existing.pending = pending;  // keep the slot in m_pendingGroups consistent
+    return slot;
+  }
+  if (m_groups.size() >= MAX_GROUP_SLOTS) {
+    logOtherError("knx", "too many associations, ignoring %4.4x", grpInfo.destFlags&0xffff);
+    return 0;
+  }
+  m_groups.push_back(grpInfo);
+  slot = static_cast<uint16_t>(m_groups.size());
+  return slot;
+}
+
+void KnxHandler::queueGroupValue(size_t slot, unsigned int value, const SingleDataField *field) {
+  groupInfo_t& grpInfo = m_groups[slot-1];
+  unsigned int converted;
+  if (convertGroupValue(grpInfo.lengthFlag, value, field, &converted) != RESULT_OK) {
     return;
   }
-  sendGroupValue(static_cast<knx_addr_t>(vit->second&0xffff),
-                 response ? APCI_GROUPVALUE_RESPONSE : APCI_GROUPVALUE_WRITE,
-                 git->second.lengthFlag, value);
+  if (!grpInfo.pending) {
+    if (grpInfo.lengthFlag.lastValueSent && grpInfo.lengthFlag.lastValue == converted) {
+      return;  // no need to send the same group value again
+    }
+    grpInfo.pending = true;
+    m_pendingGroups.push_back(static_cast<uint16_t>(slot));
+  }
+  grpInfo.pendingValue = converted;
+}
+
+size_t KnxHandler::calcMemoryUsage() {
+  size_t ret = getUpdatesMemoryUsage() + getDeferredWritesMemoryUsage()
+    + m_groupTable.capacity()*sizeof(uint16_t) + m_groups.size()*sizeof(groupInfo_t)
+    + m_pendingGroups.size()*sizeof(uint16_t) + m_subscribedGlobals.size()*memUsageNode(sizeof(groupInfo_t*));
+  ret += m_messageFieldGroupAddress.bucket_count()*sizeof(void*);
+  for (const auto& it : m_messageFieldGroupAddress) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first);
+  }
+  ret += m_messageGroupNames.bucket_count()*sizeof(void*);
+  for (const auto& it : m_messageGroupNames) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it);
+  }
+  ret += m_subscribedMessages.bucket_count()*sizeof(void*);
+  for (const auto& it : m_subscribedMessages) {
+    ret += memUsageNode(sizeof(it)) + it.second.capacity()*sizeof(uint16_t);
+  }
+  return ret;
+}
+
+void KnxHandler::sendPendingGroupValues() {
+  if (m_pendingGroups.empty() || !m_con || !m_con->isConnected() || !m_con->getAddress()) {
+    return;  // kept until the connection is back
+  }
+  size_t count = m_pendingGroups.size();
+  if (g_maxSendRate > 0) {
+    // refill the allowance according to the elapsed time, allowing bursts of up to one second
+    uint64_t now = clockGetMillis();
+    if (m_sendAllowanceTime == 0 || now < m_sendAllowanceTime) {
+      m_sendAllowance = static_cast<float>(g_maxSendRate);
+    } else {
+      m_sendAllowance += static_cast<float>(now - m_sendAllowanceTime) * static_cast<float>(g_maxSendRate) / 1000;
+      if (m_sendAllowance > static_cast<float>(g_maxSendRate)) {
+        m_sendAllowance = static_cast<float>(g_maxSendRate);
+      }
+    }
+    m_sendAllowanceTime = now;
+    if (static_cast<float>(count) > m_sendAllowance) {
+      count = static_cast<size_t>(m_sendAllowance);
+    }
+  }
+  for (size_t sent = 0; sent < count; sent++) {
+    groupInfo_t& grpInfo = m_groups[m_pendingGroups.front()-1];
+    if (!grpInfo.pending) {
+      m_pendingGroups.pop_front();
+      continue;
+    }
+    result_t result = sendConvertedGroupValue(static_cast<knx_addr_t>(grpInfo.destFlags&0xffff),
+        APCI_GROUPVALUE_WRITE, grpInfo.lengthFlag, grpInfo.pendingValue);
+    if (result == RESULT_ERR_SEND) {
+      break;  // keep it pending for the next round
+    }
+    m_pendingGroups.pop_front();
+    grpInfo.pending = false;
+    if (result == RESULT_OK && g_maxSendRate > 0) {
+      m_sendAllowance -= 1;
+    }
+  }
+  if (!m_pendingGroups.empty()) {
+    logOtherDebug("knx", "%d group value writes pending", m_pendingGroups.size());
+  }
 }
 
 result_t KnxHandler::receiveTelegram(int maxlen, knx_transfer_t* typ, uint8_t *buf, int *recvlen,
@@ -589,19 +727,20 @@ void KnxHandler::handleGroupTelegram(knx_addr_t src, knx_addr_t dest, int len, c
     return;  // neither A_GroupValue_Read nor A_GroupValue_Write (A_GroupValue_Response not used at all)
   }
   const auto subKey = static_cast<uint32_t>(dest | (isWrite ? FLAG_WRITE : FLAG_READ));
-  auto sit = m_subscribedGroups.find(subKey);
+  size_t slot = getGroupSlot(subKey);
   if (needsLog(lf_other, ll_debug)) {
     logOtherDebug("knx", "received %ssubscribed %s from %4.4x to %4.4x, len %d",
-                  sit == m_subscribedGroups.end() ? "un" : "",
+                  slot == 0 ? "un" : "",
                   apci == APCI_GROUPVALUE_WRITE ? "write" : apci == APCI_GROUPVALUE_READ ? "read" : "response",
                   src, dest, len);
   }
-  if (sit == m_subscribedGroups.end()) {
+  if (slot == 0) {
     return;  // address+direction not subscribed
   }
-  if (sit->second.messageKey == 0) {
+  groupInfo_t& grpInfo = m_groups[slot-1];
+  if (grpInfo.messageKey == 0) {
     // global values, only readable
-    switch (sit->second.globalIndex) {
+    switch (grpInfo.globalIndex) {
       case GLOBAL_VERSION:
         sendGlobalValue(GLOBAL_VERSION, VERSION_INT, true);
         break;
@@ -626,12 +765,12 @@ void KnxHandler::handleGroupTelegram(knx_addr_t src, knx_addr_t dest, int len, c
     }
     return;
   }
-  const vector<Message*>* messages = m_messages->getByKey(sit->second.messageKey);
+  const vector<Message*>* messages = m_messages->getByKey(grpInfo.messageKey);
   if (!messages) {
     return;
   }
   Message *msg = nullptr;
-  ssize_t fieldIndex = sit->second.fieldIndex;
+  ssize_t fieldIndex = grpInfo.fieldIndex;
   const SingleDataField* field = nullptr;
   for (const auto& message : *messages) {
     if (!message->isAvailable() || message->getDstAddress() == SYN) {
@@ -685,7 +824,7 @@ void KnxHandler::handleGroupTelegram(knx_addr_t src, knx_addr_t dest, int len, c
     // ugly but least intrusive: format single num field value to string to have it parsed back later on
     ostringstream str;
     // convert value to dpt
-    auto lengthFlag = sit->second.lengthFlag;
+    auto lengthFlag = grpInfo.lengthFlag;
     if (lengthFlag.isFloat || lengthFlag.hasDivisor) {
       float fval;
       if (lengthFlag.length == 2) {
@@ -713,12 +852,11 @@ void KnxHandler::handleGroupTelegram(knx_addr_t src, knx_addr_t dest, int len, c
         str << static_cast<uint32_t>(value);
       }
     }
-    res = m_busHandler->readFromBus(msg, str.str());
-    if (res == RESULT_OK) {
-      logOtherDebug("knx", "wrote %s %s", circuit.c_str(), name.c_str());
-    } else {
-      logOtherError("knx", "write %s %s: %s", circuit.c_str(), name.c_str(), getResultCode(res));
+    if (deferWrite(msg, str.str())) {
+      return;
     }
+    res = m_busHandler->readFromBus(msg, str.str());
+    notifyDeferredWrite(msg, str.str(), res);
     return;
   }
   logOtherNotice("knx", "received read request from %4.4x to %4.4x for %s/%s/%s",
@@ -738,12 +876,21 @@ void KnxHandler::handleGroupTelegram(knx_addr_t src, knx_addr_t dest, int len, c
   res = msg->decodeLastDataNumField(nullptr, fieldIndex, &value);
   if (res == RESULT_OK) {
     logOtherDebug("knx", "read %s %s", circuit.c_str(), name.c_str());
-    res = sendGroupValue(dest, APCI_GROUPVALUE_RESPONSE, sit->second.lengthFlag, value, field);
+    res = sendGroupValue(dest, APCI_GROUPVALUE_RESPONSE, grpInfo.lengthFlag, value, field);
   } else {
     logOtherError("knx", "read %s %s: %s", circuit.c_str(), name.c_str(), getResultCode(res));
   }
 }
 
+void KnxHandler::notifyDeferredWrite(Message* message, const string& input, result_t result) {
+  if (result == RESULT_OK) {
+    logOtherDebug("knx", "wrote %s %s", message->getCircuit().c_str(), message->getName().c_str());
+  } else {
+    logOtherError("knx", "write %s %s: %s", message->getCircuit().c_str(), message->getName().c_str(),
+        getResultCode(result));
+  }
+}
+
 // interval in seconds for sending the uptime value
 #define UPTIME_INTERVAL 3600
 
@@ -756,6 +903,8 @@ void KnxHandler::run() {
   uint8_t data[256];
   int len = 0;
   time_t definitionsSince = 0;
+  uint64_t definitionsGeneration = 0;
+  vector<fieldValue_t> values;
   while (isRunning()) {
     bool wasConnected = m_con->isConnected();
     bool needsWait = true;
@@ -787,6 +936,7 @@ void KnxHandler::run() {
       lastTaskRun = now;
     } else if (now > lastTaskRun+(m_scanFinishReceived ? 1 : 15)) {
       m_scanFinishReceived = false;
+      m_memoryUsage = calcMemoryUsage();
       if (m_con->isConnected()) {
         sendSignal = true;
         if (now > lastUptime + UPTIME_INTERVAL) {
@@ -796,10 +946,12 @@ void KnxHandler::run() {
       }
       if (m_con->isConnected() && definitionsSince == 0) {
         definitionsSince = 1;
+        definitionsGeneration = 0;
       }
       if (m_con->isConnected()) {
         deque<Message*> messages;
-        m_messages->findAll("", "", m_levels, false, true, true, true, true, true, 0, 0, true, &messages);
+        // only check the messages added since the last run (or all after reloading the configuration)
+        m_messages->findAllAdded(&definitionsGeneration, m_levels, true, &messages);
         int addCnt = 0;
         for (const auto& message : messages) {
           const auto mit = m_subscribedMessages.find(message->getKey());
@@ -813,6 +965,10 @@ void KnxHandler::run() {
           if (message->getCreateTime() <= definitionsSince) {  // only newer defined
             continue;
           }
+          const string prefix = message->getCircuit()+"/"+message->getName();
+          if (m_messageGroupNames.find(prefix) == m_messageGroupNames.cend()) {
+            continue;  // no field assigned
+          }
           ssize_t fieldCount = static_cast<signed>(message->getFieldCount());
           if (isWrite && fieldCount > 1) {
             // impossible with more than one field
@@ -828,7 +984,7 @@ void KnxHandler::run() {
             if (fieldName.empty() && fieldCount == 1) {
               fieldName = "0";  // might occur for unnamed single field sets
             }
-            string key = message->getCircuit()+"/"+message->getName()+"/"+fieldName;
+            string key = prefix+"/"+fieldName;
             const auto git = m_messageFieldGroupAddress.find(key);
             if (git == m_messageFieldGroupAddress.cend()) {
               continue;
@@ -842,31 +998,33 @@ void KnxHandler::run() {
             // store association
             knx_addr_t dest = git->second;
             auto subKey = static_cast<uint32_t>(dest | (isWrite ? FLAG_WRITE : FLAG_READ));
-            auto sit = m_subscribedGroups.find(subKey);
-            if (sit != m_subscribedGroups.cend()) {
+            size_t slot = getGroupSlot(subKey);
+            if (slot) {
               if (isWrite) {
                 logOtherDebug("knx", "ignored already subscribed %s", key.c_str());
                 continue;
               }
-              if (sit->second.messageKey == message->getKey()) {
+              if (m_groups[slot-1].messageKey == message->getKey()) {
                 continue;
               }  // else: overwrite "write-read" with readable message
               logOtherDebug("knx", "replacing write-read association %s to %4.4x", key.c_str(), dest);
             }
-            groupInfo_t grpInfo;
+            groupInfo_t grpInfo = {};
             grpInfo.messageKey = message->getKey();
             grpInfo.globalIndex = static_cast<global_t>(index);
             grpInfo.lengthFlag = lengthFlag;
-            m_subscribedGroups[subKey] = grpInfo;
-            m_subscribedMessages[message->getKey()].push_back(subKey);
+            grpInfo.destFlags = subKey;
+            slot = setGroup(grpInfo);
+            if (!slot) {
+              continue;
+            }
+            m_subscribedMessages[message->getKey()].push_back(static_cast<uint16_t>(slot));
             logOtherDebug("knx", "added %s association %s to %4.4x", isWrite ? "write" : "read", key.c_str(), dest);
             if (isWrite) {
               // add "write-read" association to allow reading the last written value of a writable message
               // when there is no readable message set directly yet
-              subKey = static_cast<uint32_t>(dest | FLAG_READ);
-              sit = m_subscribedGroups.find(subKey);
-              if (sit == m_subscribedGroups.cend()) {
-                m_subscribedGroups[subKey] = grpInfo;
+              grpInfo.destFlags = subKey = static_cast<uint32_t>(dest | FLAG_READ);
+              if (!getGroupSlot(subKey) && setGroup(grpInfo)) {
                 logOtherDebug("knx", "added write-read association %s to %4.4x", key.c_str(), dest);
               }
             }
@@ -878,17 +1036,21 @@ void KnxHandler::run() {
           }
           if (message->getLastUpdateTime() > message->getCreateTime()) {
             // ensure data is published as well
+            m_updatesMutex.lock();
             m_updatedMessages[message->getKey()]++;
+            m_updatesMutex.unlock();
           } else if (message->isWrite()) {
             // publish data for read pendant of write message
             Message* read = m_messages->find(message->getCircuit(), message->getName(), "", false);
             if (read && read->getLastUpdateTime() > 0) {
+              m_updatesMutex.lock();
               m_updatedMessages[read->getKey()]++;
+              m_updatesMutex.unlock();
             }
           }
         }
         if (addCnt > 0) {
-          logOtherInfo("knx", "added %d associations, %d active now", addCnt, m_subscribedGroups.size());
+          logOtherInfo("knx", "added %d associations, %d active now", addCnt, m_groups.size());
         }
         definitionsSince = now;
         needsWait = true;
@@ -921,8 +1083,9 @@ void KnxHandler::run() {
       // APDU data starting with octet 6 according to spec, contains 2 bits of application layer
       // limit number of read telegrams in order to give back control to outer loop for checking updates etc
       for (int count = 0; count < 10; count++) {
-        // wait for telegram on first iteration only
-        result_t res = receiveTelegram(sizeof(data), &typ, data, &len, &src, &dest, count == 0);
+        // wait for telegram on first iteration only (and not with deferred writes or group values pending)
+        result_t res = receiveTelegram(sizeof(data), &typ, data, &len, &src, &dest,
+            count == 0 && !hasDeferredWrites() && m_pendingGroups.empty());
         if (res != RESULT_OK) {
           if (res == RESULT_ERR_GENERIC_IO) {
             m_con->close();
@@ -933,8 +1096,10 @@ void KnxHandler::run() {
         handleReceivedTelegram(typ, src, dest, len, data);
       }
     }
+    writeDeferred(m_messages);
     if (!m_updatedMessages.empty()) {
-      m_messages->lock();
+      m_messages->lockShared();
+      m_updatesMutex.lock();
       if (m_con->isConnected()) {
         for (auto it = m_updatedMessages.begin(); it != m_updatedMessages.end(); ) {
           const vector<Message*>* messages = m_messages->getByKey(it->first);
@@ -955,20 +1120,25 @@ void KnxHandler::run() {
             } else if (message->getLastChangeTime() <= lastUpdates) {
               continue;
             }
-            for (auto destFlags : mit->second) {
-              auto sit = m_subscribedGroups.find(destFlags);
-              if (sit == m_subscribedGroups.end()) {
+            // decode all fields at once instead of once per subscribed group (fields failing to decode are skipped
+            // below)
+            if (message->decodeLastDataValues(&values) == RESULT_EMPTY) {
+              continue;
+            }
+            for (auto slot : mit->second) {
+              const groupInfo_t& grpInfo = m_groups[slot-1];
+              if (grpInfo.messageKey != message->getKey()) {
+                continue;  // replaced by another message
+              }
+              ssize_t index = grpInfo.fieldIndex;
+              if (index < 0 || static_cast<size_t>(index) >= values.size()) {
                 continue;
               }
-              ssize_t index = sit->second.fieldIndex;
-              const SingleDataField *field = message->getField(index);
-              if (!field || field->isIgnored()) {
+              const fieldValue_t& value = values[index];
+              if (!value.field || value.field->isIgnored()) {
                 continue;
               }
-              knx_addr_t dest = destFlags&0xffff;
-              unsigned int value = 0;
-              result = message->decodeLastDataNumField(nullptr, index, &value);
-              sendGroupValue(dest, APCI_GROUPVALUE_WRITE, sit->second.lengthFlag, value, field);
+              queueGroupValue(slot, value.rawValue, value.field);
             }
           }
           it = m_updatedMessages.erase(it);
@@ -977,8 +1147,10 @@ void KnxHandler::run() {
       } else {
         m_updatedMessages.clear();
       }
-      m_messages->unlock();
+      m_updatesMutex.unlock();
+      m_messages->unlockShared();
     }
+    sendPendingGroupValues();
     if ((!m_con->isConnected() && !Wait(5)) || (needsWait && !Wait(0, 100))
     ) {
       break;
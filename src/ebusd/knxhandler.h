@@ -19,10 +19,14 @@
 #ifndef EBUSD_KNXHANDLER_H_
 #define EBUSD_KNXHANDLER_H_
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <list>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include "ebusd/datahandler.h"
 #include "ebusd/bushandler.h"
@@ -39,6 +43,9 @@ namespace ebusd {
 using std::map;
 using std::string;
 using std::vector;
+using std::deque;
+using std::unordered_map;
+using std::unordered_set;
 
 /**
  * Helper function for getting the argp definition for KNX.
@@ -81,6 +88,12 @@ enum apci_t {
 #define FLAG_READ 0x400000
 #define FLAG_WRITE 0x800000
 
+/** the number of entries in the group address table (one per 16 bit group address and direction). */
+#define GROUP_TABLE_SIZE 0x20000
+
+/** the maximum number of group subscriptions (limited by the slot type of the group address table). */
+#define MAX_GROUP_SLOTS 0xffff
+
 /** datatype length flags (byte length on KNX in bits 0-3, extra info in higher bits). */
 typedef struct {
   bool hasDivisor: 1;
@@ -112,6 +125,9 @@ typedef struct {
     global_t globalIndex;  // global value index
   };
   dtlf_t lengthFlag;  // telegram length and flags
+  uint32_t destFlags;  // group address in lower 16 bits and FLAG_READ or FLAG_WRITE
+  bool pending;  // whether the pending value still needs to be sent
+  uint32_t pendingValue;  // the pending value already converted to the datapoint type
 } groupInfo_t;
 
 
@@ -143,6 +159,9 @@ class KnxHandler : public DataSink, public DataSource, public WaitThread {
   // @copydoc
   void notifyScanStatus(scanStatus_t scanStatus) override;
 
+  // @copydoc
+  size_t getMemoryUsage() const override { return m_memoryUsage; }
+
   /**
    * Send a group value.
    * @param dest the destination group address.
@@ -155,6 +174,27 @@ class KnxHandler : public DataSink, public DataSource, public WaitThread {
   result_t sendGroupValue(knx_addr_t dest, apci_t apci, dtlf_t& lengthFlag, unsigned int value,
   const SingleDataField *field = nullptr) const;
 
+  /**
+   * Convert a raw value to the datapoint type of a group.
+   * @param lengthFlag the datatype length flag.
+   * @param value the raw value.
+   * @param field the message field or nullptr for non field related.
+   * @param converted pointer to a variable in which to store the converted value.
+   * @return the result code.
+   */
+  static result_t convertGroupValue(const dtlf_t& lengthFlag, unsigned int value, const SingleDataField *field,
+  unsigned int* converted);
+
+  /**
+   * Send a group value already converted to the datapoint type.
+   * @param dest the destination group address.
+   * @param apci the APCI value.
+   * @param lengthFlag the datatype length flag.
+   * @param value the converted value.
+   * @return the result code.
+   */
+  result_t sendConvertedGroupValue(knx_addr_t dest, apci_t apci, dtlf_t& lengthFlag, unsigned int value) const;
+
   /**
    * Send a global value to the registered group address.
    * @param index the global value index to send.
@@ -191,6 +231,9 @@ class KnxHandler : public DataSink, public DataSource, public WaitThread {
   // @copydoc
   void run() override;
 
+  // @copydoc
+  void notifyDeferredWrite(Message* message, const string& input, result_t result) override;
+
   /**
    * Handle a received non-group telegram when the device has an individual address and is programmable.
    * @param typ the transfer data type.
@@ -216,6 +259,42 @@ class KnxHandler : public DataSink, public DataSource, public WaitThread {
    */
   void handleGroupTelegram(knx_addr_t src, knx_addr_t dest, int len, const uint8_t *data);
 
+  /**
+   * Get the subscription of a group address.
+   * @param destFlags the group address in lower 16 bits and @a FLAG_READ or @a FLAG_WRITE.
+   * @return the index in @a m_groups plus one, or 0 if not subscribed.
+   */
+  size_t getGroupSlot(uint32_t destFlags) const {
+    return m_groupTable[(destFlags&0xffff) | ((destFlags&FLAG_WRITE) ? 0x10000 : 0)];
+  }
+
+  /**
+   * Add a subscription of a group address or replace an existing one.
+   * @param grpInfo the @a groupInfo_t with the group address and direction in destFlags.
+   * @return the index in @a m_groups plus one, or 0 if the maximum number of subscriptions was reached.
+   */
+  size_t setGroup(const groupInfo_t& grpInfo);
+
+  /**
+   * Queue a group value write for sending with @a sendPendingGroupValues().
+   * A value still pending for the same group is replaced.
+   * @param slot the index in @a m_groups plus one.
+   * @param value the raw value.
+   * @param field the message field.
+   */
+  void queueGroupValue(size_t slot, unsigned int value, const SingleDataField *field);
+
+  /**
+   * Send the pending group value writes within the limit of the send rate.
+   */
+  void sendPendingGroupValues();
+
+  /**
+   * Calculate the estimated memory used by the state (only to be called from the handler thread).
+   * @return the estimated number of bytes.
+   */
+  size_t calcMemoryUsage();
+
  private:
   /** the @a MessageMap instance. */
   MessageMap* m_messages;
@@ -224,23 +303,35 @@ class KnxHandler : public DataSink, public DataSource, public WaitThread {
   StringReplacers m_replacers;
 
   /** the group address for relevant message fields before being subscribed to by "circuit/message/field" name. */
-  map<string, knx_addr_t> m_messageFieldGroupAddress;
+  unordered_map<string, knx_addr_t> m_messageFieldGroupAddress;
+
+  /** the "circuit/message" names having at least one field in @a m_messageFieldGroupAddress. */
+  unordered_set<string> m_messageGroupNames;
+
+  /** the subscribed groups that need to be responded to (index by slot minus one, references stay valid). */
+  deque<groupInfo_t> m_groups;
 
   /**
-   * the group addresses that need to be responded to.
-   * key is the group address in lower 16 bits, and flags in upper 16 bits with:
-   * - read direction in bit 6 (<<16),
-   * - write direction in bit 7 (<<16).
+   * the slot in @a m_groups (index plus one) or 0 for all group addresses and directions.
+   * index is the group address in lower 16 bits and the write direction in bit 16.
    * this way read and write may be mapped to different messages.
-   * value contains the message key and additional infos.
    */
-  map<uint32_t, groupInfo_t>m_subscribedGroups;
+  vector<uint16_t> m_groupTable;
+
+  /** the slots in @a m_groups by subscribed message key. */
+  unordered_map<uint64_t, vector<uint16_t>> m_subscribedMessages;
+
+  /** the entry in @a m_groups by subscribed global values. */
+  map<global_t, groupInfo_t*>m_subscribedGlobals;
 
-  /** the group address and flags (key of m_subscribedGroups) by subscribed message key. */
-  map<uint64_t, list<uint32_t> >m_subscribedMessages;
+  /** the slots in @a m_groups with a pending value in the order of queueing. */
+  deque<uint16_t> m_pendingGroups;
 
-  /** the group address and flags (key of m_subscribedGroups) by subscribed global values. */
-  map<global_t, uint32_t>m_subscribedGlobals;
+  /** the number of group value writes that may be sent right now according to the send rate. */
+  float m_sendAllowance;
+
+  /** the system time in milliseconds of the last update of @a m_sendAllowance. */
+  uint64_t m_sendAllowanceTime;
 
   /** the time the run thread was entered. */
   time_t m_start;
@@ -277,6 +368,9 @@ class KnxHandler : public DataSink, public DataSource, public WaitThread {
 
   /** the last system time when a communication error was logged. */
   time_t m_lastErrorLogTime;
+
+  /** the estimated memory used by the state, updated periodically by the handler thread. */
+  std::atomic<size_t> m_memoryUsage;
 };
 
 }  // namespace ebusd
@@ -23,8 +23,10 @@
 #include "ebusd/main.h"
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <argp.h>
 #include <csignal>
+#include <cerrno>
 #include <iostream>
 #include <algorithm>
 #include <iomanip>
@@ -34,6 +36,7 @@
 #include "ebusd/network.h"
 #include "lib/utils/log.h"
 #include "lib/utils/httpclient.h"
+#include "lib/utils/trace.h"
 #include "ebusd/scan.h"
 
 
@@ -89,6 +92,7 @@ static struct options s_opt = {
   false,  // readOnly
   false,  // initialSend
   0,  // extraLatency
+  false,  // burstSend
 
   false,  // scanConfig
   0,  // initialScan
@@ -96,6 +100,9 @@ static struct options s_opt = {
   false,  // checkConfig
   OF_NONE,  // dumpConfig
   nullptr,  // dumpConfigTo
+  nullptr,  // configCache
+  nullptr,  // httpCache
+  false,  // lazyConfig
   5,  // pollInterval
   false,  // injectMessages
   false,  // stopAfterInject
@@ -108,8 +115,14 @@ static struct options s_opt = {
   3,  // acquireRetries
   2,  // sendRetries
   SLAVE_RECV_TIMEOUT*5/3,  // receiveTimeout
+  0,  // writeCoalesce
   0,  // masterCount
   false,  // generateSyn
+  1000,  // grabSize
+  1,  // grabHistory
+  0,  // historySize
+  0,  // busPriority
+  0,  // busCpus
 
   "",  // accessLevel
   "",  // aclFile
@@ -120,22 +133,35 @@ static struct options s_opt = {
   8888,  // port
   false,  // localOnly
   0,  // httpPort
+  0,  // rawPort
+  nullptr,  // socketPath
+  nullptr,  // httpSocketPath
+  0660,  // socketMode
+  false,  // reactor
   "/var/" PACKAGE "/html",  // htmlPath
   true,  // updateCheck
+  nullptr,  // stateFile
+  false,  // lockMemory
 
   PACKAGE_LOGFILE,  // logFile
   -1,  // logAreas
   ll_COUNT,  // logLevel
   false,  // multiLog
+  0,  // logBuffer
+  0,  // traceSize
 
   0,  // logRaw
   PACKAGE_LOGFILE,  // logRawFile
   100,  // logRawSize
+  0,  // logRawBuffer
+  false,  // logRawCompress
 
   false,  // dump
   "/tmp/" PACKAGE "_dump.bin",  // dumpFile
   100,  // dumpSize
   false,  // dumpFlush
+  0,  // dumpBuffer
+  false,  // dumpCompress
 };
 
 /** the @a MessageMap instance, or nullptr. */
@@ -145,7 +171,7 @@ static MessageMap* s_messageMap = nullptr;
 static ScanHelper* s_scanHelper = nullptr;
 
 /** the @a Request @a Queue instance, or nullptr. */
-static Queue<Request*>* s_requestQueue = nullptr;
+static BoundedQueue<Request*>* s_requestQueue = nullptr;
 
 /** the @a MainLoop instance, or nullptr. */
 static MainLoop* s_mainLoop = nullptr;
@@ -153,20 +179,33 @@ static MainLoop* s_mainLoop = nullptr;
 /** the @a Network instance, or nullptr. */
 static Network* s_network = nullptr;
 
+/** the @a RowCache instance for the config files, or nullptr. */
+static RowCache* s_rowCache = nullptr;
+
 /** the (optionally corrected) config path for retrieving configuration files from. */
 static string s_configPath = CONFIG_PATH;
 
+/** whether the device was explicitly given on the command line. */
+static bool s_deviceGiven = false;
+
+/** the names of devices for additional bus segments. */
+static vector<const char*> s_otherDeviceNames;
+
 /** the documentation of the program. */
 static const char argpdoc[] =
   "A daemon for communication with eBUS heating systems.";
 
 #define O_INISND -2
 #define O_DEVLAT (O_INISND-1)
-#define O_CFGLNG (O_DEVLAT-1)
+#define O_BURSND (O_DEVLAT-1)
+#define O_CFGLNG (O_BURSND-1)
 #define O_CHKCFG (O_CFGLNG-1)
 #define O_DMPCFG (O_CHKCFG-1)
 #define O_DMPCTO (O_DMPCFG-1)
-#define O_POLINT (O_DMPCTO-1)
+#define O_CFGCAC (O_DMPCTO-1)
+#define O_HTTPCA (O_CFGCAC-1)
+#define O_LAZCFG (O_HTTPCA-1)
+#define O_POLINT (O_LAZCFG-1)
 #define O_CAFILE (O_POLINT-1)
 #define O_CAPATH (O_CAFILE-1)
 #define O_ANSWER (O_CAPATH-1)
@@ -174,26 +213,45 @@ static const char argpdoc[] =
 #define O_ACQRET (O_ACQTIM-1)
 #define O_SNDRET (O_ACQRET-1)
 #define O_RCVTIM (O_SNDRET-1)
-#define O_MASCNT (O_RCVTIM-1)
+#define O_WRTCOA (O_RCVTIM-1)
+#define O_MASCNT (O_WRTCOA-1)
 #define O_GENSYN (O_MASCNT-1)
-#define O_ACLDEF (O_GENSYN-1)
+#define O_GRBSIZ (O_GENSYN-1)
+#define O_GRBHIS (O_GRBSIZ-1)
+#define O_HISSIZ (O_GRBHIS-1)
+#define O_BUSPRI (O_HISSIZ-1)
+#define O_BUSCPU (O_BUSPRI-1)
+#define O_ACLDEF (O_BUSCPU-1)
 #define O_ACLFIL (O_ACLDEF-1)
 #define O_HEXCMD (O_ACLFIL-1)
 #define O_DEFCMD (O_HEXCMD-1)
 #define O_PIDFIL (O_DEFCMD-1)
 #define O_LOCAL  (O_PIDFIL-1)
 #define O_HTTPPT (O_LOCAL-1)
-#define O_HTMLPA (O_HTTPPT-1)
+#define O_RAWPRT (O_HTTPPT-1)
+#define O_SOCKPA (O_RAWPRT-1)
+#define O_HTTPSO (O_SOCKPA-1)
+#define O_SOCKMO (O_HTTPSO-1)
+#define O_REACTR (O_SOCKMO-1)
+#define O_HTMLPA (O_REACTR-1)
 #define O_UPDCHK (O_HTMLPA-1)
-#define O_LOG    (O_UPDCHK-1)
+#define O_STATEF (O_UPDCHK-1)
+#define O_MEMLCK (O_STATEF-1)
+#define O_LOG    (O_MEMLCK-1)
 #define O_LOGARE (O_LOG-1)
 #define O_LOGLEV (O_LOGARE-1)
-#define O_RAW    (O_LOGLEV-1)
+#define O_LOGBUF (O_LOGLEV-1)
+#define O_TRCSIZ (O_LOGBUF-1)
+#define O_RAW    (O_TRCSIZ-1)
 #define O_RAWFIL (O_RAW-1)
 #define O_RAWSIZ (O_RAWFIL-1)
-#define O_DMPFIL (O_RAWSIZ-1)
+#define O_RAWBUF (O_RAWSIZ-1)
+#define O_RAWCMP (O_RAWBUF-1)
+#define O_DMPFIL (O_RAWCMP-1)
 #define O_DMPSIZ (O_DMPFIL-1)
 #define O_DMPFLU (O_DMPSIZ-1)
+#define O_DMPBUF (O_DMPFLU-1)
+#define O_DMPCMP (O_DMPBUF-1)
 
 /** the definition of the known program arguments. */
 static const struct argp_option argpoptions[] = {
@@ -201,11 +259,17 @@ static const struct argp_option argpoptions[] = {
   {"device",         'd',      "DEV",      0, "Use DEV as eBUS device ("
       "\"enh:DEVICE\" or \"enh:IP:PORT\" for enhanced device, "
       "\"ens:DEVICE\" for enhanced high speed serial device, "
-      "\"DEVICE\" for serial device, or \"[udp:]IP:PORT\" for network device) [/dev/ttyUSB0]", 0 },
+      "\"DEVICE\" for serial device, \"[udp:]IP:PORT\" for network device, \"replay:[FACTOR:]FILE\" for "
+      "replaying a dump FILE read-only at FACTOR times the bus speed (0 for as fast as possible), or "
+      "\"sim:[KEY=VALUE[,KEY=VALUE]*:]FILE\" for a simulated bus with slaves answering from definition FILE with "
+      "latency=MS, collision=PERCENT, nak=PERCENT, traffic=PERCENT, and syn=MS). Can be given multiple times for "
+      "several bus segments sharing the same configuration [/dev/ttyUSB0]", 0 },
   {"nodevicecheck",  'n',      nullptr,    0, "Skip serial eBUS device test", 0 },
   {"readonly",       'r',      nullptr,    0, "Only read from device, never write to it", 0 },
   {"initsend",       O_INISND, nullptr,    0, "Send an initial escape symbol after connecting device", 0 },
   {"latency",        O_DEVLAT, "MSEC",     0, "Extra transfer latency in ms [0]", 0 },
+  {"burstsend",      O_BURSND, nullptr,    0, "Send the remainder of a telegram in chunks to an enhanced device "
+      "and verify the echo of each chunk before sending the next one", 0 },
 
   {nullptr,          0,        nullptr,    0, "Message configuration options:", 2 },
   {"configpath",     'c',      "PATH",     0, "Read CSV config files from PATH (local folder or HTTPS URL) ["
@@ -220,6 +284,11 @@ static const struct argp_option argpoptions[] = {
   {"dumpconfig",     O_DMPCFG, "FORMAT", OPTION_ARG_OPTIONAL,
       "Check and dump config files in FORMAT (\"json\" or \"csv\"), then stop", 0 },
   {"dumpconfigto",   O_DMPCTO, "FILE",     0, "Dump config files to FILE", 0 },
+  {"configcache",    O_CFGCAC, "FILE",     0, "Cache the parsed rows of config files in FILE for faster startup", 0 },
+  {"httpcache",      O_HTTPCA, "PATH",     0, "Cache config files retrieved from HTTPS in PATH for revalidation and "
+      "offline use", 0 },
+  {"lazyconfig",     O_LAZCFG, nullptr,    0, "Only index CSV config files in subdirectories on startup and read them "
+      "when their slave address is seen or their circuit is used (without scanconfig)", 0 },
   {"pollinterval",   O_POLINT, "SEC",      0, "Poll for data every SEC seconds (0=disable) [5]", 0 },
   {"inject",         'i',      "stop", OPTION_ARG_OPTIONAL, "Inject remaining arguments as already seen messages (e.g. "
       "\"FF08070400/0AB5454850303003277201\"), optionally stop afterwards", 0 },
@@ -236,8 +305,18 @@ static const struct argp_option argpoptions[] = {
   {"acquireretries", O_ACQRET, "COUNT",    0, "Retry bus acquisition COUNT times [3]", 0 },
   {"sendretries",    O_SNDRET, "COUNT",    0, "Repeat failed sends COUNT times [2]", 0 },
   {"receivetimeout", O_RCVTIM, "MSEC",     0, "Expect a slave to answer within MSEC ms [25]", 0 },
+  {"writecoalesce",  O_WRTCOA, "MSEC",     0, "Defer writes from data sources (e.g. MQTT) for MSEC ms and only "
+      "send the last one of the same message (0=disable) [0]", 0 },
   {"numbermasters",  O_MASCNT, "COUNT",    0, "Expect COUNT masters on the bus, 0 for auto detection [0]", 0 },
   {"generatesyn",    O_GENSYN, nullptr,    0, "Enable AUTO-SYN symbol generation", 0 },
+  {"grabsize",       O_GRBSIZ, "COUNT",    0, "Keep at most COUNT grabbed messages, dropping the least recently "
+      "seen ones [1000]", 0 },
+  {"grabhistory",    O_GRBHIS, "COUNT",    0, "Keep the last COUNT telegrams of each grabbed message [1]", 0 },
+  {"historysize",    O_HISSIZ, "COUNT",    0, "Keep the last COUNT updates of each message in memory (0=disable) [0]",
+      0 },
+  {"busprio",        O_BUSPRI, "PRIO",     0, "Run the bus handling thread with real-time (SCHED_FIFO) priority PRIO "
+      "from 1 to 99 (0=default scheduling) [0]", 0 },
+  {"buscpus",        O_BUSCPU, "LIST",     0, "Pin the bus handling thread to the CPUs in LIST (e.g. \"1,3-4\")", 0 },
 
   {nullptr,          0,        nullptr,    0, "Daemon options:", 4 },
   {"accesslevel",    O_ACLDEF, "LEVEL",    0, "Set default access level to LEVEL (\"*\" for everything) [\"\"]", 0 },
@@ -249,8 +328,17 @@ static const struct argp_option argpoptions[] = {
   {"port",           'p',      "PORT",     0, "Listen for command line connections on PORT [8888]", 0 },
   {"localhost",      O_LOCAL,  nullptr,    0, "Listen for command line connections on 127.0.0.1 interface only", 0 },
   {"httpport",       O_HTTPPT, "PORT",     0, "Listen for HTTP connections on PORT, 0 to disable [0]", 0 },
+  {"rawport",        O_RAWPRT, "PORT",     0, "Stream the raw telegrams seen on the bus to connections on PORT, 0 to "
+      "disable [0]", 0 },
+  {"socketpath",     O_SOCKPA, "PATH",     0, "Listen for command line connections on Unix domain socket PATH", 0 },
+  {"httpsocketpath", O_HTTPSO, "PATH",     0, "Listen for HTTP connections on Unix domain socket PATH", 0 },
+  {"socketmode",     O_SOCKMO, "MODE",     0, "Set the permissions of the Unix domain sockets to octal MODE [660]", 0 },
+  {"reactor",        O_REACTR, nullptr,    0, "Handle all client connections in a single event loop thread", 0 },
   {"htmlpath",       O_HTMLPA, "PATH",     0, "Path for HTML files served by HTTP port [/var/ebusd/html]", 0 },
   {"updatecheck",    O_UPDCHK, "MODE",     0, "Set automatic update check to MODE (on|off) [on]", 0 },
+  {"statefile",      O_STATEF, "FILE",     0, "Persist the last data of messages and the scan results in FILE "
+      "periodically and on shutdown for restoring them on startup", 0 },
+  {"lockmemory",     O_MEMLCK, nullptr,    0, "Lock all memory pages in RAM for avoiding page faults", 0 },
 
   {nullptr,          0,        nullptr,    0, "Log options:", 5 },
   {"logfile",        'l',      "FILE",     0, "Write log to FILE (only for daemon, empty string for using syslog) ["
@@ -261,18 +349,28 @@ static const struct argp_option argpoptions[] = {
       "|all [all]", 0 },
   {"loglevel",       O_LOGLEV, "LEVEL",    0, "Only write log below or equal to LEVEL: error|notice|info|debug"
       " [notice]", 0 },
+  {"logbuffer",      O_LOGBUF, "COUNT",    0, "Write log asynchronously with a buffer of COUNT records per thread"
+      " (0 for writing synchronously) [0]", 0 },
+  {"tracesize",      O_TRCSIZ, "COUNT",    0, "Keep the last COUNT bus state transitions, arbitrations, and request"
+      " lifecycles for retrieval in Chrome trace format via HTTP \"/trace\" (0 to disable) [0]", 0 },
 
   {nullptr,          0,        nullptr,    0, "Raw logging options:", 6 },
   {"lograwdata",     O_RAW,    "bytes", OPTION_ARG_OPTIONAL,
       "Log messages or all received/sent bytes on the bus", 0 },
   {"lograwdatafile", O_RAWFIL, "FILE",     0, "Write raw log to FILE [" PACKAGE_LOGFILE "]", 0 },
   {"lograwdatasize", O_RAWSIZ, "SIZE",     0, "Make raw log file no larger than SIZE kB [100]", 0 },
+  {"lograwdatabuffer", O_RAWBUF, "SECONDS", 0, "Buffer raw log in blocks and flush at least every SECONDS"
+      " (0 for flushing each line) [0]", 0 },
+  {"lograwdatacompress", O_RAWCMP, nullptr, 0, "Compress rotated raw log file with gzip", 0 },
 
   {nullptr,          0,        nullptr,    0, "Binary dump options:", 7 },
   {"dump",           'D',      nullptr,    0, "Enable binary dump of received bytes", 0 },
   {"dumpfile",       O_DMPFIL, "FILE",     0, "Dump received bytes to FILE [/tmp/" PACKAGE "_dump.bin]", 0 },
   {"dumpsize",       O_DMPSIZ, "SIZE",     0, "Make dump file no larger than SIZE kB [100]", 0 },
   {"dumpflush",      O_DMPFLU, nullptr,    0, "Flush each byte", 0 },
+  {"dumpbuffer",     O_DMPBUF, "SECONDS",  0, "Buffer dump in blocks and flush at least every SECONDS"
+      " (0 for flushing every 16 bytes) [0]", 0 },
+  {"dumpcompress",   O_DMPCMP, nullptr,    0, "Compress rotated dump file with gzip", 0 },
 
   {nullptr,          0,        nullptr,    0, nullptr, 0 },
 };
@@ -295,6 +393,11 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
       argp_error(state, "invalid device");
       return EINVAL;
     }
+    if (s_deviceGiven) {
+      s_otherDeviceNames.push_back(arg);
+      break;
+    }
+    s_deviceGiven = true;
     opt->device = arg;
     break;
   case 'n':  // --nodevicecheck
@@ -323,6 +426,9 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     }
     opt->extraLatency = value > 1000 ? value/1000 : value;  // backwards compatible (micros)
     break;
+  case O_BURSND:  // --burstsend
+    opt->burstSend = true;
+    break;
 
   // Message configuration options:
   case 'c':  // --configpath=https://cfg.ebusd.eu/
@@ -396,6 +502,23 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     }
     opt->dumpConfigTo = arg;
     break;
+  case O_CFGCAC:  // --configcache=FILE
+    if (!arg || arg[0] == 0) {
+      argp_error(state, "invalid configcache");
+      return EINVAL;
+    }
+    opt->configCache = arg;
+    break;
+  case O_HTTPCA:  // --httpcache=PATH
+    if (!arg || arg[0] == 0) {
+      argp_error(state, "invalid httpcache");
+      return EINVAL;
+    }
+    opt->httpCache = arg;
+    break;
+  case O_LAZCFG:  // --lazyconfig
+    opt->lazyConfig = true;
+    break;
   case O_POLINT:  // --pollinterval=5
     value = parseInt(arg, 10, 0, 3600, &result);
     if (result != RESULT_OK) {
@@ -473,6 +596,14 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     }
     opt->receiveTimeout =  value > 1000 ? value/1000 : value;  // backwards compatible (micros)
     break;
+  case O_WRTCOA:  // --writecoalesce=0
+    value = parseInt(arg, 10, 0, 10000, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid writecoalesce");
+      return EINVAL;
+    }
+    opt->writeCoalesce = value;
+    break;
   case O_MASCNT:  // --numbermasters=0
     value = parseInt(arg, 10, 0, 25, &result);
     if (result != RESULT_OK) {
@@ -488,6 +619,44 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     }
     opt->generateSyn = true;
     break;
+  case O_GRBSIZ:  // --grabsize=1000
+    value = parseInt(arg, 10, 1, 100000, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid grabsize");
+      return EINVAL;
+    }
+    opt->grabSize = value;
+    break;
+  case O_GRBHIS:  // --grabhistory=1
+    value = parseInt(arg, 10, 1, 100, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid grabhistory");
+      return EINVAL;
+    }
+    opt->grabHistory = value;
+    break;
+  case O_HISSIZ:  // --historysize=0
+    value = parseInt(arg, 10, 0, 10000, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid historysize");
+      return EINVAL;
+    }
+    opt->historySize = value;
+    break;
+  case O_BUSPRI:  // --busprio=0
+    value = parseInt(arg, 10, 0, 99, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid busprio");
+      return EINVAL;
+    }
+    opt->busPriority = static_cast<int>(value);
+    break;
+  case O_BUSCPU:  // --buscpus=1
+    if (arg == nullptr || !Thread::parseCpuList(arg, &opt->busCpus)) {
+      argp_error(state, "invalid buscpus");
+      return EINVAL;
+    }
+    break;
 
   // Daemon options:
   case O_ACLDEF:  // --accesslevel=*
@@ -539,6 +708,39 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     }
     opt->httpPort = (uint16_t)value;
     break;
+  case O_RAWPRT:  // --rawport=0
+    value = parseInt(arg, 10, 0, 65535, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid rawport");
+      return EINVAL;
+    }
+    opt->rawPort = (uint16_t)value;
+    break;
+  case O_SOCKPA:  // --socketpath=/var/run/ebusd.sock
+    if (arg == nullptr || arg[0] == 0) {
+      argp_error(state, "invalid socketpath");
+      return EINVAL;
+    }
+    opt->socketPath = arg;
+    break;
+  case O_HTTPSO:  // --httpsocketpath=/var/run/ebusd-http.sock
+    if (arg == nullptr || arg[0] == 0) {
+      argp_error(state, "invalid httpsocketpath");
+      return EINVAL;
+    }
+    opt->httpSocketPath = arg;
+    break;
+  case O_SOCKMO:  // --socketmode=660
+    value = parseInt(arg, 8, 1, 0777, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid socketmode");
+      return EINVAL;
+    }
+    opt->socketMode = (mode_t)value;
+    break;
+  case O_REACTR:  // --reactor
+    opt->reactor = true;
+    break;
   case O_HTMLPA:  // --htmlpath=/var/ebusd/html
     if (arg == nullptr || arg[0] == 0 || strcmp("/", arg) == 0) {
       argp_error(state, "invalid htmlpath");
@@ -560,6 +762,16 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
       return EINVAL;
     }
     break;
+  case O_STATEF:  // --statefile=/var/ebusd/state
+    if (arg == nullptr || arg[0] == 0 || strcmp("/", arg) == 0) {
+      argp_error(state, "invalid statefile");
+      return EINVAL;
+    }
+    opt->stateFile = arg;
+    break;
+  case O_MEMLCK:  // --lockmemory
+    opt->lockMemory = true;
+    break;
 
   // Log options:
   case 'l':  // --logfile=/var/log/ebusd.log
@@ -626,6 +838,22 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     opt->logLevel = logLevel;
     break;
   }
+  case O_LOGBUF:  // --logbuffer=0
+    value = parseInt(arg, 10, 0, 100000, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid logbuffer");
+      return EINVAL;
+    }
+    opt->logBuffer = value;
+    break;
+  case O_TRCSIZ:  // --tracesize=0
+    value = parseInt(arg, 10, 0, 100000, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid tracesize");
+      return EINVAL;
+    }
+    opt->traceSize = value;
+    break;
 
   // Raw logging options:
   case O_RAW:  // --lograwdata
@@ -646,6 +874,17 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     }
     opt->logRawSize = value;
     break;
+  case O_RAWBUF:  // --lograwdatabuffer=0
+    value = parseInt(arg, 10, 0, 3600, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid lograwdatabuffer");
+      return EINVAL;
+    }
+    opt->logRawBuffer = value;
+    break;
+  case O_RAWCMP:  // --lograwdatacompress
+    opt->logRawCompress = true;
+    break;
 
 
   // Binary dump options:
@@ -668,8 +907,27 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     opt->dumpSize = value;
     break;
   case O_DMPFLU:  // --dumpflush
+    if (opt->dumpBuffer > 0) {
+      argp_error(state, "invalid dumpflush (combined with dumpbuffer)");
+      return EINVAL;
+    }
     opt->dumpFlush = true;
     break;
+  case O_DMPBUF:  // --dumpbuffer=0
+    value = parseInt(arg, 10, 0, 3600, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid dumpbuffer");
+      return EINVAL;
+    }
+    if (value > 0 && opt->dumpFlush) {
+      argp_error(state, "invalid dumpbuffer (combined with dumpflush)");
+      return EINVAL;
+    }
+    opt->dumpBuffer = value;
+    break;
+  case O_DMPCMP:  // --dumpcompress
+    opt->dumpCompress = true;
+    break;
 
   case ARGP_KEY_ARG:
     if (opt->injectMessages || (opt->checkConfig && opt->scanConfig)) {
@@ -766,6 +1024,14 @@ void cleanup() {
     delete s_scanHelper;
     s_scanHelper = nullptr;
   }
+  if (s_rowCache != nullptr) {
+    FileReader::setRowCache(nullptr);
+    if (!s_rowCache->save()) {
+      logError(lf_main, "unable to write config cache to %s", s_opt.configCache);
+    }
+    delete s_rowCache;
+    s_rowCache = nullptr;
+  }
 }
 
 /**
@@ -788,6 +1054,7 @@ void shutdown(bool error) {
   }
 
   logNotice(lf_main, "ebusd stopped");
+  stopAsyncLog();
   closeLogFile();
 
   exit(error ? EXIT_FAILURE : EXIT_SUCCESS);
@@ -798,32 +1065,16 @@ void shutdown(bool error) {
  * @param sig the received signal.
  */
 void signalHandler(int sig) {
+  // only flag the signal here as logging and locking are not async-signal-safe, the main loop handles it
   switch (sig) {
   case SIGHUP:
-    logNotice(lf_main, "SIGHUP received");
-    if (!s_opt.foreground && s_opt.logFile && s_opt.logFile[0] != 0) {  // for log file rotation
-      closeLogFile();
-      setLogFile(s_opt.logFile);
-    }
+    g_reopenLogSignal = 1;
     break;
   case SIGINT:
-    logNotice(lf_main, "SIGINT received");
-    if (s_mainLoop) {
-      s_mainLoop->shutdown();
-    } else {
-      shutdown();
-    }
-    break;
   case SIGTERM:
-    logNotice(lf_main, "SIGTERM received");
-    if (s_mainLoop) {
-      s_mainLoop->shutdown();
-    } else {
-      shutdown();
-    }
+    g_shutdownSignal = sig;
     break;
   default:
-    logNotice(lf_main, "undefined signal %s", strsignal(sig));
     break;
   }
 }
@@ -900,7 +1151,7 @@ int main(int argc, char* argv[], char* envp[]) {
   }
   const string lang = MappedFileReader::normalizeLanguage(
     s_opt.preferLanguage == nullptr || !s_opt.preferLanguage[0] ? "" : s_opt.preferLanguage);
-  string configLocalPrefix, configUriPrefix;
+  string configLocalPrefix, configUriPrefix, httpCachePath;
   HttpClient::initialize(s_opt.caFile, s_opt.caPath);
   HttpClient* configHttpClient = nullptr;
   if (s_configPath.find("://") == string::npos) {
@@ -935,22 +1186,46 @@ int main(int argc, char* argv[], char* envp[]) {
       // if that did not work, issue a single retry with higher timeout:
       && !configHttpClient->connect(configHost, configPort, proto == "https", PACKAGE_NAME "/" PACKAGE_VERSION, 8)
     ) {
-      logWrite(lf_main, ll_error, "invalid configPath URL (connect)");  // force logging on exit
-      delete configHttpClient;
-      cleanup();
-      return EINVAL;
+      if (!s_opt.httpCache) {
+        logWrite(lf_main, ll_error, "invalid configPath URL (connect)");  // force logging on exit
+        delete configHttpClient;
+        cleanup();
+        return EINVAL;
+      }
+      logNotice(lf_main, "configPath URL not reachable, using cached config files");
+    } else {
+      logInfo(lf_main, "configPath URL is valid");
     }
-    logInfo(lf_main, "configPath URL is valid");
     configHttpClient->disconnect();
+    if (s_opt.httpCache) {
+      httpCachePath = s_opt.httpCache;
+      if (httpCachePath[httpCachePath.length()-1] != '/') {
+        httpCachePath += "/";
+      }
+      if (mkdir(httpCachePath.c_str(), 0755) != 0 && errno != EEXIST) {
+        logError(lf_main, "unable to create HTTP cache path %s", httpCachePath.c_str());
+        httpCachePath = "";
+      }
+    }
   }
   if (!s_opt.readOnly && s_opt.scanConfig && s_opt.initialScan == 0) {
     s_opt.initialScan = BROADCAST;
   }
 
+  if (s_opt.configCache) {
+    s_rowCache = new RowCache(s_opt.configCache);
+    if (s_rowCache->load()) {
+      logInfo(lf_main, "using config cache %s", s_opt.configCache);
+    }
+    FileReader::setRowCache(s_rowCache);
+  }
   s_messageMap = new MessageMap(s_opt.checkConfig, lang);
   s_scanHelper = new ScanHelper(s_messageMap, s_configPath, configLocalPrefix, configUriPrefix,
-    lang.empty() ? lang : "?l=" + lang, configHttpClient, s_opt.checkConfig);
+    lang.empty() ? lang : "?l=" + lang, configHttpClient, s_opt.checkConfig, httpCachePath,
+    s_opt.lazyConfig && !s_opt.checkConfig && !s_opt.scanConfig);
   s_messageMap->setResolver(s_scanHelper);
+  s_messageMap->setHistorySize(s_opt.historySize);
+  Tracer::getInstance()->setCapacity(s_opt.traceSize);
   if (s_opt.checkConfig) {
     logNotice(lf_main, PACKAGE_STRING "." REVISION " performing configuration check...");
 
@@ -1022,6 +1297,21 @@ int main(int argc, char* argv[], char* envp[]) {
     cleanup();
     return EINVAL;
   }
+  vector<Device*> otherDevices;
+  for (const auto name : s_otherDeviceNames) {
+    Device *otherDevice = Device::create(name, s_opt.extraLatency, !s_opt.noDeviceCheck, s_opt.readOnly,
+                                         s_opt.initialSend);
+    if (otherDevice == nullptr) {
+      logWrite(lf_main, ll_error, "unable to create device %s", name);  // force logging on exit
+      for (const auto created : otherDevices) {
+        delete created;
+      }
+      delete device;
+      cleanup();
+      return EINVAL;
+    }
+    otherDevices.push_back(otherDevice);
+  }
 
   if (!s_opt.foreground) {
     if (!setLogFile(s_opt.logFile)) {
@@ -1031,6 +1321,12 @@ int main(int argc, char* argv[], char* envp[]) {
     }
     daemonize();  // make daemon
   }
+  if (s_opt.logBuffer > 0 && !startAsyncLog(s_opt.logBuffer)) {
+    logError(lf_main, "unable to start asynchronous log");
+  }
+  if (s_opt.lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    logError(lf_main, "unable to lock memory: %s", strerror(errno));
+  }
 
   // trap signals that we expect to receive
   signal(SIGHUP, signalHandler);
@@ -1048,11 +1344,20 @@ int main(int argc, char* argv[], char* envp[]) {
 
   // load configuration files
   s_scanHelper->loadConfigFiles(!s_opt.scanConfig);
+  if (s_rowCache && !s_rowCache->save()) {
+    logError(lf_main, "unable to write config cache to %s", s_opt.configCache);
+  }
+
+  if (g_shutdownSignal) {
+    logNotice(lf_main, "%s received", g_shutdownSignal == SIGINT ? "SIGINT" : "SIGTERM");
+    shutdown();
+    return 0;
+  }
 
-  s_requestQueue = new Queue<Request*>();
+  s_requestQueue = new BoundedQueue<Request*>();
 
   // create the MainLoop and start it
-  s_mainLoop = new MainLoop(s_opt, device, s_messageMap, s_scanHelper, s_requestQueue);
+  s_mainLoop = new MainLoop(s_opt, device, s_messageMap, s_scanHelper, s_requestQueue, otherDevices);
   if (s_opt.injectMessages) {
     BusHandler* busHandler = s_mainLoop->getBusHandler();
     int scanAdrCount = 0;
@@ -1085,7 +1390,9 @@ int main(int argc, char* argv[], char* envp[]) {
   }
   s_mainLoop->start("mainloop");
 
-  s_network = new Network(s_opt.localOnly, s_opt.port, s_opt.httpPort, s_requestQueue);
+  s_network = new Network(s_opt.localOnly, s_opt.port, s_opt.httpPort, s_requestQueue, s_opt.reactor,
+      s_opt.rawPort, s_mainLoop->getBusHandler()->getRawTelegrams(), s_opt.socketPath, s_opt.httpSocketPath,
+      s_opt.socketMode);
   s_network->start("network");
 
   // wait for end of MainLoop
@@ -20,6 +20,7 @@
 #define EBUSD_MAIN_H_
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <string>
 #include <map>
 #include "lib/ebus/data.h"
@@ -39,6 +40,7 @@ typedef struct options {
   bool readOnly;  //!< read-only access to the device
   bool initialSend;  //!< send an initial escape symbol after connecting device
   unsigned int extraLatency;  //!< extra transfer latency in ms [0 for USB, 10 for IP]
+  bool burstSend;  //!< send the remainder of a telegram at once to an enhanced device
 
   bool scanConfig;  //!< pick configuration files matching initial scan
   /** the initial address to scan for scanconfig
@@ -48,6 +50,9 @@ typedef struct options {
   bool checkConfig;  //!< check config files, then stop
   OutputFormat dumpConfig;  //!< dump config files, then stop
   const char* dumpConfigTo;  //!< file to dump config to
+  const char* configCache;  //!< file for caching the rows of read config files, or nullptr
+  const char* httpCache;  //!< path for caching config files retrieved from HTTPS, or nullptr
+  bool lazyConfig;  //!< only index config files in subdirectories on startup and read them when needed
   unsigned int pollInterval;  //!< poll interval in seconds, 0 to disable [5]
   bool injectMessages;  //!< inject remaining arguments as already seen messages
   bool stopAfterInject;  //!< only inject messages once, then stop
@@ -60,8 +65,14 @@ typedef struct options {
   unsigned int acquireRetries;  //!< number of retries for bus acquisition [3]
   unsigned int sendRetries;  //!< number of retries for failed sends [2]
   unsigned int receiveTimeout;  //!< timeout for receiving answer from slave in ms [25]
+  unsigned int writeCoalesce;  //!< time in ms to wait for superseding writes of the same message, 0 to disable [0]
   unsigned int masterCount;  //!< expected number of masters for arbitration [0]
   bool generateSyn;  //!< enable AUTO-SYN symbol generation
+  unsigned int grabSize;  //!< maximum number of distinct grabbed messages [1000]
+  unsigned int grabHistory;  //!< number of last telegrams to keep per grabbed message [1]
+  unsigned int historySize;  //!< number of last updates to keep in memory per message, 0 to disable [0]
+  int busPriority;  //!< real-time (SCHED_FIFO) priority of the bus handler thread, 0 for default scheduling [0]
+  uint64_t busCpus;  //!< bit mask of CPUs to pin the bus handler thread to, 0 for no pinning [0]
 
   const char* accessLevel;  //!< default access level
   const char* aclFile;  //!< ACL file name
@@ -72,22 +83,35 @@ typedef struct options {
   uint16_t port;  //!< port to listen for command line connections [8888]
   bool localOnly;  //!< listen on 127.0.0.1 interface only
   uint16_t httpPort;  //!< optional port to listen for HTTP connections, 0 to disable [0]
+  uint16_t rawPort;  //!< optional port to stream the raw telegrams to, 0 to disable [0]
+  const char* socketPath;  //!< optional Unix domain socket path to listen for command line connections
+  const char* httpSocketPath;  //!< optional Unix domain socket path to listen for HTTP connections
+  mode_t socketMode;  //!< permission mode of the Unix domain socket files [0660]
+  bool reactor;  //!< handle all client connections in a single event loop thread
   const char* htmlPath;  //!< path for HTML files served by the HTTP port [/var/ebusd/html]
   bool updateCheck;  //!< perform automatic update check
+  const char* stateFile;  //!< file for persisting the last data and scan results, or nullptr
+  bool lockMemory;  //!< lock all current and future memory pages of the process in RAM
 
   const char* logFile;  //!< log file name [/var/log/ebusd.log]
   int logAreas;  //!< log areas [all]
   LogLevel logLevel;  //!< log level [notice]
   bool multiLog;  //!< multiple log levels adjusted with --log=...
+  unsigned int logBuffer;  //!< number of log records to buffer per thread for writing asynchronously, or 0 [0]
+  unsigned int traceSize;  //!< number of trace events to keep, or 0 [0]
 
   unsigned int logRaw;  //!< raw log each received/sent byte on the bus (1=messages, 2=bytes)
   const char* logRawFile;  //!< name of raw log file [/var/log/ebusd.log]
   unsigned int logRawSize;  //!< maximum size of raw log file in kB [100]
+  unsigned int logRawBuffer;  //!< maximum interval in seconds for flushing the buffered raw log, or 0 [0]
+  bool logRawCompress;  //!< compress the rotated raw log file
 
   bool dump;  //!< binary dump received bytes
   const char* dumpFile;  //!< name of dump file [/tmp/ebusd_dump.bin]
   unsigned int dumpSize;  //!< maximum size of dump file in kB [100]
   bool dumpFlush;  //!< flush each byte
+  unsigned int dumpBuffer;  //!< maximum interval in seconds for flushing the buffered dump, or 0 [0]
+  bool dumpCompress;  //!< compress the rotated dump file
 } options_t;
 
 }  // namespace ebusd
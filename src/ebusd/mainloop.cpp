@@ -24,9 +24,12 @@
 #include <iomanip>
 #include <deque>
 #include <algorithm>
+#include <cstring>
 #include "ebusd/main.h"
 #include "ebusd/scan.h"
 #include "lib/utils/log.h"
+#include "lib/utils/timerwheel.h"
+#include "lib/utils/clock.h"
 #include "lib/ebus/data.h"
 
 namespace ebusd {
@@ -37,6 +40,7 @@ using std::setfill;
 using std::setw;
 using std::endl;
 using std::ifstream;
+using std::ofstream;
 
 /** the number of seconds of permanent missing signal after which to reconnect the device. */
 #define RECONNECT_MISSING_SIGNAL 60
@@ -98,6 +102,15 @@ result_t UserList::addFromFile(const string& filename, unsigned int lineNo, map<
 }
 
 
+/** the block size in bytes for buffered raw log and dump files. */
+#define ROTATE_BLOCK_SIZE 4096
+
+/** the time in seconds after which a listen subscription not polled by its connection any more is dropped. */
+#define LISTEN_SUBSCRIPTION_TIMEOUT 60
+
+/** the interval in seconds after which a parked server-sent events request is answered with a keep-alive. */
+#define EVENTS_KEEPALIVE_INTERVAL 15
+
 #define VERBOSITY_0 OF_NONE
 #define VERBOSITY_1 OF_NAMES
 #define VERBOSITY_2 (VERBOSITY_1 | OF_UNITS)
@@ -105,14 +118,28 @@ result_t UserList::addFromFile(const string& filename, unsigned int lineNo, map<
 #define VERBOSITY_4 (VERBOSITY_3 | OF_ALL_ATTRS)
 
 
+void OtherBusListener::notifyStatus(bool error, const char* message) {
+  if (error) {
+    logError(lf_bus, "device %s status: %s", m_device->getName(), message);
+  } else {
+    logNotice(lf_bus, "device %s status: %s", m_device->getName(), message);
+  }
+}
+
+
 MainLoop::MainLoop(const struct options& opt, Device *device, MessageMap* messages, ScanHelper* scanHelper,
-  Queue<Request*>* requestQueue)
+  BoundedQueue<Request*>* requestQueue, const vector<Device*>& otherDevices)
   : Thread(), m_device(device), m_reconnectCount(0), m_userList(opt.accessLevel), m_messages(messages),
     m_scanHelper(scanHelper), m_address(opt.address), m_scanConfig(opt.scanConfig),
     m_initialScan(opt.readOnly ? ESC : opt.initialScan), m_scanStatus(SCAN_STATUS_NONE),
     m_polling(opt.pollInterval > 0), m_enableHex(opt.enableHex),
-    m_shutdown(false), m_runUpdateCheck(opt.updateCheck), m_httpClient(), m_requestQueue(requestQueue) {
+    m_shutdown(false), m_logFile(!opt.foreground && opt.logFile ? opt.logFile : ""),
+    m_runUpdateCheck(opt.updateCheck), m_httpClient(), m_otherDevices(otherDevices),
+    m_eventsSubscribed(false), m_requestQueue(requestQueue),
+    m_stateFile(opt.stateFile ? opt.stateFile : ""), m_stateRestored(false) {
   m_device->setListener(this);
+  m_queueWaitMetric = Metrics::getInstance()->getHistogram("ebusd_request_queue_wait_seconds",
+      "Time a client request waits in the request queue", {100, 1000, 10000, 100000, 1000000, 10000000});
   // open Device
   result_t result = m_device->open();
   if (result != RESULT_OK) {
@@ -121,14 +148,16 @@ MainLoop::MainLoop(const struct options& opt, Device *device, MessageMap* messag
     logError(lf_bus, "device %s not available", m_device->getName());
   }
   if (opt.dumpFile[0]) {
-    m_dumpFile = new RotateFile(opt.dumpFile, opt.dumpSize, false, opt.dumpFlush ? 1 : 16);
+    m_dumpFile = new RotateFile(opt.dumpFile, opt.dumpSize, false,
+        opt.dumpFlush ? 1 : opt.dumpBuffer > 0 ? ROTATE_BLOCK_SIZE : 16, opt.dumpBuffer, opt.dumpCompress);
     m_dumpFile->setEnabled(opt.dump);
   } else {
     m_dumpFile = nullptr;
   }
   m_logRawEnabled = opt.logRaw != 0;
   if (opt.logRawFile[0] && strcmp(opt.logRawFile, opt.logFile) != 0) {
-    m_logRawFile = new RotateFile(opt.logRawFile, opt.logRawSize, true);
+    m_logRawFile = new RotateFile(opt.logRawFile, opt.logRawSize, true, ROTATE_BLOCK_SIZE, opt.logRawBuffer,
+        opt.logRawCompress);
     m_logRawFile->setEnabled(m_logRawEnabled);
   } else {
     m_logRawFile = nullptr;
@@ -156,8 +185,37 @@ MainLoop::MainLoop(const struct options& opt, Device *device, MessageMap* messag
       opt.acquireRetries, opt.sendRetries,
       opt.acquireTimeout, opt.receiveTimeout,
       opt.masterCount, opt.generateSyn,
-      opt.pollInterval);
+      opt.pollInterval, opt.grabSize, opt.grabHistory, opt.burstSend, opt.writeCoalesce);
+  if (!m_stateFile.empty()) {
+    loadState();
+  }
+  m_busHandler->addStoreListener(this);
   m_busHandler->start("bushandler");
+  setBusScheduling(m_busHandler, opt);
+  for (const auto otherDevice : m_otherDevices) {
+    auto listener = new OtherBusListener(otherDevice);
+    m_otherListeners.push_back(listener);
+    otherDevice->setListener(listener);
+    result = otherDevice->open();
+    if (result != RESULT_OK) {
+      logError(lf_bus, "unable to open %s: %s", otherDevice->getName(), getResultCode(result));
+    } else if (!otherDevice->isValid()) {
+      logError(lf_bus, "device %s not available", otherDevice->getName());
+    }
+    // polling is done by the primary bus handler only
+    auto otherBusHandler = new BusHandler(otherDevice, m_messages, scanHelper,
+        m_address, opt.answer,
+        opt.acquireRetries, opt.sendRetries,
+        opt.acquireTimeout, opt.receiveTimeout,
+        opt.masterCount, opt.generateSyn,
+        0, opt.grabSize, opt.grabHistory, opt.burstSend, opt.writeCoalesce);
+    m_busHandler->addOtherBus(otherBusHandler);
+    m_otherBusHandlers.push_back(otherBusHandler);
+    ostringstream threadName;
+    threadName << "bushandler" << (m_otherBusHandlers.size() + 1);
+    otherBusHandler->start(threadName.str().c_str());
+    setBusScheduling(otherBusHandler, opt);
+  }
 
   // create network
   m_htmlPath = opt.htmlPath;
@@ -175,9 +233,145 @@ MainLoop::MainLoop(const struct options& opt, Device *device, MessageMap* messag
   }
 }
 
+void MainLoop::fanOutListenUpdates(time_t since, time_t until) {
+  deque<Message*> messages;
+  m_messages->lockShared();
+  m_messages->findAll("", "", "*", false, true, true, true, true, true, since, until, true, &messages);
+  m_messages->unlockShared();
+  for (auto it = m_listenSubscriptions.begin(); it != m_listenSubscriptions.end(); ) {
+    listenSubscription_t& subscription = it->second;
+    if (!subscription.parked && until > subscription.lastPoll + LISTEN_SUBSCRIPTION_TIMEOUT) {
+      it = m_listenSubscriptions.erase(it);  // connection is gone
+      continue;
+    }
+    if (!subscription.events) {  // server-sent events are fed directly by notifyStored()
+      for (const auto message : messages) {
+        if (matchesSubscription(subscription, message)) {
+          subscription.keys.insert(message->getKey());
+        }
+      }
+    }
+    ++it;
+  }
+}
+
+void MainLoop::notifyStored(const Message* message) {
+  if (!m_eventsSubscribed) {
+    return;
+  }
+  m_storedKeysMutex.lock();
+  m_storedKeys.insert(message->getKey());
+  m_storedKeysMutex.unlock();
+  m_requestQueue->wakeUp();  // push the events without waiting for the next tick of the main loop
+}
+
+void MainLoop::fanOutStoredUpdates(time_t now) {
+  set<uint64_t> keys;
+  m_storedKeysMutex.lock();
+  keys.swap(m_storedKeys);
+  m_storedKeysMutex.unlock();
+  bool eventsSubscribed = false;
+  m_messages->lockShared();
+  for (auto& it : m_listenSubscriptions) {
+    listenSubscription_t& subscription = it.second;
+    if (!subscription.events) {
+      continue;
+    }
+    eventsSubscribed = true;
+    for (const auto key : keys) {
+      const vector<Message*>* keyMessages = m_messages->getByKey(key);
+      if (!keyMessages) {
+        continue;
+      }
+      for (const auto message : *keyMessages) {
+        if (matchesSubscription(subscription, message)) {
+          subscription.keys.insert(key);
+          break;
+        }
+      }
+    }
+  }
+  m_messages->unlockShared();
+  m_eventsSubscribed = eventsSubscribed;
+  for (auto& it : m_listenSubscriptions) {
+    listenSubscription_t& subscription = it.second;
+    Request* req = subscription.parked;
+    if (!req || (subscription.keys.empty() && now < subscription.lastPoll + EVENTS_KEEPALIVE_INTERVAL)) {
+      continue;
+    }
+    subscription.parked = nullptr;
+    subscription.lastPoll = now;
+    RequestMode reqMode = req->getMode();
+    ostringstream ostream;
+    if (subscription.keys.empty()) {
+      ostream << ":\n\n";  // comment line as keep-alive for detecting a closed connection
+    } else {
+      formatListenUpdates(&subscription, reqMode.format, &ostream);
+    }
+    req->setResult(ostream.str(), req->getUser(), &reqMode, now, false);
+  }
+}
+
+bool MainLoop::matchesSubscription(const listenSubscription_t& subscription, const Message* message) {
+  if (!message->hasLevel(subscription.levels, true)) {
+    return false;
+  }
+  return !subscription.events || ((subscription.circuit.empty()
+      || strcasecmp(message->getCircuit().c_str(), subscription.circuit.c_str()) == 0)
+      && (subscription.name.empty() || strcasecmp(message->getName().c_str(), subscription.name.c_str()) == 0));
+}
+
+void MainLoop::formatListenUpdates(listenSubscription_t* subscription, OutputFormat format, ostringstream* ostream) {
+  m_messages->lockShared();
+  for (const auto key : subscription->keys) {
+    const vector<Message*>* keyMessages = m_messages->getByKey(key);
+    if (!keyMessages) {
+      continue;
+    }
+    for (const auto message : *keyMessages) {
+      if (!message->hasLevel(subscription->levels, true) || !message->isAvailable()) {
+        continue;
+      }
+      if (subscription->events) {
+        if (matchesSubscription(*subscription, message)) {
+          formatEvent(message, subscription->raw, format, ostream);
+        }
+        continue;
+      }
+      if (message->getLastChangeTime() < subscription->since) {
+        continue;
+      }
+      *ostream << message->getCircuit() << " " << message->getName() << " = " << dec;
+      message->decodeLastData(false, nullptr, -1, format, ostream);
+      *ostream << endl;
+    }
+  }
+  m_messages->unlockShared();
+  subscription->keys.clear();
+}
+
+void MainLoop::setBusScheduling(BusHandler* busHandler, const struct options& opt) {
+  if (opt.busPriority == 0 && opt.busCpus == 0) {
+    return;
+  }
+  int error = busHandler->setScheduling(opt.busPriority, opt.busCpus);
+  if (error != 0) {
+    logError(lf_bus, "unable to set scheduling of bus thread: %s", strerror(error));
+  } else {
+    logNotice(lf_bus, "bus thread running with priority %d, CPU mask %llx", opt.busPriority,
+        static_cast<unsigned long long>(opt.busCpus));  // NOLINT(runtime/int)
+  }
+}
+
 MainLoop::~MainLoop() {
   m_shutdown = true;
   join();
+  if (m_busHandler != nullptr) {
+    m_busHandler->removeStoreListener(this);
+  }
+  if (!m_stateFile.empty() && m_busHandler != nullptr) {
+    saveState();
+  }
 
   for (const auto dataHandler : m_dataHandlers) {
     delete dataHandler;
@@ -191,6 +385,18 @@ MainLoop::~MainLoop() {
     delete m_logRawFile;
     m_logRawFile = nullptr;
   }
+  for (const auto otherBusHandler : m_otherBusHandlers) {
+    delete otherBusHandler;
+  }
+  m_otherBusHandlers.clear();
+  for (const auto otherDevice : m_otherDevices) {
+    delete otherDevice;
+  }
+  m_otherDevices.clear();
+  for (const auto listener : m_otherListeners) {
+    delete listener;
+  }
+  m_otherListeners.clear();
   if (m_busHandler != nullptr) {
     delete m_busHandler;
     m_busHandler = nullptr;
@@ -214,9 +420,39 @@ MainLoop::~MainLoop() {
 /** the number of completed scan runs after which to try again failed ones. */
 #define SCAN_REPEAT_COUNT 6
 
+/** the interval in seconds for persisting the state file. */
+#define STATE_SAVE_INTERVAL (10*60)
+
+/** the IDs of the deadlines in the @a TimerWheel of the main loop. */
+enum MainLoopTimer {
+  mt_tasks,        //!< regular tasks like signal check, scan, and flushing files
+  mt_stateSave,    //!< persisting the state file
+  mt_updateCheck,  //!< the update check
+};
+
+volatile sig_atomic_t g_shutdownSignal = 0;
+
+volatile sig_atomic_t g_reopenLogSignal = 0;
+
+void MainLoop::handleSignals() {
+  if (g_reopenLogSignal) {
+    g_reopenLogSignal = 0;
+    logNotice(lf_main, "SIGHUP received");
+    if (!m_logFile.empty()) {  // for log file rotation
+      closeLogFile();
+      setLogFile(m_logFile.c_str());
+    }
+  }
+  int sig = g_shutdownSignal;
+  if (sig) {
+    logNotice(lf_main, "%s received", sig == SIGINT ? "SIGINT" : "SIGTERM");
+    m_shutdown = true;
+  }
+}
+
 void MainLoop::run() {
   bool reload = true;
-  time_t lastTaskRun, now, start, lastSignal = 0, since, sinkSince = 1, nextCheckRun;
+  time_t lastTaskRun, now, start, lastSignal = 0, since, sinkSince = 1, listenSince;
   int taskDelay = 5;
   symbol_t lastScanAddress = 0;  // 0 is known to be a master
   scanStatus_t lastScanStatus = m_scanStatus;
@@ -224,20 +460,61 @@ void MainLoop::run() {
   time(&now);
   start = now;
   lastTaskRun = now;
-  nextCheckRun = now + CHECK_INITIAL_DELAY;
+  listenSince = now;
+  TimerWheel timers(100, 64);
+  timers.scheduleIn(mt_tasks, taskDelay*1000);
+  if (!m_stateFile.empty()) {
+    timers.scheduleIn(mt_stateSave, STATE_SAVE_INTERVAL*1000);
+  }
+  if (m_runUpdateCheck) {
+    timers.scheduleIn(mt_updateCheck, CHECK_INITIAL_DELAY*1000);
+  }
   ostringstream updates;
   list<DataSink*> dataSinks;
+  size_t changeSinks = 0;  // the number of sinks interested in changed messages only
   deque<Message*> messages;
 
   for (const auto dataHandler : m_dataHandlers) {
     if (dataHandler->isDataSink()) {
-      dataSinks.push_back(dynamic_cast<DataSink*>(dataHandler));
+      DataSink* dataSink = dynamic_cast<DataSink*>(dataHandler);
+      dataSinks.push_back(dataSink);
+      if (dataSink->isChangesOnly()) {
+        changeSinks++;
+      }
     }
     dataHandler->startHandler();
   }
+  if (m_scanConfig && !m_scanHelper->startScanConfigLoader()) {
+    logError(lf_main, "unable to start background scan config loader");
+  }
   while (!m_shutdown) {
-    // pick the next request to handle
-    Request* req = m_requestQueue->pop(taskDelay);
+    handleSignals();
+    if (m_shutdown) {
+      break;
+    }
+    // pick the next request to handle, waiting at most until the next deadline and for a second in order to
+    // handle signals in time
+    int64_t untilNext = timers.getMillisUntilNext(clockGetMillis());
+    Request* req = m_requestQueue->pop(untilNext < 0 || untilNext > 1000 ? 1
+      : static_cast<int>((untilNext+999)/1000));
+    if (req) {
+      m_queueWaitMetric->observeSince(req->getQueuedTime());
+    }
+    bool runTasks = false, runStateSave = false, runUpdateCheck = false;
+    int timer;
+    while (timers.popExpired(clockGetMillis(), &timer)) {
+      switch (timer) {
+        case mt_tasks:
+          runTasks = true;
+          break;
+        case mt_stateSave:
+          runStateSave = true;
+          break;
+        default:
+          runUpdateCheck = true;
+          break;
+      }
+    }
     time(&now);
     if (now < lastTaskRun) {
       // clock skew
@@ -245,7 +522,8 @@ void MainLoop::run() {
         lastSignal -= lastTaskRun-now;
       }
       lastTaskRun = now;
-    } else if (!m_shutdown && now > lastTaskRun+taskDelay) {
+    }
+    if (!m_shutdown && runTasks) {
       logDebug(lf_main, "performing regular tasks");
       if (m_busHandler->hasSignal()) {
         lastSignal = now;
@@ -255,7 +533,14 @@ void MainLoop::run() {
         m_reconnectCount++;
       }
       if (m_scanConfig) {
+        m_busHandler->finishScanConfigFiles();
         bool loadDelay = false;
+        if (reload && m_stateRestored) {
+          // scan results were restored from the state file, so only load the matching config files
+          logNotice(lf_main, "skipping initial scan due to restored state");
+          m_stateRestored = false;
+          reload = false;
+        }
         if (m_initialScan != ESC && reload && m_busHandler->hasSignal()) {
           loadDelay = true;
           result_t result;
@@ -274,7 +559,7 @@ void MainLoop::run() {
               istringstream input;
               result = message->prepareMaster(0, m_address, SYN, UI_FIELD_SEPARATOR, &input, &master);
               if (result == RESULT_OK) {
-                result = m_busHandler->sendAndWait(master, &slave);
+                result = m_busHandler->sendAndWait(master, &slave, 0, rp_scan);
               }
             } else {
               result = RESULT_ERR_NOTFOUND;
@@ -298,7 +583,10 @@ void MainLoop::run() {
         }
         if (!loadDelay && m_busHandler->hasSignal()) {
           lastScanAddress = m_busHandler->getNextScanAddress(lastScanAddress, scanCompleted >= SCAN_REPEAT_COUNT);
-          if (lastScanAddress == SYN) {
+          if (lastScanAddress == SYN && m_busHandler->hasQueuedScanConfigFiles()) {
+            taskDelay = 1;  // wait for the scan config files still being loaded in the background
+            lastScanAddress = 0;
+          } else if (lastScanAddress == SYN) {
             taskDelay = 5;
             lastScanAddress = 0;
             m_scanStatus = SCAN_STATUS_FINISHED;
@@ -314,7 +602,9 @@ void MainLoop::run() {
               logError(lf_main, "scan config %2.2x: %s", lastScanAddress, getResultCode(result));
             } else {
               logInfo(lf_main, "scan config %2.2x message received", lastScanAddress);
-              nextCheckRun = now + CHECK_INITIAL_DELAY;  // delay update check due to new scan data
+              if (m_runUpdateCheck) {
+                timers.scheduleIn(mt_updateCheck, CHECK_INITIAL_DELAY*1000);  // delay due to new scan data
+              }
             }
           }
         }
@@ -335,72 +625,101 @@ void MainLoop::run() {
         for (const auto dataSink : dataSinks) {
           dataSink->notifyScanStatus(SCAN_STATUS_FINISHED);
         }
+      } else if (m_scanHelper->hasLazyConfigFiles()) {
+        loadLazyConfigFiles("");
+      }
+      if (m_dumpFile) {
+        m_dumpFile->flush();
+      }
+      if (m_logRawFile) {
+        m_logRawFile->flush();
       }
-      if (m_runUpdateCheck && !m_shutdown && now > nextCheckRun) {
-        if (!m_httpClient.connect("upd.ebusd.eu",
+      time(&lastTaskRun);
+      timers.scheduleIn(mt_tasks, taskDelay*1000);
+    }
+    if (runStateSave) {
+      saveState();
+      timers.scheduleIn(mt_stateSave, STATE_SAVE_INTERVAL*1000);
+    }
+    if (runUpdateCheck && !m_shutdown) {
+      if (!m_httpClient.connect("upd.ebusd.eu",
 #ifdef HAVE_SSL
-                            443, true,
+                          443, true,
 #else
-                            80, false,
+                          80, false,
 #endif
-                            PACKAGE_NAME "/" PACKAGE_VERSION)) {
-          logError(lf_main, "update check connect error");
-          nextCheckRun = now + CHECK_INITIAL_DELAY;
-        } else {
-          ostringstream ostr;
-          ostr << "{\"v\":\"" PACKAGE_VERSION "\",\"r\":\"" REVISION << "\""
+                          PACKAGE_NAME "/" PACKAGE_VERSION)) {
+        logError(lf_main, "update check connect error");
+        timers.scheduleIn(mt_updateCheck, CHECK_INITIAL_DELAY*1000);
+      } else {
+        ostringstream ostr;
+        ostr << "{\"v\":\"" PACKAGE_VERSION "\",\"r\":\"" REVISION << "\""
 #if defined(__amd64__) || defined(__x86_64__) || defined(__ia64__) || defined(__IA64__)
-               << ",\"a\":\"amd64\""
+             << ",\"a\":\"amd64\""
 #elif defined(__aarch64__)
-               << ",\"a\":\"aarch64\""
+             << ",\"a\":\"aarch64\""
 #elif defined(__arm__)
-               << ",\"a\":\"arm\""
+             << ",\"a\":\"arm\""
 #elif defined(__i386__) || defined(__i686__)
-               << ",\"a\":\"i386\""
+             << ",\"a\":\"i386\""
 #elif defined(__mips__)
-               << ",\"a\":\"mips\""
+             << ",\"a\":\"mips\""
 #else
-               << ",\"a\":\"other\""
+             << ",\"a\":\"other\""
 #endif
-               << ",\"u\":" << (now-start);
-          m_device->formatInfo(&ostr, false, true, true);
-          if (m_reconnectCount) {
-            ostr << ",\"rc\":" << m_reconnectCount;
-          }
-          m_busHandler->formatUpdateInfo(&ostr);
-          ostr << "}";
-          string response;
-          bool repeat = false;
-          if (!m_httpClient.post("/", ostr.str(), &response, &repeat)) {
-            logError(lf_main, "update check error: %s", response.c_str());
-            nextCheckRun = now + (repeat ? CHECK_INITIAL_DELAY : CHECK_DELAY);
-          } else {
-            m_updateCheck = response.empty() ? "unknown" : response;
-            logNotice(lf_main, "update check: %s", response.c_str());
-            if (!dataSinks.empty()) {
-              for (const auto dataSink : dataSinks) {
-                dataSink->notifyUpdateCheckResult(response == "OK" ? "" : m_updateCheck);
-              }
+             << ",\"u\":" << (now-start);
+        m_device->formatInfo(&ostr, false, true, true);
+        if (m_reconnectCount) {
+          ostr << ",\"rc\":" << m_reconnectCount;
+        }
+        m_busHandler->formatUpdateInfo(&ostr);
+        ostr << "}";
+        string response;
+        bool repeat = false;
+        if (!m_httpClient.post("/", ostr.str(), &response, &repeat)) {
+          logError(lf_main, "update check error: %s", response.c_str());
+          timers.scheduleIn(mt_updateCheck, (repeat ? CHECK_INITIAL_DELAY : CHECK_DELAY)*1000);
+        } else {
+          m_updateCheck = response.empty() ? "unknown" : response;
+          logNotice(lf_main, "update check: %s", response.c_str());
+          if (!dataSinks.empty()) {
+            for (const auto dataSink : dataSinks) {
+              dataSink->notifyUpdateCheckResult(response == "OK" ? "" : m_updateCheck);
             }
-            nextCheckRun = now + CHECK_DELAY;
           }
+          timers.scheduleIn(mt_updateCheck, CHECK_DELAY*1000);
         }
       }
-      time(&lastTaskRun);
     }
     time(&now);
     if (!dataSinks.empty()) {
-      messages.clear();
-      m_messages->lock();
-      m_messages->findAll("", "", "*", false, true, true, true, true, true, sinkSince, now, false, &messages);
-      for (const auto message : messages) {
-        for (const auto dataSink : dataSinks) {
-          dataSink->notifyUpdate(message);
+      m_messages->lockShared();
+      // sinks interested in changes only are not bothered with unchanged repeats of passive telegrams
+      int first = changeSinks == dataSinks.size() ? 1 : 0, last = changeSinks > 0 ? 1 : 0;
+      for (int changed = first; changed <= last; changed++) {
+        messages.clear();
+        m_messages->findAll("", "", "*", false, true, true, true, true, true, sinkSince, now, changed == 1,
+            &messages);
+        for (const auto message : messages) {
+          for (const auto dataSink : dataSinks) {
+            if (dataSink->isChangesOnly() == (changed == 1)) {
+              dataSink->notifyUpdate(message);
+            }
+          }
         }
       }
-      m_messages->unlock();
+      m_messages->unlockShared();
       sinkSince = now;
     }
+    if (now > listenSince) {
+      if (!m_listenSubscriptions.empty()) {
+        fanOutListenUpdates(listenSince, now);
+      }
+      listenSince = now;
+    }
+    if (m_eventsSubscribed) {
+      fanOutStoredUpdates(now);
+    }
     if (req == nullptr) {
       continue;
     }
@@ -417,8 +736,9 @@ void MainLoop::run() {
     bool connected = true;
     if (!req->empty()) {
       req->log();
-      result_t result = decodeRequest(req, &connected, &reqMode, &user, &reload, &ostream);
-      if (!req->isHttp() && (ostream.tellp() == 0 || result != RESULT_OK)) {
+      ResultStreamer streamer(req);
+      result_t result = decodeRequest(req, &connected, &reqMode, &user, &reload, &streamer, &ostream);
+      if (!req->isHttp() && ((ostream.tellp() == 0 && !streamer.isStarted()) || result != RESULT_OK)) {
         if (reqMode.listenMode != lm_direct) {
           ostream.str("");
         }
@@ -426,23 +746,36 @@ void MainLoop::run() {
       }
       const auto resp = ostream.str();
       req->log(&resp);
-      if (ostream.tellp() == 0) {
+      if (ostream.tellp() == 0 && req->isHttp()) {
         ostream << "\n";  // only for HTTP
       } else if (!req->isHttp()) {
         ostream << (reqMode.listenMode == lm_direct ? "\n" : "\n\n");
       }
     }
-    if (reqMode.listenMode == lm_listen) {
-      if (!reqMode.listenOnlyUnknown) {
-        string levels = getUserLevels(user);
-        messages.clear();
-        m_messages->findAll("", "", levels, false, true, true, true, true, true, since, now, true, &messages);
-        for (const auto message : messages) {
-          ostream << message->getCircuit() << " " << message->getName() << " = " << dec;
-          message->decodeLastData(false, nullptr, -1, reqMode.format, &ostream);
-          ostream << endl;
+    int connectionId = req->getConnectionId();  // unlike the address of the request, the ID is never reused
+    if ((reqMode.listenMode != lm_listen && reqMode.listenMode != lm_events) || reqMode.listenOnlyUnknown) {
+      if (!m_listenSubscriptions.empty()) {
+        m_listenSubscriptions.erase(connectionId);
+      }
+    } else {
+      auto it = m_listenSubscriptions.find(connectionId);
+      if (it == m_listenSubscriptions.end()) {
+        // new subscription: updates are fanned out from now on
+        m_listenSubscriptions[connectionId] = {getUserLevels(user), listenSince, now, {}, false, "", "", false,
+            nullptr};
+      } else {
+        listenSubscription_t& subscription = it->second;
+        subscription.levels = getUserLevels(user);
+        subscription.lastPoll = now;
+        if (subscription.events && subscription.keys.empty() && ostream.tellp() == 0) {
+          subscription.parked = req;  // answered by fanOutStoredUpdates() as soon as there are updates
+          continue;
         }
+        formatListenUpdates(&subscription, reqMode.format, &ostream);
+        subscription.since = listenSince;
       }
+    }
+    if (reqMode.listenMode == lm_listen) {
       if (reqMode.listenWithUnknown || reqMode.listenOnlyUnknown) {
         if (m_busHandler->isGrabEnabled()) {
           m_busHandler->formatGrabResult(true, OF_NONE, &ostream, true, since, now);
@@ -458,6 +791,103 @@ void MainLoop::run() {
     // send result to client
     req->setResult(ostream.str(), user, &reqMode, now, !connected);
   }
+  m_eventsSubscribed = false;
+  for (auto& it : m_listenSubscriptions) {
+    if (it.second.parked) {
+      it.second.parked->setResult("", "", nullptr, now, true);  // release the waiting connection
+      it.second.parked = nullptr;
+    }
+  }
+}
+
+void MainLoop::loadLazyConfigFiles(const string& circuit) {
+  if (!m_scanHelper->hasLazyConfigFiles()) {
+    return;
+  }
+  bool loaded = false;
+  vector<string> files;
+  if (circuit.empty()) {
+    symbol_t address = 0;  // 0 is known to be a master
+    while ((address = m_busHandler->getNextScanAddress(address, false)) != SYN) {
+      files.clear();
+      m_scanHelper->loadLazyConfigFiles(address, "", &files);
+      for (const auto& file : files) {
+        m_busHandler->setScanConfigLoaded(address, file);
+      }
+      if (files.empty()) {
+        m_busHandler->setScanConfigLoaded(address, "");
+      } else {
+        loaded = true;
+      }
+    }
+  } else {
+    m_scanHelper->loadLazyConfigFiles(SYN, circuit, &files);
+    loaded = !files.empty();
+  }
+  if (!loaded) {
+    return;
+  }
+  m_scanHelper->executeInstructions(m_busHandler);
+  // notify data sinks to make them update the messages
+  for (const auto dataHandler : m_dataHandlers) {
+    if (dataHandler->isDataSink()) {
+      dynamic_cast<DataSink*>(dataHandler)->notifyScanStatus(SCAN_STATUS_FINISHED);
+    }
+  }
+}
+
+void MainLoop::loadState() {
+  ifstream stream(m_stateFile);
+  if (!stream.is_open()) {
+    logNotice(lf_main, "no state to restore from %s", m_stateFile.c_str());
+    return;
+  }
+  int messageCount = 0, addressCount = 0, invalidCount = 0;
+  string line;
+  while (getline(stream, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    bool valid;
+    if (line[0] == 'm') {
+      valid = m_messages->restoreState(line);
+      if (valid) {
+        messageCount++;
+      }
+    } else {
+      valid = m_busHandler->restoreState(line);
+      if (valid && line[0] == 's') {
+        m_stateRestored = true;
+      } else if (valid) {
+        addressCount++;
+      }
+    }
+    if (!valid) {
+      invalidCount++;
+    }
+  }
+  stream.close();
+  logNotice(lf_main, "restored state from %s: %d messages, %d addresses, %d invalid", m_stateFile.c_str(),
+      messageCount, addressCount, invalidCount);
+}
+
+void MainLoop::saveState() {
+  string tempFile = m_stateFile + ".tmp";
+  ofstream stream(tempFile, ofstream::trunc);
+  if (!stream.is_open()) {
+    logError(lf_main, "unable to write state to %s", tempFile.c_str());
+    return;
+  }
+  stream << "# " PACKAGE_STRING "." REVISION " state\n";
+  m_busHandler->formatState(&stream);
+  m_messages->formatState(&stream);
+  stream.close();
+  if (stream.fail() || rename(tempFile.c_str(), m_stateFile.c_str()) != 0) {
+    logError(lf_main, "unable to write state to %s", m_stateFile.c_str());
+    remove(tempFile.c_str());
+    return;
+  }
+  logDebug(lf_main, "saved state to %s", m_stateFile.c_str());
 }
 
 void MainLoop::notifyDeviceData(symbol_t symbol, bool received) {
@@ -517,21 +947,25 @@ void MainLoop::notifyStatus(bool error, const char* message) {
 }
 
 result_t MainLoop::decodeRequest(Request* req, bool* connected, RequestMode* reqMode,
-    string* user, bool* reload, ostringstream* ostream) {
+    string* user, bool* reload, ResultStreamer* streamer, ostringstream* ostream) {
   vector<string> args;
   req->split(&args);
   string cmd = args.size() > 0 ? args[0] : "";
   if (req->isHttp()) {
     if (args.size() < 2) {
       *connected = false;
-      *ostream << "HTTP/1.0 400 Bad Request\r\n\r\n";
+      *ostream << "HTTP/1.0 400 Bad Request\r\nConnection: close\r\n\r\n";
       return RESULT_OK;
     }
     if (cmd == "GET") {
-      return executeGet(args, connected, ostream);
+      *connected = req->isKeepAlive();
+      if (args[1].substr(0, 7) == "/events" && (args[1].length() == 7 || args[1][7] == '/')) {
+        return executeEvents(req, args, connected, reqMode, user, ostream);
+      }
+      return executeGet(args, connected, streamer, ostream);
     }
     *connected = false;
-    *ostream << "HTTP/1.0 405 Method Not Allowed\r\n\r\n";
+    *ostream << "HTTP/1.0 405 Method Not Allowed\r\nConnection: close\r\n\r\n";
     return RESULT_OK;
   }
 
@@ -572,7 +1006,7 @@ result_t MainLoop::decodeRequest(Request* req, bool* connected, RequestMode* req
     return RESULT_OK;
   }
   if (cmd == "F" || cmd == "FIND") {
-    return executeFind(args, getUserLevels(*user), ostream);
+    return executeFind(args, getUserLevels(*user), streamer, ostream);
   }
   if (cmd == "L" || cmd == "LISTEN") {
     return executeListen(args, reqMode, ostream);
@@ -584,7 +1018,7 @@ result_t MainLoop::decodeRequest(Request* req, bool* connected, RequestMode* req
     return executeState(args, ostream);
   }
   if (cmd == "G" || cmd == "GRAB") {
-    return executeGrab(args, ostream);
+    return executeGrab(args, streamer, ostream);
   }
   if (cmd == "DEF" || cmd == "DEFINE") {
     if (m_newlyDefinedMessages) {
@@ -612,8 +1046,7 @@ result_t MainLoop::decodeRequest(Request* req, bool* connected, RequestMode* req
     return executeDump(args, ostream);
   }
   if (cmd == "RELOAD") {
-    *reload = true;
-    return executeReload(args, ostream);
+    return executeReload(args, reload, ostream);
   }
   if (cmd == "Q" || cmd == "QUIT") {
     return executeQuit(args, connected, ostream);
@@ -687,7 +1120,7 @@ result_t MainLoop::executeAuth(const vector<string>& args, string* user, ostring
 
 result_t MainLoop::executeRead(const vector<string>& args, const string& levels, ostringstream* ostream) {
   size_t argPos = 1;
-  bool hex = false, newDefinition = false;
+  bool hex = false, newDefinition = false, history = false, stale = false;
   OutputFormat verbosity = OF_NONE;
   time_t maxAge = 5*60;
   string circuit, params;
@@ -702,8 +1135,12 @@ result_t MainLoop::executeRead(const vector<string>& args, const string& levels,
         return RESULT_OK;
       }
       newDefinition = true;
+    } else if (args[argPos] == "-history") {
+      history = true;
     } else if (args[argPos] == "-f") {
       maxAge = 0;
+    } else if (args[argPos] == "-r") {
+      stale = true;
     } else if (args[argPos] == "-m") {
       argPos++;
       if (args.size() > argPos) {
@@ -783,7 +1220,11 @@ result_t MainLoop::executeRead(const vector<string>& args, const string& levels,
   }
   if ((hex && (newDefinition || verbosity != OF_NONE || !circuit.empty() || !params.empty() || dstAddress != SYN
       || pollPriority > 0 || args.size() < argPos + 1))
-  || (newDefinition && (hex || !circuit.empty() || pollPriority > 0 || args.size() != argPos + 1))) {
+  || (newDefinition && (hex || !circuit.empty() || pollPriority > 0 || args.size() != argPos + 1))
+  || (history && (hex || newDefinition || !params.empty() || srcAddress != SYN || dstAddress != SYN
+      || pollPriority > 0))
+  || (stale && (hex || newDefinition || history || !params.empty() || srcAddress != SYN || dstAddress != SYN
+      || maxAge == 0))) {
     argPos = 0;  // print usage
   }
 
@@ -791,12 +1232,15 @@ result_t MainLoop::executeRead(const vector<string>& args, const string& levels,
     *ostream <<
         "usage: read [-f] [-m SECONDS] [-s QQ] [-d ZZ] [-c CIRCUIT] [-p PRIO] [-v|-V] [-n|-N] [-i VALUE[;VALUE]*]"
         " NAME [FIELD[.N]]\n"
+        "  or:  read -r [-m SECONDS] [-c CIRCUIT] [-p PRIO] [-v|-V] [-n|-N] NAME [FIELD[.N]]\n"
         "  or:  read [-f] [-m SECONDS] [-s QQ] [-d ZZ] [-v|-V] [-n|-N] [-i VALUE[;VALUE]*] -def DEFINITION "
         "(only if enabled)\n"
         "  or:  read [-f] [-m SECONDS] [-s QQ] [-c CIRCUIT] -h ZZPBSBNN[DD]*\n"
+        "  or:  read -history [-c CIRCUIT] [-v|-V] [-n|-N] NAME [FIELD[.N]] (only if enabled)\n"
         " Read value(s) or hex message.\n"
         "  -f           force reading from the bus (same as '-m 0')\n"
         "  -m SECONDS   only return cached value if age is less than SECONDS [300]\n"
+        "  -r           return an older cached value right away with its age and refresh it in the background\n"
         "  -c CIRCUIT   limit to messages of CIRCUIT\n"
         "  -s QQ        override source address QQ\n"
         "  -d ZZ        override destination address ZZ\n"
@@ -809,6 +1253,7 @@ result_t MainLoop::executeRead(const vector<string>& args, const string& levels,
         "  NAME         NAME of the message to send\n"
         "  FIELD        only retrieve the field named FIELD\n"
         "  N            only retrieve the N'th field named FIELD (0-based)\n"
+        "  -history     return the stored history of the message (only if enabled)\n"
         "  -def         read with explicit message definition (only if enabled):\n"
         "    DEFINITION message definition to use instead of known definition\n"
         "  -h           send hex read message (or answer from cache):\n"
@@ -896,9 +1341,31 @@ result_t MainLoop::executeRead(const vector<string>& args, const string& levels,
     }
   }
 
+  if (!circuit.empty()) {
+    loadLazyConfigFiles(circuit);
+  }
   string name;
   Message* message;
   result_t ret;
+  if (history) {
+    message = m_messages->find(circuit, args[argPos], levels, false);
+    if (message == nullptr || !message->getHistory()) {
+      message = m_messages->find(circuit, args[argPos], levels, false, true);
+    }
+    if (message == nullptr) {
+      return RESULT_ERR_NOTFOUND;
+    }
+    if (!message->getHistory()) {
+      *ostream << "ERR: option not enabled";
+      return RESULT_OK;
+    }
+    ret = message->decodeHistory(0, fieldIndex == -2 ? nullptr : fieldName.c_str(), fieldIndex, verbosity, ostream);
+    if (ret == RESULT_EMPTY) {
+      *ostream << "ERR: no data stored";
+      return RESULT_OK;
+    }
+    return ret;
+  }
   if (newDefinition) {
     string errorDescription;
     istringstream defstr("#\n" + args[argPos]);  // ensure first line is not used for determining col names
@@ -929,8 +1396,9 @@ result_t MainLoop::executeRead(const vector<string>& args, const string& levels,
   if (!hasCache || (allowCache && message && message->getLastUpdateTime() > cacheMessage->getLastUpdateTime())) {
     cacheMessage = message;  // message is newer/better
   }
-  if (cacheMessage && (cacheMessage->getLastUpdateTime() + maxAge > now
-                       || (cacheMessage->isPassive() && cacheMessage->getLastUpdateTime() != 0))) {
+  bool outdated = cacheMessage && cacheMessage->getLastUpdateTime() + maxAge <= now
+    && !(cacheMessage->isPassive() && cacheMessage->getLastUpdateTime() != 0);
+  if (cacheMessage && (!outdated || (stale && cacheMessage->getLastUpdateTime() != 0))) {
     if (verbosity & OF_NAMES) {
       *ostream << cacheMessage->getCircuit() << " " << cacheMessage->getName() << " ";
     }
@@ -945,6 +1413,15 @@ result_t MainLoop::executeRead(const vector<string>& args, const string& levels,
     }
     logInfo(lf_main, "read %s %s cached: %s", cacheMessage->getCircuit().c_str(), cacheMessage->getName().c_str(),
         ostream->str().c_str());
+    if (outdated) {
+      *ostream << " [age " << static_cast<unsigned>(now - cacheMessage->getLastUpdateTime()) << "s]";
+      Message* refresh = message && !message->isPassive() ? message : cacheMessage;
+      ret = m_busHandler->refreshInBackground(refresh);
+      if (ret != RESULT_OK && ret != RESULT_ERR_DUPLICATE) {
+        logError(lf_main, "read %s %s refresh: %s", refresh->getCircuit().c_str(), refresh->getName().c_str(),
+            getResultCode(ret));
+      }
+    }
     return RESULT_OK;
   }
 
@@ -1080,7 +1557,7 @@ result_t MainLoop::executeWrite(const vector<string>& args, const string levels,
     }
     // send message
     SlaveSymbolString slave;
-    ret = m_busHandler->sendAndWait(master, &slave);
+    ret = m_busHandler->sendAndWait(master, &slave, 0, rp_interactiveWrite);
 
     if (ret == RESULT_OK) {
       // also update read messages
@@ -1111,6 +1588,9 @@ result_t MainLoop::executeWrite(const vector<string>& args, const string levels,
     return ret;
   }
 
+  if (!circuit.empty()) {
+    loadLazyConfigFiles(circuit);
+  }
   Message* message;
   result_t ret;
   if (newDefinition) {
@@ -1210,9 +1690,9 @@ result_t MainLoop::parseHexAndSend(const vector<string>& args, size_t& argPos, b
   }
   logNotice(lf_main, isDirectMode ? "direct cmd: %s" : "hex cmd: %s", master.getStr().c_str());
 
-  // send message
+  // send message (handled like a write as it might be one)
   SlaveSymbolString slave;
-  ret = m_busHandler->sendAndWait(master, &slave);
+  ret = m_busHandler->sendAndWait(master, &slave, 0, rp_interactiveWrite);
 
   if (ret == RESULT_OK) {
     if (master[1] == BROADCAST) {
@@ -1300,7 +1780,8 @@ result_t MainLoop::executeDirect(const vector<string>& args, RequestMode* reqMod
   return RESULT_OK;
 }
 
-result_t MainLoop::executeFind(const vector<string>& args, const string& levels, ostringstream* ostream) {
+result_t MainLoop::executeFind(const vector<string>& args, const string& levels, ResultStreamer* streamer,
+    ostringstream* ostream) {
   size_t argPos = 1;
   bool configFormat = false, exact = false, withRead = true, withWrite = false, withPassive = true, first = true,
       onlyWithData = false, hexFormat = false, userLevel = true, withConditions = false;
@@ -1444,6 +1925,12 @@ result_t MainLoop::executeFind(const vector<string>& args, const string& levels,
     if (onlyWithData && lastup == 0) {
       continue;
     }
+    if (streamer) {
+      streamer->flush(ostream);
+      if (streamer->isAborted()) {
+        break;
+      }
+    }
     if (configFormat) {
       if (found) {
         *ostream << endl;
@@ -1596,7 +2083,7 @@ result_t MainLoop::executeState(const vector<string>& args, ostringstream* ostre
   return RESULT_ERR_NO_SIGNAL;
 }
 
-result_t MainLoop::executeGrab(const vector<string>& args, ostringstream* ostream) {
+result_t MainLoop::executeGrab(const vector<string>& args, ResultStreamer* streamer, ostringstream* ostream) {
   if (args.size() == 1) {
     *ostream << (m_busHandler->enableGrab(true) ? "grab started" : "grab continued");
     return RESULT_OK;
@@ -1621,7 +2108,7 @@ result_t MainLoop::executeGrab(const vector<string>& args, ostringstream* ostrea
       }
     }
     if (!invalid) {
-      m_busHandler->formatGrabResult(onlyUnknown, decode ? OF_DEFINITION : OF_NONE, ostream);
+      m_busHandler->formatGrabResult(onlyUnknown, decode ? OF_DEFINITION : OF_NONE, ostream, false, 0, 0, streamer);
       return RESULT_OK;
     }
   }
@@ -1894,17 +2381,45 @@ result_t MainLoop::executeDump(const vector<string>& args, ostringstream* ostrea
   return RESULT_OK;
 }
 
-result_t MainLoop::executeReload(const vector<string>& args, ostringstream* ostream) {
-  if (args.size() != 1) {
-    *ostream << "usage: reload\n"
-                " Reload CSV config files.";
+result_t MainLoop::executeReload(const vector<string>& args, bool* reload, ostringstream* ostream) {
+  bool full = args.size() == 2 && args[1] == "full";
+  if (args.size() != 1 && !full) {
+    *ostream << "usage: reload [full]\n"
+                " Reload CSV config files.\n"
+                "  full  reload all files instead of only the changed ones";
     return RESULT_OK;
   }
+  if (!full) {
+    // only the changed files are read again, everything else incl. the scan results stays untouched
+    m_scanHelper->reloadConfigFiles(!m_scanConfig, &full);
+    if (!full) {
+      m_scanHelper->executeInstructions(m_busHandler);
+      return RESULT_OK;
+    }
+  } else {
+    m_scanHelper->loadConfigFiles(!m_scanConfig);
+  }
   m_busHandler->clear();
-  m_scanHelper->loadConfigFiles(!m_scanConfig);
+  *reload = true;
   return RESULT_OK;
 }
 
+void MainLoop::collectMemoryUsage(vector<pair<string, size_t>>* usage) {
+  m_messages->lockShared();
+  usage->emplace_back("definitions", m_messages->getMemoryUsage());
+  m_messages->unlockShared();
+  usage->emplace_back("strings", InternedString::getPoolMemoryUsage());
+  usage->emplace_back("templates", m_scanHelper->getTemplatesMemoryUsage());
+  usage->emplace_back("grab", m_busHandler->getGrabMemoryUsage());
+  usage->emplace_back("connections", RequestImpl::getBufferMemoryUsage());
+  usage->emplace_back("http", m_scanHelper->getHttpMemoryUsage());
+  size_t handlers = 0;
+  for (const auto dataHandler : m_dataHandlers) {
+    handlers += dataHandler->getMemoryUsage();
+  }
+  usage->emplace_back("handlers", handlers);
+}
+
 result_t MainLoop::executeInfo(const vector<string>& args, const string& user, ostringstream* ostream) {
   bool verbose = args.size() == 2 && args[1] == "verbose";
   if (args.size() != 1 && !verbose) {
@@ -1919,6 +2434,17 @@ result_t MainLoop::executeInfo(const vector<string>& args, const string& user, o
   *ostream << "device: ";
   m_device->formatInfo(ostream, verbose);
   *ostream << "\n";
+  size_t busNumber = 1;
+  for (const auto otherBusHandler : m_otherBusHandlers) {
+    *ostream << "bus " << ++busNumber << ": ";
+    m_otherDevices[busNumber-2]->formatInfo(ostream, verbose);
+    if (otherBusHandler->hasSignal()) {
+      *ostream << ", signal acquired, symbol rate " << otherBusHandler->getSymbolRate();
+    } else {
+      *ostream << ", no signal";
+    }
+    *ostream << "\n";
+  }
   if (!user.empty()) {
     *ostream << "user: " << user << "\n";
   }
@@ -1938,6 +2464,10 @@ result_t MainLoop::executeInfo(const vector<string>& args, const string& user, o
       *ostream << "min symbol latency: " << m_busHandler->getMinSymbolLatency() << "\n"
                << "max symbol latency: " << m_busHandler->getMaxSymbolLatency() << "\n";
     }
+    if (m_busHandler->getMaxSymbolJitter() >= 0) {
+      *ostream << "avg symbol jitter micros: " << m_busHandler->getAvgSymbolJitter() << "\n"
+               << "max symbol jitter micros: " << m_busHandler->getMaxSymbolJitter() << "\n";
+    }
     if (m_scanStatus != SCAN_STATUS_NONE) {
       *ostream << "scan: " << (m_scanStatus == SCAN_STATUS_FINISHED ? "finished" : "running");
       unsigned int running = m_busHandler->getRunningScans();
@@ -1954,7 +2484,13 @@ result_t MainLoop::executeInfo(const vector<string>& args, const string& user, o
            << "messages: " << m_messages->size() << "\n"
            << "conditional: " << m_messages->sizeConditional() << "\n"
            << "poll: " << m_messages->sizePoll() << "\n"
-           << "update: " << m_messages->sizePassive();
+           << "update: " << m_messages->sizePassive() << "\n";
+  vector<pair<string, size_t>> usage;
+  collectMemoryUsage(&usage);
+  for (const auto& it : usage) {
+    *ostream << "memory " << it.first << ": " << it.second << "\n";
+  }
+  m_busHandler->formatGrabInfo(ostream);
   m_busHandler->formatSeenInfo(ostream);
   return RESULT_OK;
 }
@@ -1999,7 +2535,7 @@ result_t MainLoop::executeHelp(ostringstream* ostream) {
       " log       Set log area level:    log [AREA[,AREA]* LEVEL]\n"
       " raw       Toggle logging of messages or each byte.\n"
       " dump      Toggle binary dump of received bytes\n"
-      " reload    Reload CSV config files\n"
+      " reload    Reload CSV config files: reload [full]\n"
       " quit|q    Close connection\n"
       " help|?    Print help             help [COMMAND], COMMMAND ?";
   return RESULT_OK;
@@ -2014,7 +2550,8 @@ bool parseBoolQuery(const string& value) {
   return value.length() == 0 || value == "1" || value == "true";
 }
 
-result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostringstream* ostream) {
+result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ResultStreamer* streamer,
+    ostringstream* ostream) {
   time_t maxAge = -1;
   size_t argPos = 1;
   string uri = args[argPos++];
@@ -2029,8 +2566,8 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
       circuit = uri.substr(6, pos - 6);
       name = uri.substr(pos + 1);
     }
-    bool required = false, full = false, withWrite = false, raw = false;
-    bool withDefinition = false;
+    bool required = false, stale = false, full = false, withWrite = false, raw = false;
+    bool withDefinition = false, cbor = false;
     string newDefinition;
     OutputFormat verbosity = OF_NAMES;
     time_t since = 0;
@@ -2080,12 +2617,16 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
         } else if (qname == "maxage") {
           maxAge = parseInt(value.c_str(), 10, 0, 24*60*60, &ret);
           required = true;
+        } else if (qname == "stale") {
+          stale = parseBoolQuery(value);
         } else if (qname == "write") {
           withWrite = parseBoolQuery(value);
         } else if (qname == "raw") {
           raw = parseBoolQuery(value);
         } else if (qname == "def") {
           withDefinition = parseBoolQuery(value);
+        } else if (qname == "cbor") {
+          cbor = parseBoolQuery(value);
         } else if (qname == "define") {
           if (!m_newlyDefinedMessages || circuit.empty() || name.empty() || value.empty()) {
             ret = RESULT_ERR_INVALID_ARG;
@@ -2112,7 +2653,11 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
       }
     }
 
-    *ostream << "{";
+    if (cbor) {
+      ostream->put(static_cast<char>(CBOR_MAP_INDEFINITE));
+    } else {
+      *ostream << "{";
+    }
     string lastCircuit;
     time_t now;
     time(&now);
@@ -2123,8 +2668,13 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
       ret = m_messages->readFromStream(&defstr, "http", now, true, nullptr, &errorDescription, true);
     }
     if (ret == RESULT_OK) {
+      prepareHttpStreaming(cbor ? 10 : 6, *connected, streamer);
       bool first = true;
-      verbosity |= OF_JSON | (full ? OF_ALL_ATTRS : OF_NONE) | (withDefinition ? OF_DEFINITION : OF_NONE);
+      if (cbor) {
+        verbosity |= OF_CBOR;
+      } else {
+        verbosity |= OF_JSON | (full ? OF_ALL_ATTRS : OF_NONE) | (withDefinition ? OF_DEFINITION : OF_NONE);
+      }
       deque<Message*> messages;
       m_messages->findAll(circuit, name, getUserLevels(user), exact, true, withWrite, true, true, true, 0, 0, false,
                           &messages);
@@ -2144,7 +2694,13 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
           if (message->isPassive()) {
             continue;  // not possible to actively read this message
           }
-          if (m_busHandler->readFromBus(message, "") != RESULT_OK) {
+          if (stale && lastup != 0) {
+            // answer with the outdated value and refresh it in the background
+            m_busHandler->refreshInBackground(message);
+            if (lastup > maxLastUp) {
+              maxLastUp = lastup;
+            }
+          } else if (m_busHandler->readFromBus(message, "") != RESULT_OK) {
             continue;
           }
         } else {
@@ -2156,7 +2712,15 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
           }
         }
         bool sameCircuit = message->getCircuit() == lastCircuit;
-        if (!sameCircuit) {
+        if (!sameCircuit && cbor) {
+          if (lastCircuit.length() > 0) {
+            ostream->put(static_cast<char>(CBOR_BREAK));
+          }
+          lastCircuit = message->getCircuit();
+          appendCborText(lastCircuit, ostream);
+          ostream->put(static_cast<char>(CBOR_MAP_INDEFINITE));
+          lastName = "";
+        } else if (!sameCircuit) {
           if (lastCircuit.length() > 0) {
             *ostream << "\n  }\n },";
           }
@@ -2175,11 +2739,31 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
           Message* next = *(it+1);
           same = next->getCircuit() == lastCircuit && next->getName() == name;
         }
-        message->decodeJson(!first, same, true, raw, verbosity, ostream);
+        if (cbor) {
+          message->decodeCbor(same, verbosity, ostream);
+        } else {
+          message->decodeJsonCached(!first, same, true, raw, verbosity, ostream);
+        }
         lastName = name;
         first = false;
+        if (streamer) {
+          streamer->flush(ostream);
+        }
       }
 
+      if (cbor) {
+        if (lastCircuit.length() > 0) {
+          ostream->put(static_cast<char>(CBOR_BREAK));
+        }
+        appendCborText("global", ostream);
+        appendCborHead(CBOR_MAP, 2, ostream);
+        appendCborText("version", ostream);
+        appendCborText(PACKAGE_VERSION "." REVISION, ostream);
+        appendCborText("lastup", ostream);
+        appendCborInt(maxLastUp, ostream);
+        ostream->put(static_cast<char>(CBOR_BREAK));
+        return finishHttpResult(ret, 10, *connected, streamer, ostream);
+      }
       if (lastCircuit.length() > 0) {
         *ostream << "\n  }\n },";
       }
@@ -2214,23 +2798,46 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
       *ostream << ",\n  \"reconnects\": " << m_reconnectCount
                << ",\n  \"masters\": " << m_busHandler->getMasterCount()
                << ",\n  \"messages\": " << m_messages->size()
-               << ",\n  \"lastup\": " << static_cast<unsigned>(maxLastUp)
+               << ",\n  \"lastup\": " << static_cast<unsigned>(maxLastUp);
+      vector<pair<string, size_t>> usage;
+      collectMemoryUsage(&usage);
+      *ostream << ",\n  \"memory\": {";
+      bool firstUsage = true;
+      for (const auto& it : usage) {
+        *ostream << (firstUsage ? "" : ",") << "\n   \"" << it.first << "\": " << it.second;
+        firstUsage = false;
+      }
+      *ostream << "\n  }"
                << "\n }"
                << "\n}";
       type = 6;
     }
-    *connected = false;
-    return formatHttpResult(ret, type, ostream);
+    return finishHttpResult(ret, type, *connected, streamer, ostream);
   }  // request for "/data..."
 
+  if (uri == "/metrics") {
+    Metrics::getInstance()->format(ostream);
+    type = 11;
+    return formatHttpResult(ret, type, *connected, ostream);
+  }
+
+  if (uri == "/trace") {
+    Tracer* tracer = Tracer::getInstance();
+    if (!tracer->isEnabled()) {
+      return formatHttpResult(RESULT_ERR_NOTFOUND, type, *connected, ostream);
+    }
+    tracer->format(ostream);
+    type = 6;
+    return formatHttpResult(ret, type, *connected, ostream);
+  }
+
   if (uri == "/datatypes") {
     *ostream << "[";
     OutputFormat verbosity = OF_NAMES|OF_JSON|OF_ALL_ATTRS;
     DataTypeList::getInstance()->dump(verbosity, true, ostream);
     *ostream << "\n]";
     type = 6;
-    *connected = false;
-    return formatHttpResult(ret, type, ostream);
+    return formatHttpResult(ret, type, *connected, ostream);
   }
 
   if (uri == "/raw") {
@@ -2266,12 +2873,93 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
         time(&now);
         until = now-1;
       }
-      m_busHandler->formatGrabResult(onlyUnknown, OF_JSON, ostream, false, since, until);
+      prepareHttpStreaming(6, *connected, streamer);
+      m_busHandler->formatGrabResult(onlyUnknown, OF_JSON, ostream, false, since, until, streamer);
       *ostream << "\n]";
       type = 6;
     }
-    *connected = false;
-    return formatHttpResult(ret, type, ostream);
+    return finishHttpResult(ret, type, *connected, streamer, ostream);
+  }
+
+  if (uri.substr(0, 9) == "/history/") {
+    string circuit, name;
+    size_t pos = uri.find('/', 9);
+    if (pos != string::npos) {
+      circuit = uri.substr(9, pos - 9);
+      name = uri.substr(pos + 1);
+    }
+    if (circuit.empty() || name.empty()) {
+      ret = RESULT_ERR_INVALID_ARG;
+    }
+    OutputFormat verbosity = OF_NAMES|OF_JSON;
+    time_t since = 0;
+    string user;
+    if (ret == RESULT_OK && args.size() > argPos) {
+      string secret;
+      string query = args[argPos];
+      istringstream stream(query);
+      string token;
+      while (getline(stream, token, '&')) {
+        pos = token.find('=');
+        string qname, value;
+        if (pos != string::npos) {
+          qname = token.substr(0, pos);
+          value = token.substr(pos + 1);
+        } else {
+          qname = token;
+        }
+        if (qname == "since") {
+          since = parseInt(value.c_str(), 10, 0, 0xffffffff, &ret);
+        } else if (qname == "verbose") {
+          if (parseBoolQuery(value)) {
+            verbosity |= OF_UNITS | OF_COMMENTS;
+          }
+        } else if (qname == "numeric") {
+          if (parseBoolQuery(value)) {
+            verbosity = (verbosity & ~OF_VALUENAME) | OF_NUMERIC;
+          }
+        } else if (qname == "valuename") {
+          if (parseBoolQuery(value)) {
+            verbosity = (verbosity & ~OF_NUMERIC) | OF_VALUENAME;
+          }
+        } else if (qname == "user") {
+          user = value;
+        } else if (qname == "secret") {
+          secret = value;
+        }
+        if (ret != RESULT_OK) {
+          break;
+        }
+      }
+      if ((!user.empty() || !secret.empty()) && !m_userList.checkSecret(user, secret)) {
+        ret = RESULT_ERR_NOTAUTHORIZED;
+      }
+    }
+    Message* message = nullptr;
+    if (ret == RESULT_OK) {
+      string levels = getUserLevels(user);
+      message = m_messages->find(circuit, name, levels, false);
+      if (message == nullptr || !message->getHistory()) {
+        message = m_messages->find(circuit, name, levels, false, true);
+      }
+      if (message == nullptr) {
+        ret = RESULT_ERR_NOTFOUND;
+      } else if (!message->getHistory()) {
+        ret = RESULT_ERR_INVALID_ARG;
+      }
+    }
+    if (ret == RESULT_OK) {
+      *ostream << "{\n \"circuit\": \"" << message->getCircuit() << "\",\n \"name\": \"" << message->getName()
+               << "\",\n \"history\": ";
+      ret = message->decodeHistory(since, nullptr, -1, verbosity, ostream);
+      if (ret == RESULT_EMPTY) {
+        *ostream << "[]";
+        ret = RESULT_OK;
+      }
+      *ostream << "\n}";
+      type = 6;
+    }
+    return formatHttpResult(ret, type, *connected, ostream);
   }
 
   if (uri == "/decode") {
@@ -2326,8 +3014,7 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
       }
       type = 6;
     }
-    *connected = false;
-    return formatHttpResult(ret, type, ostream);
+    return formatHttpResult(ret, type, *connected, ostream);
   }
 
   if (uri.length() < 1 || uri[0] != '/' || uri.find("//") != string::npos || uri.find("..") != string::npos) {
@@ -2373,15 +3060,130 @@ result_t MainLoop::executeGet(const vector<string>& args, bool* connected, ostri
       }
     }
   }
-  *connected = false;
-  return formatHttpResult(ret, type, ostream);
+  return formatHttpResult(ret, type, *connected, ostream);
+}
+
+result_t MainLoop::executeEvents(const Request* req, const vector<string>& args, bool* connected,
+    RequestMode* reqMode, string* user, ostringstream* ostream) {
+  string uri = args[1];
+  string circuit, name;
+  size_t pos = uri.find('/', 8);
+  if (pos == string::npos) {
+    circuit = uri.length() <= 8 ? "" : uri.substr(8);
+  } else {
+    circuit = uri.substr(8, pos - 8);
+    name = uri.substr(pos + 1);
+  }
+  bool full = false, raw = false, withDefinition = false;
+  OutputFormat verbosity = OF_NAMES;
+  string newUser;
+  result_t ret = RESULT_OK;
+  if (args.size() > 2) {
+    string secret;
+    istringstream stream(args[2]);
+    string token;
+    while (getline(stream, token, '&')) {
+      pos = token.find('=');
+      string qname, value;
+      if (pos != string::npos) {
+        qname = token.substr(0, pos);
+        value = token.substr(pos + 1);
+      } else {
+        qname = token;
+      }
+      if (qname == "verbose") {
+        if (parseBoolQuery(value)) {
+          verbosity |= OF_UNITS | OF_COMMENTS;
+        }
+      } else if (qname == "indexed") {
+        if (parseBoolQuery(value)) {
+          verbosity &= ~OF_NAMES;
+        }
+      } else if (qname == "numeric") {
+        if (parseBoolQuery(value)) {
+          verbosity = (verbosity & ~OF_VALUENAME) | OF_NUMERIC;
+        }
+      } else if (qname == "valuename") {
+        if (parseBoolQuery(value)) {
+          verbosity = (verbosity & ~OF_NUMERIC) | OF_VALUENAME;
+        }
+      } else if (qname == "full") {
+        full = parseBoolQuery(value);
+      } else if (qname == "raw") {
+        raw = parseBoolQuery(value);
+      } else if (qname == "def") {
+        withDefinition = parseBoolQuery(value);
+      } else if (qname == "user") {
+        newUser = value;
+      } else if (qname == "secret") {
+        secret = value;
+      }
+    }
+    if ((!newUser.empty() || !secret.empty()) && !m_userList.checkSecret(newUser, secret)) {
+      ret = RESULT_ERR_NOTAUTHORIZED;
+    }
+  }
+  if (ret != RESULT_OK) {
+    return formatHttpResult(ret, 12, *connected, ostream);
+  }
+  *user = newUser;
+  reqMode->listenMode = lm_events;
+  reqMode->format = verbosity | OF_JSON | (full ? OF_ALL_ATTRS : OF_NONE)
+    | (withDefinition ? OF_DEFINITION : OF_NONE);
+  reqMode->listenWithUnknown = reqMode->listenOnlyUnknown = false;
+  time_t now;
+  time(&now);
+  m_listenSubscriptions[req->getConnectionId()] = {getUserLevels(newUser), now, now, {}, true, circuit, name, raw,
+      nullptr};
+  m_eventsSubscribed = true;
+  *connected = true;
+  *ostream << "retry: 5000\n\n";
+  return formatHttpResult(RESULT_OK, 12, true, ostream);
+}
+
+void MainLoop::formatEvent(const Message* message, bool raw, OutputFormat format, ostringstream* ostream) {
+  ostringstream json;
+  json << "{\"";
+  AttributedItem::appendJsonEscaped(message->getCircuit(), &json);
+  json << "\": {\"messages\": {";
+  message->decodeJsonCached(false, false, true, raw, format, &json);
+  json << "}}}";
+  // each line of the payload needs its own field prefix
+  *ostream << "event: update\ndata: ";
+  for (const char ch : json.str()) {
+    if (ch == '\n') {
+      *ostream << "\ndata: ";
+    } else {
+      *ostream << ch;
+    }
+  }
+  *ostream << "\n\n";
+}
+
+void MainLoop::prepareHttpStreaming(int type, bool keepAlive, ResultStreamer* streamer) {
+  if (!streamer || !streamer->isChunkedAllowed()) {
+    return;
+  }
+  ostringstream header;
+  formatHttpResult(RESULT_OK, type, keepAlive, &header, true);
+  streamer->setHttpHeader(header.str());
+}
+
+result_t MainLoop::finishHttpResult(result_t ret, int type, bool keepAlive, ResultStreamer* streamer,
+    ostringstream* ostream) {
+  if (!streamer || !streamer->isStarted()) {
+    return formatHttpResult(ret, type, keepAlive, ostream);
+  }
+  // header was already sent, so the result code can not be reported anymore
+  streamer->finish(ostream);
+  return RESULT_OK;
 }
 
-result_t MainLoop::formatHttpResult(result_t ret, int type, ostringstream* ostream) {
+result_t MainLoop::formatHttpResult(result_t ret, int type, bool keepAlive, ostringstream* ostream, bool chunked) {
   string data = ret == RESULT_OK ? ostream->str() : "";
   ostream->str("");
   ostream->clear();
-  *ostream << "HTTP/1.0 ";
+  *ostream << (keepAlive || chunked ? "HTTP/1.1 " : "HTTP/1.0 ");
   switch (ret) {
   case RESULT_OK:
     *ostream << "200 OK\r\nContent-Type: ";
@@ -2410,11 +3212,19 @@ result_t MainLoop::formatHttpResult(result_t ret, int type, ostringstream* ostre
     case 9:
       *ostream << "text/comma-separated-values";
       break;
+    case 10:
+      *ostream << "application/cbor";
+      break;
+    case 11:
+      *ostream << "text/plain;version=0.0.4;charset=utf-8";
+      break;
+    case 12:
+      *ostream << "text/event-stream;charset=utf-8\r\nCache-Control: no-cache";
+      break;
     default:
       *ostream << "text/html";
       break;
     }
-    *ostream << "\r\nContent-Length: " << setw(0) << dec << static_cast<unsigned>(data.length());
     break;
   case RESULT_ERR_NOTFOUND:
     *ostream << "404 Not Found";
@@ -2435,6 +3245,12 @@ result_t MainLoop::formatHttpResult(result_t ret, int type, ostringstream* ostre
     *ostream << "500 Internal Server Error";
     break;
   }
+  if (chunked) {
+    *ostream << "\r\nTransfer-Encoding: chunked";
+  } else if (ret != RESULT_OK || type != 12) {  // event stream is sent until the connection is closed
+    *ostream << "\r\nContent-Length: " << setw(0) << dec << static_cast<unsigned>(data.length());
+  }
+  *ostream << (keepAlive ? "\r\nConnection: keep-alive" : "\r\nConnection: close");
   *ostream << "\r\nServer: " PACKAGE_NAME "/" PACKAGE_VERSION "\r\n\r\n" << data;
   return RESULT_OK;
 }
@@ -23,7 +23,10 @@
 #include <list>
 #include <vector>
 #include <map>
+#include <set>
 #include <algorithm>
+#include <atomic>
+#include <csignal>
 #include "ebusd/bushandler.h"
 #include "ebusd/datahandler.h"
 #include "ebusd/request.h"
@@ -32,6 +35,7 @@
 #include "lib/ebus/message.h"
 #include "lib/utils/rotatefile.h"
 #include "lib/utils/httpclient.h"
+#include "lib/utils/metrics.h"
 
 namespace ebusd {
 
@@ -96,10 +100,57 @@ class UserList : public UserInfo, public MappedFileReader {
 };
 
 
+using std::set;
+
+/** the updates pending for a client connection in listen mode. */
+typedef struct listenSubscription {
+  string levels;  //!< the access levels of the user
+  time_t since;  //!< the start time of the pending updates
+  time_t lastPoll;  //!< the last time the connection fetched its updates
+  set<uint64_t> keys;  //!< the keys of the updated @a Message instances since @a since
+  bool events;  //!< whether the updates are sent as HTTP server-sent events
+  string circuit;  //!< the circuit name to filter the server-sent events by, or empty for all
+  string name;  //!< the message name to filter the server-sent events by, or empty for all
+  bool raw;  //!< whether to add the raw data to the server-sent events
+  Request* parked;  //!< the server-sent events @a Request waiting for updates to answer, or nullptr
+} listenSubscription_t;
+
+
+/**
+ * The @a DeviceListener for the @a Device of an additional bus segment (only logging the status).
+ */
+class OtherBusListener : public DeviceListener {
+ public:
+  /**
+   * Constructor.
+   * @param device the @a Device of the additional bus segment.
+   */
+  explicit OtherBusListener(const Device* device) : DeviceListener(), m_device(device) {}
+
+  // @copydoc
+  void notifyDeviceData(symbol_t symbol, bool received) override {}
+
+  // @copydoc
+  void notifyStatus(bool error, const char* message) override;
+
+
+ private:
+  /** the @a Device of the additional bus segment. */
+  const Device* m_device;
+};
+
+
+/** the number of the last received shutdown signal, or 0 (only set by the signal handler). */
+extern volatile sig_atomic_t g_shutdownSignal;
+
+/** set to 1 when the log file is to be reopened (only set by the signal handler). */
+extern volatile sig_atomic_t g_reopenLogSignal;
+
+
 /**
  * The main loop handling requests from connected clients.
  */
-class MainLoop : public Thread, DeviceListener {
+class MainLoop : public Thread, DeviceListener, StoreListener {
  public:
   /**
    * Construct the main loop and create bus handling components.
@@ -108,9 +159,10 @@ class MainLoop : public Thread, DeviceListener {
    * @param messages the @a MessageMap instance.
    * @param scanHelper the @a ScanHelper instance.
    * @param requestQueue the reference to the @a Request @a Queue.
+   * @param otherDevices the @a Device instances of additional bus segments (taken over by the main loop).
    */
   MainLoop(const struct options& opt, Device *device, MessageMap* messages, ScanHelper* scanHelper,
-      Queue<Request*>* requestQueue);
+      BoundedQueue<Request*>* requestQueue, const vector<Device*>& otherDevices = {});
 
   /**
    * Destructor.
@@ -134,6 +186,9 @@ class MainLoop : public Thread, DeviceListener {
   // @copydoc
   void notifyStatus(bool error, const char* message) override;
 
+  // @copydoc
+  void notifyStored(const Message* message) override;
+
 
  protected:
   // @copydoc
@@ -141,6 +196,48 @@ class MainLoop : public Thread, DeviceListener {
 
 
  private:
+  /**
+   * Apply the configured scheduling policy and CPU affinity to the thread of a started @a BusHandler.
+   * @param busHandler the started @a BusHandler.
+   * @param opt the program options.
+   */
+  static void setBusScheduling(BusHandler* busHandler, const struct options& opt);
+
+  /**
+   * Find the messages changed in the time range once and add them to each matching listen subscription.
+   * @param since the start time of the range (inclusive).
+   * @param until the end time of the range (exclusive).
+   */
+  void fanOutListenUpdates(time_t since, time_t until);
+
+  /**
+   * Add the keys of the @a Message instances stored by the bus handler in the meantime to each matching server-sent
+   * events subscription and answer the parked requests having updates or a due keep-alive.
+   * @param now the current time.
+   */
+  void fanOutStoredUpdates(time_t now);
+
+  /**
+   * Check whether a @a Message matches the levels and filters of a listen subscription.
+   * @param subscription the listen subscription.
+   * @param message the @a Message to check.
+   * @return true when the @a Message matches.
+   */
+  static bool matchesSubscription(const listenSubscription_t& subscription, const Message* message);
+
+  /**
+   * Format the updates pending for a listen subscription and clear them.
+   * @param subscription the listen subscription.
+   * @param format the @a OutputFormat options to use.
+   * @param ostream the @a ostringstream to format the updates to.
+   */
+  void formatListenUpdates(listenSubscription_t* subscription, OutputFormat format, ostringstream* ostream);
+
+  /**
+   * Handle the signals flagged by the signal handler in the meantime (log file reopening and shutdown).
+   */
+  void handleSignals();
+
   /**
    * Decode and execute client request.
    * @param req the @a Request to decode.
@@ -148,11 +245,12 @@ class MainLoop : public Thread, DeviceListener {
    * @param reqMode the @a RequestMode to use and update.
    * @param user set to the new user name when changed by authentication.
    * @param reload set to true when the configuration files were reloaded.
+   * @param streamer the @a ResultStreamer for passing large results in parts.
    * @param ostream the @a ostringstream to format the result string to.
    * @return the result code.
    */
   result_t decodeRequest(Request* req, bool* connected, RequestMode* reqMode,
-      string* user, bool* reload, ostringstream* ostream);
+      string* user, bool* reload, ResultStreamer* streamer, ostringstream* ostream);
 
   /**
    * Parse the hex master message from the remaining arguments.
@@ -182,6 +280,22 @@ class MainLoop : public Thread, DeviceListener {
    */
   result_t executeAuth(const vector<string>& args, string* user, ostringstream* ostream);
 
+  /**
+   * Read the config files only indexed on startup for the newly seen slaves or for a circuit.
+   * @param circuit the circuit name to read the files for, or empty for the newly seen slaves.
+   */
+  void loadLazyConfigFiles(const string& circuit);
+
+  /**
+   * Restore the last data of messages and the scan results from the state file.
+   */
+  void loadState();
+
+  /**
+   * Persist the last data of messages and the scan results to the state file.
+   */
+  void saveState();
+
   /**
    * Execute the read command.
    * @param args the arguments passed to the command (starting with the command itself), or empty for help.
@@ -232,10 +346,12 @@ class MainLoop : public Thread, DeviceListener {
    * Execute the find command.
    * @param args the arguments passed to the command (starting with the command itself), or empty for help.
    * @param levels the current user's access levels.
+   * @param streamer the @a ResultStreamer for passing large results in parts.
    * @param ostream the @a ostringstream to format the result string to.
    * @return the result code.
    */
-  result_t executeFind(const vector<string>& args, const string& levels, ostringstream* ostream);
+  result_t executeFind(const vector<string>& args, const string& levels, ResultStreamer* streamer,
+      ostringstream* ostream);
 
   /**
    * Execute the listen command.
@@ -257,10 +373,11 @@ class MainLoop : public Thread, DeviceListener {
   /**
    * Execute the grab command.
    * @param args the arguments passed to the command (starting with the command itself), or empty for help.
+   * @param streamer the @a ResultStreamer for passing large results in parts.
    * @param ostream the @a ostringstream to format the result string to.
    * @return the result code.
    */
-  result_t executeGrab(const vector<string>& args, ostringstream* ostream);
+  result_t executeGrab(const vector<string>& args, ResultStreamer* streamer, ostringstream* ostream);
 
   /**
    * Execute the define command.
@@ -322,10 +439,17 @@ class MainLoop : public Thread, DeviceListener {
   /**
    * Execute the reload command.
    * @param args the arguments passed to the command (starting with the command itself), or empty for help.
+   * @param reload set to true when all configuration files were reloaded.
    * @param ostream the @a ostringstream to format the result string to.
    * @return the result code.
    */
-  result_t executeReload(const vector<string>& args, ostringstream* ostream);
+  result_t executeReload(const vector<string>& args, bool* reload, ostringstream* ostream);
+
+  /**
+   * Collect the estimated memory used by the subsystems.
+   * @param usage the vector to add the subsystem name and estimated number of bytes to.
+   */
+  void collectMemoryUsage(vector<pair<string, size_t>>* usage);
 
   /**
    * Execute the info command.
@@ -355,20 +479,65 @@ class MainLoop : public Thread, DeviceListener {
   /**
    * Execute the HTTP GET command.
    * @param args the arguments passed to the command (starting with the command itself).
-   * @param connected set to false when the client connection shall be closed.
+   * @param connected true when the client requested a persistent connection, set to false when the client connection
+   * shall be closed.
+   * @param streamer the @a ResultStreamer for passing large results in parts, or nullptr.
    * @param ostream the @a ostringstream to format the result string to.
    * @return the result code.
    */
-  result_t executeGet(const vector<string>& args, bool* connected, ostringstream* ostream);
+  result_t executeGet(const vector<string>& args, bool* connected, ResultStreamer* streamer, ostringstream* ostream);
+
+  /**
+   * Execute the HTTP GET command for the server-sent events stream.
+   * @param req the @a Request to subscribe for updates.
+   * @param args the arguments passed to the command (starting with the command itself).
+   * @param connected set to true when the stream was started.
+   * @param reqMode the @a RequestMode to use and update.
+   * @param user the current user name to update.
+   * @param ostream the @a ostringstream to format the result string to.
+   * @return the result code.
+   */
+  result_t executeEvents(const Request* req, const vector<string>& args, bool* connected, RequestMode* reqMode,
+      string* user, ostringstream* ostream);
+
+  /**
+   * Format a server-sent event for an updated @a Message.
+   * @param message the updated @a Message.
+   * @param raw whether to add the raw data.
+   * @param format the @a OutputFormat options to use.
+   * @param ostream the @a ostringstream to format the event to.
+   */
+  static void formatEvent(const Message* message, bool raw, OutputFormat format, ostringstream* ostream);
 
   /**
    * Format the HTTP answer to the result string.
    * @param ret the result code of handling the request.
    * @param type the content type.
+   * @param keepAlive whether the connection is kept open after the answer.
    * @param ostream the @a ostringstream to format the result string to.
+   * @param chunked true to format only the header for a result with chunked transfer encoding.
    * @return the result code.
    */
-  result_t formatHttpResult(result_t ret, int type, ostringstream* ostream);
+  result_t formatHttpResult(result_t ret, int type, bool keepAlive, ostringstream* ostream, bool chunked = false);
+
+  /**
+   * Finish the HTTP answer either streamed by the @a ResultStreamer or completely formatted to the result string.
+   * @param ret the result code of handling the request.
+   * @param type the content type.
+   * @param keepAlive whether the connection is kept open after the answer.
+   * @param streamer the @a ResultStreamer, or nullptr.
+   * @param ostream the @a ostringstream to format the result string to.
+   * @return the result code.
+   */
+  result_t finishHttpResult(result_t ret, int type, bool keepAlive, ResultStreamer* streamer, ostringstream* ostream);
+
+  /**
+   * Prepare the @a ResultStreamer for streaming a successful HTTP answer if supported by the client.
+   * @param type the content type.
+   * @param keepAlive whether the connection is kept open after the answer.
+   * @param streamer the @a ResultStreamer, or nullptr.
+   */
+  void prepareHttpStreaming(int type, bool keepAlive, ResultStreamer* streamer);
 
   /** the @a Device instance. */
   Device* m_device;
@@ -431,6 +600,9 @@ class MainLoop : public Thread, DeviceListener {
   /** set to true to shutdown. */
   bool m_shutdown;
 
+  /** the log file to reopen on SIGHUP, or empty. */
+  const string m_logFile;
+
   /** perform automatic update check. */
   bool m_runUpdateCheck;
 
@@ -440,8 +612,29 @@ class MainLoop : public Thread, DeviceListener {
   /** the created @a BusHandler instance. */
   BusHandler* m_busHandler;
 
+  /** the @a Device instances of additional bus segments. */
+  vector<Device*> m_otherDevices;
+
+  /** the @a OtherBusListener instances for the additional bus segments. */
+  vector<OtherBusListener*> m_otherListeners;
+
+  /** the @a BusHandler instances of additional bus segments. */
+  vector<BusHandler*> m_otherBusHandlers;
+
+  /** the subscriptions of connections in listen mode by their connection ID to which the updates are fanned out. */
+  map<int, listenSubscription_t> m_listenSubscriptions;
+
+  /** whether any of @a m_listenSubscriptions is for server-sent events (for skipping @a notifyStored() early). */
+  std::atomic<bool> m_eventsSubscribed;
+
+  /** the @a Mutex for @a m_storedKeys. */
+  Mutex m_storedKeysMutex;
+
+  /** the keys of the @a Message instances stored by the bus handler since the last @a fanOutStoredUpdates(). */
+  set<uint64_t> m_storedKeys;
+
   /** the reference to the @a Request @a Queue. */
-  Queue<Request*>* m_requestQueue;
+  BoundedQueue<Request*>* m_requestQueue;
 
   /** the path for HTML files served by the HTTP port. */
   string m_htmlPath;
@@ -451,6 +644,15 @@ class MainLoop : public Thread, DeviceListener {
 
   /** the result of the last update check, or empty. */
   string m_updateCheck;
+
+  /** the @a MetricHistogram of the time requests wait in the request queue. */
+  MetricHistogram* m_queueWaitMetric;
+
+  /** the file for persisting the last data and scan results, or empty. */
+  const string m_stateFile;
+
+  /** whether scan results were restored from @a m_stateFile (for skipping the initial scan). */
+  bool m_stateRestored;
 };
 
 }  // namespace ebusd
@@ -21,11 +21,18 @@
 #endif
 
 #include "ebusd/mqtthandler.h"
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+#include <mqtt_protocol.h>
+#endif
+#include <poll.h>
 #include <csignal>
 #include <deque>
 #include <algorithm>
 #include <utility>
 #include "lib/utils/log.h"
+#include "lib/utils/clock.h"
+#include "lib/utils/memusage.h"
+#include "lib/utils/timerwheel.h"
 #include "lib/ebus/symbol.h"
 
 namespace ebusd {
@@ -54,6 +61,12 @@ using std::dec;
 #define O_KEPA (O_KEYF+1)
 #define O_INSE (O_KEPA+1)
 #define O_VERB (O_INSE+1)
+#define O_BATC (O_VERB+1)
+#define O_BATS (O_BATC+1)
+#define O_EXPI (O_BATS+1)
+#define O_UPRO (O_EXPI+1)
+#define O_CBOR (O_UPRO+1)
+#define O_STAL (O_CBOR+1)
 
 /** the definition of the MQTT arguments. */
 static const struct argp_option g_mqtt_argp_options[] = {
@@ -74,16 +87,31 @@ static const struct argp_option g_mqtt_argp_options[] = {
   {"mqttvar",      O_IVAR, "NAME=VALUE[,...]", 0, "Add variable(s) to the read MQTT integration settings", 0 },
   {"mqttjson",     O_JSON, "short", OPTION_ARG_OPTIONAL,
    "Publish in JSON format instead of strings, optionally in short (value directly below field key)", 0 },
+  {"mqttcbor",     O_CBOR, nullptr,      0,
+   "Publish message data in binary CBOR format instead of strings (global and definition topics are unaffected)",
+   0 },
   {"mqttverbose",  O_VERB, nullptr,      0, "Publish all available attributes", 0 },
 #if (LIBMOSQUITTO_VERSION_NUMBER >= 1003001)
   {"mqttlog",      O_LOGL, nullptr,      0, "Log library events", 0 },
 #endif
-#if (LIBMOSQUITTO_VERSION_NUMBER >= 1004001)
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+  {"mqttversion",  O_VERS, "VERSION",    0, "Use protocol VERSION (3.1, 3.1.1, or 5) [3.1]", 0 },
+  {"mqttexpiry",   O_EXPI, "SECONDS",    0,
+   "Let the broker expire published message data after SECONDS (MQTT 5 only, 0 for never) [0]", 0 },
+  {"mqttproperties", O_UPRO, nullptr,    0,
+   "Add the field unit and type as user properties to each published field (MQTT 5 only)", 0 },
+#elif (LIBMOSQUITTO_VERSION_NUMBER >= 1004001)
   {"mqttversion",  O_VERS, "VERSION",    0, "Use protocol VERSION [3.1]", 0 },
 #endif
   {"mqttignoreinvalid", O_IGIN, nullptr, 0,
    "Ignore invalid parameters during init (e.g. for DNS not resolvable yet)", 0 },
   {"mqttchanges",  O_CHGS, nullptr,      0, "Whether to only publish changed messages instead of all received", 0 },
+  {"mqttbatch",    O_BATC, "SECONDS",    0,
+   "Publish updated messages in batches at most every SECONDS, coalescing repeated updates (0 to publish with each "
+   "loop) [0]", 0 },
+  {"mqttbatchsize", O_BATS, "COUNT",     0, "Publish at most COUNT messages per batch [100]", 0 },
+  {"mqttstale",    O_STAL, nullptr,      0,
+   "Answer read requests without input from the cache right away and refresh the value in the background", 0 },
 
 #if (LIBMOSQUITTO_MAJOR >= 1)
   {"mqttca",       O_CAFI, "CA",         0, "Use CA file or dir (ending with '/') for MQTT TLS (no default)", 0 },
@@ -114,8 +142,15 @@ static bool g_logFromLib = false;         //!< log library events
 #if (LIBMOSQUITTO_VERSION_NUMBER >= 1004001)
 static int g_version = MQTT_PROTOCOL_V31;  //!< protocol version to use
 #endif
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+static unsigned int g_messageExpiry = 0;  //!< the message expiry interval in seconds for message data, 0 for never
+static bool g_userProperties = false;     //!< whether to add unit and type user properties to published fields
+#endif
 static bool g_ignoreInvalidParams = false;  //!< ignore invalid parameters during init
 static bool g_onlyChanges = false;        //!< whether to only publish changed messages instead of all received
+static unsigned int g_batchInterval = 0;  //!< the interval in seconds for publishing batched updates, 0 for no batch
+static unsigned int g_batchSize = 100;    //!< the maximum number of messages to publish per batch
+static bool g_staleReads = false;         //!< whether to answer read requests from the cache and refresh later
 
 #if (LIBMOSQUITTO_MAJOR >= 1)
 static const char* g_cafile = nullptr;    //!< CA file for TLS
@@ -264,6 +299,10 @@ static error_t mqtt_parse_opt(int key, char *arg, struct argp_state *state) {
     }
     break;
 
+  case O_CBOR:  // --mqttcbor
+    g_publishFormat |= OF_CBOR|OF_NAMES;
+    break;
+
   case O_VERB:  // --mqttverbose
     g_publishFormat = (g_publishFormat & ~OF_SHORT) | OF_NAMES|OF_UNITS|OF_COMMENTS|OF_ALL_ATTRS;
     break;
@@ -276,6 +315,12 @@ static error_t mqtt_parse_opt(int key, char *arg, struct argp_state *state) {
 
 #if (LIBMOSQUITTO_VERSION_NUMBER >= 1004001)
   case O_VERS:  // --mqttversion=3.1.1
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+    if (arg != nullptr && strcmp(arg, "5") == 0) {
+      g_version = MQTT_PROTOCOL_V5;
+      break;
+    }
+#endif
     if (arg == nullptr || arg[0] == 0 || (strcmp(arg, "3.1") != 0 && strcmp(arg, "3.1.1") != 0)) {
       argp_error(state, "invalid mqttversion");
       return EINVAL;
@@ -284,6 +329,21 @@ static error_t mqtt_parse_opt(int key, char *arg, struct argp_state *state) {
     break;
 #endif
 
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+  case O_EXPI:  // --mqttexpiry=3600
+    value = parseInt(arg, 10, 0, 0x7fffffff, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid mqttexpiry");
+      return EINVAL;
+    }
+    g_messageExpiry = value;
+    break;
+
+  case O_UPRO:  // --mqttproperties
+    g_userProperties = true;
+    break;
+#endif
+
   case O_IGIN:
     g_ignoreInvalidParams = true;
     break;
@@ -292,6 +352,28 @@ static error_t mqtt_parse_opt(int key, char *arg, struct argp_state *state) {
     g_onlyChanges = true;
     break;
 
+  case O_BATC:  // --mqttbatch=5
+    value = parseInt(arg, 10, 0, 3600, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid mqttbatch");
+      return EINVAL;
+    }
+    g_batchInterval = value;
+    break;
+
+  case O_BATS:  // --mqttbatchsize=100
+    value = parseInt(arg, 10, 1, 100000, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid mqttbatchsize");
+      return EINVAL;
+    }
+    g_batchSize = value;
+    break;
+
+  case O_STAL:
+    g_staleReads = true;
+    break;
+
 #if (LIBMOSQUITTO_MAJOR >= 1)
     case O_CAFI:  // --mqttca=file or --mqttca=dir/
       if (arg == nullptr || arg[0] == 0) {
@@ -422,6 +504,22 @@ void on_connect(
   }
 }
 
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+void on_connect_v5(struct mosquitto *mosq, void *obj, int rc, int flags, const mosquitto_property *props) {
+  if (rc != 0) {
+    logOtherError("mqtt", "connection refused: %s", mosquitto_reason_string(rc));
+    return;
+  }
+  uint16_t topicAliasMaximum = 0;
+  mosquitto_property_read_int16(props, MQTT_PROP_TOPIC_ALIAS_MAXIMUM, &topicAliasMaximum, false);
+  logOtherNotice("mqtt", "connection established (topic alias maximum %d)", topicAliasMaximum);
+  MqttHandler* handler = reinterpret_cast<MqttHandler*>(obj);
+  if (handler) {
+    handler->notifyConnected(topicAliasMaximum);
+  }
+}
+#endif
+
 #if (LIBMOSQUITTO_VERSION_NUMBER >= 1003001)
 void on_log(struct mosquitto *mosq, void *obj, int level, const char* msg) {
   switch (level) {
@@ -486,9 +584,14 @@ string removeTrailingNonTopicPart(const string& str) {
 MqttHandler::MqttHandler(UserInfo* userInfo, BusHandler* busHandler, MessageMap* messages)
   : DataSink(userInfo, "mqtt"), DataSource(busHandler), WaitThread(), m_messages(messages), m_connected(false),
     m_initialConnectFailed(false), m_lastUpdateCheckResult("."), m_lastScanStatus(SCAN_STATUS_NONE),
-    m_lastErrorLogTime(0) {
+    m_lastErrorLogTime(0), m_memoryUsage(0) {
   m_definitionsSince = 0;
   m_mosquitto = nullptr;
+  m_publishMetric = Metrics::getInstance()->getCounter("ebusd_mqtt_published_total",
+      "Number of topics published to the MQTT broker");
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+  m_topicAliasMaximum = 0;
+#endif
   bool hasIntegration = false;
   if (g_integrationFile != nullptr) {
     if (!m_replacers.parseFile(g_integrationFile)) {
@@ -664,7 +767,15 @@ MqttHandler::MqttHandler(UserInfo* userInfo, BusHandler* busHandler, MessageMap*
       mosquitto_log_callback_set(m_mosquitto, on_log);
     }
 #endif
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+    if (g_version == MQTT_PROTOCOL_V5) {
+      mosquitto_connect_v5_callback_set(m_mosquitto, on_connect_v5);
+    } else {
+      mosquitto_connect_callback_set(m_mosquitto, on_connect);
+    }
+#else
     mosquitto_connect_callback_set(m_mosquitto, on_connect);
+#endif
     mosquitto_message_callback_set(m_mosquitto, on_message);
     int ret;
 #if (LIBMOSQUITTO_MAJOR >= 1)
@@ -701,7 +812,12 @@ void MqttHandler::startHandler() {
   }
 }
 
-void MqttHandler::notifyConnected() {
+void MqttHandler::notifyConnected(uint16_t topicAliasMaximum) {
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+  // aliases are only valid for a single network connection
+  m_topicAliasMaximum = topicAliasMaximum;
+  m_topicAliases.clear();
+#endif
   if (m_mosquitto && isRunning()) {
     const string sep = (g_publishFormat & OF_JSON) ? "\"" : "";
     if (m_globalTopic.has("name")) {
@@ -818,6 +934,19 @@ void MqttHandler::notifyTopic(const string& topic, const string& data) {
         m_messages->addPollMessage(false, message);
       }
     }
+    if (isWrite && deferWrite(message, useData)) {
+      logOtherDebug("mqtt", "deferred write %s %s: %s", circuit.c_str(), name.c_str(), data.c_str());
+      return;
+    }
+    if (!isWrite && g_staleReads && useData.empty() && message->getLastUpdateTime() != 0) {
+      result_t result = m_busHandler->refreshInBackground(message);
+      if (result != RESULT_OK && result != RESULT_ERR_DUPLICATE) {
+        logOtherError("mqtt", "refresh %s %s: %s", circuit.c_str(), name.c_str(), getResultCode(result));
+      }
+      ostringstream ostream;
+      publishMessage(message, &ostream);  // the refreshed value is published with the regular updates
+      return;
+    }
     result_t result = m_busHandler->readFromBus(message, useData);
     if (result != RESULT_OK) {
       logOtherError("mqtt", "%s %s %s: %s", isWrite?"write":"read", circuit.c_str(), name.c_str(),
@@ -830,6 +959,64 @@ void MqttHandler::notifyTopic(const string& topic, const string& data) {
   publishMessage(message, &ostream);
 }
 
+size_t MqttHandler::calcMemoryUsage() {
+  size_t ret = getUpdatesMemoryUsage() + getDeferredWritesMemoryUsage()
+    + m_definitionKeys.size()*memUsageNode(sizeof(uint64_t));
+  for (const auto& it : m_messageTopics) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.second.circuit) + memUsage(it.second.name)
+      + memUsage(it.second.topic) + it.second.fieldTopics.capacity()*sizeof(string);
+    for (const auto& topic : it.second.fieldTopics) {
+      ret += memUsage(topic);
+    }
+  }
+  for (const auto& it : m_messageDefinitions) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.second.circuit) + memUsage(it.second.name)
+      + it.second.definitions.capacity()*sizeof(definition_t);
+    for (const auto& definition : it.second.definitions) {
+      ret += memUsage(definition.topic) + memUsage(definition.payload);
+    }
+  }
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+  for (const auto& it : m_topicAliases) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first);
+  }
+#endif
+  return ret;
+}
+
+void MqttHandler::notifyDeferredWrite(Message* message, const string& input, result_t result) {
+  if (result != RESULT_OK) {
+    logOtherError("mqtt", "write %s %s: %s", message->getCircuit().c_str(), message->getName().c_str(),
+        getResultCode(result));
+    return;
+  }
+  logOtherNotice("mqtt", "write %s %s: %s", message->getCircuit().c_str(), message->getName().c_str(),
+      input.c_str());
+  ostringstream ostream;
+  publishMessage(message, &ostream);
+}
+
+void MqttHandler::stop() {
+  WaitThread::stop();
+  m_notify.notify();
+}
+
+void MqttHandler::notifyUpdate(Message* message) {
+  DataSink::notifyUpdate(message);
+  if (message) {
+    m_notify.notify();  // publish without waiting for the network timeout
+  }
+  if (message && m_hasDefinitionTopic && !(message->getDataHandlerState()&1)) {
+    m_updatesMutex.lock();
+    m_definitionKeys.insert(message->getKey());  // definition might be pending until seen
+    m_updatesMutex.unlock();
+  }
+}
+
+bool MqttHandler::isChangesOnly() const {
+  return g_onlyChanges;
+}
+
 void MqttHandler::notifyUpdateCheckResult(const string& checkResult) {
   if (checkResult != m_lastUpdateCheckResult) {
     m_lastUpdateCheckResult = checkResult;
@@ -872,8 +1059,17 @@ void splitFields(const string& str, vector<string>* row) {
   FileReader::splitFields(&istr, row, &lineNo, nullptr, nullptr, false);
 }
 
+/** the interval in seconds for the regular tasks (uptime, signal, and definitions). */
+#define TASK_INTERVAL 15
+
+/** the IDs of the deadlines in the @a TimerWheel of the MQTT handler. */
+enum MqttTimer {
+  mqt_tasks,  //!< the regular tasks
+  mqt_batch,  //!< publishing the next batch of updates
+};
+
 void MqttHandler::run() {
-  time_t lastTaskRun, now, start, lastSignal = 0, lastUpdates = 0;
+  time_t lastTaskRun, now, start, lastSignal = 0, lastUpdates = 0, lastBatch = 0;
   bool signal = false;
   bool globalHasName = m_globalTopic.has("name");
   string signalTopic = m_globalTopic.get("", "signal");
@@ -881,8 +1077,9 @@ void MqttHandler::run() {
   ostringstream updates;
   unsigned int filterPriority = 0;
   unsigned int filterSeen = 0;
-  string filterCircuit, filterNonCircuit, filterName, filterNonName, filterField, filterNonField,
+  SearchPattern filterCircuit, filterNonCircuit, filterName, filterNonName, filterField, filterNonField,
       filterLevel, filterDirection;
+  uint64_t definitionsGeneration = 0;
   vector<string> typeSwitchNames;
   if (m_hasDefinitionTopic) {
     result_t result = RESULT_OK;
@@ -894,22 +1091,14 @@ void MqttHandler::run() {
     if (result != RESULT_OK) {
       filterSeen = 0;
     }
-    filterCircuit = m_replacers["filter-circuit"];
-    FileReader::tolower(&filterCircuit);
-    filterNonCircuit = m_replacers["filter-non-circuit"];
-    FileReader::tolower(&filterNonCircuit);
-    filterName = m_replacers["filter-name"];
-    FileReader::tolower(&filterName);
-    filterNonName = m_replacers["filter-non-name"];
-    FileReader::tolower(&filterNonName);
-    filterField = m_replacers["filter-field"];
-    FileReader::tolower(&filterField);
-    filterNonField = m_replacers["filter-non-field"];
-    FileReader::tolower(&filterNonField);
-    filterLevel = m_replacers["filter-level"];
-    FileReader::tolower(&filterLevel);
-    filterDirection = m_replacers["filter-direction"];
-    FileReader::tolower(&filterDirection);
+    filterCircuit = SearchPattern(m_replacers["filter-circuit"], true);
+    filterNonCircuit = SearchPattern(m_replacers["filter-non-circuit"], true);
+    filterName = SearchPattern(m_replacers["filter-name"], true);
+    filterNonName = SearchPattern(m_replacers["filter-non-name"], true);
+    filterField = SearchPattern(m_replacers["filter-field"], true);
+    filterNonField = SearchPattern(m_replacers["filter-non-field"], true);
+    filterLevel = SearchPattern(m_replacers["filter-level"], true);
+    filterDirection = SearchPattern(m_replacers["filter-direction"], true);
     if (!m_typeSwitches.empty()) {
       splitFields(m_replacers["type_switch-names"], &typeSwitchNames);
     }
@@ -917,11 +1106,27 @@ void MqttHandler::run() {
   time(&now);
   start = lastTaskRun = now;
   bool allowReconnect = false;
+  TimerWheel timers(100, 64);
+  timers.scheduleIn(mqt_tasks, TASK_INTERVAL*1000);
   while (isRunning()) {
     bool wasConnected = m_connected;
-    bool needsWait = handleTraffic(allowReconnect);
+    // wait for network traffic or a notification at most until the next deadline
+    int64_t untilNext = timers.getMillisUntilNext(clockGetMillis());
+    int untilDeferred = writeDeferred(m_messages);
+    if (untilDeferred >= 0 && (untilNext < 0 || untilDeferred < untilNext)) {
+      untilNext = untilDeferred;
+    }
+    bool needsWait = handleTraffic(allowReconnect, untilNext < 0 ? 1000 : static_cast<int>(untilNext));
     bool reconnected = !wasConnected && m_connected;
     allowReconnect = false;
+    bool runTasks = false;
+    int timer;
+    while (timers.popExpired(clockGetMillis(), &timer)) {
+      if (timer == mqt_tasks) {
+        runTasks = true;
+        timers.scheduleIn(mqt_tasks, TASK_INTERVAL*1000);
+      }  // mqt_batch only wakes up for publishing the next batch
+    }
     time(&now);
     bool sendSignal = reconnected;
     if (now < start) {
@@ -930,8 +1135,9 @@ void MqttHandler::run() {
         lastSignal -= lastTaskRun-now;
       }
       lastTaskRun = now;
-    } else if (now > lastTaskRun+15) {
+    } else if (runTasks) {
       allowReconnect = true;
+      m_memoryUsage = calcMemoryUsage();
       if (m_connected) {
         sendSignal = true;
         time_t uptime = now - start;
@@ -964,11 +1170,42 @@ void MqttHandler::run() {
       if (m_connected && m_hasDefinitionTopic) {
         ostringstream ostr;
         deque<Message*> messages;
-        m_messages->findAll("", "", m_levels, false, true, true, true, true, true, 0, 0, false, &messages);
-        bool includeActiveWrite = FileReader::matches("w", filterDirection, true, true);
+        if (m_definitionsSince <= 1) {
+          definitionsGeneration = 0;  // check all messages after start or requested config restart
+        }
+        // keep the found messages from being removed by a reload while publishing their definitions
+        m_messages->lockShared();
+        // only check the messages added since the last run (or all after reloading the configuration)
+        bool onlyAdded = m_messages->findAllAdded(&definitionsGeneration, m_levels, filterSeen == 0, &messages);
+        vector<uint64_t> unavailableKeys;
+        if (filterSeen > 0) {
+          m_updatesMutex.lock();
+          if (onlyAdded) {
+            // additionally check the messages seen since the last run or not available before
+            set<const Message*> added(messages.begin(), messages.end());
+            for (const auto key : m_definitionKeys) {
+              const vector<Message*>* keyMessages = m_messages->getByKey(key);
+              if (!keyMessages) {
+                continue;
+              }
+              for (const auto message : *keyMessages) {
+                if (message->hasLevel(m_levels, true) && added.insert(message).second) {
+                  messages.push_back(message);
+                }
+              }
+            }
+          }
+          m_definitionKeys.clear();
+          m_updatesMutex.unlock();
+        }
+        bool includeActiveWrite = filterDirection.matches("w");
         for (const auto& message : messages) {
           bool checkPollAdjust = false;
           if (filterSeen > 0) {
+            if (!message->isAvailable()) {
+              unavailableKeys.push_back(message->getKey());  // check again with the next run
+              continue;
+            }
             if (message->getLastUpdateTime() == 0) {
               if (message->isPassive()) {
                 // only wait for data on passive messages
@@ -996,15 +1233,15 @@ void MqttHandler::run() {
           } else if (message->getCreateTime() <= m_definitionsSince) {  // only newer defined
             continue;
           }
-          if (!FileReader::matches(message->getCircuit(), filterCircuit, true, true)
-          || (!filterNonCircuit.empty() && FileReader::matches(message->getCircuit(), filterNonCircuit, true, true))
-          || !FileReader::matches(message->getName(), filterName, true, true)
-          || (!filterNonName.empty() && FileReader::matches(message->getName(), filterNonName, true, true))
-          || !FileReader::matches(message->getLevel(), filterLevel, true, true)) {
+          if (!filterCircuit.matches(message->getCircuit())
+          || (!filterNonCircuit.empty() && filterNonCircuit.matches(message->getCircuit()))
+          || !filterName.matches(message->getName())
+          || (!filterNonName.empty() && filterNonName.matches(message->getName()))
+          || !filterLevel.matches(message->getLevel())) {
             continue;
           }
           const string direction = directionNames[(message->isWrite() ? 2 : 0) + (message->isPassive() ? 1 : 0)];
-          if (!FileReader::matches(direction, filterDirection, true, true)) {
+          if (!filterDirection.matches(direction)) {
             continue;
           }
           if (checkPollAdjust) {
@@ -1023,185 +1260,203 @@ void MqttHandler::run() {
               continue;  // avoid sending definition of read AND write message with the same key
             }
           }
-          StringReplacers msgValues = m_replacers;  // need a copy here as the contents are manipulated
-          msgValues.set("circuit", message->getCircuit());
-          msgValues.set("name", message->getName());
-          msgValues.set("priority", static_cast<int>(message->getPollPriority()));
-          msgValues.set("level", message->getLevel());
-          msgValues.set("direction", direction);
-          msgValues.set("messagecomment", message->getAttribute("comment"));
-          msgValues.reduce(true);
-          string str = msgValues.get("direction_map-"+direction, false, false);
-          msgValues.set("direction_map", str);
-          msgValues.reduce(true);
-          ostringstream fields;
-          size_t fieldCount = message->getFieldCount();
-          for (size_t index = 0; index < fieldCount; index++) {
-            const SingleDataField* field = message->getField(index);
-            if (!field || field->isIgnored()) {
-              continue;
-            }
-            string fieldName = message->getFieldName(index);
-            if (fieldName.empty() && fieldCount == 1) {
-              fieldName = "0";  // might occur for unnamed single field sets
-            }
-            if (!FileReader::matches(fieldName, filterField, true, true)
-            || (!filterNonField.empty() && FileReader::matches(fieldName, filterNonField, true, true))) {
-              continue;
-            }
-            const DataType* dataType = field->getDataType();
-            string typeStr;
-            if (dataType->isNumeric()) {
-              if (field->isList()) {
-                typeStr = "list";
-              } else {
-                typeStr = "number";
+          messageDefinitions_t& cached = getMessageDefinitions(message);
+          if (!cached.valid) {
+            // build the definitions only once as long as the message is not changed or replaced
+            StringReplacers msgValues = m_replacers;  // need a copy here as the contents are manipulated
+            msgValues.set("circuit", message->getCircuit());
+            msgValues.set("name", message->getName());
+            msgValues.set("priority", static_cast<int>(message->getPollPriority()));
+            msgValues.set("level", message->getLevel());
+            msgValues.set("direction", direction);
+            msgValues.set("messagecomment", message->getAttribute("comment"));
+            msgValues.reduce(true);
+            string str = msgValues.get("direction_map-"+direction, false, false);
+            msgValues.set("direction_map", str);
+            msgValues.reduce(true);
+            ostringstream fields;
+            size_t fieldCount = message->getFieldCount();
+            for (size_t index = 0; index < fieldCount; index++) {
+              const SingleDataField* field = message->getField(index);
+              if (!field || field->isIgnored()) {
+                continue;
               }
-            } else if (dataType->hasFlag(DAT)) {
-              auto dt = dynamic_cast<const DateTimeDataType*>(dataType);
-              if (dt->hasDate()) {
-                typeStr = dt->hasDate() ? "datetime" : "date";
+              string fieldName = message->getFieldName(index);
+              if (fieldName.empty() && fieldCount == 1) {
+                fieldName = "0";  // might occur for unnamed single field sets
+              }
+              if (!filterField.matches(fieldName)
+              || (!filterNonField.empty() && filterNonField.matches(fieldName))) {
+                continue;
+              }
+              const DataType* dataType = field->getDataType();
+              string typeStr;
+              if (dataType->isNumeric()) {
+                if (field->isList()) {
+                  typeStr = "list";
+                } else {
+                  typeStr = "number";
+                }
+              } else if (dataType->hasFlag(DAT)) {
+                auto dt = dynamic_cast<const DateTimeDataType*>(dataType);
+                if (dt->hasDate()) {
+                  typeStr = dt->hasDate() ? "datetime" : "date";
+                } else {
+                  typeStr = "time";
+                }
               } else {
-                typeStr = "time";
+                typeStr = "string";
               }
-            } else {
-              typeStr = "string";
-            }
-            ostr.str("");
-            ostr << "type_map-" << direction << "-" << typeStr;
-            str = msgValues.get(ostr.str(), false, false);
-            if (str.empty()) {
               ostr.str("");
-              ostr << "type_map-" << typeStr;
+              ostr << "type_map-" << direction << "-" << typeStr;
               str = msgValues.get(ostr.str(), false, false);
-            }
-            if (str.empty()) {
-              continue;
-            }
-            StringReplacers values = msgValues;  // need a copy here as the contents are manipulated
-            values.set("index", static_cast<signed>(index));
-            values.set("field", fieldName);
-            values.set("fieldname", field->getName(-1));
-            values.set("type", typeStr);
-            values.set("type_map", str);
-            values.set("basetype", dataType->getId());
-            values.set("comment", field->getAttribute("comment"));
-            values.set("unit", field->getAttribute("unit"));
-            if (dataType->isNumeric() && !dataType->hasFlag(EXP)) {
-              auto dt = dynamic_cast<const NumberDataType*>(dataType);
-              ostr.str("");
-              if (dt->getMinMax(false, g_publishFormat, &ostr) == RESULT_OK) {
-                values.set("min", ostr.str());
+              if (str.empty()) {
                 ostr.str("");
+                ostr << "type_map-" << typeStr;
+                str = msgValues.get(ostr.str(), false, false);
               }
-              if (dt->getMinMax(true, g_publishFormat, &ostr) == RESULT_OK) {
-                values.set("max", ostr.str());
-                ostr.str("");
+              if (str.empty()) {
+                continue;
               }
-              if (dt->getStep(g_publishFormat, &ostr) != RESULT_OK) {
-                // fallback method, when smallest number didn't work
-                int divisor = dt->getDivisor();
-                float step = 1.0f;
-                if (divisor > 1) {
-                  step /= static_cast<float>(divisor);
-                } else if (divisor < 0) {
-                  step *= static_cast<float>(-divisor);
+              StringReplacers values = msgValues;  // need a copy here as the contents are manipulated
+              values.set("index", static_cast<signed>(index));
+              values.set("field", fieldName);
+              values.set("fieldname", field->getName(-1));
+              values.set("type", typeStr);
+              values.set("type_map", str);
+              values.set("basetype", dataType->getId());
+              values.set("comment", field->getAttribute("comment"));
+              values.set("unit", field->getAttribute("unit"));
+              if (dataType->isNumeric() && !dataType->hasFlag(EXP)) {
+                auto dt = dynamic_cast<const NumberDataType*>(dataType);
+                ostr.str("");
+                if (dt->getMinMax(false, g_publishFormat, &ostr) == RESULT_OK) {
+                  values.set("min", ostr.str());
+                  ostr.str("");
                 }
-                ostr << static_cast<float>(step);
-              }
-              values.set("step", ostr.str());
-            }
-            if (dataType->isNumeric() && field->isList() && !values["field_values-entry"].empty()) {
-              auto vl = (dynamic_cast<const ValueListDataField*>(field))->getList();
-              string entryFormat = values["field_values-entry"];
-              string::size_type pos = -1;
-              while ((pos = entryFormat.find('$', pos+1)) != std::string::npos) {
-                if (entryFormat.substr(pos+1, 4) == "text" || entryFormat.substr(pos+1, 5) == "value") {
-                  entryFormat.replace(pos, 1, "%");
+                if (dt->getMinMax(true, g_publishFormat, &ostr) == RESULT_OK) {
+                  values.set("max", ostr.str());
+                  ostr.str("");
                 }
-              }
-              entryFormat.replace(0, 0, "entry = ");
-              string result = values["field_values-prefix"];
-              bool first = true;
-              for (const auto& it : vl) {
-                StringReplacers entry;
-                entry.parseLine(entryFormat);
-                entry.set("value", it.first);
-                entry.set("text", it.second);
-                entry.reduce();
-                if (first) {
-                  first = false;
-                } else {
-                  result += values["field_values-separator"];
+                if (dt->getStep(g_publishFormat, &ostr) != RESULT_OK) {
+                  // fallback method, when smallest number didn't work
+                  int divisor = dt->getDivisor();
+                  float step = 1.0f;
+                  if (divisor > 1) {
+                    step /= static_cast<float>(divisor);
+                  } else if (divisor < 0) {
+                    step *= static_cast<float>(-divisor);
+                  }
+                  ostr << static_cast<float>(step);
                 }
-                result += entry.get("entry", false, false);
+                values.set("step", ostr.str());
               }
-              result += values["field_values-suffix"];
-              values.set("field_values", result);
-            }
-            if (!m_typeSwitches.empty()) {
-              values.reduce(true);
-              str = values.get("type_switch-by", false, false);
-              string typeSwitch;
-              for (int i = 0; i < 2; i++) {
-                ostr.str("");
-                if (i == 0) {
-                  ostr << direction << '-';
+              if (dataType->isNumeric() && field->isList() && !values["field_values-entry"].empty()) {
+                auto vl = (dynamic_cast<const ValueListDataField*>(field))->getList();
+                string entryFormat = values["field_values-entry"];
+                string::size_type pos = -1;
+                while ((pos = entryFormat.find('$', pos+1)) != std::string::npos) {
+                  if (entryFormat.substr(pos+1, 4) == "text" || entryFormat.substr(pos+1, 5) == "value") {
+                    entryFormat.replace(pos, 1, "%");
+                  }
                 }
-                ostr << typeStr;
-                const string key = ostr.str();
-                for (auto const &check : m_typeSwitches[key]) {
-                  if (FileReader::matches(str, check.second, true, true)) {
-                    typeSwitch = check.first;
-                    i = 2;  // early exit
-                    break;
+                entryFormat.replace(0, 0, "entry = ");
+                string result = values["field_values-prefix"];
+                bool first = true;
+                for (const auto& it : vl) {
+                  StringReplacers entry;
+                  entry.parseLine(entryFormat);
+                  entry.set("value", it.first);
+                  entry.set("text", it.second);
+                  entry.reduce();
+                  if (first) {
+                    first = false;
+                  } else {
+                    result += values["field_values-separator"];
                   }
+                  result += entry.get("entry", false, false);
                 }
+                result += values["field_values-suffix"];
+                values.set("field_values", result);
               }
-              values.set("type_switch", typeSwitch);
-              if (!typeSwitchNames.empty()) {
-                vector<string> strs;
-                splitFields(typeSwitch, &strs);
-                for (size_t pos = 0; pos < typeSwitchNames.size(); pos++) {
-                  values.set(typeSwitchNames[pos], pos < strs.size() ? strs[pos] : "");
+              if (!m_typeSwitches.empty()) {
+                values.reduce(true);
+                str = values.get("type_switch-by", false, false);
+                string typeSwitch;
+                for (int i = 0; i < 2; i++) {
+                  ostr.str("");
+                  if (i == 0) {
+                    ostr << direction << '-';
+                  }
+                  ostr << typeStr;
+                  const string key = ostr.str();
+                  for (auto const &check : m_typeSwitches[key]) {
+                    if (FileReader::matches(str, check.second, true, true)) {
+                      typeSwitch = check.first;
+                      i = 2;  // early exit
+                      break;
+                    }
+                  }
+                }
+                values.set("type_switch", typeSwitch);
+                if (!typeSwitchNames.empty()) {
+                  vector<string> strs;
+                  splitFields(typeSwitch, &strs);
+                  for (size_t pos = 0; pos < typeSwitchNames.size(); pos++) {
+                    values.set(typeSwitchNames[pos], pos < strs.size() ? strs[pos] : "");
+                  }
                 }
               }
-            }
-            values.reduce(true);
-            string typePartSuffix = values["type_part-by"];
-            if (typePartSuffix.empty()) {
-              typePartSuffix = typeStr;
-            }
-            str = values.get("type_part-" + typePartSuffix, false, false);
-            values.set("type_part", str);
-            values.reduce();
-            if (m_hasDefinitionFieldsPayload) {
-              string value = values["field_payload"];
-              if (!value.empty()) {
-                if (fields.tellp() > 0) {
-                  fields << values["field-separator"];
+              values.reduce(true);
+              string typePartSuffix = values["type_part-by"];
+              if (typePartSuffix.empty()) {
+                typePartSuffix = typeStr;
+              }
+              str = values.get("type_part-" + typePartSuffix, false, false);
+              values.set("type_part", str);
+              values.reduce();
+              if (m_hasDefinitionFieldsPayload) {
+                string value = values["field_payload"];
+                if (!value.empty()) {
+                  if (fields.tellp() > 0) {
+                    fields << values["field-separator"];
+                  }
+                  fields << value;
                 }
-                fields << value;
+                continue;
               }
-              continue;
+              appendDefinition(values, &cached.definitions);
             }
-            publishDefinition(values);
+            if (fields.tellp() > 0) {
+              msgValues.set("fields_payload", fields.str());
+              appendDefinition(msgValues, &cached.definitions);
+            }
+            cached.valid = true;
           }
-          if (fields.tellp() > 0) {
-            msgValues.set("fields_payload", fields.str());
-            publishDefinition(msgValues);
+          for (const auto& definition : cached.definitions) {
+            publishTopic(definition.topic, definition.payload, definition.retain);
           }
           if (filterSeen && message->getLastUpdateTime() > message->getCreateTime()) {
             // ensure data is published as well
+            m_updatesMutex.lock();
             m_updatedMessages[message->getKey()]++;
+            m_updatesMutex.unlock();
           } else if (filterSeen && direction == "w") {
             // publish data for read pendant of write message
             Message* read = m_messages->find(message->getCircuit(), message->getName(), "", false);
             if (read && read->getLastUpdateTime() > 0) {
+              m_updatesMutex.lock();
               m_updatedMessages[read->getKey()]++;
+              m_updatesMutex.unlock();
             }
           }
         }
+        m_messages->unlockShared();
+        if (!unavailableKeys.empty()) {
+          m_updatesMutex.lock();
+          m_definitionKeys.insert(unavailableKeys.begin(), unavailableKeys.end());
+          m_updatesMutex.unlock();
+        }
         m_definitionsSince = now+1;  // +1 to not do the same ones again
         needsWait = true;
       }
@@ -1225,10 +1480,21 @@ void MqttHandler::run() {
         }
       }
     }
-    if (!m_updatedMessages.empty()) {
-      m_messages->lock();
+    m_updatesMutex.lock();
+    bool hasUpdates = !m_updatedMessages.empty();
+    m_updatesMutex.unlock();
+    if (hasUpdates && (g_batchInterval == 0 || now < lastBatch || now >= lastBatch+g_batchInterval)) {
+      // when batching, repeated updates of the same message since the last batch are coalesced in the map and the
+      // whole batch is sent out with the next mosquitto loop
+      lastBatch = now;
+      size_t published = 0;
+      m_messages->lockShared();
+      m_updatesMutex.lock();
       if (m_connected) {
         for (auto it = m_updatedMessages.begin(); it != m_updatedMessages.end(); ) {
+          if (g_batchInterval > 0 && published >= g_batchSize) {
+            break;  // remainder is published with the next batch
+          }
           const vector<Message*>* messages = m_messages->getByKey(it->first);
           if (messages) {
             for (const auto& message : *messages) {
@@ -1238,16 +1504,24 @@ void MqttHandler::run() {
                 updates.clear();
                 updates << dec;
                 publishMessage(message, &updates);
+                published++;
               }
             }
           }
           it = m_updatedMessages.erase(it);
         }
-        time(&lastUpdates);
+        if (m_updatedMessages.empty()) {
+          time(&lastUpdates);
+        }
       } else {
         m_updatedMessages.clear();
       }
-      m_messages->unlock();
+      hasUpdates = !m_updatedMessages.empty();
+      m_updatesMutex.unlock();
+      m_messages->unlockShared();
+    }
+    if (g_batchInterval > 0 && hasUpdates) {
+      timers.schedule(mqt_batch, static_cast<uint64_t>(lastBatch+g_batchInterval)*1000);
     }
     if ((!m_connected && !Wait(5)) || (needsWait && !Wait(1))) {
       break;
@@ -1291,7 +1565,7 @@ void MqttHandler::publishDefinition(StringReplacers values, const string& prefix
   publishTopic(defTopic, payload, retain);
 }
 
-void MqttHandler::publishDefinition(const StringReplacers& values) {
+void MqttHandler::appendDefinition(const StringReplacers& values, vector<definition_t>* definitions) {
   string defTopic = values.get("definition-topic", false);
   if (defTopic.empty()) {
     if (needsLog(lf_other, ll_debug)) {
@@ -1300,19 +1574,72 @@ void MqttHandler::publishDefinition(const StringReplacers& values) {
     }
     return;
   }
-  string payload = values.get("definition-payload", false);
+  definitions->emplace_back();
+  definition_t& definition = definitions->back();
+  definition.topic = defTopic;
+  definition.payload = values.get("definition-payload", false);
   string retainStr = values.get("definition-retain", false);
-  bool retain = parseBool(retainStr);
-  publishTopic(defTopic, payload, retain);
+  definition.retain = parseBool(retainStr);
+}
+
+MqttHandler::messageDefinitions_t& MqttHandler::getMessageDefinitions(const Message* message) {
+  auto it = m_messageDefinitions.find(message);
+  if (it == m_messageDefinitions.end()) {
+    if (m_messageDefinitions.size() > 2*m_messages->size()) {
+      m_messageDefinitions.clear();  // drop entries of messages no longer available after reloading the configuration
+    }
+    it = m_messageDefinitions.emplace(message, messageDefinitions_t()).first;
+    it->second.valid = false;
+  }
+  messageDefinitions_t& entry = it->second;
+  if (entry.valid && (entry.createTime != message->getCreateTime() || entry.circuit != message->getCircuit()
+      || entry.name != message->getName() || entry.priority != message->getPollPriority()
+      || entry.fieldCount != message->getFieldCount())) {
+    entry.valid = false;  // changed or different message now being stored at the same address
+  }
+  if (!entry.valid) {
+    entry.createTime = message->getCreateTime();
+    entry.circuit = message->getCircuit();
+    entry.name = message->getName();
+    entry.priority = message->getPollPriority();
+    entry.fieldCount = message->getFieldCount();
+    entry.definitions.clear();
+  }
+  return entry;
 }
 
-bool MqttHandler::handleTraffic(bool allowReconnect) {
+bool MqttHandler::handleTraffic(bool allowReconnect, int timeout) {
   if (!m_mosquitto) {
     return false;
   }
   int ret;
 #if (LIBMOSQUITTO_MAJOR >= 1)
-  ret = mosquitto_loop(m_mosquitto, -1, 1);  // waits up to 1 second for network traffic
+  int sock = mosquitto_socket(m_mosquitto);
+  if (sock >= 0) {
+    // wait for network traffic or an update to publish
+    struct pollfd fds[2] = {};
+    fds[0].fd = sock;
+    fds[0].events = static_cast<int16_t>(POLLIN | (mosquitto_want_write(m_mosquitto) ? POLLOUT : 0));
+    fds[1].fd = m_notify.notifyFD();
+    fds[1].events = POLLIN;
+    ret = MOSQ_ERR_SUCCESS;
+    if (poll(fds, 2, timeout) > 0) {
+      if (fds[1].revents) {
+        m_notify.clear();
+      }
+      if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+        ret = mosquitto_loop_read(m_mosquitto, 1);
+      }
+    }
+    if (ret == MOSQ_ERR_SUCCESS && mosquitto_want_write(m_mosquitto)) {
+      ret = mosquitto_loop_write(m_mosquitto, 1);
+    }
+    if (ret == MOSQ_ERR_SUCCESS) {
+      ret = mosquitto_loop_misc(m_mosquitto);
+    }
+  } else {
+    ret = mosquitto_loop(m_mosquitto, -1, 1);  // not connected: handles reconnect state
+  }
 #else
   ret = mosquitto_loop(m_mosquitto, -1);  // waits up to 1 second for network traffic
 #endif
@@ -1362,13 +1689,61 @@ string MqttHandler::getTopic(const Message* message, const string& suffix, const
   return m_replacers.get("topic").get(message, fieldName) + suffix;
 }
 
+const string& MqttHandler::getMessageTopic(const Message* message, ssize_t fieldIndex, const string& fieldName) {
+  auto it = m_messageTopics.find(message);
+  if (it == m_messageTopics.end()) {
+    if (m_messageTopics.size() > 2*m_messages->size()) {
+      m_messageTopics.clear();  // drop entries of messages no longer available after reloading the configuration
+    }
+    it = m_messageTopics.emplace(message, messageTopic_t()).first;
+  }
+  messageTopic_t& entry = it->second;
+  if (entry.topic.empty() || entry.circuit != message->getCircuit() || entry.name != message->getName()) {
+    // new entry or different message now being stored at the same address
+    entry.circuit = message->getCircuit();
+    entry.name = message->getName();
+    entry.topic = getTopic(message);
+    entry.fieldTopics.clear();
+  }
+  if (fieldIndex < 0) {
+    return entry.topic;
+  }
+  if (entry.fieldTopics.size() <= static_cast<size_t>(fieldIndex)) {
+    entry.fieldTopics.resize(fieldIndex+1);
+  }
+  string& topic = entry.fieldTopics[fieldIndex];
+  if (topic.empty()) {
+    topic = getTopic(message, "", fieldName);
+  }
+  return topic;
+}
+
 void MqttHandler::publishMessage(const Message* message, ostringstream* updates, bool includeWithoutData) {
   OutputFormat outputFormat = g_publishFormat;
   bool json = outputFormat & OF_JSON;
   bool noData = includeWithoutData && message->getLastUpdateTime() == 0;
+  bool cbor = outputFormat & OF_CBOR;
   if (!m_publishByField) {
     if (noData) {
-      publishEmptyTopic(getTopic(message));  // alternatively: , json ? "null" : "");
+      publishEmptyTopic(getMessageTopic(message));  // alternatively: , json ? "null" : "");
+      return;
+    }
+    if (cbor) {
+      if (m_staticTopic) {
+        appendCborHead(CBOR_MAP, 3, updates);
+        appendCborText("circuit", updates);
+        appendCborText(message->getCircuit(), updates);
+        appendCborText("name", updates);
+        appendCborText(message->getName(), updates);
+        appendCborText("fields", updates);
+      }
+      result_t result = message->decodeLastDataCbor(-1, outputFormat, updates);
+      if (result != RESULT_OK) {
+        logOtherError("mqtt", "decode %s %s: %s", message->getCircuit().c_str(), message->getName().c_str(),
+            getResultCode(result));
+        return;
+      }
+      publishTopic(getMessageTopic(message), updates->str(), false, true);
       return;
     }
     if (json) {
@@ -1392,7 +1767,7 @@ void MqttHandler::publishMessage(const Message* message, ostringstream* updates,
       }
       *updates << "}";
     }
-    publishTopic(getTopic(message), updates->str());
+    publishTopic(getMessageTopic(message), updates->str(), false, true);
     return;
   }
   if (json && !(outputFormat & OF_ALL_ATTRS)) {
@@ -1401,26 +1776,68 @@ void MqttHandler::publishMessage(const Message* message, ostringstream* updates,
   for (size_t index = 0; index < message->getFieldCount(); index++) {
     string name = message->getFieldName(index);
     if (noData) {
-      publishEmptyTopic(getTopic(message, "", name));  // alternatively: , json ? "null" : "");
+      publishEmptyTopic(getMessageTopic(message, index, name));  // alternatively: , json ? "null" : "");
       continue;
     }
-    result_t result = message->decodeLastData(false, nullptr, index, outputFormat, updates);
+    result_t result = cbor ? message->decodeLastDataCbor(index, outputFormat, updates)
+      : message->decodeLastData(false, nullptr, index, outputFormat, updates);
     if (result != RESULT_OK) {
       logOtherError("mqtt", "decode %s %s %s: %s", message->getCircuit().c_str(), message->getName().c_str(),
           name.c_str(), getResultCode(result));
       return;
     }
-    publishTopic(getTopic(message, "", name), updates->str());
+    publishTopic(getMessageTopic(message, index, name), updates->str(), false, true, message->getField(index));
     updates->str("");
     updates->clear();
   }
 }
 
-void MqttHandler::publishTopic(const string& topic, const string& data, bool retain) {
+void MqttHandler::publishTopic(const string& topic, const string& data, bool retain, bool messageData,
+    const SingleDataField* field) {
   const char* topicStr = topic.c_str();
   const char* dataStr = data.c_str();
-  const size_t len = strlen(dataStr);
-  logOtherDebug("mqtt", "publish %s %s", topicStr, dataStr);
+  const size_t len = data.length();  // might contain binary data
+  if (g_publishFormat & OF_CBOR) {
+    logOtherDebug("mqtt", "publish %s (%d bytes)", topicStr, static_cast<int>(len));
+  } else {
+    logOtherDebug("mqtt", "publish %s %s", topicStr, dataStr);
+  }
+  m_publishMetric->add();
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+  if (g_version == MQTT_PROTOCOL_V5) {
+    mosquitto_property* props = nullptr;
+    uint16_t newAlias = 0;
+    // aliases are only used with QoS 0 as the library might resend other messages on a new connection with the
+    // alias no longer being known to the broker
+    if (m_topicAliasMaximum > 0 && g_qos == 0) {
+      auto it = m_topicAliases.find(topic);
+      if (it != m_topicAliases.end()) {
+        mosquitto_property_add_int16(&props, MQTT_PROP_TOPIC_ALIAS, it->second);
+        topicStr = "";  // the broker knows the topic of this alias already
+      } else if (m_topicAliases.size() < m_topicAliasMaximum) {
+        newAlias = static_cast<uint16_t>(m_topicAliases.size()+1);
+        mosquitto_property_add_int16(&props, MQTT_PROP_TOPIC_ALIAS, newAlias);
+      }
+    }
+    if (messageData && g_messageExpiry > 0) {
+      mosquitto_property_add_int32(&props, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, g_messageExpiry);
+    }
+    if (field && g_userProperties) {
+      string unit = field->getAttribute("unit");
+      if (!unit.empty()) {
+        mosquitto_property_add_string_pair(&props, MQTT_PROP_USER_PROPERTY, "unit", unit.c_str());
+      }
+      mosquitto_property_add_string_pair(&props, MQTT_PROP_USER_PROPERTY, "type",
+          field->getDataType()->getId().c_str());
+    }
+    if (check(mosquitto_publish_v5(m_mosquitto, nullptr, topicStr, (uint32_t)len,
+        reinterpret_cast<const uint8_t*>(dataStr), g_qos, g_retain || retain, props), "publish") && newAlias) {
+      m_topicAliases[topic] = newAlias;  // only known to the broker once the topic was actually sent with it
+    }
+    mosquitto_property_free_all(&props);
+    return;
+  }
+#endif
   check(mosquitto_publish(m_mosquitto, nullptr, topicStr, (uint32_t)len,
       reinterpret_cast<const uint8_t*>(dataStr), g_qos, g_retain || retain), "publish");
 }
@@ -1428,6 +1845,7 @@ void MqttHandler::publishTopic(const string& topic, const string& data, bool ret
 void MqttHandler::publishEmptyTopic(const string& topic) {
   const char* topicStr = topic.c_str();
   logOtherDebug("mqtt", "publish empty %s", topicStr);
+  m_publishMetric->add();
   check(mosquitto_publish(m_mosquitto, nullptr, topicStr, 0, nullptr, 0, g_retain), "publish empty");
 }
 
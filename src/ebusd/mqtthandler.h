@@ -20,8 +20,10 @@
 #define EBUSD_MQTTHANDLER_H_
 
 #include <mosquitto.h>
+#include <atomic>
 #include <list>
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -29,6 +31,7 @@
 #include "ebusd/bushandler.h"
 #include "lib/ebus/message.h"
 #include "lib/ebus/stringhelper.h"
+#include "lib/utils/notify.h"
 
 namespace ebusd {
 
@@ -38,6 +41,7 @@ namespace ebusd {
 
 using std::map;
 using std::pair;
+using std::set;
 using std::string;
 using std::vector;
 
@@ -81,10 +85,17 @@ class MqttHandler : public DataSink, public DataSource, public WaitThread {
   // @copydoc
   void startHandler() override;
 
+  // @copydoc
+  void stop() override;
+
+  // @copydoc
+  size_t getMemoryUsage() const override { return m_memoryUsage; }
+
   /**
    * Notify the handler of a (re-)established connection to the broker.
+   * @param topicAliasMaximum the maximum topic alias accepted by the broker (MQTT 5 only), or 0 for none.
    */
-  void notifyConnected();
+  void notifyConnected(uint16_t topicAliasMaximum = 0);
 
   /**
    * Notify the handler of a received MQTT message.
@@ -93,6 +104,12 @@ class MqttHandler : public DataSink, public DataSource, public WaitThread {
    */
   void notifyTopic(const string& topic, const string& data);
 
+  // @copydoc
+  void notifyUpdate(Message* message) override;
+
+  // @copydoc
+  bool isChangesOnly() const override;
+
   // @copydoc
   void notifyUpdateCheckResult(const string& checkResult) override;
 
@@ -103,8 +120,17 @@ class MqttHandler : public DataSink, public DataSource, public WaitThread {
   // @copydoc
   void run() override;
 
+  // @copydoc
+  void notifyDeferredWrite(Message* message, const string& input, result_t result) override;
+
 
  private:
+  /**
+   * Calculate the estimated memory used by the state (only to be called from the handler thread).
+   * @return the estimated number of bytes.
+   */
+  size_t calcMemoryUsage();
+
   /**
    * Publish a definition topic as specified in the given values.
    * @param values the values with the message specification.
@@ -118,18 +144,45 @@ class MqttHandler : public DataSink, public DataSource, public WaitThread {
   void publishDefinition(StringReplacers values, const string& prefix, const string& topic,
                          const string& circuit, const string& name, const string& fallbackPrefix);
 
+  /** a prepared definition topic. */
+  typedef struct {
+    string topic;  //!< the definition topic
+    string payload;  //!< the definition payload
+    bool retain;  //!< whether the topic shall be retained
+  } definition_t;
+
+  /** the cached definitions of a @a Message. */
+  typedef struct {
+    bool valid;  //!< whether the definitions are complete
+    time_t createTime;  //!< the creation time of the message the definitions were built for
+    string circuit;  //!< the circuit of the message the definitions were built for
+    string name;  //!< the name of the message the definitions were built for
+    size_t priority;  //!< the poll priority of the message the definitions were built for
+    size_t fieldCount;  //!< the field count of the message the definitions were built for
+    vector<definition_t> definitions;  //!< the prepared definition topics
+  } messageDefinitions_t;
+
   /**
-   * Publish a definition topic as specified in the given values.
+   * Prepare a definition topic as specified in the given values.
    * @param values the values with the message specification.
+   * @param definitions the @a vector to append the prepared definition to.
+   */
+  void appendDefinition(const StringReplacers& values, vector<definition_t>* definitions);
+
+  /**
+   * Get the cached definitions of the @a Message (invalidated when the message was changed or replaced).
+   * @param message the @a Message to get the definitions for.
+   * @return the cached definitions.
    */
-  void publishDefinition(const StringReplacers& values);
+  messageDefinitions_t& getMessageDefinitions(const Message* message);
 
   /**
    * Called regularly to handle MQTT traffic.
    * @param allowReconnect true when reconnecting to the broker is allowed.
+   * @param timeout the maximum time in milliseconds to wait for network traffic while connected.
    * @return true on error for waiting a bit until next call, or false otherwise.
    */
-  bool handleTraffic(bool allowReconnect);
+  bool handleTraffic(bool allowReconnect, int timeout);
 
   /**
    * Build the MQTT topic string for the @a Message.
@@ -140,6 +193,15 @@ class MqttHandler : public DataSink, public DataSource, public WaitThread {
    */
   string getTopic(const Message* message, const string& suffix = "", const string& fieldName = "");
 
+  /**
+   * Get the MQTT topic string for the @a Message or one of its fields from the cache (build it when not yet cached).
+   * @param message the @a Message to get the topic string for.
+   * @param fieldIndex the index of the singular field, or -1 for the whole message.
+   * @param fieldName the name of the singular field, or empty.
+   * @return the topic string.
+   */
+  const string& getMessageTopic(const Message* message, ssize_t fieldIndex = -1, const string& fieldName = "");
+
   /**
    * Prepare a @a Message and publish as topic.
    * @param message the @a Message to publish.
@@ -153,8 +215,12 @@ class MqttHandler : public DataSink, public DataSource, public WaitThread {
    * @param topic the topic string.
    * @param data the data string.
    * @param retain whether the topic shall be retained.
+   * @param messageData whether the data is from a @a Message (to let it expire with MQTT 5).
+   * @param field the singular @a SingleDataField being published for adding user properties (MQTT 5 only), or
+   * nullptr.
    */
-  void publishTopic(const string& topic, const string& data, bool retain = false);
+  void publishTopic(const string& topic, const string& data, bool retain = false, bool messageData = false,
+      const SingleDataField* field = nullptr);
 
   /**
    * Publish a topic update to MQTT without any data.
@@ -215,6 +281,40 @@ class MqttHandler : public DataSink, public DataSource, public WaitThread {
 
   /** the last system time when a communication error was logged. */
   time_t m_lastErrorLogTime;
+
+  /** the @a Notify for waking up the thread waiting for network traffic. */
+  Notify m_notify;
+
+  /** the @a MetricCounter of published topics. */
+  MetricCounter* m_publishMetric;
+
+#if (LIBMOSQUITTO_VERSION_NUMBER >= 1006000)
+  /** the maximum topic alias accepted by the broker for the current connection, or 0 for none. */
+  uint16_t m_topicAliasMaximum;
+
+  /** the topic aliases assigned for the current connection by topic. */
+  map<string, uint16_t> m_topicAliases;
+#endif
+
+  /** a cached topic of a @a Message. */
+  typedef struct {
+    string circuit;  //!< the circuit of the message the topic was built for
+    string name;  //!< the name of the message the topic was built for
+    string topic;  //!< the topic of the whole message
+    vector<string> fieldTopics;  //!< the topics of the single fields by index (when publishing by field)
+  } messageTopic_t;
+
+  /** the cached topics by @a Message. */
+  map<const Message*, messageTopic_t> m_messageTopics;
+
+  /** the cached definitions by @a Message. */
+  map<const Message*, messageDefinitions_t> m_messageDefinitions;
+
+  /** the keys of messages to check for publishing definitions with the next run (seen or not available before). */
+  set<uint64_t> m_definitionKeys;
+
+  /** the estimated memory used by the state, updated periodically by the handler thread. */
+  std::atomic<size_t> m_memoryUsage;
 };
 
 }  // namespace ebusd
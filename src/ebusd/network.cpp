@@ -24,19 +24,35 @@
 #ifdef HAVE_PPOLL
 #  include <poll.h>
 #endif
+#ifdef HAVE_EPOLL
+#  include <sys/epoll.h>
+#endif
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <fcntl.h>
+#include <cerrno>
 #include <cstring>
+#include <iomanip>
+#include <sstream>
 #include "lib/utils/log.h"
 
 namespace ebusd {
 
+using std::setfill;
+using std::setw;
+
 int Connection::m_ids = 0;
 
 #ifndef POLLRDHUP
 #define POLLRDHUP 0
 #endif
 
+/** the maximum idle time in seconds of a persistent HTTP connection. */
+#define HTTP_KEEPALIVE_TIMEOUT 15
+
+/** the maximum number of events to handle per epoll_wait() call in reactor mode. */
+#define REACTOR_MAX_EVENTS 32
+
 
 void Connection::run() {
   int ret;
@@ -75,7 +91,9 @@ void Connection::run() {
 #endif
 
   bool closed = false;
-  RequestImpl req(m_isHttp);
+  RequestImpl req(m_isHttp, getID());
+  time_t lastActivity;
+  time(&lastActivity);
 
   while (!closed) {
 #ifdef HAVE_PPOLL
@@ -132,26 +150,50 @@ void Connection::run() {
       }
 
       // decode client data
-      if (req.add(data)) {
+      bool complete = req.add(data);
+      bool disconnect = false;
+      while (complete) {
+        req.setQueued();
         m_requestQueue->push(&req);
 
         // wait for result
         logDebug(lf_network, "[%05d] wait for result", getID());
         string result;
-        bool disconnect = req.waitResponse(&result);
-
-        if (!m_socket->isValid()) {
-          break;
+        bool partial = true;
+        bool valid = true;
+        while (partial) {
+          disconnect = req.waitResponse(&result, &partial);
+          if (valid && !m_socket->isValid()) {
+            valid = false;
+            req.abortResult();  // stop streaming the remainder
+          }
+          if (valid && !result.empty() && m_socket->send(result.c_str(), result.size()) < 0) {
+            valid = false;  // e.g. the keep-alive of server-sent events to a closed connection
+            if (partial) {
+              req.abortResult();
+            }
+          }
+        }
+        if (!valid) {
+          disconnect = true;
         }
-        m_socket->send(result.c_str(), result.size());
         if (disconnect) {
           break;
         }
+        // handle pipelined requests already received (not while listening), or wait for the next events right away
+        ListenMode listenMode = req.getMode().listenMode;
+        complete = (listenMode == lm_none || listenMode == lm_events) && req.add("");
       }
-
-      if (!m_socket->isValid()) {
+      if (disconnect || !m_socket->isValid()) {
         break;
       }
+      time(&lastActivity);
+    } else if (m_isHttp) {
+      time_t now;
+      time(&now);
+      if (now > lastActivity + HTTP_KEEPALIVE_TIMEOUT) {
+        break;  // idle persistent connection
+      }
     }
   }
 
@@ -163,8 +205,57 @@ void Connection::run() {
 }
 
 
-Network::Network(const bool local, const uint16_t port, const uint16_t httpPort, Queue<Request*>* requestQueue)
-  : Thread(), m_requestQueue(requestQueue), m_listening(false) {
+void RawConnection::run() {
+  uint64_t cursor = m_rawTelegrams->getHead();
+  while (isRunning() && m_socket->isValid()) {
+    if (!m_rawTelegrams->wait(cursor, 1)) {
+      continue;
+    }
+    ostringstream output;
+    uint64_t lost = m_rawTelegrams->read(&cursor, 64, [&output](const rawTelegram_t& telegram) {
+      formatTelegram(telegram, &output);
+    });
+    string str = output.str();
+    if (lost > 0) {
+      ostringstream lostOutput;
+      lostOutput << "lost " << lost << " telegrams\n" << str;
+      str = lostOutput.str();
+    }
+    if (m_socket->send(str.c_str(), str.size()) < 0) {
+      break;
+    }
+  }
+  if (m_socket) {
+    shutdown(m_socket->getFD(), SHUT_RD);
+  }
+  time(&m_endedAt);
+  logInfo(lf_network, "[%05d] raw connection closed", getID());
+}
+
+void RawConnection::formatTelegram(const rawTelegram_t& telegram, ostream* output) {
+  *output << static_cast<unsigned long>(telegram.time.tv_sec) << "."  // NOLINT(runtime/int)
+          << setw(3) << setfill('0') << (telegram.time.tv_nsec/1000000) << setw(0)
+          << (telegram.sent ? " > " : " < ") << telegram.master.getStr();
+  if (telegram.slave.size() > 0) {
+    *output << " / " << telegram.slave.getStr();
+  }
+  if (telegram.result != RESULT_OK) {
+    *output << " " << getResultCode(telegram.result);
+  }
+  *output << "\n";
+}
+
+Network::Network(const bool local, const uint16_t port, const uint16_t httpPort, BoundedQueue<Request*>* requestQueue,
+    const bool reactor, const uint16_t rawPort, BroadcastRing<rawTelegram_t>* rawTelegrams, const char* socketPath,
+    const char* httpSocketPath, const mode_t socketMode)
+  : Thread(), m_requestQueue(requestQueue), m_unixServer(nullptr), m_httpUnixServer(nullptr),
+    m_rawTelegrams(rawTelegrams), m_listening(false), m_reactor(reactor), m_deferredRequests(0) {
+#ifndef HAVE_EPOLL
+  if (m_reactor) {
+    logError(lf_network, "reactor mode not available, using one thread per connection");
+    m_reactor = false;
+  }
+#endif
   m_tcpServer = new TCPServer(port, local ? "127.0.0.1" : "0.0.0.0");
 
   if (m_tcpServer != nullptr && m_tcpServer->start() == 0) {
@@ -180,6 +271,30 @@ Network::Network(const bool local, const uint16_t port, const uint16_t httpPort,
   } else {
     m_httpServer = nullptr;
   }
+  if (rawPort > 0 && rawTelegrams) {
+    m_rawServer = new TCPServer(rawPort, local ? "127.0.0.1" : "0.0.0.0");
+    if (m_rawServer->start() != 0) {
+      logError(lf_network, "unable to start raw stream server on port %d: error %d", rawPort, errno);
+    }
+  } else {
+    m_rawServer = nullptr;
+  }
+  if (socketPath && socketPath[0]) {
+    m_unixServer = new TCPServer(socketPath, socketMode);
+    if (m_unixServer->start() != 0) {
+      logError(lf_network, "unable to start server on socket %s: error %d", socketPath, errno);
+      delete m_unixServer;
+      m_unixServer = nullptr;
+    }
+  }
+  if (httpSocketPath && httpSocketPath[0]) {
+    m_httpUnixServer = new TCPServer(httpSocketPath, socketMode);
+    if (m_httpUnixServer->start() != 0) {
+      logError(lf_network, "unable to start HTTP server on socket %s: error %d", httpSocketPath, errno);
+      delete m_httpUnixServer;
+      m_httpUnixServer = nullptr;
+    }
+  }
 }
 
 Network::~Network() {
@@ -202,22 +317,49 @@ Network::~Network() {
   if (m_httpServer != nullptr) {
     delete m_httpServer;
   }
+  if (m_rawServer != nullptr) {
+    delete m_rawServer;
+  }
+  if (m_unixServer != nullptr) {
+    delete m_unixServer;
+  }
+  if (m_httpUnixServer != nullptr) {
+    delete m_httpUnixServer;
+  }
   join();
+  while (!m_reactorConnections.empty()) {
+    delete m_reactorConnections.back();
+    m_reactorConnections.pop_back();
+  }
 }
 
 void Network::run() {
   if (!m_listening) {
     return;
   }
+#ifdef HAVE_EPOLL
+  if (m_reactor) {
+    runReactor();
+    return;
+  }
+#endif
   int ret;
   struct timespec tdiff;
 
   // set timeout
   tdiff.tv_sec = 1;
   tdiff.tv_nsec = 0;
+  // collect the listening servers
+  TCPServer* servers[] = {m_tcpServer, m_httpServer, m_rawServer, m_unixServer, m_httpUnixServer};
+  TCPServer* listening[sizeof(servers)/sizeof(servers[0])];
+  size_t serverCount = 0;
+  for (auto server : servers) {
+    if (server) {
+      listening[serverCount++] = server;
+    }
+  }
 #ifdef HAVE_PPOLL
-  int socketCount = m_httpServer ? 2 : 1;
-  nfds_t nfds = 1+socketCount;
+  nfds_t nfds = 1 + serverCount;
   struct pollfd fds[nfds];
 
   memset(fds, 0, sizeof(fds));
@@ -225,12 +367,9 @@ void Network::run() {
   fds[0].fd = m_notify.notifyFD();
   fds[0].events = POLLIN;
 
-  fds[1].fd = m_tcpServer->getFD();
-  fds[1].events = POLLIN;
-
-  if (m_httpServer) {
-    fds[2].fd = m_httpServer->getFD();
-    fds[2].events = POLLIN;
+  for (size_t idx = 0; idx < serverCount; idx++) {
+    fds[1+idx].fd = listening[idx]->getFD();
+    fds[1+idx].events = POLLIN;
   }
 #else
 #ifdef HAVE_PSELECT
@@ -239,15 +378,12 @@ void Network::run() {
 
   FD_ZERO(&checkfds);
   FD_SET(m_notify.notifyFD(), &checkfds);
-  FD_SET(m_tcpServer->getFD(), &checkfds);
-  if (m_httpServer) {
-    FD_SET(m_httpServer->getFD(), &checkfds);
-  }
-
-  maxfd = (m_notify.notifyFD() > m_tcpServer->getFD()) ?
-    m_notify.notifyFD() : m_tcpServer->getFD();
-  if (m_httpServer && m_httpServer->getFD() > maxfd) {
-    maxfd = m_httpServer->getFD();
+  maxfd = m_notify.notifyFD();
+  for (size_t idx = 0; idx < serverCount; idx++) {
+    FD_SET(listening[idx]->getFD(), &checkfds);
+    if (listening[idx]->getFD() > maxfd) {
+      maxfd = listening[idx]->getFD();
+    }
   }
 #endif
 #endif
@@ -272,17 +408,17 @@ void Network::run() {
       cleanupCnt = 0;
       continue;
     }
-    bool newData = false, isHttp = false;
+    TCPServer* server = nullptr;
 #ifdef HAVE_PPOLL
     // new data from notify
     if (fds[0].revents & POLLIN) {
       return;
     }
     // new data from socket
-    if (fds[1].revents & POLLIN) {
-      newData = true;
-    } else if (m_httpServer && fds[2].revents & POLLIN) {
-      newData = isHttp = true;
+    for (size_t idx = 0; idx < serverCount && !server; idx++) {
+      if (fds[1+idx].revents & POLLIN) {
+        server = listening[idx];
+      }
     }
 #else
 #ifdef HAVE_PSELECT
@@ -291,26 +427,44 @@ void Network::run() {
       return;
     }
     // new data from socket
-    if (FD_ISSET(m_tcpServer->getFD(), &readfds)) {
-      newData = true;
-    } else if (m_httpServer && FD_ISSET(m_httpServer->getFD(), &readfds)) {
-      newData = isHttp = true;
+    for (size_t idx = 0; idx < serverCount && !server; idx++) {
+      if (FD_ISSET(listening[idx]->getFD(), &readfds)) {
+        server = listening[idx];
+      }
     }
 #endif
 #endif
-    if (newData) {
-      TCPSocket* socket = (isHttp ? m_httpServer : m_tcpServer)->newSocket();
-      if (socket == nullptr) {
-        continue;
-      }
-      Connection* connection = new Connection(socket, isHttp, m_requestQueue);
-      string ip = socket->getIP();
-      connection->start("connection");
-      m_connections.push_back(connection);
-      logInfo(lf_network, "[%05d] %s connection opened %s", connection->getID(), isHttp ? "HTTP" : "client",
-          ip.c_str());
+    if (!server) {
+      continue;
     }
+    if (server == m_rawServer) {
+      acceptRawConnection();
+      continue;
+    }
+    bool isHttp = server == m_httpServer || server == m_httpUnixServer;
+    TCPSocket* socket = server->newSocket();
+    if (socket == nullptr) {
+      continue;
+    }
+    Connection* connection = new Connection(socket, isHttp, m_requestQueue);
+    string ip = socket->getIP();
+    connection->start("connection");
+    m_connections.push_back(connection);
+    logInfo(lf_network, "[%05d] %s connection opened %s", connection->getID(), isHttp ? "HTTP" : "client",
+        ip.c_str());
+  }
+}
+
+void Network::acceptRawConnection() {
+  TCPSocket* socket = m_rawServer->newSocket();
+  if (socket == nullptr) {
+    return;
   }
+  Connection* connection = new RawConnection(socket, m_rawTelegrams);
+  string ip = socket->getIP();
+  connection->start("rawconnection");
+  m_connections.push_back(connection);
+  logInfo(lf_network, "[%05d] raw connection opened %s", connection->getID(), ip.c_str());
 }
 
 void Network::cleanConnections() {
@@ -330,4 +484,327 @@ void Network::cleanConnections() {
   }
 }
 
+#ifdef HAVE_EPOLL
+void Network::runReactor() {
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    logError(lf_network, "unable to create epoll instance: error %d", errno);
+    return;
+  }
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = &m_notify;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, m_notify.notifyFD(), &event);
+  event.data.ptr = &m_resultNotify;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, m_resultNotify.notifyFD(), &event);
+  event.data.ptr = m_tcpServer;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, m_tcpServer->getFD(), &event);
+  if (m_httpServer) {
+    event.data.ptr = m_httpServer;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, m_httpServer->getFD(), &event);
+  }
+  if (m_rawServer) {
+    event.data.ptr = m_rawServer;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, m_rawServer->getFD(), &event);
+  }
+  if (m_unixServer) {
+    event.data.ptr = m_unixServer;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, m_unixServer->getFD(), &event);
+  }
+  if (m_httpUnixServer) {
+    event.data.ptr = m_httpUnixServer;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, m_httpUnixServer->getFD(), &event);
+  }
+  struct epoll_event events[REACTOR_MAX_EVENTS];
+  time_t lastListenCheck = 0;
+  bool running = true;
+  while (running) {
+    if (m_deferredRequests > 0) {
+      // retry adding the requests deferred due to the full queue
+      for (auto connection : m_reactorConnections) {
+        if (connection->m_queueDeferred && queueReactorRequest(connection)) {
+          connection->m_queueDeferred = false;
+          m_deferredRequests--;
+        }
+      }
+    }
+    int ret = epoll_wait(epfd, events, REACTOR_MAX_EVENTS, m_deferredRequests > 0 ? 10 : 1000);
+    if (ret < 0 && errno != EINTR) {
+      logError(lf_network, "epoll wait failed: error %d", errno);
+      break;
+    }
+    for (int i = 0; i < ret; i++) {
+      void* ptr = events[i].data.ptr;
+      if (ptr == &m_notify) {
+        running = false;
+        break;
+      }
+      if (ptr == &m_resultNotify) {
+        m_resultNotify.clear();
+        for (auto connection : m_reactorConnections) {
+          // take the next part only when the previous one was sent in order to throttle the result producer
+          if (connection->m_pending && connection->m_writeBuffer.empty() && connection->m_request.hasResult()) {
+            completeReactorRequest(epfd, connection);
+          }
+        }
+        continue;
+      }
+      if (ptr == m_rawServer) {
+        acceptRawConnection();  // served by its own thread reading from the ring directly
+        continue;
+      }
+      if (ptr == m_tcpServer || ptr == m_httpServer || ptr == m_unixServer || ptr == m_httpUnixServer) {
+        bool isHttp = ptr == m_httpServer || ptr == m_httpUnixServer;
+        TCPSocket* socket = static_cast<TCPServer*>(ptr)->newSocket();
+        if (socket == nullptr) {
+          continue;
+        }
+        int flags = fcntl(socket->getFD(), F_GETFL);
+        if (flags < 0 || fcntl(socket->getFD(), F_SETFL, flags | O_NONBLOCK) < 0) {
+          logError(lf_network, "unable to set connection non-blocking: error %d", errno);
+          delete socket;
+          continue;
+        }
+        ReactorConnection* connection = new ReactorConnection(socket, isHttp, &m_resultNotify);
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = connection;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, socket->getFD(), &event) != 0) {
+          logError(lf_network, "unable to add connection to epoll: error %d", errno);
+          delete connection;
+          continue;
+        }
+        m_reactorConnections.push_back(connection);
+        logInfo(lf_network, "[%05d] %s connection opened %s", connection->getID(), isHttp ? "HTTP" : "client",
+            socket->getIP().c_str());
+        continue;
+      }
+      ReactorConnection* connection = static_cast<ReactorConnection*>(ptr);
+      if (connection->m_closed) {
+        continue;  // closed earlier in this round
+      }
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        closeReactorConnection(epfd, connection);
+        continue;
+      }
+      if ((events[i].events & EPOLLOUT) && !connection->m_writeBuffer.empty()) {
+        if (!sendReactorData(epfd, connection, nullptr)) {
+          continue;
+        }
+        if (connection->m_writeBuffer.empty() && connection->m_pending && connection->m_request.hasResult()) {
+          completeReactorRequest(epfd, connection);  // next part available meanwhile
+          if (connection->m_closed) {
+            continue;
+          }
+        }
+      }
+      if (events[i].events & EPOLLIN) {
+        char data[256];
+        ssize_t datalen = connection->m_socket->recv(data, sizeof(data)-1);
+        if (datalen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+          datalen = 0;
+          data[0] = '\0';
+        } else if (datalen <= 0) {
+          closeReactorConnection(epfd, connection);
+          continue;
+        } else {
+          data[datalen] = '\0';
+          time(&connection->m_lastActivity);
+          handleReactorData(epfd, connection, data);
+        }
+      }
+      if ((events[i].events & EPOLLRDHUP) && !connection->m_closed) {
+        // half-closed by the client: stop reading, but answer the pending request first
+        connection->m_peerClosed = true;
+        if (!connection->m_pending && connection->m_writeBuffer.empty()) {
+          closeReactorConnection(epfd, connection);
+        } else {
+          updateReactorEvents(epfd, connection);
+        }
+      }
+    }
+    time_t now;
+    time(&now);
+    if (now != lastListenCheck) {
+      // check for updates on listening connections without pending request
+      lastListenCheck = now;
+      if (!m_connections.empty()) {
+        cleanConnections();
+      }
+      for (auto connection : m_reactorConnections) {
+        if (connection->m_pending || connection->m_closed || !connection->m_writeBuffer.empty()) {
+          continue;
+        }
+        if (connection->m_request.getMode().listenMode != lm_none) {
+          handleReactorData(epfd, connection, "");
+        } else if (connection->m_request.isHttp() && now > connection->m_lastActivity + HTTP_KEEPALIVE_TIMEOUT) {
+          closeReactorConnection(epfd, connection);  // idle persistent connection
+        }
+      }
+    }
+    // delete closed connections no longer referenced by a pending request
+    for (auto it = m_reactorConnections.begin(); it != m_reactorConnections.end(); ) {
+      ReactorConnection* connection = *it;
+      if (connection->m_closed && connection->m_pending && !connection->m_queueDeferred
+          && connection->m_request.hasResult()) {
+        completeReactorRequest(epfd, connection);  // drain the aborted result of the closed connection
+      }
+      if (connection->m_closed && !connection->m_pending) {
+        it = m_reactorConnections.erase(it);
+        delete connection;
+      } else {
+        ++it;
+      }
+    }
+  }
+  close(epfd);
+}
+
+void Network::handleReactorData(int epfd, ReactorConnection* connection, const char* data) {
+  if (!connection->m_request.add(data)) {
+    return;
+  }
+  // stop reading from the socket until the result was sent
+  connection->m_pending = true;
+  updateReactorEvents(epfd, connection);
+  connection->m_request.setQueued();
+  if (!queueReactorRequest(connection)) {
+    connection->m_queueDeferred = true;  // retried by the event loop
+    m_deferredRequests++;
+  }
+}
+
+bool Network::queueReactorRequest(ReactorConnection* connection) {
+  if (!m_requestQueue->tryPush(&connection->m_request)) {
+    return false;
+  }
+  logDebug(lf_network, "[%05d] wait for result", connection->getID());
+  return true;
+}
+
+void Network::completeReactorRequest(int epfd, ReactorConnection* connection) {
+  string result;
+  bool partial;
+  bool disconnect = connection->m_request.waitResponse(&result, &partial);
+  if (connection->m_closed || !sendReactorData(epfd, connection, &result)) {
+    disconnect = true;
+  }
+  if (partial) {
+    return;  // remainder of the result is still outstanding
+  }
+  connection->m_pending = false;
+  if (disconnect || connection->m_closed) {
+    if (!connection->m_closed && !connection->m_writeBuffer.empty()) {
+      connection->m_closeWhenSent = true;  // close once the remainder was sent
+      updateReactorEvents(epfd, connection);
+      return;
+    }
+    closeReactorConnection(epfd, connection);
+    return;
+  }
+  updateReactorEvents(epfd, connection);
+  time(&connection->m_lastActivity);
+  ListenMode listenMode = connection->m_request.getMode().listenMode;
+  if (listenMode == lm_none || (listenMode == lm_events && !connection->m_peerClosed)) {
+    // handle pipelined requests already received (not while listening), or wait for the next events right away
+    handleReactorData(epfd, connection, "");
+  }
+  if (connection->m_peerClosed && !connection->m_pending) {
+    if (connection->m_writeBuffer.empty()) {
+      closeReactorConnection(epfd, connection);
+    } else {
+      connection->m_closeWhenSent = true;  // close once the remainder was sent
+      updateReactorEvents(epfd, connection);
+    }
+  }
+}
+
+bool Network::sendReactorData(int epfd, ReactorConnection* connection, const string* data) {
+  bool wasEmpty = connection->m_writeBuffer.empty();
+  const char* pos;
+  size_t len;
+  if (!wasEmpty) {
+    if (data) {
+      connection->m_writeBuffer.append(*data);  // keep the order
+    }
+    pos = connection->m_writeBuffer.c_str();
+    len = connection->m_writeBuffer.size();
+  } else if (data) {
+    pos = data->c_str();
+    len = data->size();
+  } else {
+    return true;
+  }
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t ret = connection->m_socket->send(pos+sent, len-sent);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      closeReactorConnection(epfd, connection);
+      return false;
+    }
+    sent += static_cast<size_t>(ret);
+  }
+  if (!wasEmpty) {
+    connection->m_writeBuffer.erase(0, sent);
+  } else if (sent < len) {
+    connection->m_writeBuffer.assign(pos+sent, len-sent);
+  }
+  if (connection->m_writeBuffer.empty() != wasEmpty) {
+    updateReactorEvents(epfd, connection);
+  }
+  if (connection->m_closeWhenSent && connection->m_writeBuffer.empty()) {
+    closeReactorConnection(epfd, connection);
+    return false;
+  }
+  return true;
+}
+
+void Network::updateReactorEvents(int epfd, ReactorConnection* connection) {
+  if (connection->m_closed) {
+    return;
+  }
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = 0;
+  if (!connection->m_peerClosed) {
+    event.events |= EPOLLRDHUP;  // unless the half-close was already seen
+  }
+  if (!connection->m_pending && !connection->m_closeWhenSent && !connection->m_peerClosed
+      && connection->m_writeBuffer.empty()) {
+    event.events |= EPOLLIN;
+  }
+  if (!connection->m_writeBuffer.empty()) {
+    event.events |= EPOLLOUT;
+  }
+  event.data.ptr = connection;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, connection->m_socket->getFD(), &event);
+}
+
+void Network::closeReactorConnection(int epfd, ReactorConnection* connection) {
+  if (connection->m_closed) {
+    return;
+  }
+  connection->m_closed = true;
+  connection->m_writeBuffer.clear();  // nothing can be sent anymore, so the pending result may be drained
+  connection->m_closeWhenSent = false;
+  int sockFD = connection->m_socket->getFD();
+  epoll_ctl(epfd, EPOLL_CTL_DEL, sockFD, nullptr);
+  shutdown(sockFD, SHUT_RD);
+  if (connection->m_queueDeferred) {
+    connection->m_queueDeferred = false;  // never handed over to the queue
+    connection->m_pending = false;
+    m_deferredRequests--;
+  } else if (connection->m_pending) {
+    connection->m_request.abortResult();  // stop streaming the remainder
+  }
+  logInfo(lf_network, "[%05d] connection closed", connection->getID());
+}
+#endif  // HAVE_EPOLL
+
 }  // namespace ebusd
@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <list>
 #include "ebusd/request.h"
+#include "ebusd/bushandler.h"
 #include "lib/ebus/datatype.h"
 #include "lib/utils/tcpsocket.h"
 #include "lib/utils/queue.h"
@@ -48,9 +49,9 @@ class Connection : public Thread {
    * @param isHttp whether this is a HTTP message.
    * @param requestQueue the reference to the @a Request @a Queue.
    */
-  Connection(TCPSocket* socket, const bool isHttp, Queue<Request*>* requestQueue)
+  Connection(TCPSocket* socket, const bool isHttp, BoundedQueue<Request*>* requestQueue)
     : Thread(), m_isHttp(isHttp), m_socket(socket), m_requestQueue(requestQueue), m_endedAt(0) {
-    m_id = ++m_ids;
+    m_id = nextID();
   }
 
   virtual ~Connection() {
@@ -82,7 +83,13 @@ class Connection : public Thread {
    */
   bool endedBefore(const time_t* time) const { return m_endedAt > 0 && time && m_endedAt < *time; }
 
- private:
+  /**
+   * Return the next connection ID.
+   * @return the next connection ID.
+   */
+  static int nextID() { return ++m_ids; }
+
+ protected:
   /** whether this is a HTTP connection. */
   const bool m_isHttp;
 
@@ -90,7 +97,7 @@ class Connection : public Thread {
   TCPSocket* m_socket;
 
   /** the reference to the @a Request @a Queue. */
-  Queue<Request*>* m_requestQueue;
+  BoundedQueue<Request*>* m_requestQueue;
 
   /** notification object for shutdown procedure. */
   Notify m_notify;
@@ -105,6 +112,96 @@ class Connection : public Thread {
   static int m_ids;
 };
 
+/**
+ * Instance of a connected client streaming the raw telegrams directly from the @a BroadcastRing.
+ */
+class RawConnection : public Connection {
+ public:
+  /**
+   * Constructor.
+   * @param socket the @a TCPSocket for communication.
+   * @param rawTelegrams the @a BroadcastRing of @a rawTelegram_t to stream.
+   */
+  RawConnection(TCPSocket* socket, BroadcastRing<rawTelegram_t>* rawTelegrams)
+    : Connection(socket, false, nullptr), m_rawTelegrams(rawTelegrams) {}
+
+  // @copydoc
+  void run() override;
+
+  /**
+   * Format a raw telegram as a single line.
+   * @param telegram the @a rawTelegram_t to format.
+   * @param output the @a ostream to append the formatted telegram to.
+   */
+  static void formatTelegram(const rawTelegram_t& telegram, ostream* output);
+
+ private:
+  /** the @a BroadcastRing of @a rawTelegram_t to stream. */
+  BroadcastRing<rawTelegram_t>* m_rawTelegrams;
+};
+
+/**
+ * Instance of a connected client, either TCP or HTTP, handled by the event loop of @a Network in reactor mode.
+ */
+class ReactorConnection {
+ public:
+  /**
+   * Constructor.
+   * @param socket the @a TCPSocket for communication.
+   * @param isHttp whether this is a HTTP message.
+   * @param resultNotify the @a Notify instance to notify when a result was set.
+   */
+  ReactorConnection(TCPSocket* socket, const bool isHttp, const Notify* resultNotify)
+    : m_socket(socket), m_id(Connection::nextID()), m_request(isHttp, m_id), m_pending(false), m_closed(false),
+      m_peerClosed(false), m_closeWhenSent(false), m_queueDeferred(false) {
+    m_request.setResultNotify(resultNotify);
+    time(&m_lastActivity);
+  }
+
+  ~ReactorConnection() {
+    if (m_socket) {
+      delete m_socket;
+      m_socket = nullptr;
+    }
+  }
+
+  /**
+   * Return the ID of this connection.
+   * @return the ID of this connection.
+   */
+  int getID() const { return m_id; }
+
+  /** the @a TCPSocket for communication. */
+  TCPSocket* m_socket;
+
+  /** the ID of this connection. */
+  const int m_id;
+
+  /** the @a RequestImpl currently being handled. */
+  RequestImpl m_request;
+
+  /** whether the request was handed over to the @a Request @a Queue and the result is still outstanding. */
+  bool m_pending;
+
+  /** whether the connection was closed (deleted as soon as no longer pending). */
+  bool m_closed;
+
+  /** whether the client shut down its sending side (answered and closed once the pending request is done). */
+  bool m_peerClosed;
+
+  /** the result data not yet accepted by the non-blocking socket. */
+  string m_writeBuffer;
+
+  /** whether the connection is to be closed as soon as the @a m_writeBuffer was sent. */
+  bool m_closeWhenSent;
+
+  /** whether the pending request could not be added to the full @a Request @a Queue yet. */
+  bool m_queueDeferred;
+
+  /** the time of the last received data or sent result. */
+  time_t m_lastActivity;
+};
+
 /**
  * Handler for all TCP and HTTP client connections and registry of active connections.
  */
@@ -116,8 +213,17 @@ class Network : public Thread {
    * @param port the port to listen for command line connections.
    * @param httpPort the port to listen for HTTP connections, or 0.
    * @param requestQueue the reference to the @a Request @a Queue.
+   * @param reactor true to handle all connections in the event loop of this thread instead of one thread per
+   * connection.
+   * @param rawPort the port to stream the raw telegrams to, or 0.
+   * @param rawTelegrams the @a BroadcastRing of @a rawTelegram_t to stream, or nullptr.
+   * @param socketPath the path of the Unix domain socket to listen for command line connections, or nullptr.
+   * @param httpSocketPath the path of the Unix domain socket to listen for HTTP connections, or nullptr.
+   * @param socketMode the permission mode of the Unix domain socket files.
    */
-  Network(const bool local, const uint16_t port, const uint16_t httpPort, Queue<Request*>* requestQueue);
+  Network(const bool local, const uint16_t port, const uint16_t httpPort, BoundedQueue<Request*>* requestQueue,
+      const bool reactor = false, const uint16_t rawPort = 0, BroadcastRing<rawTelegram_t>* rawTelegrams = nullptr,
+      const char* socketPath = nullptr, const char* httpSocketPath = nullptr, const mode_t socketMode = 0660);
 
   /**
    * destructor.
@@ -140,7 +246,7 @@ class Network : public Thread {
   list<Connection*> m_connections;
 
   /** the reference to the @a Request @a Queue. */
-  Queue<Request*>* m_requestQueue;
+  BoundedQueue<Request*>* m_requestQueue;
 
   /** the command line @a TCPServer instance. */
   TCPServer* m_tcpServer;
@@ -148,16 +254,97 @@ class Network : public Thread {
   /** the HTTP @a TCPServer instance, or nullptr. */
   TCPServer* m_httpServer;
 
+  /** the @a TCPServer instance for raw telegram stream connections, or nullptr. */
+  TCPServer* m_rawServer;
+
+  /** the Unix domain socket @a TCPServer instance for command line connections, or nullptr. */
+  TCPServer* m_unixServer;
+
+  /** the Unix domain socket @a TCPServer instance for HTTP connections, or nullptr. */
+  TCPServer* m_httpUnixServer;
+
+  /** the @a BroadcastRing of @a rawTelegram_t to stream, or nullptr. */
+  BroadcastRing<rawTelegram_t>* m_rawTelegrams;
+
   /** @a Notify object for shutdown procedure. */
   Notify m_notify;
 
   /** true if this instance is listening. */
   bool m_listening;
 
+  /** true to handle all connections in the event loop of this thread. */
+  bool m_reactor;
+
+  /** the list of active @a ReactorConnection instances (reactor mode only). */
+  list<ReactorConnection*> m_reactorConnections;
+
+  /** the number of @a ReactorConnection instances with a deferred request (reactor mode only). */
+  size_t m_deferredRequests;
+
+  /** @a Notify object for results set on a @a ReactorConnection. */
+  Notify m_resultNotify;
+
   /**
    * clean inactive connections from container.
    */
   void cleanConnections();
+
+  /**
+   * Accept a new raw telegram stream connection and start its thread.
+   */
+  void acceptRawConnection();
+
+  /**
+   * endless event loop handling all connections (reactor mode).
+   */
+  void runReactor();
+
+  /**
+   * Handle data received on a @a ReactorConnection.
+   * @param epfd the epoll file descriptor.
+   * @param connection the @a ReactorConnection.
+   * @param data the received data, or empty for checking listen mode updates.
+   */
+  void handleReactorData(int epfd, ReactorConnection* connection, const char* data);
+
+  /**
+   * Send the result of a @a ReactorConnection request that is no longer pending.
+   * @param epfd the epoll file descriptor.
+   * @param connection the @a ReactorConnection.
+   */
+  void completeReactorRequest(int epfd, ReactorConnection* connection);
+
+  /**
+   * Send data on a @a ReactorConnection without blocking, keeping the remainder in its write buffer until the
+   * socket is writable again.
+   * @param epfd the epoll file descriptor.
+   * @param connection the @a ReactorConnection.
+   * @param data the data to send, or nullptr to only send the write buffer.
+   * @return false when the connection was closed due to an error.
+   */
+  bool sendReactorData(int epfd, ReactorConnection* connection, const string* data);
+
+  /**
+   * Update the epoll events for a @a ReactorConnection: read only when no request is pending and nothing is left
+   * to be sent, and wait for the socket becoming writable while the write buffer is not empty.
+   * @param epfd the epoll file descriptor.
+   * @param connection the @a ReactorConnection.
+   */
+  void updateReactorEvents(int epfd, ReactorConnection* connection);
+
+  /**
+   * Close a @a ReactorConnection and remove it from the event loop (deleted as soon as no longer pending).
+   * @param epfd the epoll file descriptor.
+   * @param connection the @a ReactorConnection.
+   */
+  void closeReactorConnection(int epfd, ReactorConnection* connection);
+
+  /**
+   * Add the request of a @a ReactorConnection to the @a Request @a Queue without blocking the event loop.
+   * @param connection the @a ReactorConnection.
+   * @return true when the request was added, false when it was deferred because the queue is full.
+   */
+  bool queueReactorRequest(ReactorConnection* connection);
 };
 
 }  // namespace ebusd
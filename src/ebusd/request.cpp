@@ -24,12 +24,61 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <cstring>
+#include "lib/ebus/filereader.h"
+#include "lib/utils/clock.h"
 #include "lib/utils/log.h"
+#include "lib/utils/memusage.h"
 
 namespace ebusd {
 
-RequestImpl::RequestImpl(bool isHttp)
-  : Request(), m_isHttp(isHttp), m_resultSet(false), m_disconnect(false), m_listenSince(0) {
+using std::hex;
+using std::dec;
+
+void ResultStreamer::flush(ostringstream* output) {
+  if (output->tellp() < RESULT_PART_SIZE || (!m_chunked && m_request->isHttp())) {
+    return;
+  }
+  if (m_aborted) {
+    output->str("");  // drop the remainder
+    output->clear();
+    return;
+  }
+  ostringstream part;
+  if (!m_started) {
+    m_started = true;
+    part << m_httpHeader;
+  }
+  if (m_chunked) {
+    formatChunk(output->str(), &part);
+  } else {
+    part << output->str();
+  }
+  output->str("");
+  output->clear();
+  if (!m_request->addResultPart(part.str())) {
+    m_aborted = true;
+  }
+}
+
+void ResultStreamer::finish(ostringstream* output) {
+  string data = output->str();
+  output->str("");
+  output->clear();
+  if (!data.empty()) {
+    formatChunk(data, output);
+  }
+  *output << "0\r\n\r\n";
+}
+
+void ResultStreamer::formatChunk(const string& data, ostringstream* output) {
+  *output << hex << data.length() << dec << "\r\n" << data << "\r\n";
+}
+
+std::atomic<size_t> RequestImpl::s_bufferMemoryUsage(0);
+
+RequestImpl::RequestImpl(bool isHttp, int connectionId)
+  : Request(connectionId), m_memoryUsage(0), m_isHttp(isHttp), m_keepAlive(false), m_chunkedAllowed(false),
+    m_resultSet(false), m_disconnect(false), m_aborted(false), m_listenSince(0), m_resultNotify(nullptr) {
   m_mode.listenMode = lm_none;
   m_mode.format = OF_NONE;
   m_mode.listenWithUnknown = false;
@@ -40,6 +89,7 @@ RequestImpl::RequestImpl(bool isHttp)
 
 RequestImpl::~RequestImpl() {
   m_resultSet = true;
+  s_bufferMemoryUsage -= m_memoryUsage;
   pthread_mutex_destroy(&m_mutex);
   pthread_cond_destroy(&m_cond);
 }
@@ -53,13 +103,34 @@ bool RequestImpl::add(const char* request) {
   size_t pos = m_request.find(m_isHttp ? "\n\n" : "\n");
   if (pos != string::npos) {
     if (m_isHttp) {
+      m_remainder = m_request.substr(pos + 2);  // keep pipelined requests
+      m_request.resize(pos + 1);
       pos = m_request.find("\n");
+      string headers = m_request.substr(pos);  // including leading line feed
       m_request.resize(pos);  // reduce to first line
       // typical first line: GET /ehp/outsidetemp HTTP/1.1
       pos = m_request.rfind(" HTTP/");
+      m_keepAlive = m_chunkedAllowed = false;
       if (pos != string::npos) {
+        unsigned int major = 0, minor = 0;
+        if (sscanf(m_request.c_str()+pos+6, "%u.%u", &major, &minor) == 2) {
+          // persistent by default since 1.1 only, 1.0 needs an explicit keep-alive below
+          m_keepAlive = m_chunkedAllowed = major > 1 || (major == 1 && minor >= 1);
+        }
         m_request.resize(pos);  // remove "HTTP/x.x" suffix
       }
+      FileReader::tolower(&headers);
+      pos = headers.find("\nconnection:");
+      if (pos != string::npos) {
+        pos += 12;
+        string value = headers.substr(pos, headers.find('\n', pos) - pos);
+        FileReader::trim(&value);
+        if (value == "close") {
+          m_keepAlive = false;
+        } else if (value == "keep-alive") {
+          m_keepAlive = true;
+        }
+      }
       pos = 0;
       while ((pos=m_request.find('%', pos)) != string::npos && pos+2 <= m_request.length()) {
         unsigned int value1, value2;
@@ -69,11 +140,18 @@ bool RequestImpl::add(const char* request) {
         m_request[pos] = static_cast<char>(((value1&0x0f) << 4) | (value2&0x0f));
         m_request.erase(pos+1, 2);
       }
-    } else if (pos+1 == m_request.length()) {
-      m_request.resize(pos);  // reduce to complete lines
+    } else {
+      m_remainder = m_request.substr(pos + 1);  // keep pipelined requests
+      m_request.resize(pos);  // reduce to first line
     }
+    pthread_mutex_lock(&m_mutex);
+    updateMemoryUsage();
+    pthread_mutex_unlock(&m_mutex);
     return true;
   }
+  pthread_mutex_lock(&m_mutex);
+  updateMemoryUsage();
+  pthread_mutex_unlock(&m_mutex);
   return m_request.length() == 0 && m_mode.listenMode != lm_none;
 }
 
@@ -111,18 +189,84 @@ void RequestImpl::split(vector<string>* args) {
   }
 }
 
-bool RequestImpl::waitResponse(string* result) {
+bool RequestImpl::hasResult() {
   pthread_mutex_lock(&m_mutex);
+  bool resultSet = m_resultSet || !m_resultParts.empty();
+  pthread_mutex_unlock(&m_mutex);
+  return resultSet;
+}
 
-  if (!m_resultSet) {
+bool RequestImpl::waitResponse(string* result, bool* partial) {
+  pthread_mutex_lock(&m_mutex);
+
+  while (!m_resultSet && m_resultParts.empty()) {
     pthread_cond_wait(&m_cond, &m_mutex);
   }
-  m_request.clear();
-  *result = m_result;
+  if (!m_resultSet) {
+    // only a part of the result is available yet
+    result->swap(m_resultParts);
+    m_resultParts.clear();
+    *partial = true;
+    updateMemoryUsage();
+    pthread_cond_signal(&m_cond);  // wake up the waiting producer
+    pthread_mutex_unlock(&m_mutex);
+    return false;
+  }
+  *partial = false;
+  m_request.swap(m_remainder);
+  m_remainder.clear();
+  if (m_aborted) {
+    result->clear();  // an aborted result is incomplete and the client gets disconnected
+  } else {
+    *result = m_resultParts + m_result;
+  }
+  m_resultParts.clear();
   m_result.clear();
   m_resultSet = false;
+  bool disconnect = m_disconnect || m_aborted;
+  m_aborted = false;
+  updateMemoryUsage();
+  pthread_mutex_unlock(&m_mutex);
+  return disconnect;
+}
+
+bool RequestImpl::addResultPart(const string& part) {
+  pthread_mutex_lock(&m_mutex);
+  if (!m_aborted && m_resultParts.length() >= 4 * RESULT_PART_SIZE) {
+    struct timespec t;
+    clockGettime(&t);
+    t.tv_sec += RESULT_PART_TIMEOUT;
+    while (!m_aborted && m_resultParts.length() >= 4 * RESULT_PART_SIZE) {
+      if (pthread_cond_timedwait(&m_cond, &m_mutex, &t) != 0) {
+        logNotice(lf_main, "client did not retrieve result in time, aborting");
+        m_aborted = true;
+      }
+    }
+  }
+  if (m_aborted) {
+    m_resultParts.clear();  // not needed anymore
+    updateMemoryUsage();
+    pthread_mutex_unlock(&m_mutex);
+    return false;
+  }
+  m_resultParts.append(part);
+  updateMemoryUsage();
+  const Notify* notify = m_resultNotify;
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_mutex);
+  if (notify) {
+    notify->notify();
+  }
+  return true;
+}
+
+void RequestImpl::abortResult() {
+  pthread_mutex_lock(&m_mutex);
+  m_aborted = true;
+  m_resultParts.clear();
+  updateMemoryUsage();
+  pthread_cond_signal(&m_cond);  // wake up a waiting producer
   pthread_mutex_unlock(&m_mutex);
-  return m_disconnect;
 }
 
 void RequestImpl::setResult(const string& result, const string& user, RequestMode* mode, time_t listenUntil,
@@ -136,8 +280,22 @@ void RequestImpl::setResult(const string& result, const string& user, RequestMod
   }
   m_listenSince = listenUntil;
   m_resultSet = true;
+  updateMemoryUsage();
+  const Notify* notify = m_resultNotify;  // this instance might be gone right after unlocking
   pthread_cond_signal(&m_cond);
   pthread_mutex_unlock(&m_mutex);
+  if (notify) {
+    notify->notify();
+  }
+}
+
+void RequestImpl::updateMemoryUsage() {
+  size_t usage = memUsage(m_request) + memUsage(m_remainder) + memUsage(m_user) + memUsage(m_result)
+    + memUsage(m_resultParts);
+  if (usage != m_memoryUsage) {
+    s_bufferMemoryUsage += usage - m_memoryUsage;  // wraps around correctly for shrinking buffers
+    m_memoryUsage = usage;
+  }
 }
 
 }  // namespace ebusd
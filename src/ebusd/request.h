@@ -21,6 +21,7 @@
 
 #include <string>
 #include <cstdio>
+#include <atomic>
 #include <list>
 #include <vector>
 #include "lib/ebus/datatype.h"
@@ -28,6 +29,7 @@
 #include "lib/utils/notify.h"
 #include "lib/utils/thread.h"
 #include "lib/utils/log.h"
+#include "lib/utils/clock.h"
 
 namespace ebusd {
 
@@ -40,6 +42,7 @@ enum ListenMode {
   lm_none,    //!< normal mode (no listening)
   lm_listen,  //!< listening mode
   lm_direct,  //!< direct mode
+  lm_events,  //!< HTTP server-sent events mode
 };
 
 /**
@@ -57,11 +60,37 @@ struct RequestMode {
  */
 class Request {
  public:
+  /**
+   * Constructor.
+   * @param connectionId the ID of the client connection this request is reused for.
+   */
+  explicit Request(int connectionId) : m_connectionId(connectionId) {
+    m_queuedTime.tv_sec = 0;
+    m_queuedTime.tv_nsec = 0;
+  }
+
   /**
    * Destructor.
    */
   virtual ~Request() { }
 
+  /**
+   * Remember the current time as the time this request was added to the request queue.
+   */
+  void setQueued() { clockGettime(&m_queuedTime); }
+
+  /**
+   * Get the time this request was added to the request queue.
+   * @return the time this request was added to the request queue.
+   */
+  const struct timespec& getQueuedTime() const { return m_queuedTime; }
+
+  /**
+   * Return the ID of the client connection this request is reused for.
+   * @return the ID of the client connection (unique as opposed to the address of the reused request).
+   */
+  int getConnectionId() const { return m_connectionId; }
+
   /**
    * Add request data from the client.
    * @param request the request data from the client.
@@ -86,6 +115,18 @@ class Request {
    */
   virtual bool isHttp() const = 0;
 
+  /**
+   * Return whether the client requested to keep the connection open after the response (HTTP only).
+   * @return whether the client requested a persistent connection.
+   */
+  virtual bool isKeepAlive() const = 0;
+
+  /**
+   * Return whether the client supports chunked transfer encoding (HTTP/1.1 only).
+   * @return whether the client supports chunked transfer encoding.
+   */
+  virtual bool isChunkedAllowed() const = 0;
+
   /**
    * Log the request or the given response in debug level.
    */
@@ -98,11 +139,27 @@ class Request {
   virtual const string& getUser() const = 0;
 
   /**
-   * Wait for the response being set and return the result string.
-   * @param result the variable in which to store the result string.
+   * Wait for the response or a part of it being set and return the (partial) result string.
+   * @param result the variable in which to store the (partial) result string.
+   * @param partial set to true when only a part of the result was returned and the rest is still to be awaited.
    * @return true when the client shall be disconnected.
    */
-  virtual bool waitResponse(string* result) = 0;
+  virtual bool waitResponse(string* result, bool* partial) = 0;
+
+  /**
+   * Add a part of the result string and notify a waiting thread (for streaming large results).
+   * Blocks while the previously added parts were not yet retrieved and exceed the limit, but at most for
+   * @a RESULT_PART_TIMEOUT seconds after which the result is aborted.
+   * @param part the partial result string.
+   * @return false when the result was aborted and the part was dropped.
+   */
+  virtual bool addResultPart(const string& part) = 0;
+
+  /**
+   * Abort the result currently being streamed, dropping all further parts (e.g. when the client disconnected).
+   * The client connection is closed once the final result was set.
+   */
+  virtual void abortResult() = 0;
 
   /**
    * Set the result string and notify a waiting thread.
@@ -121,6 +178,101 @@ class Request {
    * @return the @a RequestMode.
    */
   virtual RequestMode getMode(time_t* listenSince = nullptr) = 0;
+
+
+ protected:
+  /** the ID of the client connection this request is reused for. */
+  const int m_connectionId;
+
+  /** the time this request was added to the request queue. */
+  struct timespec m_queuedTime;
+};
+
+/** the size of the formatted result above which a part is passed to the client while streaming. */
+#define RESULT_PART_SIZE 16384
+
+/** the maximum time in seconds to wait for the client retrieving the previous result parts. */
+#define RESULT_PART_TIMEOUT 10
+
+/**
+ * Helper for passing a large result to the client in bounded parts while it is still being formatted.
+ */
+class ResultStreamer {
+ public:
+  /**
+   * Constructor.
+   * @param request the @a Request to pass the parts to.
+   */
+  explicit ResultStreamer(Request* request) : m_request(request), m_chunked(false), m_started(false),
+    m_aborted(false) {}
+
+  /**
+   * Set the HTTP header to send before the first part and use chunked transfer encoding for all parts.
+   * @param header the HTTP header (including the empty line).
+   */
+  void setHttpHeader(const string& header) {
+    m_httpHeader = header;
+    m_chunked = true;
+  }
+
+  /**
+   * Return whether the client accepts a HTTP result with chunked transfer encoding.
+   * @return whether the client accepts a HTTP result with chunked transfer encoding.
+   */
+  bool isChunkedAllowed() const { return m_request->isChunkedAllowed(); }
+
+  /**
+   * Return whether the result is sent with chunked transfer encoding.
+   * @return whether the result is sent with chunked transfer encoding.
+   */
+  bool isChunked() const { return m_chunked; }
+
+  /**
+   * Return whether a part of the result was already passed to the client.
+   * @return whether a part of the result was already passed to the client.
+   */
+  bool isStarted() const { return m_started; }
+
+  /**
+   * Return whether the result was aborted (e.g. because the client disconnected) so that formatting can stop.
+   * @return whether the result was aborted.
+   */
+  bool isAborted() const { return m_aborted; }
+
+  /**
+   * Pass the data formatted so far to the client if it exceeds @a RESULT_PART_SIZE.
+   * @param output the @a ostringstream with the data formatted so far (cleared when passed on).
+   */
+  void flush(ostringstream* output);
+
+  /**
+   * Replace the remaining data with the final chunks of a chunked result.
+   * @param output the @a ostringstream with the remaining data.
+   */
+  void finish(ostringstream* output);
+
+ private:
+  /**
+   * Format the data as a single chunk.
+   * @param data the data to format.
+   * @param output the @a ostringstream to append the chunk to.
+   */
+  static void formatChunk(const string& data, ostringstream* output);
+
+  /** the @a Request to pass the parts to. */
+  Request* m_request;
+
+  /** whether to use chunked transfer encoding. */
+  bool m_chunked;
+
+  /** the HTTP header to send before the first part. */
+  string m_httpHeader;
+
+  /** whether a part of the result was already passed to the client. */
+  bool m_started;
+
+  /** whether the result was aborted. */
+  bool m_aborted;
 };
 
 /**
@@ -131,8 +283,9 @@ class RequestImpl : public Request {
   /**
    * Constructor.
    * @param isHttp whether this is a HTTP request.
+   * @param connectionId the ID of the client connection this request is reused for.
    */
-  explicit RequestImpl(bool isHttp);
+  RequestImpl(bool isHttp, int connectionId);
 
   /**
    * Destructor.
@@ -161,6 +314,12 @@ class RequestImpl : public Request {
   // @copydoc
   bool isHttp() const override { return m_isHttp; }
 
+  // @copydoc
+  bool isKeepAlive() const override { return m_keepAlive; }
+
+  // @copydoc
+  bool isChunkedAllowed() const override { return m_chunkedAllowed; }
+
   // @copydoc
   void log(const string* response = nullptr) const override {
     if (response) {
@@ -178,7 +337,13 @@ class RequestImpl : public Request {
   const string& getUser() const override { return m_user; }
 
   // @copydoc
-  bool waitResponse(string* result) override;
+  bool waitResponse(string* result, bool* partial) override;
+
+  // @copydoc
+  bool addResultPart(const string& part) override;
+
+  // @copydoc
+  void abortResult() override;
 
   // @copydoc
   void setResult(const string& result, const string& user, RequestMode* mode, time_t listenUntil,
@@ -192,14 +357,53 @@ class RequestImpl : public Request {
     return m_mode;
   }
 
+  /**
+   * Set the @a Notify instance to notify whenever the result was set (for waiting asynchronously).
+   * @param notify the @a Notify instance, or nullptr.
+   */
+  void setResultNotify(const Notify* notify) { m_resultNotify = notify; }
+
+  /**
+   * Return whether the result or a part of it was set, i.e. @a waitResponse() would not block.
+   * @return whether the result or a part of it was set.
+   */
+  bool hasResult();
+
+  /**
+   * Get the number of bytes currently allocated for the request and result buffers of all instances.
+   * @return the number of bytes allocated for the buffers.
+   */
+  static size_t getBufferMemoryUsage() { return s_bufferMemoryUsage; }
+
 
  private:
+  /**
+   * Update the accounted buffer sizes of this instance in @a s_bufferMemoryUsage.
+   * Note: the caller has to hold @a m_mutex.
+   */
+  void updateMemoryUsage();
+
+  /** the number of bytes allocated for the buffers of all instances. */
+  static std::atomic<size_t> s_bufferMemoryUsage;
+
+  /** the number of bytes of this instance accounted in @a s_bufferMemoryUsage. */
+  size_t m_memoryUsage;
+
   /** whether this is a HTTP message. */
   const bool m_isHttp;
 
   /** the request string. */
   string m_request;
 
+  /** the data received after the current request (pipelined requests). */
+  string m_remainder;
+
+  /** whether the client requested a persistent HTTP connection. */
+  bool m_keepAlive;
+
+  /** whether the client supports chunked transfer encoding. */
+  bool m_chunkedAllowed;
+
   /** the current user name. */
   string m_user;
 
@@ -209,9 +413,15 @@ class RequestImpl : public Request {
   /** the result string. */
   string m_result;
 
+  /** the result parts added but not yet retrieved. */
+  string m_resultParts;
+
   /** set to true when the client shall be disconnected. */
   bool m_disconnect;
 
+  /** set to true when the result currently being streamed was aborted. */
+  bool m_aborted;
+
   /** mutex variable for exclusive lock. */
   pthread_mutex_t m_mutex;
 
@@ -223,6 +433,9 @@ class RequestImpl : public Request {
 
   /** start timestamp of listening update. */
   time_t m_listenSince;
+
+  /** the @a Notify instance to notify whenever the result was set, or nullptr. */
+  const Notify* m_resultNotify;
 };
 
 }  // namespace ebusd
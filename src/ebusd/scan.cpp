@@ -23,12 +23,14 @@
 #include "ebusd/scan.h"
 #include <dirent.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <iostream>
 #include <algorithm>
 #include <iomanip>
 #include <map>
 #include <vector>
 #include <functional>
+#include <fstream>
 #include "ebusd/bushandler.h"
 #include "lib/utils/log.h"
 
@@ -41,9 +43,45 @@ using std::setfill;
 using std::setw;
 using std::nouppercase;
 using std::cout;
+using std::ifstream;
+using std::ofstream;
 
+/** the maximum number of threads for reading configuration files in parallel. */
+#define MAX_CONFIG_READ_THREADS 8
+
+
+/**
+ * A @a Thread for loading the queued scan config files in the background.
+ */
+class ScanConfigLoader : public Thread {
+ public:
+  /**
+   * Constructor.
+   * @param helper the @a ScanHelper for loading the files.
+   */
+  explicit ScanConfigLoader(ScanHelper* helper) : Thread(), m_helper(helper) {}
+
+ protected:
+  // @copydoc
+  void run() override {
+    while (isRunning()) {
+      m_helper->loadQueuedScanConfigFile(1);
+    }
+  }
+
+ private:
+  /** the @a ScanHelper for loading the files. */
+  ScanHelper* m_helper;
+};
 
 ScanHelper::~ScanHelper() {
+  if (m_scanConfigLoader) {
+    m_scanConfigLoader->stop();
+    m_scanConfigLoader->join();
+    delete m_scanConfigLoader;
+    m_scanConfigLoader = nullptr;
+  }
+  discardScanConfigFiles();
   // free templates
   for (const auto& it : m_templatesByPath) {
     if (it.second != &m_globalTemplates) {
@@ -60,6 +98,99 @@ ScanHelper::~ScanHelper() {
 // the time slice to sleep when repeating an HTTP request
 #define REPEAT_NANOS 1000000
 
+// the first line of a config cache file
+#define CONFIG_CACHE_HEADER "ebusd-config-cache 1"
+
+bool ScanHelper::readConfigCache(const string& uri, string* cacheFile, string* etag, time_t* time,
+    string* content) const {
+  if (m_configCachePath.empty()) {
+    return false;
+  }
+  *cacheFile = uri;
+  for (auto& ch : *cacheFile) {
+    if (!isalnum(ch) && ch != '.' && ch != '-') {
+      ch = '_';
+    }
+  }
+  *cacheFile = m_configCachePath + *cacheFile;
+  ifstream ifs(cacheFile->c_str(), ifstream::in | ifstream::binary);
+  string header, cachedUri, timeStr;
+  if (!ifs.is_open() || !getline(ifs, header) || header != CONFIG_CACHE_HEADER || !getline(ifs, cachedUri)
+      || cachedUri != uri || !getline(ifs, *etag) || !getline(ifs, timeStr)) {
+    return false;
+  }
+  *time = static_cast<time_t>(strtoll(timeStr.c_str(), nullptr, 10));
+  if (content) {
+    ostringstream ostr;
+    ostr << ifs.rdbuf();
+    *content = ostr.str();
+  }
+  return true;
+}
+
+bool ScanHelper::pipelineFromConfigUri(const string& uri) {
+  string cacheFile, cachedEtag;
+  time_t cachedTime = 0;
+  bool cached = readConfigCache(uri, &cacheFile, &cachedEtag, &cachedTime, nullptr);
+  bool ret = m_configHttpClient->pipelineIfModified(uri, cached ? cachedEtag : "", cached ? cachedTime : 0);
+  updateHttpMemoryUsage();
+  return ret;
+}
+
+bool ScanHelper::getFromConfigUri(const string& uri, string* content, time_t* mtime) {
+  string cacheFile, cachedEtag, cachedContent;
+  time_t cachedTime = 0;
+  bool cached = readConfigCache(uri, &cacheFile, &cachedEtag, &cachedTime, &cachedContent);
+  bool repeat = false, notModified = false;
+  string etag;
+  time_t modTime = 0;
+  bool ret = m_configHttpClient->getIfModified(uri, cached ? cachedEtag : "", cached ? cachedTime : 0, content,
+      &notModified, &etag, &repeat, &modTime);
+  if (!ret) {
+    repeat = repeat && !cached;  // fall back to the cached content immediately
+    if (!content->empty()) {
+      logError(lf_main, "HTTP failure%s: %s", repeat ? ", repeating" : "", content->c_str());
+      content->clear();
+    }
+    if (repeat) {
+      usleep(REPEAT_NANOS);
+      ret = m_configHttpClient->getIfModified(uri, cached ? cachedEtag : "", cached ? cachedTime : 0, content,
+          &notModified, &etag, nullptr, &modTime);
+    }
+  }
+  updateHttpMemoryUsage();
+  if (ret && notModified) {
+    if (!cached) {
+      *content = "unexpected not modified";  // conditional headers are only sent with cached content
+      return false;
+    }
+    logDebug(lf_main, "using cached %s (not modified)", uri.c_str());
+    *content = cachedContent;
+    modTime = cachedTime;
+  } else if (ret && !cacheFile.empty()) {
+    string tmpFile = cacheFile + ".tmp";
+    ofstream ofs(tmpFile.c_str(), ofstream::out | ofstream::binary | ofstream::trunc);
+    if (ofs.is_open()) {
+      ofs << CONFIG_CACHE_HEADER << "\n" << uri << "\n" << etag << "\n" << modTime << "\n" << *content;
+      ofs.close();
+      if (ofs.fail() || rename(tmpFile.c_str(), cacheFile.c_str()) != 0) {
+        logError(lf_main, "unable to write config cache file %s", cacheFile.c_str());
+        unlink(tmpFile.c_str());
+      }
+    }
+  } else if (!ret && cached && (m_configHttpClient->getStatus() == 0 || m_configHttpClient->getStatus() >= 500)) {
+    // only when the server is not reachable or failing, but not when it reports the file as missing
+    logNotice(lf_main, "using cached %s (server not reachable)", uri.c_str());
+    *content = cachedContent;
+    modTime = cachedTime;
+    ret = true;
+  }
+  if (ret && mtime) {
+    *mtime = modTime;
+  }
+  return ret;
+}
+
 result_t ScanHelper::collectConfigFiles(const string& relPath, const string& prefix, const string& extension,
     vector<string>* files,
     bool ignoreAddressPrefix, const string& query,
@@ -69,19 +200,8 @@ result_t ScanHelper::collectConfigFiles(const string& relPath, const string& pre
     string uri = m_configUriPrefix + relPathWithSlash + m_configLangQuery + (m_configLangQuery.empty() ? "?" : "&")
       + "t=" + extension.substr(1) + query;
     string names;
-    bool repeat = false;
-    if (!m_configHttpClient->get(uri, "", &names, &repeat)) {
-      if (!names.empty()) {
-        logError(lf_main, "HTTP failure%s: %s", repeat ? ", repeating" : "", names.c_str());
-        names = "";
-      }
-      if (!repeat) {
-        return RESULT_ERR_NOTFOUND;
-      }
-      usleep(REPEAT_NANOS);
-      if (!m_configHttpClient->get(uri, "", &names)) {
-        return RESULT_ERR_NOTFOUND;
-      }
+    if (!getFromConfigUri(uri, &names)) {
+      return RESULT_ERR_NOTFOUND;
     }
     istringstream stream(names);
     string name;
@@ -146,17 +266,15 @@ result_t ScanHelper::collectConfigFiles(const string& relPath, const string& pre
 }
 
 DataFieldTemplates* ScanHelper::getTemplates(const string& filename) {
+  DataFieldTemplates* best = nullptr;
+  m_templatesMutex.lock();
   if (filename == "*") {
     size_t maxLength = 0;
-    DataFieldTemplates* best = nullptr;
     for (auto it : m_templatesByPath) {
       if (it.first.size() > maxLength) {
         best = it.second;
       }
     }
-    if (best) {
-      return best;
-    }
   } else {
     string path;
     size_t pos = filename.find_last_of('/');
@@ -165,33 +283,71 @@ DataFieldTemplates* ScanHelper::getTemplates(const string& filename) {
     }
     const auto it = m_templatesByPath.find(path);
     if (it != m_templatesByPath.end()) {
-      return it->second;
+      best = it->second;
+    }
+  }
+  m_templatesMutex.unlock();
+  return best ? best : &m_globalTemplates;
+}
+
+void ScanHelper::updateTemplatesMemoryUsage() {
+  size_t ret = m_globalTemplates.getMemoryUsage();
+  m_templatesMutex.lock();
+  for (const auto& it : m_templatesByPath) {
+    if (it.second != &m_globalTemplates) {
+      ret += it.second->getMemoryUsage();
     }
   }
-  return &m_globalTemplates;
+  m_templatesMutex.unlock();
+  m_templatesMemoryUsage = ret;
 }
 
 bool ScanHelper::readTemplates(const string relPath, const string extension, bool available) {
-  const auto it = m_templatesByPath.find(relPath);
-  if (it != m_templatesByPath.end()) {
+  m_templatesMutex.lock();
+  bool known = m_templatesByPath.find(relPath) != m_templatesByPath.end();
+  m_templatesMutex.unlock();
+  if (known) {
     return false;
   }
-  DataFieldTemplates* templates;
-  if (relPath.empty() || !available) {
-    templates = &m_globalTemplates;
-  } else {
-    templates = new DataFieldTemplates(m_globalTemplates);
-  }
-  m_templatesByPath[relPath] = templates;
   if (!available) {
     // global templates are stored as replacement in order to determine whether the directory was already loaded
-    return true;
+    m_templatesMutex.lock();
+    known = !m_templatesByPath.emplace(relPath, &m_globalTemplates).second;
+    m_templatesMutex.unlock();
+    return !known;
   }
+  // fill the templates completely before publishing them to concurrent readers
+  DataFieldTemplates* templates = relPath.empty() ? new DataFieldTemplates()
+    : new DataFieldTemplates(m_globalTemplates);
   string errorDescription;
   string logPath = relPath.empty() ? "/" : relPath;
   logInfo(lf_main, "reading templates %s", logPath.c_str());
   string file = (relPath.empty() ? "" : relPath + "/") + "_templates" + extension;
   result_t result = loadDefinitionsFromConfigPath(templates, file, nullptr, &errorDescription, true);
+  size_t hash = 0, size;
+  bool hashed = result == RESULT_OK && getConfigFileHash(file, &hash, &size);
+  m_templatesMutex.lock();
+  known = m_templatesByPath.find(relPath) != m_templatesByPath.end();
+  if (!known) {
+    if (relPath.empty()) {
+      m_globalTemplates.swap(templates);
+      m_templatesByPath[relPath] = &m_globalTemplates;
+    } else {
+      m_templatesByPath[relPath] = templates;
+      templates = nullptr;
+    }
+    if (hashed) {
+      m_templateHashes[file] = hash;
+    }
+  }
+  m_templatesMutex.unlock();
+  if (templates) {
+    delete templates;  // the previous global ones or the ones loaded by another thread in the meantime
+  }
+  if (known) {
+    return false;
+  }
+  updateTemplatesMemoryUsage();
   if (result == RESULT_OK) {
     logInfo(lf_main, "read templates in %s", logPath.c_str());
     return true;
@@ -201,6 +357,170 @@ bool ScanHelper::readTemplates(const string relPath, const string extension, boo
   return false;
 }
 
+/**
+ * The configuration files to read in parallel into staging @a MessageMap instances.
+ */
+class StagedFiles {
+ public:
+  /**
+   * Constructor.
+   * @param helper the @a ScanHelper for loading the files.
+   * @param messages the @a MessageMap to create the staging instances from.
+   * @param files the files to read.
+   */
+  StagedFiles(ScanHelper* helper, const MessageMap* messages, const vector<string>& files)
+    : m_helper(helper), m_messages(messages), m_files(files), m_stagings(files.size(), nullptr),
+      m_results(files.size(), RESULT_OK), m_errorDescriptions(files.size()), m_nextIndex(0),
+      m_failedIndex(files.size()) {}
+
+  /**
+   * Destructor.
+   */
+  ~StagedFiles() {
+    for (auto staging : m_stagings) {
+      if (staging) {
+        delete staging;
+      }
+    }
+  }
+
+  /**
+   * Read the files not yet taken by another thread until all files are read or a file failed.
+   */
+  void readAll() {
+    size_t index;
+    while (takeNext(&index)) {
+      MessageMap* staging = m_messages->createStaging();
+      m_results[index] = m_helper->loadDefinitionsFromConfigPath(staging, m_files[index], nullptr,
+          &m_errorDescriptions[index]);
+      m_mutex.lock();
+      m_stagings[index] = staging;
+      if (m_results[index] != RESULT_OK && index < m_failedIndex) {
+        m_failedIndex = index;  // no need to read any file behind this one
+      }
+      m_mutex.unlock();
+    }
+  }
+
+  /**
+   * Take the staging instance of a file read before.
+   * @param index the index of the file.
+   * @param result the variable in which to store the result of reading the file.
+   * @param errorDescription the string in which to store the error description of reading the file.
+   * @return the staging @a MessageMap, or nullptr if the file was not read.
+   */
+  MessageMap* take(size_t index, result_t* result, string* errorDescription) {
+    MessageMap* staging = m_stagings[index];
+    m_stagings[index] = nullptr;
+    *result = m_results[index];
+    *errorDescription = m_errorDescriptions[index];
+    return staging;
+  }
+
+ private:
+  /**
+   * Take the next file to read.
+   * @param index the variable in which to store the index of the file.
+   * @return true when a file was taken, false when there is nothing left to read.
+   */
+  bool takeNext(size_t* index) {
+    m_mutex.lock();
+    bool ret = m_nextIndex < m_failedIndex;
+    if (ret) {
+      *index = m_nextIndex++;
+    }
+    m_mutex.unlock();
+    return ret;
+  }
+
+  /** the @a ScanHelper for loading the files. */
+  ScanHelper* m_helper;
+
+  /** the @a MessageMap to create the staging instances from. */
+  const MessageMap* m_messages;
+
+  /** the files to read. */
+  const vector<string>& m_files;
+
+  /** the staging @a MessageMap for each file. */
+  vector<MessageMap*> m_stagings;
+
+  /** the result of reading each file. */
+  vector<result_t> m_results;
+
+  /** the error description of reading each file. */
+  vector<string> m_errorDescriptions;
+
+  /** the index of the next file to read. */
+  size_t m_nextIndex;
+
+  /** the lowest index of a file that failed to read. */
+  size_t m_failedIndex;
+
+  /** the @a Mutex for taking the next file. */
+  Mutex m_mutex;
+};
+
+/**
+ * A @a Thread for reading @a StagedFiles.
+ */
+class StagedFilesReader : public Thread {
+ public:
+  /**
+   * Constructor.
+   * @param files the @a StagedFiles to read.
+   */
+  explicit StagedFilesReader(StagedFiles* files) : Thread(), m_files(files) {}
+
+ protected:
+  // @copydoc
+  void run() override { m_files->readAll(); }
+
+ private:
+  /** the @a StagedFiles to read. */
+  StagedFiles* m_files;
+};
+
+result_t ScanHelper::readConfigFilesParallel(const vector<string>& files, size_t threadCount,
+    string* errorDescription) {
+  StagedFiles stagedFiles(this, m_messages, files);
+  vector<StagedFilesReader*> readers;
+  for (size_t i = 1; i < threadCount; i++) {  // the current thread is the first reader
+    StagedFilesReader* reader = new StagedFilesReader(&stagedFiles);
+    if (!reader->start("config")) {
+      delete reader;
+      break;
+    }
+    readers.push_back(reader);
+  }
+  stagedFiles.readAll();
+  for (auto reader : readers) {
+    reader->join();
+    delete reader;
+  }
+  // merge in the original order to keep conflict detection and error reporting as when reading sequentially
+  for (size_t index = 0; index < files.size(); index++) {
+    const string& name = files[index];
+    logInfo(lf_main, "reading file %s", name.c_str());
+    result_t result;
+    MessageMap* staging = stagedFiles.take(index, &result, errorDescription);
+    if (!staging) {
+      return RESULT_ERR_NOTFOUND;  // not expected to happen
+    }
+    string mergeError;
+    result_t mergeResult = m_messages->merge(staging, m_verbose, &mergeError);
+    if (mergeResult != RESULT_OK) {
+      *errorDescription = mergeError;
+      return mergeResult;
+    }
+    if (result != RESULT_OK) {
+      return result;
+    }
+    logInfo(lf_main, "successfully read file %s", name.c_str());
+  }
+  return RESULT_OK;
+}
+
 result_t ScanHelper::readConfigFiles(const string& relPath, const string& extension, bool recursive,
   string* errorDescription) {
   vector<string> files, dirs;
@@ -209,14 +529,66 @@ result_t ScanHelper::readConfigFiles(const string& relPath, const string& extens
   if (result != RESULT_OK) {
     return result;
   }
-  readTemplates(relPath, extension, hasTemplates);
-  for (const auto& name : files) {
-    logInfo(lf_main, "reading file %s", name.c_str());
-    result = loadDefinitionsFromConfigPath(m_messages, name, nullptr, errorDescription);
+  if (m_lazyConfig && !relPath.empty()) {
+    // only index the files for reading them when needed
+    lazyConfigPath_t& lazy = m_lazyPaths[relPath];
+    lazy.hasTemplates = hasTemplates;
+    lazy.commonRead = false;
+    lazy.files.clear();
+    m_lazyIndexMutex.lock();
+    for (const auto& name : files) {
+      // derive the address and circuit from the file name once for matching it later on
+      map<string, string> defaults;
+      lazyConfigFile_t file = {name, false, SYN, "", ""};
+      if (!m_messages->extractDefaultsFromFilename(name.substr(relPath.length()+1), &defaults, &file.address)) {
+        file.common = true;
+      } else {
+        file.circuit = defaults["circuit"];
+        file.suffix = defaults["suffix"];
+        m_lazyAddresses.insert(file.address);
+        m_lazyCircuits.insert(file.circuit);
+        m_lazyCircuits.insert(file.circuit+file.suffix);
+      }
+      lazy.files.push_back(file);
+    }
+    m_lazyIndexMutex.unlock();
+    files.clear();
+    logInfo(lf_main, "indexed %d files in %s", lazy.files.size(), relPath.c_str());
+  } else {
+    readTemplates(relPath, extension, hasTemplates);
+  }
+  size_t threadCount = 1;
+  if (m_configUriPrefix.empty() && files.size() > 1) {
+    // local files can be read in parallel (the HttpClient can not)
+    int cpus = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    threadCount = cpus > 1 ? std::min(files.size(), std::min((size_t)cpus, (size_t)MAX_CONFIG_READ_THREADS)) : 1;
+  }
+  if (threadCount > 1) {
+    result = readConfigFilesParallel(files, threadCount, errorDescription);
     if (result != RESULT_OK) {
       return result;
     }
-    logInfo(lf_main, "successfully read file %s", name.c_str());
+  } else {
+    size_t pipelined = 0;
+    for (size_t index = 0; index < files.size(); index++) {
+      const string& name = files[index];
+      if (!m_configUriPrefix.empty() && m_configHttpClient) {
+        // send the requests for this and the next files ahead on the persistent connection
+        if (pipelined < index) {
+          pipelined = index;
+        }
+        while (pipelined < files.size() && pipelined < index + HTTP_MAX_PIPELINED
+            && pipelineFromConfigUri(m_configUriPrefix + files[pipelined] + m_configLangQuery)) {
+          pipelined++;
+        }
+      }
+      logInfo(lf_main, "reading file %s", name.c_str());
+      result = loadDefinitionsFromConfigPath(m_messages, name, nullptr, errorDescription);
+      if (result != RESULT_OK) {
+        return result;
+      }
+      logInfo(lf_main, "successfully read file %s", name.c_str());
+    }
   }
   if (recursive) {
     for (const auto& name : dirs) {
@@ -231,33 +603,34 @@ result_t ScanHelper::readConfigFiles(const string& relPath, const string& extens
   return RESULT_OK;
 }
 
-static BusHandler* executeInstructionsBusHandlerInstance = nullptr;
-
-/**
-  * Helper method for immediate reading of a @a Message from the bus.
-  * @param message the @a Message to read.
-  */
-static void readMessage(Message* message) {
-  if (!executeInstructionsBusHandlerInstance || !message) {
-    return;
-  }
-  result_t result = executeInstructionsBusHandlerInstance->readFromBus(message, "");
-  if (result != RESULT_OK) {
-    logError(lf_main, "error reading message %s %s: %s", message->getCircuit().c_str(), message->getName().c_str(),
-        getResultCode(result));
-  }
-}
-
 result_t ScanHelper::executeInstructions(BusHandler* busHandler) {
   string errorDescription;
-  result_t result = m_messages->resolveConditions(m_verbose, &errorDescription);
+  vector<Message*> readMessages;
+  result_t result = m_messages->resolveConditions(m_verbose, &errorDescription,
+      busHandler ? &readMessages : nullptr);
   if (result != RESULT_OK) {
     logError(lf_main, "error resolving conditions: %s, last error: %s", getResultCode(result),
         errorDescription.c_str());
   }
+  if (busHandler) {
+    // read all messages referenced by conditions and not seen yet in a single batch (scan messages are left to the
+    // scan unless needed by a singleton instruction)
+    readMessages.erase(std::remove_if(readMessages.begin(), readMessages.end(),
+        [](const Message* message) { return message->isScanMessage(); }), readMessages.end());
+    m_messages->resolveInstructionConditions(&readMessages);
+    // each message is read only once after loading instead of again with every further merge
+    m_conditionReadsMutex.lock();
+    readMessages.erase(std::remove_if(readMessages.begin(), readMessages.end(),
+        [this](const Message* message) { return !m_conditionReads.insert(message->getKey()).second; }),
+        readMessages.end());
+    m_conditionReadsMutex.unlock();
+    result = busHandler->readFromBus(readMessages);
+    if (result != RESULT_OK) {
+      logError(lf_main, "error reading condition messages: %s", getResultCode(result));
+    }
+  }
   ostringstream log;
-  executeInstructionsBusHandlerInstance = busHandler;
-  result = m_messages->executeInstructions(&readMessage, &log);
+  result = m_messages->executeInstructions(&log);
   if (result != RESULT_OK) {
     logError(lf_main, "error executing instructions: %s, last error: %s", getResultCode(result),
         log.str().c_str());
@@ -278,20 +651,8 @@ result_t ScanHelper::loadDefinitionsFromConfigPath(FileReader* reader, const str
   } else if (m_configHttpClient) {
     string uri = m_configUriPrefix + filename + m_configLangQuery;
     string content;
-    bool repeat = false;
-    if (m_configHttpClient->get(uri, "", &content, &repeat, &mtime)) {
+    if (getFromConfigUri(uri, &content, &mtime)) {
       stream = new istringstream(content);
-    } else {
-      if (!content.empty()) {
-        logError(lf_main, "HTTP failure%s: %s", repeat ? ", repeating" : "", content.c_str());
-        content = "";
-      }
-      if (repeat) {
-        usleep(REPEAT_NANOS);
-        if (m_configHttpClient->get(uri, "", &content, nullptr, &mtime)) {
-          stream = new istringstream(content);
-        }
-      }
     }
   }
   result_t result;
@@ -306,8 +667,11 @@ result_t ScanHelper::loadDefinitionsFromConfigPath(FileReader* reader, const str
 
 result_t ScanHelper::loadConfigFiles(bool recursive) {
   logInfo(lf_main, "loading configuration files from %s", m_configPath.c_str());
+  m_loadMutex.lock();
+  discardScanConfigFiles();
   m_messages->lock();
   m_messages->clear();
+  m_templatesMutex.lock();
   m_globalTemplates.clear();
   for (auto& it : m_templatesByPath) {
     if (it.second != &m_globalTemplates) {
@@ -316,6 +680,14 @@ result_t ScanHelper::loadConfigFiles(bool recursive) {
     it.second = nullptr;
   }
   m_templatesByPath.clear();
+  m_templatesMutex.unlock();
+  m_templatesMemoryUsage = 0;
+  m_templateHashes.clear();
+  m_lazyPaths.clear();
+  updateLazyIndex();
+  m_conditionReadsMutex.lock();
+  m_conditionReads.clear();
+  m_conditionReadsMutex.unlock();
 
   string errorDescription;
   result_t result = readConfigFiles("", ".csv", recursive, &errorDescription);
@@ -326,10 +698,249 @@ result_t ScanHelper::loadConfigFiles(bool recursive) {
              getResultCode(result), errorDescription.c_str());
   }
   m_messages->unlock();
+  m_loadMutex.unlock();
   return result;
 }
 
+bool ScanHelper::getConfigFileHash(const string& filename, size_t* hash, size_t* size) {
+  istream* stream = nullptr;
+  if (m_configUriPrefix.empty()) {
+    string errorDescription;
+    stream = FileReader::openFile(m_configLocalPrefix + filename, &errorDescription);
+  } else if (m_configHttpClient) {
+    string content;
+    if (getFromConfigUri(m_configUriPrefix + filename + m_configLangQuery, &content)) {
+      stream = new istringstream(content);
+    }
+  }
+  if (!stream) {
+    return false;
+  }
+  FileReader::hashStream(stream, hash, size);
+  delete(stream);
+  return true;
+}
+
+bool ScanHelper::checkConfigFiles(const string& relPath, bool recursive) {
+  vector<string> files, dirs;
+  bool hasTemplates = false;
+  if (collectConfigFiles(relPath, "", ".csv", &files, false, "", &dirs, &hasTemplates) != RESULT_OK) {
+    return false;
+  }
+  const auto lazy = m_lazyPaths.find(relPath);
+  string templatesFile = (relPath.empty() ? "" : relPath + "/") + "_templates.csv";
+  if (hasTemplates && (lazy == m_lazyPaths.end() || lazy->second.commonRead)
+      && m_templateHashes.find(templatesFile) == m_templateHashes.end()) {
+    logInfo(lf_main, "new templates file %s", templatesFile.c_str());
+    return false;
+  }
+  string comment;
+  for (const auto& name : files) {
+    if (!m_messages->getLoadedFileInfo(name, &comment) && (lazy == m_lazyPaths.end()
+        || find_if(lazy->second.files.begin(), lazy->second.files.end(), [&name](const lazyConfigFile_t& file) {
+          return file.name == name;
+        }) == lazy->second.files.end())) {
+      logInfo(lf_main, "new config file %s", name.c_str());
+      return false;
+    }
+  }
+  if (recursive) {
+    for (const auto& name : dirs) {
+      if (!checkConfigFiles(name, true)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+result_t ScanHelper::reloadConfigFiles(bool recursive, bool* full) {
+  m_loadMutex.lock();
+  m_messages->lock();
+  // new files have to be read in the order of a full reload
+  *full = m_messages->size() == 0 || !checkConfigFiles("", recursive);
+  size_t hash, size, loadedHash;
+  for (const auto& it : m_templateHashes) {
+    if (*full) {
+      break;
+    }
+    if (!getConfigFileHash(it.first, &hash, &size) || hash != it.second) {
+      logInfo(lf_main, "changed templates file %s", it.first.c_str());
+      *full = true;
+    }
+  }
+  vector<string> changed;
+  string comment;
+  bool hasInstructions;
+  for (const auto& name : m_messages->getLoadedFiles()) {
+    if (*full) {
+      break;
+    }
+    m_messages->getLoadedFileInfo(name, &comment, &loadedHash, nullptr, nullptr, nullptr, &hasInstructions);
+    if (!getConfigFileHash(name, &hash, &size)) {
+      logInfo(lf_main, "removed config file %s", name.c_str());
+      *full = true;
+    } else if (hash != loadedHash) {
+      if (hasInstructions) {
+        logInfo(lf_main, "changed config file %s with instructions", name.c_str());
+        *full = true;
+      } else {
+        changed.push_back(name);
+      }
+    }
+  }
+  for (const auto& name : changed) {
+    if (*full) {
+      break;
+    }
+    if (m_messages->detachFile(name) != RESULT_OK) {
+      logInfo(lf_main, "changed config file %s has messages used by conditions", name.c_str());
+      *full = true;
+    }
+  }
+  result_t result = RESULT_OK;
+  if (*full) {
+    logNotice(lf_main, "incremental reload not possible, reloading all config files");
+    result = loadConfigFiles(recursive);
+    m_messages->unlock();
+    m_loadMutex.unlock();
+    return result;
+  }
+  for (const auto& name : changed) {
+    logInfo(lf_main, "reloading file %s", name.c_str());
+    map<string, string> defaults;
+    m_messages->getLoadedFileInfo(name, &comment, nullptr, nullptr, nullptr, &defaults);
+    string errorDescription;
+    result_t res = loadDefinitionsFromConfigPath(m_messages, name, defaults.empty() ? nullptr : &defaults,
+        &errorDescription);
+    size_t taken = m_messages->reattachFile(name);
+    if (res != RESULT_OK) {
+      logError(lf_main, "error reloading file %s: %s, %s", name.c_str(), getResultCode(res),
+          errorDescription.c_str());
+      result = res;
+    } else {
+      logInfo(lf_main, "successfully reloaded file %s, kept data of %d messages", name.c_str(), taken);
+    }
+  }
+  logNotice(lf_main, "reloaded %d changed config files, got %d messages", changed.size(), m_messages->size());
+  m_messages->unlock();
+  m_loadMutex.unlock();
+  return result;
+}
+
+result_t ScanHelper::loadLazyConfigFiles(symbol_t address, const string& circuit, vector<string>* relativeFiles) {
+  if (!hasLazyConfigFiles(address, circuit)) {
+    return RESULT_EMPTY;  // without taking the locks as this is checked for every access to a circuit
+  }
+  m_loadMutex.lock();
+  m_messages->lock();
+  result_t result = RESULT_EMPTY;
+  bool changed = false;
+  for (auto pathIt = m_lazyPaths.begin(); pathIt != m_lazyPaths.end(); ) {
+    const string& relPath = pathIt->first;
+    lazyConfigPath_t& lazy = pathIt->second;
+    vector<string> matching, common;
+    for (auto it = lazy.files.begin(); it != lazy.files.end(); ) {
+      if (it->common) {
+        common.push_back(it->name);
+      } else if ((address == SYN || address == it->address) && (circuit.empty() || circuit == it->circuit
+          || circuit == it->circuit+it->suffix)) {
+        matching.push_back(it->name);
+        it = lazy.files.erase(it);
+        continue;
+      }
+      it++;
+    }
+    if (matching.empty()) {
+      pathIt++;
+      continue;
+    }
+    size_t commonCount = 0;
+    if (!lazy.commonRead) {
+      // first use of the path: read the templates and common files
+      lazy.commonRead = true;
+      readTemplates(relPath, ".csv", lazy.hasTemplates);
+      for (auto it = lazy.files.begin(); it != lazy.files.end(); ) {
+        if (it->common) {
+          it = lazy.files.erase(it);
+        } else {
+          it++;
+        }
+      }
+      matching.insert(matching.begin(), common.begin(), common.end());
+      commonCount = common.size();
+    }
+    for (size_t index = 0; index < matching.size(); index++) {
+      const string& name = matching[index];
+      logInfo(lf_main, "reading file %s", name.c_str());
+      string errorDescription;
+      result_t res = loadDefinitionsFromConfigPath(m_messages, name, nullptr, &errorDescription);
+      if (res != RESULT_OK) {
+        logError(lf_main, "error reading config file %s: %s, %s", name.c_str(), getResultCode(res),
+            errorDescription.c_str());
+        result = res;
+        continue;
+      }
+      logNotice(lf_main, "read config file %s", name.c_str());
+      if (result == RESULT_EMPTY) {
+        result = RESULT_OK;
+      }
+      if (relativeFiles && index >= commonCount) {
+        relativeFiles->push_back(name);
+      }
+    }
+    changed = true;
+    if (lazy.files.empty()) {
+      pathIt = m_lazyPaths.erase(pathIt);
+    } else {
+      pathIt++;
+    }
+  }
+  if (changed) {
+    updateLazyIndex();
+  }
+  m_messages->unlock();
+  m_loadMutex.unlock();
+  return result;
+}
+
+bool ScanHelper::hasLazyConfigFiles(symbol_t address, const string& circuit) const {
+  m_lazyIndexMutex.lock();
+  bool ret = !m_lazyAddresses.empty() && (address == SYN || m_lazyAddresses.find(address) != m_lazyAddresses.end())
+    && (circuit.empty() || m_lazyCircuits.find(circuit) != m_lazyCircuits.end());
+  m_lazyIndexMutex.unlock();
+  return ret;
+}
+
+void ScanHelper::updateLazyIndex() {
+  m_lazyIndexMutex.lock();
+  m_lazyAddresses.clear();
+  m_lazyCircuits.clear();
+  for (const auto& it : m_lazyPaths) {
+    for (const auto& file : it.second.files) {
+      if (!file.common) {
+        m_lazyAddresses.insert(file.address);
+        m_lazyCircuits.insert(file.circuit);
+        m_lazyCircuits.insert(file.circuit+file.suffix);
+      }
+    }
+  }
+  m_lazyIndexMutex.unlock();
+}
+
 result_t ScanHelper::loadScanConfigFile(symbol_t address, string* relativeFile) {
+  scanIdent_t ident;
+  result_t result = decodeScanIdent(address, &ident);
+  if (result != RESULT_OK) {
+    return result;
+  }
+  m_loadMutex.lock();
+  result = loadScanConfigFile(ident, m_messages, relativeFile);
+  m_loadMutex.unlock();
+  return result;
+}
+
+result_t ScanHelper::decodeScanIdent(symbol_t address, scanIdent_t* scanIdent) {
   Message* message = m_messages->getScanMessage(address);
   if (!message || message->getLastUpdateTime() == 0) {
     return RESULT_ERR_NOTFOUND;
@@ -386,10 +997,6 @@ result_t ScanHelper::loadScanConfigFile(symbol_t address, string* relativeFile)
              identFields->getName(field).c_str(), getResultCode(result));
     return result;
   }
-  bool hasTemplates = false;
-  string best;
-  map<string, string> bestDefaults;
-  vector<string> files;
   auto it = ident.begin();
   while (it != ident.end()) {
     if (*it != '_' && !::isalnum(*it)) {
@@ -399,16 +1006,37 @@ result_t ScanHelper::loadScanConfigFile(symbol_t address, string* relativeFile)
       it++;
     }
   }
+  scanIdent->address = address;
+  scanIdent->manufacturer = manufStr;
+  scanIdent->addressPrefix = addrStr;
+  scanIdent->ident = ident;
+  scanIdent->sw = sw;
+  scanIdent->hw = hw;
+  return RESULT_OK;
+}
+
+result_t ScanHelper::loadScanConfigFile(const scanIdent_t& scanIdent, MessageMap* messages, string* relativeFile) {
+  symbol_t address = scanIdent.address;
+  const string& manufStr = scanIdent.manufacturer;
+  const string& addrStr = scanIdent.addressPrefix;
+  const string& ident = scanIdent.ident;
+  unsigned int sw = scanIdent.sw, hw = scanIdent.hw;
+  bool hasTemplates = false;
+  string best;
+  map<string, string> bestDefaults;
+  vector<string> files;
   // find files matching MANUFACTURER/ZZ.*csv in cfgpath
+  ostringstream out;
   string query;
-  if (!fromLocal) {
+  if (!m_configUriPrefix.empty()) {
     out << "&a=" << addrStr << "&i=" << ident << "&h=" << dec << static_cast<unsigned>(hw) << "&s=" << dec
         << static_cast<unsigned>(sw);
     query = out.str();
     out.str("");
     out.clear();
   }
-  result = collectConfigFiles(manufStr, addrStr + ".", ".csv", &files, false, query, nullptr, &hasTemplates);
+  result_t result = collectConfigFiles(manufStr, addrStr + ".", ".csv", &files, false, query, nullptr,
+      &hasTemplates);
   if (result != RESULT_OK) {
     logError(lf_main, "unable to load scan config %2.2x: list files in %s %s", address, manufStr.c_str(),
         getResultCode(result));
@@ -480,7 +1108,7 @@ result_t ScanHelper::loadScanConfigFile(symbol_t address, string* relativeFile)
         }
         if (baseName.length() < 3 || baseName.find_first_of('.') != 2) {  // different from the scheme "ZZ."
           string errorDescription;
-          result = loadDefinitionsFromConfigPath(m_messages, name, nullptr, &errorDescription);
+          result = loadDefinitionsFromConfigPath(messages, name, nullptr, &errorDescription);
           if (result == RESULT_OK) {
             logNotice(lf_main, "read common config file %s", name.c_str());
           } else {
@@ -493,7 +1121,7 @@ result_t ScanHelper::loadScanConfigFile(symbol_t address, string* relativeFile)
   }
   bestDefaults["name"] = ident;
   string errorDescription;
-  result = loadDefinitionsFromConfigPath(m_messages, best, &bestDefaults, &errorDescription);
+  result = loadDefinitionsFromConfigPath(messages, best, &bestDefaults, &errorDescription);
   if (result != RESULT_OK) {
     logError(lf_main, "error reading scan config file %s for ID \"%s\", SW%4.4d, HW%4.4d: %s, %s", best.c_str(),
         ident.c_str(), sw, hw, getResultCode(result), errorDescription.c_str());
@@ -504,6 +1132,79 @@ result_t ScanHelper::loadScanConfigFile(symbol_t address, string* relativeFile)
   return RESULT_OK;
 }
 
+bool ScanHelper::startScanConfigLoader() {
+  if (m_scanConfigLoader) {
+    return true;
+  }
+  m_scanConfigLoader = new ScanConfigLoader(this);
+  if (!m_scanConfigLoader->start("scanconfig")) {
+    delete m_scanConfigLoader;
+    m_scanConfigLoader = nullptr;
+    return false;
+  }
+  return true;
+}
+
+result_t ScanHelper::queueScanConfigFile(symbol_t address) {
+  scanConfigLoad_t* load = new scanConfigLoad_t();
+  result_t result = decodeScanIdent(address, &load->ident);
+  if (result != RESULT_OK) {
+    delete load;
+    return result;
+  }
+  load->staging = nullptr;
+  load->result = RESULT_EMPTY;
+  m_queuedScanConfigs.push(load);
+  return RESULT_OK;
+}
+
+void ScanHelper::loadQueuedScanConfigFile(int timeout) {
+  scanConfigLoad_t* load = m_queuedScanConfigs.pop(timeout);
+  if (!load) {
+    return;
+  }
+  m_loadMutex.lock();
+  load->staging = m_messages->createStaging();
+  load->result = loadScanConfigFile(load->ident, load->staging, &load->file);
+  m_loadedScanConfigs.push(load);  // while still locked for not being missed by discardScanConfigFiles()
+  m_loadMutex.unlock();
+}
+
+bool ScanHelper::takeScanConfigFile(symbol_t* address, string* relativeFile, result_t* result) {
+  scanConfigLoad_t* load = m_loadedScanConfigs.pop();
+  if (!load) {
+    return false;
+  }
+  *address = load->ident.address;
+  *result = load->result;
+  // merge even on error as the common files or parts of the file might have been read already
+  string errorDescription;
+  result_t mergeResult = m_messages->merge(load->staging, m_verbose, &errorDescription);
+  if (mergeResult != RESULT_OK) {
+    logError(lf_main, "error merging scan config file %s for %2.2x: %s, %s", load->file.c_str(), *address,
+        getResultCode(mergeResult), errorDescription.c_str());
+    if (*result == RESULT_OK) {
+      *result = mergeResult;
+    }
+  }
+  if (*result == RESULT_OK) {
+    *relativeFile = load->file;
+  }
+  delete load;
+  return true;
+}
+
+void ScanHelper::discardScanConfigFiles() {
+  scanConfigLoad_t* load;
+  while ((load = m_queuedScanConfigs.pop()) != nullptr) {
+    delete load;
+  }
+  while ((load = m_loadedScanConfigs.pop()) != nullptr) {
+    delete load->staging;
+    delete load;
+  }
+}
+
 bool ScanHelper::parseMessage(const string& arg, bool onlyMasterSlave, MasterSymbolString* master,
   SlaveSymbolString* slave) {
   size_t pos = arg.find_first_of('/');
@@ -20,14 +20,18 @@
 #define EBUSD_SCAN_H_
 
 #include <stdint.h>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include "lib/ebus/data.h"
 #include "lib/ebus/message.h"
 #include "lib/ebus/result.h"
 #include "lib/utils/httpclient.h"
 #include "lib/utils/log.h"
+#include "lib/utils/queue.h"
+#include "lib/utils/thread.h"
 
 namespace ebusd {
 
@@ -35,7 +39,45 @@ namespace ebusd {
  * Helpers for handling device scanning and config loading.
  */
 
+using std::set;
+
 class BusHandler;
+class ScanConfigLoader;
+
+/** the identification of a slave used for finding the matching scan config file. */
+typedef struct scanIdent {
+  symbol_t address;  //!< the slave address
+  string manufacturer;  //!< the lower case manufacturer name (i.e. the relative config path)
+  string addressPrefix;  //!< the lower case hex slave address (i.e. the file name prefix)
+  string ident;  //!< the lower case identification with only alphanumeric characters and underscores
+  unsigned int sw;  //!< the software version number
+  unsigned int hw;  //!< the hardware version number
+} scanIdent_t;
+
+/** the configuration files of a path only indexed on startup. */
+/** a configuration file only indexed so far. */
+typedef struct lazyConfigFile {
+  string name;  //!< the file name with relative path
+  bool common;  //!< whether the file name differs from the scheme "ZZ." (read with the first matching file)
+  symbol_t address;  //!< the slave address derived from the file name
+  string circuit;  //!< the circuit name derived from the file name
+  string suffix;  //!< the circuit suffix derived from the file name
+} lazyConfigFile_t;
+
+/** the configuration files of a path only indexed so far. */
+typedef struct lazyConfigPath {
+  bool hasTemplates;  //!< whether the templates file is available in the path
+  bool commonRead;  //!< whether the templates and common files of the path were read already
+  vector<lazyConfigFile_t> files;  //!< the files in the path not read yet
+} lazyConfigPath_t;
+
+/** a scan config file to be loaded in the background. */
+typedef struct scanConfigLoad {
+  scanIdent_t ident;  //!< the identification of the slave
+  MessageMap* staging;  //!< the staging @a MessageMap the file was loaded into, or nullptr
+  string file;  //!< the relative name of the loaded configuration file
+  result_t result;  //!< the result of loading the file
+} scanConfigLoad_t;
 
 /**
  * Helper class for handling device scanning and config loading.
@@ -51,15 +93,20 @@ class ScanHelper : public Resolver {
    * @param configLangQuery the optional language query part for retrieving configuration files from HTTPS (empty for local files). 
    * @param configHttpClient the @a HttpClient for retrieving configuration files from HTTPS.
    * @param verbose whether to verbosely log problems.
+   * @param configCachePath the path (including trailing "/") for caching configuration files retrieved from HTTPS,
+   * or empty.
+   * @param lazyConfig whether to only index the configuration files in subdirectories when loading them recursively
+   * and read them later on in @a loadLazyConfigFiles().
    */
   ScanHelper(MessageMap* messages,
   const string configPath, const string configLocalPrefix,
   const string configUriPrefix, const string configLangQuery,
-  HttpClient* configHttpClient, bool verbose)
+  HttpClient* configHttpClient, bool verbose, const string configCachePath = "", bool lazyConfig = false)
     : Resolver(), m_messages(messages),
     m_configPath(configPath), m_configLocalPrefix(configLocalPrefix),
     m_configUriPrefix(configUriPrefix), m_configLangQuery(configLangQuery),
-    m_configHttpClient(configHttpClient), m_verbose(verbose) {}
+    m_configHttpClient(configHttpClient), m_verbose(verbose), m_configCachePath(configCachePath),
+    m_lazyConfig(lazyConfig), m_templatesMemoryUsage(0), m_httpMemoryUsage(0), m_scanConfigLoader(nullptr) {}
 
   /**
    * Destructor.
@@ -84,6 +131,18 @@ class ScanHelper : public Resolver {
    */
   virtual DataFieldTemplates* getTemplates(const string& filename);
 
+  /**
+   * Get the estimated memory used by all loaded @a DataFieldTemplates.
+   * @return the estimated number of bytes.
+   */
+  size_t getTemplatesMemoryUsage() const { return m_templatesMemoryUsage; }
+
+  /**
+   * Get the estimated memory used by the buffers of the @a HttpClient for retrieving configuration files.
+   * @return the estimated number of bytes, or 0 if not retrieving from HTTPS.
+   */
+  size_t getHttpMemoryUsage() const { return m_httpMemoryUsage; }
+
   /**
    * Load the message definitions from configuration files.
    * @param recursive whether to load all files recursively.
@@ -91,6 +150,45 @@ class ScanHelper : public Resolver {
    */
   result_t loadConfigFiles(bool recursive = true);
 
+  /**
+   * Reload the message definitions incrementally by reading again only the configuration files whose content
+   * changed (the reloaded messages with unchanged ID keep their last seen data). Falls back to @a loadConfigFiles()
+   * when a file was added or removed, a templates file changed, or a changed file contains instructions or messages
+   * referenced by conditions.
+   * @param recursive whether to load all files recursively.
+   * @param full the variable in which to store whether a full reload was done instead.
+   * @return the result code.
+   */
+  result_t reloadConfigFiles(bool recursive, bool* full);
+
+  /**
+   * @return whether configuration files in subdirectories were only indexed and not read yet.
+   */
+  bool hasLazyConfigFiles() const {
+    m_lazyIndexMutex.lock();
+    bool ret = !m_lazyAddresses.empty();
+    m_lazyIndexMutex.unlock();
+    return ret;
+  }
+
+  /**
+   * @param address the slave address the files have to match, or @a SYN for any.
+   * @param circuit the circuit name the files have to match, or empty for any.
+   * @return whether configuration files possibly matching the slave address and circuit were only indexed and not
+   * read yet.
+   */
+  bool hasLazyConfigFiles(symbol_t address, const string& circuit) const;
+
+  /**
+   * Read the configuration files only indexed so far that match the slave address and circuit, preceded by the
+   * templates and common files of their path on first use.
+   * @param address the slave address the files have to match, or @a SYN for any.
+   * @param circuit the circuit name the files have to match, or empty for any.
+   * @param relativeFiles the @a vector to which to add the names of the successfully read files, or nullptr.
+   * @return @a RESULT_OK when all matching files were read, @a RESULT_EMPTY when no file matched, or an error code.
+   */
+  result_t loadLazyConfigFiles(symbol_t address, const string& circuit, vector<string>* relativeFiles = nullptr);
+
   /**
    * Load the message definitions from a configuration file matching the scan result.
    * @param address the address of the scan participant
@@ -101,6 +199,35 @@ class ScanHelper : public Resolver {
    */
   result_t loadScanConfigFile(symbol_t address, string* relativeFile);
 
+  /**
+   * Start the background @a Thread for loading scan config files queued with @a queueScanConfigFile().
+   * @return true when the @a Thread was started (or is already running).
+   */
+  bool startScanConfigLoader();
+
+  /**
+   * @return whether the background @a Thread for loading scan config files is running.
+   */
+  bool hasScanConfigLoader() const { return m_scanConfigLoader != nullptr; }
+
+  /**
+   * Decode the scan result of the participant and queue loading the matching configuration file in the background.
+   * The file is resolved, retrieved and read into a staging @a MessageMap and has to be picked up with
+   * @a takeScanConfigFile() afterwards.
+   * @param address the address of the scan participant.
+   * @return the result code of decoding the scan result.
+   */
+  result_t queueScanConfigFile(symbol_t address);
+
+  /**
+   * Merge the next configuration file loaded in the background into the @a MessageMap.
+   * @param address the variable in which to store the address of the scan participant.
+   * @param relativeFile the string in which the name of the configuration file is stored on success.
+   * @param result the variable in which to store the result code of loading the file.
+   * @return true when a loaded file was taken, false when none is available yet.
+   */
+  bool takeScanConfigFile(symbol_t* address, string* relativeFile, result_t* result);
+
   /**
    * Helper method for executing all loaded and resolvable instructions.
    * @param busHandler the @a BusHandler instance.
@@ -158,6 +285,34 @@ class ScanHelper : public Resolver {
    */
   bool readTemplates(const string relPath, const string extension, bool available);
 
+  /**
+   * Decode the identification of a slave from its scan result.
+   * @param address the address of the scan participant.
+   * @param scanIdent the @a scanIdent_t to fill.
+   * @return the result code.
+   */
+  result_t decodeScanIdent(symbol_t address, scanIdent_t* scanIdent);
+
+  /**
+   * Load the message definitions from the configuration file matching the slave identification.
+   * @param scanIdent the @a scanIdent_t of the slave.
+   * @param messages the @a MessageMap to load the messages into.
+   * @param relativeFile the string in which the name of the configuration file is stored on success.
+   * @return the result code.
+   */
+  result_t loadScanConfigFile(const scanIdent_t& scanIdent, MessageMap* messages, string* relativeFile);
+
+  /**
+   * Load the next queued scan config file into a staging @a MessageMap (called by the @a ScanConfigLoader).
+   * @param timeout the maximum time in seconds to wait for a queued file.
+   */
+  void loadQueuedScanConfigFile(int timeout);
+
+  /**
+   * Discard all queued and loaded but not yet taken scan config files.
+   */
+  void discardScanConfigFiles();
+
   /**
    * Read the configuration files from the specified path.
    * @param relPath the relative path from which to read the files (without trailing "/").
@@ -169,6 +324,80 @@ class ScanHelper : public Resolver {
   result_t readConfigFiles(const string& relPath, const string& extension, bool recursive,
   string* errorDescription);
 
+  /**
+   * Read the configuration files in parallel into staging @a MessageMap instances and merge them afterwards.
+   * @param files the files to read.
+   * @param threadCount the number of threads to use (including the current one).
+   * @param errorDescription a string in which to store the error description in case of error.
+   * @return the result code.
+   */
+  result_t readConfigFilesParallel(const vector<string>& files, size_t threadCount, string* errorDescription);
+
+  /**
+   * Calculate the hash of the current content of a configuration file the same way as when reading it.
+   * @param filename the relative name of the file.
+   * @param hash pointer to a @a size_t value for storing the hash of the file.
+   * @param size pointer to a @a size_t value for storing the normalized size of the file.
+   * @return true on success, false if the file could not be retrieved.
+   */
+  bool getConfigFileHash(const string& filename, size_t* hash, size_t* size);
+
+  /**
+   * Check the configuration files from the specified path for being all loaded before.
+   * @param relPath the relative path from which to check the files (without trailing "/").
+   * @param recursive whether to check all files recursively.
+   * @return true when all files and templates in the path were loaded before, false when a full reload is needed.
+   */
+  bool checkConfigFiles(const string& relPath, bool recursive);
+
+  /**
+   * Rebuild @a m_lazyAddresses and @a m_lazyCircuits from the files in @a m_lazyPaths not read yet.
+   */
+  void updateLazyIndex();
+
+  /**
+   * Update @a m_templatesMemoryUsage from the loaded @a DataFieldTemplates (only by the thread loading them).
+   */
+  void updateTemplatesMemoryUsage();
+
+  /**
+   * Update @a m_httpMemoryUsage from the buffers of the @a HttpClient (only by the thread using it).
+   */
+  void updateHttpMemoryUsage() {
+    if (m_configHttpClient) {
+      m_httpMemoryUsage = m_configHttpClient->getMemoryUsage();
+    }
+  }
+
+  /**
+   * Read the local cache of a config URI.
+   * @param uri the URI.
+   * @param cacheFile the string in which to store the name of the cache file.
+   * @param etag the string in which to store the cached entity tag.
+   * @param time the variable in which to store the cached modification time.
+   * @param content the string in which to store the cached content, or nullptr.
+   * @return true when the cache is configured and contains the URI.
+   */
+  bool readConfigCache(const string& uri, string* cacheFile, string* etag, time_t* time, string* content) const;
+
+  /**
+   * Send the request for a config URI ahead on the persistent connection for picking up the response in a later call
+   * to @a getFromConfigUri().
+   * @param uri the URI to retrieve.
+   * @return true when the request was sent, false if pipelining is currently not possible.
+   */
+  bool pipelineFromConfigUri(const string& uri);
+
+  /**
+   * Retrieve the content from the config URI, using and updating the local cache if configured.
+   * If the server can not be reached, a previously cached content is used instead.
+   * @param uri the URI to retrieve.
+   * @param content the string in which to store the retrieved content (or the error message on failure).
+   * @param mtime optional pointer to a @a time_t value for storing the modification time of the content, or nullptr.
+   * @return true on success, false on error.
+   */
+  bool getFromConfigUri(const string& uri, string* content, time_t* mtime = nullptr);
+
   /** the @a MessageMap instance. */
   MessageMap* m_messages;
 
@@ -190,6 +419,24 @@ class ScanHelper : public Resolver {
   /** whether to verbosely log problems. */
   const bool m_verbose;
 
+  /** the path (including trailing "/") for caching configuration files retrieved from HTTPS, or empty. */
+  const string m_configCachePath;
+
+  /** whether to only index the configuration files in subdirectories when loading them recursively. */
+  const bool m_lazyConfig;
+
+  /** the configuration files only indexed so far by relative path. */
+  map<string, lazyConfigPath_t> m_lazyPaths;
+
+  /** @a Mutex for accessing @a m_lazyAddresses and @a m_lazyCircuits. */
+  mutable Mutex m_lazyIndexMutex;
+
+  /** the slave addresses of the files in @a m_lazyPaths not read yet. */
+  set<symbol_t> m_lazyAddresses;
+
+  /** the circuit names (with and without suffix) of the files in @a m_lazyPaths not read yet. */
+  set<string> m_lazyCircuits;
+
   /** the global @a DataFieldTemplates. */
   DataFieldTemplates m_globalTemplates;
 
@@ -198,6 +445,38 @@ class ScanHelper : public Resolver {
    * @a globalTemplates as replacement for missing file).
    */
   map<string, DataFieldTemplates*> m_templatesByPath;
+
+  /** the hash of each read templates file (by file name with relative path). */
+  map<string, size_t> m_templateHashes;
+
+  /** the @a Mutex for accessing @a m_templatesByPath. */
+  Mutex m_templatesMutex;
+
+  /** the @a Mutex for loading configuration files (shared by the @a HttpClient and templates). */
+  Mutex m_loadMutex;
+
+  /** the estimated memory used by all loaded @a DataFieldTemplates (updated after loading them). */
+  std::atomic<size_t> m_templatesMemoryUsage;
+
+  /** the estimated memory used by the buffers of the @a HttpClient (updated after each retrieval). */
+  std::atomic<size_t> m_httpMemoryUsage;
+
+  /** @a Mutex for accessing @a m_conditionReads. */
+  Mutex m_conditionReadsMutex;
+
+  /** the keys of the @a Message instances referenced by conditions that were read (or attempted) since loading. */
+  set<uint64_t> m_conditionReads;
+
+  /** the background @a ScanConfigLoader, or nullptr. */
+  ScanConfigLoader* m_scanConfigLoader;
+
+  /** the scan config files queued for loading in the background. */
+  Queue<scanConfigLoad_t*> m_queuedScanConfigs;
+
+  /** the scan config files loaded in the background and not yet taken. */
+  Queue<scanConfigLoad_t*> m_loadedScanConfigs;
+
+  friend class ScanConfigLoader;
 };
 
 }  // namespace ebusd
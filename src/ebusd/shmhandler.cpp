@@ -0,0 +1,252 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "ebusd/shmhandler.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include "lib/utils/log.h"
+
+namespace ebusd {
+
+using std::ostringstream;
+
+#define O_SHM -2
+#define O_SLT (O_SHM-1)
+
+/** the average number of manifest bytes reserved per slot. */
+#define MANIFEST_BYTES_PER_SLOT 96
+
+/** the definition of the shared memory arguments. */
+static const struct argp_option g_shm_argp_options[] = {
+  {nullptr,        0, nullptr,    0, "Shared memory options:", 1 },
+  {"shm",      O_SHM, "NAME",     0, "Export the current values of all message fields to the POSIX shared memory "
+                                     "object NAME (e.g. \"/ebusd\")", 0 },
+  {"shmslots", O_SLT, "COUNT",    0, "Maximum number of message fields in the shared memory [1024]", 0 },
+
+  {nullptr,        0, nullptr,    0, nullptr, 0 },
+};
+
+static const char* g_name = nullptr;  //!< the name of the shared memory object
+static uint32_t g_slotCapacity = 1024;  //!< the maximum number of slots
+
+/**
+ * The shared memory argument parsing function.
+ * @param key the key from @a g_shm_argp_options.
+ * @param arg the option argument, or nullptr.
+ * @param state the parsing state.
+ */
+static error_t shm_parse_opt(int key, char *arg, struct argp_state *state) {
+  result_t result;
+  unsigned int value;
+  switch (key) {
+  case O_SHM:  // --shm=/ebusd
+    if (arg == nullptr || arg[0] != '/' || arg[1] == 0 || strchr(arg+1, '/')) {
+      argp_error(state, "invalid shm name");
+      return EINVAL;
+    }
+    g_name = arg;
+    break;
+
+  case O_SLT:  // --shmslots=1024
+    value = parseInt(arg, 10, 1, 0x100000, &result);
+    if (result != RESULT_OK) {
+      argp_error(state, "invalid shmslots");
+      return EINVAL;
+    }
+    g_slotCapacity = value;
+    break;
+
+  default:
+    return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+static const struct argp g_shm_argp = { g_shm_argp_options, shm_parse_opt, nullptr, nullptr, nullptr, nullptr,
+  nullptr };
+static const struct argp_child g_shm_argp_child = {&g_shm_argp, 0, "", 1};
+
+
+const struct argp_child* shmhandler_getargs() {
+  return &g_shm_argp_child;
+}
+
+bool shmhandler_register(UserInfo* userInfo, BusHandler* busHandler, MessageMap* messages,
+    list<DataHandler*>* handlers) {
+  if (g_name) {
+    handlers->push_back(new ShmHandler(busHandler, g_name, g_slotCapacity));
+  }
+  return true;
+}
+
+ShmHandler::ShmHandler(BusHandler* busHandler, const char* name, uint32_t slotCapacity)
+  : DataHandler(), StoreListener(), m_busHandler(busHandler), m_name(name), m_header(nullptr), m_size(0),
+    m_full(false) {
+  size_t manifestCapacity = slotCapacity * MANIFEST_BYTES_PER_SLOT;
+  size_t size = sizeof(shmTableHeader_t) + slotCapacity * sizeof(shmValueSlot_t) + manifestCapacity;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    logOtherError("shm", "unable to open %s: %s", name, strerror(errno));
+    return;
+  }
+  void* addr = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (addr == MAP_FAILED) {
+    logOtherError("shm", "unable to map %s: %s", name, strerror(errno));
+    close(fd);
+    shm_unlink(name);
+    return;
+  }
+  close(fd);
+  m_size = size;
+  m_header = new(addr) shmTableHeader_t();  // the segment is zero filled already
+  m_header->version = SHM_VERSION;
+  m_header->headerSize = static_cast<uint32_t>(sizeof(shmTableHeader_t));
+  m_header->slotSize = static_cast<uint32_t>(sizeof(shmValueSlot_t));
+  m_header->slotCapacity = slotCapacity;
+  m_header->slotOffset = static_cast<uint32_t>(sizeof(shmTableHeader_t));
+  m_header->manifestOffset = static_cast<uint32_t>(sizeof(shmTableHeader_t) + slotCapacity * sizeof(shmValueSlot_t));
+  m_header->manifestCapacity = static_cast<uint32_t>(manifestCapacity);
+  m_header->pid = static_cast<uint32_t>(getpid());
+  m_header->slotCount.store(0, std::memory_order_relaxed);
+  m_header->manifestLength.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(m_header->magic, SHM_MAGIC, sizeof(m_header->magic));  // mark as valid last
+  logOtherNotice("shm", "exporting up to %d values to %s", slotCapacity, name);
+}
+
+ShmHandler::~ShmHandler() {
+  if (m_header) {
+    m_busHandler->removeStoreListener(this);
+    munmap(m_header, m_size);
+    m_header = nullptr;
+    shm_unlink(m_name.c_str());
+  }
+}
+
+void ShmHandler::startHandler() {
+  if (m_header) {
+    m_busHandler->addStoreListener(this);
+  }
+}
+
+void ShmHandler::notifyStored(const Message* message) {
+  m_mutex.lock();
+  auto it = m_slots.find(message->getKey());
+  if ((it != m_slots.end() && it->second.empty()) || message->decodeLastDataValues(&m_values) < RESULT_OK) {
+    m_mutex.unlock();  // not exported or not decodable
+    return;
+  }
+  if (it == m_slots.end()) {
+    it = m_slots.emplace(message->getKey(), vector<uint32_t>()).first;
+    allocateSlots(message, m_values, &it->second);
+  }
+  const vector<uint32_t>& slots = it->second;
+  shmValueSlot_t* table = reinterpret_cast<shmValueSlot_t*>(reinterpret_cast<char*>(m_header)
+      + m_header->slotOffset);
+  int64_t lastUpdate = static_cast<int64_t>(message->getLastUpdateTime());
+  for (size_t index = 0; index < slots.size() && index < m_values.size(); index++) {
+    const fieldValue_t& value = m_values[index];
+    shmValueSlot_t& slot = table[slots[index]];
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.type = static_cast<uint32_t>(value.type);
+    slot.lastUpdate = lastUpdate;
+    slot.intValue = value.intValue;
+    slot.floatValue = value.floatValue;
+    if (value.type == fvt_string) {
+      strncpy(slot.stringValue, value.stringValue.c_str(), SHM_STRING_SIZE - 1);
+      slot.stringValue[SHM_STRING_SIZE - 1] = 0;
+    } else {
+      slot.stringValue[0] = 0;
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+  }
+  m_mutex.unlock();
+}
+
+void ShmHandler::notifyUnchanged(const Message* message) {
+  m_mutex.lock();
+  auto it = m_slots.find(message->getKey());
+  if (it == m_slots.end()) {
+    m_mutex.unlock();
+    notifyStored(message);  // not exported yet
+    return;
+  }
+  shmValueSlot_t* table = reinterpret_cast<shmValueSlot_t*>(reinterpret_cast<char*>(m_header)
+      + m_header->slotOffset);
+  int64_t lastUpdate = static_cast<int64_t>(message->getLastUpdateTime());
+  for (const auto slotId : it->second) {
+    shmValueSlot_t& slot = table[slotId];
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.lastUpdate = lastUpdate;
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+  }
+  m_mutex.unlock();
+}
+
+void ShmHandler::allocateSlots(const Message* message, const vector<fieldValue_t>& values,
+    vector<uint32_t>* slots) {
+  char* manifest = reinterpret_cast<char*>(m_header) + m_header->manifestOffset;
+  uint32_t count = m_header->slotCount.load(std::memory_order_relaxed);
+  uint32_t length = m_header->manifestLength.load(std::memory_order_relaxed);
+  for (size_t index = 0; index < values.size(); index++) {
+    const SingleDataField* field = values[index].field;
+    ostringstream line;
+    line << count << "\t" << (message->isWrite() ? "w" : "r") << "\t" << message->getCircuit() << "\t"
+         << message->getName() << "\t";
+    string fieldName = field ? field->getName(-1) : "";
+    if (fieldName.empty()) {
+      line << index;
+    } else {
+      line << fieldName;
+    }
+    line << "\t" << (field ? field->getAttribute("unit") : "") << "\n";
+    string str = line.str();
+    if (count >= m_header->slotCapacity || length + str.length() > m_header->manifestCapacity) {
+      if (!m_full) {
+        logOtherError("shm", "capacity exceeded, unable to export %s %s", message->getCircuit().c_str(),
+            message->getName().c_str());
+        m_full = true;
+      }
+      break;
+    }
+    memcpy(manifest + length, str.c_str(), str.length());
+    length += static_cast<uint32_t>(str.length());
+    slots->push_back(count++);
+  }
+  // publish the new manifest lines before the slots
+  m_header->manifestLength.store(length, std::memory_order_release);
+  m_header->slotCount.store(count, std::memory_order_release);
+}
+
+}  // namespace ebusd
@@ -0,0 +1,169 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EBUSD_SHMHANDLER_H_
+#define EBUSD_SHMHANDLER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ebusd/datahandler.h"
+#include "ebusd/bushandler.h"
+#include "lib/ebus/message.h"
+#include "lib/utils/thread.h"
+
+namespace ebusd {
+
+/** @file ebusd/shmhandler.h
+ * A data handler exporting the current values of all message fields to a POSIX shared memory segment for local
+ * readers.
+ *
+ * The segment starts with a @a shmTableHeader_t followed by the value slots of type @a shmValueSlot_t and the
+ * manifest. The manifest is a text with one line per slot in the form "ID\tDIRECTION\tCIRCUIT\tNAME\tFIELD\tUNIT"
+ * with DIRECTION being "r" or "w" and ID being the stable index of the slot. Slots and manifest lines are only ever
+ * appended.
+ *
+ * A reader maps the segment read-only, reads @a shmTableHeader_t::slotCount (acquire) and then the manifest and
+ * the slots up to that count. Each slot is protected by a sequence lock: read @a shmValueSlot_t::sequence (acquire),
+ * retry while it is odd, copy the slot, issue an acquire fence, and retry if the sequence changed meanwhile.
+ */
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+/** the magic at the start of the shared memory segment. */
+#define SHM_MAGIC "EBUSDSHM"
+
+/** the version of the shared memory layout. */
+#define SHM_VERSION 1
+
+/** the maximum length of a string value in a slot including the terminating zero. */
+#define SHM_STRING_SIZE 32
+
+/** the header of the shared memory segment. */
+typedef struct shmTableHeader {
+  char magic[8];  //!< the magic @a SHM_MAGIC (without terminating zero)
+  uint32_t version;  //!< the layout version @a SHM_VERSION
+  uint32_t headerSize;  //!< the size of this header in bytes
+  uint32_t slotSize;  //!< the size of a single slot in bytes
+  uint32_t slotCapacity;  //!< the maximum number of slots
+  uint32_t slotOffset;  //!< the offset of the first slot from the start of the segment
+  uint32_t manifestOffset;  //!< the offset of the manifest from the start of the segment
+  uint32_t manifestCapacity;  //!< the maximum size of the manifest in bytes
+  uint32_t pid;  //!< the process ID of ebusd
+  std::atomic<uint32_t> slotCount;  //!< the number of slots in use (updated after the manifest line was added)
+  std::atomic<uint32_t> manifestLength;  //!< the length of the manifest in bytes
+} shmTableHeader_t;
+
+/** a single value slot in the shared memory segment. */
+typedef struct shmValueSlot {
+  std::atomic<uint32_t> sequence;  //!< the sequence lock (odd while the slot is being written)
+  uint32_t type;  //!< the @a FieldValueType of the value
+  int64_t lastUpdate;  //!< the time of the last update in seconds since the epoch
+  int64_t intValue;  //!< the integer value (for @a fvt_integer)
+  double floatValue;  //!< the floating point value (for @a fvt_float)
+  char stringValue[SHM_STRING_SIZE];  //!< the zero terminated (and possibly truncated) text value (for @a fvt_string)
+} shmValueSlot_t;
+
+/**
+ * Helper function for getting the argp definition for the shared memory export.
+ * @return a pointer to the argp_child structure.
+ */
+const struct argp_child* shmhandler_getargs();
+
+/**
+ * Registration function that is called once during initialization.
+ * @param userInfo the @a UserInfo instance.
+ * @param busHandler the @a BusHandler instance.
+ * @param messages the @a MessageMap instance.
+ * @param handlers the @a list to which new @a DataHandler instances shall be added.
+ * @return true if registration was successful.
+ */
+bool shmhandler_register(UserInfo* userInfo, BusHandler* busHandler, MessageMap* messages,
+    list<DataHandler*>* handlers);
+
+
+/**
+ * The main class exporting the current values to shared memory, updated directly by the bus handling thread.
+ */
+class ShmHandler : public DataHandler, public StoreListener {
+ public:
+  /**
+   * Constructor.
+   * @param busHandler the @a BusHandler instance.
+   * @param name the name of the shared memory object.
+   * @param slotCapacity the maximum number of value slots.
+   */
+  ShmHandler(BusHandler* busHandler, const char* name, uint32_t slotCapacity);
+
+  /**
+   * Destructor.
+   */
+  virtual ~ShmHandler();
+
+  // @copydoc
+  void startHandler() override;
+
+  // @copydoc
+  void notifyStored(const Message* message) override;
+
+  // @copydoc
+  void notifyUnchanged(const Message* message) override;
+
+
+ private:
+  /**
+   * Allocate the slots for the fields of a @a Message and add them to the manifest.
+   * @param message the @a Message.
+   * @param values the decoded @a fieldValue_t of the @a Message.
+   * @param slots the @a vector to add the slot IDs to.
+   */
+  void allocateSlots(const Message* message, const vector<fieldValue_t>& values, vector<uint32_t>* slots);
+
+  /** the @a BusHandler instance. */
+  BusHandler* m_busHandler;
+
+  /** the name of the shared memory object. */
+  const string m_name;
+
+  /** the mapped shared memory segment, or nullptr. */
+  shmTableHeader_t* m_header;
+
+  /** the size of the mapped shared memory segment. */
+  size_t m_size;
+
+  /** the slot IDs of the fields by message key (empty when not exported due to exceeded capacity). */
+  unordered_map<uint64_t, vector<uint32_t>> m_slots;
+
+  /** the reused decoded values. */
+  vector<fieldValue_t> m_values;
+
+  /** @a Mutex for the writers of the different bus segments. */
+  Mutex m_mutex;
+
+  /** whether the slot capacity was exceeded. */
+  bool m_full;
+};
+
+}  // namespace ebusd
+
+#endif  // EBUSD_SHMHANDLER_H_
@@ -0,0 +1,146 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/ebus/arena.h"
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+namespace ebusd {
+
+using std::atomic;
+using std::max_align_t;
+
+/**
+ * The header of each chunk.
+ */
+struct ArenaChunk {
+  /** the number of objects allocated from this chunk plus one while the arena still allocates from it. */
+  atomic<size_t> m_references;
+
+  /** the number of bytes used from this chunk (excluding this header). */
+  size_t m_used;
+};
+
+/**
+ * The header in front of each allocated object (properly aligned for the object following it).
+ */
+union AllocationHeader {
+  /** the chunk the object was allocated from, or nullptr if allocated from the heap. */
+  ArenaChunk* m_chunk;
+
+  /** for alignment only. */
+  max_align_t m_align;
+};
+
+/**
+ * Round up a size to the maximum alignment.
+ * @param size the size to round up.
+ * @return the rounded up size.
+ */
+static inline size_t alignSize(size_t size) {
+  return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+}
+
+/** the aligned size of the chunk header. */
+static const size_t chunkHeaderSize = alignSize(sizeof(ArenaChunk));
+
+/** the active arena of the current thread, or nullptr. */
+static thread_local DefinitionArena* s_activeArena = nullptr;
+
+/** the number of currently allocated chunks. */
+static atomic<size_t> s_chunkCount(0);
+
+/**
+ * Drop a reference to a chunk and free it when it was the last one.
+ * @param chunk the @a ArenaChunk.
+ */
+static void unreferenceChunk(ArenaChunk* chunk) {
+  if (--chunk->m_references == 0) {
+    chunk->~ArenaChunk();
+    free(chunk);
+    s_chunkCount--;
+  }
+}
+
+DefinitionArena::DefinitionArena(size_t chunkSize)
+  : m_chunkSize(alignSize(chunkSize)), m_previous(s_activeArena), m_chunk(nullptr) {
+  s_activeArena = this;
+}
+
+DefinitionArena::~DefinitionArena() {
+  s_activeArena = m_previous;
+  if (m_chunk) {
+    unreferenceChunk(m_chunk);
+  }
+}
+
+void* DefinitionArena::allocateInChunk(size_t size) {
+  if (!m_chunk || m_chunk->m_used + size > m_chunkSize) {
+    void* mem = malloc(chunkHeaderSize + m_chunkSize);
+    if (!mem) {
+      throw std::bad_alloc();
+    }
+    if (m_chunk) {
+      unreferenceChunk(m_chunk);
+    }
+    m_chunk = new(mem) ArenaChunk();
+    m_chunk->m_references = 1;
+    m_chunk->m_used = 0;
+    s_chunkCount++;
+  }
+  void* ret = reinterpret_cast<char*>(m_chunk) + chunkHeaderSize + m_chunk->m_used;
+  m_chunk->m_used += size;
+  m_chunk->m_references++;
+  return ret;
+}
+
+void* DefinitionArena::allocate(size_t size) {
+  size_t total = sizeof(AllocationHeader) + alignSize(size);
+  DefinitionArena* arena = s_activeArena;
+  AllocationHeader* header;
+  if (arena && total <= arena->m_chunkSize/4) {
+    header = reinterpret_cast<AllocationHeader*>(arena->allocateInChunk(total));
+    header->m_chunk = arena->m_chunk;
+  } else {
+    header = reinterpret_cast<AllocationHeader*>(malloc(total));
+    if (!header) {
+      throw std::bad_alloc();
+    }
+    header->m_chunk = nullptr;
+  }
+  return header + 1;
+}
+
+void DefinitionArena::release(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  AllocationHeader* header = reinterpret_cast<AllocationHeader*>(ptr) - 1;
+  if (header->m_chunk) {
+    unreferenceChunk(header->m_chunk);
+  } else {
+    free(header);
+  }
+}
+
+size_t DefinitionArena::getChunkCount() {
+  return s_chunkCount;
+}
+
+}  // namespace ebusd
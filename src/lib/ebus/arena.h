@@ -0,0 +1,122 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_EBUS_ARENA_H_
+#define LIB_EBUS_ARENA_H_
+
+#include <cstddef>
+
+namespace ebusd {
+
+/** \file lib/ebus/arena.h */
+
+struct ArenaChunk;
+
+/**
+ * An arena for allocating the objects of parsed definitions (messages, fields, conditions, instructions) from a few
+ * larger chunks instead of individually from the heap.
+ * Constructing an instance makes it the active arena of the current thread until it is destructed again (arenas may
+ * be nested). Each chunk is freed as a whole as soon as all objects allocated from it were released and the
+ * arena moved on to another chunk or was destructed, i.e. the objects may well outlive the arena itself.
+ * Note that a chunk is only freed as a whole: a single object still alive (e.g. a definition kept over a reload
+ * while the others of the same file were replaced) keeps its complete chunk allocated until it is released as well.
+ * The objects of a file should therefore be released together, which is the case when a file is read with its own
+ * arena and all of its definitions are cleared on reload.
+ */
+class DefinitionArena {
+ public:
+  /**
+   * Construct a new instance and make it the active arena of the current thread.
+   * @param chunkSize the size of each chunk in bytes (also the memory that a single remaining object may keep
+   * allocated at most).
+   */
+  explicit DefinitionArena(size_t chunkSize = 16*1024);
+
+  /**
+   * Destructor restoring the previously active arena of the current thread.
+   */
+  ~DefinitionArena();
+
+  /**
+   * Allocate memory from the active arena of the current thread, or from the heap if none is active or the size
+   * is too big for a chunk.
+   * @param size the size in bytes to allocate.
+   * @return the allocated memory (never nullptr, throws std::bad_alloc instead).
+   */
+  static void* allocate(size_t size);
+
+  /**
+   * Release memory previously allocated with @a allocate().
+   * @param ptr the allocated memory (may be nullptr).
+   */
+  static void release(void* ptr);
+
+  /**
+   * Get the number of currently allocated chunks in all arenas.
+   * @return the number of currently allocated chunks.
+   */
+  static size_t getChunkCount();
+
+
+ private:
+  /**
+   * Hidden copy constructor.
+   * @param other the instance to copy from.
+   */
+  DefinitionArena(const DefinitionArena& other);
+
+  /**
+   * Allocate memory from the current chunk, starting a new chunk if necessary.
+   * @param size the aligned size in bytes to allocate including the allocation header.
+   * @return the allocated memory including the allocation header.
+   */
+  void* allocateInChunk(size_t size);
+
+  /** the size of each chunk in bytes. */
+  const size_t m_chunkSize;
+
+  /** the previously active arena of the current thread, or nullptr. */
+  DefinitionArena* m_previous;
+
+  /** the current chunk to allocate from, or nullptr. */
+  ArenaChunk* m_chunk;
+};
+
+
+/**
+ * Base class for objects to be allocated from the active @a DefinitionArena.
+ */
+class ArenaAllocated {
+ public:
+  /**
+   * Allocate memory for a new instance.
+   * @param size the size of the instance in bytes.
+   * @return the allocated memory.
+   */
+  static void* operator new(size_t size) { return DefinitionArena::allocate(size); }
+
+  /**
+   * Release the memory of a deleted instance.
+   * @param ptr the allocated memory.
+   */
+  static void operator delete(void* ptr) { DefinitionArena::release(ptr); }
+};
+
+}  // namespace ebusd
+
+#endif  // LIB_EBUS_ARENA_H_
@@ -59,6 +59,12 @@ class TemParamDataType : public NumberDataType {
   // @copydoc
   result_t writeSymbols(size_t offset, size_t length, istringstream* input,
       SymbolString* output, size_t* usedLength) const override;
+
+  // @copydoc
+  RawValueReader getRawValueReader(size_t) const override { return nullptr; }
+
+  // @copydoc
+  RawValueWriter getRawValueWriter(size_t) const override { return nullptr; }
 };
 
 /**
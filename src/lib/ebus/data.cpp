@@ -28,11 +28,13 @@
 #include <vector>
 #include <cstring>
 #include <algorithm>
+#include "lib/utils/memusage.h"
 
 namespace ebusd {
 
 using std::dec;
 using std::hex;
+using std::setfill;
 using std::setw;
 
 /** the week day names. */
@@ -121,6 +123,26 @@ void AttributedItem::appendJson(bool prependFieldSeparator, const string& name,
   }
 }
 
+void AttributedItem::appendJsonEscaped(const string& str, ostream* output) {
+  for (const char ch : str) {
+    if (ch == '"' || ch == '\\') {
+      *output << '\\' << ch;
+    } else if (static_cast<unsigned char>(ch) < 0x20) {
+      *output << "\\u00" << hex << setw(2) << setfill('0') << static_cast<unsigned>(ch) << dec << setfill(' ');
+    } else {
+      *output << ch;
+    }
+  }
+}
+
+map<string, InternedString> AttributedItem::internAttributes(const map<string, string>& attributes) {
+  map<string, InternedString> ret;
+  for (const auto& entry : attributes) {
+    ret[entry.first] = entry.second;
+  }
+  return ret;
+}
+
 void AttributedItem::mergeAttributes(map<string, string>* attributes) const {
   for (const auto& entry : m_attributes) {
     const auto it = attributes->find(entry.first);
@@ -142,7 +164,7 @@ void AttributedItem::dumpAttribute(bool prependFieldSeparator, OutputFormat outp
 bool AttributedItem::appendAttribute(OutputFormat outputFormat, const string& name, bool onlyIfNonEmpty,
     const string& prefix, const string& suffix, ostream* output) const {
   const auto it = m_attributes.find(name);
-  string value = it == m_attributes.end() ? "" : it->second;
+  const string& value = it == m_attributes.end() ? InternedString().str() : it->second.str();
   if (onlyIfNonEmpty && value.empty()) {
     return false;
   }
@@ -188,7 +210,15 @@ bool AttributedItem::appendAttributes(OutputFormat outputFormat, ostream* output
 
 string AttributedItem::getAttribute(const string& name) const {
   const auto it = m_attributes.find(name);
-  return it == m_attributes.end() ? "" : it->second;
+  return it == m_attributes.end() ? "" : it->second.str();
+}
+
+size_t AttributedItem::getAttributesMemoryUsage() const {
+  size_t ret = 0;
+  for (const auto& it : m_attributes) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first);
+  }
+  return ret;
 }
 
 
@@ -524,8 +554,24 @@ result_t SingleDataField::read(const SymbolString& data, size_t offset,
   if (isIgnored() || (fieldName != nullptr && m_name != fieldName) || fieldIndex > 0) {
     return RESULT_EMPTY;
   }
-  result_t res = m_dataType->readRawValue(offset, m_length, data, output);
-  return res;
+  return readRawValue(data, offset, output);
+}
+
+result_t SingleDataField::readValues(const SymbolString& data, size_t offset, fieldValue_t* values) const {
+  if (m_partType == pt_any) {
+    return RESULT_ERR_INVALID_PART;
+  }
+  if ((data.isMaster() ? pt_masterData : pt_slaveData) != m_partType) {
+    return RESULT_EMPTY;
+  }
+  bool remainder = m_length == REMAIN_LEN && m_dataType->isAdjustableLength();
+  if (offset + (remainder?1:m_length) > data.getDataSize()) {
+    return RESULT_ERR_INVALID_POS;
+  }
+  if (isIgnored()) {
+    return RESULT_EMPTY;
+  }
+  return readValue(data, offset, values);
 }
 
 result_t SingleDataField::read(const SymbolString& data, size_t offset,
@@ -600,14 +646,66 @@ result_t SingleDataField::write(char separator, size_t offset, istringstream* in
   return writeSymbols(offset, input, data, usedLength);
 }
 
+result_t SingleDataField::readValue(const SymbolString& input, size_t offset, fieldValue_t* value) const {
+  value->field = this;
+  value->type = fvt_null;
+  value->rawValue = 0;
+  if (!m_dataType->isNumeric()) {
+    ostringstream output;
+    result_t result = m_dataType->readSymbols(offset, m_length, input, OF_NONE, &output);
+    if (result != RESULT_OK) {
+      return result;
+    }
+    value->type = fvt_string;
+    value->stringValue = output.str();
+    return RESULT_OK;
+  }
+  const NumberDataType* numType = reinterpret_cast<const NumberDataType*>(m_dataType);
+  result_t result = readRawValue(input, offset, &value->rawValue);
+  if (result != RESULT_OK) {
+    return result;
+  }
+  FieldValueType type;
+  if (numType->isFloat()) {
+    type = fvt_float;
+    result = numType->getFloatFromRawValue(value->rawValue, &value->floatValue);
+  } else {
+    type = fvt_integer;
+    result = numType->getIntFromRawValue(value->rawValue, &value->intValue);
+  }
+  if (result == RESULT_EMPTY) {
+    return RESULT_OK;  // replacement value
+  }
+  if (result == RESULT_OK) {
+    value->type = type;
+  }
+  return result;
+}
+
 result_t SingleDataField::readSymbols(const SymbolString& input, size_t offset,
     OutputFormat outputFormat, ostream* output) const {
-  return m_dataType->readSymbols(offset, m_length, input, outputFormat, output);
+  if (!m_rawValueReader) {
+    return m_dataType->readSymbols(offset, m_length, input, outputFormat, output);
+  }
+  unsigned int value = 0;
+  result_t result = readRawValue(input, offset, &value);
+  if (result != RESULT_OK) {
+    return result;
+  }
+  return static_cast<const NumberDataType*>(m_dataType)->readFromRawValue(value, outputFormat, output);
 }
 
 result_t SingleDataField::writeSymbols(size_t offset, istringstream* input,
     SymbolString* output, size_t* usedLength) const {
-  return m_dataType->writeSymbols(offset, m_length, input, output, usedLength);
+  if (!m_rawValueWriter) {
+    return m_dataType->writeSymbols(offset, m_length, input, output, usedLength);
+  }
+  unsigned int value = 0;
+  result_t result = static_cast<const NumberDataType*>(m_dataType)->parseRawValue(m_length, input, &value);
+  if (result != RESULT_OK) {
+    return result;
+  }
+  return writeRawValue(value, offset, output, usedLength);
 }
 
 const SingleDataField* SingleDataField::clone() const {
@@ -624,7 +722,7 @@ result_t SingleDataField::derive(const string& name, PartType partType, int divi
   if (!numeric && (divisor != 0 || !values.empty())) {
     return RESULT_ERR_INVALID_ARG;  // cannot set divisor or values for non-numeric field
   }
-  string useName = name.empty() ? m_name : name;
+  string useName = name.empty() ? m_name.str() : name;
   mergeAttributes(attributes);
   const DataType* dataType = m_dataType;
   if (numeric) {
@@ -694,13 +792,21 @@ const ValueListDataField* ValueListDataField::clone() const {
   return new ValueListDataField(*this);
 }
 
+size_t ValueListDataField::getMemoryUsage() const {
+  size_t ret = sizeof(ValueListDataField) + getAttributesMemoryUsage();
+  for (const auto& it : m_values) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.second);
+  }
+  return ret;
+}
+
 result_t ValueListDataField::derive(const string& name, PartType partType, int divisor,
     const map<unsigned int, string>& values, map<string, string>* attributes,
     vector<const SingleDataField*>* fields) const {
   if (m_partType != pt_any && partType == pt_any) {
     return RESULT_ERR_INVALID_PART;  // cannot create a template from a concrete instance
   }
-  string useName = name.empty() ? m_name : name;
+  string useName = name.empty() ? m_name.str() : name;
   mergeAttributes(attributes);
   if (divisor != 0 && divisor != 1) {
     return RESULT_ERR_INVALID_ARG;  // cannot use divisor != 1 for value list field
@@ -746,11 +852,29 @@ void ValueListDataField::dump(bool prependFieldSeparator, OutputFormat outputFor
   dumpSuffix(outputFormat, output);
 }
 
+result_t ValueListDataField::readValue(const SymbolString& input, size_t offset, fieldValue_t* value) const {
+  value->field = this;
+  value->type = fvt_null;
+  result_t result = readRawValue(input, offset, &value->rawValue);
+  if (result != RESULT_OK) {
+    return result;
+  }
+  value->intValue = value->rawValue;
+  const auto it = m_values.find(value->rawValue);
+  if (it != m_values.end()) {
+    value->type = fvt_string;
+    value->stringValue = it->second;
+  } else if (value->rawValue != m_dataType->getReplacement()) {
+    value->type = fvt_integer;  // fall back to raw value in input
+  }
+  return RESULT_OK;
+}
+
 result_t ValueListDataField::readSymbols(const SymbolString& input, size_t offset,
     OutputFormat outputFormat, ostream* output) const {
   unsigned int value = 0;
 
-  result_t result = m_dataType->readRawValue(offset, m_length, input, &value);
+  result_t result = readRawValue(input, offset, &value);
   if (result != RESULT_OK) {
     return result;
   }
@@ -790,12 +914,12 @@ result_t ValueListDataField::writeSymbols(size_t offset, istringstream* input,
   const string inputStr = input->str();
   if (isIgnored() || inputStr == NULL_VALUE) {
     // replacement value
-    return numType->writeRawValue(numType->getReplacement(), offset, m_length, output, usedLength);
+    return writeRawValue(numType->getReplacement(), offset, output, usedLength);
   }
 
   for (const auto& it : m_values) {
     if (it.second == inputStr) {
-      return numType->writeRawValue(it.first, offset, m_length, output, usedLength);
+      return writeRawValue(it.first, offset, output, usedLength);
     }
   }
   const char* str = inputStr.c_str();
@@ -806,7 +930,7 @@ result_t ValueListDataField::writeSymbols(size_t offset, istringstream* input,
     return RESULT_ERR_INVALID_NUM;  // invalid value
   }
   if (m_values.find(value) != m_values.end()) {
-    return numType->writeRawValue(value, offset, m_length, output, usedLength);
+    return writeRawValue(value, offset, output, usedLength);
   }
   return RESULT_ERR_NOTFOUND;  // value assignment not found
 }
@@ -816,13 +940,17 @@ const ConstantDataField* ConstantDataField::clone() const {
   return new ConstantDataField(*this);
 }
 
+size_t ConstantDataField::getMemoryUsage() const {
+  return sizeof(ConstantDataField) + getAttributesMemoryUsage() + memUsage(m_value);
+}
+
 result_t ConstantDataField::derive(const string& name, PartType partType, int divisor,
     const map<unsigned int, string>& values, map<string, string>* attributes,
     vector<const SingleDataField*>* fields) const {
   if (m_partType != pt_any && partType == pt_any) {
     return RESULT_ERR_INVALID_PART;  // cannot create a template from a concrete instance
   }
-  string useName = name.empty() ? m_name : name;
+  string useName = name.empty() ? m_name.str() : name;
   for (const auto& entry : m_attributes) {  // merge with this attributes
     if ((*attributes)[entry.first].empty()) {
       (*attributes)[entry.first] = entry.second;
@@ -850,6 +978,17 @@ void ConstantDataField::dump(bool prependFieldSeparator, OutputFormat outputForm
   dumpSuffix(outputFormat, output);
 }
 
+result_t ConstantDataField::readValue(const SymbolString& input, size_t offset, fieldValue_t* value) const {
+  if (m_verify) {
+    ostringstream coutput;
+    result_t result = readSymbols(input, offset, OF_NONE, &coutput);
+    if (result != RESULT_OK) {
+      return result;
+    }
+  }
+  return SingleDataField::readValue(input, offset, value);
+}
+
 result_t ConstantDataField::readSymbols(const SymbolString& input, size_t offset,
     OutputFormat outputFormat, ostream* output) const {
   ostringstream coutput;
@@ -935,6 +1074,14 @@ const DataFieldSet* DataFieldSet::clone() const {
   return new DataFieldSet(m_name, fields);
 }
 
+size_t DataFieldSet::getMemoryUsage() const {
+  size_t ret = sizeof(DataFieldSet) + getAttributesMemoryUsage() + m_fields.capacity()*sizeof(SingleDataField*);
+  for (const auto field : m_fields) {
+    ret += field->getMemoryUsage();
+  }
+  return ret;
+}
+
 size_t DataFieldSet::getLength(PartType partType, size_t maxLength) const {
   size_t length = 0;
   bool previousFullByteOffset[] = { true, true, true, true };
@@ -1090,6 +1237,37 @@ result_t DataFieldSet::read(const SymbolString& data, size_t offset,
   return RESULT_OK;
 }
 
+void DataFieldSet::buildDecodePlan() {
+  for (int part = 0; part < 2; part++) {
+    PartType partType = part == 0 ? pt_masterData : pt_slaveData;
+    vector<decodeStep_t>& plan = m_decodePlan[part];
+    plan.clear();
+    bool previousFullByteOffset = true, fixed = true, complete = true;
+    int16_t previousFirstBit = -1;
+    size_t offset = 0, outputPosition = 0;
+    for (const auto field : m_fields) {
+      if (field->getPartType() == partType) {
+        if (!fixed) {
+          complete = false;  // offset depends on the length of a previous field
+          break;
+        }
+        if (!previousFullByteOffset && !field->hasFullByteOffset(false, previousFirstBit)) {
+          offset--;
+        }
+        plan.push_back({field, offset, outputPosition});
+        size_t length = field->getLength(partType, 0);
+        fixed = length == field->getLength(partType, 1);  // not fixed for remainder length
+        offset += length;
+        previousFullByteOffset = field->hasFullByteOffset(true, previousFirstBit);
+      }
+      if (!field->isIgnored()) {
+        outputPosition++;
+      }
+    }
+    m_hasDecodePlan[part] = complete;
+  }
+}
+
 result_t DataFieldSet::read(const SymbolString& data, size_t offset,
     bool leadingSeparator, const char* fieldName, ssize_t fieldIndex,
     OutputFormat outputFormat, ssize_t outputIndex, ostream* output) const {
@@ -1099,6 +1277,22 @@ result_t DataFieldSet::read(const SymbolString& data, size_t offset,
     outputIndex = 0;
   }
   PartType partType = data.isMaster() ? pt_masterData : pt_slaveData;
+  int part = data.isMaster() ? 0 : 1;
+  if (fieldName == nullptr && fieldIndex < 0 && m_hasDecodePlan[part]) {
+    // all fields requested: use the precomputed offsets
+    for (const auto& step : m_decodePlan[part]) {
+      result_t result = step.field->read(data, offset + step.offset, leadingSeparator, nullptr, -1,
+          outputFormat, outputIndex < 0 ? -1 : outputIndex + static_cast<ssize_t>(step.outputPosition), output);
+      if (result < RESULT_OK) {
+        return result;
+      }
+      if (result != RESULT_EMPTY) {
+        found = true;
+        leadingSeparator = true;
+      }
+    }
+    return found ? RESULT_OK : RESULT_EMPTY;
+  }
   for (const auto field : m_fields) {
     if (field->getPartType() != partType) {
       if (outputIndex >= 0 && !field->isIgnored()) {
@@ -1140,6 +1334,45 @@ result_t DataFieldSet::read(const SymbolString& data, size_t offset,
   return RESULT_OK;
 }
 
+result_t DataFieldSet::readValues(const SymbolString& data, size_t offset, fieldValue_t* values) const {
+  bool previousFullByteOffset = true, found = false;
+  int16_t previousFirstBit = -1;
+  PartType partType = data.isMaster() ? pt_masterData : pt_slaveData;
+  size_t position = 0;
+  result_t failed = RESULT_OK;
+  for (const auto field : m_fields) {
+    if (field->getPartType() != partType) {
+      if (!field->isIgnored()) {
+        position++;
+      }
+      continue;
+    }
+    if (!previousFullByteOffset && !field->hasFullByteOffset(false, previousFirstBit)) {
+      offset--;
+    }
+    result_t result = field->readValues(data, offset, values + position);
+    if (result < RESULT_OK) {
+      // keep on reading the other fields
+      values[position].field = nullptr;
+      values[position].type = fvt_null;
+      failed = result;
+    }
+    size_t remain = data.getDataSize() > offset ? data.getDataSize()-offset : 0;
+    offset += field->getLength(partType, remain);
+    previousFullByteOffset = field->hasFullByteOffset(true, previousFirstBit);
+    if (result != RESULT_EMPTY) {
+      found = true;
+    }
+    if (!field->isIgnored()) {
+      position++;
+    }
+  }
+  if (failed != RESULT_OK) {
+    return failed;
+  }
+  return found ? RESULT_OK : RESULT_EMPTY;
+}
+
 result_t DataFieldSet::write(char separator, size_t offset, istringstream* input,
     SymbolString* data, size_t* usedLength) const {
   string token;
@@ -1295,6 +1528,7 @@ result_t LoadableDataFieldSet::addFromFile(const string& filename, unsigned int
       }
     }
   }
+  buildDecodePlan();
   return result;
 }
 
@@ -1459,4 +1693,12 @@ const DataField* DataFieldTemplates::get(const string& name) const {
   return ref->second;
 }
 
+size_t DataFieldTemplates::getMemoryUsage() const {
+  size_t ret = sizeof(DataFieldTemplates);
+  for (const auto& it : m_fieldsByName) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first) + it.second->getMemoryUsage();
+  }
+  return ret;
+}
+
 }  // namespace ebusd
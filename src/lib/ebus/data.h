@@ -30,6 +30,8 @@
 #include "lib/ebus/result.h"
 #include "lib/ebus/filereader.h"
 #include "lib/ebus/datatype.h"
+#include "lib/ebus/intern.h"
+#include "lib/ebus/arena.h"
 
 namespace ebusd {
 
@@ -53,10 +55,28 @@ namespace ebusd {
 class DataFieldTemplates;
 class SingleDataField;
 
+/** the type of a decoded @a fieldValue_t. */
+enum FieldValueType {
+  fvt_null,     //!< no value (e.g. the replacement value or not yet decoded)
+  fvt_integer,  //!< an integer number in intValue
+  fvt_float,    //!< a floating point number in floatValue
+  fvt_string,   //!< a text in stringValue (string, date, time, or name from a value list)
+};
+
+/** a single decoded field value. */
+typedef struct {
+  const SingleDataField* field;  //!< the decoded field (for name, unit, and comment), or nullptr if decoding failed
+  FieldValueType type;  //!< the type of the value
+  unsigned int rawValue;  //!< the numeric raw value (numeric fields only)
+  int64_t intValue;  //!< the integer value (also for a name from a value list)
+  float floatValue;  //!< the floating point value (including divisor)
+  string stringValue;  //!< the text value
+} fieldValue_t;
+
 /**
  * Base class for named items with optional named attributes.
  */
-class AttributedItem {
+class AttributedItem : public ArenaAllocated {
  public:
   /**
    * Constructs a new instance.
@@ -64,7 +84,7 @@ class AttributedItem {
    * @param attributes the additional named attributes.
    */
   AttributedItem(const string& name, const map<string, string>& attributes)
-    : m_name(name), m_attributes(attributes) {}
+    : m_name(name), m_attributes(internAttributes(attributes)) {}
 
   /**
    * Constructs a new instance (without additional attributes).
@@ -73,6 +93,14 @@ class AttributedItem {
   explicit AttributedItem(const string& name)
     : m_name(name) {}
 
+  /**
+   * Constructs a new instance with already interned attributes (e.g. when deriving from another instance).
+   * @param name the item name.
+   * @param attributes the additional named attributes with interned values.
+   */
+  AttributedItem(const InternedString& name, const map<string, InternedString>& attributes)
+    : m_name(name), m_attributes(attributes) {}
+
   /**
    * Destructor.
    */
@@ -113,6 +141,20 @@ class AttributedItem {
   static void appendJson(bool prependFieldSeparator, const string& name, const string& value,
       bool forceString, ostream* output);
 
+  /**
+   * Append a @a string escaped for use within a JSON string literal (without the enclosing quotes) to the output.
+   * @param str the @a string to append.
+   * @param output the @a ostream to append to.
+   */
+  static void appendJsonEscaped(const string& str, ostream* output);
+
+  /**
+   * Intern the values of the additional named attributes.
+   * @param attributes the additional named attributes.
+   * @return the additional named attributes with interned values.
+   */
+  static map<string, InternedString> internAttributes(const map<string, string>& attributes);
+
   /**
    * Merge this instance's additional named attributes into the specified attributes.
    * @param attributes the additional named attributes to merge in this instance's additional named attributes.
@@ -153,7 +195,7 @@ class AttributedItem {
    * Get the item name.
    * @return the item name.
    */
-  const string& getName() const { return m_name; }
+  const string& getName() const { return m_name.str(); }
 
   /**
    * Get a named attribute.
@@ -162,13 +204,19 @@ class AttributedItem {
    */
   string getAttribute(const string& name) const;
 
+  /**
+   * Get the estimated heap memory used by the additional named attributes (without the shared values).
+   * @return the estimated number of bytes.
+   */
+  size_t getAttributesMemoryUsage() const;
+
 
  protected:
   /** the field name. */
-  const string m_name;
+  const InternedString m_name;
 
-  /** the additional named attributes. */
-  const map<string, string> m_attributes;
+  /** the additional named attributes (with the values shared between all instances). */
+  const map<string, InternedString> m_attributes;
 };
 
 
@@ -215,6 +263,12 @@ class DataField : public AttributedItem {
    */
   virtual bool isList() const { return false; }
 
+  /**
+   * Get the estimated memory used by this instance including the contained fields.
+   * @return the estimated number of bytes.
+   */
+  virtual size_t getMemoryUsage() const = 0;
+
   /**
    * Factory method for creating new instances.
    * @param isWriteMessage whether the field is part of a write message (default false).
@@ -332,6 +386,18 @@ class DataField : public AttributedItem {
     bool leadingSeparator, const char* fieldName, ssize_t fieldIndex,
     OutputFormat outputFormat, ssize_t outputIndex, ostream* output) const = 0;
 
+  /**
+   * Reads the typed values of all fields from the @a SymbolString.
+   * @param data the data @a SymbolString for reading binary data.
+   * @param offset the additional offset to add for reading binary data.
+   * @param values the caller provided buffer with one entry per non-ignored field (see @a getCount()) in which to
+   * store the values. Entries of fields in the other message part are left untouched. The remaining fields are
+   * still read when a single field fails, with the field of the failed entry set to nullptr.
+   * @return @a RESULT_OK on success, or @a RESULT_EMPTY if no field was read, or the error code of the last failed
+   * field.
+   */
+  virtual result_t readValues(const SymbolString& data, size_t offset, fieldValue_t* values) const = 0;
+
   /**
    * Writes the value to the master or slave @a SymbolString.
    * @param input the @a istringstream to parse the formatted value from.
@@ -362,7 +428,11 @@ class SingleDataField : public DataField {
   SingleDataField(const string& name, const map<string, string>& attributes, const DataType* dataType,
     PartType partType, size_t length)
     : DataField(name, attributes),
-    m_partType(partType), m_dataType(dataType), m_length(length) {}
+    m_partType(partType), m_dataType(dataType), m_length(length),
+    m_rawValueReader(dataType->isNumeric()
+      ? static_cast<const NumberDataType*>(dataType)->getRawValueReader(length) : nullptr),
+    m_rawValueWriter(dataType->isNumeric()
+      ? static_cast<const NumberDataType*>(dataType)->getRawValueWriter(length) : nullptr) {}
 
   /**
    * Destructor.
@@ -372,6 +442,9 @@ class SingleDataField : public DataField {
   // @copydoc
   const SingleDataField* clone() const override;
 
+  // @copydoc
+  size_t getMemoryUsage() const override { return sizeof(SingleDataField) + getAttributesMemoryUsage(); }
+
   /**
    * Factory method for creating a new @a SingleDataField instance derived from a base type.
    * @param name the field name.
@@ -427,7 +500,7 @@ class SingleDataField : public DataField {
 
   // @copydoc
   string getName(ssize_t fieldIndex) const override {
-    return isIgnored() || fieldIndex > 0 ? "" : m_name;
+    return isIgnored() || fieldIndex > 0 ? "" : m_name.str();
   }
 
   // @copydoc
@@ -474,12 +547,24 @@ class SingleDataField : public DataField {
       bool leadingSeparator, const char* fieldName, ssize_t fieldIndex,
       OutputFormat outputFormat, ssize_t outputIndex, ostream* output) const override;
 
+  // @copydoc
+  result_t readValues(const SymbolString& data, size_t offset, fieldValue_t* values) const override;
+
   // @copydoc
   result_t write(char separator, size_t offset, istringstream* input,
       SymbolString* data, size_t* usedLength) const override;
 
 
  protected:
+  /**
+   * Internal method for reading the typed value of the field from a @a SymbolString.
+   * @param input the @a SymbolString to read the binary value from.
+   * @param offset the offset in the @a SymbolString.
+   * @param value the @a fieldValue_t in which to store the value.
+   * @return @a RESULT_OK on success, or an error code.
+   */
+  virtual result_t readValue(const SymbolString& input, size_t offset, fieldValue_t* value) const;
+
   /**
    * Internal method for reading the field from a @a SymbolString.
    * @param input the @a SymbolString to read the binary value from.
@@ -502,6 +587,42 @@ class SingleDataField : public DataField {
   virtual result_t writeSymbols(size_t offset, istringstream* input,
       SymbolString* output, size_t* usedLength) const;
 
+  /**
+   * Internal method for reading the numeric raw value of the field from a @a SymbolString using the specialized
+   * @a RawValueReader if available.
+   * @param input the @a SymbolString to read the binary value from.
+   * @param offset the offset in the @a SymbolString.
+   * @param value the variable in which to store the numeric raw value.
+   * @return @a RESULT_OK on success, or an error code.
+   */
+  result_t readRawValue(const SymbolString& input, size_t offset, unsigned int* value) const {
+    if (m_rawValueReader) {
+      return m_rawValueReader(static_cast<const NumberDataType*>(m_dataType), offset, input, value);
+    }
+    return m_dataType->readRawValue(offset, m_length, input, value);
+  }
+
+  /**
+   * Internal method for writing the numeric raw value of the field to a @a SymbolString using the specialized
+   * @a RawValueWriter if available.
+   * @param value the numeric raw value to write.
+   * @param offset the offset in the @a SymbolString.
+   * @param output the @a SymbolString to write the binary value to.
+   * @param usedLength the variable in which to store the used length in bytes, or nullptr.
+   * @return @a RESULT_OK on success, or an error code.
+   */
+  result_t writeRawValue(unsigned int value, size_t offset, SymbolString* output, size_t* usedLength) const {
+    const NumberDataType* numType = static_cast<const NumberDataType*>(m_dataType);
+    if (!m_rawValueWriter) {
+      return numType->writeRawValue(value, offset, m_length, output, usedLength);
+    }
+    m_rawValueWriter(numType, value, offset, output);
+    if (usedLength != nullptr) {
+      *usedLength = m_length;
+    }
+    return RESULT_OK;
+  }
+
   /** the message part in which the field is stored. */
   const PartType m_partType;
 
@@ -510,6 +631,12 @@ class SingleDataField : public DataField {
 
   /** the number of symbols in the message part in which the field is stored. */
   const size_t m_length;
+
+  /** the @a RawValueReader specialized for the numeric data type and length, or nullptr. */
+  const RawValueReader m_rawValueReader;
+
+  /** the @a RawValueWriter specialized for the numeric data type and length, or nullptr. */
+  const RawValueWriter m_rawValueWriter;
 };
 
 
@@ -540,6 +667,9 @@ class ValueListDataField : public SingleDataField {
   // @copydoc
   const ValueListDataField* clone() const override;
 
+  // @copydoc
+  size_t getMemoryUsage() const override;
+
   // @copydoc
   bool isList() const override { return true; }
 
@@ -557,6 +687,9 @@ class ValueListDataField : public SingleDataField {
   const map<unsigned int, string>& getList() const { return m_values; }
 
  protected:
+  // @copydoc
+  result_t readValue(const SymbolString& input, size_t offset, fieldValue_t* value) const override;
+
   // @copydoc
   result_t readSymbols(const SymbolString& input, size_t offset,
       const OutputFormat outputFormat, ostream* output) const override;
@@ -600,6 +733,9 @@ class ConstantDataField : public SingleDataField {
   // @copydoc
   const ConstantDataField* clone() const override;
 
+  // @copydoc
+  size_t getMemoryUsage() const override;
+
   // @copydoc
   result_t derive(const string& name, PartType partType, int divisor,
       const map<unsigned int, string>& values, map<string, string>* attributes,
@@ -610,6 +746,9 @@ class ConstantDataField : public SingleDataField {
 
 
  protected:
+  // @copydoc
+  result_t readValue(const SymbolString& input, size_t offset, fieldValue_t* value) const override;
+
   // @copydoc
   result_t readSymbols(const SymbolString& input, size_t offset,
       const OutputFormat outputFormat, ostream* output) const override;
@@ -672,6 +811,7 @@ class DataFieldSet : public DataField {
     }
     m_uniqueNames = uniqueNames;
     m_ignoredCount = ignoredCount;
+    buildDecodePlan();
   }
 
   /**
@@ -682,6 +822,9 @@ class DataFieldSet : public DataField {
   // @copydoc
   const DataFieldSet* clone() const override;
 
+  // @copydoc
+  size_t getMemoryUsage() const override;
+
   // @copydoc
   bool isSet() const override { return true; };
 
@@ -735,6 +878,9 @@ class DataFieldSet : public DataField {
       bool leadingSeparator, const char* fieldName, ssize_t fieldIndex,
       OutputFormat outputFormat, ssize_t outputIndex, ostream* output) const override;
 
+  // @copydoc
+  result_t readValues(const SymbolString& data, size_t offset, fieldValue_t* values) const override;
+
   // @copydoc
   result_t write(char separator, size_t offset, istringstream* input,
       SymbolString* data, size_t* usedLength) const override;
@@ -753,6 +899,25 @@ class DataFieldSet : public DataField {
 
   /** the number of ignored fields. */
   size_t m_ignoredCount;
+
+  /**
+   * Precompute the decode plan for each part from the current fields.
+   */
+  void buildDecodePlan();
+
+ private:
+  /** a single step of the decode plan. */
+  typedef struct {
+    const SingleDataField* field;  // the field to read
+    size_t offset;  // the offset relative to the start of the part
+    size_t outputPosition;  // the number of non-ignored fields before this one (in all parts)
+  } decodeStep_t;
+
+  /** the decode plan for the master data (0) and slave data (1) for reading all fields at once. */
+  vector<decodeStep_t> m_decodePlan[2];
+
+  /** whether the decode plan for the master data (0) and slave data (1) is usable (all offsets fixed). */
+  bool m_hasDecodePlan[2];
 };
 
 
@@ -811,6 +976,12 @@ class DataFieldTemplates : public MappedFileReader {
    */
   void clear();
 
+  /**
+   * Exchange the @a DataField instances with another instance.
+   * @param other the other @a DataFieldTemplates.
+   */
+  void swap(DataFieldTemplates* other) { m_fieldsByName.swap(other->m_fieldsByName); }
+
   /**
    * Adds a template @a DataField instance to this map.
    * @param field the @a DataField instance to add.
@@ -836,6 +1007,12 @@ class DataFieldTemplates : public MappedFileReader {
    */
   const DataField* get(const string& name) const;
 
+  /**
+   * Get the estimated memory used by the templates.
+   * @return the estimated number of bytes.
+   */
+  size_t getMemoryUsage() const;
+
 
  private:
   /** the known template @a DataField instances by name. */
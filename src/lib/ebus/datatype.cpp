@@ -97,6 +97,53 @@ uint32_t floatToUint(float val) {
 #endif
 }
 
+void appendCborHead(uint8_t majorType, uint64_t argument, ostream* output) {
+  uint8_t head = static_cast<uint8_t>(majorType << 5);
+  int bytes;
+  if (argument < 24) {
+    output->put(static_cast<char>(head | argument));
+    return;
+  }
+  if (argument <= 0xff) {
+    head |= 24;
+    bytes = 1;
+  } else if (argument <= 0xffff) {
+    head |= 25;
+    bytes = 2;
+  } else if (argument <= 0xffffffff) {
+    head |= 26;
+    bytes = 4;
+  } else {
+    head |= 27;
+    bytes = 8;
+  }
+  output->put(static_cast<char>(head));
+  for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+    output->put(static_cast<char>((argument >> shift) & 0xff));
+  }
+}
+
+void appendCborInt(int64_t value, ostream* output) {
+  if (value < 0) {
+    appendCborHead(CBOR_NEGATIVE, static_cast<uint64_t>(-(value + 1)), output);
+  } else {
+    appendCborHead(CBOR_UNSIGNED, static_cast<uint64_t>(value), output);
+  }
+}
+
+void appendCborFloat(float value, ostream* output) {
+  uint32_t bits = floatToUint(value);
+  output->put(static_cast<char>(0xfa));  // major type 7 with single precision float
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    output->put(static_cast<char>((bits >> shift) & 0xff));
+  }
+}
+
+void appendCborText(const string& value, ostream* output) {
+  appendCborHead(CBOR_TEXT, value.length(), output);
+  output->write(value.data(), static_cast<std::streamsize>(value.length()));
+}
+
 
 bool DataType::dump(OutputFormat outputFormat, size_t length, bool appendDivisor, ostream* output) const {
   if (outputFormat & OF_JSON) {
@@ -798,16 +845,14 @@ result_t NumberDataType::readSymbols(size_t offset, size_t length, const SymbolS
   return readFromRawValue(value, outputFormat, output);
 }
 
-result_t NumberDataType::getFloatFromRawValue(unsigned int value, float* output) const {
+result_t NumberDataType::checkRawValue(unsigned int value, bool* negative) const {
   if (!hasFlag(REQ) && value == m_replacement) {
     return RESULT_EMPTY;
   }
-
-  bool negative;
   if (hasFlag(SIG)) {  // signed value
-    negative = (value & (1 << (m_bitCount - 1))) != 0;
+    *negative = (value & (1 << (m_bitCount - 1))) != 0;
     if (!hasFlag(EXP)) {
-      if (negative) {  // negative signed value
+      if (*negative) {  // negative signed value
         if (value < m_minValue) {
           return RESULT_ERR_OUT_OF_RANGE;  // value out of range
         }
@@ -818,7 +863,33 @@ result_t NumberDataType::getFloatFromRawValue(unsigned int value, float* output)
   } else if (value < m_minValue || value > m_maxValue) {
     return RESULT_ERR_OUT_OF_RANGE;  // value out of range
   } else {
-    negative = false;
+    *negative = false;
+  }
+  return RESULT_OK;
+}
+
+result_t NumberDataType::getIntFromRawValue(unsigned int value, int64_t* output) const {
+  bool negative;
+  result_t result = checkRawValue(value, &negative);
+  if (result != RESULT_OK) {
+    return result;
+  }
+  if (isFloat()) {
+    return RESULT_ERR_INVALID_NUM;
+  }
+  if (negative) {
+    *output = static_cast<int64_t>(value) - (static_cast<int64_t>(1) << m_bitCount);
+  } else {
+    *output = static_cast<int64_t>(value);
+  }
+  return RESULT_OK;
+}
+
+result_t NumberDataType::getFloatFromRawValue(unsigned int value, float* output) const {
+  bool negative;
+  result_t result = checkRawValue(value, &negative);
+  if (result != RESULT_OK) {
+    return result;
   }
   int signedValue;
   if (m_bitCount == 32) {
@@ -1012,6 +1083,125 @@ result_t NumberDataType::writeRawValue(unsigned int value, size_t offset, size_t
   return RESULT_OK;
 }
 
+/**
+ * Read a byte aligned binary raw value.
+ * @tparam BYTES the number of bytes.
+ * @tparam REVERSED whether the most significant byte comes first.
+ */
+template<size_t BYTES, bool REVERSED>
+static result_t readBinaryRawValue(const NumberDataType*, size_t offset, const SymbolString& input,
+    unsigned int* value) {
+  if (offset + BYTES > input.getDataSize()) {
+    return RESULT_ERR_INVALID_POS;  // not enough data available
+  }
+  unsigned int result = 0;
+  for (size_t i = 0; i < BYTES; i++) {
+    result |= static_cast<unsigned int>(input.dataAt(offset + (REVERSED ? BYTES - 1 - i : i))) << (8 * i);
+  }
+  *value = result;
+  return RESULT_OK;
+}
+
+/**
+ * Write a byte aligned binary raw value.
+ * @tparam BYTES the number of bytes.
+ * @tparam REVERSED whether the most significant byte comes first.
+ */
+template<size_t BYTES, bool REVERSED>
+static void writeBinaryRawValue(const NumberDataType*, unsigned int value, size_t offset, SymbolString* output) {
+  for (size_t i = 0; i < BYTES; i++) {
+    output->dataAt(offset + (REVERSED ? BYTES - 1 - i : i)) = static_cast<symbol_t>(value >> (8 * i));
+  }
+}
+
+/**
+ * Read a single byte BCD raw value.
+ * @tparam REQUIRED whether the value is required (i.e. no replacement value).
+ */
+template<bool REQUIRED>
+static result_t readBcdRawValue(const NumberDataType* type, size_t offset, const SymbolString& input,
+    unsigned int* value) {
+  if (offset + 1 > input.getDataSize()) {
+    return RESULT_ERR_INVALID_POS;  // not enough data available
+  }
+  symbol_t symbol = input.dataAt(offset);
+  if (!REQUIRED && symbol == (type->getReplacement() & 0xff)) {
+    *value = type->getReplacement();
+    return RESULT_OK;
+  }
+  if ((symbol & 0xf0) > 0x90 || (symbol & 0x0f) > 0x09) {
+    return RESULT_ERR_OUT_OF_RANGE;  // invalid BCD
+  }
+  *value = static_cast<unsigned int>((symbol >> 4) * 10 + (symbol & 0x0f));
+  return RESULT_OK;
+}
+
+/**
+ * Write a single byte BCD raw value.
+ * @tparam REQUIRED whether the value is required (i.e. no replacement value).
+ */
+template<bool REQUIRED>
+static void writeBcdRawValue(const NumberDataType* type, unsigned int value, size_t offset, SymbolString* output) {
+  symbol_t symbol;
+  if (!REQUIRED && value == type->getReplacement()) {
+    symbol = type->getReplacement() & 0xff;
+  } else {
+    symbol = (symbol_t)(value % 100);
+    symbol = (symbol_t)(((symbol / 10) << 4) | (symbol % 10));
+  }
+  output->dataAt(offset) = symbol;
+}
+
+RawValueReader NumberDataType::getRawValueReader(size_t length) const {
+  if (m_firstBit != 0 || m_bitCount != length * 8) {
+    return nullptr;
+  }
+  if (hasFlag(BCD)) {
+    if (length != 1 || hasFlag(HCD)) {
+      return nullptr;
+    }
+    return hasFlag(REQ) ? readBcdRawValue<true> : readBcdRawValue<false>;
+  }
+  bool reversed = hasFlag(REV);
+  switch (length) {
+    case 1:
+      return readBinaryRawValue<1, false>;
+    case 2:
+      return reversed ? readBinaryRawValue<2, true> : readBinaryRawValue<2, false>;
+    case 3:
+      return reversed ? readBinaryRawValue<3, true> : readBinaryRawValue<3, false>;
+    case 4:
+      return reversed ? readBinaryRawValue<4, true> : readBinaryRawValue<4, false>;
+    default:
+      return nullptr;
+  }
+}
+
+RawValueWriter NumberDataType::getRawValueWriter(size_t length) const {
+  if (m_firstBit != 0 || m_bitCount != length * 8) {
+    return nullptr;
+  }
+  if (hasFlag(BCD)) {
+    if (length != 1 || hasFlag(HCD)) {
+      return nullptr;
+    }
+    return hasFlag(REQ) ? writeBcdRawValue<true> : writeBcdRawValue<false>;
+  }
+  bool reversed = hasFlag(REV);
+  switch (length) {
+    case 1:
+      return writeBinaryRawValue<1, false>;
+    case 2:
+      return reversed ? writeBinaryRawValue<2, true> : writeBinaryRawValue<2, false>;
+    case 3:
+      return reversed ? writeBinaryRawValue<3, true> : writeBinaryRawValue<3, false>;
+    case 4:
+      return reversed ? writeBinaryRawValue<4, true> : writeBinaryRawValue<4, false>;
+    default:
+      return nullptr;
+  }
+}
+
 result_t NumberDataType::getRawValueFromFloat(float val, unsigned int* output) const {
   unsigned int value;
   if (hasFlag(EXP)) {  // IEEE 754 binary32
@@ -1084,6 +1274,15 @@ result_t NumberDataType::getRawValueFromFloat(float val, unsigned int* output) c
 result_t NumberDataType::writeSymbols(size_t offset, size_t length, istringstream* input,
                                       SymbolString* output, size_t* usedLength) const {
   unsigned int value;
+  result_t result = parseRawValue(length, input, &value);
+  if (result != RESULT_OK) {
+    return result;
+  }
+  return writeRawValue(value, offset, length, output, usedLength);
+}
+
+result_t NumberDataType::parseRawValue(size_t length, istringstream* input, unsigned int* output) const {
+  unsigned int value;
 
   const string inputStr = input->str();
   if (!hasFlag(REQ) && (isIgnored() || inputStr == NULL_VALUE)) {
@@ -1163,8 +1362,8 @@ result_t NumberDataType::writeSymbols(size_t offset, size_t length, istringstrea
       return RESULT_ERR_OUT_OF_RANGE;  // value out of range
     }
   }
-
-  return writeRawValue(value, offset, length, output, usedLength);
+  *output = value;
+  return RESULT_OK;
 }
 
 
@@ -1175,7 +1374,9 @@ bool DataTypeList::s_contrib_initialized = libebus_contrib_register();
 #endif
 
 
-DataTypeList::DataTypeList() {
+DataTypeList::DataTypeList() : m_builtinCount(0), m_hasOtherLengthTypes(false) {
+  memset(m_builtinKeys, 0, sizeof(m_builtinKeys));
+  memset(m_builtinTypes, 0, sizeof(m_builtinTypes));
   add(new StringDataType("STR", MAX_LEN*8, ADJ, ' '));  // >= 1 byte character string filled up with space
   // unsigned decimal in BCD, 0000 - 9999 (fixed length)
   add(new NumberDataType("PIN", 16, FIX|BCD|REV, 0xffff, 0, 0x9999, 1));
@@ -1284,6 +1485,34 @@ DataTypeList::DataTypeList() {
   add(new NumberDataType("BI5", 3, ADJ|REQ, 0, 5, 1));  // bit 5 (up to 3 bits until bit 7)
   add(new NumberDataType("BI6", 2, ADJ|REQ, 0, 6, 1));  // bit 6 (up to 2 bits until bit 7)
   add(new NumberDataType("BI7", 1, REQ, 0, 7, 1));  // bit 7
+  indexBuiltins();
+}
+
+void DataTypeList::indexBuiltins() {
+  for (const auto& it : m_typesById) {
+    const string& id = it.first;
+    size_t length = 0;
+    if (id.length() == 5 && id[3] == LENGTH_SEPARATOR && id[4] >= '1' && id[4] <= '9') {
+      length = static_cast<size_t>(id[4]-'0');
+    } else if (id.length() != 3) {
+      if (id.find(LENGTH_SEPARATOR) != string::npos) {
+        m_hasOtherLengthTypes = true;
+      }
+      continue;
+    }
+    uint32_t key = getBuiltinKey(id[0], id[1], id[2], length);
+    size_t slot = getBuiltinSlot(key);
+    if (m_builtinKeys[slot] != 0) {
+      // collision: only found via m_typesById
+      if (length > 0) {
+        m_hasOtherLengthTypes = true;
+      }
+      continue;
+    }
+    m_builtinKeys[slot] = key;
+    m_builtinTypes[slot] = it.second;
+    m_builtinCount++;
+  }
 }
 
 DataTypeList* DataTypeList::getInstance() {
@@ -1321,34 +1550,61 @@ void DataTypeList::clear() {
   }
   m_cleanupTypes.clear();
   m_typesById.clear();
+  memset(m_builtinKeys, 0, sizeof(m_builtinKeys));
+  memset(m_builtinTypes, 0, sizeof(m_builtinTypes));
+  m_builtinCount = 0;
+  m_hasOtherLengthTypes = false;
 }
 
 result_t DataTypeList::add(const DataType* dataType) {
+  m_mutex.lock();
   if (m_typesById.find(dataType->getId()) != m_typesById.end()) {
+    m_mutex.unlock();
     return RESULT_ERR_DUPLICATE_NAME;  // duplicate key
   }
   m_typesById[dataType->getId()] = dataType;
+  if (m_builtinCount > 0 && dataType->getId().find(LENGTH_SEPARATOR) != string::npos) {
+    m_hasOtherLengthTypes = true;
+  }
   m_cleanupTypes.push_back(dataType);
+  m_mutex.unlock();
   return RESULT_OK;
 }
 
+void DataTypeList::addCleanup(const DataType* dataType) {
+  m_mutex.lock();
+  m_cleanupTypes.push_back(dataType);
+  m_mutex.unlock();
+}
+
 const DataType* DataTypeList::get(const string& id, size_t length) const {
+  const DataType* dataType;
   if (length > 0) {
-    ostringstream str;
-    str << id << LENGTH_SEPARATOR << static_cast<unsigned>(length);
-    auto it = m_typesById.find(str.str());
-    if (it != m_typesById.end()) {
-      return it->second;
+    dataType = getBuiltin(id, length);
+    if (dataType) {
+      return dataType;
+    }
+    if (m_hasOtherLengthTypes) {
+      ostringstream str;
+      str << id << LENGTH_SEPARATOR << static_cast<unsigned>(length);
+      auto it = m_typesById.find(str.str());
+      if (it != m_typesById.end()) {
+        return it->second;
+      }
     }
   }
-  auto it = m_typesById.find(id);
-  if (it == m_typesById.end()) {
-    return nullptr;
+  dataType = getBuiltin(id, 0);
+  if (!dataType) {
+    auto it = m_typesById.find(id);
+    if (it == m_typesById.end()) {
+      return nullptr;
+    }
+    dataType = it->second;
   }
-  if (length > 0 && !it->second->isAdjustableLength()) {
+  if (length > 0 && !dataType->isAdjustableLength()) {
     return nullptr;
   }
-  return it->second;
+  return dataType;
 }
 
 }  // namespace ebusd
@@ -57,6 +57,15 @@ using std::ostringstream;
 /** the separator character used between base type name and length (in CSV only). */
 #define LENGTH_SEPARATOR ':'
 
+/** the number of bits for the slot in the perfect hash table of built-in @a DataType IDs. */
+#define BUILTIN_TYPE_BITS 8
+
+/** the number of slots in the perfect hash table of built-in @a DataType IDs. */
+#define BUILTIN_TYPE_SLOTS (1 << BUILTIN_TYPE_BITS)
+
+/** the multiplier of the perfect hash of built-in @a DataType IDs (found to not produce collisions). */
+#define BUILTIN_TYPE_SEED 0x513a13
+
 /** the replacement string for undefined values (in UI and CSV). */
 #define NULL_VALUE "-"
 
@@ -110,6 +119,9 @@ enum OutputFormat : OutputFormatBaseType {
 
   /** bit flag for @a OutputFormat: include message/field definition. */
   OF_DEFINITION = 1 << 8,
+
+  /** bit flag for @a OutputFormat: binary CBOR format (RFC 8949) of the field values only. */
+  OF_CBOR = 1 << 9,
 };
 
 constexpr inline enum OutputFormat operator| (enum OutputFormat self, enum OutputFormat other) {
@@ -199,6 +211,59 @@ float uintToFloat(unsigned int value, bool negative);
  */
 uint32_t floatToUint(float val);
 
+/** the CBOR major type for an unsigned integer. */
+#define CBOR_UNSIGNED 0
+
+/** the CBOR major type for a negative integer. */
+#define CBOR_NEGATIVE 1
+
+/** the CBOR major type for a text string. */
+#define CBOR_TEXT 3
+
+/** the CBOR major type for an array. */
+#define CBOR_ARRAY 4
+
+/** the CBOR major type for a map. */
+#define CBOR_MAP 5
+
+/** the CBOR initial byte for a null value. */
+#define CBOR_NULL 0xf6
+
+/** the CBOR initial byte for a map of indefinite length (terminated by @a CBOR_BREAK). */
+#define CBOR_MAP_INDEFINITE 0xbf
+
+/** the CBOR initial byte terminating an item of indefinite length. */
+#define CBOR_BREAK 0xff
+
+/**
+ * Append the head of a CBOR data item using the shortest possible encoding of the argument.
+ * @param majorType the CBOR major type (e.g. @a CBOR_MAP).
+ * @param argument the argument (e.g. the unsigned integer value, or the length of a string, array, or map).
+ * @param output the @a ostream to append to.
+ */
+void appendCborHead(uint8_t majorType, uint64_t argument, ostream* output);
+
+/**
+ * Append a signed integer as CBOR data item.
+ * @param value the integer value.
+ * @param output the @a ostream to append to.
+ */
+void appendCborInt(int64_t value, ostream* output);
+
+/**
+ * Append a float value as CBOR single precision data item.
+ * @param value the float value.
+ * @param output the @a ostream to append to.
+ */
+void appendCborFloat(float value, ostream* output);
+
+/**
+ * Append a text string as CBOR data item.
+ * @param value the string (expected to be UTF-8).
+ * @param output the @a ostream to append to.
+ */
+void appendCborText(const string& value, ostream* output);
+
 /**
  * Base class for all kinds of data types.
  */
@@ -433,6 +498,28 @@ class DateTimeDataType : public DataType {
 };
 
 
+class NumberDataType;
+
+/**
+ * Function specialized for reading the numeric raw value of a @a NumberDataType with a fixed length.
+ * @param type the @a NumberDataType.
+ * @param offset the offset in the @a SymbolString.
+ * @param input the unescaped @a SymbolString to read the binary value from.
+ * @param value the variable in which to store the numeric raw value.
+ * @return @a RESULT_OK on success, or an error code.
+ */
+typedef result_t (*RawValueReader)(const NumberDataType* type, size_t offset, const SymbolString& input,
+    unsigned int* value);
+
+/**
+ * Function specialized for writing the numeric raw value of a @a NumberDataType with a fixed length.
+ * @param type the @a NumberDataType.
+ * @param value the numeric raw value to write.
+ * @param offset the offset in the @a SymbolString.
+ * @param output the unescaped @a SymbolString to write the binary value to.
+ */
+typedef void (*RawValueWriter)(const NumberDataType* type, unsigned int value, size_t offset, SymbolString* output);
+
 /**
  * A number based @a DataType.
  */
@@ -556,6 +643,20 @@ class NumberDataType : public DataType {
    */
   result_t getFloatFromRawValue(unsigned int value, float* output) const;
 
+  /**
+   * Convert the numeric raw value to its signed integer representation (only without divisor and exponent).
+   * @param value the numeric raw value.
+   * @param output the integer variable to write the value to.
+   * @return @a RESULT_OK on success, @a RESULT_EMPTY for the replacement value,
+   * @a RESULT_ERR_INVALID_NUM if the value is not an integer, or an error code.
+   */
+  result_t getIntFromRawValue(unsigned int value, int64_t* output) const;
+
+  /**
+   * @return true if the value is a floating point value (i.e. having an exponent or a divisor).
+   */
+  bool isFloat() const { return hasFlag(EXP) || m_divisor < 0 || m_divisor > 1; }
+
   /**
    * Convert the float value to the numeric raw value (including optional divisor).
    * @param value the float value.
@@ -587,12 +688,45 @@ class NumberDataType : public DataType {
   result_t writeRawValue(unsigned int value, size_t offset, size_t length,
       SymbolString* output, size_t* usedLength) const;
 
+  /**
+   * Get the function specialized for reading the raw value with the specified length (i.e. with the flags resolved at
+   * compile time), available for byte aligned binary values of up to 4 bytes and for single byte BCD values.
+   * Note: derived classes overriding @a readSymbols() or @a writeSymbols() have to return nullptr.
+   * @param length the number of symbols to read.
+   * @return the @a RawValueReader behaving exactly like @a readRawValue(), or nullptr if not available.
+   */
+  virtual RawValueReader getRawValueReader(size_t length) const;
+
+  /**
+   * Get the function specialized for writing the raw value with the specified length (see @a getRawValueReader()).
+   * @param length the number of symbols to write.
+   * @return the @a RawValueWriter behaving exactly like @a writeRawValue(), or nullptr if not available.
+   */
+  virtual RawValueWriter getRawValueWriter(size_t length) const;
+
   // @copydoc
   result_t writeSymbols(size_t offset, size_t length, istringstream* input,
       SymbolString* output, size_t* usedLength) const override;
 
+  /**
+   * Internal method for parsing the formatted value to the numeric raw value (see @a writeSymbols()).
+   * @param length the number of symbols to write, or @a REMAIN_LEN.
+   * @param input the @a istringstream to parse the formatted value from.
+   * @param output the variable in which to store the numeric raw value.
+   * @return @a RESULT_OK on success, or an error code.
+   */
+  result_t parseRawValue(size_t length, istringstream* input, unsigned int* output) const;
+
 
  private:
+  /**
+   * Check the numeric raw value against the replacement value and the value range.
+   * @param value the numeric raw value.
+   * @param negative the variable in which to store whether the value is a negative signed value.
+   * @return @a RESULT_OK on success, @a RESULT_EMPTY for the replacement value, or an error code.
+   */
+  result_t checkRawValue(unsigned int value, bool* negative) const;
+
   /** the minimum raw value. */
   const unsigned int m_minValue;
 
@@ -661,7 +795,7 @@ class DataTypeList {
    * Adds a @a DataType instance for later cleanup.
    * @param dataType the @a DataType instance to add.
    */
-  void addCleanup(const DataType* dataType) { m_cleanupTypes.push_back(dataType); }
+  void addCleanup(const DataType* dataType);
 
   /**
    * Gets the @a DataType instance with the specified ID.
@@ -672,6 +806,11 @@ class DataTypeList {
    */
   const DataType* get(const string& id, size_t length = 0) const;
 
+  /**
+   * @return the number of built-in @a DataType instances found with a single probe of the perfect hash table.
+   */
+  size_t getBuiltinCount() const { return m_builtinCount; }
+
   /**
    * Returns an iterator pointing to the first ID/@a DataType pair.
    * @return an iterator pointing to the first ID/@a DataType pair.
@@ -685,13 +824,71 @@ class DataTypeList {
   map<string, const DataType*>::const_iterator end() const { return m_typesById.cend(); }
 
  private:
+  /**
+   * Build the key of a built-in @a DataType ID for the perfect hash table.
+   * @param c0 the first character of the ID.
+   * @param c1 the second character of the ID.
+   * @param c2 the third character of the ID.
+   * @param length the length suffix (at most 0xff), or 0 for none.
+   * @return the key (never 0).
+   */
+  static constexpr uint32_t getBuiltinKey(char c0, char c1, char c2, size_t length) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(c0)) | static_cast<uint32_t>(static_cast<uint8_t>(c1)) << 8
+      | static_cast<uint32_t>(static_cast<uint8_t>(c2)) << 16 | static_cast<uint32_t>(length) << 24;
+  }
+
+  /**
+   * Calculate the slot of a key in the perfect hash table.
+   * @param key the key built with @a getBuiltinKey().
+   * @return the slot.
+   */
+  static constexpr size_t getBuiltinSlot(uint32_t key) {
+    return static_cast<size_t>(static_cast<uint32_t>(key * BUILTIN_TYPE_SEED) >> (32 - BUILTIN_TYPE_BITS));
+  }
+
+  /**
+   * Gets the built-in @a DataType instance with the specified ID from the perfect hash table.
+   * @param id the ID string (excluding optional length suffix).
+   * @param length the length suffix, or 0 for none.
+   * @return the @a DataType instance, or nullptr if not a built-in type.
+   */
+  const DataType* getBuiltin(const string& id, size_t length) const {
+    if (id.length() != 3 || length > 0xff) {
+      return nullptr;
+    }
+    uint32_t key = getBuiltinKey(id[0], id[1], id[2], length);
+    size_t slot = getBuiltinSlot(key);
+    return m_builtinKeys[slot] == key ? m_builtinTypes[slot] : nullptr;
+  }
+
+  /**
+   * Put all currently known @a DataType instances with an ID matching the built-in scheme into the perfect hash
+   * table.
+   */
+  void indexBuiltins();
+
   /** the known @a DataType instances by ID (e.g. "ID:BITS" or just "ID").
    * Note: adjustable length types are stored by ID only. */
   map<string, const DataType*> m_typesById;
 
+  /** the keys of the built-in @a DataType instances by slot (0 for an empty slot). */
+  uint32_t m_builtinKeys[BUILTIN_TYPE_SLOTS];
+
+  /** the built-in @a DataType instances by slot. */
+  const DataType* m_builtinTypes[BUILTIN_TYPE_SLOTS];
+
+  /** the number of built-in @a DataType instances in the perfect hash table. */
+  size_t m_builtinCount;
+
+  /** whether a @a DataType with length suffix was added that is not in the perfect hash table. */
+  bool m_hasOtherLengthTypes;
+
   /** the @a DataType instances to cleanup. */
   list<const DataType*> m_cleanupTypes;
 
+  /** the @a Mutex for modifying access (types may be derived while reading files in parallel). */
+  Mutex m_mutex;
+
   /** the singleton instance. */
   static DataTypeList s_instance;
 
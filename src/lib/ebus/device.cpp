@@ -42,6 +42,7 @@
 #include <iomanip>
 #include "lib/ebus/data.h"
 #include "lib/utils/clock.h"
+#include "lib/utils/metrics.h"
 #include "lib/utils/tcpsocket.h"
 
 namespace ebusd {
@@ -80,6 +81,40 @@ Device::Device(const char* name, bool readOnly, bool initialSend)
 }
 
 Device* Device::create(const char* name, unsigned int extraLatency, bool checkDevice, bool readOnly, bool initialSend) {
+  if (strncmp(name, "replay:", 7) == 0) {
+    // support replay:[<factor>:]<file>
+    const char* file = name+7;
+    double speed = 1;
+    const char* sep = strchr(file, ':');
+    if (sep) {
+      char* end = nullptr;
+      speed = strtod(file, &end);
+      if (end != sep || speed < 0) {
+        return nullptr;  // invalid speed factor
+      }
+      file = sep+1;
+    }
+    if (!*file) {
+      return nullptr;  // missing file name
+    }
+    return new ReplayDevice(name, file, speed);
+  }
+  if (strncmp(name, "sim:", 4) == 0) {
+    // support sim:[<key>=<value>[,<key>=<value>]*:]<file>
+    const char* file = name+4;
+    simOptions_t options = {0, 0, 0, 0, 10};
+    const char* sep = strchr(file, ':');
+    if (sep) {
+      if (!SimulationDevice::parseOptions(string(file, sep-file), &options)) {
+        return nullptr;  // invalid option
+      }
+      file = sep+1;
+    }
+    if (!*file) {
+      return nullptr;  // missing file name
+    }
+    return new SimulationDevice(name, file, options, readOnly);
+  }
   bool highSpeed = strncmp(name, "ens:", 4) == 0;
   bool enhanced = highSpeed || strncmp(name, "enh:", 4) == 0;
   if (enhanced) {
@@ -137,7 +172,8 @@ FileDevice::FileDevice(const char* name, bool checkDevice, unsigned int latency,
     m_enhancedProto(enhancedProto), m_fd(-1), m_resetRequested(false),
     m_arbitrationMaster(SYN),
     m_arbitrationCheck(0), m_bufSize(((MAX_LEN+1+3)/4)*4), m_bufLen(0), m_bufPos(0),
-    m_extraFatures(0), m_infoId(0xff), m_infoReqTime(0), m_infoLen(0), m_infoPos(0) {
+    m_extraFatures(0), m_infoId(0xff), m_infoReqTime(0), m_infoLen(0), m_infoPos(0),
+    m_sentTime({0, 0}), m_latencySamples(0), m_latencySmoothed(0), m_latencyVariance(0) {
   m_buffer = reinterpret_cast<symbol_t*>(malloc(m_bufSize));
   if (!m_buffer) {
     m_bufSize = 0;
@@ -175,6 +211,13 @@ void FileDevice::formatInfo(ostringstream* ostream, bool verbose, bool asJson, b
   if (!isValid()) {
     *ostream << ", invalid";
   }
+  unsigned int smoothed, variance;
+  unsigned int estimate = getLatencyEstimate(&smoothed, &variance);
+  if (estimate > 0) {
+    *ostream << ", latency " << estimate << " ms (round-trip " << (smoothed/1000) << "." << ((smoothed/100)%10)
+             << " +/- " << (variance/1000) << "." << ((variance/100)%10) << " ms), timeout extended by "
+             << getLatency() << " ms";
+  }
   bool infoAdded = false;
   if (verbose) {
     info = getEnhancedInfos();
@@ -193,6 +236,9 @@ void FileDevice::formatInfo(ostringstream* ostream, bool verbose, bool asJson, b
 
 result_t FileDevice::open() {
   close();
+  m_sentTime.tv_sec = 0;
+  m_latencySamples = 0;
+  m_latencySmoothed = m_latencyVariance = 0;
   return m_bufSize == 0 ? RESULT_ERR_DEVICE : RESULT_OK;
 }
 
@@ -335,12 +381,81 @@ result_t FileDevice::send(symbol_t value) {
   if (m_readOnly || !write(value)) {
     return RESULT_ERR_SEND;
   }
+  clockGettime(&m_sentTime);
   if (m_listener != nullptr) {
     m_listener->notifyDeviceData(value, false);
   }
   return RESULT_OK;
 }
 
+result_t FileDevice::sendBurst(const symbol_t* values, size_t count) {
+  if (!isValid()) {
+    return RESULT_ERR_DEVICE;
+  }
+  if (m_readOnly || !m_enhancedProto || count == 0 || count > MAX_BURST_LEN) {
+    return RESULT_ERR_SEND;
+  }
+  symbol_t buf[2*MAX_BURST_LEN];
+  for (size_t pos = 0; pos < count; pos++) {
+    symbol_t seq[2] = makeEnhancedSequence(ENH_REQ_SEND, values[pos]);
+    buf[2*pos] = seq[0];
+    buf[2*pos+1] = seq[1];
+  }
+#ifdef DEBUG_RAW_TRAFFIC
+  fprintf(stdout, "raw enhanced > %d symbols\n", static_cast<int>(count));
+  fflush(stdout);
+#endif
+  if (::write(m_fd, buf, 2*count) != static_cast<ssize_t>(2*count)) {
+    return RESULT_ERR_SEND;
+  }
+  clockGettime(&m_sentTime);
+  if (m_listener != nullptr) {
+    for (size_t pos = 0; pos < count; pos++) {
+      m_listener->notifyDeviceData(values[pos], false);
+    }
+  }
+  return RESULT_OK;
+}
+
+void FileDevice::updateLatencyEstimate() {
+  if (m_sentTime.tv_sec == 0) {
+    return;  // nothing sent
+  }
+  struct timespec now;
+  clockGettime(&now);
+  int64_t micros = (now.tv_sec-m_sentTime.tv_sec)*1000000 + (now.tv_nsec-m_sentTime.tv_nsec)/1000;
+  m_sentTime.tv_sec = 0;
+  if (micros < 0 || micros > 1000000) {
+    return;  // clock skew or out of reasonable range
+  }
+  if (m_latencySamples == 0) {
+    m_latencySmoothed = micros;
+    m_latencyVariance = micros/2;
+  } else {
+    // same as TCP RTO calculation (RFC 6298): alpha=1/8, beta=1/4
+    int64_t diff = m_latencySmoothed > micros ? m_latencySmoothed-micros : micros-m_latencySmoothed;
+    m_latencyVariance += (diff-m_latencyVariance)/4;
+    m_latencySmoothed += (micros-m_latencySmoothed)/8;
+  }
+  if (m_latencySamples < LATENCY_MIN_SAMPLES) {
+    m_latencySamples++;
+  }
+}
+
+unsigned int FileDevice::getLatencyEstimate(unsigned int* smoothed, unsigned int* variance) const {
+  if (m_latencySamples < LATENCY_MIN_SAMPLES) {
+    return 0;
+  }
+  if (smoothed) {
+    *smoothed = static_cast<unsigned int>(m_latencySmoothed);
+  }
+  if (variance) {
+    *variance = static_cast<unsigned int>(m_latencyVariance);
+  }
+  int64_t estimate = (m_latencySmoothed+4*m_latencyVariance+999)/1000;
+  return static_cast<unsigned int>(estimate < 1 ? 1 : estimate);
+}
+
 /**
  * the maximum duration in milliseconds to wait for an enhanced sequence to complete after the first part was already
  * retrieved (3ms rounded up to the next 10ms): 2* (Start+8Bit+Stop+Extra @ 9600Bd)
@@ -374,7 +489,7 @@ result_t FileDevice::recv(unsigned int timeout, symbol_t* value, ArbitrationStat
     return RESULT_ERR_DEVICE;
   }
   bool repeated = false;
-  timeout += m_latency;
+  timeout += getLatency();
   uint64_t until = clockGetMillis() + timeout;
   do {
     bool isAvailable = available();
@@ -423,6 +538,7 @@ result_t FileDevice::recv(unsigned int timeout, symbol_t* value, ArbitrationStat
         return RESULT_ERR_DEVICE;
       }
       if (ret == 0) {
+        updateLatencyEstimate();  // the elapsed time is a lower bound for the actual latency
         return RESULT_ERR_TIMEOUT;
       }
     }
@@ -435,15 +551,17 @@ result_t FileDevice::recv(unsigned int timeout, symbol_t* value, ArbitrationStat
     if (!isAvailable && incomplete && !repeated) {
       // for a two-byte transfer another poll is needed
       repeated = true;
-      timeout = m_latency+ENHANCED_COMPLETE_WAIT_DURATION;
+      timeout = getLatency()+ENHANCED_COMPLETE_WAIT_DURATION;
       continue;
     }
     uint64_t now = clockGetMillis();
     if (now >= until) {
+      updateLatencyEstimate();
       return RESULT_ERR_TIMEOUT;
     }
     timeout = static_cast<unsigned>(until - now);
   } while (true);
+  updateLatencyEstimate();
   if (m_enhancedProto || *value != SYN || m_arbitrationMaster == SYN || m_arbitrationCheck) {
     if (m_listener != nullptr) {
       m_listener->notifyDeviceData(*value, true);
@@ -1016,6 +1134,19 @@ result_t NetworkDevice::open() {
   return afterOpen();
 }
 
+unsigned int NetworkDevice::getLatency() const {
+  unsigned int estimate = getLatencyEstimate();
+  if (estimate == 0) {
+    return m_latency;
+  }
+  if (estimate < HOST_LATENCY_MS) {
+    estimate = HOST_LATENCY_MS;
+  } else if (estimate > MAX_NETWORK_LATENCY_MS) {
+    estimate = MAX_NETWORK_LATENCY_MS;
+  }
+  return estimate+m_extraLatency;
+}
+
 void NetworkDevice::checkDevice() {
   int cnt;
   if (ioctl(m_fd, FIONREAD, &cnt) < 0) {
@@ -1023,4 +1154,432 @@ void NetworkDevice::checkDevice() {
   }
 }
 
+
+
+void ReplayDevice::formatInfo(ostringstream* ostream, bool verbose, bool asJson, bool noWait) {
+  if (asJson) {
+    return;
+  }
+  *ostream << m_name << ", readonly";
+  if (noWait) {
+    return;
+  }
+  if (!isValid()) {
+    *ostream << ", invalid";
+  }
+  *ostream << ", " << (m_finished ? "finished" : "replayed") << " " << m_symbols << " symbols";
+}
+
+result_t ReplayDevice::open() {
+  close();
+  m_stream.open(m_file.c_str(), ifstream::in | ifstream::binary);
+  if (!m_stream.is_open()) {
+    return RESULT_ERR_NOTFOUND;
+  }
+  m_bufLen = m_bufPos = 0;
+  m_symbols = m_telegrams = 0;
+  m_lastSymbol = SYN;
+  m_startTime = 0;
+  m_finished = false;
+  return RESULT_OK;
+}
+
+void ReplayDevice::close() {
+  if (m_stream.is_open()) {
+    m_stream.close();
+  }
+}
+
+result_t ReplayDevice::recv(unsigned int timeout, symbol_t* value, ArbitrationState* arbitrationState) {
+  *arbitrationState = as_none;
+  if (!isValid()) {
+    return RESULT_ERR_DEVICE;
+  }
+  struct timespec now;
+  clockGettime(&now);
+  uint64_t nowMicros = static_cast<uint64_t>(now.tv_sec)*1000000 + static_cast<uint64_t>(now.tv_nsec/1000);
+  if (m_startTime == 0) {
+    m_startTime = nowMicros;
+    Metrics* metrics = Metrics::getInstance();
+    m_startDecoded = metrics->getCounterValue("ebusd_bus_decoded_telegrams_total");
+    m_startPublished = metrics->getCounterValue("ebusd_mqtt_published_total");
+  }
+  if (m_bufPos >= m_bufLen && !m_finished) {
+    m_stream.read(reinterpret_cast<char*>(m_buffer), sizeof(m_buffer));
+    m_bufLen = static_cast<size_t>(m_stream.gcount());
+    m_bufPos = 0;
+    if (m_bufLen == 0) {
+      m_finished = true;
+      notifyFinished();
+    }
+  }
+  if (m_finished) {
+    usleep(timeout*1000);
+    return RESULT_ERR_TIMEOUT;
+  }
+  if (m_speed > 0) {
+    // keep the pace of the real bus multiplied by the speed factor
+    uint64_t due = m_startTime + static_cast<uint64_t>(static_cast<double>(m_symbols)*NOMINAL_SYMBOL_MICROS/m_speed);
+    if (due > nowMicros) {
+      uint64_t wait = due-nowMicros;
+      if (wait > timeout*1000ULL) {
+        usleep(timeout*1000);
+        return RESULT_ERR_TIMEOUT;
+      }
+      usleep(static_cast<useconds_t>(wait));
+    }
+  }
+  symbol_t symbol = m_buffer[m_bufPos++];
+  m_symbols++;
+  if (m_lastSymbol == SYN && symbol != SYN) {
+    m_telegrams++;
+  }
+  m_lastSymbol = symbol;
+  *value = symbol;
+  if (m_listener != nullptr) {
+    m_listener->notifyDeviceData(symbol, true);
+  }
+  return RESULT_OK;
+}
+
+void ReplayDevice::notifyFinished() {
+  if (m_listener == nullptr) {
+    return;
+  }
+  struct timespec now;
+  clockGettime(&now);
+  uint64_t nowMicros = static_cast<uint64_t>(now.tv_sec)*1000000 + static_cast<uint64_t>(now.tv_nsec/1000);
+  double secs = static_cast<double>(nowMicros-m_startTime)/1000000;
+  if (secs <= 0) {
+    secs = 0.000001;
+  }
+  Metrics* metrics = Metrics::getInstance();
+  uint64_t decoded = metrics->getCounterValue("ebusd_bus_decoded_telegrams_total")-m_startDecoded;
+  uint64_t published = metrics->getCounterValue("ebusd_mqtt_published_total")-m_startPublished;
+  ostringstream str;
+  str << "replay finished in " << std::fixed << std::setprecision(3) << secs << " s: "
+      << m_symbols << " symbols (" << std::setprecision(0) << static_cast<double>(m_symbols)/secs << "/s), "
+      << m_telegrams << " telegrams (" << static_cast<double>(m_telegrams)/secs << "/s), "
+      << decoded << " decoded (" << static_cast<double>(decoded)/secs << "/s), "
+      << published << " published (" << static_cast<double>(published)/secs << "/s)";
+  m_listener->notifyStatus(false, str.str().c_str());
+}
+
+
+
+bool SimulationDevice::parseOptions(const string& str, simOptions_t* options) {
+  istringstream stream(str);
+  string token;
+  while (getline(stream, token, ',')) {
+    size_t pos = token.find('=');
+    if (pos == string::npos) {
+      return false;
+    }
+    string key = token.substr(0, pos);
+    result_t result = RESULT_OK;
+    if (key == "latency") {
+      options->latency = parseInt(token.substr(pos+1).c_str(), 10, 0, 1000, &result);
+    } else if (key == "collision") {
+      options->collision = parseInt(token.substr(pos+1).c_str(), 10, 0, 100, &result);
+    } else if (key == "nak") {
+      options->nak = parseInt(token.substr(pos+1).c_str(), 10, 0, 100, &result);
+    } else if (key == "traffic") {
+      options->traffic = parseInt(token.substr(pos+1).c_str(), 10, 0, 100, &result);
+    } else if (key == "syn") {
+      options->syn = parseInt(token.substr(pos+1).c_str(), 10, 1, 1000, &result);
+    } else {
+      return false;
+    }
+    if (result != RESULT_OK) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SimulationDevice::formatInfo(ostringstream* ostream, bool verbose, bool asJson, bool noWait) {
+  if (asJson) {
+    return;
+  }
+  *ostream << m_name;
+  if (isReadOnly()) {
+    *ostream << ", readonly";
+  }
+  if (noWait) {
+    return;
+  }
+  if (!isValid()) {
+    *ostream << ", invalid";
+    return;
+  }
+  *ostream << ", " << m_masters.size() << " definitions, " << m_answered << " answered, " << m_naks << " NAKs, "
+           << m_collisions << " collisions, " << m_foreign << " foreign";
+}
+
+result_t SimulationDevice::open() {
+  close();
+  ifstream stream(m_file.c_str(), ifstream::in);
+  if (!stream.is_open()) {
+    return RESULT_ERR_NOTFOUND;
+  }
+  m_masters.clear();
+  m_slaves.clear();
+  m_answers.clear();
+  m_addresses.clear();
+  string line;
+  while (getline(stream, line)) {
+    size_t pos = line.find_first_not_of(" \t\r");
+    if (pos == string::npos || line[pos] == '#') {
+      continue;
+    }
+    size_t end = line.find_last_not_of(" \t\r");
+    line = line.substr(pos, end+1-pos);
+    pos = line.find('/');
+    MasterSymbolString master;
+    SlaveSymbolString slave;
+    result_t result = master.parseHex(line.substr(0, pos));
+    if (result == RESULT_OK && pos != string::npos && pos+1 < line.size()) {
+      result = slave.parseHex(line.substr(pos+1));
+    }
+    if (result == RESULT_OK && (!master.isComplete() || master.size() != 5+master.getDataSize()
+        || !isValidAddress(master[1]) || (slave.size() > 0 && (master[1] == BROADCAST || isMaster(master[1])
+        || !slave.isComplete() || slave.size() != 1+slave.getDataSize())))) {
+      result = RESULT_ERR_INVALID_ARG;
+    }
+    if (result != RESULT_OK) {
+      if (m_listener != nullptr) {
+        m_listener->notifyStatus(true, ("invalid simulation definition " + line).c_str());
+      }
+      return result;
+    }
+    m_answers[master.getStr(1)] = m_masters.size();
+    m_addresses[master[1]] = true;
+    m_masters.push_back(master);
+    m_slaves.push_back(slave);
+  }
+  if (m_masters.empty()) {
+    return RESULT_ERR_NOTFOUND;
+  }
+  m_pending.clear();
+  m_arbitrationMaster = SYN;
+  m_arbitrationCheck = false;
+  m_state = ss_idle;
+  m_nextSyn = 0;
+  m_valid = true;
+  return RESULT_OK;
+}
+
+bool SimulationDevice::chance(unsigned int percent) {
+  return percent > 0 && static_cast<unsigned int>(rand_r(&m_seed)%100) < percent;
+}
+
+void SimulationDevice::addPending(symbol_t symbol, bool escape, uint64_t due) {
+  if (escape && (symbol == ESC || symbol == SYN)) {
+    m_pending.push_back({ESC, due});
+    symbol = symbol == ESC ? 0x00 : 0x01;
+  }
+  m_pending.push_back({symbol, due});
+}
+
+void SimulationDevice::addSlave(const SlaveSymbolString& slave, uint64_t due) {
+  for (size_t pos = 0; pos < slave.size(); pos++) {
+    addPending(slave[pos], true, due);
+  }
+  addPending(slave.calcCrc(), true, due);
+}
+
+void SimulationDevice::addForeign(size_t index, symbol_t master, bool skipMaster, uint64_t due) {
+  MasterSymbolString str = m_masters[index];
+  str[0] = master;
+  for (size_t pos = skipMaster ? 1 : 0; pos < str.size(); pos++) {
+    addPending(str[pos], true, due);
+  }
+  addPending(str.calcCrc(), true, due);
+  symbol_t dest = str[1];
+  if (dest != BROADCAST) {
+    addPending(ACK, false, due+m_options.latency);
+    if (!isMaster(dest)) {
+      addSlave(m_slaves[index], due+m_options.latency);
+      addPending(ACK, false, due+m_options.latency);
+    }
+  }
+  addPending(SYN, false, due+m_options.latency);
+  m_foreign++;
+}
+
+void SimulationDevice::handleMaster(symbol_t crc, uint64_t now) {
+  m_state = ss_idle;
+  symbol_t dest = m_master[1];
+  if (dest == BROADCAST || m_addresses.find(dest) == m_addresses.end()) {
+    return;  // no answer expected or unknown destination
+  }
+  size_t index = 0;
+  if (!isMaster(dest)) {
+    const auto it = m_answers.find(m_master.getStr(1));
+    if (it == m_answers.end()) {
+      return;  // unknown request: let it time out
+    }
+    index = it->second;
+  }
+  uint64_t due = now+m_options.latency;
+  if (crc != m_master.calcCrc() || chance(m_options.nak)) {
+    addPending(NAK, false, due);
+    m_naks++;
+    m_master.clear();
+    m_state = ss_master;  // the complete master part is repeated once
+    return;
+  }
+  addPending(ACK, false, due);
+  if (isMaster(dest)) {
+    m_answered++;
+    return;
+  }
+  m_answerIndex = index;
+  addSlave(m_slaves[m_answerIndex], due);
+  m_state = ss_masterAck;
+}
+
+result_t SimulationDevice::send(symbol_t value) {
+  if (!isValid()) {
+    return RESULT_ERR_DEVICE;
+  }
+  if (m_readOnly) {
+    return RESULT_ERR_SEND;
+  }
+  if (m_listener != nullptr) {
+    m_listener->notifyDeviceData(value, false);
+  }
+  uint64_t now = clockGetMillis();
+  addPending(value, false, now);  // echo of the sent symbol
+  if (value == SYN) {
+    m_state = ss_idle;
+    m_escape = false;
+    return RESULT_OK;
+  }
+  if (m_state == ss_masterAck) {
+    if (value == ACK) {
+      m_answered++;
+      m_state = ss_idle;
+    } else {
+      addSlave(m_slaves[m_answerIndex], now+m_options.latency);  // repeat the slave part
+    }
+    return RESULT_OK;
+  }
+  if (m_state != ss_master) {
+    return RESULT_OK;
+  }
+  if (m_escape) {
+    m_escape = false;
+    value = value == 0x00 ? ESC : value == 0x01 ? SYN : value;
+  } else if (value == ESC) {
+    m_escape = true;
+    return RESULT_OK;
+  }
+  if (m_master.isComplete() && m_master.size() >= 5) {
+    handleMaster(value, now);
+  } else {
+    m_master.push_back(value);
+  }
+  return RESULT_OK;
+}
+
+result_t SimulationDevice::sendBurst(const symbol_t* values, size_t count) {
+  for (size_t pos = 0; pos < count; pos++) {
+    result_t result = send(values[pos]);
+    if (result != RESULT_OK) {
+      return result;
+    }
+  }
+  return RESULT_OK;
+}
+
+result_t SimulationDevice::recv(unsigned int timeout, symbol_t* value, ArbitrationState* arbitrationState) {
+  *arbitrationState = m_arbitrationMaster == SYN ? as_none : as_start;
+  if (!isValid()) {
+    m_arbitrationMaster = SYN;
+    m_arbitrationCheck = false;
+    return RESULT_ERR_DEVICE;
+  }
+  uint64_t now = clockGetMillis();
+  if (m_arbitrationCheck) {
+    m_arbitrationCheck = false;
+    symbol_t master = m_arbitrationMaster;
+    m_arbitrationMaster = SYN;
+    if (chance(m_options.collision)) {
+      // a foreign master with higher priority wins the arbitration
+      symbol_t winner = master == 0x00 ? 0x10 : 0x00;
+      *value = winner;
+      *arbitrationState = as_lost;
+      m_collisions++;
+      addForeign(static_cast<size_t>(rand_r(&m_seed))%m_masters.size(), winner, true, now);
+    } else {
+      *value = master;
+      *arbitrationState = as_won;
+      m_master.clear();
+      m_master.push_back(master);
+      m_escape = false;
+      m_state = ss_master;
+    }
+    if (m_listener != nullptr) {
+      m_listener->notifyDeviceData(*value, true);
+    }
+    m_nextSyn = now+m_options.syn;
+    return RESULT_OK;
+  }
+  bool generated = m_pending.empty();
+  uint64_t due = generated ? m_nextSyn : m_pending.front().due;
+  if (generated && m_state != ss_idle) {
+    due = now+timeout;  // waiting for the next symbol from ebusd
+  }
+  if (due > now) {
+    if (due-now > timeout) {
+      usleep(timeout*1000);
+      return RESULT_ERR_TIMEOUT;
+    }
+    usleep(static_cast<useconds_t>((due-now)*1000));
+    now = due;
+  }
+  if (generated) {
+    *value = SYN;
+  } else {
+    *value = m_pending.front().symbol;
+    m_pending.pop_front();
+  }
+  m_nextSyn = now+m_options.syn;
+  if (m_listener != nullptr) {
+    m_listener->notifyDeviceData(*value, true);
+  }
+  if (!generated) {
+    return RESULT_OK;
+  }
+  if (m_arbitrationMaster != SYN) {
+    // write the own master address right after the SYN
+    if (m_listener != nullptr) {
+      m_listener->notifyDeviceData(m_arbitrationMaster, false);
+    }
+    m_arbitrationCheck = true;
+    *arbitrationState = as_running;
+  } else if (chance(m_options.traffic)) {
+    size_t index = static_cast<size_t>(rand_r(&m_seed))%m_masters.size();
+    addForeign(index, m_masters[index][0], false, now+m_options.syn);
+  }
+  return RESULT_OK;
+}
+
+result_t SimulationDevice::startArbitration(symbol_t masterAddress) {
+  if (m_arbitrationCheck) {
+    if (masterAddress != SYN) {
+      return RESULT_ERR_ARB_RUNNING;  // should not occur
+    }
+    m_arbitrationCheck = false;
+    m_arbitrationMaster = SYN;
+    return RESULT_OK;
+  }
+  if (m_readOnly && masterAddress != SYN) {
+    return RESULT_ERR_SEND;
+  }
+  m_arbitrationMaster = masterAddress;
+  return RESULT_OK;
+}
+
 }  // namespace ebusd
@@ -27,11 +27,19 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <deque>
+#include <map>
+#include <vector>
 #include "lib/ebus/result.h"
 #include "lib/ebus/symbol.h"
 
 namespace ebusd {
 
+using std::ifstream;
+using std::deque;
+using std::map;
+using std::vector;
+
 /** @file lib/ebus/device.h
  * Classes providing access to the eBUS.
  *
@@ -39,14 +47,30 @@ namespace ebusd {
  * port or a remote @a NetworkDevice handled via a TCP socket. It allows to
  * send and receive bytes to/from the eBUS while optionally dumping the data
  * to a file and/or forwarding it to a logging function.
+ * A @a ReplayDevice feeds previously dumped raw data back to the listener
+ * for offline analysis and end-to-end throughput measurement.
+ * A @a SimulationDevice emulates a virtual bus with slaves answering from a
+ * definition file for load testing without any hardware.
  */
 
 /** the transfer latency of the network device [ms]. */
 #define NETWORK_LATENCY_MS 30
 
+/** the maximum adaptive transfer latency of the network device [ms]. */
+#define MAX_NETWORK_LATENCY_MS 250
+
+/** the number of latency samples required before the adaptive latency is used. */
+#define LATENCY_MIN_SAMPLES 8
+
+/** the maximum number of symbols sent at once via @a Device::sendBurst() (fully escaped master part with CRC). */
+#define MAX_BURST_LEN (2*(5+255+1))
+
 /** the extra transfer latency to take into account for enhanced protocol. */
 #define ENHANCED_LATENCY_MS 10
 
+/** the nominal duration of a single symbol on the bus at 2400 Baud (10 bits per symbol) [us]. */
+#define NOMINAL_SYMBOL_MICROS 4167
+
 /** the latency of the host [ms]. */
 #if defined(__CYGWIN__) || defined(_WIN32)
 #define HOST_LATENCY_MS 20
@@ -209,6 +233,20 @@ class Device {
    */
   virtual bool supportsUpdateCheck() const = 0;
 
+  /**
+   * Return whether the device supports sending several symbols at once via @a sendBurst().
+   * @return whether the device supports sending several symbols at once.
+   */
+  virtual bool supportsBurstSend() const { return false; }
+
+  /**
+   * Write several symbols at once to the device without waiting for the echo of each symbol in between.
+   * @param values the escaped symbols to send.
+   * @param count the number of symbols to send.
+   * @return the result_t code.
+   */
+  virtual result_t sendBurst(const symbol_t* values, size_t count) { return RESULT_ERR_SEND; }
+
  protected:
   /** the device name (e.g. "/dev/ttyUSB0" for serial, "127.0.0.1:1234" for network). */
   const char* m_name;
@@ -280,6 +318,14 @@ class FileDevice : public Device {
    */
   virtual unsigned int getLatency() const { return m_latency; }
 
+  /**
+   * Get the estimated transfer latency from the round-trip time of the sent symbols (smoothed like the TCP RTO).
+   * @param smoothed optional variable in which to store the smoothed round-trip time in microseconds.
+   * @param variance optional variable in which to store the round-trip time variance in microseconds.
+   * @return the estimated transfer latency in milliseconds, or 0 if not enough samples were gathered yet.
+   */
+  unsigned int getLatencyEstimate(unsigned int* smoothed = nullptr, unsigned int* variance = nullptr) const;
+
   /**
    * Return whether the device supports the ebusd enhanced protocol.
    * @return whether the device supports the ebusd enhanced protocol.
@@ -295,6 +341,12 @@ class FileDevice : public Device {
   // @copydoc
   bool supportsUpdateCheck() const override { return m_enhancedProto && m_extraFatures & 0x01; }
 
+  // @copydoc
+  bool supportsBurstSend() const override { return m_enhancedProto; }
+
+  // @copydoc
+  result_t sendBurst(const symbol_t* values, size_t count) override;
+
   /**
    * @return whether the device supports the ebusd enhanced protocol and supports querying extra infos.
    */
@@ -381,6 +433,11 @@ class FileDevice : public Device {
   bool m_resetRequested;
 
  private:
+  /**
+   * Update the latency estimate with the time elapsed since the last sent symbol (if any).
+   */
+  void updateLatencyEstimate();
+
   /**
    * Handle the already buffered enhanced data.
    * @param value the reference in which the read byte value is stored.
@@ -426,6 +483,18 @@ class FileDevice : public Device {
   /** the info buffer. */
   symbol_t m_infoBuf[16];
 
+  /** the time of the last sent symbol waiting for being received, or tv_sec 0. */
+  struct timespec m_sentTime;
+
+  /** the number of round-trip time samples. */
+  unsigned int m_latencySamples;
+
+  /** the smoothed round-trip time in microseconds. */
+  int64_t m_latencySmoothed;
+
+  /** the round-trip time variance in microseconds. */
+  int64_t m_latencyVariance;
+
   /** a string describing the enhanced device version. */
   string m_enhInfoVersion;
 
@@ -506,7 +575,7 @@ class NetworkDevice : public FileDevice {
   NetworkDevice(const char* name, const char* hostOrIp, uint16_t port, unsigned int extraLatency, bool readOnly,
       bool initialSend, bool udp, bool enhancedProto = false)
     : FileDevice(name, true, NETWORK_LATENCY_MS+extraLatency, readOnly, initialSend, enhancedProto),
-    m_hostOrIp(hostOrIp), m_port(port), m_udp(udp) {}
+    m_extraLatency(extraLatency), m_hostOrIp(hostOrIp), m_port(port), m_udp(udp) {}
 
   /**
    * Destructor.
@@ -520,6 +589,13 @@ class NetworkDevice : public FileDevice {
   // @copydoc
   result_t open() override;
 
+  /**
+   * Get the transfer latency of this device adapted to the estimated round-trip time once enough samples were
+   * gathered, otherwise the fixed @a NETWORK_LATENCY_MS.
+   * @return the transfer latency in milliseconds.
+   */
+  unsigned int getLatency() const override;
+
 
  protected:
   // @copydoc
@@ -527,6 +603,9 @@ class NetworkDevice : public FileDevice {
 
 
  private:
+  /** the extra bus transfer latency in milliseconds. */
+  const unsigned int m_extraLatency;
+
   /** the host name or IP address of the device. */
   const char* m_hostOrIp;
 
@@ -537,6 +616,288 @@ class NetworkDevice : public FileDevice {
   const bool m_udp;
 };
 
+
+/**
+ * The read-only @a Device replaying a raw dump file (e.g. from "--dumpfile").
+ */
+class ReplayDevice : public Device {
+ public:
+  /**
+   * Construct a new instance.
+   * @param name the device name (e.g. "replay:10:/tmp/ebus_dump.bin").
+   * @param file the name of the file to replay.
+   * @param speed the speed factor relative to the real bus speed, or 0 for replaying as fast as possible.
+   */
+  ReplayDevice(const char* name, const string& file, double speed)
+    : Device(name, true, false), m_file(file), m_speed(speed), m_bufLen(0), m_bufPos(0),
+    m_symbols(0), m_telegrams(0), m_lastSymbol(SYN), m_startTime(0), m_startDecoded(0), m_startPublished(0),
+    m_finished(false) {}
+
+  /**
+   * Destructor.
+   */
+  ~ReplayDevice() override { close(); }
+
+  // @copydoc
+  void formatInfo(ostringstream* output, bool verbose, bool asJson = false, bool noWait = false) override;
+
+  // @copydoc
+  result_t open() override;
+
+  // @copydoc
+  void close() override;
+
+  // @copydoc
+  bool isValid() override { return m_stream.is_open(); }
+
+  // @copydoc
+  result_t send(symbol_t value) override { return RESULT_ERR_DEVICE; }
+
+  // @copydoc
+  result_t recv(unsigned int timeout, symbol_t* value, ArbitrationState* arbitrationState) override;
+
+  // @copydoc
+  result_t startArbitration(symbol_t masterAddress) override {
+    return masterAddress == SYN ? RESULT_OK : RESULT_ERR_DEVICE;
+  }
+
+  // @copydoc
+  bool isArbitrating() const override { return false; }
+
+  // @copydoc
+  bool supportsUpdateCheck() const override { return false; }
+
+
+ private:
+  /**
+   * Notify the listener about the replay statistics once the end of the file was reached.
+   */
+  void notifyFinished();
+
+  /** the name of the file to replay. */
+  const string m_file;
+
+  /** the speed factor relative to the real bus speed, or 0 for replaying as fast as possible. */
+  const double m_speed;
+
+  /** the stream of the file to replay. */
+  ifstream m_stream;
+
+  /** the buffer for reading from the file. */
+  symbol_t m_buffer[4096];
+
+  /** the number of symbols available in @a m_buffer. */
+  size_t m_bufLen;
+
+  /** the position of the next symbol in @a m_buffer. */
+  size_t m_bufPos;
+
+  /** the number of symbols replayed so far. */
+  uint64_t m_symbols;
+
+  /** the number of telegrams (i.e. non-SYN symbols following a SYN) replayed so far. */
+  uint64_t m_telegrams;
+
+  /** the last symbol replayed. */
+  symbol_t m_lastSymbol;
+
+  /** the system time in microseconds when the replay was started. */
+  uint64_t m_startTime;
+
+  /** the number of completed telegrams decoded by the listener when the replay was started. */
+  uint64_t m_startDecoded;
+
+  /** the number of messages published when the replay was started. */
+  uint64_t m_startPublished;
+
+  /** whether the end of the file was reached. */
+  bool m_finished;
+};
+
+/** the options of a @a SimulationDevice. */
+typedef struct {
+  unsigned int latency;  //!< the delay of the slave answer [ms]
+  unsigned int collision;  //!< the probability of losing the arbitration [%]
+  unsigned int nak;  //!< the probability of a slave answering with NAK [%]
+  unsigned int traffic;  //!< the probability of a foreign master sending a telegram after each SYN [%]
+  unsigned int syn;  //!< the interval of the generated SYN symbols [ms] (default 10)
+} simOptions_t;
+
+/**
+ * The @a Device emulating a virtual bus with slaves answering from a definition file.
+ * Each line of the definition file consists of the hex master part "QQZZPBSBNN[DD]*" followed by "/" and the hex
+ * slave part "NN[DD]*" (empty for broadcast and master-master telegrams). The master address QQ is ignored when
+ * answering and used for the telegrams sent by foreign masters.
+ */
+class SimulationDevice : public Device {
+ public:
+  /**
+   * Construct a new instance.
+   * @param name the device name (e.g. "sim:latency=5,collision=2:/etc/ebusd/sim.txt").
+   * @param file the name of the definition file.
+   * @param options the @a simOptions_t.
+   * @param readOnly whether to allow read access to the device only.
+   */
+  SimulationDevice(const char* name, const string& file, const simOptions_t& options, bool readOnly)
+    : Device(name, readOnly, false), m_file(file), m_options(options), m_valid(false), m_seed(1),
+    m_arbitrationMaster(SYN), m_arbitrationCheck(false), m_state(ss_idle), m_escape(false), m_answerIndex(0),
+    m_nextSyn(0), m_answered(0), m_collisions(0), m_naks(0), m_foreign(0) {}
+
+  /**
+   * Parse the @a simOptions_t from the comma separated list of KEY=VALUE pairs.
+   * @param str the comma separated list of KEY=VALUE pairs.
+   * @param options the @a simOptions_t to fill.
+   * @return true on success, false on invalid key or value.
+   */
+  static bool parseOptions(const string& str, simOptions_t* options);
+
+  // @copydoc
+  void formatInfo(ostringstream* output, bool verbose, bool asJson = false, bool noWait = false) override;
+
+  // @copydoc
+  result_t open() override;
+
+  // @copydoc
+  void close() override { m_valid = false; }
+
+  // @copydoc
+  bool isValid() override { return m_valid; }
+
+  // @copydoc
+  result_t send(symbol_t value) override;
+
+  // @copydoc
+  result_t recv(unsigned int timeout, symbol_t* value, ArbitrationState* arbitrationState) override;
+
+  // @copydoc
+  result_t startArbitration(symbol_t masterAddress) override;
+
+  // @copydoc
+  bool isArbitrating() const override { return m_arbitrationMaster != SYN; }
+
+  // @copydoc
+  bool supportsUpdateCheck() const override { return false; }
+
+  // @copydoc
+  bool supportsBurstSend() const override { return true; }
+
+  // @copydoc
+  result_t sendBurst(const symbol_t* values, size_t count) override;
+
+
+ private:
+  /** the state of the telegram seen by the simulated slaves. */
+  enum SimState {
+    ss_idle,       //!< no telegram in process or telegram not to be answered
+    ss_master,     //!< receiving the master part from ebusd
+    ss_masterAck,  //!< slave part sent, waiting for the master ACK
+  };
+
+  /** a symbol to be received. */
+  typedef struct {
+    symbol_t symbol;  //!< the symbol
+    uint64_t due;  //!< the system time in milliseconds from which the symbol is available
+  } pending_t;
+
+  /**
+   * Return whether a random event with the specified probability occurred.
+   * @param percent the probability in percent.
+   * @return true if the event occurred.
+   */
+  bool chance(unsigned int percent);
+
+  /**
+   * Add a symbol to be received (escaped if necessary).
+   * @param symbol the symbol to add.
+   * @param escape whether to escape the symbol.
+   * @param due the system time in milliseconds from which the symbol is available.
+   */
+  void addPending(symbol_t symbol, bool escape, uint64_t due);
+
+  /**
+   * Add the slave part with CRC to be received.
+   * @param slave the @a SlaveSymbolString to add.
+   * @param due the system time in milliseconds from which the symbols are available.
+   */
+  void addSlave(const SlaveSymbolString& slave, uint64_t due);
+
+  /**
+   * Add a complete telegram of a foreign master to be received.
+   * @param index the index of the definition to use.
+   * @param master the master address QQ of the foreign master.
+   * @param skipMaster whether to skip the master address QQ (already received during arbitration).
+   * @param due the system time in milliseconds from which the symbols are available.
+   */
+  void addForeign(size_t index, symbol_t master, bool skipMaster, uint64_t due);
+
+  /**
+   * Handle the completely received master part sent by ebusd.
+   * @param crc the received CRC.
+   * @param now the current system time in milliseconds.
+   */
+  void handleMaster(symbol_t crc, uint64_t now);
+
+  /** the name of the definition file. */
+  const string m_file;
+
+  /** the @a simOptions_t. */
+  const simOptions_t m_options;
+
+  /** whether the definition file was loaded successfully. */
+  bool m_valid;
+
+  /** the seed for the pseudo random number generator. */
+  unsigned int m_seed;
+
+  /** the master parts of the definitions. */
+  vector<MasterSymbolString> m_masters;
+
+  /** the slave parts of the definitions. */
+  vector<SlaveSymbolString> m_slaves;
+
+  /** the definition index by master part without QQ. */
+  map<string, size_t> m_answers;
+
+  /** the known destination addresses ZZ. */
+  map<symbol_t, bool> m_addresses;
+
+  /** the symbols to be received. */
+  deque<pending_t> m_pending;
+
+  /** the master address to arbitrate for, or @a SYN. */
+  symbol_t m_arbitrationMaster;
+
+  /** whether the arbitration master address was sent and its result is to be received next. */
+  bool m_arbitrationCheck;
+
+  /** the state of the telegram seen by the simulated slaves. */
+  SimState m_state;
+
+  /** the unescaped master part currently received from ebusd. */
+  MasterSymbolString m_master;
+
+  /** whether the last symbol received from ebusd was @a ESC. */
+  bool m_escape;
+
+  /** the index of the definition currently answered. */
+  size_t m_answerIndex;
+
+  /** the system time in milliseconds when the next SYN is generated. */
+  uint64_t m_nextSyn;
+
+  /** the number of telegrams answered. */
+  uint64_t m_answered;
+
+  /** the number of simulated arbitration collisions. */
+  uint64_t m_collisions;
+
+  /** the number of simulated NAKs. */
+  uint64_t m_naks;
+
+  /** the number of telegrams sent by foreign masters. */
+  uint64_t m_foreign;
+};
+
 }  // namespace ebusd
 
 #endif  // LIB_EBUS_DEVICE_H_
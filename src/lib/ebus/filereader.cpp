@@ -18,6 +18,11 @@
 
 #include "lib/ebus/filereader.h"
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -25,6 +30,7 @@
 #include <climits>
 #include <fstream>
 #include <functional>
+#include "lib/ebus/arena.h"
 
 namespace ebusd {
 
@@ -34,7 +40,16 @@ using std::cout;
 using std::endl;
 using std::setw;
 using std::dec;
+using std::ofstream;
+using std::streampos;
 
+/** the magic bytes at the start of a @a RowCache file. */
+static const char ROWCACHE_MAGIC[4] = {'E', 'B', 'R', 'C'};
+
+/** the version of the @a RowCache file format. */
+#define ROWCACHE_VERSION 2
+
+RowCache* FileReader::s_rowCache = nullptr;
 
 istream* FileReader::openFile(const string& filename, string* errorDescription, time_t* time) {
   struct stat st;
@@ -67,35 +82,107 @@ result_t FileReader::readFromStream(istream* stream, const string& filename, con
   if (size) {
     *size = 0;
   }
+  DefinitionArena arena;  // allocate the definitions of this file together for releasing them together
   unsigned int lineNo = 0;
   vector<string> row;
   result_t result = RESULT_OK;
-  while (stream->peek() != EOF && result == RESULT_OK) {
-    result = readLineFromStream(stream, filename, verbose, &lineNo, &row, errorDescription, replace, hash, size);
+  RowCache* cache = s_rowCache;
+  size_t length = 0;
+  if (cache) {
+    // only plain files are cached and recognized by their modification time and length without reading them
+    streampos start = mtime == 0 || !dynamic_cast<ifstream*>(stream) ? streampos(-1) : stream->tellg();
+    if (start >= 0 && stream->seekg(0, ifstream::end)) {
+      streampos streamEnd = stream->tellg();
+      stream->seekg(start);
+      length = streamEnd >= start ? static_cast<size_t>(streamEnd - start) : 0;
+    }
+    if (start < 0 || !*stream) {
+      stream->clear();
+      cache = nullptr;
+    }
+  }
+  string rows;
+  size_t fileHash, fileSize;
+  if (cache && cache->find(filename, mtime, length, &fileHash, &fileSize, &rows)) {
+    if (hash) {
+      *hash = fileHash;
+    }
+    if (size) {
+      *size = fileSize;
+    }
+    const char* rowPos = rows.data();
+    const char* rowEnd = rowPos + rows.length();
+    while (result == RESULT_OK && RowCache::readRow(&rowPos, rowEnd, &lineNo, &row)) {
+      *errorDescription = "";
+      result = finishLine(filename, verbose, lineNo, addFromFile(filename, lineNo, &row, errorDescription, replace),
+          errorDescription);
+    }
+    return result;
+  }
+  string buffer;  // split from the whole content at once instead of line by line from the stream
+  readRemaining(stream, &buffer);
+  const char* pos = buffer.data();
+  const char* end = pos + buffer.length();
+  if (!cache) {
+    while (pos < end && result == RESULT_OK) {
+      if (!splitFields(&pos, end, &row, &lineNo, hash, size)) {
+        *errorDescription = "blank line";
+        result = finishLine(filename, verbose, lineNo, RESULT_ERR_EOF, errorDescription);
+        break;
+      }
+      *errorDescription = "";
+      result = finishLine(filename, verbose, lineNo, addFromFile(filename, lineNo, &row, errorDescription, replace),
+          errorDescription);
+    }
+    return result;
+  }
+  hashBuffer(pos, end, &fileHash, &fileSize);
+  if (hash) {
+    *hash = fileHash;
+  }
+  if (size) {
+    *size = fileSize;
+  }
+  while (pos < end && result == RESULT_OK) {
+    if (!splitFields(&pos, end, &row, &lineNo)) {
+      *errorDescription = "blank line";
+      result = finishLine(filename, verbose, lineNo, RESULT_ERR_EOF, errorDescription);
+      break;
+    }
+    RowCache::appendRow(lineNo, row, &rows);
+    *errorDescription = "";
+    result = finishLine(filename, verbose, lineNo, addFromFile(filename, lineNo, &row, errorDescription, replace),
+        errorDescription);
+  }
+  if (result == RESULT_OK) {
+    cache->add(filename, mtime, buffer.length(), fileHash, fileSize, rows);
   }
   return result;
 }
 
 result_t FileReader::readLineFromStream(istream* stream, const string& filename, bool verbose,
     unsigned int* lineNo, vector<string>* row, string* errorDescription, bool replace, size_t* hash, size_t* size) {
-  result_t result;
   if (!splitFields(stream, row, lineNo, hash, size)) {
     *errorDescription = "blank line";
-    result = RESULT_ERR_EOF;
-  } else {
-    *errorDescription = "";
-    result = addFromFile(filename, *lineNo, row, errorDescription, replace);
+    return finishLine(filename, verbose, *lineNo, RESULT_ERR_EOF, errorDescription);
   }
+  *errorDescription = "";
+  return finishLine(filename, verbose, *lineNo, addFromFile(filename, *lineNo, row, errorDescription, replace),
+      errorDescription);
+}
+
+result_t FileReader::finishLine(const string& filename, bool verbose, unsigned int lineNo, result_t result,
+    string* errorDescription) {
   if (result != RESULT_OK) {
     if (!errorDescription->empty()) {
       string error;
-      formatError(filename, *lineNo, result, *errorDescription, &error);
+      formatError(filename, lineNo, result, *errorDescription, &error);
       *errorDescription = error;
       if (verbose) {
         cout << error << endl;
       }
     } else if (!verbose) {
-      return formatError(filename, *lineNo, result, "", errorDescription);
+      return formatError(filename, lineNo, result, "", errorDescription);
     }
   } else if (!verbose) {
     *errorDescription = "";
@@ -210,94 +297,351 @@ bool FileReader::matches(const string& input, const string& search, bool ignoreC
   return false;
 }
 
-static size_t hashFunction(const string& str) {
+
+SearchPattern::SearchPattern(const string& search, bool ignoreCase)
+  : m_ignoreCase(ignoreCase), m_empty(search.empty()), m_matchAll(search.empty()) {
+  string lower = search;
+  if (ignoreCase) {
+    FileReader::tolower(&lower);
+  }
+  size_t from = 0;
+  while (!m_matchAll && from <= lower.length()) {
+    size_t to = lower.find('|', from);
+    if (to == string::npos) {
+      to = lower.length();
+    }
+    if (from == to) {
+      m_matchAll = true;  // empty pattern matches everything
+      break;
+    }
+    alternative_t alternative;
+    string alt = lower.substr(from, to-from);
+    from = to+1;
+    alternative.matchStart = alt[0] == '^';
+    if (alternative.matchStart) {
+      alt.erase(0, 1);
+    }
+    alternative.matchEnd = !alt.empty() && alt[alt.length()-1] == '$';
+    if (alternative.matchEnd) {
+      alt.erase(alt.length()-1);
+    }
+    alternative.onlyEmpty = alternative.matchStart && alternative.matchEnd && alt.empty();
+    size_t star = alt.find('*');
+    alternative.hasStar = star != string::npos;
+    if (alternative.hasStar) {
+      alternative.suffix = alt.substr(star + 1);
+      alt.erase(star);
+    }
+    alternative.prefix = alt;
+    m_alternatives.push_back(alternative);
+  }
+}
+
+bool SearchPattern::matches(const string& input) const {
+  if (m_matchAll) {
+    return true;
+  }
+  if (m_ignoreCase) {
+    string lower = input;
+    FileReader::tolower(&lower);
+    return matchesCase(lower);
+  }
+  return matchesCase(input);
+}
+
+bool SearchPattern::matchesCase(const string& input) const {
+  for (const auto& alternative : m_alternatives) {
+    if (alternative.onlyEmpty) {
+      if (input.empty()) {
+        return true;
+      }
+      continue;
+    }
+    const string& prefix = alternative.prefix;
+    bool matchEnd = alternative.matchEnd;
+    size_t checkEnd = input.length();
+    if (alternative.hasStar) {
+      const string& suffix = alternative.suffix;
+      if (!suffix.empty()) {
+        if (checkEnd < suffix.length()) {
+          checkEnd = string::npos;  // no-match
+        } else {
+          checkEnd -= suffix.length();
+          if (matchEnd) {
+            if (input.find(suffix, checkEnd) == string::npos) {
+              checkEnd = string::npos;  // no-match
+            }
+          } else {
+            checkEnd = input.rfind(suffix, checkEnd);
+          }
+        }
+      }
+      matchEnd = false;  // prefix is no longer required to match at the end
+    }
+    if (checkEnd == string::npos) {
+      continue;
+    }
+    if (prefix.empty()) {
+      return true;  // empty prefix matches everything
+    }
+    if (prefix.length() > checkEnd) {
+      continue;  // prefix is longer than remainder
+    }
+    if (alternative.matchStart) {
+      if (input.compare(0, prefix.length(), prefix) == 0 && (!matchEnd || prefix.length() == checkEnd)) {
+        return true;
+      }
+    } else if (matchEnd) {
+      if (input.compare(checkEnd-prefix.length(), prefix.length(), prefix) == 0) {
+        return true;
+      }
+    } else {
+      size_t pos = input.find(prefix);
+      if (pos != string::npos && pos+prefix.length() <= checkEnd) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * Calculate the hash of a character sequence.
+ * @param str the characters to hash.
+ * @param length the number of characters.
+ * @return the hash value.
+ */
+static size_t hashFunction(const char* str, size_t length) {
   size_t hash = 0;
-  for (unsigned char c : str) {
-    hash = (31 * hash) ^ c;
+  for (const char* end = str + length; str < end; str++) {
+    hash = (31 * hash) ^ static_cast<unsigned char>(*str);
   }
   return hash;
 }
 
-bool FileReader::splitFields(istream* stream, vector<string>* row, unsigned int* lineNo,
-    size_t* hash, size_t* size, bool clear) {
-  if (clear) {
-    row->clear();
+/**
+ * Trim the character sequence on both sides like @a FileReader::trim(), i.e. a blank only sequence is kept as is.
+ * @param line the pointer to the first character, updated to the first non blank character.
+ * @param length the number of characters, updated to the trimmed length.
+ */
+static void trimSpan(const char** line, size_t* length) {
+  size_t start = 0;
+  while (start < *length && ((*line)[start] == ' ' || (*line)[start] == '\t')) {
+    start++;
   }
-  string line;
-  bool quotedText = false, wasQuoted = false;
-  ostringstream field;
-  char prev = FIELD_SEPARATOR;
-  bool empty = true, read = false;
-  while (getline(*stream, line)) {
-    read = true;
+  if (start == *length) {
+    return;  // blank only
+  }
+  size_t end = *length;
+  while ((*line)[end - 1] == ' ' || (*line)[end - 1] == '\t') {
+    end--;
+  }
+  *line += start;
+  *length = end - start;
+}
+
+/**
+ * Helper for splitting the (possibly multiline) fields of a single row taken from subsequent lines.
+ */
+class FieldSplitter {
+ public:
+  /**
+   * Constructor.
+   * @param row the @a vector to which to add the fields.
+   */
+  explicit FieldSplitter(vector<string>* row)
+    : m_row(row), m_quotedText(false), m_wasQuoted(false), m_prev(FIELD_SEPARATOR), m_empty(true) {}
+
+  /**
+   * Add the next line.
+   * @param line the pointer to the first character of the line.
+   * @param length the length of the line (excluding the line feed).
+   * @param lineNo the current line number (incremented).
+   * @param hash optional pointer to a @a size_t value for combining the hash of the line with, or nullptr.
+   * @param size optional pointer to a @a size_t value to add the trimmed line length to, or nullptr.
+   * @return true when the row is complete, false when the next line is needed.
+   */
+  bool addLine(const char* line, size_t length, unsigned int* lineNo, size_t* hash, size_t* size) {
     ++(*lineNo);
-    trim(&line);
-    size_t length = line.size();
+    trimSpan(&line, &length);
     if (size) {
       *size += length + 1;  // normalized with trailing endl
     }
     if (hash) {
-      *hash ^= (hashFunction(line) ^ (length << (7 * (*lineNo % 5)))) & 0xffffffff;
+      *hash ^= (hashFunction(line, length) ^ (length << (7 * (*lineNo % 5)))) & 0xffffffff;
     }
-    if (!quotedText && (length == 0 || line[0] == '#' || (line.length() > 1 && line[0] == '/' && line[1] == '/'))) {
-      if (*lineNo == 1) {
-        break;  // keep empty first line for applying default header
-      }
-      continue;  // skip empty lines and comments
+    if (!m_quotedText && (length == 0 || line[0] == '#' || (length > 1 && line[0] == '/' && line[1] == '/'))) {
+      // keep empty first line for applying default header, skip other empty lines and comments
+      return *lineNo == 1;
     }
     for (size_t pos = 0; pos < length; pos++) {
       char ch = line[pos];
       switch (ch) {
       case FIELD_SEPARATOR:
-        if (quotedText) {
-          field << ch;
+        if (m_quotedText) {
+          m_field.push_back(ch);
         } else {
-          string str = field.str();
-          trim(&str);
-          empty &= str.empty();
-          row->push_back(str);
-          field.str("");
-          wasQuoted = false;
+          addField();
+          m_wasQuoted = false;
         }
         break;
       case TEXT_SEPARATOR:
-        if (prev == TEXT_SEPARATOR && !quotedText) {  // double dquote
-          field << ch;
-          quotedText = true;
-        } else if (quotedText) {
-          quotedText = false;
-        } else if (prev == FIELD_SEPARATOR) {
-          quotedText = wasQuoted = true;
+        if (m_prev == TEXT_SEPARATOR && !m_quotedText) {  // double dquote
+          m_field.push_back(ch);
+          m_quotedText = true;
+        } else if (m_quotedText) {
+          m_quotedText = false;
+        } else if (m_prev == FIELD_SEPARATOR) {
+          m_quotedText = m_wasQuoted = true;
         } else {
-          field << ch;
+          m_field.push_back(ch);
         }
         break;
       case '\r':
         break;
-      default:
-        if (prev == TEXT_SEPARATOR && !quotedText && wasQuoted) {
-          field << TEXT_SEPARATOR;  // single dquote in the middle of formerly quoted text
-          quotedText = true;
-        } else if (quotedText && pos == 0 && field.tellp() > 0 && *(field.str().end()-1) != VALUE_SEPARATOR) {
-          field << VALUE_SEPARATOR;  // add separator in between multiline field parts
+      default: {
+        if (m_prev == TEXT_SEPARATOR && !m_quotedText && m_wasQuoted) {
+          m_field.push_back(TEXT_SEPARATOR);  // single dquote in the middle of formerly quoted text
+          m_quotedText = true;
+        } else if (m_quotedText && pos == 0 && !m_field.empty() && m_field[m_field.length()-1] != VALUE_SEPARATOR) {
+          m_field.push_back(VALUE_SEPARATOR);  // add separator in between multiline field parts
+        }
+        // append all following regular characters at once
+        size_t runEnd = pos + 1;
+        while (runEnd < length && line[runEnd] != FIELD_SEPARATOR && line[runEnd] != TEXT_SEPARATOR
+            && line[runEnd] != '\r') {
+          runEnd++;
         }
-        field << ch;
+        m_field.append(line + pos, runEnd - pos);
+        pos = runEnd - 1;
+        ch = line[pos];
         break;
       }
-      prev = ch;
+      }
+      m_prev = ch;
+    }
+    return !m_quotedText;
+  }
+
+  /**
+   * Finish the row.
+   * @param read whether any line was read.
+   * @return true if there are more lines to read, false when there are no more lines left.
+   */
+  bool finish(bool read) {
+    if (m_empty && m_field.empty()) {
+      m_row->clear();
+      return read;
+    }
+    addField();
+    return true;
+  }
+
+ private:
+  /**
+   * Add the trimmed current field to the row.
+   */
+  void addField() {
+    const char* str = m_field.data();
+    size_t length = m_field.length();
+    trimSpan(&str, &length);
+    m_empty &= length == 0;
+    m_row->emplace_back(str, length);
+    m_field.clear();
+  }
+
+  /** the @a vector to which to add the fields. */
+  vector<string>* m_row;
+
+  /** the current field (capacity reused for all fields of the row). */
+  string m_field;
+
+  /** whether currently in quoted text. */
+  bool m_quotedText;
+
+  /** whether the current field was quoted. */
+  bool m_wasQuoted;
+
+  /** the previous character. */
+  char m_prev;
+
+  /** whether all fields added so far were empty. */
+  bool m_empty;
+};
+
+void FileReader::hashStream(istream* stream, size_t* hash, size_t* size) {
+  istream::pos_type start = stream->tellg();
+  string buffer;
+  readRemaining(stream, &buffer);
+  hashBuffer(buffer.data(), buffer.data() + buffer.length(), hash, size);
+  stream->clear();
+  stream->seekg(start);
+}
+
+void FileReader::hashBuffer(const char* pos, const char* end, size_t* hash, size_t* size) {
+  *hash = 0;
+  *size = 0;
+  unsigned int lineNo = 0;
+  while (pos < end) {
+    const char* lineEnd = static_cast<const char*>(memchr(pos, '\n', end - pos));
+    if (!lineEnd) {
+      lineEnd = end;
     }
-    if (!quotedText) {
+    const char* line = pos;
+    size_t length = lineEnd - pos;
+    pos = lineEnd < end ? lineEnd + 1 : end;
+    ++lineNo;
+    trimSpan(&line, &length);
+    *size += length + 1;  // normalized with trailing endl
+    *hash ^= (hashFunction(line, length) ^ (length << (7 * (lineNo % 5)))) & 0xffffffff;
+  }
+}
+
+void FileReader::readRemaining(istream* stream, string* buffer) {
+  buffer->clear();
+  char chunk[4096];
+  while (stream->read(chunk, sizeof(chunk)) || stream->gcount() > 0) {
+    buffer->append(chunk, static_cast<size_t>(stream->gcount()));
+  }
+}
+
+bool FileReader::splitFields(istream* stream, vector<string>* row, unsigned int* lineNo,
+    size_t* hash, size_t* size, bool clear) {
+  if (clear) {
+    row->clear();
+  }
+  FieldSplitter splitter(row);
+  string line;
+  bool read = false;
+  while (getline(*stream, line)) {
+    read = true;
+    if (splitter.addLine(line.data(), line.length(), lineNo, hash, size)) {
       break;
     }
   }
-  string str = field.str();
-  trim(&str);
-  if (empty && str.empty()) {
+  return splitter.finish(read);
+}
+
+bool FileReader::splitFields(const char** pos, const char* end, vector<string>* row, unsigned int* lineNo,
+    size_t* hash, size_t* size, bool clear) {
+  if (clear) {
     row->clear();
-    return read;
   }
-  row->push_back(str);
-  return true;
+  FieldSplitter splitter(row);
+  bool read = false;
+  while (*pos < end) {
+    const char* lineEnd = static_cast<const char*>(memchr(*pos, '\n', end - *pos));
+    if (!lineEnd) {
+      lineEnd = end;
+    }
+    const char* line = *pos;
+    *pos = lineEnd < end ? lineEnd + 1 : end;
+    read = true;
+    if (splitter.addLine(line, lineEnd - line, lineNo, hash, size)) {
+      break;
+    }
+  }
+  return splitter.finish(read);
 }
 
 result_t FileReader::formatError(const string& filename, unsigned int lineNo, result_t result,
@@ -339,6 +683,7 @@ result_t MappedFileReader::readFromStream(istream* stream, const string& filenam
     map<string, string>* defaults, string* errorDescription, bool replace, size_t* hash, size_t* size) {
   m_mutex.lock();
   m_columnNames.clear();
+  m_columnKeys.clear();
   m_lastDefaults.clear();
   m_lastSubDefaults.clear();
   if (defaults) {
@@ -366,6 +711,10 @@ result_t MappedFileReader::addFromFile(const string& filename, unsigned int line
       return RESULT_ERR_EOF;
     }
     m_columnNames = *row;
+    m_columnKeys.clear();
+    for (const auto& columnName : m_columnNames) {
+      m_columnKeys.push_back(!columnName.empty() && columnName[0] == '*' ? columnName.substr(1) : columnName);
+    }
     return RESULT_OK;
   }
   if (row->empty()) {
@@ -392,7 +741,8 @@ result_t MappedFileReader::addFromFile(const string& filename, unsigned int line
       }
       colNameIdx = lastRepeatStart;
     }
-    string columnName = m_columnNames[colNameIdx];
+    const string& columnName = m_columnNames[colNameIdx];
+    const string* key = &columnName;
     if (!columnName.empty() && columnName[0] == '*') {  // marker for next entry
       if (empty) {
         lastMappedRow->clear();
@@ -401,15 +751,15 @@ result_t MappedFileReader::addFromFile(const string& filename, unsigned int line
         subRowsMapped.resize(subRowsMapped.size() + 1);
         lastMappedRow = &subRowsMapped[subRowsMapped.size() - 1];
       }
-      columnName = columnName.substr(1);
+      key = &m_columnKeys[colNameIdx];
       lastRepeatStart = colNameIdx;
       empty = true;
     } else if (columnName == SKIP_COLUMN) {
       continue;
     }
-    string value = (*row)[colIdx];
+    string& value = (*row)[colIdx];
     empty &= value.empty();
-    (*lastMappedRow)[columnName] = value;
+    (*lastMappedRow)[*key].swap(value);  // the row is not needed anymore
   }
   if (empty) {
     lastMappedRow->clear();
@@ -437,4 +787,249 @@ const string MappedFileReader::combineRow(const map<string, string>& row) {
   return ostream.str();
 }
 
+
+/**
+ * Append a 32 bit unsigned value in little endian byte order.
+ * @param value the value to append.
+ * @param output the @a string to append to.
+ */
+static void appendUInt32(size_t value, string* output) {
+  for (int i = 0; i < 4; i++) {
+    output->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+/**
+ * Read a 32 bit unsigned value in little endian byte order.
+ * @param pos pointer to the current position (updated).
+ * @param end the end of the data.
+ * @param value pointer to a variable in which to store the value.
+ * @return true on success, false when not enough data is left.
+ */
+static bool readUInt32(const char** pos, const char* end, size_t* value) {
+  if (end - *pos < 4) {
+    return false;
+  }
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(*pos);
+  *value = static_cast<size_t>(data[0]) | (static_cast<size_t>(data[1]) << 8)
+    | (static_cast<size_t>(data[2]) << 16) | (static_cast<size_t>(data[3]) << 24);
+  *pos += 4;
+  return true;
+}
+
+/**
+ * Read a length prefixed string.
+ * @param pos pointer to the current position (updated).
+ * @param end the end of the data.
+ * @param data pointer to a variable in which to store the start of the string.
+ * @param length pointer to a variable in which to store the length of the string.
+ * @return true on success, false when not enough data is left.
+ */
+static bool readChars(const char** pos, const char* end, const char** data, size_t* length) {
+  if (!readUInt32(pos, end, length) || static_cast<size_t>(end - *pos) < *length) {
+    return false;
+  }
+  *data = *pos;
+  *pos += *length;
+  return true;
+}
+
+RowCache::~RowCache() {
+  if (m_mapped) {
+    munmap(m_mapped, m_mappedSize);
+    m_mapped = nullptr;
+  }
+}
+
+bool RowCache::load() {
+  m_mutex.lock();
+  if (m_mapped) {
+    munmap(m_mapped, m_mappedSize);
+    m_mapped = nullptr;
+  }
+  m_mappedEntries.clear();
+  m_addedEntries.clear();
+  m_changed = false;
+  bool ret = false;
+  int fd = open(m_filename.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= 12) {
+    void* mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      m_mapped = static_cast<char*>(mapped);
+      m_mappedSize = (size_t)st.st_size;
+      const char* pos = m_mapped;
+      const char* end = m_mapped + m_mappedSize;
+      size_t version = 0, count = 0;
+      ret = memcmp(pos, ROWCACHE_MAGIC, sizeof(ROWCACHE_MAGIC)) == 0;
+      pos += sizeof(ROWCACHE_MAGIC);
+      ret = ret && readUInt32(&pos, end, &version) && version == ROWCACHE_VERSION && readUInt32(&pos, end, &count);
+      for (size_t i = 0; ret && i < count; i++) {
+        const char* name;
+        size_t nameLength;
+        mappedEntry_t entry;
+        ret = readChars(&pos, end, &name, &nameLength) && readChars(&pos, end, &entry.data, &entry.length);
+        if (ret) {
+          entry.used = false;
+          m_mappedEntries[string(name, nameLength)] = entry;
+        }
+      }
+      if (!ret) {
+        m_mappedEntries.clear();
+        munmap(m_mapped, m_mappedSize);
+        m_mapped = nullptr;
+      }
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  m_mutex.unlock();
+  return ret;
+}
+
+bool RowCache::save() {
+  m_mutex.lock();
+  if (!m_changed) {
+    m_mutex.unlock();
+    return true;
+  }
+  string tmpName = m_filename + ".tmp";
+  ofstream stream(tmpName.c_str(), ofstream::out | ofstream::binary | ofstream::trunc);
+  bool ret = stream.is_open();
+  if (ret) {
+    string data(ROWCACHE_MAGIC, sizeof(ROWCACHE_MAGIC));
+    appendUInt32(ROWCACHE_VERSION, &data);
+    size_t count = m_addedEntries.size();
+    for (const auto& it : m_mappedEntries) {
+      if (it.second.used) {
+        count++;
+      }
+    }
+    appendUInt32(count, &data);
+    stream.write(data.data(), static_cast<std::streamsize>(data.length()));
+    for (const auto& it : m_mappedEntries) {
+      if (!it.second.used) {
+        continue;
+      }
+      data.clear();
+      appendUInt32(it.first.length(), &data);
+      data.append(it.first);
+      appendUInt32(it.second.length, &data);
+      stream.write(data.data(), static_cast<std::streamsize>(data.length()));
+      stream.write(it.second.data, static_cast<std::streamsize>(it.second.length));
+    }
+    for (const auto& it : m_addedEntries) {
+      data.clear();
+      appendUInt32(it.first.length(), &data);
+      data.append(it.first);
+      appendUInt32(it.second.length(), &data);
+      data.append(it.second);
+      stream.write(data.data(), static_cast<std::streamsize>(data.length()));
+    }
+    stream.close();
+    ret = !stream.fail() && rename(tmpName.c_str(), m_filename.c_str()) == 0;
+    if (!ret) {
+      unlink(tmpName.c_str());
+    }
+  }
+  m_mutex.unlock();
+  if (ret && load()) {  // release the memory of the added entries
+    m_mutex.lock();
+    for (auto& it : m_mappedEntries) {
+      it.second.used = true;
+    }
+    m_mutex.unlock();
+  }
+  return ret;
+}
+
+/**
+ * Append the stamp identifying the content of a file to a cache entry.
+ * @param mtime the modification time of the file.
+ * @param length the length of the file.
+ * @param output the @a string to append to.
+ */
+static void appendStamp(time_t mtime, size_t length, string* output) {
+  uint64_t value = static_cast<uint64_t>(mtime);
+  appendUInt32(static_cast<size_t>(value & 0xffffffff), output);
+  appendUInt32(static_cast<size_t>(value >> 32), output);
+  appendUInt32(length & 0xffffffff, output);
+}
+
+/** the length of the stamp and hash data at the start of a cache entry. */
+#define ROWCACHE_ENTRY_HEADER (5*4)
+
+bool RowCache::find(const string& filename, time_t mtime, size_t length, size_t* hash, size_t* size,
+    string* rows) {
+  string stamp;
+  appendStamp(mtime, length, &stamp);
+  const char* data = nullptr;
+  size_t dataLength = 0;
+  bool ret = false;
+  m_mutex.lock();
+  const auto added = m_addedEntries.find(filename);
+  if (added != m_addedEntries.end()) {
+    data = added->second.data();
+    dataLength = added->second.length();
+  } else {
+    auto mapped = m_mappedEntries.find(filename);
+    if (mapped != m_mappedEntries.end()) {
+      data = mapped->second.data;
+      dataLength = mapped->second.length;
+      mapped->second.used = true;
+    }
+  }
+  if (data && dataLength >= ROWCACHE_ENTRY_HEADER && memcmp(data, stamp.data(), stamp.length()) == 0) {
+    const char* pos = data + stamp.length();
+    readUInt32(&pos, data + dataLength, hash);
+    readUInt32(&pos, data + dataLength, size);
+    rows->assign(pos, dataLength - ROWCACHE_ENTRY_HEADER);
+    ret = true;
+  }
+  m_mutex.unlock();
+  return ret;
+}
+
+void RowCache::add(const string& filename, time_t mtime, size_t length, size_t hash, size_t size,
+    const string& rows) {
+  m_mutex.lock();
+  string& entry = m_addedEntries[filename];
+  entry.clear();
+  appendStamp(mtime, length, &entry);
+  appendUInt32(hash & 0xffffffff, &entry);
+  appendUInt32(size & 0xffffffff, &entry);
+  entry.append(rows);
+  m_mappedEntries.erase(filename);
+  m_changed = true;
+  m_mutex.unlock();
+}
+
+void RowCache::appendRow(unsigned int lineNo, const vector<string>& row, string* rows) {
+  appendUInt32(lineNo, rows);
+  appendUInt32(row.size(), rows);
+  for (const auto& field : row) {
+    appendUInt32(field.length(), rows);
+    rows->append(field);
+  }
+}
+
+bool RowCache::readRow(const char** pos, const char* end, unsigned int* lineNo, vector<string>* row) {
+  size_t value, count;
+  if (!readUInt32(pos, end, &value) || !readUInt32(pos, end, &count)) {
+    return false;
+  }
+  *lineNo = static_cast<unsigned int>(value);
+  row->clear();
+  for (size_t i = 0; i < count; i++) {
+    const char* data;
+    size_t length;
+    if (!readChars(pos, end, &data, &length)) {
+      return false;
+    }
+    row->push_back(string(data, length));
+  }
+  return true;
+}
+
 }  // namespace ebusd
@@ -60,6 +60,8 @@ using std::istream;
 /** special marker string for skipping columns in @a MappedFileReader. */
 static const char SKIP_COLUMN[] = "\b";
 
+class RowCache;
+
 /**
  * An abstract class that support reading definitions from a file.
  */
@@ -168,6 +170,21 @@ class FileReader {
   static bool splitFields(istream* stream, vector<string>* row, unsigned int* lineNo,
       size_t* hash = nullptr, size_t* size = nullptr, bool clear = true);
 
+  /**
+   * Split the next line(s) from the buffer into fields like @a splitFields() for an @a istream but without copying
+   * each line first.
+   * @param pos the pointer to the next character to read in the buffer (updated to the start of the next line).
+   * @param end the pointer behind the last character of the buffer.
+   * @param row the @a vector to which to add the fields. This will be empty for completely empty and comment lines.
+   * @param lineNo the current line number (incremented with each line read).
+   * @param hash optional pointer to a @a size_t value for combining the hash of the line with, or nullptr.
+   * @param size optional pointer to a @a size_t value to add the trimmed line length to, or nullptr.
+   * @param clear whether to clear the fields before adding any.
+   * @return true if there are more lines to read, false when there are no more lines left.
+   */
+  static bool splitFields(const char** pos, const char* end, vector<string>* row, unsigned int* lineNo,
+      size_t* hash = nullptr, size_t* size = nullptr, bool clear = true);
+
   /**
    * Format the specified hash as 8 hex digits to the output stream.
    * @param hash the hash code.
@@ -188,6 +205,110 @@ class FileReader {
    */
   static result_t formatError(const string& filename, unsigned int lineNo, result_t result,
       const string& error, string* errorDescription);
+
+  /**
+   * Calculate the hash and normalized size of the remaining lines in the stream the same way as @a splitFields()
+   * does and rewind the stream afterwards.
+   * @param stream the @a istream to read from.
+   * @param hash pointer to a @a size_t value for storing the hash of the lines.
+   * @param size pointer to a @a size_t value for storing the normalized size of the lines.
+   */
+  static void hashStream(istream* stream, size_t* hash, size_t* size);
+
+  /**
+   * Calculate the hash and normalized size of the lines in the buffer the same way as @a hashStream() does.
+   * @param pos the pointer to the first character of the buffer.
+   * @param end the pointer behind the last character of the buffer.
+   * @param hash pointer to a @a size_t value for storing the hash of the lines.
+   * @param size pointer to a @a size_t value for storing the normalized size of the lines.
+   */
+  static void hashBuffer(const char* pos, const char* end, size_t* hash, size_t* size);
+
+  /**
+   * Read the remaining content of the stream into the buffer.
+   * @param stream the @a istream to read from.
+   * @param buffer the @a string to store the content in.
+   */
+  static void readRemaining(istream* stream, string* buffer);
+
+  /**
+   * Set the @a RowCache to use for all subsequently read streams.
+   * @param cache the @a RowCache to use, or nullptr to disable caching.
+   */
+  static void setRowCache(RowCache* cache) { s_rowCache = cache; }
+
+ protected:
+  /**
+   * Finish the handling of a single line definition by formatting the error description if necessary.
+   * @param filename the name of the file being read.
+   * @param verbose whether to verbosely log problems.
+   * @param lineNo the line number in the file being read.
+   * @param result the result code of handling the line.
+   * @param errorDescription a string in which to store the error description in case of error.
+   * @return the result code.
+   */
+  static result_t finishLine(const string& filename, bool verbose, unsigned int lineNo, result_t result,
+      string* errorDescription);
+
+ private:
+  /** the @a RowCache to use for all read streams, or nullptr. */
+  static RowCache* s_rowCache;
+};
+
+
+/**
+ * A search pattern prepared once for being checked repeatedly in the same way as in @a FileReader::matches().
+ */
+class SearchPattern {
+ public:
+  /**
+   * Constructs a new instance.
+   * @param search the search pattern (see @a FileReader::matches()).
+   * @param ignoreCase true to ignore case differences.
+   */
+  explicit SearchPattern(const string& search = "", bool ignoreCase = false);
+
+  /**
+   * @return whether the search pattern is empty (matching everything).
+   */
+  bool empty() const { return m_empty; }
+
+  /**
+   * Check the input string against the search pattern.
+   * @param input the input string to check.
+   * @return true if the input string matches the search pattern.
+   */
+  bool matches(const string& input) const;
+
+ private:
+  /**
+   * Check the input string against the alternatives without case conversion.
+   * @param input the input string to check (in lower case when ignoring case differences).
+   * @return true if the input string matches the search pattern.
+   */
+  bool matchesCase(const string& input) const;
+
+  /** a single alternative of the search pattern. */
+  typedef struct {
+    bool matchStart;  //!< whether to match the beginning of the input
+    bool matchEnd;  //!< whether to match the end of the input
+    bool onlyEmpty;  //!< whether to match the empty input only ("^$")
+    bool hasStar;  //!< whether the alternative contains a "*"
+    string prefix;  //!< the part before the "*" (or the whole alternative)
+    string suffix;  //!< the part after the "*"
+  } alternative_t;
+
+  /** whether to ignore case differences. */
+  bool m_ignoreCase;
+
+  /** whether the search pattern is empty. */
+  bool m_empty;
+
+  /** whether the search pattern matches everything (e.g. contains an empty alternative). */
+  bool m_matchAll;
+
+  /** the alternatives of the search pattern. */
+  vector<alternative_t> m_alternatives;
 };
 
 
@@ -211,6 +332,7 @@ class MappedFileReader : public FileReader {
    */
   virtual ~MappedFileReader() {
     m_columnNames.clear();
+    m_columnKeys.clear();
     m_lastDefaults.clear();
     m_lastSubDefaults.clear();
   }
@@ -324,6 +446,9 @@ class MappedFileReader : public FileReader {
   /** the name of each column. */
   vector<string> m_columnNames;
 
+  /** the name of each column without the leading sub row marker (used as key in the mapped rows). */
+  vector<string> m_columnKeys;
+
   /** all previously extracted default values by type and field name. */
   map<string, map<string, string> > m_lastDefaults;
 
@@ -331,6 +456,110 @@ class MappedFileReader : public FileReader {
   map<string, vector< map<string, string> > > m_lastSubDefaults;
 };
 
+
+/**
+ * A persistent cache of the rows split from configuration files, keyed by the file name together with the hash and
+ * normalized size of its content.
+ * The cache file is memory mapped on @a load() and only the entries for files that were read again are kept on
+ * @a save(), so that entries of changed or no longer used files are dropped.
+ */
+class RowCache {
+ public:
+  /**
+   * Constructor.
+   * @param filename the name of the cache file.
+   */
+  explicit RowCache(const string& filename)
+    : m_filename(filename), m_mapped(nullptr), m_mappedSize(0), m_changed(false) {}
+
+  /**
+   * Destructor.
+   */
+  ~RowCache();
+
+  /**
+   * Memory map the entries from the cache file.
+   * @return true when the cache file was mapped successfully, false when it is missing or invalid.
+   */
+  bool load();
+
+  /**
+   * Write all entries used or added since @a load() to the cache file if anything was added and map it again.
+   * @return true on success or when nothing was added, false on error.
+   */
+  bool save();
+
+  /**
+   * Find the cached rows of a file that was not modified since being added.
+   * @param filename the relative name of the file.
+   * @param mtime the modification time of the file.
+   * @param length the length of the file.
+   * @param hash pointer to a variable in which to store the hash of the file content.
+   * @param size pointer to a variable in which to store the normalized size of the file content.
+   * @param rows the @a string in which to store the encoded rows for @a readRow().
+   * @return true when the rows were found.
+   */
+  bool find(const string& filename, time_t mtime, size_t length, size_t* hash, size_t* size, string* rows);
+
+  /**
+   * Add the rows of a file.
+   * @param filename the relative name of the file.
+   * @param mtime the modification time of the file.
+   * @param length the length of the file.
+   * @param hash the hash of the file content.
+   * @param size the normalized size of the file content.
+   * @param rows the rows encoded with @a appendRow().
+   */
+  void add(const string& filename, time_t mtime, size_t length, size_t hash, size_t size, const string& rows);
+
+  /**
+   * Encode a single row.
+   * @param lineNo the line number of the row.
+   * @param row the fields of the row.
+   * @param rows the @a string to append the encoded row to.
+   */
+  static void appendRow(unsigned int lineNo, const vector<string>& row, string* rows);
+
+  /**
+   * Decode a single row.
+   * @param pos pointer to the current position in the encoded rows (updated).
+   * @param end the end of the encoded rows.
+   * @param lineNo pointer to a variable in which to store the line number of the row.
+   * @param row the @a vector to clear and fill with the fields of the row.
+   * @return true when a row was decoded, false at the end or on invalid data.
+   */
+  static bool readRow(const char** pos, const char* end, unsigned int* lineNo, vector<string>* row);
+
+ private:
+  /** the name of the cache file. */
+  const string m_filename;
+
+  /** the memory mapped cache file content, or nullptr. */
+  char* m_mapped;
+
+  /** the size of the memory mapped cache file content. */
+  size_t m_mappedSize;
+
+  /** an entry in the mapped cache file. */
+  typedef struct {
+    const char* data;  //!< the entry data
+    size_t length;  //!< the length of the entry data
+    bool used;  //!< whether the entry was used since @a load()
+  } mappedEntry_t;
+
+  /** the entries from the mapped cache file by file name. */
+  map<string, mappedEntry_t> m_mappedEntries;
+
+  /** the entries added since @a load() by file name. */
+  map<string, string> m_addedEntries;
+
+  /** whether entries were added since @a load(). */
+  bool m_changed;
+
+  /** @a Mutex for access to the entries. */
+  Mutex m_mutex;
+};
+
 }  // namespace ebusd
 
 #endif  // LIB_EBUS_FILEREADER_H_
@@ -0,0 +1,198 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/ebus/history.h"
+
+namespace ebusd {
+
+/** the tag for unchanged symbols. */
+#define CHANGE_NONE 0
+
+/** the tag for a list of changed symbols with unchanged length. */
+#define CHANGE_PATCH 1
+
+/** the tag for completely replaced symbols. */
+#define CHANGE_FULL 2
+
+/**
+ * Append an unsigned number with variable length (7 bits per symbol, highest bit set for continuation).
+ * @param value the value to append.
+ * @param output the deque to append to.
+ */
+static void appendVarInt(size_t value, deque<symbol_t>* output) {
+  while (value >= 0x80) {
+    output->push_back(static_cast<symbol_t>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  output->push_back(static_cast<symbol_t>(value));
+}
+
+/**
+ * Read an unsigned number with variable length.
+ * @param input the deque to read from.
+ * @param pos the position to read at, updated to the position behind the number.
+ * @return the read value.
+ */
+static size_t readVarInt(const deque<symbol_t>& input, size_t* pos) {
+  size_t value = 0;
+  unsigned int shift = 0;
+  symbol_t symbol;
+  do {
+    symbol = input[(*pos)++];
+    value |= static_cast<size_t>(symbol & 0x7f) << shift;
+    shift += 7;
+  } while (symbol & 0x80);
+  return value;
+}
+
+/**
+ * Append the changes from one @a SymbolString to another.
+ * @param from the previous @a SymbolString.
+ * @param to the next @a SymbolString.
+ * @param output the deque to append to.
+ */
+static void encodeSymbols(const SymbolString& from, const SymbolString& to, deque<symbol_t>* output) {
+  size_t changed = 0;
+  if (from.size() == to.size()) {
+    for (size_t pos = 0; pos < to.size(); pos++) {
+      if (from[pos] != to[pos]) {
+        changed++;
+      }
+    }
+    if (changed == 0) {
+      output->push_back(CHANGE_NONE);
+      return;
+    }
+  }
+  if (from.size() == to.size() && changed * 2 < to.size()) {
+    output->push_back(CHANGE_PATCH);
+    appendVarInt(changed, output);
+    for (size_t pos = 0; pos < to.size(); pos++) {
+      if (from[pos] != to[pos]) {
+        appendVarInt(pos, output);
+        output->push_back(to[pos]);
+      }
+    }
+    return;
+  }
+  output->push_back(CHANGE_FULL);
+  appendVarInt(to.size(), output);
+  for (size_t pos = 0; pos < to.size(); pos++) {
+    output->push_back(to[pos]);
+  }
+}
+
+/**
+ * Apply the changes to a @a SymbolString.
+ * @param input the deque to read the changes from.
+ * @param pos the position to read at, updated to the position behind the changes.
+ * @param symbols the @a SymbolString to apply the changes to.
+ */
+static void decodeSymbols(const deque<symbol_t>& input, size_t* pos, SymbolString* symbols) {
+  symbol_t tag = input[(*pos)++];
+  if (tag == CHANGE_PATCH) {
+    size_t changed = readVarInt(input, pos);
+    for (size_t index = 0; index < changed; index++) {
+      size_t offset = readVarInt(input, pos);
+      (*symbols)[offset] = input[(*pos)++];
+    }
+  } else if (tag == CHANGE_FULL) {
+    size_t length = readVarInt(input, pos);
+    symbols->clear();
+    for (size_t index = 0; index < length; index++) {
+      symbols->push_back(input[(*pos)++]);
+    }
+  }
+}
+
+void DataHistory::add(time_t time, const MasterSymbolString& master, const SlaveSymbolString& slave) {
+  m_mutex.lock();
+  if (m_size == 0) {
+    m_oldest.time = time;
+    m_oldest.master = master;
+    m_oldest.slave = slave;
+    m_newest = m_oldest;
+    m_size = 1;
+    m_mutex.unlock();
+    return;
+  }
+  if (m_capacity == 1) {
+    m_newest.time = time;
+    m_newest.master = master;
+    m_newest.slave = slave;
+    m_oldest = m_newest;
+    m_mutex.unlock();
+    return;
+  }
+  historyEntry_t next;
+  next.time = time < m_newest.time ? m_newest.time : time;
+  next.master = master;
+  next.slave = slave;
+  encode(m_newest, next);
+  m_newest = next;
+  if (m_size < m_capacity) {
+    m_size++;
+    m_mutex.unlock();
+    return;
+  }
+  // drop the oldest entry by applying the changes to its successor
+  size_t pos = 0;
+  decode(&pos, &m_oldest);
+  m_changes.erase(m_changes.begin(), m_changes.begin() + static_cast<ssize_t>(pos));
+  m_mutex.unlock();
+}
+
+void DataHistory::clear() {
+  m_mutex.lock();
+  m_size = 0;
+  m_changes.clear();
+  m_mutex.unlock();
+}
+
+void DataHistory::getAll(time_t since, vector<historyEntry_t>* entries) const {
+  m_mutex.lock();
+  if (m_size == 0) {
+    m_mutex.unlock();
+    return;
+  }
+  historyEntry_t entry = m_oldest;
+  size_t pos = 0;
+  for (size_t index = 0; index < m_size; index++) {
+    if (index > 0) {
+      decode(&pos, &entry);
+    }
+    if (since == 0 || entry.time >= since) {
+      entries->push_back(entry);
+    }
+  }
+  m_mutex.unlock();
+}
+
+void DataHistory::encode(const historyEntry_t& from, const historyEntry_t& to) {
+  appendVarInt(static_cast<size_t>(to.time - from.time), &m_changes);
+  encodeSymbols(from.master, to.master, &m_changes);
+  encodeSymbols(from.slave, to.slave, &m_changes);
+}
+
+void DataHistory::decode(size_t* pos, historyEntry_t* entry) const {
+  entry->time += static_cast<time_t>(readVarInt(m_changes, pos));
+  decodeSymbols(m_changes, pos, &entry->master);
+  decodeSymbols(m_changes, pos, &entry->slave);
+}
+
+}  // namespace ebusd
@@ -0,0 +1,143 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_EBUS_HISTORY_H_
+#define LIB_EBUS_HISTORY_H_
+
+#include <time.h>
+#include <deque>
+#include <vector>
+#include "lib/ebus/symbol.h"
+#include "lib/utils/thread.h"
+
+namespace ebusd {
+
+/** \file lib/ebus/history.h */
+
+using std::deque;
+using std::vector;
+
+/** a single entry of a @a DataHistory. */
+typedef struct historyEntry {
+  time_t time;  //!< the time of the update
+  MasterSymbolString master;  //!< the master data
+  SlaveSymbolString slave;  //!< the slave data
+} historyEntry_t;
+
+
+/**
+ * A compact history of the last master and slave data of a @a Message.
+ * Only the oldest and the newest entry are kept in full, all entries in between are stored as changes to their
+ * respective predecessor (time difference plus changed symbols only).
+ * All methods are thread safe as entries are added by the bus thread while being read by others.
+ */
+class DataHistory {
+ public:
+  /**
+   * Construct a new instance.
+   * @param capacity the maximum number of entries to keep (at least 1).
+   */
+  explicit DataHistory(size_t capacity)
+    : m_capacity(capacity < 1 ? 1 : capacity), m_size(0) {}
+
+  /**
+   * Add an entry, dropping the oldest one if the capacity is reached.
+   * @param time the time of the update.
+   * @param master the master data.
+   * @param slave the slave data.
+   */
+  void add(time_t time, const MasterSymbolString& master, const SlaveSymbolString& slave);
+
+  /**
+   * Remove all entries.
+   */
+  void clear();
+
+  /**
+   * Decode all entries.
+   * @param since the time from which to return entries (inclusive), or 0 for all.
+   * @param entries the vector to add the entries to (oldest first).
+   */
+  void getAll(time_t since, vector<historyEntry_t>* entries) const;
+
+  /**
+   * Get the number of entries.
+   * @return the number of entries.
+   */
+  size_t size() const {
+    m_mutex.lock();
+    size_t ret = m_size;
+    m_mutex.unlock();
+    return ret;
+  }
+
+  /**
+   * Get the maximum number of entries.
+   * @return the maximum number of entries.
+   */
+  size_t getCapacity() const { return m_capacity; }
+
+  /**
+   * Get the number of bytes used for the changes stored between the oldest and the newest entry.
+   * @return the number of bytes used for the changes.
+   */
+  size_t getEncodedSize() const {
+    m_mutex.lock();
+    size_t ret = m_changes.size();
+    m_mutex.unlock();
+    return ret;
+  }
+
+
+ private:
+  /**
+   * Append the changes from one entry to the next.
+   * @param from the previous @a historyEntry_t.
+   * @param to the next @a historyEntry_t.
+   */
+  void encode(const historyEntry_t& from, const historyEntry_t& to);
+
+  /**
+   * Apply the changes starting at a position to an entry.
+   * @param pos the position in @a m_changes to start at, updated to the position of the next changes.
+   * @param entry the @a historyEntry_t to apply the changes to.
+   */
+  void decode(size_t* pos, historyEntry_t* entry) const;
+
+  /** the maximum number of entries. */
+  const size_t m_capacity;
+
+  /** the number of entries. */
+  size_t m_size;
+
+  /** the oldest entry (valid if @a m_size is at least 1). */
+  historyEntry_t m_oldest;
+
+  /** the newest entry (valid if @a m_size is at least 1). */
+  historyEntry_t m_newest;
+
+  /** the encoded changes from each entry to its successor starting with the oldest entry. */
+  deque<symbol_t> m_changes;
+
+  /** @a Mutex for accessing the entries. */
+  mutable Mutex m_mutex;
+};
+
+}  // namespace ebusd
+
+#endif  // LIB_EBUS_HISTORY_H_
@@ -0,0 +1,113 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/ebus/intern.h"
+#include <unordered_map>
+#include <tuple>
+#include "lib/utils/thread.h"
+#include "lib/utils/memusage.h"
+
+namespace ebusd {
+
+using std::unordered_map;
+
+/** the type of the global string pool (the nodes keep their address when rehashing). */
+typedef unordered_map<string, std::atomic<size_t>> StringPool;
+
+/**
+ * Get the global string pool.
+ * @return the global string pool (allocated once and never freed to be usable during static destruction).
+ */
+static StringPool* getPool() {
+  static StringPool* pool = new StringPool();
+  return pool;
+}
+
+/**
+ * Get the @a Mutex for access to the global string pool.
+ * @return the @a Mutex for access to the global string pool.
+ */
+static Mutex* getPoolMutex() {
+  static Mutex* mutex = new Mutex();
+  return mutex;
+}
+
+InternedString::PoolEntry* InternedString::intern(const string& str) {
+  if (str.empty()) {
+    return getEmpty();
+  }
+  Mutex* mutex = getPoolMutex();
+  mutex->lock();
+  StringPool* pool = getPool();
+  auto it = pool->find(str);
+  if (it == pool->end()) {
+    it = pool->emplace(std::piecewise_construct, std::forward_as_tuple(str), std::forward_as_tuple(0)).first;
+  }
+  PoolEntry* ret = &*it;
+  ret->second.fetch_add(1, std::memory_order_relaxed);
+  mutex->unlock();
+  return ret;
+}
+
+void InternedString::releaseLast() {
+  Mutex* mutex = getPoolMutex();
+  mutex->lock();
+  // new references from other instances are only added under the lock or while this one is still counted
+  if (m_entry->second.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    StringPool* pool = getPool();
+    pool->erase(pool->find(m_entry->first));
+  }
+  mutex->unlock();
+  m_entry = getEmpty();
+}
+
+bool InternedString::find(const string& str, InternedString* interned) {
+  if (str.empty()) {
+    *interned = InternedString();
+    return true;
+  }
+  Mutex* mutex = getPoolMutex();
+  mutex->lock();
+  StringPool* pool = getPool();
+  const auto it = pool->find(str);
+  PoolEntry* entry = nullptr;
+  if (it != pool->end()) {
+    entry = &*it;
+    entry->second.fetch_add(1, std::memory_order_relaxed);
+  }
+  mutex->unlock();
+  if (!entry) {
+    return false;
+  }
+  *interned = InternedString(entry);  // released the previous one outside of the lock
+  return true;
+}
+
+size_t InternedString::getPoolMemoryUsage() {
+  Mutex* mutex = getPoolMutex();
+  mutex->lock();
+  const StringPool* pool = getPool();
+  size_t ret = pool->bucket_count()*sizeof(void*);
+  for (const auto& entry : *pool) {
+    ret += memUsageNode(sizeof(entry)) + memUsage(entry.first);
+  }
+  mutex->unlock();
+  return ret;
+}
+
+}  // namespace ebusd
@@ -0,0 +1,292 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_EBUS_INTERN_H_
+#define LIB_EBUS_INTERN_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <ostream>
+#include <utility>
+
+namespace ebusd {
+
+/** \file lib/ebus/intern.h */
+
+using std::string;
+using std::ostream;
+
+/**
+ * An immutable string stored only once in a global pool shared by all instances with the same content.
+ * Copying and comparing for equality only deals with the pointer to the pooled string, so this is meant for the
+ * limited vocabulary of configuration items (names, circuits, units, comments).
+ * Pooled strings are reference counted and removed from the pool together with the last instance referencing
+ * them, e.g. when the messages of a previous configuration are deleted on reload. The empty string is not pooled.
+ */
+class InternedString {
+ public:
+  /**
+   * Construct a new instance with the empty string.
+   */
+  InternedString() : m_entry(getEmpty()) {}
+
+  /**
+   * Construct a new instance (implicitly in place of a plain string).
+   * @param str the string to intern.
+   */
+  InternedString(const string& str) : m_entry(intern(str)) {}  // NOLINT(runtime/explicit)
+
+  /**
+   * Copy constructor.
+   * @param other the instance to copy from.
+   */
+  InternedString(const InternedString& other) : m_entry(other.m_entry) { addRef(); }
+
+  /**
+   * Move constructor.
+   * @param other the instance to move from (reset to the empty string).
+   */
+  InternedString(InternedString&& other) : m_entry(other.m_entry) { other.m_entry = getEmpty(); }
+
+  /**
+   * Destructor.
+   */
+  ~InternedString() { release(); }
+
+  /**
+   * Assign from another instance.
+   * @param other the instance to copy from.
+   * @return this instance.
+   */
+  InternedString& operator=(const InternedString& other) {
+    if (m_entry != other.m_entry) {
+      other.addRef();
+      release();
+      m_entry = other.m_entry;
+    }
+    return *this;
+  }
+
+  /**
+   * Move assign from another instance.
+   * @param other the instance to move from (swapped with this instance).
+   * @return this instance.
+   */
+  InternedString& operator=(InternedString&& other) {
+    std::swap(m_entry, other.m_entry);
+    return *this;
+  }
+
+  /**
+   * Find the already pooled instance of a string without adding it to the pool.
+   * @param str the string to find.
+   * @param interned the @a InternedString in which to store the found instance.
+   * @return true if the string was found in the pool, false otherwise (i.e. no instance with that content exists).
+   */
+  static bool find(const string& str, InternedString* interned);
+
+  /**
+   * Get the estimated heap memory used by the global string pool.
+   * @return the estimated number of bytes used by the pool.
+   */
+  static size_t getPoolMemoryUsage();
+
+  /**
+   * Get the pooled string.
+   * @return the pooled string.
+   */
+  const string& str() const { return m_entry->first; }
+
+  /**
+   * Get the pooled string.
+   * @return the pooled string.
+   */
+  operator const string&() const { return m_entry->first; }  // NOLINT(runtime/explicit)
+
+  /**
+   * Get the unique ID of the pooled string.
+   * @return the unique ID of the pooled string.
+   */
+  uintptr_t getId() const { return reinterpret_cast<uintptr_t>(m_entry); }
+
+  /**
+   * Get the pooled string as C string.
+   * @return the pooled string as C string.
+   */
+  const char* c_str() const { return m_entry->first.c_str(); }
+
+  /**
+   * Get the length of the pooled string.
+   * @return the length of the pooled string.
+   */
+  size_t length() const { return m_entry->first.length(); }
+
+  /**
+   * Return whether the pooled string is empty.
+   * @return whether the pooled string is empty.
+   */
+  bool empty() const { return m_entry->first.empty(); }
+
+  /**
+   * Compare for equality with another instance.
+   * @param other the other @a InternedString.
+   * @return true if both have the same content.
+   */
+  bool operator==(const InternedString& other) const { return m_entry == other.m_entry; }
+
+  /**
+   * Compare for inequality with another instance.
+   * @param other the other @a InternedString.
+   * @return true if both have different content.
+   */
+  bool operator!=(const InternedString& other) const { return m_entry != other.m_entry; }
+
+  /**
+   * Compare for equality with a plain string.
+   * @param other the plain string.
+   * @return true if both have the same content.
+   */
+  bool operator==(const string& other) const { return m_entry->first == other; }
+
+  /**
+   * Compare for inequality with a plain string.
+   * @param other the plain string.
+   * @return true if both have different content.
+   */
+  bool operator!=(const string& other) const { return m_entry->first != other; }
+
+  /**
+   * Compare for equality with a C string.
+   * @param other the C string.
+   * @return true if both have the same content.
+   */
+  bool operator==(const char* other) const { return m_entry->first == other; }
+
+  /**
+   * Compare for inequality with a C string.
+   * @param other the C string.
+   * @return true if both have different content.
+   */
+  bool operator!=(const char* other) const { return m_entry->first != other; }
+
+
+ private:
+  /** the pooled string with the number of instances referencing it. */
+  typedef std::pair<const string, std::atomic<size_t>> PoolEntry;
+
+  /**
+   * Construct a new instance taking over an already counted reference.
+   * @param entry the @a PoolEntry.
+   */
+  explicit InternedString(PoolEntry* entry) : m_entry(entry) {}
+
+  /**
+   * Get the entry of the empty string (not part of the pool and not reference counted).
+   * @return the entry of the empty string (allocated once and never freed to be usable during static destruction).
+   */
+  static PoolEntry* getEmpty() {
+    static PoolEntry* entry = new PoolEntry("", 0);
+    return entry;
+  }
+
+  /**
+   * Get the pooled instance of a string with an added reference, adding it to the pool if necessary.
+   * @param str the string to intern.
+   * @return the @a PoolEntry.
+   */
+  static PoolEntry* intern(const string& str);
+
+  /**
+   * Add a reference to the pooled string.
+   */
+  void addRef() const {
+    if (m_entry != getEmpty()) {
+      m_entry->second.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Remove the reference to the pooled string.
+   */
+  void release() {
+    if (m_entry == getEmpty()) {
+      return;
+    }
+    size_t refs = m_entry->second.load(std::memory_order_relaxed);
+    while (refs > 1) {
+      if (m_entry->second.compare_exchange_weak(refs, refs - 1, std::memory_order_release,
+          std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    releaseLast();
+  }
+
+  /**
+   * Remove the possibly last reference to the pooled string under the pool lock and remove it from the pool then.
+   */
+  void releaseLast();
+
+  /** the @a PoolEntry of the pooled string. */
+  PoolEntry* m_entry;
+};
+
+/**
+ * Write the pooled string to the @a ostream.
+ * @param stream the @a ostream to write to.
+ * @param str the @a InternedString to write.
+ * @return the @a ostream.
+ */
+inline ostream& operator<<(ostream& stream, const InternedString& str) { return stream << str.str(); }
+
+/**
+ * Compare a plain string for equality with an @a InternedString.
+ * @param str the plain string.
+ * @param other the @a InternedString.
+ * @return true if both have the same content.
+ */
+inline bool operator==(const string& str, const InternedString& other) { return other == str; }
+
+/**
+ * Compare a plain string for inequality with an @a InternedString.
+ * @param str the plain string.
+ * @param other the @a InternedString.
+ * @return true if both have different content.
+ */
+inline bool operator!=(const string& str, const InternedString& other) { return other != str; }
+
+/**
+ * Compare a C string for equality with an @a InternedString.
+ * @param str the C string.
+ * @param other the @a InternedString.
+ * @return true if both have the same content.
+ */
+inline bool operator==(const char* str, const InternedString& other) { return other == str; }
+
+/**
+ * Compare a C string for inequality with an @a InternedString.
+ * @param str the C string.
+ * @param other the @a InternedString.
+ * @return true if both have different content.
+ */
+inline bool operator!=(const char* str, const InternedString& other) { return other != str; }
+
+}  // namespace ebusd
+
+#endif  // LIB_EBUS_INTERN_H_
@@ -23,9 +23,13 @@
 #include <locale>
 #include <iomanip>
 #include <climits>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_set>
 #include "lib/ebus/data.h"
 #include "lib/ebus/result.h"
 #include "lib/ebus/symbol.h"
+#include "lib/utils/memusage.h"
 
 namespace ebusd {
 
@@ -69,6 +73,12 @@ using std::endl;
 /** the maximum poll priority for a @a Message referred to by a @a Condition. */
 #define POLL_PRIORITY_CONDITION 5
 
+/** the number of consecutive unchanged polls after which the poll back off factor is increased. */
+#define POLL_BACKOFF_POLLS 4
+
+/** the maximum poll back off factor for messages that did not change for a while. */
+#define POLL_MAX_BACKOFF 4
+
 /** the field name constant for the message level. */
 static const char* FIELNAME_LEVEL = "level";
 
@@ -91,26 +101,42 @@ static const char* defaultMessageFieldMap[] = {  // access level not included in
     "*name", "part", "type", "divisor/values", "unit", "comment",
 };
 
+/**
+ * Get the interned lower case variant of a string.
+ * @param str the string to convert.
+ * @return the interned lower case string.
+ */
+static InternedString toLower(const string& str) {
+  string lower = str;
+  FileReader::tolower(&lower);
+  return InternedString(lower);
+}
+
 /** the m_pollOrder of the last polled message. */
 static unsigned int g_lastPollOrder = 0;
 
 
-Message::Message(const string& filename, const string& circuit, const string& level, const string& name,
-    bool isWrite, bool isPassive, const map<string, string>& attributes,
+Message::Message(const InternedString& filename, const InternedString& circuit, const InternedString& level,
+    const InternedString& name, bool isWrite, bool isPassive, const map<string, InternedString>& attributes,
     symbol_t srcAddress, symbol_t dstAddress,
     const vector<symbol_t>& id,
     const DataField* data, bool deleteData,
     size_t pollPriority,
     Condition* condition)
     : AttributedItem(name, attributes),
-      m_filename(filename), m_circuit(circuit), m_level(level), m_isWrite(isWrite),
+      m_filename(filename), m_circuit(circuit), m_lowerCircuit(toLower(circuit)), m_lowerName(toLower(name)),
+      m_level(level), m_isWrite(isWrite),
       m_isPassive(isPassive),
       m_srcAddress(srcAddress), m_dstAddress(dstAddress),
       m_id(id), m_key(createKey(id, isWrite, isPassive, srcAddress, dstAddress)),
       m_data(data), m_deleteData(deleteData),
       m_pollPriority(pollPriority),
-      m_usedByCondition(false), m_isScanMessage(false), m_condition(condition),
-      m_dataHandlerState(0), m_lastUpdateTime(0), m_lastChangeTime(0), m_pollOrder(0), m_lastPollTime(0) {
+      m_usedByCondition(false), m_isScanMessage(false), m_condition(condition), m_history(nullptr),
+      m_dataHandlerState(0), m_lastUpdateTime(0), m_lastChangeTime(0), m_pollOrder(0), m_lastPollTime(0),
+      m_lastPassiveUpdateTime(0), m_passiveUpdateInterval(0), m_unchangedPollCount(0), m_pollLatency(0),
+      m_polledLatency(0), m_dataVersion(0), m_changeVersion(0),
+      m_jsonCacheVersion(0), m_jsonCacheArgs(0), m_jsonCacheFormat(OF_NONE),
+      m_nextSibling(this) {
   if (circuit == "scan") {
     setScanMessage();
     m_pollPriority = 0;
@@ -123,14 +149,19 @@ Message::Message(const string& circuit, const string& level, const string& name,
     bool broadcast, const DataField* data, bool deleteData)
     : AttributedItem(name),
       m_filename(""),
-      m_circuit(circuit), m_level(level), m_isWrite(broadcast),
+      m_circuit(circuit), m_lowerCircuit(toLower(circuit)), m_lowerName(toLower(name)),
+      m_level(level), m_isWrite(broadcast),
       m_isPassive(false),
       m_srcAddress(SYN), m_dstAddress(broadcast ? BROADCAST : SYN),
       m_id({pb, sb}), m_key(createKey(pb, sb, broadcast)),
       m_data(data), m_deleteData(deleteData),
       m_pollPriority(0),
-      m_usedByCondition(false), m_isScanMessage(true), m_condition(nullptr),
-      m_lastUpdateTime(0), m_lastChangeTime(0), m_pollOrder(0), m_lastPollTime(0) {
+      m_usedByCondition(false), m_isScanMessage(true), m_condition(nullptr), m_history(nullptr),
+      m_lastUpdateTime(0), m_lastChangeTime(0), m_pollOrder(0), m_lastPollTime(0),
+      m_lastPassiveUpdateTime(0), m_passiveUpdateInterval(0), m_unchangedPollCount(0), m_pollLatency(0),
+      m_polledLatency(0), m_dataVersion(0), m_changeVersion(0),
+      m_jsonCacheVersion(0), m_jsonCacheArgs(0), m_jsonCacheFormat(OF_NONE),
+      m_nextSibling(this) {
   time(&m_createTime);
 }
 
@@ -469,6 +500,7 @@ result_t Message::create(const string& filename, const DataFieldTemplates* templ
   }
   unsigned int index = 0;
   bool multiple = dstAddresses.size() > 1;
+  map<string, InternedString> attributes = AttributedItem::internAttributes(*row);
   char num[10];
   for (const auto dstAddress : dstAddresses) {
     string useCircuit = circuit;
@@ -478,11 +510,11 @@ result_t Message::create(const string& filename, const DataFieldTemplates* templ
     }
     Message* message;
     if (chainIds.size() > 1) {
-      message = new ChainedMessage(filename, useCircuit, level, name, isWrite, *row, srcAddress, dstAddress, id,
+      message = new ChainedMessage(filename, useCircuit, level, name, isWrite, attributes, srcAddress, dstAddress, id,
                                    chainIds, chainLengths, data, index == 0, pollPriority, condition);
     } else {
-      message = new Message(filename, useCircuit, level, name, isWrite, isPassive, *row, srcAddress, dstAddress, id,
-                            data, index == 0, pollPriority, condition);
+      message = new Message(filename, useCircuit, level, name, isWrite, isPassive, attributes, srcAddress, dstAddress,
+                            id, data, index == 0, pollPriority, condition);
     }
     messages->push_back(message);
     index++;
@@ -519,7 +551,7 @@ bool Message::extractFieldNames(const string& str, bool checkAbbreviated, vector
 }
 
 Message* Message::derive(symbol_t dstAddress, symbol_t srcAddress, const string& circuit) const {
-  Message* result = new Message(m_filename, circuit.length() == 0 ? m_circuit : circuit, m_level, m_name,
+  Message* result = new Message(m_filename, circuit.empty() ? m_circuit : InternedString(circuit), m_level, m_name,
     m_isWrite, m_isPassive, m_attributes,
     srcAddress == SYN ? m_srcAddress : srcAddress, dstAddress,
     m_id, m_data, false,
@@ -635,9 +667,49 @@ bool Message::isLessPollWeight(const Message* other) const {
   if (m_pollPriority < other->m_pollPriority) {
     return false;
   }
+  if (m_pollLatency != other->m_pollLatency) {
+    return m_pollLatency > other->m_pollLatency;  // prefer the one occupying the bus for a shorter time
+  }
   return m_lastPollTime > other->m_lastPollTime;
 }
 
+void Message::setPassiveUpdate(time_t now) {
+  if (m_lastPassiveUpdateTime > 0 && now > m_lastPassiveUpdateTime) {
+    auto interval = static_cast<unsigned int>(now - m_lastPassiveUpdateTime);
+    m_passiveUpdateInterval = m_passiveUpdateInterval == 0 ? interval : (3 * m_passiveUpdateInterval + interval) / 4;
+  }
+  m_lastPassiveUpdateTime = now;
+}
+
+void Message::setPolled(bool changed, unsigned int latency) {
+  m_unchangedPollCount = changed ? 0 : m_unchangedPollCount + 1;
+  // not applied to m_pollLatency directly as that is part of the poll weight while queued
+  m_polledLatency = latency == 0 ? 1 : latency;
+}
+
+unsigned int Message::getPollBackoff() const {
+  unsigned int backoff = 1 + m_unchangedPollCount / POLL_BACKOFF_POLLS;
+  return backoff > POLL_MAX_BACKOFF ? POLL_MAX_BACKOFF : backoff;
+}
+
+bool Message::isRecentlyUpdated(time_t now, unsigned int pollInterval) const {
+  if (m_lastUpdateTime > 0 && difftime(now, m_lastUpdateTime) <= pollInterval) {
+    return true;
+  }
+  if (m_lastPassiveUpdateTime == 0) {
+    return false;
+  }
+  double age = difftime(now, m_lastPassiveUpdateTime);
+  double period = static_cast<double>(pollInterval * m_pollPriority);
+  return age < period || (m_passiveUpdateInterval > 0 && m_passiveUpdateInterval < period
+      && age < 2 * m_passiveUpdateInterval);
+}
+
+bool Message::isPollDue(time_t now, unsigned int pollInterval) const {
+  time_t last = m_lastUpdateTime > m_lastPollTime ? m_lastUpdateTime : m_lastPollTime;
+  return difftime(now, last) >= static_cast<double>(pollInterval * m_pollPriority * getPollBackoff());
+}
+
 void Message::setUsedByCondition() {
   if (m_usedByCondition) {
     return;
@@ -652,6 +724,24 @@ bool Message::isAvailable() {
   return (m_condition == nullptr) || m_condition->isTrue();
 }
 
+size_t Message::getMemoryUsage() const {
+  size_t ret = sizeof(Message) + getAttributesMemoryUsage() + m_id.capacity()
+    + m_lastMasterData.getHeapSize() + m_lastSlaveData.getHeapSize() + memUsage(m_jsonCache);
+  if (m_deleteData) {
+    ret += m_data->getMemoryUsage();
+  }
+  if (m_history) {
+    ret += sizeof(DataHistory) + m_history->getEncodedSize();
+  }
+  Mutex* mutex = const_cast<Mutex*>(&m_preparedMastersMutex);
+  mutex->lock();
+  for (const auto& it : m_preparedMasters) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first) + it.second.getHeapSize();
+  }
+  mutex->unlock();
+  return ret;
+}
+
 bool Message::hasField(const char* fieldName, bool numeric) const {
   return m_data->hasField(fieldName, numeric);
 }
@@ -688,6 +778,28 @@ result_t Message::prepareMasterPart(size_t index, char separator, istringstream*
   if (index != 0) {
     return RESULT_ERR_NOTFOUND;
   }
+  // the encoded part only depends on the definition and the remaining input (if the stream is still usable)
+  bool cacheable = input->rdstate() == std::ios::goodbit;
+  string key;
+  if (cacheable) {
+    key = input->str();
+    std::streampos pos = input->tellg();
+    if (pos > 0) {
+      key.erase(0, static_cast<size_t>(pos));
+    }
+    key.push_back(separator);
+    m_preparedMastersMutex.lock();
+    const auto it = m_preparedMasters.find(key);
+    if (it != m_preparedMasters.end()) {
+      for (size_t i = 0; i < it->second.size(); i++) {
+        master->push_back(it->second[i]);
+      }
+      m_preparedMastersMutex.unlock();
+      return RESULT_OK;
+    }
+    m_preparedMastersMutex.unlock();
+  }
+  size_t start = master->size();
   master->push_back(0);  // length, will be set later
   for (size_t i = 2; i < m_id.size(); i++) {
     master->push_back(m_id[i]);
@@ -697,6 +809,18 @@ result_t Message::prepareMasterPart(size_t index, char separator, istringstream*
     return result;
   }
   master->adjustHeader();
+  if (cacheable) {
+    MasterSymbolString prepared;
+    for (size_t i = start; i < master->size(); i++) {
+      prepared.push_back((*master)[i]);
+    }
+    m_preparedMastersMutex.lock();
+    if (m_preparedMasters.size() >= MAX_PREPARED_MASTERS) {
+      m_preparedMasters.clear();  // simply start over, e.g. for varying write values
+    }
+    m_preparedMasters[key] = std::move(prepared);
+    m_preparedMastersMutex.unlock();
+  }
   return result;
 }
 
@@ -712,9 +836,11 @@ result_t Message::prepareSlave(istringstream* input, SlaveSymbolString* slave) {
   }
   slave->adjustHeader();
   time(&m_lastUpdateTime);
+  m_dataVersion++;
   if (*slave != m_lastSlaveData) {
     m_lastChangeTime = m_lastUpdateTime;
     m_lastSlaveData = *slave;
+    m_changeVersion++;
   }
   return result;
 }
@@ -732,10 +858,12 @@ result_t Message::storeLastData(size_t index, const MasterSymbolString& data) {
       || data.getDataSize() + 2 > m_id.size())) {
     time(&m_lastUpdateTime);
   }
+  m_dataVersion++;
   switch (data.compareTo(m_lastMasterData)) {
   case 1:  // completely different
     m_lastChangeTime = m_lastUpdateTime;
     m_lastMasterData = data;
+    m_changeVersion++;
     break;
   case 2:  // only master address is different
     m_lastMasterData = data;
@@ -749,13 +877,41 @@ result_t Message::storeLastData(size_t index, const SlaveSymbolString& data) {
   if (data.size() > 0) {
     time(&m_lastUpdateTime);
   }
+  m_dataVersion++;
   if (m_lastSlaveData != data) {
     m_lastChangeTime = m_lastUpdateTime;
     m_lastSlaveData = data;
+    m_changeVersion++;
+  }
+  if (m_history && data.size() > 0) {
+    m_history->add(m_lastUpdateTime, m_lastMasterData, m_lastSlaveData);
   }
   return RESULT_OK;
 }
 
+void Message::takeLastData(const Message& other) {
+  m_lastMasterData = other.m_lastMasterData;
+  m_lastSlaveData = other.m_lastSlaveData;
+  m_lastUpdateTime = other.m_lastUpdateTime;
+  m_lastChangeTime = other.m_lastChangeTime;
+  m_lastPassiveUpdateTime = other.m_lastPassiveUpdateTime;
+  m_passiveUpdateInterval = other.m_passiveUpdateInterval;
+  m_unchangedPollCount = other.m_unchangedPollCount;
+  m_dataVersion++;
+  if (m_lastChangeTime != 0) {
+    m_changeVersion++;
+  }
+}
+
+void Message::restoreLastData(time_t lastUpdateTime, const MasterSymbolString& master,
+    const SlaveSymbolString& slave) {
+  m_lastMasterData = master;
+  m_lastSlaveData = slave;
+  m_lastUpdateTime = m_lastChangeTime = lastUpdateTime;
+  m_dataVersion++;
+  m_changeVersion++;
+}
+
 result_t Message::decodeLastData(bool master, bool leadingSeparator, const char* fieldName,
     ssize_t fieldIndex, OutputFormat outputFormat, ostream* output) const {
   result_t result;
@@ -777,8 +933,14 @@ result_t Message::decodeLastData(bool master, bool leadingSeparator, const char*
 
 result_t Message::decodeLastData(bool leadingSeparator, const char* fieldName,
     ssize_t fieldIndex, const OutputFormat outputFormat, ostream* output) const {
+  return decodeData(m_lastMasterData, m_lastSlaveData, leadingSeparator, fieldName, fieldIndex, outputFormat,
+      output);
+}
+
+result_t Message::decodeData(const MasterSymbolString& master, const SlaveSymbolString& slave, bool leadingSeparator,
+    const char* fieldName, ssize_t fieldIndex, OutputFormat outputFormat, ostream* output) const {
   ostream::pos_type startPos = output->tellp();
-  result_t result = m_data->read(m_lastMasterData, getIdLength(), leadingSeparator, fieldName, fieldIndex,
+  result_t result = m_data->read(master, getIdLength(), leadingSeparator, fieldName, fieldIndex,
       outputFormat, -1, output);
   if (result < RESULT_OK) {
     return result;
@@ -794,7 +956,7 @@ result_t Message::decodeLastData(bool leadingSeparator, const char* fieldName,
   }
   if (!skipSlaveData) {
     bool useLeadingSeparator = leadingSeparator || output->tellp() > startPos;
-    result = m_data->read(m_lastSlaveData, 0, useLeadingSeparator, fieldName, fieldIndex, outputFormat, -1, output);
+    result = m_data->read(slave, 0, useLeadingSeparator, fieldName, fieldIndex, outputFormat, -1, output);
     if (result < RESULT_OK) {
       return result;
     }
@@ -808,6 +970,144 @@ result_t Message::decodeLastData(bool leadingSeparator, const char* fieldName,
   return result;
 }
 
+void Message::setHistorySize(size_t size) {
+  if (m_history && m_history->getCapacity() == size) {
+    return;
+  }
+  if (m_history) {
+    delete m_history;
+    m_history = nullptr;
+  }
+  if (size > 0) {
+    m_history = new DataHistory(size);
+  }
+}
+
+result_t Message::decodeHistory(time_t since, const char* fieldName, ssize_t fieldIndex, OutputFormat outputFormat,
+    ostream* output) const {
+  if (!m_history || m_history->size() == 0) {
+    return RESULT_EMPTY;
+  }
+  vector<historyEntry_t> entries;
+  m_history->getAll(since, &entries);
+  bool json = outputFormat & OF_JSON;
+  if (json) {
+    *output << "[";
+  }
+  bool first = true;
+  for (const auto& entry : entries) {
+    if (json) {
+      *output << (first ? "\n" : ",\n") << " {\"time\": " << entry.time << ", \"fields\": {";
+    } else {
+      if (!first) {
+        *output << "\n";
+      }
+      *output << entry.time << " ";
+    }
+    first = false;
+    result_t result = decodeData(entry.master, entry.slave, false, fieldName, fieldIndex, outputFormat, output);
+    if (result < RESULT_OK) {
+      return result;
+    }
+    if (json) {
+      *output << "\n }}";
+    }
+  }
+  if (json) {
+    *output << (first ? "]" : "\n]");
+  }
+  return RESULT_OK;
+}
+
+result_t Message::decodeLastDataValues(vector<fieldValue_t>* values) const {
+  size_t count = m_data->getCount();
+  values->resize(count);
+  for (size_t index = 0; index < count; index++) {
+    fieldValue_t& value = (*values)[index];
+    value.field = m_data->getField(static_cast<ssize_t>(index));
+    value.type = fvt_null;
+    value.rawValue = 0;
+  }
+  if (count == 0) {
+    return RESULT_EMPTY;
+  }
+  // both parts are read even if one fails so that the fields decoded successfully are available
+  result_t masterResult = m_data->readValues(m_lastMasterData, getIdLength(), values->data());
+  bool empty = masterResult == RESULT_EMPTY;
+  result_t result = m_data->readValues(m_lastSlaveData, 0, values->data());
+  if (result < RESULT_OK) {
+    return result;
+  }
+  if (masterResult < RESULT_OK) {
+    return masterResult;
+  }
+  if (result == RESULT_EMPTY && !empty) {
+    result = RESULT_OK;  // OK if at least one part was non-empty
+  }
+  return result;
+}
+
+/**
+ * Append a single decoded field value as CBOR data item.
+ * @param value the decoded @a fieldValue_t.
+ * @param numeric whether to output the raw numeric value of value=name pairs.
+ * @param output the @a ostream to append to.
+ */
+static void appendCborValue(const fieldValue_t& value, bool numeric, ostream* output) {
+  switch (value.type) {
+  case fvt_integer:
+    appendCborInt(value.intValue, output);
+    break;
+  case fvt_float:
+    appendCborFloat(value.floatValue, output);
+    break;
+  case fvt_string:
+    if (numeric && value.field->isList()) {
+      appendCborInt(value.intValue, output);
+    } else {
+      appendCborText(value.stringValue, output);
+    }
+    break;
+  default:
+    output->put(static_cast<char>(CBOR_NULL));
+    break;
+  }
+}
+
+result_t Message::decodeLastDataCbor(ssize_t fieldIndex, OutputFormat outputFormat, ostream* output) const {
+  vector<fieldValue_t> values;
+  result_t result = decodeLastDataValues(&values);
+  if (result < RESULT_OK) {
+    return result;
+  }
+  bool numeric = outputFormat & OF_NUMERIC;
+  if (fieldIndex >= 0) {
+    if ((size_t)fieldIndex >= values.size()) {
+      return RESULT_ERR_NOTFOUND;
+    }
+    appendCborValue(values[fieldIndex], numeric, output);
+    return RESULT_OK;
+  }
+  bool names = outputFormat & OF_NAMES;
+  for (size_t index = 0; names && index < values.size(); index++) {
+    const string& name = values[index].field->getName(-1);
+    names = !name.empty();
+    for (size_t other = 0; names && other < index; other++) {
+      names = values[other].field->getName(-1) != name;
+    }
+  }
+  appendCborHead(CBOR_MAP, values.size(), output);
+  for (size_t index = 0; index < values.size(); index++) {
+    if (names) {
+      appendCborText(values[index].field->getName(-1), output);
+    } else {
+      appendCborHead(CBOR_UNSIGNED, index, output);
+    }
+    appendCborValue(values[index], numeric, output);
+  }
+  return RESULT_OK;
+}
+
 result_t Message::decodeLastDataNumField(const char* fieldName, ssize_t fieldIndex, unsigned int* output) const {
   result_t result = m_data->read(m_lastMasterData, getIdLength(), fieldName, fieldIndex, output);
   if (result < RESULT_OK) {
@@ -947,20 +1247,14 @@ void Message::decodeJson(bool leadingSeparator, bool appendDirectionCondition, b
     *output << ",\n";
   }
   *output << "   \"";
-  *output << getName();
-  if (appendDirectionCondition) {
-    if (isPassive()) {
-      *output << "-u";
-    } else if (isWrite()) {
-      *output << "-w";
-    }
-    if (isConditional()) {
-      m_condition->dump(false, output);
-    }
-  }
+  ostringstream key;
+  dumpKey(appendDirectionCondition, &key);
+  appendJsonEscaped(key.str(), output);
   bool withDefinition = outputFormat & OF_DEFINITION;
   *output << "\": {"
-          << "\n    \"name\": \"" << getName() << "\""
+          << "\n    \"name\": \"";
+  appendJsonEscaped(getName(), output);
+  *output << "\""
           << ",\n    \"passive\": " << (isPassive() ? "true" : "false")
           << ",\n    \"write\": " << (isWrite() ? "true" : "false");
   if (outputFormat & OF_ALL_ATTRS) {
@@ -1022,6 +1316,64 @@ void Message::decodeJson(bool leadingSeparator, bool appendDirectionCondition, b
   *output << "\n   }";
 }
 
+void Message::decodeJsonCached(bool leadingSeparator, bool appendDirectionCondition, bool withData, bool addRaw,
+                               OutputFormat outputFormat, ostringstream* output) const {
+  if (leadingSeparator) {
+    *output << ",\n";
+  }
+  unsigned int version = m_dataVersion;
+  size_t args = (appendDirectionCondition ? 1 : 0) | (withData ? 2 : 0) | (addRaw ? 4 : 0) | (m_pollPriority << 3);
+  if (m_jsonCache.empty() || version != m_jsonCacheVersion || args != m_jsonCacheArgs
+      || outputFormat != m_jsonCacheFormat) {
+    ostringstream fragment;
+    decodeJson(false, appendDirectionCondition, withData, addRaw, outputFormat, &fragment);
+    m_jsonCache = fragment.str();
+    m_jsonCacheVersion = version;
+    m_jsonCacheArgs = args;
+    m_jsonCacheFormat = outputFormat;
+  }
+  *output << m_jsonCache;
+}
+
+void Message::decodeCbor(bool appendDirectionCondition, OutputFormat outputFormat, ostream* output) const {
+  if (appendDirectionCondition) {
+    ostringstream key;
+    dumpKey(true, &key);
+    appendCborText(key.str(), output);
+  } else {
+    appendCborText(getName(), output);
+  }
+  output->put(static_cast<char>(CBOR_MAP_INDEFINITE));
+  appendCborText("lastup", output);
+  appendCborInt(getLastUpdateTime(), output);
+  if (getLastUpdateTime() != 0) {
+    ostringstream fields;
+    result_t dret = decodeLastDataCbor(-1, outputFormat, &fields);
+    if (dret == RESULT_OK) {
+      appendCborText("fields", output);
+      *output << fields.str();
+    } else {
+      appendCborText("decodeerror", output);
+      appendCborText(getResultCode(dret), output);
+    }
+  }
+  output->put(static_cast<char>(CBOR_BREAK));
+}
+
+void Message::dumpKey(bool appendDirectionCondition, ostream* output) const {
+  *output << getName();
+  if (appendDirectionCondition) {
+    if (isPassive()) {
+      *output << "-u";
+    } else if (isWrite()) {
+      *output << "-w";
+    }
+    if (isConditional()) {
+      m_condition->dump(false, output);
+    }
+  }
+}
+
 bool Message::setDataHandlerState(int state, bool addBits) {
   if (addBits ? state == (m_dataHandlerState&state) : state == m_dataHandlerState) {
     return false;
@@ -1031,8 +1383,9 @@ bool Message::setDataHandlerState(int state, bool addBits) {
 }
 
 
-ChainedMessage::ChainedMessage(const string& filename, const string& circuit, const string& level, const string& name,
-    bool isWrite, const map<string, string>& attributes,
+ChainedMessage::ChainedMessage(const InternedString& filename, const InternedString& circuit,
+    const InternedString& level, const InternedString& name, bool isWrite,
+    const map<string, InternedString>& attributes,
     symbol_t srcAddress, symbol_t dstAddress,
     const vector<symbol_t>& id,
     const vector< vector<symbol_t> >& ids, const vector<size_t>& lengths,
@@ -1069,7 +1422,8 @@ ChainedMessage::~ChainedMessage() {
 }
 
 Message* ChainedMessage::derive(symbol_t dstAddress, symbol_t srcAddress, const string& circuit) const {
-  ChainedMessage* result = new ChainedMessage(m_filename, circuit.length() == 0 ? m_circuit : circuit, m_level, m_name,
+  ChainedMessage* result = new ChainedMessage(m_filename, circuit.empty() ? m_circuit : InternedString(circuit),
+    m_level, m_name,
     m_isWrite, m_attributes,
     srcAddress == SYN ? m_srcAddress : srcAddress, dstAddress,
     m_id, m_ids, m_lengths, m_data, false,
@@ -1111,6 +1465,16 @@ bool ChainedMessage::checkId(const MasterSymbolString& master, size_t* index) co
   return false;
 }
 
+size_t ChainedMessage::getMemoryUsage() const {
+  size_t ret = Message::getMemoryUsage() - sizeof(Message) + sizeof(ChainedMessage)
+    + m_ids.capacity()*sizeof(vector<symbol_t>) + m_lengths.capacity()*sizeof(size_t);
+  for (size_t index = 0; index < m_ids.size(); index++) {
+    ret += m_ids[index].capacity() + 2*sizeof(time_t) + sizeof(MasterSymbolString) + sizeof(SlaveSymbolString)
+      + m_lastMasterDatas[index]->getHeapSize() + m_lastSlaveDatas[index]->getHeapSize();
+  }
+  return ret;
+}
+
 bool ChainedMessage::checkId(const Message& other) const {
   size_t idLen = getIdLength();
   if (idLen != other.getIdLength() || other.getCount() == 1) {  // only equal for chained messages
@@ -1532,7 +1896,7 @@ CombinedCondition* SimpleCondition::combineAnd(Condition* other) {
   return ret->combineAnd(this)->combineAnd(other);
 }
 
-result_t SimpleCondition::resolve(void (*readMessageFunc)(Message* message), MessageMap* messages,
+result_t SimpleCondition::resolve(vector<Message*>* readMessages, MessageMap* messages,
     ostringstream* errorMessage) {
   if (m_message == nullptr) {
     Message* message;
@@ -1589,8 +1953,9 @@ result_t SimpleCondition::resolve(void (*readMessageFunc)(Message* message), Mes
       messages->addPollMessage(true, message);
     }
   }
-  if (m_message->getLastUpdateTime() == 0 && readMessageFunc != nullptr) {
-    (*readMessageFunc)(m_message);
+  if (m_message->getLastUpdateTime() == 0 && readMessages != nullptr
+      && std::find(readMessages->begin(), readMessages->end(), m_message) == readMessages->end()) {
+    readMessages->push_back(m_message);
   }
   return RESULT_OK;
 }
@@ -1599,13 +1964,14 @@ bool SimpleCondition::isTrue() {
   if (!m_message) {
     return false;
   }
-  if (m_message->getLastChangeTime() > m_lastCheckTime) {
+  unsigned int version = m_message->getChangeVersion();
+  if (version != m_checkedVersion) {  // only re-evaluate when the referenced data changed
     bool isTrue = !m_hasValues;  // for message seen check
     if (!isTrue) {
       isTrue = checkValue(m_message, m_field);
     }
     m_isTrue = isTrue;
-    m_lastCheckTime = m_message->getLastChangeTime();
+    m_checkedVersion = version;
   }
   return m_isTrue;
 }
@@ -1648,11 +2014,11 @@ void CombinedCondition::dump(bool matched, ostream* output) const {
   }
 }
 
-result_t CombinedCondition::resolve(void (*readMessageFunc)(Message* message), MessageMap* messages,
+result_t CombinedCondition::resolve(vector<Message*>* readMessages, MessageMap* messages,
     ostringstream* errorMessage) {
   for (const auto condition : m_conditions) {
     ostringstream dummy;
-    result_t ret = condition->resolve(readMessageFunc, messages, &dummy);
+    result_t ret = condition->resolve(readMessages, messages, &dummy);
     if (ret != RESULT_OK) {
       *errorMessage << dummy.str();
       return ret;
@@ -1771,13 +2137,77 @@ result_t LoadInstruction::execute(MessageMap* messages, ostringstream* log) {
 }
 
 
+void MessageKeyIndex::insert(uint64_t key, const vector<Message*>* messages) {
+  if ((m_size + 1) * 4 > m_slots.size() * 3) {
+    rehash(m_slots.empty() ? 64 : m_slots.size() * 2);  // keep load factor below 75%
+  }
+  size_t mask = m_slots.size() - 1;
+  size_t pos = hash(key) & mask;
+  while (m_slots[pos].messages) {
+    if (m_slots[pos].key == key) {
+      m_slots[pos].messages = messages;
+      return;
+    }
+    pos = (pos + 1) & mask;
+  }
+  m_slots[pos].key = key;
+  m_slots[pos].messages = messages;
+  m_size++;
+}
+
+void MessageKeyIndex::erase(uint64_t key) {
+  if (m_size == 0) {
+    return;
+  }
+  size_t mask = m_slots.size() - 1;
+  size_t pos = hash(key) & mask;
+  while (m_slots[pos].key != key) {
+    if (!m_slots[pos].messages) {
+      return;  // not indexed
+    }
+    pos = (pos + 1) & mask;
+  }
+  if (!m_slots[pos].messages) {
+    return;
+  }
+  // backward shift deletion to keep the probe sequences intact without tombstones
+  size_t next = pos;
+  while (true) {
+    next = (next + 1) & mask;
+    if (!m_slots[next].messages) {
+      break;
+    }
+    size_t home = hash(m_slots[next].key) & mask;
+    // move the entry in next to the gap at pos if its home slot is not within (pos, next]
+    if ((next > pos && (home <= pos || home > next)) || (next < pos && home <= pos && home > next)) {
+      m_slots[pos] = m_slots[next];
+      pos = next;
+    }
+  }
+  m_slots[pos].messages = nullptr;
+  m_size--;
+}
+
+void MessageKeyIndex::rehash(size_t capacity) {
+  vector<Slot> old;
+  old.swap(m_slots);
+  m_slots.resize(capacity, Slot{0, nullptr});
+  m_size = 0;
+  for (const auto& slot : old) {
+    if (slot.messages) {
+      insert(slot.key, slot.messages);
+    }
+  }
+}
+
+
 vector<string> MessageMap::s_noFiles;
 
 result_t MessageMap::add(bool storeByName, Message* message, bool replace) {
   uint64_t key = message->getKey();
   bool conditional = message->isConditional();
+  lock();
   if (!m_addAll) {
-    lock();
     const auto keyIt = m_messagesByKey.find(key);
     if (keyIt != m_messagesByKey.end()) {
       if (replace) {
@@ -1801,7 +2231,9 @@ result_t MessageMap::add(bool storeByName, Message* message, bool replace) {
         }
       }
     }
-    unlock();
+  }
+  if (m_historySize > 0) {
+    message->setHistorySize(m_historySize);
   }
   bool isPassive = message->isPassive();
   if (storeByName) {
@@ -1816,7 +2248,6 @@ result_t MessageMap::add(bool storeByName, Message* message, bool replace) {
     string suffix = FIELD_SEPARATOR + name + (isPassive ? "P" : (isWrite ? "W" : "R"));
     string nameKey = circuit + suffix;
     if (!m_addAll) {
-      lock();
       const auto nameIt = m_messagesByName.find(nameKey);
       if (nameIt != m_messagesByName.end()) {
         vector<Message*>* messages = &nameIt->second;
@@ -1838,9 +2269,24 @@ result_t MessageMap::add(bool storeByName, Message* message, bool replace) {
           return RESULT_ERR_DUPLICATE_NAME;  // duplicate key
         }
       }
-      unlock();
+    }
+    string siblingKey = circuit + FIELD_SEPARATOR + name;
+    for (const char* type = "PRW"; *type; type++) {
+      const auto siblingIt = m_messagesByName.find(siblingKey + *type);
+      if (siblingIt != m_messagesByName.end() && !siblingIt->second.empty()) {
+        linkSibling(message, siblingIt->second.front());  // all siblings are already linked with each other
+        break;
+      }
     }
     m_messagesByName[nameKey].push_back(message);
+    if (!m_restoredData.empty()) {
+      const auto restoredIt = m_restoredData.find(nameKey);
+      if (restoredIt != m_restoredData.end() && restoredIt->second.key == key) {
+        message->restoreLastData(restoredIt->second.lastUpdateTime, restoredIt->second.master,
+            restoredIt->second.slave);
+        m_restoredData.erase(restoredIt);
+      }
+    }
     nameKey = suffix;  // also store without circuit
     const auto nameIt = m_messagesByName.find(nameKey);
     if (nameIt == m_messagesByName.end()) {
@@ -1858,6 +2304,9 @@ result_t MessageMap::add(bool storeByName, Message* message, bool replace) {
       }
     }
     m_messageCount++;
+    if (!m_staging) {
+      m_journal.push_back(message);
+    }
     if (conditional) {
       m_conditionalMessageCount++;
     }
@@ -1873,7 +2322,13 @@ result_t MessageMap::add(bool storeByName, Message* message, bool replace) {
   if (idLength > m_maxIdLength) {
     m_maxIdLength = idLength;
   }
-  m_messagesByKey[key].push_back(message);
+  vector<Message*>* keyMessages = &m_messagesByKey[key];
+  if (keyMessages->empty()) {
+    m_keyIndex.insert(key, keyMessages);
+  }
+  keyMessages->push_back(message);
+  m_knownPbSb.set((size_t)((key >> (8 * 4)) & 0xffff));
+  unlock();
   return RESULT_OK;
 }
 
@@ -1882,22 +2337,33 @@ void MessageMap::remove(Message* message) {
     return;
   }
   lock();
+  // start a new journal generation so that consumers no longer see the removed instance
+  m_journalStart += m_journal.size() + 1;
+  m_journal.clear();
+  if (unlink(message)) {
+    delete message;
+  }
+  unlock();
+}
+
+bool MessageMap::unlink(Message* message) {
   uint64_t key = message->getKey();
   bool conditional = message->isConditional();
   const auto keyIt = m_messagesByKey.find(key);
-  bool needDelete = false;
+  bool found = false;
   if (keyIt != m_messagesByKey.end()) {
     vector<Message*>* messages = &keyIt->second;
     for (auto it = messages->begin(); it != messages->end(); ) {
       Message* other = *it;
       if (other == message) {
-        needDelete = true;
+        found = true;
         it = messages->erase(it);
       } else {
         ++it;
       }
     }
     if (messages->empty()) {
+      m_keyIndex.erase(key);
       m_messagesByKey.erase(keyIt);
     }
   }
@@ -1908,7 +2374,7 @@ void MessageMap::remove(Message* message) {
       Message* other = *it;
       if (other == message) {
         storedByName = true;
-        needDelete = true;
+        found = true;
         it = messages->erase(it);
       } else {
         ++it;
@@ -1921,6 +2387,7 @@ void MessageMap::remove(Message* message) {
     }
   }
   if (storedByName) {
+    unlinkSibling(message);
     bool isPassive = message->isPassive();
     m_messageCount--;
     if (conditional) {
@@ -1931,12 +2398,88 @@ void MessageMap::remove(Message* message) {
     }
   }
   if (message->getPollPriority() > 0) {
+    m_pollMutex.lock();
     m_pollMessages.remove(message);
+    m_pollMutex.unlock();
   }
-  if (needDelete) {
-    delete message;
+  return found;
+}
+
+result_t MessageMap::detachFile(const string& filename) {
+  lock();
+  vector<Message*> detach;
+  for (const auto& it : m_messagesByKey) {
+    for (const auto message : it.second) {
+      if (message->m_filename != filename) {
+        continue;
+      }
+      if (message->m_usedByCondition) {
+        unlock();
+        return RESULT_ERR_INVALID_ARG;  // the condition would keep referencing the detached instance
+      }
+      detach.push_back(message);
+    }
+  }
+  vector<Message*>& detached = m_detachedMessages[filename];
+  for (const auto message : detach) {
+    if (unlink(message)) {
+      detached.push_back(message);
+    }
+  }
+  // keep the journal generation so that consumers only see the reloaded instances as added
+  for (auto& message : m_journal) {
+    if (message && message->m_filename == filename) {
+      message = nullptr;
+    }
+  }
+  const string prefix = filename + ":";
+  vector<Condition*>& conditions = m_detachedConditions[filename];
+  for (auto it = m_conditions.begin(); it != m_conditions.end(); ) {
+    if (it->first.compare(0, prefix.length(), prefix) == 0) {
+      conditions.push_back(it->second);
+      it = m_conditions.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  unlock();
+  return RESULT_OK;
+}
+
+size_t MessageMap::reattachFile(const string& filename) {
+  lock();
+  size_t taken = 0;
+  const auto detachedIt = m_detachedMessages.find(filename);
+  if (detachedIt != m_detachedMessages.end()) {
+    for (const auto& it : m_messagesByKey) {
+      for (const auto message : it.second) {
+        if (message->m_filename != filename) {
+          continue;
+        }
+        for (const auto other : detachedIt->second) {
+          if (other->getKey() == message->getKey() && other->getName() == message->getName()
+          && other->getCircuit() == message->getCircuit() && other->getLastUpdateTime() > 0) {
+            message->takeLastData(*other);
+            taken++;
+            break;
+          }
+        }
+      }
+    }
+    for (const auto message : detachedIt->second) {
+      delete message;
+    }
+    m_detachedMessages.erase(detachedIt);
+  }
+  const auto conditionsIt = m_detachedConditions.find(filename);
+  if (conditionsIt != m_detachedConditions.end()) {
+    for (const auto condition : conditionsIt->second) {
+      delete condition;
+    }
+    m_detachedConditions.erase(conditionsIt);
   }
   unlock();
+  return taken;
 }
 
 result_t MessageMap::getFieldMap(const string& preferLanguage, vector<string>* row, string* errorDescription) const {
@@ -2249,6 +2792,10 @@ result_t MessageMap::readFromStream(istream* stream, const string& filename, con
   if (!size) {
     size = &localSize;
   }
+  map<string, string> initialDefaults;
+  if (defaults) {
+    initialDefaults = *defaults;
+  }
   result_t result
   = MappedFileReader::readFromStream(stream, filename, mtime, verbose, defaults, errorDescription, replace, hash, size);
   if (defaults) {
@@ -2257,7 +2804,12 @@ result_t MessageMap::readFromStream(istream* stream, const string& filename, con
       string name = AttributedItem::pluck("name", defaults);
       if (!name.empty() || !defaults->empty()) {
         AttributedItem::pluck("suffix", defaults);
-        m_circuitData[circuit] = new AttributedItem(name, *defaults);
+        if (m_staging) {
+          // applied in merge() only when the circuit is still unknown by then
+          m_stagedCircuitData[circuit] = new AttributedItem(name, *defaults);
+        } else {
+          m_circuitData[circuit] = new AttributedItem(name, *defaults);
+        }
       }
     }
   }
@@ -2265,6 +2817,7 @@ result_t MessageMap::readFromStream(istream* stream, const string& filename, con
     m_loadedFileInfos[filename].m_hash = *hash;
     m_loadedFileInfos[filename].m_size = *size;
     m_loadedFileInfos[filename].m_time = mtime;
+    m_loadedFileInfos[filename].m_defaults = initialDefaults;
   }
   return result;
 }
@@ -2290,6 +2843,7 @@ result_t MessageMap::addFromFile(const string& filename, unsigned int lineNo, ma
       *errorDescription = "invalid instruction";
       return result;
     }
+    m_loadedFileInfos[filename].m_hasInstructions = true;
     auto it = m_instructions.find(filename);
     if (it == m_instructions.end()) {
       m_instructions[filename].push_back(instruction);
@@ -2332,6 +2886,8 @@ result_t MessageMap::addFromFile(const string& filename, unsigned int lineNo, ma
           *errorDescription = "invalid name";
         } else if (result == RESULT_ERR_DUPLICATE) {
           *errorDescription = "duplicate ID";
+        } else if (result == RESULT_OK && m_staging) {
+          m_stagedMessages.push_back(pair<unsigned int, Message*>(lineNo, message));
         }
       }
       if (result != RESULT_OK) {
@@ -2345,6 +2901,74 @@ result_t MessageMap::addFromFile(const string& filename, unsigned int lineNo, ma
   return result;
 }
 
+MessageMap* MessageMap::createStaging() const {
+  MessageMap* staging = new MessageMap(m_addAll, getPreferLanguage(), false);
+  staging->m_resolver = m_resolver;
+  staging->m_staging = true;
+  return staging;
+}
+
+result_t MessageMap::merge(MessageMap* staging, bool verbose, string* errorDescription) {
+  lock();
+  result_t result = RESULT_OK;
+  for (const auto& it : staging->m_stagedMessages) {
+    Message* message = it.second;
+    if (result == RESULT_OK) {
+      result = add(true, message, false);
+      if (result != RESULT_OK) {
+        *errorDescription = result == RESULT_ERR_DUPLICATE_NAME ? "invalid name" : "duplicate ID";
+        result = finishLine(message->m_filename, verbose, it.first, result, errorDescription);
+      }
+    }
+    if (result != RESULT_OK) {
+      delete message;  // delete all remaining messages on error
+    }
+  }
+  for (const auto& it : staging->m_conditions) {
+    m_conditions[it.first] = it.second;
+  }
+  for (const auto& it : staging->m_instructions) {
+    vector<Instruction*>& instructions = m_instructions[it.first];
+    instructions.insert(instructions.end(), it.second.begin(), it.second.end());
+  }
+  for (const auto& it : staging->m_circuitData) {
+    const auto existing = m_circuitData.find(it.first);
+    if (existing == m_circuitData.end()) {
+      m_circuitData[it.first] = it.second;
+    } else {
+      delete existing->second;
+      existing->second = it.second;
+    }
+  }
+  for (const auto& it : staging->m_stagedCircuitData) {
+    if (m_circuitData.find(it.first) == m_circuitData.end()) {
+      m_circuitData[it.first] = it.second;
+    } else {
+      delete it.second;
+    }
+  }
+  if (result == RESULT_OK) {
+    for (const auto& it : staging->m_loadedFileInfos) {
+      m_loadedFileInfos[it.first] = it.second;
+    }
+  }
+  unlock();
+  // all instances are owned by this instance now
+  staging->m_stagedMessages.clear();
+  staging->m_stagedCircuitData.clear();
+  staging->m_messagesByName.clear();
+  staging->m_messagesByKey.clear();
+  staging->m_keyIndex.clear();
+  while (!staging->m_pollMessages.empty()) {
+    staging->m_pollMessages.pop();
+  }
+  staging->m_conditions.clear();
+  staging->m_instructions.clear();
+  staging->m_circuitData.clear();
+  delete staging;
+  return result;
+}
+
 Message* MessageMap::getScanMessage(symbol_t dstAddress) {
   if (dstAddress == SYN) {
     return m_scanMessage;
@@ -2365,11 +2989,80 @@ Message* MessageMap::getScanMessage(symbol_t dstAddress) {
   return message;
 }
 
-result_t MessageMap::resolveConditions(bool verbose, string* errorDescription) {
+void MessageMap::formatState(ostream* output) {
+  lockShared();
+  for (const auto& it : m_messagesByName) {
+    if (it.first[0] == FIELD_SEPARATOR) {  // skip instances stored without circuit
+      continue;
+    }
+    const Message* latest = nullptr;
+    for (const auto message : it.second) {
+      if (message->getLastUpdateTime() != 0
+          && (!latest || message->getLastUpdateTime() > latest->getLastUpdateTime())) {
+        latest = message;
+      }
+    }
+    if (latest) {
+      *output << "m," << dec << latest->getLastUpdateTime() << "," << hex << latest->getKey() << dec << ","
+              << latest->getLastMasterData().getStr() << "," << latest->getLastSlaveData().getStr() << ","
+              << it.first << "\n";
+    }
+  }
+  unlockShared();
+}
+
+bool MessageMap::restoreState(const string& line) {
+  // m,LASTUPDATETIME,KEY,MASTER,SLAVE,NAMEKEY
+  vector<string> parts;
+  size_t start = 0;
+  while (parts.size() < 5) {
+    size_t pos = line.find(FIELD_SEPARATOR, start);
+    if (pos == string::npos) {
+      return false;
+    }
+    parts.push_back(line.substr(start, pos - start));
+    start = pos + 1;
+  }
+  string nameKey = line.substr(start);
+  if (parts[0] != "m" || nameKey.length() < 3) {
+    return false;
+  }
+  char* strEnd = nullptr;
+  restoredData_t data;
+  data.lastUpdateTime = static_cast<time_t>(strtoll(parts[1].c_str(), &strEnd, 10));
+  if (strEnd == nullptr || *strEnd != 0 || data.lastUpdateTime <= 0) {
+    return false;
+  }
+  data.key = strtoull(parts[2].c_str(), &strEnd, 16);
+  if (strEnd == nullptr || *strEnd != 0 || parts[2].empty()) {
+    return false;
+  }
+  if (data.master.parseHex(parts[3]) != RESULT_OK || data.slave.parseHex(parts[4]) != RESULT_OK) {
+    return false;
+  }
+  lock();
+  bool restored = false;
+  const auto it = m_messagesByName.find(nameKey);
+  if (it != m_messagesByName.end()) {
+    for (const auto message : it->second) {
+      if (message->getKey() == data.key) {
+        message->restoreLastData(data.lastUpdateTime, data.master, data.slave);
+        restored = true;
+      }
+    }
+  }
+  if (!restored) {
+    m_restoredData[nameKey] = data;
+  }
+  unlock();
+  return true;
+}
+
+result_t MessageMap::resolveConditions(bool verbose, string* errorDescription, vector<Message*>* readMessages) {
   result_t overallResult = RESULT_OK;
   for (const auto& it : m_conditions) {
     Condition* condition = it.second;
-    result_t result = resolveCondition(nullptr, condition, errorDescription);
+    result_t result = resolveCondition(readMessages, condition, errorDescription);
     if (result != RESULT_OK) {
       overallResult = result;
     }
@@ -2377,10 +3070,10 @@ result_t MessageMap::resolveConditions(bool verbose, string* errorDescription) {
   return overallResult;
 }
 
-result_t MessageMap::resolveCondition(void (*readMessageFunc)(Message* message), Condition* condition,
+result_t MessageMap::resolveCondition(vector<Message*>* readMessages, Condition* condition,
     string* errorDescription) {
   ostringstream error;
-  result_t result = condition->resolve(readMessageFunc, this, &error);
+  result_t result = condition->resolve(readMessages, this, &error);
   if (result != RESULT_OK) {
     string errorMessage = error.str();
     if (errorMessage.length() > 0) {
@@ -2393,7 +3086,22 @@ result_t MessageMap::resolveCondition(void (*readMessageFunc)(Message* message),
   return result;
 }
 
-result_t MessageMap::executeInstructions(void (*readMessageFunc)(Message* message), ostringstream* log) {
+void MessageMap::resolveInstructionConditions(vector<Message*>* readMessages) {
+  if (m_addAll) {
+    return;
+  }
+  for (const auto& it : m_instructions) {
+    for (const auto instruction : it.second) {
+      Condition* condition = instruction->getCondition();
+      if (condition != nullptr && instruction->isSingleton()) {
+        ostringstream dummy;
+        condition->resolve(readMessages, this, &dummy);
+      }
+    }
+  }
+}
+
+result_t MessageMap::executeInstructions(ostringstream* log) {
   result_t overallResult = RESULT_OK;
   vector<string> remove;
   for (auto& it : m_instructions) {
@@ -2409,8 +3117,7 @@ result_t MessageMap::executeInstructions(void (*readMessageFunc)(Message* messag
       bool execute = m_addAll || condition == nullptr;
       if (!execute) {
         string errorDescription;
-        result_t result = resolveCondition(instruction->isSingleton()?readMessageFunc:nullptr, condition,
-            &errorDescription);
+        result_t result = resolveCondition(nullptr, condition, &errorDescription);
         if (result != RESULT_OK) {
           overallResult = result;
           *log << "error resolving condition for \"";
@@ -2486,7 +3193,7 @@ vector<string> MessageMap::getLoadedFiles() const {
 }
 
 bool MessageMap::getLoadedFileInfo(const string& filename, string* comment, size_t* hash, size_t* size,
-    time_t* time) const {
+    time_t* time, map<string, string>* defaults, bool* hasInstructions) const {
   const auto it = m_loadedFileInfos.find(filename);
   if (it == m_loadedFileInfos.end()) {
     *comment = "";
@@ -2499,6 +3206,9 @@ bool MessageMap::getLoadedFileInfo(const string& filename, string* comment, size
     if (time) {
       *time = 0;
     }
+    if (hasInstructions) {
+      *hasInstructions = false;
+    }
     return false;
   }
   *comment = it->second.m_comment;
@@ -2511,15 +3221,17 @@ bool MessageMap::getLoadedFileInfo(const string& filename, string* comment, size
   if (time) {
     *time = it->second.m_time;
   }
+  if (defaults) {
+    *defaults = it->second.m_defaults;
+  }
+  if (hasInstructions) {
+    *hasInstructions = it->second.m_hasInstructions;
+  }
   return true;
 }
 
 const vector<Message*>* MessageMap::getByKey(uint64_t key) const {
-  const auto it = m_messagesByKey.find(key);
-  if (it != m_messagesByKey.end()) {
-    return &it->second;
-  }
-  return nullptr;
+  return m_keyIndex.find(key);
 }
 
 Message* MessageMap::find(const string& circuit, const string& name, const string& levels, bool isWrite,
@@ -2529,6 +3241,8 @@ Message* MessageMap::find(const string& circuit, const string& name, const strin
   string lname = name;
   FileReader::tolower(&lname);
   string suffix = FIELD_SEPARATOR + lname + (isPassive ? "P" : (isWrite ? "W" : "R"));
+  Message* ret = nullptr;
+  lockShared();
   for (int i = 0; i < 2; i++) {
     string nameKey;
     if (i == 0) {
@@ -2542,11 +3256,13 @@ Message* MessageMap::find(const string& circuit, const string& name, const strin
     if (it != m_messagesByName.end()) {
       Message* message = getFirstAvailable(it->second);
       if (message && message->hasLevel(levels)) {
-        return message;
+        ret = message;
+        break;
       }
     }
   }
-  return nullptr;
+  unlockShared();
+  return ret;
 }
 
 void MessageMap::findAll(const string& circuit, const string& name, const string& levels,
@@ -2559,62 +3275,132 @@ void MessageMap::findAll(const string& circuit, const string& name, const string
   bool checkCircuit = lcircuit.length() > 0;
   bool checkLevel = levels != "*";
   bool checkName = lname.length() > 0;
-  for (const auto& it : m_messagesByName) {
-    if (it.first[0] == FIELD_SEPARATOR) {  // avoid duplicates: instances stored multiple times have a special key
+  InternedString icircuit, iname;
+  if (completeMatch && ((checkCircuit && !InternedString::find(lcircuit, &icircuit))
+      || (checkName && !InternedString::find(lname, &iname)))) {
+    return;  // not known to any message at all
+  }
+  lockShared();
+  // the keys are "circuit,nameT" in lower case and ordered, so all keys of a circuit are contiguous
+  auto it = checkCircuit && completeMatch ? m_messagesByName.lower_bound(lcircuit + FIELD_SEPARATOR)
+      : m_messagesByName.begin();
+  while (it != m_messagesByName.end()) {
+    const string& key = it->first;
+    if (key[0] == FIELD_SEPARATOR) {  // avoid duplicates: instances stored multiple times have a special key
+      it = m_messagesByName.lower_bound(string(1, FIELD_SEPARATOR + 1));
       continue;
     }
-    for (const auto message : it.second) {
-      if (checkLevel && !message->hasLevel(levels, includeEmptyLevel)) {
-        continue;
-      }
-      if (checkCircuit) {
-        string check = message->getCircuit();
-        FileReader::tolower(&check);
-        if (completeMatch ? (check != lcircuit) : (check.find(lcircuit) == check.npos)) {
+    size_t sepPos = key.find(FIELD_SEPARATOR);
+    if (checkCircuit) {
+      if (completeMatch) {
+        if (sepPos != lcircuit.length() || key.compare(0, sepPos, lcircuit) != 0) {
+          break;  // beyond the keys of the circuit
+        }
+      } else {
+        size_t pos = key.find(lcircuit);
+        if (pos == string::npos || pos + lcircuit.length() > sepPos) {
+          // skip all keys of this circuit
+          it = m_messagesByName.lower_bound(key.substr(0, sepPos) + static_cast<char>(FIELD_SEPARATOR + 1));
           continue;
         }
       }
-      if (checkName) {
-        string check = message->getName();
-        FileReader::tolower(&check);
-        if (completeMatch ? (check != lname) : (check.find(lname) == check.npos)) {
-          continue;
+    }
+    const vector<Message*>* candidates[3];
+    size_t candidateCount = 0;
+    if (checkName && completeMatch) {
+      // directly look up the name within this circuit (in key order) and skip the other keys of this circuit
+      string nameKey = key.substr(0, sepPos + 1) + lname;
+      for (const char* type = "PRW"; *type; type++) {
+        if (*type == 'P' ? withPassive : *type == 'R' ? withRead : withWrite) {
+          const auto nameIt = m_messagesByName.find(nameKey + *type);
+          if (nameIt != m_messagesByName.end()) {
+            candidates[candidateCount++] = &nameIt->second;
+          }
         }
       }
-      if (message->isPassive()) {
-        if (!withPassive) {
+      it = m_messagesByName.lower_bound(key.substr(0, sepPos) + static_cast<char>(FIELD_SEPARATOR + 1));
+    } else {
+      candidates[candidateCount++] = &it->second;
+      it++;
+    }
+    for (size_t index = 0; index < candidateCount; index++) {
+      for (const auto message : *candidates[index]) {
+        if (checkLevel && !message->hasLevel(levels, includeEmptyLevel)) {
           continue;
         }
-      } else if (message->isWrite()) {
-        if (!withWrite) {
-          continue;
+        if (checkCircuit) {
+          const InternedString& check = message->getLowerCircuit();
+          if (completeMatch ? (check != icircuit) : (check.str().find(lcircuit) == string::npos)) {
+            continue;
+          }
         }
-      } else {
-        if (!withRead) {
-          continue;
+        if (checkName) {
+          const InternedString& check = message->getLowerName();
+          if (completeMatch ? (check != iname) : (check.str().find(lname) == string::npos)) {
+            continue;
+          }
         }
-      }
-      if (since != 0 || until != 0) {
-        if (message->getDstAddress() == SYN) {
-          continue;
+        if (message->isPassive()) {
+          if (!withPassive) {
+            continue;
+          }
+        } else if (message->isWrite()) {
+          if (!withWrite) {
+            continue;
+          }
+        } else {
+          if (!withRead) {
+            continue;
+          }
         }
-        time_t lastchg = changedSince ? message->getLastChangeTime() : message->getLastUpdateTime();
-        if ((since != 0 && lastchg < since)
-        || (until != 0 && lastchg >= until)) {
-          continue;
+        if (since != 0 || until != 0) {
+          if (message->getDstAddress() == SYN) {
+            continue;
+          }
+          time_t lastchg = changedSince ? message->getLastChangeTime() : message->getLastUpdateTime();
+          if ((since != 0 && lastchg < since)
+          || (until != 0 && lastchg >= until)) {
+            continue;
+          }
+        }
+        if (!onlyAvailable || message->isAvailable()) {
+          messages->push_back(message);
         }
       }
-      if (!onlyAvailable || message->isAvailable()) {
-        messages->push_back(message);
+    }
+  }
+  unlockShared();
+}
+
+bool MessageMap::findAllAdded(uint64_t* generation, const string& levels, bool onlyAvailable,
+    deque<Message*>* messages) {
+  lockShared();
+  bool added = *generation >= m_journalStart;
+  if (added) {
+    bool checkLevel = levels != "*";
+    for (size_t pos = static_cast<size_t>(*generation - m_journalStart); pos < m_journal.size(); pos++) {
+      Message* message = m_journal[pos];
+      if (!message) {
+        continue;  // detached for reloading the file
       }
+      if ((checkLevel && !message->hasLevel(levels, true)) || (onlyAvailable && !message->isAvailable())) {
+        continue;
+      }
+      messages->push_back(message);
     }
+  } else {
+    findAll("", "", levels, false, true, true, true, true, onlyAvailable, 0, 0, false, messages);
   }
+  *generation = m_journalStart + m_journal.size();
+  unlockShared();
+  return added;
 }
 
-Message* MessageMap::getFirstAvailableFromIterator(const map<uint64_t, vector<Message*> >::const_iterator& it,
-    const MasterSymbolString* sameIdExtAs, bool onlyAvailable) const {
-  if (it != m_messagesByKey.end()) {
-    return getFirstAvailable(it->second, sameIdExtAs, onlyAvailable);
+Message* MessageMap::getFirstAvailableByKey(uint64_t key, const MasterSymbolString* sameIdExtAs,
+    bool onlyAvailable) const {
+  const vector<Message*>* messages = m_keyIndex.find(key);
+  if (messages) {
+    return getFirstAvailable(*messages, sameIdExtAs, onlyAvailable);
   }
   return nullptr;
 }
@@ -2624,6 +3410,9 @@ Message* MessageMap::find(const MasterSymbolString& master, bool anyDestination,
   if (anyDestination && master.size() >= 5 && master[4] == 0 && master[2] == 0x07 && master[3] == 0x04) {
     return m_scanMessage;
   }
+  if (master.size() >= 5 && !m_knownPbSb.test((size_t)(master[2] << 8 | master[3]))) {
+    return nullptr;  // no message with this PB/SB at all
+  }
   uint64_t baseKey = Message::createKey(master,
       anyDestination || master[1] != BROADCAST ? m_maxIdLength : m_maxBroadcastIdLength, anyDestination);
   if (baseKey == INVALID_KEY) {
@@ -2631,6 +3420,8 @@ Message* MessageMap::find(const MasterSymbolString& master, bool anyDestination,
   }
   bool isWriteDest = isMaster(master[1]) || master[1] == BROADCAST;
   size_t maxIdLength = Message::getKeyLength(baseKey);
+  Message* message = nullptr;
+  lockShared();
   for (size_t idLength = maxIdLength; true; idLength--) {
     uint64_t key = baseKey;
     if (idLength == maxIdLength) {
@@ -2645,47 +3436,44 @@ Message* MessageMap::find(const MasterSymbolString& master, bool anyDestination,
         }
       }
     }
-    Message* message;
     if (withPassive) {
-      message = getFirstAvailableFromIterator(m_messagesByKey.find(key), &master, onlyAvailable);
+      message = getFirstAvailableByKey(key, &master, onlyAvailable);
       if (message) {
-        return message;
+        break;
       }
     }
     if ((key & ID_SOURCE_MASK) != 0) {
       key &= ~ID_SOURCE_MASK;
       if (withPassive) {
         // try again without specific source master
-        message = getFirstAvailableFromIterator(m_messagesByKey.find(key), &master, onlyAvailable);
+        message = getFirstAvailableByKey(key, &master, onlyAvailable);
         if (message) {
-          return message;
+          break;
         }
       }
     }
     if (withRead) {
       // try again with special value for active read
-      message = getFirstAvailableFromIterator(
-        m_messagesByKey.find(key | (isWriteDest ? ID_SOURCE_ACTIVE_READ_MASTER : ID_SOURCE_ACTIVE_READ)),
-        &master, onlyAvailable);
+      message = getFirstAvailableByKey(
+        key | (isWriteDest ? ID_SOURCE_ACTIVE_READ_MASTER : ID_SOURCE_ACTIVE_READ), &master, onlyAvailable);
       if (message) {
-        return message;
+        break;
       }
     }
     if (withWrite) {
       // try again with special value for active write
-      message = getFirstAvailableFromIterator(
-        m_messagesByKey.find(key | (isWriteDest ? ID_SOURCE_ACTIVE_WRITE_MASTER : ID_SOURCE_ACTIVE_WRITE)),
-        &master, onlyAvailable);
+      message = getFirstAvailableByKey(
+        key | (isWriteDest ? ID_SOURCE_ACTIVE_WRITE_MASTER : ID_SOURCE_ACTIVE_WRITE), &master, onlyAvailable);
       if (message) {
-        return message;
+        break;
       }
     }
     if (idLength == 0) {
       break;
     }
   }
-
-  return nullptr;
+  unlockShared();
+  return message;
 }
 
 void MessageMap::invalidateCache(Message* message) {
@@ -2693,29 +3481,46 @@ void MessageMap::invalidateCache(Message* message) {
     return;
   }
   message->m_lastUpdateTime = 0;
-  string circuit = message->getCircuit();
-  string name = message->getName();
-  deque<Message*> messages;
-  findAll(circuit, name, "*", true, true, true, true, true, true, 0, 0, false, &messages);
-  for (auto checkMessage : messages) {
-    if (checkMessage != message) {
-      checkMessage->m_lastUpdateTime = 0;
+  message->m_dataVersion++;
+  lockShared();
+  for (Message* sibling = message->m_nextSibling; sibling != message; sibling = sibling->m_nextSibling) {
+    if (sibling->isAvailable()) {
+      sibling->m_lastUpdateTime = 0;
+      sibling->m_dataVersion++;
     }
   }
+  unlockShared();
+}
+
+void MessageMap::linkSibling(Message* message, Message* sibling) {
+  unlinkSibling(message);
+  message->m_nextSibling = sibling->m_nextSibling;
+  sibling->m_nextSibling = message;
+}
+
+void MessageMap::unlinkSibling(Message* message) {
+  Message* previous = message;
+  while (previous->m_nextSibling != message) {
+    previous = previous->m_nextSibling;
+  }
+  previous->m_nextSibling = message->m_nextSibling;
+  message->m_nextSibling = message;
 }
 
 void MessageMap::addPollMessage(bool toFront, Message* message) {
   if (message != nullptr && message->getPollPriority() > 0) {
-    lock();
+    m_pollMutex.lock();
     message->m_lastPollTime = toFront ? 0 : m_pollMessages.size();
     m_pollMessages.push(message);
-    unlock();
+    m_pollMutex.unlock();
   }
 }
 
 bool MessageMap::decodeCircuit(const string& circuit, OutputFormat outputFormat, ostringstream* output) const {
+  lockShared();
   const auto it = m_circuitData.find(circuit);
   if (it == m_circuitData.end()) {
+    unlockShared();
     return false;
   }
   if (outputFormat & OF_JSON) {
@@ -2723,17 +3528,52 @@ bool MessageMap::decodeCircuit(const string& circuit, OutputFormat outputFormat,
   } else {
     *output << it->second->getName() << "=";
   }
-  return it->second->appendAttributes(outputFormat, output);
+  bool ret = it->second->appendAttributes(outputFormat, output);
+  unlockShared();
+  return ret;
+}
+
+size_t MessageMap::getMemoryUsage() const {
+  std::unordered_set<const Message*> messages;
+  size_t ret = m_keyIndex.getMemoryUsage();
+  for (const auto& it : m_messagesByName) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first) + it.second.capacity()*sizeof(Message*);
+    messages.insert(it.second.begin(), it.second.end());
+  }
+  for (const auto& it : m_messagesByKey) {
+    ret += memUsageNode(sizeof(it)) + it.second.capacity()*sizeof(Message*);
+    messages.insert(it.second.begin(), it.second.end());
+  }
+  for (const auto& it : m_detachedMessages) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first) + it.second.capacity()*sizeof(Message*);
+    messages.insert(it.second.begin(), it.second.end());
+  }
+  for (const auto message : messages) {
+    ret += message->getMemoryUsage();
+  }
+  for (const auto& it : m_conditions) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first);
+  }
+  for (const auto& it : m_instructions) {
+    ret += memUsageNode(sizeof(it)) + memUsage(it.first) + it.second.capacity()*sizeof(Instruction*);
+  }
+  ret += m_journal.capacity()*sizeof(Message*) + m_stagedMessages.capacity()*sizeof(m_stagedMessages[0]);
+  return ret;
 }
 
 void MessageMap::clear() {
+  lock();
+  m_journalStart += m_journal.size() + 1;
+  m_journal.clear();
   m_loadedFiles.clear();
   m_loadedFileInfos.clear();
   // clear poll messages
+  m_pollMutex.lock();
   while (!m_pollMessages.empty()) {
     m_pollMessages.top();
     m_pollMessages.pop();
   }
+  m_pollMutex.unlock();
   // free message instances by name
   for (auto it : m_messagesByName) {
     vector<Message*> nameMessages = it.second;
@@ -2771,6 +3611,19 @@ void MessageMap::clear() {
   for (const auto& it : m_conditions) {
     delete it.second;
   }
+  // free instances detached for reloading
+  for (const auto& it : m_detachedMessages) {
+    for (const auto message : it.second) {
+      delete message;
+    }
+  }
+  m_detachedMessages.clear();
+  for (const auto& it : m_detachedConditions) {
+    for (const auto condition : it.second) {
+      delete condition;
+    }
+  }
+  m_detachedConditions.clear();
   // free instruction instances
   for (const auto& it : m_instructions) {
     vector<Instruction*> instructions = it.second;
@@ -2786,30 +3639,57 @@ void MessageMap::clear() {
   m_messagesByName.clear();
   // clear messages by key
   m_messagesByKey.clear();
+  m_keyIndex.clear();
+  m_knownPbSb.reset();
   m_conditions.clear();
   m_instructions.clear();
   for (const auto& it : m_circuitData) {
     delete it.second;
   }
   m_circuitData.clear();
+  for (const auto& it : m_stagedCircuitData) {
+    delete it.second;
+  }
+  m_stagedCircuitData.clear();
+  m_stagedMessages.clear();
   m_maxIdLength = m_maxBroadcastIdLength = 0;
   m_additionalScanMessages = false;
+  unlock();
 }
 
-Message* MessageMap::getNextPoll() {
+Message* MessageMap::getNextPoll(time_t now, unsigned int pollInterval, bool onlyDue) {
   if (m_pollMessages.empty()) {
     return nullptr;
   }
-  lock();
-  Message* ret = m_pollMessages.top();
-  m_pollMessages.pop();
-  if (ret->m_pollOrder > g_lastPollOrder) {
-    g_lastPollOrder = ret->m_pollOrder;
-  }
-  ret->m_pollOrder += (unsigned int)ret->m_pollPriority;
-  time(&(ret->m_lastPollTime));
-  m_pollMessages.push(ret);  // re-insert at new position
-  unlock();
+  m_pollMutex.lock();
+  Message* ret = nullptr;
+  for (size_t remain = m_pollMessages.size(); remain > 0; remain--) {  // check each message at most once
+    Message* message = m_pollMessages.top();
+    if (onlyDue && !message->isPollDue(now, pollInterval)) {
+      break;  // the most urgent one is not due, so leave the time to the regular poll
+    }
+    m_pollMessages.pop();
+    if (message->m_polledLatency > 0) {
+      // apply the latency of the last poll while not queued
+      message->m_pollLatency = message->m_pollLatency == 0 ? message->m_polledLatency
+          : (3 * message->m_pollLatency + message->m_polledLatency) / 4;
+      message->m_polledLatency = 0;
+    }
+    if (message->m_pollOrder > g_lastPollOrder) {
+      g_lastPollOrder = message->m_pollOrder;
+    }
+    message->m_pollOrder += (unsigned int)message->m_pollPriority * message->getPollBackoff();
+    bool skip = message->isRecentlyUpdated(now, pollInterval);
+    if (!skip) {
+      message->m_lastPollTime = now;
+    }
+    m_pollMessages.push(message);  // re-insert at new position
+    if (!skip) {
+      ret = message;
+      break;
+    }
+  }
+  m_pollMutex.unlock();
   return ret;
 }
 
@@ -2824,6 +3704,7 @@ void MessageMap::dump(bool withConditions, OutputFormat outputFormat, ostream* o
   if (!(outputFormat & OF_SHORT)) {
     *output << endl;
   }
+  lockShared();
   for (const auto& it : m_messagesByName) {
     if (it.first[0] == FIELD_SEPARATOR) {  // skip instances stored multiple times (key starting with "-")
       continue;
@@ -2870,6 +3751,7 @@ void MessageMap::dump(bool withConditions, OutputFormat outputFormat, ostream* o
       }
     }
   }
+  unlockShared();
   if (isJson) {
     *output << (m_addAll ? "]" : "}") << endl;
   } else {
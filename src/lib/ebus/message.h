@@ -20,14 +20,18 @@
 #define LIB_EBUS_MESSAGE_H_
 
 #include <stdint.h>
+#include <bitset>
 #include <string>
 #include <vector>
 #include <deque>
 #include <map>
 #include <queue>
+#include <utility>
 #include "lib/ebus/data.h"
+#include "lib/ebus/history.h"
 #include "lib/ebus/result.h"
 #include "lib/ebus/symbol.h"
+#include "lib/utils/thread.h"
 
 namespace ebusd {
 
@@ -58,14 +62,19 @@ namespace ebusd {
  * template class.
  */
 
+using std::bitset;
 using std::priority_queue;
 using std::deque;
+using std::pair;
 
 class Condition;
 class SimpleCondition;
 class CombinedCondition;
 class MessageMap;
 
+/** the maximum number of prepared master parts cached per @a Message (see Message#prepareMasterPart()). */
+#define MAX_PREPARED_MASTERS 8
+
 
 /**
  * Defines parameters of a message sent or received on the bus.
@@ -91,8 +100,8 @@ class Message : public AttributedItem {
    * @param pollPriority the priority for polling, or 0 for no polling at all.
    * @param condition the @a Condition for this message, or nullptr.
    */
-  Message(const string& filename, const string& circuit, const string& level, const string& name,
-      bool isWrite, bool isPassive, const map<string, string>& attributes,
+  Message(const InternedString& filename, const InternedString& circuit, const InternedString& level,
+      const InternedString& name, bool isWrite, bool isPassive, const map<string, InternedString>& attributes,
       symbol_t srcAddress, symbol_t dstAddress,
       const vector<symbol_t>& id,
       const DataField* data, bool deleteData,
@@ -125,6 +134,10 @@ class Message : public AttributedItem {
     if (m_deleteData) {
       delete m_data;
     }
+    if (m_history) {
+      delete m_history;
+      m_history = nullptr;
+    }
   }
 
   /**
@@ -246,6 +259,18 @@ class Message : public AttributedItem {
    */
   string getCircuit() const { return m_circuit; }
 
+  /**
+   * Get the interned optional circuit name in lower case (for matching).
+   * @return the interned optional circuit name in lower case.
+   */
+  const InternedString& getLowerCircuit() const { return m_lowerCircuit; }
+
+  /**
+   * Get the interned message name in lower case (for matching).
+   * @return the interned message name in lower case.
+   */
+  const InternedString& getLowerName() const { return m_lowerName; }
+
   /**
    * Get the optional access level.
    * @return the optional access level.
@@ -429,6 +454,7 @@ class Message : public AttributedItem {
  protected:
   /**
    * Prepare a part of the master data @a SymbolString for sending (everything including NN).
+   * The prepared symbols are cached by the remaining input and reused for identical input.
    * @param index the index of the part to prepare.
    * @param separator the separator character between multiple fields.
    * @param input the @a istringstream to parse the formatted value(s) from.
@@ -471,6 +497,22 @@ class Message : public AttributedItem {
    */
   virtual result_t storeLastData(size_t index, const SlaveSymbolString& data);
 
+  /**
+   * Take over the last seen data together with the update times from another instance with the same key (e.g. the
+   * one replaced by reloading the configuration file).
+   * Note: the poll order is kept as the message might already be queued for polling.
+   * @param other the other @a Message to take the data from.
+   */
+  void takeLastData(const Message& other);
+
+  /**
+   * Restore the last data from a persisted state (e.g. after a restart).
+   * @param lastUpdateTime the time when the data was last updated.
+   * @param master the last master data.
+   * @param slave the last slave data.
+   */
+  void restoreLastData(time_t lastUpdateTime, const MasterSymbolString& master, const SlaveSymbolString& slave);
+
   /**
    * Decode the value from the last stored master or slave data.
    * @param master true for decoding the master data, false for slave.
@@ -496,6 +538,52 @@ class Message : public AttributedItem {
   virtual result_t decodeLastData(bool leadingSeparator, const char* fieldName,
       ssize_t fieldIndex, OutputFormat outputFormat, ostream* output) const;
 
+  /**
+   * Decode the value from the specified master and slave data.
+   * @param master the @a MasterSymbolString to decode.
+   * @param slave the @a SlaveSymbolString to decode.
+   * @param leadingSeparator whether to prepend a separator before the formatted value.
+   * @param fieldName the optional name of a field to limit the output to.
+   * @param fieldIndex the optional index of the field to limit the output to (either named or overall), or -1.
+   * @param outputFormat the @a OutputFormat options to use.
+   * @param output the @a ostream to append the formatted value to.
+   * @return @a RESULT_OK on success, or an error code.
+   */
+  result_t decodeData(const MasterSymbolString& master, const SlaveSymbolString& slave, bool leadingSeparator,
+      const char* fieldName, ssize_t fieldIndex, OutputFormat outputFormat, ostream* output) const;
+
+  /**
+   * Enable or disable the history of the stored data.
+   * @param size the maximum number of entries to keep in the history, or 0 to disable it.
+   */
+  void setHistorySize(size_t size);
+
+  /**
+   * Get the history of the stored data.
+   * @return the @a DataHistory, or nullptr if disabled.
+   */
+  const DataHistory* getHistory() const { return m_history; }
+
+  /**
+   * Get the estimated memory used by this instance including the owned fields and the cached data.
+   * Note: the cached data is not locked, so the result is only an estimation.
+   * @return the estimated number of bytes.
+   */
+  virtual size_t getMemoryUsage() const;
+
+  /**
+   * Decode the values from the history of the stored data.
+   * @param since the time from which to output entries (inclusive), or 0 for all.
+   * @param fieldName the optional name of a field to limit the output to.
+   * @param fieldIndex the optional index of the field to limit the output to (either named or overall), or -1.
+   * @param outputFormat the @a OutputFormat options to use (plain text with one line per entry starting with the
+   * time, or a JSON array of objects with "time" and "fields").
+   * @param output the @a ostream to append the formatted values to.
+   * @return @a RESULT_OK on success, @a RESULT_EMPTY if the history is disabled or empty, or an error code.
+   */
+  result_t decodeHistory(time_t since, const char* fieldName, ssize_t fieldIndex, OutputFormat outputFormat,
+      ostream* output) const;
+
   /**
    * Decode a particular numeric field value from the last stored data.
    * @param fieldName the name of the field to decode, or nullptr for the first field.
@@ -505,6 +593,25 @@ class Message : public AttributedItem {
    */
   virtual result_t decodeLastDataNumField(const char* fieldName, ssize_t fieldIndex, unsigned int* output) const;
 
+  /**
+   * Decode the typed values of all fields from the last stored master and slave data.
+   * @param values the caller provided @a vector in which to store one @a fieldValue_t per non-ignored field (resized
+   * as needed, reusing previously allocated entries).
+   * @return @a RESULT_OK on success, or an error code (with the entries of all fields decoded successfully still
+   * being set and the field of the others set to nullptr).
+   */
+  virtual result_t decodeLastDataValues(vector<fieldValue_t>* values) const;
+
+  /**
+   * Decode the values of all fields or of a single field from the last stored master and slave data to CBOR.
+   * @param fieldIndex the index of the single field to output the bare value of, or -1 for a map of all fields
+   * (keyed by field name when unique and @a OF_NAMES is set, or by field index otherwise).
+   * @param outputFormat the @a OutputFormat options to use (only @a OF_NAMES and @a OF_NUMERIC are considered).
+   * @param output the @a ostream to append the binary CBOR data to.
+   * @return @a RESULT_OK on success, or an error code.
+   */
+  virtual result_t decodeLastDataCbor(ssize_t fieldIndex, OutputFormat outputFormat, ostream* output) const;
+
   /**
    * Get the last seen master data.
    * @return the last seen @a MasterSymbolString.
@@ -517,6 +624,18 @@ class Message : public AttributedItem {
    */
   const SlaveSymbolString& getLastSlaveData() const { return m_lastSlaveData; }
 
+  /**
+   * Return whether the telegram is identical to the last stored data, i.e. storing it again would only update the
+   * last update time. Always false for a @a Message consisting of several parts or having siblings.
+   * @param master the received @a MasterSymbolString.
+   * @param slave the received @a SlaveSymbolString.
+   * @return whether the telegram is identical to the last stored data.
+   */
+  bool isLastData(const MasterSymbolString& master, const SlaveSymbolString& slave) const {
+    return m_lastUpdateTime != 0 && m_nextSibling == this && getCount() == 1 && slave == m_lastSlaveData
+      && master.compareTo(m_lastMasterData) == 0;
+  }
+
   /**
    * Get the time when this message was created.
    * @return the time when this message was created.
@@ -549,12 +668,61 @@ class Message : public AttributedItem {
    */
   time_t getLastChangeTime() const { return m_lastChangeTime; }
 
+  /**
+   * Get the counter of changes to the last data.
+   * @return the counter of changes to the last data (incremented only when the data actually changed).
+   */
+  unsigned int getChangeVersion() const { return m_changeVersion; }
+
   /**
    * Get the time when this message was last polled for.
    * @return the time when this message was last polled for, or 0 for never.
    */
   time_t getLastPollTime() const { return m_lastPollTime; }
 
+  /**
+   * Update the statistics after this message was updated by another participant on the bus.
+   * @param now the current system time.
+   */
+  void setPassiveUpdate(time_t now);
+
+  /**
+   * Update the statistics after this message was polled successfully.
+   * @param changed whether the polled data differs from the one seen before.
+   * @param latency the time in milliseconds from starting the poll request until the last answer was received.
+   */
+  void setPolled(bool changed, unsigned int latency);
+
+  /**
+   * Get the smoothed latency of a poll request for this message.
+   * @return the smoothed latency in milliseconds, or 0 if not yet known.
+   */
+  unsigned int getPollLatency() const { return m_pollLatency; }
+
+  /**
+   * Get the factor by which polling of this message is slowed down as it did not change in the last polls.
+   * @return the factor (1 for no back off, at most 4).
+   */
+  unsigned int getPollBackoff() const;
+
+  /**
+   * Return whether this message was updated recently enough to not need to be polled now.
+   * @param now the current system time.
+   * @param pollInterval the interval in seconds in which poll messages are cycled.
+   * @return true when this message was updated within the poll interval, or when it was updated passively within
+   * the period it would be polled anyway or is expected to be updated passively again soon.
+   */
+  bool isRecentlyUpdated(time_t now, unsigned int pollInterval) const;
+
+  /**
+   * Return whether this message is due for being polled (e.g. when filling idle bus time).
+   * @param now the current system time.
+   * @param pollInterval the interval in seconds in which poll messages are cycled.
+   * @return true when the last poll or update is older than the poll interval multiplied with the priority and the
+   * back off factor.
+   */
+  bool isPollDue(time_t now, unsigned int pollInterval) const;
+
   /**
    * Return whether this @a Message needs to be polled after the other one.
    * @param other the other @a Message to compare with.
@@ -600,15 +768,51 @@ class Message : public AttributedItem {
   virtual void decodeJson(bool leadingSeparator, bool appendDirectionCondition, bool withData, bool addRaw,
                           OutputFormat outputFormat, ostringstream* output) const;
 
+  /**
+   * Decode the message from the last stored data in JSON format like @a decodeJson() but reuse the fragment
+   * formatted by the previous call if neither the data nor the arguments changed in the meantime.
+   * Note: the cache is not synchronized, so this may only be called by a single thread.
+   * @param leadingSeparator whether to prepend a separator before the first value.
+   * @param appendDirectionCondition whether to append the direction and condition to the name key.
+   * @param withData whether to add the last data as well.
+   * @param addRaw whether to add the raw symbols as well.
+   * @param outputFormat the @a OutputFormat options to use.
+   * @param output the @a ostringstream to append the decoded value(s) to.
+   */
+  void decodeJsonCached(bool leadingSeparator, bool appendDirectionCondition, bool withData, bool addRaw,
+                        OutputFormat outputFormat, ostringstream* output) const;
+
+  /**
+   * Decode the message from the last stored data as CBOR map entry with the name as key (like in
+   * @a decodeJson()) and a map with the last update time and the field values as value.
+   * @param appendDirectionCondition whether to append the direction and condition to the name key.
+   * @param outputFormat the @a OutputFormat options to use (see @a decodeLastDataCbor()).
+   * @param output the @a ostream to append the binary CBOR data to.
+   */
+  void decodeCbor(bool appendDirectionCondition, OutputFormat outputFormat, ostream* output) const;
+
  protected:
+  /**
+   * Write the name key of the message as used for decoding in JSON or CBOR format.
+   * @param appendDirectionCondition whether to append the direction and condition to the name.
+   * @param output the @a ostream to append the key to.
+   */
+  void dumpKey(bool appendDirectionCondition, ostream* output) const;
+
   /** the source filename. */
-  const string m_filename;
+  const InternedString m_filename;
 
   /** the optional circuit name. */
-  const string m_circuit;
+  const InternedString m_circuit;
+
+  /** the optional circuit name in lower case (for matching). */
+  const InternedString m_lowerCircuit;
+
+  /** the message name in lower case (for matching). */
+  const InternedString m_lowerName;
 
   /** the optional access level. */
-  const string m_level;
+  const InternedString m_level;
 
   /** whether this is a write message. */
   const bool m_isWrite;
@@ -673,6 +877,9 @@ class Message : public AttributedItem {
   /** the last seen @a SlaveSymbolString. */
   SlaveSymbolString m_lastSlaveData;
 
+  /** the history of the stored data, or nullptr if disabled. */
+  DataHistory* m_history;
+
   /** the system time when the message was created or changed in poll priority. */
   time_t m_createTime;
 
@@ -690,6 +897,51 @@ class Message : public AttributedItem {
 
   /** the system time when this message was last polled for, 0 for never. */
   time_t m_lastPollTime;
+
+  /** the system time when this message was last updated by another participant, 0 for never. */
+  time_t m_lastPassiveUpdateTime;
+
+  /** the smoothed interval in seconds between passive updates, 0 if not yet known. */
+  unsigned int m_passiveUpdateInterval;
+
+  /** the number of consecutive polls without a change of the data. */
+  unsigned int m_unchangedPollCount;
+
+  /** the smoothed latency of poll requests in milliseconds, 0 if not yet known. */
+  unsigned int m_pollLatency;
+
+  /** the latency of the last poll request in milliseconds not yet applied to @a m_pollLatency, or 0. */
+  unsigned int m_polledLatency;
+
+  /** the counter of changes to the last data (incremented with each store or invalidation). */
+  unsigned int m_dataVersion;
+
+  /** the counter of actual changes to the last data (that @a Condition instances depending on it check against). */
+  unsigned int m_changeVersion;
+
+  /** the JSON fragment formatted by the last call to @a decodeJsonCached(), or empty. */
+  mutable string m_jsonCache;
+
+  /** the value of @a m_dataVersion when @a m_jsonCache was formatted. */
+  mutable unsigned int m_jsonCacheVersion;
+
+  /** the arguments used for formatting @a m_jsonCache (flags in the lowest bits, poll priority above). */
+  mutable size_t m_jsonCacheArgs;
+
+  /** the @a OutputFormat used for formatting @a m_jsonCache. */
+  mutable OutputFormat m_jsonCacheFormat;
+
+  /**
+   * the next @a Message with the same circuit and name in the circular list of siblings maintained by
+   * @a MessageMap (this instance if there is none).
+   */
+  Message* m_nextSibling;
+
+  /** the cached master parts (NN and following symbols) prepared by @a prepareMasterPart() by input. */
+  map<string, MasterSymbolString> m_preparedMasters;
+
+  /** @a Mutex for @a m_preparedMasters (prepared from the main and the bus thread). */
+  Mutex m_preparedMastersMutex;
 };
 
 
@@ -716,8 +968,8 @@ class ChainedMessage : public Message {
    * @param pollPriority the priority for polling, or 0 for no polling at all.
    * @param condition the @a Condition for this message, or nullptr.
    */
-  ChainedMessage(const string& filename, const string& circuit, const string& level, const string& name,
-      bool isWrite, const map<string, string>& attributes,
+  ChainedMessage(const InternedString& filename, const InternedString& circuit, const InternedString& level,
+      const InternedString& name, bool isWrite, const map<string, InternedString>& attributes,
       symbol_t srcAddress, symbol_t dstAddress,
       const vector<symbol_t>& id,
       const vector< vector<symbol_t> >& ids, const vector<size_t>& lengths,
@@ -739,6 +991,9 @@ class ChainedMessage : public Message {
   // @copydoc
   bool checkId(const Message& other) const override;
 
+  // @copydoc
+  size_t getMemoryUsage() const override;
+
   // @copydoc
   size_t getCount() const override { return m_ids.size(); }
 
@@ -843,16 +1098,112 @@ class MessagePriorityQueue
 };
 
 
+/**
+ * Flat open-addressing hash index (linear probing) from a @a Message key to the list of @a Message instances.
+ * The referenced lists are owned by the caller and have to stay at the same address while being indexed.
+ */
+class MessageKeyIndex {
+ public:
+  /**
+   * Construct a new empty instance.
+   */
+  MessageKeyIndex() : m_size(0) {}
+
+  /**
+   * Find the list of @a Message instances for the key.
+   * @param key the @a Message key.
+   * @return the list of @a Message instances, or nullptr if not indexed.
+   */
+  const vector<Message*>* find(uint64_t key) const {
+    if (m_size == 0) {
+      return nullptr;
+    }
+    size_t mask = m_slots.size() - 1;
+    for (size_t pos = hash(key) & mask; m_slots[pos].messages; pos = (pos + 1) & mask) {
+      if (m_slots[pos].key == key) {
+        return m_slots[pos].messages;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * Add or replace the list of @a Message instances for the key.
+   * @param key the @a Message key.
+   * @param messages the list of @a Message instances.
+   */
+  void insert(uint64_t key, const vector<Message*>* messages);
+
+  /**
+   * Remove the key from the index.
+   * @param key the @a Message key.
+   */
+  void erase(uint64_t key);
+
+  /**
+   * Remove all keys from the index.
+   */
+  void clear() {
+    m_slots.clear();
+    m_size = 0;
+  }
+
+  /**
+   * @return the number of indexed keys.
+   */
+  size_t size() const { return m_size; }
+
+  /**
+   * @return the number of bytes allocated for the slots.
+   */
+  size_t getMemoryUsage() const { return m_slots.capacity()*sizeof(Slot); }
+
+
+ private:
+  /**
+   * Calculate the hash value of a key (finalizer of splitmix64 for spreading the sparse key bits).
+   * @param key the @a Message key.
+   * @return the hash value.
+   */
+  static size_t hash(uint64_t key) {
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t)(key ^ (key >> 31));
+  }
+
+  /**
+   * Resize the slots to the specified capacity and re-insert all indexed keys.
+   * @param capacity the new capacity (power of 2).
+   */
+  void rehash(size_t capacity);
+
+  /** a single slot in the index. */
+  struct Slot {
+    /** the @a Message key. */
+    uint64_t key;
+
+    /** the list of @a Message instances, or nullptr for an empty slot. */
+    const vector<Message*>* messages;
+  };
+
+  /** the slots (capacity is always a power of 2). */
+  vector<Slot> m_slots;
+
+  /** the number of used slots. */
+  size_t m_size;
+};
+
+
 /**
  * An abstract condition based on the value of one or more @a Message instances.
  */
-class Condition {
+class Condition : public ArenaAllocated {
  public:
   /**
    * Construct a new instance.
    */
   Condition()
-    : m_lastCheckTime(0), m_isTrue(false) { }
+    : m_isTrue(false) { }
 
   /**
    * Destructor.
@@ -893,25 +1244,24 @@ class Condition {
 
   /**
    * Resolve the referred @a Message instance(s) and field index(es).
+   * @param readMessages the vector to add the referred @a Message instances to that were not read from the bus yet
+   * (without duplicates), or nullptr.
    * @param messages the @a MessageMap instance for resolving.
-   * @param readMessageFunc the function to call for immediate reading of a @a Message from the bus, or nullptr.
    * @param errorMessage a @a ostringstream to which to add optional error messages.
    * @return @a RESULT_OK on success, or an error code.
    */
-  virtual result_t resolve(void (*readMessageFunc)(Message* message), MessageMap* messages,
+  virtual result_t resolve(vector<Message*>* readMessages, MessageMap* messages,
       ostringstream* errorMessage) = 0;
 
   /**
    * Check and return whether this condition is fulfilled.
+   * The result is cached and only re-evaluated when the last data of a referenced @a Message changed.
    * @return whether this condition is fulfilled.
    */
   virtual bool isTrue() = 0;
 
 
  protected:
-  /** the system time when the condition was last checked, 0 for never. */
-  time_t m_lastCheckTime;
-
   /** whether the condition was @a true during the last check. */
   bool m_isTrue;
 };
@@ -938,7 +1288,7 @@ class SimpleCondition : public Condition {
       const string& name, symbol_t dstAddress, const string& field, bool hasValues = false)
     : Condition(),
       m_condName(condName), m_refName(refName), m_circuit(circuit), m_level(level), m_name(name),
-      m_dstAddress(dstAddress), m_field(field), m_hasValues(hasValues), m_message(nullptr) { }
+      m_dstAddress(dstAddress), m_field(field), m_hasValues(hasValues), m_message(nullptr), m_checkedVersion(0) { }
 
   /**
    * Destructor.
@@ -955,7 +1305,7 @@ class SimpleCondition : public Condition {
   CombinedCondition* combineAnd(Condition* other) override;
 
   // @copydoc
-  result_t resolve(void (*readMessageFunc)(Message* message), MessageMap* messages,
+  result_t resolve(vector<Message*>* readMessages, MessageMap* messages,
       ostringstream* errorMessage) override;
 
   // @copydoc
@@ -1009,6 +1359,9 @@ class SimpleCondition : public Condition {
 
   /** the resolved @a Message instance, or nullptr. */
   Message* m_message;
+
+  /** the change version of @a m_message when the condition was last checked (0 for never changed). */
+  unsigned int m_checkedVersion;
 };
 
 
@@ -1024,7 +1377,8 @@ class SimpleNumericCondition : public SimpleCondition {
    * @param circuit the circuit name.
    * @param level the access level.
    * @param name the message name, or empty for scan message.
-   * @param dstAddress the override destination address, or @a SYN (only for @a Message without specific destination as well as scan message).
+   * @param dstAddress the override destination address, or @a SYN (only for @a Message without specific destination
+   * as well as scan message).
    * @param field the field name.
    * @param valueRanges the valid value ranges (pairs of from/to inclusive), empty for @a m_message seen check.
    */
@@ -1062,7 +1416,8 @@ class SimpleStringCondition : public SimpleCondition {
    * @param circuit the circuit name.
    * @param level the access level.
    * @param name the message name, or empty for scan message.
-   * @param dstAddress the override destination address, or @a SYN (only for @a Message without specific destination as well as scan message).
+   * @param dstAddress the override destination address, or @a SYN (only for @a Message without specific destination
+   * as well as scan message).
    * @param field the field name.
    * @param values the valid values.
    */
@@ -1114,7 +1469,7 @@ class CombinedCondition : public Condition {
   CombinedCondition* combineAnd(Condition* other) override { m_conditions.push_back(other); return this; }
 
   // @copydoc
-  result_t resolve(void (*readMessageFunc)(Message* message), MessageMap* messages,
+  result_t resolve(vector<Message*>* readMessages, MessageMap* messages,
       ostringstream* errorMessage) override;
 
   // @copydoc
@@ -1130,7 +1485,7 @@ class CombinedCondition : public Condition {
 /**
  * An abstract instruction based on the value of one or more @a Message instances.
  */
-class Instruction {
+class Instruction : public ArenaAllocated {
  public:
   /**
    * Construct a new instance.
@@ -1251,6 +1606,12 @@ class LoadedFileInfo {
 
   /** the modification time of the file. */
   time_t m_time;
+
+  /** the defaults the file was loaded with (for reloading it the same way). */
+  map<string, string> m_defaults;
+
+  /** whether the file contained instructions. */
+  bool m_hasInstructions;
 };
 
 
@@ -1304,8 +1665,9 @@ class MessageMap : public MappedFileReader {
    */
   explicit MessageMap(bool addAll = false, const string& preferLanguage = "", bool deleteData = true)
   : MappedFileReader::MappedFileReader(true, preferLanguage), m_resolver(nullptr),
-    m_addAll(addAll), m_additionalScanMessages(false), m_maxIdLength(0), m_maxBroadcastIdLength(0),
-    m_messageCount(0), m_conditionalMessageCount(0), m_passiveMessageCount(0) {
+    m_addAll(addAll), m_staging(false), m_journalStart(1), m_additionalScanMessages(false), m_maxIdLength(0),
+    m_maxBroadcastIdLength(0), m_messageCount(0), m_conditionalMessageCount(0), m_passiveMessageCount(0),
+    m_historySize(0) {
     m_scanMessage = Message::createScanMessage(false, deleteData);
     m_broadcastScanMessage = Message::createScanMessage(true, false);
   }
@@ -1331,6 +1693,12 @@ class MessageMap : public MappedFileReader {
    */
   void setResolver(Resolver* resolver) { m_resolver = resolver; }
 
+  /**
+   * Set the size of the data history to enable for each @a Message added afterwards.
+   * @param size the maximum number of entries to keep in the history of each @a Message, or 0 to disable it.
+   */
+  void setHistorySize(size_t size) { m_historySize = size; }
+
   /**
    * @return the @a Resolver instance.
    */
@@ -1352,6 +1720,25 @@ class MessageMap : public MappedFileReader {
    */
   void remove(Message* message);
 
+  /**
+   * Create a new empty staging instance with the same settings for reading a single file independently of this
+   * instance (e.g. in another thread). The read definitions are transferred afterwards with @a merge().
+   * Note: the staging instance does not support replacing already existing entries.
+   * @return the new staging @a MessageMap instance.
+   */
+  MessageMap* createStaging() const;
+
+  /**
+   * Merge the definitions read into a staging instance into this instance and delete the staging instance.
+   * The @a Message instances are added in the order they were read, so that conflicts are detected and reported
+   * just like when the file would have been read into this instance directly.
+   * @param staging the staging @a MessageMap created by @a createStaging().
+   * @param verbose whether to verbosely log problems.
+   * @param errorDescription a string in which to store the error description in case of error.
+   * @return @a RESULT_OK on success, or an error code.
+   */
+  result_t merge(MessageMap* staging, bool verbose, string* errorDescription);
+
   // @copydoc
   result_t getFieldMap(const string& preferLanguage, vector<string>* row, string* errorDescription) const override;
 
@@ -1400,28 +1787,39 @@ class MessageMap : public MappedFileReader {
    * Resolve all @a Condition instances.
    * @param verbose whether to verbosely add all problems to the error message.
    * @param errorDescription a string in which to store the error description in case of error.
+   * @param readMessages the vector to add the referred @a Message instances to that were not read from the bus yet
+   * (without duplicates), or nullptr.
    * @return @a RESULT_OK on success, or an error code.
    */
-  result_t resolveConditions(bool verbose, string* errorDescription);
+  result_t resolveConditions(bool verbose, string* errorDescription, vector<Message*>* readMessages = nullptr);
 
   /**
    * Resolve a @a Condition.
-   * @param readMessageFunc the function to call for immediate reading of a @a Message from the bus, or nullptr.
+   * @param readMessages the vector to add the referred @a Message instances to that were not read from the bus yet
+   * (without duplicates), or nullptr.
    * @param condition the @a Condition to resolve.
    * @param errorDescription a string in which to store the error description in case of error.
    * @return @a RESULT_OK on success, or an error code.
    */
-  result_t resolveCondition(void (*readMessageFunc)(Message* message), Condition* condition,
-      string* errorDescription);
+  result_t resolveCondition(vector<Message*>* readMessages, Condition* condition, string* errorDescription);
+
+  /**
+   * Resolve the @a Condition instances of the pending singleton @a Instruction instances in order to collect the
+   * @a Message instances to read from the bus before calling @a executeInstructions().
+   * Errors are ignored here as they are reported by @a executeInstructions().
+   * @param readMessages the vector to add the referred @a Message instances to that were not read from the bus yet
+   * (without duplicates).
+   */
+  void resolveInstructionConditions(vector<Message*>* readMessages);
 
   /**
    * Run all executable @a Instruction instances.
-   * @param readMessageFunc the function to call for immediate reading of a
-   * @a Message values from the bus required for singleton instructions, or nullptr.
+   * Note: the @a Message values required for singleton instructions have to be read before (see
+   * @a resolveInstructionConditions()).
    * @param log the @a ostringstream to log success messages to (if necessary).
    * @return @a RESULT_OK on success, or an error code.
    */
-  result_t executeInstructions(void (*readMessageFunc)(Message* message), ostringstream* log);
+  result_t executeInstructions(ostringstream* log);
 
   /**
    * Add a loaded file to a participant.
@@ -1451,16 +1849,36 @@ class MessageMap : public MappedFileReader {
    * @param hash optional pointer to a @a size_t value for storing the hash of the file, or nullptr.
    * @param size optional pointer to a @a size_t value for storing the normalized size of the file, or nullptr.
    * @param time optional pointer to a @a time_t value for storing the modification time of the file, or nullptr.
+   * @param defaults optional pointer to a map in which to store the defaults the file was loaded with, or nullptr.
+   * @param hasInstructions optional pointer to a bool for storing whether the file contained instructions, or
+   * nullptr.
    * @return true if the file info was found, false otherwise.
    */
   bool getLoadedFileInfo(const string& filename, string* comment, size_t* hash = nullptr, size_t* size = nullptr,
-      time_t* time = nullptr) const;
+      time_t* time = nullptr, map<string, string>* defaults = nullptr, bool* hasInstructions = nullptr) const;
+
+  /**
+   * Detach all @a Message instances and conditions loaded from the specified file in preparation of reloading it.
+   * The detached instances are kept until @a reattachFile() is called for the same file.
+   * @param filename the name of the configuration file (including relative path).
+   * @return @a RESULT_OK on success, or @a RESULT_ERR_INVALID_ARG if one of the instances is referenced by a
+   * condition (which requires a full reload).
+   */
+  result_t detachFile(const string& filename);
+
+  /**
+   * Finish reloading the specified file detached before: the newly loaded @a Message instances with the same key
+   * and name take over the last seen data of the detached ones, which are freed afterwards.
+   * @param filename the name of the configuration file (including relative path).
+   * @return the number of @a Message instances that took over the last seen data.
+   */
+  size_t reattachFile(const string& filename);
 
   /**
    * Get the stored @a Message instances for the key.
    * @param key the key of the @a Message.
    * @return the found @a Message instances, or nullptr.
-   * Note: the caller may not free the returned instances.
+   * Note: the caller may not free the returned instances and has to hold the shared lock while using them.
    */
   const vector<Message*>* getByKey(uint64_t key) const;
 
@@ -1504,15 +1922,27 @@ class MessageMap : public MappedFileReader {
     time_t since, time_t until, bool changedSince, deque<Message*>* messages) const;
 
   /**
-   * Get the first available @a Message from the first map iterator entry.
-   * @param it the map iterator with list of @a Message instances to check.
+   * Find all messages added since the specified generation of the change journal. When messages were removed in the
+   * meantime (e.g. due to reloading the configuration), all messages are found instead.
+   * @param generation the variable with the generation from the previous call (0 for finding all messages), updated
+   * to the current generation.
+   * @param levels the access levels to match.
+   * @param onlyAvailable true to include only available messages, false to also include messages that are currently
+   * not available.
+   * @param messages the @a deque to which to add the found @a Message instances.
+   * @return true if only the messages added since the generation were found, false if all messages were found.
+   */
+  bool findAllAdded(uint64_t* generation, const string& levels, bool onlyAvailable, deque<Message*>* messages);
+
+  /**
+   * Get the first available @a Message indexed by the key.
+   * @param key the @a Message key to look up in the @a MessageKeyIndex.
    * @param sameIdExtAs the optional @a MasterSymbolString to check for having the same ID.
    * @param onlyAvailable true to include only available messages (default true), false to also include messages that
    * are currently not available (e.g. due to unresolved or false conditions).
-   * @return the first available @a Message from the first map iterator entry.
+   * @return the first available @a Message indexed by the key, or nullptr.
    */
-  Message* getFirstAvailableFromIterator(const map<uint64_t, vector<Message*> >::const_iterator& it,
-    const MasterSymbolString* sameIdExtAs, bool onlyAvailable) const;
+  Message* getFirstAvailableByKey(uint64_t key, const MasterSymbolString* sameIdExtAs, bool onlyAvailable) const;
 
   /**
    * Find the @a Message instance for the specified master data.
@@ -1535,6 +1965,21 @@ class MessageMap : public MappedFileReader {
    */
   void invalidateCache(Message* message);
 
+  /**
+   * Format the last data of all stored @a Message instances having data for persisting it.
+   * @param output the @a ostream to append one line per @a Message to.
+   */
+  void formatState(ostream* output);
+
+  /**
+   * Restore the last data of a @a Message from a line formatted by @a formatState().
+   * The data is restored immediately if the @a Message is already known, or otherwise as soon as it gets added (e.g.
+   * after loading the configuration file of a scanned slave).
+   * @param line the line to parse.
+   * @return true when the line was valid.
+   */
+  bool restoreState(const string& line);
+
   /**
    * Add a @a Message to the list of instances to poll.
    * @param toFront whether to add the @a Message to the very front of the poll queue.
@@ -1552,14 +1997,25 @@ class MessageMap : public MappedFileReader {
   bool decodeCircuit(const string& circuit, OutputFormat outputFormat, ostringstream* output) const;
 
   /**
-   * Lock this instance against simultaneous modifying access.
+   * Lock this instance exclusively for modifying access (e.g. while loading the configuration).
+   */
+  void lock() { m_accessMutex.lock(); }
+
+  /**
+   * Release the exclusive lock taken with @a lock().
+   */
+  void unlock() { m_accessMutex.unlock(); }
+
+  /**
+   * Lock this instance for reading access shared with other readers. Required while using the result of
+   * @a getByKey() or iterating over found @a Message instances that might otherwise be removed by a reload.
    */
-  void lock() { m_mutex.lock(); }
+  void lockShared() const { m_accessMutex.lockShared(); }
 
   /**
-   * Unlock this instance against simultaneous modifying access.
+   * Release the shared lock taken with @a lockShared().
    */
-  void unlock() { m_mutex.unlock(); }
+  void unlockShared() const { m_accessMutex.unlockShared(); }
 
   /**
    * Removes all @a Message instances.
@@ -1584,6 +2040,13 @@ class MessageMap : public MappedFileReader {
    */
   size_t sizePassive() const { return m_passiveMessageCount; }
 
+  /**
+   * Get the estimated memory used by all stored @a Message instances, their indexes, and the conditions.
+   * Note: the caller has to hold the shared lock (see @a lockShared()).
+   * @return the estimated number of bytes.
+   */
+  size_t getMemoryUsage() const;
+
   /**
    * Get the number of stored @a Message instances with a poll priority.
    * @return the the number of stored @a Message instances with a poll priority.
@@ -1591,11 +2054,16 @@ class MessageMap : public MappedFileReader {
   size_t sizePoll() const { return m_pollMessages.size(); }
 
   /**
-   * Get the next @a Message to poll.
+   * Get the next @a Message to poll. Messages that were updated recently by other means are skipped (without
+   * consuming the poll) and re-inserted like a polled one.
+   * @param now the current system time.
+   * @param pollInterval the interval in seconds in which poll messages are cycled.
+   * @param onlyDue whether to return only a message that is due for polling (see @a Message::isPollDue()), e.g. for
+   * filling idle bus time.
    * @return the next @a Message to poll, or nullptr.
    * Note: the caller may not free the returned instance.
    */
-  Message* getNextPoll();
+  Message* getNextPoll(time_t now, unsigned int pollInterval, bool onlyDue = false);
 
   /**
    * Get the number of stored @a Condition instances.
@@ -1619,6 +2087,26 @@ class MessageMap : public MappedFileReader {
 
 
  private:
+  /**
+   * Remove a @a Message from all indexes and the poll queue without freeing it.
+   * @param message the @a Message to unlink.
+   * @return true if the @a Message was found in any of the indexes.
+   */
+  bool unlink(Message* message);
+
+  /**
+   * Add a @a Message to the circular list of siblings of another @a Message.
+   * @param message the @a Message to link (removed from its current siblings first).
+   * @param sibling the @a Message with the same circuit and name.
+   */
+  static void linkSibling(Message* message, Message* sibling);
+
+  /**
+   * Remove a @a Message from its circular list of siblings.
+   * @param message the @a Message to unlink.
+   */
+  static void unlinkSibling(Message* message);
+
   /** empty vector for @a getLoadedFiles(). */
   static vector<string> s_noFiles;
 
@@ -1628,6 +2116,22 @@ class MessageMap : public MappedFileReader {
   /** whether to add all messages, even if duplicate. */
   const bool m_addAll;
 
+  /** whether this is a staging instance created by @a createStaging(). */
+  bool m_staging;
+
+  /** the added @a Message instances with their line number in the order they were read (staging instance only). */
+  vector<pair<unsigned int, Message*>> m_stagedMessages;
+
+  /** additional attributes by circuit name derived from the file name (staging instance only). */
+  map<string, AttributedItem*> m_stagedCircuitData;
+
+  /** the change journal with the @a Message instances stored by name in the order they were added since the last
+   * removal (with detached instances replaced by nullptr). */
+  vector<Message*> m_journal;
+
+  /** the change journal generation of the first entry in @a m_journal. */
+  uint64_t m_journalStart;
+
   /** the @a Message instance used for scanning a slave. */
   Message* m_scanMessage;
 
@@ -1643,6 +2147,12 @@ class MessageMap : public MappedFileReader {
   /** the @a LoadedFileInfo by for load configuration files (by file name with relative path). */
   map<string, LoadedFileInfo> m_loadedFileInfos;
 
+  /** the @a Message instances detached by @a detachFile() (by file name with relative path). */
+  map<string, vector<Message*>> m_detachedMessages;
+
+  /** the @a Condition instances detached by @a detachFile() (by file name with relative path). */
+  map<string, vector<Condition*>> m_detachedConditions;
+
   /** the maximum ID length used by any of the known @a Message instances. */
   size_t m_maxIdLength;
 
@@ -1658,15 +2168,44 @@ class MessageMap : public MappedFileReader {
   /** the number of distinct passive @a Message instances stored in @a m_messagesByKey. */
   size_t m_passiveMessageCount;
 
+  /** the size of the data history to enable for each added @a Message, or 0. */
+  size_t m_historySize;
+
+  /** the persisted data of a @a Message to restore. */
+  typedef struct {
+    uint64_t key;  //!< the key of the @a Message
+    time_t lastUpdateTime;  //!< the time when the data was last updated
+    MasterSymbolString master;  //!< the last master data
+    SlaveSymbolString slave;  //!< the last slave data
+  } restoredData_t;
+
+  /** the persisted data of not yet added @a Message instances by name key (see @a m_messagesByName). */
+  map<string, restoredData_t> m_restoredData;
+
   /** the known @a Message instances by lowercase circuit (optional), name, and type. */
   map<string, vector<Message*> > m_messagesByName;
 
   /** the known @a Message instances by key. */
   map<uint64_t, vector<Message*> > m_messagesByKey;
 
+  /** the hash index on top of @a m_messagesByKey for fast lookup of received telegrams. */
+  MessageKeyIndex m_keyIndex;
+
+  /**
+   * the bits for each combination of primary and secondary ID byte used by any of the known @a Message instances
+   * (negative cache for telegrams from unknown messages, only reset on @a clear()).
+   */
+  bitset<0x10000> m_knownPbSb;
+
   /** the known @a Message instances to poll, by priority. */
   MessagePriorityQueue m_pollMessages;
 
+  /** @a SharedMutex for reading access shared between threads and exclusive modifying access. */
+  mutable SharedMutex m_accessMutex;
+
+  /** @a Mutex for access to @a m_pollMessages (separate for not blocking the bus thread). */
+  Mutex m_pollMutex;
+
   /** the @a Condition instances by filename and condition name. */
   map<string, Condition*> m_conditions;
 
@@ -38,6 +38,8 @@ static const char* knownFieldNames[] = {
 /** the number of known field names. */
 static const size_t knownFieldCount = sizeof(knownFieldNames) / sizeof(char*);
 
+static_assert(knownFieldCount == REPLACER_SLOT_COUNT, "slot count mismatch");
+
 std::pair<string, int> StringReplacer::makeField(const string& name, bool isField) {
   if (!isField) {
     return {name, -1};
@@ -177,21 +179,41 @@ bool StringReplacer::has(const string& field) const {
 }
 
 string StringReplacer::get(const map<string, string>& values, bool untilFirstEmpty, bool onlyAlphanum) const {
-  ostringstream ret;
+  string ret;
   for (const auto &it : m_parts) {
     if (it.second < 0) {
-      ret << it.first;
+      ret += it.first;
       continue;
     }
     const auto pos = values.find(it.first);
-    if (pos == values.cend()) {
+    if (pos == values.cend() || pos->second.empty()) {
       if (untilFirstEmpty) {
         break;
       }
       if (m_emptyIfMissing) {
         return "";
       }
-    } else if (pos->second.empty()) {
+    } else {
+      ret += pos->second;
+    }
+  }
+  if (onlyAlphanum) {
+    normalize(ret);
+  }
+  return ret;
+}
+
+string StringReplacer::render(const string* const slots[REPLACER_SLOT_COUNT], bool untilFirstEmpty,
+  bool onlyAlphanum) const {
+  string ret;
+  for (const auto &it : m_parts) {
+    if (it.second < 0) {
+      ret += it.first;
+      continue;
+    }
+    // unknown fields are never set in the slots
+    const string* value = it.second < REPLACER_SLOT_COUNT ? slots[it.second] : nullptr;
+    if (!value || value->empty()) {
       if (untilFirstEmpty) {
         break;
       }
@@ -199,35 +221,25 @@ string StringReplacer::get(const map<string, string>& values, bool untilFirstEmp
         return "";
       }
     } else {
-      ret << pos->second;
+      ret += *value;
     }
   }
-  if (!onlyAlphanum) {
-    return ret.str();
+  if (onlyAlphanum) {
+    normalize(ret);
   }
-  string str = ret.str();
-  normalize(str);
-  return str;
+  return ret;
 }
 
 string StringReplacer::get(const string& circuit, const string& name, const string& fieldName) const {
-  map <string, string> values;
-  values["circuit"] = circuit;
-  values["name"] = name;
-  if (!fieldName.empty()) {
-    values["field"] = fieldName;
-  }
-  return get(values, true);
+  const string* slots[REPLACER_SLOT_COUNT] = {&circuit, &name, &fieldName};
+  return render(slots, true, false);
 }
 
 string StringReplacer::get(const Message* message, const string& fieldName) const {
-  map<string, string> values;
-  values["circuit"] = message->getCircuit();
-  values["name"] = message->getName();
-  if (!fieldName.empty()) {
-    values["field"] = fieldName;
-  }
-  return get(message->getCircuit(), message->getName(), fieldName);
+  const string circuit = message->getCircuit();
+  const string name = message->getName();
+  const string* slots[REPLACER_SLOT_COUNT] = {&circuit, &name, &fieldName};
+  return render(slots, true, false);
 }
 
 bool StringReplacer::isReducable(const map<string, string>& values) const {
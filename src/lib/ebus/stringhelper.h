@@ -40,6 +40,9 @@ using std::ostringstream;
 using std::string;
 using std::vector;
 
+/** the number of fixed value slots of a @a StringReplacer, one for each known field name (circuit, name, field). */
+#define REPLACER_SLOT_COUNT 3
+
 
 /**
  * Helper class for replacing a template string with real values.
@@ -176,6 +179,15 @@ class StringReplacer {
    */
   static pair<string, int> makeField(const string& name, bool isField);
 
+  /**
+   * Get the replaced template string from the fixed value slots without any named lookup.
+   * @param slots the values of the known field names by their slot index, nullptr for undefined values.
+   * @param untilFirstEmpty true to only return the prefix before the first empty field.
+   * @param onlyAlphanum whether to only allow alpha numeric characters plus underscore.
+   * @return the replaced template string.
+   */
+  string render(const string* const slots[REPLACER_SLOT_COUNT], bool untilFirstEmpty, bool onlyAlphanum) const;
+
   /**
    * Add a part to the list of parts.
    * @param stack the parsing stack.
@@ -54,6 +54,72 @@ static const symbol_t CRC_LOOKUP_TABLE[] = {
   0x95, 0x0e, 0x38, 0xa3, 0x54, 0xcf, 0xf9, 0x62, 0x8c, 0x17, 0x21, 0xba, 0x4d, 0xd6, 0xe0, 0x7b,
 };
 
+/**
+ * CRC8 lookup table for two subsequent updates, i.e. CRC_LOOKUP_TABLE applied 2 times (for slicing).
+ */
+static const symbol_t CRC_LOOKUP_TABLE2[] = {
+  0x00, 0x16, 0x2c, 0x3a, 0x58, 0x4e, 0x74, 0x62, 0xb0, 0xa6, 0x9c, 0x8a, 0xe8, 0xfe, 0xc4, 0xd2,
+  0xfb, 0xed, 0xd7, 0xc1, 0xa3, 0xb5, 0x8f, 0x99, 0x4b, 0x5d, 0x67, 0x71, 0x13, 0x05, 0x3f, 0x29,
+  0x6d, 0x7b, 0x41, 0x57, 0x35, 0x23, 0x19, 0x0f, 0xdd, 0xcb, 0xf1, 0xe7, 0x85, 0x93, 0xa9, 0xbf,
+  0x96, 0x80, 0xba, 0xac, 0xce, 0xd8, 0xe2, 0xf4, 0x26, 0x30, 0x0a, 0x1c, 0x7e, 0x68, 0x52, 0x44,
+  0xda, 0xcc, 0xf6, 0xe0, 0x82, 0x94, 0xae, 0xb8, 0x6a, 0x7c, 0x46, 0x50, 0x32, 0x24, 0x1e, 0x08,
+  0x21, 0x37, 0x0d, 0x1b, 0x79, 0x6f, 0x55, 0x43, 0x91, 0x87, 0xbd, 0xab, 0xc9, 0xdf, 0xe5, 0xf3,
+  0xb7, 0xa1, 0x9b, 0x8d, 0xef, 0xf9, 0xc3, 0xd5, 0x07, 0x11, 0x2b, 0x3d, 0x5f, 0x49, 0x73, 0x65,
+  0x4c, 0x5a, 0x60, 0x76, 0x14, 0x02, 0x38, 0x2e, 0xfc, 0xea, 0xd0, 0xc6, 0xa4, 0xb2, 0x88, 0x9e,
+  0x2f, 0x39, 0x03, 0x15, 0x77, 0x61, 0x5b, 0x4d, 0x9f, 0x89, 0xb3, 0xa5, 0xc7, 0xd1, 0xeb, 0xfd,
+  0xd4, 0xc2, 0xf8, 0xee, 0x8c, 0x9a, 0xa0, 0xb6, 0x64, 0x72, 0x48, 0x5e, 0x3c, 0x2a, 0x10, 0x06,
+  0x42, 0x54, 0x6e, 0x78, 0x1a, 0x0c, 0x36, 0x20, 0xf2, 0xe4, 0xde, 0xc8, 0xaa, 0xbc, 0x86, 0x90,
+  0xb9, 0xaf, 0x95, 0x83, 0xe1, 0xf7, 0xcd, 0xdb, 0x09, 0x1f, 0x25, 0x33, 0x51, 0x47, 0x7d, 0x6b,
+  0xf5, 0xe3, 0xd9, 0xcf, 0xad, 0xbb, 0x81, 0x97, 0x45, 0x53, 0x69, 0x7f, 0x1d, 0x0b, 0x31, 0x27,
+  0x0e, 0x18, 0x22, 0x34, 0x56, 0x40, 0x7a, 0x6c, 0xbe, 0xa8, 0x92, 0x84, 0xe6, 0xf0, 0xca, 0xdc,
+  0x98, 0x8e, 0xb4, 0xa2, 0xc0, 0xd6, 0xec, 0xfa, 0x28, 0x3e, 0x04, 0x12, 0x70, 0x66, 0x5c, 0x4a,
+  0x63, 0x75, 0x4f, 0x59, 0x3b, 0x2d, 0x17, 0x01, 0xd3, 0xc5, 0xff, 0xe9, 0x8b, 0x9d, 0xa7, 0xb1,
+};
+
+/**
+ * CRC8 lookup table for three subsequent updates, i.e. CRC_LOOKUP_TABLE applied 3 times (for slicing).
+ */
+static const symbol_t CRC_LOOKUP_TABLE3[] = {
+  0x00, 0x5e, 0xbc, 0xe2, 0xe3, 0xbd, 0x5f, 0x01, 0x5d, 0x03, 0xe1, 0xbf, 0xbe, 0xe0, 0x02, 0x5c,
+  0xba, 0xe4, 0x06, 0x58, 0x59, 0x07, 0xe5, 0xbb, 0xe7, 0xb9, 0x5b, 0x05, 0x04, 0x5a, 0xb8, 0xe6,
+  0xef, 0xb1, 0x53, 0x0d, 0x0c, 0x52, 0xb0, 0xee, 0xb2, 0xec, 0x0e, 0x50, 0x51, 0x0f, 0xed, 0xb3,
+  0x55, 0x0b, 0xe9, 0xb7, 0xb6, 0xe8, 0x0a, 0x54, 0x08, 0x56, 0xb4, 0xea, 0xeb, 0xb5, 0x57, 0x09,
+  0x45, 0x1b, 0xf9, 0xa7, 0xa6, 0xf8, 0x1a, 0x44, 0x18, 0x46, 0xa4, 0xfa, 0xfb, 0xa5, 0x47, 0x19,
+  0xff, 0xa1, 0x43, 0x1d, 0x1c, 0x42, 0xa0, 0xfe, 0xa2, 0xfc, 0x1e, 0x40, 0x41, 0x1f, 0xfd, 0xa3,
+  0xaa, 0xf4, 0x16, 0x48, 0x49, 0x17, 0xf5, 0xab, 0xf7, 0xa9, 0x4b, 0x15, 0x14, 0x4a, 0xa8, 0xf6,
+  0x10, 0x4e, 0xac, 0xf2, 0xf3, 0xad, 0x4f, 0x11, 0x4d, 0x13, 0xf1, 0xaf, 0xae, 0xf0, 0x12, 0x4c,
+  0x8a, 0xd4, 0x36, 0x68, 0x69, 0x37, 0xd5, 0x8b, 0xd7, 0x89, 0x6b, 0x35, 0x34, 0x6a, 0x88, 0xd6,
+  0x30, 0x6e, 0x8c, 0xd2, 0xd3, 0x8d, 0x6f, 0x31, 0x6d, 0x33, 0xd1, 0x8f, 0x8e, 0xd0, 0x32, 0x6c,
+  0x65, 0x3b, 0xd9, 0x87, 0x86, 0xd8, 0x3a, 0x64, 0x38, 0x66, 0x84, 0xda, 0xdb, 0x85, 0x67, 0x39,
+  0xdf, 0x81, 0x63, 0x3d, 0x3c, 0x62, 0x80, 0xde, 0x82, 0xdc, 0x3e, 0x60, 0x61, 0x3f, 0xdd, 0x83,
+  0xcf, 0x91, 0x73, 0x2d, 0x2c, 0x72, 0x90, 0xce, 0x92, 0xcc, 0x2e, 0x70, 0x71, 0x2f, 0xcd, 0x93,
+  0x75, 0x2b, 0xc9, 0x97, 0x96, 0xc8, 0x2a, 0x74, 0x28, 0x76, 0x94, 0xca, 0xcb, 0x95, 0x77, 0x29,
+  0x20, 0x7e, 0x9c, 0xc2, 0xc3, 0x9d, 0x7f, 0x21, 0x7d, 0x23, 0xc1, 0x9f, 0x9e, 0xc0, 0x22, 0x7c,
+  0x9a, 0xc4, 0x26, 0x78, 0x79, 0x27, 0xc5, 0x9b, 0xc7, 0x99, 0x7b, 0x25, 0x24, 0x7a, 0x98, 0xc6,
+};
+
+/**
+ * CRC8 lookup table for four subsequent updates, i.e. CRC_LOOKUP_TABLE applied 4 times (for slicing).
+ */
+static const symbol_t CRC_LOOKUP_TABLE4[] = {
+  0x00, 0x8f, 0x85, 0x0a, 0x91, 0x1e, 0x14, 0x9b, 0xb9, 0x36, 0x3c, 0xb3, 0x28, 0xa7, 0xad, 0x22,
+  0xe9, 0x66, 0x6c, 0xe3, 0x78, 0xf7, 0xfd, 0x72, 0x50, 0xdf, 0xd5, 0x5a, 0xc1, 0x4e, 0x44, 0xcb,
+  0x49, 0xc6, 0xcc, 0x43, 0xd8, 0x57, 0x5d, 0xd2, 0xf0, 0x7f, 0x75, 0xfa, 0x61, 0xee, 0xe4, 0x6b,
+  0xa0, 0x2f, 0x25, 0xaa, 0x31, 0xbe, 0xb4, 0x3b, 0x19, 0x96, 0x9c, 0x13, 0x88, 0x07, 0x0d, 0x82,
+  0x92, 0x1d, 0x17, 0x98, 0x03, 0x8c, 0x86, 0x09, 0x2b, 0xa4, 0xae, 0x21, 0xba, 0x35, 0x3f, 0xb0,
+  0x7b, 0xf4, 0xfe, 0x71, 0xea, 0x65, 0x6f, 0xe0, 0xc2, 0x4d, 0x47, 0xc8, 0x53, 0xdc, 0xd6, 0x59,
+  0xdb, 0x54, 0x5e, 0xd1, 0x4a, 0xc5, 0xcf, 0x40, 0x62, 0xed, 0xe7, 0x68, 0xf3, 0x7c, 0x76, 0xf9,
+  0x32, 0xbd, 0xb7, 0x38, 0xa3, 0x2c, 0x26, 0xa9, 0x8b, 0x04, 0x0e, 0x81, 0x1a, 0x95, 0x9f, 0x10,
+  0xbf, 0x30, 0x3a, 0xb5, 0x2e, 0xa1, 0xab, 0x24, 0x06, 0x89, 0x83, 0x0c, 0x97, 0x18, 0x12, 0x9d,
+  0x56, 0xd9, 0xd3, 0x5c, 0xc7, 0x48, 0x42, 0xcd, 0xef, 0x60, 0x6a, 0xe5, 0x7e, 0xf1, 0xfb, 0x74,
+  0xf6, 0x79, 0x73, 0xfc, 0x67, 0xe8, 0xe2, 0x6d, 0x4f, 0xc0, 0xca, 0x45, 0xde, 0x51, 0x5b, 0xd4,
+  0x1f, 0x90, 0x9a, 0x15, 0x8e, 0x01, 0x0b, 0x84, 0xa6, 0x29, 0x23, 0xac, 0x37, 0xb8, 0xb2, 0x3d,
+  0x2d, 0xa2, 0xa8, 0x27, 0xbc, 0x33, 0x39, 0xb6, 0x94, 0x1b, 0x11, 0x9e, 0x05, 0x8a, 0x80, 0x0f,
+  0xc4, 0x4b, 0x41, 0xce, 0x55, 0xda, 0xd0, 0x5f, 0x7d, 0xf2, 0xf8, 0x77, 0xec, 0x63, 0x69, 0xe6,
+  0x64, 0xeb, 0xe1, 0x6e, 0xf5, 0x7a, 0x70, 0xff, 0xdd, 0x52, 0x58, 0xd7, 0x4c, 0xc3, 0xc9, 0x46,
+  0x8d, 0x02, 0x08, 0x87, 0x1c, 0x93, 0x99, 0x16, 0x34, 0xbb, 0xb1, 0x3e, 0xa5, 0x2a, 0x20, 0xaf,
+};
+
 
 unsigned int parseInt(const char* str, int base, unsigned int minValue, unsigned int maxValue,
     result_t* result, size_t* length) {
@@ -100,6 +166,37 @@ int parseSignedInt(const char* str, int base, int minValue, int maxValue,
 }
 
 
+void SymbolBuffer::reserve(size_t capacity) {
+  if (capacity <= m_capacity) {
+    return;
+  }
+  symbol_t* heap = new symbol_t[capacity];
+  memcpy(heap, data(), m_size);
+  if (m_heap) {
+    delete[] m_heap;
+  }
+  m_heap = heap;
+  m_capacity = capacity;
+}
+
+void SymbolBuffer::moveFrom(SymbolBuffer* other) {
+  if (!other->m_heap) {
+    assign(other->m_inline, other->m_size);  // inline symbols are simply copied
+    other->m_size = 0;
+    return;
+  }
+  if (m_heap) {
+    delete[] m_heap;
+  }
+  m_heap = other->m_heap;
+  m_size = other->m_size;
+  m_capacity = other->m_capacity;
+  other->m_heap = nullptr;
+  other->m_size = 0;
+  other->m_capacity = SYMBOL_BUFFER_INLINE_SIZE;
+}
+
+
 void SymbolString::updateCrc(symbol_t value, symbol_t* crc) {
   *crc = CRC_LOOKUP_TABLE[*crc]^value;
 }
@@ -176,23 +273,53 @@ bool SymbolString::dumpJson(bool withSeparator, ostringstream* output) const {
   return true;
 }
 
-symbol_t SymbolString::calcCrc() const {
-  symbol_t crc = 0;
-  for (size_t i = 0; i < m_data.size(); i++) {
-    symbol_t value = m_data[i];
-    if (value == ESC) {
-      updateCrc(ESC, &crc);
-      updateCrc(0x00, &crc);
-    } else if (value == SYN) {
-      updateCrc(ESC, &crc);
-      updateCrc(0x01, &crc);
+symbol_t SymbolString::calcEscapedCrc(const symbol_t* data, size_t len, symbol_t crc) {
+  const symbol_t* end = data+len;
+  for (; data+4 <= end; data += 4) {
+    crc = CRC_LOOKUP_TABLE4[crc]^CRC_LOOKUP_TABLE3[data[0]]^CRC_LOOKUP_TABLE2[data[1]]
+      ^CRC_LOOKUP_TABLE[data[2]]^data[3];
+  }
+  for (; data < end; data++) {
+    crc = CRC_LOOKUP_TABLE[crc]^*data;
+  }
+  return crc;
+}
+
+/**
+ * Return whether the symbol needs to be escaped.
+ * @param value the unescaped symbol.
+ * @return true for #ESC and #SYN.
+ */
+static inline bool isEscapable(symbol_t value) {
+  return static_cast<symbol_t>(value-ESC) <= SYN-ESC;
+}
+
+symbol_t SymbolString::calcUnescapedCrc(const symbol_t* data, size_t len, symbol_t crc) {
+  const symbol_t* end = data+len;
+  while (data < end) {
+    if (data+4 <= end && !isEscapable(data[0]) && !isEscapable(data[1]) && !isEscapable(data[2])
+        && !isEscapable(data[3])) {
+      // fast path without escape sequence
+      crc = CRC_LOOKUP_TABLE4[crc]^CRC_LOOKUP_TABLE3[data[0]]^CRC_LOOKUP_TABLE2[data[1]]
+        ^CRC_LOOKUP_TABLE[data[2]]^data[3];
+      data += 4;
+      continue;
+    }
+    symbol_t value = *data++;
+    if (isEscapable(value)) {
+      // ESC followed by 0x00 for ESC or 0x01 for SYN
+      crc = CRC_LOOKUP_TABLE2[crc]^CRC_LOOKUP_TABLE[ESC]^(value == ESC ? 0x00 : 0x01);
     } else {
-      updateCrc(value, &crc);
+      crc = CRC_LOOKUP_TABLE[crc]^value;
     }
   }
   return crc;
 }
 
+symbol_t SymbolString::calcCrc() const {
+  return calcUnescapedCrc(m_data.data(), m_data.size());
+}
+
 
 /**
  * Return the index of the upper or lower 4 bits of a master address.
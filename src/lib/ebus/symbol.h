@@ -24,6 +24,7 @@
 #include <sstream>
 #include <queue>
 #include <string>
+#include <utility>
 #include <vector>
 #include "lib/ebus/result.h"
 
@@ -114,6 +115,166 @@ unsigned int parseInt(const char* str, int base, unsigned int minValue, unsigned
 int parseSignedInt(const char* str, int base, int minValue, int maxValue,
     result_t* result, size_t* length = nullptr, bool allowIncomplete = false);
 
+/** the number of symbols a @a SymbolBuffer holds without heap allocation (more than any master or slave part). */
+#define SYMBOL_BUFFER_INLINE_SIZE 40
+
+/**
+ * A sequence of symbols stored inline up to @a SYMBOL_BUFFER_INLINE_SIZE and on the heap only beyond that.
+ */
+class SymbolBuffer {
+ public:
+  /**
+   * Creates a new empty instance.
+   */
+  SymbolBuffer() : m_heap(nullptr), m_size(0), m_capacity(SYMBOL_BUFFER_INLINE_SIZE) {}
+
+  /**
+   * Copy constructor.
+   * @param other the @a SymbolBuffer to copy from.
+   */
+  SymbolBuffer(const SymbolBuffer& other) : SymbolBuffer() { assign(other.data(), other.m_size); }
+
+  /**
+   * Move constructor.
+   * @param other the @a SymbolBuffer to move from.
+   */
+  SymbolBuffer(SymbolBuffer&& other) : SymbolBuffer() { moveFrom(&other); }
+
+  /**
+   * Destructor.
+   */
+  ~SymbolBuffer() {
+    if (m_heap) {
+      delete[] m_heap;
+    }
+  }
+
+  SymbolBuffer& operator=(const SymbolBuffer& other) {
+    if (this != &other) {
+      assign(other.data(), other.m_size);
+    }
+    return *this;
+  }
+
+  SymbolBuffer& operator=(SymbolBuffer&& other) {
+    if (this != &other) {
+      moveFrom(&other);
+    }
+    return *this;
+  }
+
+  bool operator==(const SymbolBuffer& other) const {
+    return m_size == other.m_size && memcmp(data(), other.data(), m_size) == 0;
+  }
+
+  bool operator!=(const SymbolBuffer& other) const { return !(*this == other); }
+
+  symbol_t& operator[](size_t index) { return data()[index]; }
+
+  symbol_t operator[](size_t index) const { return data()[index]; }
+
+  /**
+   * @return the pointer to the first symbol.
+   */
+  symbol_t* data() { return m_heap ? m_heap : m_inline; }
+
+  /**
+   * @return the pointer to the first symbol.
+   */
+  const symbol_t* data() const { return m_heap ? m_heap : m_inline; }
+
+  /**
+   * @return the pointer to the first symbol.
+   */
+  const symbol_t* begin() const { return data(); }
+
+  /**
+   * @return the pointer behind the last symbol.
+   */
+  const symbol_t* end() const { return data() + m_size; }
+
+  /**
+   * @return the number of symbols.
+   */
+  size_t size() const { return m_size; }
+
+  /**
+   * @return the number of bytes allocated on the heap, or 0 while the symbols fit into the inline storage.
+   */
+  size_t getHeapSize() const { return m_heap ? m_capacity : 0; }
+
+  /**
+   * Append a symbol.
+   * @param value the symbol to append.
+   */
+  void push_back(symbol_t value) {
+    if (m_size == m_capacity) {
+      reserve(2 * m_capacity);
+    }
+    data()[m_size++] = value;
+  }
+
+  /**
+   * Change the number of symbols.
+   * @param size the new number of symbols.
+   * @param value the symbol to fill added positions with.
+   */
+  void resize(size_t size, symbol_t value = 0) {
+    if (size > m_capacity) {
+      reserve(size);
+    }
+    if (size > m_size) {
+      memset(data() + m_size, value, size - m_size);
+    }
+    m_size = size;
+  }
+
+  /**
+   * Remove all symbols (keeping the capacity).
+   */
+  void clear() { m_size = 0; }
+
+
+ private:
+  /**
+   * Ensure the capacity for the specified number of symbols.
+   * @param capacity the minimum capacity.
+   */
+  void reserve(size_t capacity);
+
+  /**
+   * Replace the symbols.
+   * @param data the symbols to copy.
+   * @param size the number of symbols.
+   */
+  void assign(const symbol_t* data, size_t size) {
+    if (size > m_capacity) {
+      reserve(size);
+    }
+    memcpy(this->data(), data, size);
+    m_size = size;
+  }
+
+  /**
+   * Take over the symbols from another instance and leave that one empty.
+   * @param other the @a SymbolBuffer to move from.
+   */
+  void moveFrom(SymbolBuffer* other);
+
+  /** the inline symbols (unused when @a m_heap is set). */
+  symbol_t m_inline[SYMBOL_BUFFER_INLINE_SIZE];
+
+  /** the symbols on the heap, or nullptr when fitting into @a m_inline. */
+  symbol_t* m_heap;
+
+  /** the number of symbols. */
+  size_t m_size;
+
+  /** the number of symbols fitting in the current storage. */
+  size_t m_capacity;
+};
+
+
 /**
  * A string of unescaped bus symbols.
  */
@@ -133,6 +294,25 @@ class SymbolString {
    */
   static void updateCrc(symbol_t value, symbol_t* crc);
 
+  /**
+   * Calculate the CRC over a buffer of escaped symbols (i.e. as transferred on the bus).
+   * @param data the escaped symbols.
+   * @param len the number of symbols in @a data.
+   * @param crc the initial CRC to update.
+   * @return the calculated CRC.
+   */
+  static symbol_t calcEscapedCrc(const symbol_t* data, size_t len, symbol_t crc = 0);
+
+  /**
+   * Calculate the CRC over a buffer of unescaped symbols by implicitly adding the escape sequence for each
+   * #ESC and #SYN symbol.
+   * @param data the unescaped symbols.
+   * @param len the number of symbols in @a data.
+   * @param crc the initial CRC to update.
+   * @return the calculated CRC.
+   */
+  static symbol_t calcUnescapedCrc(const symbol_t* data, size_t len, symbol_t crc = 0);
+
   /**
    * Return whether this instance if for the master part.
    * @return whether this instance if for the master part.
@@ -197,7 +377,7 @@ class SymbolString {
    * @param other the other instance.
    * @return true if this instance is equal to the other instance.
    */
-  bool operator == (const SymbolString& other) {
+  bool operator == (const SymbolString& other) const {
     return m_isMaster == other.m_isMaster && m_data == other.m_data;
   }
 
@@ -206,7 +386,7 @@ class SymbolString {
    * @param other the other instance.
    * @return true if this instance is different from the other instance.
    */
-  bool operator != (const SymbolString& other) {
+  bool operator != (const SymbolString& other) const {
     return m_isMaster != other.m_isMaster || m_data != other.m_data;
   }
 
@@ -230,7 +410,7 @@ class SymbolString {
     if (m_data.size() == 1) {
       return 2;
     }
-    if (equal(m_data.begin()+1, m_data.end(), other.m_data.begin()+1)) {
+    if (memcmp(m_data.begin()+1, other.m_data.begin()+1, m_data.size()-1) == 0) {
       return 2;
     }
     return 1;
@@ -248,6 +428,12 @@ class SymbolString {
    */
   size_t size() const { return m_data.size(); }
 
+  /**
+   * Return the number of bytes allocated on the heap for this symbol string.
+   * @return the number of bytes allocated on the heap.
+   */
+  size_t getHeapSize() const { return m_data.getHeapSize(); }
+
   /**
    * Adjust the header NN field to the number of data bytes DD.
    * @return true on success, false if the number of data bytes DD is too big.
@@ -352,8 +538,15 @@ class SymbolString {
   SymbolString(const SymbolString& str)
     : m_data(str.m_data), m_isMaster(str.m_isMaster) {}
 
+  /**
+   * Hidden move constructor.
+   * @param str the @a SymbolString to move from.
+   */
+  SymbolString(SymbolString&& str)
+    : m_data(std::move(str.m_data)), m_isMaster(str.m_isMaster) {}
+
   /** the string of unescaped symbols. */
-  vector<symbol_t> m_data;
+  SymbolBuffer m_data;
 
   /** whether this instance is for the master part. */
   bool m_isMaster;
@@ -376,12 +569,24 @@ class MasterSymbolString : public SymbolString {
    */
   MasterSymbolString(const MasterSymbolString& str) : SymbolString(str) {}
 
+  /**
+   * Move constructor.
+   * @param str the @a MasterSymbolString to move from.
+   */
+  MasterSymbolString(MasterSymbolString&& str) : SymbolString(std::move(str)) {}
+
   MasterSymbolString& operator=(const MasterSymbolString& other) {
     this->m_data = other.m_data;
     this->m_isMaster = true;
     return *this;
   }
 
+  MasterSymbolString& operator=(MasterSymbolString&& other) {
+    this->m_data = std::move(other.m_data);
+    this->m_isMaster = true;
+    return *this;
+  }
+
   MasterSymbolString& operator=(const MasterSymbolString* other) {
     this->m_data = other->m_data;
     this->m_isMaster = true;
@@ -406,12 +611,24 @@ class SlaveSymbolString : public SymbolString {
    */
   SlaveSymbolString(const SlaveSymbolString& str) : SymbolString(str) {}
 
+  /**
+   * Move constructor.
+   * @param str the @a SlaveSymbolString to move from.
+   */
+  SlaveSymbolString(SlaveSymbolString&& str) : SymbolString(std::move(str)) {}
+
   SlaveSymbolString& operator=(const SlaveSymbolString& other) {
     this->m_data = other.m_data;
     this->m_isMaster = false;
     return *this;
   }
 
+  SlaveSymbolString& operator=(SlaveSymbolString&& other) {
+    this->m_data = std::move(other.m_data);
+    this->m_isMaster = false;
+    return *this;
+  }
+
   SlaveSymbolString& operator=(const SlaveSymbolString* other) {
     this->m_data = other->m_data;
     this->m_isMaster = false;
@@ -0,0 +1,345 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include "lib/ebus/message.h"
+#include "lib/ebus/stringhelper.h"
+
+using namespace ebusd;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+/** the minimum duration of a single benchmark in nanoseconds. */
+static int64_t minDuration = 200000000;
+
+/** sink for results to avoid the benchmarked code being optimized away. */
+static size_t sink = 0;
+
+/**
+ * Run the function repeatedly until the minimum duration elapsed and print the result as JSON line.
+ * @param name the benchmark name.
+ * @param variant the benchmark variant (e.g. the data type).
+ * @param func the function to benchmark returning a value for the sink.
+ * @param opsPerCall the number of operations done by a single call of the function.
+ */
+template<typename F>
+void bench(const string& name, const string& variant, F func, size_t opsPerCall = 1) {
+  size_t iterations = 1;
+  int64_t duration;
+  while (true) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+      sink += func();
+    }
+    duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+        .count();
+    if (duration >= minDuration || iterations >= (1u << 30)) {
+      break;
+    }
+    iterations *= duration < minDuration / 16 ? 8 : 2;
+  }
+  size_t ops = iterations * opsPerCall;
+  cout << "{\"benchmark\": \"" << name << "\", \"variant\": \"" << variant << "\", \"ops\": " << ops
+       << ", \"ns_per_op\": " << static_cast<double>(duration) / static_cast<double>(ops) << "}" << endl;
+}
+
+namespace ebusd {
+
+class BenchResolver : public Resolver {
+ public:
+  explicit BenchResolver(DataFieldTemplates* templates) : m_templates(templates) {}
+
+  DataFieldTemplates* getTemplates(const string& filename) override {
+    return m_templates;
+  }
+
+  result_t loadDefinitionsFromConfigPath(FileReader* reader, const string& filename,
+      map<string, string>* defaults, string* errorDescription, bool replace = false) override {
+    return RESULT_ERR_NOTFOUND;
+  }
+
+ private:
+  DataFieldTemplates* m_templates;
+};
+
+}  // namespace ebusd
+
+/** the data types with sample slave data for the read/write benchmarks. */
+static const char* dataChecks[][2] = {
+  {"UCH", "012a"},
+  {"SCH", "01f0"},
+  {"D1C", "0164"},
+  {"UIN", "02e803"},
+  {"SIN", "0218fc"},
+  {"D2B", "02a012"},
+  {"D2C", "02a012"},
+  {"ULG", "04a0860100"},
+  {"FLR", "0488130000"},
+  {"EXP", "040000c841"},
+  {"BCD", "0142"},
+  {"HEX:4", "0401020304"},
+  {"STR:8", "0848656c6c6f212121"},
+  {"BDA", "0426110723"},
+  {"HTI", "03172a05"},
+  {"BTI", "03051023"},
+};
+
+void benchData(DataFieldTemplates* templates) {
+  for (const auto& check : dataChecks) {
+    vector< map<string, string> > rows;
+    map<string, string> row;
+    row["name"] = "x";
+    row["part"] = "s";
+    row["type"] = check[0];
+    rows.push_back(row);
+    string errorDescription;
+    const DataField* field = nullptr;
+    result_t result = DataField::create(false, false, false, MAX_POS, templates, &rows, &errorDescription, &field);
+    if (result != RESULT_OK || !field) {
+      cerr << "create " << check[0] << ": " << getResultCode(result) << " " << errorDescription << endl;
+      continue;
+    }
+    SlaveSymbolString slave;
+    slave.parseHex(check[1]);
+    ostringstream output;
+    result = field->read(slave, 0, false, nullptr, -1, OF_NONE, -1, &output);
+    if (result != RESULT_OK) {
+      cerr << "read " << check[0] << ": " << getResultCode(result) << endl;
+      delete field;
+      continue;
+    }
+    const string value = output.str();
+    bench("data_read", check[0], [&]() -> size_t {
+      output.str("");
+      field->read(slave, 0, false, nullptr, -1, OF_NONE, -1, &output);
+      return static_cast<size_t>(output.tellp());
+    });
+    bench("data_read_json", check[0], [&]() -> size_t {
+      output.str("");
+      field->read(slave, 0, false, nullptr, -1, OF_NAMES|OF_JSON, -1, &output);
+      return static_cast<size_t>(output.tellp());
+    });
+    bench("data_write", check[0], [&]() -> size_t {
+      istringstream input(value);
+      SlaveSymbolString written;
+      field->write(UI_FIELD_SEPARATOR, 0, &input, &written, nullptr);
+      return written.size();
+    });
+    delete field;
+  }
+}
+
+/**
+ * Generate the definitions of a realistic set of messages.
+ * @param count the number of messages to generate.
+ * @param masters optional pointer to a @a vector of hex master data for finding each message, or nullptr.
+ * @return the generated CSV text.
+ */
+string generateMessages(size_t count, vector<string>* masters = nullptr) {
+  static const char* circuits[][2] = {{"bai", "08"}, {"mc", "15"}, {"mc.2", "25"}, {"hwc", "26"}, {"sol", "ec"}};
+  static const char* types[] = {"UCH", "D2C", "UIN", "BCD", "HEX:4", "EXP"};
+  ostringstream str;
+  char buf[128];
+  for (size_t index = 0; index < count; index++) {
+    const char** circuit = circuits[index % 5];
+    const char* pbsb = index % 2 == 0 ? "b509" : "b524";
+    auto id = static_cast<unsigned>(0x0d00 + index);
+    snprintf(buf, sizeof(buf), "%s,%s,name%u,,,%s,%s,%4.4x,,s,%s\n",
+        index % 7 == 0 ? "u" : index % 3 == 0 ? "w" : "r", circuit[0], static_cast<unsigned>(index), circuit[1],
+        pbsb, id, types[index % 6]);
+    str << buf;
+    if (masters) {
+      snprintf(buf, sizeof(buf), "31%s%s02%4.4x", circuit[1], pbsb, id);
+      masters->push_back(buf);
+    }
+  }
+  return str.str();
+}
+
+void benchMessages(MessageMap* messages, size_t count) {
+  messages->clear();
+  string errorDescription;
+  vector<string> row;
+  unsigned int lineNo = 0;
+  istringstream header("#");
+  messages->readLineFromStream(&header, "bench.csv", false, &lineNo, &row, &errorDescription, false, nullptr,
+      nullptr);
+  vector<string> masterStrs;
+  istringstream input(generateMessages(count, &masterStrs));
+  lineNo = 1;
+  while (input.peek() != EOF) {
+    result_t result = messages->readLineFromStream(&input, "bench.csv", false, &lineNo, &row, &errorDescription,
+        false, nullptr, nullptr);
+    if (result != RESULT_OK) {
+      cerr << "line " << lineNo << ": " << getResultCode(result) << " " << errorDescription << endl;
+      return;
+    }
+  }
+  vector<MasterSymbolString> masters;
+  vector<Message*> all;
+  SlaveSymbolString slave;
+  slave.parseHex("04a0860100");
+  for (const auto& masterStr : masterStrs) {
+    MasterSymbolString master;
+    master.parseHex(masterStr);
+    Message* message = messages->find(master);
+    if (!message) {
+      cerr << "message not found for " << masterStr << endl;
+      continue;
+    }
+    message->storeLastData(master, slave);
+    masters.push_back(master);
+    all.push_back(message);
+  }
+  if (all.empty()) {
+    return;
+  }
+  const string variant = std::to_string(all.size());
+  size_t pos = 0;
+  bench("message_find", variant, [&]() -> size_t {
+    pos = (pos + 1) % masters.size();
+    return messages->find(masters[pos]) ? 1 : 0;
+  });
+  bench("message_find_by_name", variant, [&]() -> size_t {
+    pos = (pos + 1) % all.size();
+    return messages->find(all[pos]->getCircuit(), all[pos]->getName(), "", all[pos]->isWrite(),
+                         all[pos]->isPassive()) ? 1 : 0;
+  });
+  bench("message_decode", variant, [&]() -> size_t {
+    pos = (pos + 1) % all.size();
+    ostringstream output;
+    all[pos]->decodeLastData(false, nullptr, -1, OF_NONE, &output);
+    return static_cast<size_t>(output.tellp());
+  });
+  bench("message_decode_json", variant, [&]() -> size_t {
+    pos = (pos + 1) % all.size();
+    ostringstream output;
+    all[pos]->decodeJson(false, false, true, false, OF_NAMES|OF_JSON, &output);
+    return static_cast<size_t>(output.tellp());
+  });
+}
+
+void benchSplitFields(const string& variant, const string& data) {
+  size_t lines = 0;
+  for (const auto ch : data) {
+    if (ch == '\n') {
+      lines++;
+    }
+  }
+  if (lines == 0) {
+    lines = 1;
+  }
+  bench("split_fields_stream", variant, [&]() -> size_t {
+    istringstream stream(data);
+    vector<string> row;
+    unsigned int lineNo = 0;
+    size_t count = 0;
+    while (FileReader::splitFields(&stream, &row, &lineNo)) {
+      count += row.size();
+    }
+    return count;
+  }, lines);
+  bench("split_fields_buffer", variant, [&]() -> size_t {
+    const char* pos = data.c_str();
+    const char* end = pos + data.size();
+    vector<string> row;
+    unsigned int lineNo = 0;
+    size_t count = 0;
+    while (FileReader::splitFields(&pos, end, &row, &lineNo)) {
+      count += row.size();
+    }
+    return count;
+  }, lines);
+}
+
+void benchStringReplacer() {
+  StringReplacer replacer;
+  replacer.parse("ebusd/%circuit/%name/%field");
+  bench("string_replacer_get", "circuit/name/field", [&]() -> size_t {
+    return replacer.get("bai", "FlowTemp", "temp").size();
+  });
+  map<string, string> values;
+  values["circuit"] = "bai";
+  values["name"] = "FlowTemp";
+  values["field"] = "temp";
+  bench("string_replacer_get", "map", [&]() -> size_t {
+    return replacer.get(values).size();
+  });
+}
+
+void benchCrc() {
+  MasterSymbolString master;
+  master.parseHex("1008b5110a0102030405a90607aa08");
+  bench("crc", "symbolwise", [&]() -> size_t {
+    symbol_t crc = 0;
+    for (size_t pos = 0; pos < master.size(); pos++) {
+      symbol_t value = master[pos];
+      if (value == ESC || value == SYN) {
+        SymbolString::updateCrc(ESC, &crc);
+        value = value == ESC ? 0x00 : 0x01;
+      }
+      SymbolString::updateCrc(value, &crc);
+    }
+    return crc;
+  });
+  bench("crc", "bulk", [&]() -> size_t {
+    return master.calcCrc();
+  });
+}
+
+int main(int argc, char** argv) {
+  vector<string> files;
+  for (int argpos = 1; argpos < argc; argpos++) {
+    string arg = argv[argpos];
+    if (arg == "-q") {
+      minDuration /= 10;  // quick run
+    } else {
+      files.push_back(arg);
+    }
+  }
+  DataFieldTemplates* templates = new DataFieldTemplates();
+  benchData(templates);
+  // a single instance only as the scan message shares its ident fields
+  MessageMap* messages = new MessageMap();
+  messages->setResolver(new BenchResolver(templates));
+  benchMessages(messages, 100);
+  benchMessages(messages, 2000);
+  delete messages;
+  benchSplitFields("generated_2000", generateMessages(2000));
+  for (const auto& file : files) {
+    std::ifstream stream(file);
+    if (!stream.is_open()) {
+      cerr << "unable to open " << file << endl;
+      continue;
+    }
+    ostringstream data;
+    data << stream.rdbuf();
+    benchSplitFields(file.substr(file.find_last_of('/') + 1), data.str());
+  }
+  benchStringReplacer();
+  benchCrc();
+  delete templates;
+  return sink == 0 ? 1 : 0;
+}
@@ -537,6 +537,27 @@ int main() {
   };
   auto templates = new DataFieldTemplates();
   unsigned int lineNo = 0;
+  // all built-in types have to be found with a single probe of the perfect hash table
+  DataTypeList* types = DataTypeList::getInstance();
+  size_t builtins = 0;
+  for (const auto& it : *types) {
+    const string& id = it.first;
+    if (id.length() != 3 && (id.length() != 5 || id[3] != LENGTH_SEPARATOR)) {
+      continue;
+    }
+    builtins++;
+    if (types->get(id.substr(0, 3), id.length() == 5 ? static_cast<size_t>(id[4]-'0') : 0) != it.second) {
+      cout << "  type " << id << " lookup: error" << endl;
+      error = true;
+    }
+  }
+  if (types->getBuiltinCount() != builtins) {
+    cout << "  built-in types: error: got " << types->getBuiltinCount() << ", expected " << builtins << endl;
+    error = true;
+  } else {
+    cout << "  built-in types: " << builtins << " OK" << endl;
+  }
+
   istringstream dummystr("#");
   string errorDescription;
   vector<string> row;
@@ -750,5 +771,74 @@ int main() {
 
   delete templates;
 
+  // verify the specialized raw value kernels against the generic implementation
+  const symbol_t patterns[] = {0x00, 0x01, 0x09, 0x10, 0x7f, 0x80, 0x99, 0x9a, 0xa0, 0xfe, 0xff};
+  const size_t patternCount = sizeof(patterns)/sizeof(patterns[0]);
+  for (const auto& it : *DataTypeList::getInstance()) {
+    if (!it.second->isNumeric()) {
+      continue;
+    }
+    const NumberDataType* numType = static_cast<const NumberDataType*>(it.second);
+    if (numType->getFirstBit() != 0 || numType->getBitCount() % 8 != 0) {
+      continue;
+    }
+    size_t length = numType->getBitCount() / 8;
+    RawValueReader rawReader = numType->getRawValueReader(length);
+    RawValueWriter rawWriter = numType->getRawValueWriter(length);
+    if (!rawReader && !rawWriter) {
+      continue;
+    }
+    if (!rawReader || !rawWriter) {
+      cout << "kernel " << it.first << " error: reader and writer not both available" << endl;
+      error = true;
+      continue;
+    }
+    bool ok = true;
+    for (size_t first = 0; ok && first < patternCount; first++) {
+      SlaveSymbolString input;
+      input.push_back(static_cast<symbol_t>(length));
+      for (size_t pos = 0; pos < length; pos++) {
+        input.push_back(patterns[(first + pos * 3) % patternCount]);
+      }
+      unsigned int expectValue = 0, gotValue = 0;
+      result_t expectResult = numType->readRawValue(0, length, input, &expectValue);
+      result_t gotResult = rawReader(numType, 0, input, &gotValue);
+      if (gotResult != expectResult || (expectResult == RESULT_OK && gotValue != expectValue)) {
+        cout << "kernel " << it.first << " read >" << input.getStr() << "< error: got " << getResultCode(gotResult)
+             << " " << gotValue << ", expected " << getResultCode(expectResult) << " " << expectValue << endl;
+        ok = false;
+        break;
+      }
+      if (rawReader(numType, 1, input, &gotValue) != numType->readRawValue(1, length, input, &expectValue)) {
+        cout << "kernel " << it.first << " read beyond end error" << endl;
+        ok = false;
+        break;
+      }
+      vector<unsigned int> values = {numType->getReplacement()};
+      if (expectResult == RESULT_OK) {
+        values.push_back(expectValue);
+      }
+      for (const auto value : values) {
+        SlaveSymbolString expectOutput, gotOutput;
+        expectOutput.push_back(static_cast<symbol_t>(length));
+        gotOutput.push_back(static_cast<symbol_t>(length));
+        size_t usedLength = 0;
+        expectResult = numType->writeRawValue(value, 0, length, &expectOutput, &usedLength);
+        rawWriter(numType, value, 0, &gotOutput);
+        if (expectResult != RESULT_OK || usedLength != length || gotOutput != expectOutput) {
+          cout << "kernel " << it.first << " write " << value << " error: got >" << gotOutput.getStr()
+               << "<, expected >" << expectOutput.getStr() << "< " << getResultCode(expectResult) << endl;
+          ok = false;
+          break;
+        }
+      }
+    }
+    if (ok) {
+      cout << "kernel " << it.first << " OK" << endl;
+    } else {
+      error = true;
+    }
+  }
+
   return error ? 1 : 0;
 }
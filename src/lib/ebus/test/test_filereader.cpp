@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <string>
@@ -276,7 +277,12 @@ int main(int argc, char** argv) {
     }
     bool result = FileReader::matches(str, pattern);
     cout << "matches(\"" << str << "\", \"" << pattern << "\") = " << (result ? "true" : "false");
-    if (result==expectResult) {
+    string upper = str;
+    transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    if (SearchPattern(pattern).matches(str) != result || SearchPattern(pattern, true).matches(upper) != result) {
+      cout << ": pattern mismatch";
+      error = true;
+    } else if (result==expectResult) {
       cout << ": OK";
     } else {
       cout << ": wrong";
@@ -361,5 +367,98 @@ int main(int argc, char** argv) {
     error = true;
   }
 
+  ifs.clear();
+  ifs.seekg(0);
+  FileReader::hashStream(&ifs, &hash, &size);
+  if (hash == expectHash && size == expectSize && ifs.tellg() == 0) {
+    cout << "hash stream OK" << endl;
+  } else {
+    cout << "hash stream error: got 0x" << hex << hash << ", expected 0x" << expectHash << dec << endl;
+    error = true;
+  }
+
+  string buffer = ifs.str();
+  const char* bufferPos = buffer.data();
+  const char* bufferEnd = bufferPos + buffer.length();
+  unsigned int bufferLineNo = 0;
+  size_t bufferHash = 0, bufferSize = 0;
+  vector<string> bufferRow;
+  ifs.clear();
+  ifs.seekg(0);
+  lineNo = 0;
+  bool sameRows = true;
+  while (ifs.peek() != EOF && sameRows) {
+    sameRows = FileReader::splitFields(&ifs, &row, &lineNo)
+      == FileReader::splitFields(&bufferPos, bufferEnd, &bufferRow, &bufferLineNo, &bufferHash, &bufferSize)
+      && row == bufferRow && lineNo == bufferLineNo;
+  }
+  if (sameRows && bufferPos == bufferEnd && bufferHash == expectHash && bufferSize == expectSize) {
+    cout << "split buffer OK" << endl;
+  } else {
+    cout << "split buffer error: line " << bufferLineNo << endl;
+    error = true;
+  }
+
+  // blank only fields and lines are kept as is like by FileReader::trim()
+  string blanks = "a,  , b \n   \n \t\n";
+  bufferPos = blanks.data();
+  bufferEnd = bufferPos + blanks.length();
+  bufferLineNo = 0;
+  bufferSize = 0;
+  string trimmed = "   ";
+  FileReader::trim(&trimmed);
+  bool blanksOk = trimmed == "   "
+    && FileReader::splitFields(&bufferPos, bufferEnd, &bufferRow, &bufferLineNo, nullptr, &bufferSize)
+    && bufferRow == vector<string>{"a", "  ", "b"}
+    && FileReader::splitFields(&bufferPos, bufferEnd, &bufferRow, &bufferLineNo, nullptr, &bufferSize)
+    && bufferRow == vector<string>{"   "}
+    && FileReader::splitFields(&bufferPos, bufferEnd, &bufferRow, &bufferLineNo, nullptr, &bufferSize)
+    && bufferRow == vector<string>{" \t"}
+    && bufferPos == bufferEnd && bufferLineNo == 3 && bufferSize == blanks.length() - 1;
+  if (blanksOk) {
+    cout << "split blanks OK" << endl;
+  } else {
+    cout << "split blanks error: line " << bufferLineNo << endl;
+    error = true;
+  }
+
+  string cacheFile = "test_filereader_cache.bin";
+  RowCache cache(cacheFile);
+  string rows;
+  row.clear();
+  RowCache::appendRow(1, row, &rows);
+  row.push_back("col 1");
+  row.push_back("");
+  row.push_back("col \"3\"");
+  RowCache::appendRow(3, row, &rows);
+  cache.add("test.csv", 1234, 99, expectHash, expectSize, rows);
+  bool saved = cache.save();
+  RowCache loaded(cacheFile);
+  string found;
+  size_t foundHash = 0, foundSize = 0;
+  if (saved && loaded.load() && loaded.find("test.csv", 1234, 99, &foundHash, &foundSize, &found) && found == rows
+      && foundHash == expectHash && foundSize == expectSize
+      && !loaded.find("test.csv", 1234, 100, &foundHash, &foundSize, &found)
+      && !loaded.find("test.csv", 1235, 99, &foundHash, &foundSize, &found)
+      && !loaded.find("other.csv", 0, 0, &foundHash, &foundSize, &found)) {
+    cout << "row cache OK" << endl;
+  } else {
+    cout << "row cache error" << endl;
+    error = true;
+  }
+  vector<string> readRow;
+  const char* pos = rows.data();
+  const char* end = pos + rows.length();
+  bool ok = RowCache::readRow(&pos, end, &lineNo, &readRow) && lineNo == 1 && readRow.empty()
+    && RowCache::readRow(&pos, end, &lineNo, &readRow) && lineNo == 3 && readRow == row
+    && !RowCache::readRow(&pos, end, &lineNo, &readRow);
+  if (ok) {
+    cout << "row cache rows OK" << endl;
+  } else {
+    cout << "row cache rows error" << endl;
+    error = true;
+  }
+  remove(cacheFile.c_str());
+
   return error ? 1 : 0;
 }
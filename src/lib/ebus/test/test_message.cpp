@@ -80,6 +80,75 @@ class TestResolver : public Resolver {
 
 }  // namespace ebusd
 
+/**
+ * Read definitions into a @a MessageMap.
+ * @param messages the @a MessageMap to read into.
+ * @param definitions the definition lines (without the leading header line).
+ * @param filename the name of the file to pretend.
+ * @param errorDescription a string in which to store the error description in case of error.
+ * @return the result code.
+ */
+static result_t readDefinitions(MessageMap* messages, const string& definitions, const string& filename,
+    string* errorDescription) {
+  istringstream stream("#\n" + definitions);
+  return messages->readFromStream(&stream, filename, 0, false, nullptr, errorDescription);
+}
+
+/**
+ * Create a new @a MessageMap and read definitions into it.
+ * @param resolver the @a Resolver to use.
+ * @param definitions the definition lines (without the leading header line).
+ * @param filename the name of the file to pretend.
+ * @param result the variable in which to store the result code.
+ * @param errorDescription a string in which to store the error description in case of error.
+ * @return the new @a MessageMap (to be deleted by the caller).
+ */
+static MessageMap* createMessages(Resolver* resolver, const string& definitions, const string& filename,
+    result_t* result, string* errorDescription) {
+  MessageMap* messages = new MessageMap(false, "", false);
+  messages->setResolver(resolver);
+  *result = readDefinitions(messages, definitions, filename, errorDescription);
+  return messages;
+}
+
+/**
+ * Store the last data of a @a Message.
+ * @param message the @a Message to store the data in, or nullptr.
+ * @param masterHex the master data as hex string.
+ * @param slaveHex the slave data as hex string.
+ * @return true when the data was parsed and stored successfully.
+ */
+static bool storeData(Message* message, const string& masterHex, const string& slaveHex) {
+  MasterSymbolString master;
+  SlaveSymbolString slave;
+  return message && master.parseHex(masterHex) == RESULT_OK && slave.parseHex(slaveHex) == RESULT_OK
+      && message->storeLastData(master, slave) == RESULT_OK;
+}
+
+/**
+ * Report the outcome of a check.
+ * @param name the name of the check.
+ * @param ok whether the check succeeded.
+ * @param details the details to print on failure, or empty.
+ */
+static void report(const string& name, bool ok, const string& details = "") {
+  if (ok) {
+    cout << name << " OK" << endl;
+    return;
+  }
+  cout << name << " error" << (details.empty() ? "" : ": " + details) << endl;
+  error = true;
+}
+
+/**
+ * @param result the result code.
+ * @param errorDescription the error description.
+ * @return the details for @a report() of a result code and error description.
+ */
+static string resultDetails(result_t result, const string& errorDescription) {
+  return string(getResultCode(result)) + ", " + errorDescription;
+}
+
 int main() {
   // message:   [type],[circuit],name,[comment],[QQ[;QQ]*],[ZZ],[PBSB],[ID],fields...
   // field:     name,part,type[:len][,[divisor|values][,[unit][,[comment]]]]
@@ -410,6 +479,14 @@ int main() {
         if (decodeJson) {
           message->decodeJson(false, false, true, false, OF_JSON|OF_DEFINITION, &output);
           string str = output.str();
+          for (int i = 0; i < 2; i++) {  // fresh and reused fragment
+            ostringstream cached;
+            message->decodeJsonCached(false, false, true, false, OF_JSON|OF_DEFINITION, &cached);
+            if (cached.str() != str) {
+              cout << "  cached JSON error: " << cached.str() << endl;
+              error = true;
+            }
+          }
           size_t start = str.find("\"lastup\": ");
           if (start != string::npos) {
             start += 10;
@@ -483,9 +560,314 @@ int main() {
 
       bool match = writeMstr == *mstrs[0];
       verify(failedPrepareMatch, "prepare", inputStr, match, mstrs[0]->getStr(), writeMstr.getStr());
+
+      // prepare again with another source address (from the cache)
+      istringstream cachedInput(inputStr);
+      MasterSymbolString cachedMstr;
+      result = message->prepareMaster(0, 0x10, SYN, UI_FIELD_SEPARATOR, &cachedInput, &cachedMstr);
+      match = result == RESULT_OK && cachedMstr[0] == 0x10 && cachedMstr.getStr(1) == writeMstr.getStr(1);
+      verify(false, "prepare cached", inputStr, match, writeMstr.getStr(1), cachedMstr.getStr(1));
     }
   }
 
+  // check hash index with colliding probe sequences and removal
+  MessageKeyIndex index;
+  vector<Message*> dummy;
+  for (uint64_t key = 0; key < 1000; key++) {
+    index.insert(key << 32, &dummy);
+  }
+  for (uint64_t key = 0; key < 1000; key += 2) {
+    index.erase(key << 32);
+  }
+  bool indexOk = index.size() == 500;
+  for (uint64_t key = 0; key < 1000 && indexOk; key++) {
+    indexOk = (index.find(key << 32) != nullptr) == ((key & 1) == 1);
+  }
+  report("key index", indexOk);
+
+  // check merging of staging instances read independently
+  result_t result;
+  MessageMap* mergeMessages = createMessages(messages->getResolver(), "", "merge.csv", &result, &errorDescription);
+  const char* stagingInputs[] = {
+    "r,merge,first,,,08,b509,0d0100,,s,UCH\n",
+    "r,merge,second,,,08,b509,0d0200,,s,UCH\nr,merge,third,,,08,b509,0d0300,,s,UCH\n",
+    "r,merge,fourth,,,08,b509,0d0400,,s,UCH\nr,merge,other,,,08,b509,0d0100,,s,UCH\n",
+  };
+  result_t mergeResults[3];
+  vector<MessageMap*> stagings;
+  for (const auto input : stagingInputs) {
+    MessageMap* staging = mergeMessages->createStaging();
+    result = readDefinitions(staging, input, "merge.csv", &errorDescription);
+    if (result != RESULT_OK) {
+      cout << "staging read error: " << resultDetails(result, errorDescription) << endl;
+      error = true;
+    }
+    stagings.push_back(staging);
+  }
+  for (size_t i = 0; i < stagings.size(); i++) {
+    errorDescription = "";
+    mergeResults[i] = mergeMessages->merge(stagings[i], false, &errorDescription);
+  }
+  report("merge", mergeResults[0] == RESULT_OK && mergeResults[1] == RESULT_OK
+      && mergeResults[2] == RESULT_ERR_DUPLICATE && errorDescription.find("merge.csv:3") == 0
+      && mergeMessages->size() == 4 && mergeMessages->find("merge", "fourth", "", false)
+      && !mergeMessages->find("merge", "other", "", false), resultDetails(mergeResults[2], errorDescription));
+
+  // check finding the messages added since the last check
+  uint64_t generation = 0;
+  deque<Message*> found;
+  bool journalOk = !mergeMessages->findAllAdded(&generation, "*", false, &found) && found.size() == 4;
+  found.clear();
+  journalOk = journalOk && mergeMessages->findAllAdded(&generation, "*", false, &found) && found.empty();
+  readDefinitions(mergeMessages, "r,merge,fifth,,,08,b509,0d0500,,s,UCH\n", "journal.csv", &errorDescription);
+  journalOk = journalOk && mergeMessages->findAllAdded(&generation, "*", false, &found) && found.size() == 1
+      && found.front()->getName() == "fifth";
+  found.clear();
+  mergeMessages->remove(mergeMessages->find("merge", "first", "", false));
+  journalOk = journalOk && !mergeMessages->findAllAdded(&generation, "*", false, &found) && found.size() == 4;
+  report("journal", journalOk);
+  delete mergeMessages;
+
+  // check decoding of typed values
+  MessageMap* valueMessages = createMessages(messages->getResolver(),
+      "r,vals,multi,,,08,b509,0d0100,a,s,UCH,,,,b,s,D1C,,°C,,c,s,UCH,0=off;1=on,,,"
+      "d,s,UCH,0=off;1=on,,,e,s,STR:3,,,,f,s,SCH,,,\n", "vals.csv", &result, &errorDescription);
+  Message* valueMessage = valueMessages->find("vals", "multi", "", false);
+  vector<fieldValue_t> values;
+  if (result == RESULT_OK && storeData(valueMessage, "1008b509030d0100", "0801340102414243fe")) {
+    result = valueMessage->decodeLastDataValues(&values);
+  }
+  report("decode values", result == RESULT_OK && values.size() == 6
+      && values[0].type == fvt_integer && values[0].intValue == 1
+      && values[1].type == fvt_float && values[1].floatValue == 26.0f
+      && values[1].field->getAttribute("unit") == "°C"
+      && values[2].type == fvt_string && values[2].stringValue == "on" && values[2].intValue == 1
+      && values[3].type == fvt_integer && values[3].intValue == 2
+      && values[4].type == fvt_string && values[4].stringValue == "ABC"
+      && values[5].type == fvt_integer && values[5].intValue == -2 && values[5].field->getName(-1) == "f",
+      resultDetails(result, errorDescription));
+  // check a single field failing to decode does not prevent decoding the others
+  vector<fieldValue_t> partialValues;
+  result_t partialResult = readDefinitions(valueMessages, "r,vals,partial,,,08,b509,0d0200,a,s,BCD,,,,b,s,UCH,,,\n",
+      "partial.csv", &errorDescription);
+  Message* partialMessage = valueMessages->find("vals", "partial", "", false);
+  if (partialResult == RESULT_OK && storeData(partialMessage, "1008b509030d0200", "02ab05")) {
+    partialResult = partialMessage->decodeLastDataValues(&partialValues);
+  }
+  report("decode partial values", partialResult < RESULT_OK && partialValues.size() == 2
+      && partialValues[0].field == nullptr && partialValues[1].field && partialValues[1].type == fvt_integer
+      && partialValues[1].intValue == 5, getResultCode(partialResult));
+  // check CBOR encoding of the typed values
+  ostringstream cbor;
+  string cborHex;
+  if (result == RESULT_OK) {
+    result = valueMessage->decodeLastDataCbor(-1, OF_NAMES, &cbor);
+    for (auto ch : cbor.str()) {
+      cborHex += "0123456789abcdef"[(ch >> 4) & 0x0f];
+      cborHex += "0123456789abcdef"[ch & 0x0f];
+    }
+  }
+  report("decode cbor", result == RESULT_OK && cborHex == "a66161016162fa41d000006163626f6e616402616563414243616621",
+      string(getResultCode(result)) + ", " + cborHex);
+  delete valueMessages;
+
+  // check poll scheduling with passive updates and back off
+  MessageMap* pollMessages = createMessages(messages->getResolver(),
+      "r1,poll,first,,,08,b509,0d0100,,s,UCH\nr1,poll,second,,,08,b509,0d0200,,s,UCH\n", "poll.csv", &result,
+      &errorDescription);
+  Message* firstPoll = pollMessages->find("poll", "first", "", false);
+  Message* secondPoll = pollMessages->find("poll", "second", "", false);
+  time_t pollNow = 1000;
+  bool pollOk = result == RESULT_OK && firstPoll && secondPoll && pollMessages->sizePoll() == 2
+      && firstPoll->isPollDue(pollNow, 30);
+  if (pollOk) {
+    firstPoll->setPassiveUpdate(pollNow - 20);
+    firstPoll->setPassiveUpdate(pollNow - 10);  // updated passively every 10 seconds
+    pollOk = firstPoll->isRecentlyUpdated(pollNow, 30) && !secondPoll->isRecentlyUpdated(pollNow, 30)
+        && pollMessages->getNextPoll(pollNow, 30) == secondPoll && pollMessages->getNextPoll(pollNow, 30) == secondPoll
+        && !secondPoll->isPollDue(pollNow, 30) && pollMessages->getNextPoll(pollNow, 30, true) == nullptr;
+  }
+  for (unsigned int count = 0; pollOk && count < 8; count++) {
+    secondPoll->setPolled(false, 100);
+  }
+  // the latency is applied only when taken from the poll queue
+  pollOk = pollOk && secondPoll->getPollBackoff() == 3 && secondPoll->getPollLatency() == 0
+      && pollMessages->getNextPoll(pollNow, 30) == secondPoll && secondPoll->getPollLatency() == 100;
+  report("poll schedule", pollOk, resultDetails(result, errorDescription));
+  delete pollMessages;
+
+  // check reloading a changed file keeps the last data of messages with unchanged ID
+  size_t chunkCount = DefinitionArena::getChunkCount();
+  MessageMap* reloadMessages = createMessages(messages->getResolver(),
+      "r,rel,first,,,08,b509,0d0100,,s,UCH\nr,rel,second,,,08,b509,0d0200,,s,UCH\n", "reload.csv", &result,
+      &errorDescription);
+  Message* reloadFirst = reloadMessages->find("rel", "first", "", false);
+  bool reloadOk = result == RESULT_OK && DefinitionArena::getChunkCount() > chunkCount
+      && storeData(reloadFirst, "ff08b509030d0100", "0105");
+  uint64_t reloadGeneration = 0;
+  deque<Message*> added;
+  reloadMessages->findAllAdded(&reloadGeneration, "*", false, &added);
+  size_t taken = 0;
+  if (reloadOk) {
+    reloadOk = reloadMessages->detachFile("reload.csv") == RESULT_OK && reloadMessages->size() == 0;
+  }
+  if (reloadOk) {
+    result = readDefinitions(reloadMessages,
+        "r,rel,first,,,08,b509,0d0100,,s,SCH\nr,rel,third,,,08,b509,0d0300,,s,UCH\n", "reload.csv",
+        &errorDescription);
+    taken = reloadMessages->reattachFile("reload.csv");
+    added.clear();
+    reloadFirst = reloadMessages->find("rel", "first", "", false);
+    reloadOk = result == RESULT_OK && taken == 1 && reloadMessages->size() == 2 && reloadFirst
+        && reloadFirst->getLastSlaveData().getStr() == "0105" && reloadFirst->getLastUpdateTime() > 0
+        && !reloadMessages->find("rel", "second", "", false)
+        && reloadMessages->findAllAdded(&reloadGeneration, "*", false, &added) && added.size() == 2;
+  }
+  report("reload file", reloadOk, string(getResultCode(result)) + ", " + std::to_string(taken) + ", "
+      + errorDescription);
+  delete reloadMessages;
+  report("arena release", DefinitionArena::getChunkCount() == chunkCount,
+      std::to_string(DefinitionArena::getChunkCount()) + " instead of " + std::to_string(chunkCount));
+
+  // check filtered lookups only return the matching messages in key order
+  MessageMap* findMessages = createMessages(messages->getResolver(),
+      "r,bai,temp,,,08,b509,0d0100,,s,UCH\nw,bai,temp,,,08,b509,0e0100,,s,UCH\n"
+      "r,bai,flow,,,08,b509,0d0200,,s,UCH\nr,bai2,temp,,,15,b509,0d0100,,s,UCH\nr,hc,temp,,,26,b509,0d0100,,s,UCH\n"
+      "r,hc,bait,,,26,b509,0d0200,,s,UCH\n", "find.csv", &result, &errorDescription);
+  bool findOk = result == RESULT_OK;
+  const char* findChecks[][4] = {
+    // circuit, name, complete match, expected "circuit.name" list
+    {"bai", "", "1", "bai.flow,bai.temp,bai.temp,"},
+    {"BAI", "temp", "1", "bai.temp,bai.temp,"},
+    {"bai", "", "", "bai.flow,bai.temp,bai.temp,bai2.temp,"},
+    {"", "temp", "1", "bai.temp,bai.temp,bai2.temp,hc.temp,"},
+    {"", "ai", "", "hc.bait,"},
+    {"i2", "te", "", "bai2.temp,"},
+    {"unknown", "temp", "1", ""},
+  };
+  for (size_t index = 0; findOk && index < sizeof(findChecks)/sizeof(findChecks[0]); index++) {
+    deque<Message*> found;
+    findMessages->findAll(findChecks[index][0], findChecks[index][1], "*", findChecks[index][2][0] == '1', true, true,
+        true, true, false, 0, 0, false, &found);
+    ostringstream names;
+    for (const auto message : found) {
+      names << message->getCircuit() << "." << message->getName() << ",";
+    }
+    if (names.str() != findChecks[index][3]) {
+      cout << "find all \"" << findChecks[index][0] << "\" \"" << findChecks[index][1] << "\": " << names.str()
+          << endl;
+      findOk = false;
+    }
+  }
+  if (findOk) {
+    // check writing invalidates the read sibling only
+    Message* readMessage = findMessages->find("bai", "temp", "", false);
+    Message* otherMessage = findMessages->find("bai2", "temp", "", false);
+    findOk = storeData(readMessage, "ff08b509030d0100", "0105") && storeData(otherMessage, "ff15b509030d0100", "0105");
+    if (findOk) {
+      findMessages->invalidateCache(findMessages->find("bai", "temp", "", true));
+      findOk = readMessage->getLastUpdateTime() == 0 && otherMessage->getLastUpdateTime() > 0;
+    }
+  }
+  report("find all", findOk, resultDetails(result, errorDescription));
+  delete findMessages;
+
+  // check a condition follows each change of the referenced message even within the same second
+  MessageMap* condMessages = createMessages(messages->getResolver(),
+      "*[on],cond,state,,,,1\nr,cond,state,,,08,b509,0d0100,,s,UCH\n[on]r,cond,value,,,08,b509,0d0200,,s,UCH\n",
+      "cond.csv", &result, &errorDescription);
+  if (result == RESULT_OK) {
+    result = condMessages->resolveConditions(false, &errorDescription);
+  }
+  Message* stateMessage = condMessages->find("cond", "state", "", false);
+  deque<Message*> condFound;
+  condMessages->findAll("cond", "value", "*", true, true, false, false, true, false, 0, 0, false, &condFound);
+  Message* condMessage = condFound.empty() ? nullptr : condFound.front();
+  report("condition change", result == RESULT_OK && stateMessage && condMessage && !condMessage->isAvailable()
+      && storeData(stateMessage, "ff08b509030d0100", "0101") && condMessage->isAvailable()
+      && storeData(stateMessage, "ff08b509030d0100", "0102") && !condMessage->isAvailable(),
+      resultDetails(result, errorDescription));
+  delete condMessages;
+
+  // check the history keeps the last updates only and decodes them again
+  MessageMap* historyMessages = new MessageMap(false, "", false);
+  historyMessages->setResolver(messages->getResolver());
+  historyMessages->setHistorySize(3);
+  result = readDefinitions(historyMessages, "r,hist,value,,,08,b509,0d0100,,s,UCH\n", "hist.csv", &errorDescription);
+  Message* historyMessage = historyMessages->find("hist", "value", "", false);
+  bool historyOk = result == RESULT_OK && historyMessage && historyMessage->getHistory();
+  const char* historyValues[] = {"0101", "0102", "0102", "020304"};
+  for (size_t index = 0; historyOk && index < sizeof(historyValues)/sizeof(historyValues[0]); index++) {
+    historyOk = storeData(historyMessage, "ff08b509030d0100", historyValues[index]);
+  }
+  vector<historyEntry_t> historyEntries;
+  if (historyOk) {
+    historyMessage->getHistory()->getAll(0, &historyEntries);
+    historyOk = historyEntries.size() == 3 && historyEntries[0].slave.getStr() == "0102"
+        && historyEntries[1].slave.getStr() == "0102" && historyEntries[2].slave.getStr() == "020304"
+        && historyEntries[2].master.getStr() == "ff08b509030d0100";
+  }
+  if (historyOk) {
+    ostringstream historyOutput, expectOutput;
+    expectOutput << historyEntries[0].time << " 2\n" << historyEntries[1].time << " 2\n"
+        << historyEntries[2].time << " 3";
+    historyOk = historyMessage->decodeHistory(0, nullptr, -1, OF_NONE, &historyOutput) == RESULT_OK
+        && historyOutput.str() == expectOutput.str();
+    if (!historyOk) {
+      cout << "history decode: " << historyOutput.str() << endl;
+    }
+  }
+  report("history", historyOk, resultDetails(result, errorDescription));
+  delete historyMessages;
+
+  // check the last data is restored from the state for messages added before and after restoring
+  MessageMap* stateMessages = createMessages(messages->getResolver(),
+      "r,state,first,,,08,b509,0d0100,,s,UCH\nr,state,second,,,08,b509,0d0200,,s,UCH\n", "state.csv", &result,
+      &errorDescription);
+  bool stateOk = result == RESULT_OK
+      && storeData(stateMessages->find("state", "first", "", false), "ff08b509030d0100", "0105")
+      && storeData(stateMessages->find("state", "second", "", false), "ff08b509030d0200", "0107");
+  ostringstream stateOutput;
+  if (stateOk) {
+    stateMessages->formatState(&stateOutput);
+    delete stateMessages;
+    stateMessages = createMessages(messages->getResolver(), "r,state,first,,,08,b509,0d0100,,s,UCH\n", "first.csv",
+        &result, &errorDescription);
+    istringstream stateLines(stateOutput.str());
+    string line;
+    while (stateOk && getline(stateLines, line)) {
+      stateOk = stateMessages->restoreState(line);
+    }
+    stateOk = stateOk && !stateMessages->restoreState("m,1,x,ff,00,state,firstR");
+  }
+  if (stateOk && result == RESULT_OK) {
+    result = readDefinitions(stateMessages, "r,state,second,,,08,b509,0d0200,,s,UCH\n", "second.csv",
+        &errorDescription);
+    Message* stateFirst = stateMessages->find("state", "first", "", false);
+    Message* stateSecond = stateMessages->find("state", "second", "", false);
+    ostringstream firstValue, secondValue;
+    stateOk = result == RESULT_OK && stateFirst && stateSecond && stateFirst->getLastUpdateTime() > 0
+        && stateSecond->getLastUpdateTime() > 0
+        && stateFirst->decodeLastData(false, nullptr, -1, OF_NONE, &firstValue) == RESULT_OK
+        && stateSecond->decodeLastData(false, nullptr, -1, OF_NONE, &secondValue) == RESULT_OK
+        && firstValue.str() == "5" && secondValue.str() == "7";
+  }
+  report("restore state", stateOk && result == RESULT_OK,
+      resultDetails(result, errorDescription) + ": " + stateOutput.str());
+  delete stateMessages;
+
+  InternedString interned1(string("intern") + "test"), interned2("interntest"), interned3;
+  bool internOk = interned1 == interned2 && interned1.getId() == interned2.getId() && interned1 == "interntest"
+      && interned3.empty() && interned3 != interned1 && InternedString::find("interntest", &interned3)
+      && interned3 == interned1 && !InternedString::find("notinterned", &interned3);
+  {
+    InternedString released("internreleased"), releasedCopy(released);
+    internOk = internOk && releasedCopy == released && InternedString::find("internreleased", &interned3);
+    interned3 = interned2;
+  }
+  internOk = internOk && !InternedString::find("internreleased", &interned3) && interned3 == interned1;
+  report("intern", internOk);
+
   delete templates;
   delete messages;
   for (vector<MasterSymbolString*>::iterator it = mstrs.begin(); it != mstrs.end(); it++) {
@@ -119,6 +119,64 @@ int main(int argc, char** argv) {
     verify(false, "data size", "0427a90015a901", sstr.getDataSize() == 4, expectStr, gotStr);
   }
 
+  // check symbols exceeding the inline buffer
+  string longStr;
+  for (int i = 0; i < 3 * SYMBOL_BUFFER_INLINE_SIZE; i++) {
+    longStr += "0" + std::to_string(i % 10);
+  }
+  MasterSymbolString longMstr;
+  result = longMstr.parseHex(longStr);
+  MasterSymbolString copied(longMstr);
+  MasterSymbolString moved(std::move(copied));
+  MasterSymbolString shortMstr;
+  shortMstr.parseHex("ff08b509");
+  MasterSymbolString shortMoved(std::move(shortMstr));
+  if (result == RESULT_OK && longMstr.getStr() == longStr && moved == longMstr && copied.size() == 0
+      && shortMoved.getStr() == "ff08b509") {
+    cout << "long symbols OK" << endl;
+  } else {
+    cout << "long symbols error: " << moved.getStr() << endl;
+    error = true;
+  }
+  moved = shortMoved;
+  if (moved.getStr() == "ff08b509" && moved.compareTo(shortMoved) == 0) {
+    cout << "assign symbols OK" << endl;
+  } else {
+    cout << "assign symbols error: " << moved.getStr() << endl;
+    error = true;
+  }
+
+  // check the bulk CRC against the symbol by symbol update for all lengths and alignments
+  symbol_t unescaped[64], escaped[128];
+  bool crcOk = true;
+  for (size_t len = 0; len <= sizeof(unescaped) && crcOk; len++) {
+    size_t escapedLen = 0;
+    symbol_t crc = 0;
+    for (size_t pos = 0; pos < len; pos++) {
+      symbol_t value = static_cast<symbol_t>(pos*37+len*11);
+      if (pos % 7 == 3) {
+        value = (pos & 1) ? ESC : SYN;
+      }
+      unescaped[pos] = value;
+      if (value == ESC || value == SYN) {
+        escaped[escapedLen++] = ESC;
+        value = value == ESC ? 0x00 : 0x01;
+      }
+      escaped[escapedLen++] = value;
+    }
+    for (size_t pos = 0; pos < escapedLen; pos++) {
+      SymbolString::updateCrc(escaped[pos], &crc);
+    }
+    crcOk = SymbolString::calcEscapedCrc(escaped, escapedLen) == crc
+      && SymbolString::calcUnescapedCrc(unescaped, len) == crc;
+  }
+  if (crcOk) {
+    cout << "bulk CRC OK" << endl;
+  } else {
+    cout << "bulk CRC error" << endl;
+    error = true;
+  }
+
   int masterCnt = 0, slaveCnt = 0;
   for (int i=0; i<256; i++) {
     symbol_t address = static_cast<symbol_t>(i);
@@ -20,13 +20,18 @@
 #include <cstring>
 #include <cstdlib>
 #include <sstream>
+#include <iomanip>
+#include <ctime>
 #include <csignal>
+#include <map>
 #ifdef HAVE_SSL
 #if OPENSSL_VERSION_NUMBER < 0x10101000L
 #include <sys/stat.h>
 #endif
 #endif  // HAVE_SSL
 #include "lib/utils/log.h"
+#include "lib/utils/memusage.h"
+#include "lib/utils/thread.h"
 
 namespace ebusd {
 
@@ -34,6 +39,12 @@ using std::string;
 using std::ostringstream;
 using std::dec;
 using std::hex;
+using std::setfill;
+using std::setw;
+using std::map;
+
+/** the maximum size of a response body. */
+#define HTTP_MAX_BODY (16*1024*1024)
 
 #ifdef HAVE_SSL
 
@@ -48,6 +59,35 @@ using std::hex;
 // the time slice to sleep between repeated SSL reads/writes
 #define SLEEP_NANOS 20000
 
+/** the TLS sessions for resumption by server name. */
+static map<string, SSL_SESSION*> s_sslSessions;
+
+/** the @a Mutex for @a s_sslSessions. */
+static Mutex s_sslSessionsMutex;
+
+/**
+ * Called by OpenSSL when a new TLS session (or session ticket) was received from the server.
+ * @param ssl the SSL instance.
+ * @param session the new session.
+ * @return 1 when the session reference was taken over, 0 otherwise.
+ */
+static int sslNewSessionCallback(SSL *ssl, SSL_SESSION *session) {
+  const char* serverName = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+  if (!serverName) {
+    return 0;
+  }
+  s_sslSessionsMutex.lock();
+  auto it = s_sslSessions.find(serverName);
+  if (it != s_sslSessions.end()) {
+    SSL_SESSION_free(it->second);
+    it->second = session;
+  } else {
+    s_sslSessions[serverName] = session;
+  }
+  s_sslSessionsMutex.unlock();
+  return 1;
+}
+
 bool checkError(const char* call) {
   unsigned long err = ERR_get_error();
   if (err) {
@@ -185,7 +225,7 @@ SSLSocket* SSLSocket::connect(const string& host, const uint16_t& port, bool htt
   ostringstream ostr;
   ostr << host << ':' << static_cast<unsigned>(port);
   const string hostPort = ostr.str();
-  time_t until = time(nullptr) + 1 + (timeout <= 5 ? 5 : timeout);  // at least 5 seconds, 1 extra for rounding
+  time_t until = getUntil(timeout);
   if (!https) {
     do {
       BIO *bio = BIO_new_connect(static_cast<const char*>(hostPort.c_str()));
@@ -238,6 +278,9 @@ SSLSocket* SSLSocket::connect(const string& host, const uint16_t& port, bool htt
         }
       }
       SSL_CTX_set_options(ctx, SSL_OP_ALL | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
+      // keep the sessions in s_sslSessions for resuming them on the next connect to the same server
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+      SSL_CTX_sess_set_new_cb(ctx, sslNewSessionCallback);
     }
     bio = BIO_new_ssl_connect(ctx);
     if (isError("new_ssl_conn", bio != nullptr)) {
@@ -259,6 +302,12 @@ SSLSocket* SSLSocket::connect(const string& host, const uint16_t& port, bool htt
     if (isError("tls_host", SSL_set_tlsext_host_name(ssl, hostname), 1)) {
       break;
     }
+    s_sslSessionsMutex.lock();
+    auto it = s_sslSessions.find(host);
+    if (it != s_sslSessions.end()) {
+      SSL_set_session(ssl, it->second);  // takes its own reference
+    }
+    s_sslSessionsMutex.unlock();
     long res = BIO_do_connect(bio);
     time_t now = 0;
     while (res <= 0 && (BIO_should_retry(bio) || now == 0)) {  // always repeat on first failure
@@ -275,6 +324,7 @@ SSLSocket* SSLSocket::connect(const string& host, const uint16_t& port, bool htt
     if (isError("connect", res, 1)) {
       break;
     }
+    logDebug(lf_network, "HTTP connect: TLS session %s", SSL_session_reused(ssl) ? "resumed" : "established");
     X509 *cert = SSL_get_peer_certificate(ssl);
     if (isError("peer_cert", cert != nullptr)) {
       break;
@@ -391,14 +441,11 @@ bool HttpClient::connect(const string& host, const uint16_t port, bool https, co
   }
   m_socket = TCPSocket::connect(host, port, timeout);
 #endif
-  if (!m_socket) {
-    return false;
-  }
-  m_host = host;
+  m_host = host;  // kept even on failure for being able to reconnect later on
   m_port = port;
   m_timeout = timeout;
   m_userAgent = userAgent;
-  return true;
+  return m_socket != nullptr;
 }
 
 bool HttpClient::reconnect() {
@@ -418,49 +465,110 @@ bool HttpClient::reconnect() {
 }
 
 bool HttpClient::ensureConnected() {
-  if (m_socket && m_socket->isValid()) {
-    return true;
+  if (m_socket) {
+    m_socket->setTimeout(m_timeout);  // restart the timeout for reusing a persistent connection
+    if (m_socket->isValid()) {
+      return true;
+    }
   }
   return reconnect();
 }
 
+size_t HttpClient::getMemoryUsage() const {
+  size_t ret = m_bufferSize + memUsage(m_received);
+  for (const auto& request : m_pipelined) {
+    ret += sizeof(string) + memUsage(request);
+  }
+  return ret;
+}
+
 void HttpClient::disconnect() {
   if (m_socket) {
     delete m_socket;
     m_socket = nullptr;
   }
+  m_responses = 0;
+  m_pipelined.clear();  // the outstanding responses are lost
+  m_received.clear();
 }
 
 bool HttpClient::get(const string& uri, const string& body, string* response, bool* repeatable, time_t* time) {
   return request("GET", uri, body, response, repeatable, time);
 }
 
+string HttpClient::formatConditionalHeaders(const string& etag, time_t modifiedSince) {
+  ostringstream headers;
+  if (!etag.empty()) {
+    headers << "If-None-Match: " << etag << "\r\n";
+  }
+  if (modifiedSince > 0) {
+    static const char* dayNames[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char* monthNames[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    struct tm t;
+    if (gmtime_r(&modifiedSince, &t)) {
+      // If-Modified-Since: Wed, 21 Oct 2015 07:28:00 GMT
+      headers << "If-Modified-Since: " << dayNames[t.tm_wday] << ", " << setfill('0') << setw(2) << t.tm_mday << " "
+              << monthNames[t.tm_mon] << " " << setw(4) << (t.tm_year + 1900) << " " << setw(2) << t.tm_hour << ":"
+              << setw(2) << t.tm_min << ":" << setw(2) << t.tm_sec << " GMT\r\n" << setw(0) << setfill(' ');
+    }
+  }
+  return headers.str();
+}
+
+bool HttpClient::etagMatches(const string& etag, const string& other) {
+  size_t pos = strncasecmp(etag.c_str(), "W/", 2) == 0 ? 2 : 0;
+  size_t otherPos = strncasecmp(other.c_str(), "W/", 2) == 0 ? 2 : 0;
+  return etag.length() - pos == other.length() - otherPos && etag.compare(pos, string::npos, other, otherPos) == 0;
+}
+
+bool HttpClient::getIfModified(const string& uri, const string& etag, time_t modifiedSince, string* response,
+    bool* notModified, string* newEtag, bool* repeatable, time_t* time) {
+  *notModified = false;
+  string respEtag;
+  if (!newEtag) {
+    newEtag = &respEtag;
+  }
+  bool ret = request("GET", uri, "", response, repeatable, time, formatConditionalHeaders(etag, modifiedSince),
+      newEtag, notModified);
+  if (!ret || !*notModified || etag.empty() || newEtag->empty() || etagMatches(etag, *newEtag)) {
+    return ret;
+  }
+  // the server reported a different entity tag for the not modified content: fetch it again unconditionally
+  *notModified = false;
+  return request("GET", uri, "", response, repeatable, time, "", newEtag, nullptr);
+}
+
 bool HttpClient::post(const string& uri, const string& body, string* response, bool* repeatable) {
   return request("POST", uri, body, response, repeatable);
 }
 
-const int indexToMonth[] = {
-  -1, -1,  2, 12, -1, -1,  1, -1,  // 0-7
-  -1, -1, -1, -1,  7, -1,  6,  8,  // 8-15
-   9,  5,  3, -1, 10, -1, 11, -1,  // 16-23
-  -1, -1,  4, -1, -1, -1, -1, -1,  // 24-31
-};
+bool HttpClient::pipelineIfModified(const string& uri, const string& etag, time_t modifiedSince) {
+  return pipeline("GET", uri, formatConditionalHeaders(etag, modifiedSince));
+}
 
-bool HttpClient::request(const string& method, const string& uri, const string& body, string* response,
-bool* repeatable, time_t* time) {
-  if (!ensureConnected()) {
-    *response = "not connected";
-    if (repeatable) {
-      *repeatable = true;
-    }
+bool HttpClient::pipeline(const string& method, const string& uri, const string& headers) {
+  if (!m_socket || m_responses == 0 || m_pipelined.size() >= HTTP_MAX_PIPELINED) {
+    return false;  // only on a connection that the server already kept alive
+  }
+  string str = formatRequest(method, uri, "", headers);
+  if (!sendRequest(str)) {
+    disconnect();
     return false;
   }
+  m_pipelined.push_back(str);
+  return true;
+}
+
+string HttpClient::formatRequest(const string& method, const string& uri, const string& body,
+    const string& headers) const {
   ostringstream ostr;
-  ostr << method << " " << uri << " HTTP/1.0\r\n"
+  ostr << method << " " << uri << " HTTP/1.1\r\n"
        << "Host: " << m_host << "\r\n";
   if (!m_userAgent.empty()) {
     ostr << "User-Agent: " << m_userAgent << "\r\n";
   }
+  ostr << headers;
   if (body.empty()) {
     ostr << "\r\n";
   } else {
@@ -469,50 +577,164 @@ bool* repeatable, time_t* time) {
          << "\r\n"
          << body;
   }
-  string str = ostr.str();
-  size_t len = str.size();
-  const char* cstr = str.c_str();
+  return ostr.str();
+}
+
+bool HttpClient::sendRequest(const string& request) {
+  size_t len = request.size();
+  const char* cstr = request.c_str();
   for (size_t pos = 0; pos < len; ) {
     ssize_t sent = m_socket->send(cstr + pos, len - pos);
     if (sent < 0) {
+      return false;
+    }
+    pos += sent;
+  }
+  return true;
+}
+
+const int indexToMonth[] = {
+  -1, -1,  2, 12, -1, -1,  1, -1,  // 0-7
+  -1, -1, -1, -1,  7, -1,  6,  8,  // 8-15
+   9,  5,  3, -1, 10, -1, 11, -1,  // 16-23
+  -1, -1,  4, -1, -1, -1, -1, -1,  // 24-31
+};
+
+/**
+ * Find a header in the response headers.
+ * @param headers the response headers starting with the status line, each line terminated by CRLF.
+ * @param name the header name (case insensitive).
+ * @return the position of the header value, or string::npos if not found.
+ */
+static size_t findHeader(const string& headers, const char* name) {
+  size_t nameLen = strlen(name);
+  for (size_t pos = headers.find("\r\n"); pos != string::npos; pos = headers.find("\r\n", pos+2)) {
+    size_t valuePos = pos+2+nameLen;
+    if (valuePos < headers.length() && headers[valuePos] == ':'
+        && strncasecmp(headers.c_str()+pos+2, name, nameLen) == 0) {
+      valuePos++;
+      while (valuePos < headers.length() && headers[valuePos] == ' ') {
+        valuePos++;
+      }
+      return valuePos;
+    }
+  }
+  return string::npos;
+}
+
+/**
+ * Return whether a header in the response headers has the specified value.
+ * @param headers the response headers starting with the status line, each line terminated by CRLF.
+ * @param name the header name (case insensitive).
+ * @param value the expected value (case insensitive).
+ * @return true if the header is present with the value.
+ */
+static bool hasHeaderValue(const string& headers, const char* name, const char* value) {
+  size_t pos = findHeader(headers, name);
+  if (pos == string::npos) {
+    return false;
+  }
+  size_t len = strlen(value);
+  return strncasecmp(headers.c_str()+pos, value, len) == 0 && headers.compare(pos+len, 2, "\r\n") == 0;
+}
+
+bool HttpClient::request(const string& method, const string& uri, const string& body, string* response,
+bool* repeatable, time_t* time, const string& headers, string* etag, bool* notModified) {
+  m_status = 0;
+  string str = formatRequest(method, uri, body, headers);
+  bool pipelined = body.empty() && !m_pipelined.empty() && m_pipelined.front() == str;
+  if (pipelined) {
+    m_pipelined.pop_front();  // already sent
+  } else if (!m_pipelined.empty()) {
+    disconnect();  // responses to other requests are still outstanding
+  }
+  string result;
+  size_t pos;
+  for (bool retry = true; ; retry = false) {
+    if (!pipelined) {
+      if (!ensureConnected()) {
+        *response = "not connected";
+        if (repeatable) {
+          *repeatable = true;
+        }
+        return false;
+      }
+    }
+    bool reused = m_responses > 0;
+    if (!pipelined && !sendRequest(str)) {
       disconnect();
+      if (reused && retry) {
+        continue;  // persistent connection closed by the server in the meantime
+      }
       *response = "send error";
       if (repeatable) {
         *repeatable = true;
       }
       return false;
     }
-    pos += sent;
+    result.swap(m_received);
+    m_received.clear();
+    pos = readUntil(" ", 4 * 1024, &result);  // max 4k headers
+    if (pos == string::npos && result.empty() && reused && retry) {
+      disconnect();  // persistent connection closed by the server in the meantime
+      pipelined = false;
+      continue;
+    }
+    break;
   }
-  string result;
-  size_t pos = readUntil(" ", 4 * 1024, &result);  // max 4k headers
   if (pos == string::npos || pos > 8 || result.substr(0, 5) != "HTTP/") {
     disconnect();
     *response = "receive error (headers)";
     return false;
   }
-  if (result.substr(pos+1, 6) != "200 OK") {
+  m_status = static_cast<int>(strtol(result.c_str()+pos+1, nullptr, 10));
+  bool isNotModified = notModified && m_status == 304;
+  if (!isNotModified && m_status != 200) {
     disconnect();
     size_t endpos = result.find("\r\n", pos+1);
     *response = "receive error: " + result.substr(pos+1, endpos == string::npos ? endpos : endpos-pos-1);
     return false;
   }
+  bool keepAlive = result.substr(0, 9) == "HTTP/1.1 ";  // persistent by default since 1.1
   pos = readUntil("\r\n\r\n", 4 * 1024, &result);  // max 4k headers
   if (pos == string::npos) {
     disconnect();
     *response = "receive error (headers)";
     return false;
   }
-  string headers = result.substr(0, pos+2);  // including final \r\n
-  const char* hdrs = headers.c_str();
+  string respHeaders = result.substr(0, pos+2);  // including final \r\n
+  const char* hdrs = respHeaders.c_str();
   *response = result.substr(pos+4);
+  if (hasHeaderValue(respHeaders, "Connection", "close")) {
+    keepAlive = false;
+  } else if (hasHeaderValue(respHeaders, "Connection", "keep-alive")) {
+    keepAlive = true;
+  }
+  if (etag) {
+    pos = findHeader(respHeaders, "ETag");
+    if (pos == string::npos) {
+      etag->clear();
+    } else {
+      *etag = respHeaders.substr(pos, respHeaders.find("\r\n", pos) - pos);
+    }
+  }
+  if (isNotModified) {
+    *notModified = true;
+    m_received = *response;  // no body
+    response->clear();
+    m_responses++;
+    if (!keepAlive) {
+      disconnect();
+    }
+    return true;
+  }
 #ifdef HAVE_TIME_H
   if (time) {
-    pos = headers.find("\r\nLast-Modified: ");
-    if (pos != string::npos && headers.substr(pos+42, 4) == " GMT") {
+    pos = findHeader(respHeaders, "Last-Modified");
+    if (pos != string::npos && respHeaders.substr(pos+25, 4) == " GMT") {
       // Last-Modified: Wed, 21 Oct 2015 07:28:00 GMT
       struct tm t;
-      pos += strlen("\r\nLast-Modified: ") + 5;
+      pos += 5;
       char* strEnd = nullptr;
       t.tm_mday = static_cast<int>(strtol(hdrs + pos, &strEnd, 10));
       if (strEnd != hdrs + pos + 2 || t.tm_mday < 1 || t.tm_mday > 31) {
@@ -547,21 +769,79 @@ bool* repeatable, time_t* time) {
     }
   }
 #endif
-  pos = headers.find("\r\nContent-Length: ");
-  if (pos == string::npos) {
-    disconnect();
-    return true;
+  if (hasHeaderValue(respHeaders, "Transfer-Encoding", "chunked")) {
+    if (!readChunked(response)) {
+      disconnect();
+      *response = "receive error (chunked)";
+      return false;
+    }
+  } else {
+    pos = findHeader(respHeaders, "Content-Length");
+    if (pos == string::npos) {
+      readUntil("", HTTP_MAX_BODY, response);  // body ends with the connection
+      disconnect();
+      return true;
+    }
+    char* strEnd = nullptr;
+    unsigned long length = strtoul(hdrs + pos, &strEnd, 10);
+    if (strEnd == nullptr || *strEnd != '\r' || length > HTTP_MAX_BODY) {
+      disconnect();
+      *response = "invalid content length ";
+      return false;
+    }
+    if (response->length() < length) {
+      readUntil("", length, response);
+    }
+    if (response->length() < length) {
+      disconnect();
+      return false;
+    }
+    if (response->length() > length) {
+      m_received = response->substr(length);  // start of the next pipelined response
+      response->resize(length);
+    }
   }
-  char* strEnd = nullptr;
-  unsigned long length = strtoul(hdrs + pos + strlen("\r\nContent-Length: "), &strEnd, 10);
-  if (strEnd == nullptr || *strEnd != '\r') {
+  m_responses++;
+  if (!keepAlive) {
     disconnect();
-    *response = "invalid content length ";
-    return false;
   }
-  pos = readUntil("", length, response);
-  disconnect();
-  return pos == length;
+  return true;
+}
+
+bool HttpClient::readChunked(string* response) {
+  string data;
+  data.swap(*response);
+  while (true) {
+    size_t pos = readUntil("\r\n", 4 * 1024, &data);  // chunk size line
+    if (pos == string::npos) {
+      return false;
+    }
+    char* strEnd = nullptr;
+    unsigned long size = strtoul(data.c_str(), &strEnd, 16);
+    if (strEnd == nullptr || strEnd == data.c_str() || response->length() + size > HTTP_MAX_BODY) {
+      return false;
+    }
+    data.erase(0, pos+2);
+    if (size == 0) {
+      // skip the trailer headers up to the final empty line
+      while ((pos=readUntil("\r\n", 4 * 1024, &data)) != 0) {
+        if (pos == string::npos) {
+          return false;
+        }
+        data.erase(0, pos+2);
+      }
+      m_received = data.substr(2);  // start of the next pipelined response
+      return true;
+    }
+    if (data.length() < size+2) {
+      readUntil("", size+2, &data);
+    }
+    if (data.length() < size+2 || data.compare(size, 2, "\r\n") != 0) {
+      return false;
+    }
+    response->append(data, 0, size);
+    data.erase(0, size+2);
+  }
 }
 
 size_t HttpClient::readUntil(const string& delim, size_t length, string* result) {
@@ -587,9 +867,9 @@ size_t HttpClient::readUntil(const string& delim, size_t length, string* result)
     }
     m_buffer[received] = 0;
     size_t oldLength = result->length();
-    *result += m_buffer;
+    result->append(m_buffer, static_cast<size_t>(received));
     if (findDelim) {
-      pos = result->find(delim, oldLength - (delim.length() - 1));
+      pos = result->find(delim, oldLength < delim.length() ? 0 : oldLength - (delim.length() - 1));
     }
   }
   return findDelim ? pos : result->length();
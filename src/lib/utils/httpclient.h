@@ -25,6 +25,7 @@
 
 #include <unistd.h>
 #include <cstdint>
+#include <deque>
 #include <string>
 #include "lib/utils/tcpsocket.h"
 
@@ -43,6 +44,10 @@ namespace ebusd {
 
 using std::string;
 using std::ifstream;
+using std::deque;
+
+/** the maximum number of requests sent ahead via @a HttpClient::pipeline(). */
+#define HTTP_MAX_PIPELINED 8
 
 #ifdef HAVE_SSL
 class SSLSocket {
@@ -54,6 +59,15 @@ class SSLSocket {
    */
   SSLSocket(BIO *bio, time_t until) : m_bio(bio), m_until(until) {}
 
+  /**
+   * Return the system time until a socket opened now with the specified timeout is allowed to be used.
+   * @param timeout the timeout in seconds.
+   * @return the system time until the socket is allowed to be used.
+   */
+  static time_t getUntil(int timeout) {
+    return time(nullptr) + 1 + (timeout <= 5 ? 5 : timeout);  // at least 5 seconds, 1 extra for rounding
+  }
+
  public:
   /**
    * Destructor.
@@ -95,12 +109,18 @@ class SSLSocket {
    */
   bool isValid();
 
+  /**
+   * Allow the socket to be used for the specified timeout from now on (e.g. for reusing a persistent connection).
+   * @param timeout the timeout in seconds.
+   */
+  void setTimeout(int timeout) { m_until = getUntil(timeout); }
+
  private:
   /** the BIO instance for communication. */
   BIO *m_bio;
 
   /** the system time until the socket is allowed to be used. */
-  const time_t m_until;
+  time_t m_until;
 };
 
 #define SocketClass SSLSocket
@@ -123,7 +143,7 @@ class HttpClient {
 #ifdef HAVE_SSL
     m_https(false),
 #endif
-    m_socket(nullptr), m_port(0), m_timeout(0), m_bufferSize(0), m_buffer(nullptr) {
+    m_socket(nullptr), m_port(0), m_timeout(0), m_responses(0), m_status(0), m_bufferSize(0), m_buffer(nullptr) {
   }
 
   /**
@@ -183,6 +203,26 @@ class HttpClient {
    */
   void disconnect();
 
+  /**
+   * Get the estimated memory used by the buffers of this instance.
+   * @return the estimated number of bytes.
+   */
+  size_t getMemoryUsage() const;
+
+  /**
+   * Get the HTTP status code of the last response.
+   * @return the HTTP status code of the last response, or 0 if the last request did not get any response.
+   */
+  int getStatus() const { return m_status; }
+
+  /**
+   * Compare two entity tags using the weak comparison, i.e. ignoring the weak indicator "W/".
+   * @param etag the first entity tag (including the quotes).
+   * @param other the second entity tag (including the quotes).
+   * @return true if both entity tags match.
+   */
+  static bool etagMatches(const string& etag, const string& other);
+
   /**
    * Execute a GET request.
    * @param uri the URI string.
@@ -196,6 +236,22 @@ class HttpClient {
   bool get(const string& uri, const string& body, string* response, bool* repeatable = nullptr,
   time_t* time = nullptr);
 
+  /**
+   * Execute a conditional GET request.
+   * @param uri the URI string.
+   * @param etag the entity tag of the locally available content, or empty.
+   * @param modifiedSince the modification time of the locally available content, or 0.
+   * @param response the response body from the server (or the HTTP header on error), or empty if not modified.
+   * @param notModified pointer to a bool in which to store whether the server reported the content as not modified.
+   * @param newEtag optional pointer to a string in which to store the entity tag of the response, or nullptr.
+   * @param repeatable optional pointer to a bool in which to store whether the request should be repeated later on
+   * (e.g. due to temporary connectivity issues).
+   * @param time optional pointer to a @a time_t value for storing the modification time of the file, or nullptr.
+   * @return true on success (including not modified), false on error.
+   */
+  bool getIfModified(const string& uri, const string& etag, time_t modifiedSince, string* response,
+  bool* notModified, string* newEtag = nullptr, bool* repeatable = nullptr, time_t* time = nullptr);
+
   /**
    * Execute a POST request.
    * @param uri the URI string.
@@ -216,10 +272,37 @@ class HttpClient {
    * @param repeatable optional pointer to a bool in which to store whether the request should be repeated later on
    * (e.g. due to temporary connectivity issues).
    * @param time optional pointer to a @a time_t value for storing the modification time of the file, or nullptr.
+   * @param headers optional additional request header lines (each terminated by CRLF).
+   * @param etag optional pointer to a string in which to store the entity tag of the response, or nullptr.
+   * @param notModified optional pointer to a bool in which to store whether the server answered with
+   * "304 Not Modified" (only accepted when set), or nullptr.
    * @return true on success, false on error.
    */
   bool request(const string& method, const string& uri, const string& body, string* response,
-  bool* repeatable = nullptr, time_t* time = nullptr);
+  bool* repeatable = nullptr, time_t* time = nullptr, const string& headers = "", string* etag = nullptr,
+  bool* notModified = nullptr);
+
+  /**
+   * Send a conditional GET request ahead without waiting for the response, which is then picked up by a later
+   * call to @a getIfModified() with the same arguments.
+   * @param uri the URI string.
+   * @param etag the entity tag of the locally available content, or empty.
+   * @param modifiedSince the modification time of the locally available content, or 0.
+   * @return true when the request was sent, false if pipelining is currently not possible (i.e. the server did not
+   * yet keep the connection alive, or too many requests are already outstanding).
+   */
+  bool pipelineIfModified(const string& uri, const string& etag, time_t modifiedSince);
+
+  /**
+   * Send a request ahead without waiting for the response, which is then picked up by a later call to
+   * @a request() with the same arguments.
+   * @param method the method string.
+   * @param uri the URI string.
+   * @param headers optional additional request header lines (each terminated by CRLF).
+   * @return true when the request was sent, false if pipelining is currently not possible (i.e. the server did not
+   * yet keep the connection alive, or too many requests are already outstanding).
+   */
+  bool pipeline(const string& method, const string& uri, const string& headers = "");
 
  private:
   /**
@@ -231,6 +314,38 @@ class HttpClient {
    */
   size_t readUntil(const string& delim, size_t length, string* result);
 
+  /**
+   * Format a request.
+   * @param method the method string.
+   * @param uri the URI string.
+   * @param body the optional body to send.
+   * @param headers additional request header lines (each terminated by CRLF).
+   * @return the formatted request.
+   */
+  string formatRequest(const string& method, const string& uri, const string& body, const string& headers) const;
+
+  /**
+   * Format the conditional request header lines.
+   * @param etag the entity tag of the locally available content, or empty.
+   * @param modifiedSince the modification time of the locally available content, or 0.
+   * @return the header lines (each terminated by CRLF).
+   */
+  static string formatConditionalHeaders(const string& etag, time_t modifiedSince);
+
+  /**
+   * Send the formatted request to the connected socket.
+   * @param request the formatted request.
+   * @return true on success, false on error.
+   */
+  bool sendRequest(const string& request);
+
+  /**
+   * Read a body in chunked transfer encoding from the connected socket.
+   * @param response the data received after the headers, replaced by the decoded body.
+   * @return true on success, false on error.
+   */
+  bool readChunked(string* response);
+
  private:
 #ifdef HAVE_SSL
   /** true once @a initialize() was called. */
@@ -261,6 +376,18 @@ class HttpClient {
   /** the optional user agent to send in the request header. */
   string m_userAgent;
 
+  /** the number of responses received on the current connection (it is persistent when non-zero). */
+  unsigned int m_responses;
+
+  /** the requests sent ahead via @a pipeline() whose responses were not yet read. */
+  deque<string> m_pipelined;
+
+  /** the HTTP status code of the last response, or 0. */
+  int m_status;
+
+  /** the data received after the end of the last response (the start of a pipelined response). */
+  string m_received;
+
   /** the size of the @a m_buffer. */
   size_t m_bufferSize;
 
@@ -27,13 +27,28 @@
 #include <sys/time.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
 #ifdef HAVE_SYSLOG_H
 #include <syslog.h>
 #endif
+#include <atomic>
 #include "lib/utils/clock.h"
+#include "lib/utils/thread.h"
+#include "lib/utils/metrics.h"
 
 namespace ebusd {
 
+using std::atomic;
+
+/** the maximum length of the formatted message of an asynchronously written record (including the terminator). */
+#define LOG_RECORD_TEXT_SIZE 512
+
+/** the maximum length of the facility name of an asynchronously written record (including the terminator). */
+#define LOG_RECORD_FACILITY_SIZE 16
+
+/** the interval in milliseconds for the writer thread to look for new records. */
+#define LOG_WRITER_INTERVAL 20
+
 /** the name of each @a LogFacility. */
 static const char *s_facilityNames[] = {
   "main",
@@ -70,6 +85,9 @@ static const int s_syslogLevels[] = {
 /** the current log level by log facility. */
 static LogLevel s_facilityLogLevel[] = { ll_notice, ll_notice, ll_notice, ll_notice, ll_notice, };
 
+/** the @a Mutex for serializing the output to the log file or syslog. */
+static Mutex s_writeMutex;
+
 /** the current log FILE, or nullptr if closed or syslog is used. */
 static FILE* s_logFile = stdout;
 
@@ -166,12 +184,15 @@ bool setLogFile(const char* filename) {
   if (newFile == nullptr) {
     return false;
   }
+  s_writeMutex.lock();
   closeLogFile();
   s_logFile = newFile;
+  s_writeMutex.unlock();
   return true;
 }
 
 void closeLogFile() {
+  s_writeMutex.lock();
   if (s_logFile != nullptr) {
     if (s_logFile != stdout) {
       fclose(s_logFile);
@@ -184,6 +205,7 @@ void closeLogFile() {
     s_useSyslog = false;
   }
 #endif
+  s_writeMutex.unlock();
 }
 
 bool needsLog(const LogFacility facility, const LogLevel level) {
@@ -197,6 +219,294 @@ bool needsLog(const LogFacility facility, const LogLevel level) {
   return s_facilityLogLevel[facility] >= level;
 }
 
+/**
+ * Write a formatted message to the log file or syslog.
+ * @param facility the facility name.
+ * @param level the @a LogLevel.
+ * @param ts the time of the message.
+ * @param text the formatted message.
+ */
+static void writeFormatted(const char* facility, const LogLevel level, const struct timespec& ts, const char* text) {
+  s_writeMutex.lock();
+#ifdef HAVE_SYSLOG_H
+  if (s_useSyslog) {
+    syslog(s_syslogLevels[level], "[%s %s] %s", facility, s_levelNames[level], text);
+  } else
+#endif
+  if (s_logFile != nullptr) {
+    struct tm td;
+    localtime_r(&ts.tv_sec, &td);
+    fprintf(s_logFile, "%04d-%02d-%02d %02d:%02d:%02d.%03ld [%s %s] %s\n",
+      td.tm_year+1900, td.tm_mon+1, td.tm_mday,
+      td.tm_hour, td.tm_min, td.tm_sec, ts.tv_nsec/1000000,
+      facility, s_levelNames[level], text);
+    fflush(s_logFile);
+  }
+  s_writeMutex.unlock();
+}
+
+/** a single asynchronously written log record. */
+typedef struct logRecord {
+  struct timespec time;  //!< the time of the record
+  LogLevel level;  //!< the @a LogLevel
+  char facility[LOG_RECORD_FACILITY_SIZE];  //!< the facility name
+  char text[LOG_RECORD_TEXT_SIZE];  //!< the formatted message
+} logRecord_t;
+
+/**
+ * A ring buffer of @a logRecord_t filled by a single thread and drained by the writer thread without locking.
+ */
+class LogBuffer {
+ public:
+  /**
+   * Constructor.
+   * @param capacity the number of records to buffer.
+   * @param next the next @a LogBuffer in the list of all buffers, or nullptr.
+   */
+  LogBuffer(size_t capacity, LogBuffer* next)
+    : m_capacity(capacity), m_records(new logRecord_t[capacity]), m_head(0), m_tail(0), m_next(next) {}
+
+  /**
+   * Destructor.
+   */
+  ~LogBuffer() { delete[] m_records; }
+
+  /**
+   * Get the next free record for writing by the owning thread.
+   * @return the next free @a logRecord_t, or nullptr if the buffer is full.
+   */
+  logRecord_t* peekFree() {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= m_capacity) {
+      return nullptr;
+    }
+    return &m_records[head % m_capacity];
+  }
+
+  /**
+   * Publish the record previously returned by @a peekFree() to the writer thread.
+   */
+  void commit() { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  /**
+   * Get the oldest pending record for the writer thread.
+   * @return the oldest pending @a logRecord_t, or nullptr if the buffer is empty.
+   */
+  const logRecord_t* peekPending() const {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &m_records[tail % m_capacity];
+  }
+
+  /**
+   * Release the record previously returned by @a peekPending() for reuse by the owning thread.
+   */
+  void release() { m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  /**
+   * @return the next @a LogBuffer in the list of all buffers, or nullptr.
+   */
+  LogBuffer* getNext() const { return m_next; }
+
+
+ private:
+  /** the number of records to buffer. */
+  const size_t m_capacity;
+
+  /** the buffered records. */
+  logRecord_t* m_records;
+
+  /** the total number of records written by the owning thread. */
+  atomic<size_t> m_head;
+
+  /** the total number of records drained by the writer thread. */
+  atomic<size_t> m_tail;
+
+  /** the next @a LogBuffer in the list of all buffers, or nullptr. */
+  LogBuffer* const m_next;
+};
+
+/**
+ * The thread draining all @a LogBuffer instances in the order of the record time.
+ */
+class LogWriter : public WaitThread {
+ public:
+  /**
+   * Constructor.
+   * @param capacity the number of records to buffer per thread.
+   * @param generation the unique generation of this instance (never 0).
+   */
+  LogWriter(size_t capacity, unsigned int generation)
+    : WaitThread(), m_capacity(capacity), m_generation(generation), m_buffers(nullptr), m_droppedCount(0),
+      m_reportedDroppedCount(0),
+      m_droppedMetric(Metrics::getInstance()->getCounter("ebusd_log_dropped_total",
+        "Number of log records dropped due to full buffers")) {}
+
+  /**
+   * Destructor.
+   */
+  ~LogWriter() override {
+    LogBuffer* buffer = m_buffers.load();
+    while (buffer) {
+      LogBuffer* next = buffer->getNext();
+      delete buffer;
+      buffer = next;
+    }
+  }
+
+  /**
+   * @return the unique generation of this instance.
+   */
+  unsigned int getGeneration() const { return m_generation; }
+
+  /**
+   * Create a new @a LogBuffer for the calling thread.
+   * @return the new @a LogBuffer.
+   */
+  LogBuffer* createBuffer() {
+    m_buffersMutex.lock();
+    LogBuffer* buffer = new LogBuffer(m_capacity, m_buffers.load(std::memory_order_relaxed));
+    m_buffers.store(buffer, std::memory_order_release);
+    m_buffersMutex.unlock();
+    return buffer;
+  }
+
+  /**
+   * Count a record dropped due to a full buffer.
+   */
+  void dropped() {
+    m_droppedCount++;
+    m_droppedMetric->add();
+  }
+
+  /**
+   * @return the number of records dropped so far.
+   */
+  uint64_t getDroppedCount() const { return m_droppedCount.load(); }
+
+  /**
+   * Write all pending records in the order of their time.
+   */
+  void drain() {
+    LogBuffer* first = m_buffers.load(std::memory_order_acquire);
+    while (true) {
+      LogBuffer* oldest = nullptr;
+      const logRecord_t* oldestRecord = nullptr;
+      for (LogBuffer* buffer = first; buffer; buffer = buffer->getNext()) {
+        const logRecord_t* record = buffer->peekPending();
+        if (record && (!oldestRecord || record->time.tv_sec < oldestRecord->time.tv_sec
+            || (record->time.tv_sec == oldestRecord->time.tv_sec
+                && record->time.tv_nsec < oldestRecord->time.tv_nsec))) {
+          oldest = buffer;
+          oldestRecord = record;
+        }
+      }
+      if (!oldest) {
+        break;
+      }
+      writeFormatted(oldestRecord->facility, oldestRecord->level, oldestRecord->time, oldestRecord->text);
+      oldest->release();
+    }
+    uint64_t droppedCount = m_droppedCount.load();
+    if (droppedCount != m_reportedDroppedCount) {
+      struct timespec ts;
+      clockGettime(&ts);
+      char text[64];
+      snprintf(text, sizeof(text), "%llu log records dropped",
+          static_cast<unsigned long long>(droppedCount - m_reportedDroppedCount));  // NOLINT(runtime/int)
+      writeFormatted(s_facilityNames[lf_other], ll_notice, ts, text);
+      m_reportedDroppedCount = droppedCount;
+    }
+  }
+
+
+ protected:
+  // @copydoc
+  void run() override {
+    while (isRunning()) {
+      Wait(0, LOG_WRITER_INTERVAL);
+      drain();
+    }
+    drain();
+  }
+
+
+ private:
+  /** the number of records to buffer per thread. */
+  const size_t m_capacity;
+
+  /** the unique generation of this instance. */
+  const unsigned int m_generation;
+
+  /** the @a Mutex for adding to @a m_buffers. */
+  Mutex m_buffersMutex;
+
+  /** the list of all @a LogBuffer instances (one per logging thread). */
+  atomic<LogBuffer*> m_buffers;
+
+  /** the number of records dropped so far. */
+  atomic<uint64_t> m_droppedCount;
+
+  /** the number of dropped records already reported in the log. */
+  uint64_t m_reportedDroppedCount;
+
+  /** the @a MetricCounter for dropped records. */
+  MetricCounter* m_droppedMetric;
+};
+
+/** the running @a LogWriter, or nullptr for writing synchronously. */
+static atomic<LogWriter*> s_logWriter(nullptr);
+
+/** the number of threads currently using the @a LogWriter loaded from @a s_logWriter. */
+static atomic<unsigned int> s_logWriterUsers(0);
+
+/** the generation of the last started @a LogWriter. */
+static unsigned int s_logWriterGeneration = 0;
+
+/** the number of records dropped by previously stopped @a LogWriter instances. */
+static uint64_t s_previousDroppedCount = 0;
+
+/** the @a LogBuffer of the current thread, or nullptr. */
+static thread_local LogBuffer* s_threadBuffer = nullptr;
+
+/** the generation of the @a LogWriter the @a s_threadBuffer belongs to, or 0. */
+static thread_local unsigned int s_threadBufferGeneration = 0;
+
+bool startAsyncLog(unsigned int records) {
+  if (records == 0 || s_logWriter.load()) {
+    return false;
+  }
+  LogWriter* writer = new LogWriter(records, ++s_logWriterGeneration);
+  if (!writer->start("logwriter")) {
+    delete writer;
+    return false;
+  }
+  s_logWriter.store(writer);
+  return true;
+}
+
+void stopAsyncLog() {
+  LogWriter* writer = s_logWriter.exchange(nullptr);
+  if (!writer) {
+    return;
+  }
+  while (s_logWriterUsers.load() > 0) {
+    usleep(1000);  // wait for other threads still adding a record before deleting the writer
+  }
+  writer->stop();
+  writer->join();
+  writer->drain();  // records added by other threads while stopping
+  s_previousDroppedCount += writer->getDroppedCount();
+  delete writer;
+}
+
+uint64_t getLogDroppedCount() {
+  LogWriter* writer = s_logWriter.load();
+  return s_previousDroppedCount + (writer ? writer->getDroppedCount() : 0);
+}
+
 void logWrite(const char* facility, const LogLevel level, const char* message, va_list ap) {
   if (s_logFile == nullptr
 #ifdef HAVE_SYSLOG_H
@@ -205,25 +515,40 @@ void logWrite(const char* facility, const LogLevel level, const char* message, v
   ) {
     return;
   }
+  s_logWriterUsers.fetch_add(1);
+  LogWriter* writer = s_logWriter.load();
+  if (writer) {
+    if (s_threadBufferGeneration != writer->getGeneration()) {
+      s_threadBuffer = writer->createBuffer();
+      s_threadBufferGeneration = writer->getGeneration();
+    }
+    logRecord_t* record = s_threadBuffer->peekFree();
+    if (!record) {
+      writer->dropped();
+      s_logWriterUsers.fetch_sub(1);
+      return;
+    }
+    va_list aq;
+    va_copy(aq, ap);
+    int len = vsnprintf(record->text, LOG_RECORD_TEXT_SIZE, message, aq);
+    va_end(aq);
+    if (len >= 0 && len < LOG_RECORD_TEXT_SIZE) {
+      clockGettime(&record->time);
+      record->level = level;
+      strncpy(record->facility, facility, LOG_RECORD_FACILITY_SIZE-1);
+      record->facility[LOG_RECORD_FACILITY_SIZE-1] = 0;
+      s_threadBuffer->commit();
+      s_logWriterUsers.fetch_sub(1);
+      return;
+    }
+    // too long for a record: write synchronously instead
+  }
+  s_logWriterUsers.fetch_sub(1);
   char* buf;
   if (vasprintf(&buf, message, ap) >= 0 && buf) {
-#ifdef HAVE_SYSLOG_H
-    if (s_useSyslog) {
-      syslog(s_syslogLevels[level], "[%s %s] %s", facility, s_levelNames[level], buf);
-    } else {
-#endif
-      struct timespec ts;
-      struct tm td;
-      clockGettime(&ts);
-      localtime_r(&ts.tv_sec, &td);
-      fprintf(s_logFile, "%04d-%02d-%02d %02d:%02d:%02d.%03ld [%s %s] %s\n",
-        td.tm_year+1900, td.tm_mon+1, td.tm_mday,
-        td.tm_hour, td.tm_min, td.tm_sec, ts.tv_nsec/1000000,
-        facility, s_levelNames[level], buf);
-      fflush(s_logFile);
-#ifdef HAVE_SYSLOG_H
-    }
-#endif
+    struct timespec ts;
+    clockGettime(&ts);
+    writeFormatted(facility, level, ts, buf);
   }
   if (buf) {
     free(buf);
@@ -19,6 +19,8 @@
 #ifndef LIB_UTILS_LOG_H_
 #define LIB_UTILS_LOG_H_
 
+#include <stdint.h>
+
 namespace ebusd {
 
 /** \file lib/utils/log.h */
@@ -108,6 +110,26 @@ bool setLogFile(const char* filename);
  */
 void closeLogFile();
 
+/**
+ * Start writing the log asynchronously: each thread formats its records into an own ring buffer without locking
+ * and a separate writer thread drains all buffers to the log file or syslog.
+ * Must be called after forking (i.e. after daemonizing).
+ * @param records the number of records to buffer per thread.
+ * @return true on success, false if already started or the writer thread could not be started.
+ */
+bool startAsyncLog(unsigned int records);
+
+/**
+ * Stop writing the log asynchronously after writing all pending records.
+ */
+void stopAsyncLog();
+
+/**
+ * Get the number of records dropped so far due to full buffers.
+ * @return the number of dropped records.
+ */
+uint64_t getLogDroppedCount();
+
 /**
  * Return whether logging is needed for the specified facility and level.
  * @param facility the @a LogFacility of the message to check.
@@ -134,36 +156,51 @@ void logWrite(const LogFacility facility, const LogLevel level, const char* mess
  */
 void logWrite(const char* facility, const LogLevel level, const char* message, ...);
 
-/** A macro that calls the logging function only if needed. */
-#define LOG(facility, level, ...) (needsLog(facility, level) ? logWrite(facility, level, __VA_ARGS__) : void(0))
+#ifndef LOG_MAX_LEVEL
+/**
+ * The highest @a LogLevel compiled in (as number, e.g. 2 for ll_notice). Messages above are removed at compile time
+ * including the evaluation of their arguments, which is useful for embedded builds.
+ */
+#define LOG_MAX_LEVEL 4
+#endif
+
+/** A macro that checks whether logging is compiled in and needed for the facility and level. */
+#define NEEDS_LOG(facility, level) ((level) <= LOG_MAX_LEVEL && needsLog(facility, level))
+
+/** A macro that calls the logging function only if needed (the arguments are only evaluated in that case). */
+#define LOG(facility, level, ...) (NEEDS_LOG(facility, level) ? logWrite(facility, level, __VA_ARGS__) : void(0))
 
 /** A macro for an error message that calls the logging function only if needed. */
-#define logError(facility, ...) (needsLog(facility, ll_error) ? logWrite(facility, ll_error, __VA_ARGS__) : void(0))
+#define logError(facility, ...) \
+  (NEEDS_LOG(facility, ll_error) ? logWrite(facility, ll_error, __VA_ARGS__) : void(0))
 
 /** A macro for a notice message that calls the logging function only if needed. */
-#define logNotice(facility, ...) (needsLog(facility, ll_notice) ? logWrite(facility, ll_notice, __VA_ARGS__) : void(0))
+#define logNotice(facility, ...) \
+  (NEEDS_LOG(facility, ll_notice) ? logWrite(facility, ll_notice, __VA_ARGS__) : void(0))
 
 /** A macro for an info message that calls the logging function only if needed. */
-#define logInfo(facility, ...) (needsLog(facility, ll_info) ? logWrite(facility, ll_info, __VA_ARGS__) : void(0))
+#define logInfo(facility, ...) \
+  (NEEDS_LOG(facility, ll_info) ? logWrite(facility, ll_info, __VA_ARGS__) : void(0))
 
 /** A macro for a debug message that calls the logging function only if needed. */
-#define logDebug(facility, ...) (needsLog(facility, ll_debug) ? logWrite(facility, ll_debug, __VA_ARGS__) : void(0))
+#define logDebug(facility, ...) \
+  (NEEDS_LOG(facility, ll_debug) ? logWrite(facility, ll_debug, __VA_ARGS__) : void(0))
 
 /** A macro for an error message that calls the logging function only if needed. */
 #define logOtherError(facility, ...) \
-  (needsLog(lf_other, ll_error) ? logWrite(facility, ll_error, __VA_ARGS__) : void(0))
+  (NEEDS_LOG(lf_other, ll_error) ? logWrite(facility, ll_error, __VA_ARGS__) : void(0))
 
 /** A macro for a notice message that calls the logging function only if needed. */
 #define logOtherNotice(facility, ...) \
-  (needsLog(lf_other, ll_notice) ? logWrite(facility, ll_notice, __VA_ARGS__) : void(0))
+  (NEEDS_LOG(lf_other, ll_notice) ? logWrite(facility, ll_notice, __VA_ARGS__) : void(0))
 
 /** A macro for an info message that calls the logging function only if needed. */
 #define logOtherInfo(facility, ...) \
-  (needsLog(lf_other, ll_info) ? logWrite(facility, ll_info, __VA_ARGS__) : void(0))
+  (NEEDS_LOG(lf_other, ll_info) ? logWrite(facility, ll_info, __VA_ARGS__) : void(0))
 
 /** A macro for a debug message that calls the logging function only if needed. */
 #define logOtherDebug(facility, ...) \
-  (needsLog(lf_other, ll_debug) ? logWrite(facility, ll_debug, __VA_ARGS__) : void(0))
+  (NEEDS_LOG(lf_other, ll_debug) ? logWrite(facility, ll_debug, __VA_ARGS__) : void(0))
 
 }  // namespace ebusd
 
@@ -0,0 +1,62 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_UTILS_MEMUSAGE_H_
+#define LIB_UTILS_MEMUSAGE_H_
+
+#include <stddef.h>
+#include <string>
+
+namespace ebusd {
+
+/** \file lib/utils/memusage.h
+ * Helpers for estimating the heap memory used by standard containers.
+ * The estimations are meant for comparing subsystems and deployments, not for exact accounting.
+ */
+
+using std::string;
+
+/** the estimated heap overhead in bytes of each node in a map, set, list, or hash container (links and header). */
+#define MEMUSAGE_NODE_OVERHEAD (4*sizeof(void*))
+
+/**
+ * Get the estimated heap memory used by a @a string (not including the @a string object itself).
+ * @param str the @a string.
+ * @return the number of bytes allocated on the heap, or 0 if the content is stored inline.
+ */
+inline size_t memUsage(const string& str) {
+  const char* data = str.data();
+  const char* self = reinterpret_cast<const char*>(&str);
+  if (data >= self && data < self + sizeof(str)) {
+    return 0;  // short string stored inline
+  }
+  return str.capacity() + 1;
+}
+
+/**
+ * Get the estimated heap memory used by a node based container entry holding a value of the specified size.
+ * @param valueSize the size of the value (or key and value pair) in bytes.
+ * @return the estimated number of bytes allocated on the heap for the node.
+ */
+inline size_t memUsageNode(size_t valueSize) {
+  return MEMUSAGE_NODE_OVERHEAD + valueSize;
+}
+
+}  // namespace ebusd
+
+#endif  // LIB_UTILS_MEMUSAGE_H_
@@ -0,0 +1,180 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/utils/metrics.h"
+#include <iomanip>
+#include "lib/utils/clock.h"
+
+namespace ebusd {
+
+MetricHistogram::MetricHistogram(const vector<uint64_t>& bounds)
+  : m_bounds(bounds), m_sum(0), m_count(0) {
+  m_buckets = new atomic<uint64_t>[m_bounds.size() + 1];
+  for (size_t index = 0; index <= m_bounds.size(); index++) {
+    m_buckets[index] = 0;
+  }
+}
+
+void MetricHistogram::observe(uint64_t micros) {
+  size_t index = 0;
+  while (index < m_bounds.size() && micros > m_bounds[index]) {
+    index++;
+  }
+  m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(micros, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MetricHistogram::observeSince(const struct timespec& start) {
+  struct timespec now;
+  clockGettime(&now);
+  int64_t micros = (now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+  if (micros >= 0) {  // skip clock skew
+    observe(static_cast<uint64_t>(micros));
+  }
+}
+
+/**
+ * Format a duration in microseconds as seconds.
+ * @param micros the duration in microseconds.
+ * @param output the @a ostream to append to.
+ */
+static void formatSeconds(uint64_t micros, ostream* output) {
+  *output << (micros / 1000000) << "." << std::setw(6) << std::setfill('0') << (micros % 1000000)
+          << std::setw(0);
+}
+
+void MetricHistogram::format(const string& name, const string& labels, ostream* output) const {
+  string prefix = labels.empty() ? "" : labels + ",";
+  uint64_t cumulative = 0;
+  for (size_t index = 0; index < m_bounds.size(); index++) {
+    cumulative += m_buckets[index].load(std::memory_order_relaxed);
+    *output << name << "_bucket{" << prefix << "le=\"";
+    formatSeconds(m_bounds[index], output);
+    *output << "\"} " << cumulative << "\n";
+  }
+  cumulative += m_buckets[m_bounds.size()].load(std::memory_order_relaxed);
+  *output << name << "_bucket{" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+  string suffix = labels.empty() ? " " : "{" + labels + "} ";
+  *output << name << "_sum" << suffix;
+  formatSeconds(m_sum.load(std::memory_order_relaxed), output);
+  *output << "\n" << name << "_count" << suffix << m_count.load(std::memory_order_relaxed) << "\n";
+}
+
+
+Metrics* Metrics::getInstance() {
+  static Metrics instance;
+  return &instance;
+}
+
+Metrics::~Metrics() {
+  for (auto& it : m_families) {
+    for (auto& counter : it.second.counters) {
+      delete counter.second;
+    }
+    for (auto& gauge : it.second.gauges) {
+      delete gauge.second;
+    }
+    for (auto& histogram : it.second.histograms) {
+      delete histogram.second;
+    }
+  }
+  m_families.clear();
+}
+
+Metrics::family_t* Metrics::getFamily(const string& name, const char* type, const string& help) {
+  auto it = m_families.find(name);
+  if (it == m_families.end()) {
+    family_t& family = m_families[name];
+    family.type = type;
+    family.help = help;
+    return &family;
+  }
+  return &it->second;
+}
+
+MetricCounter* Metrics::getCounter(const string& name, const string& help, const string& labels) {
+  m_mutex.lock();
+  family_t* family = getFamily(name, "counter", help);
+  MetricCounter*& counter = family->counters[labels];
+  if (!counter) {
+    counter = new MetricCounter();
+  }
+  m_mutex.unlock();
+  return counter;
+}
+
+uint64_t Metrics::getCounterValue(const string& name, const string& labels) {
+  uint64_t value = 0;
+  m_mutex.lock();
+  const auto family = m_families.find(name);
+  if (family != m_families.end()) {
+    const auto counter = family->second.counters.find(labels);
+    if (counter != family->second.counters.end()) {
+      value = counter->second->get();
+    }
+  }
+  m_mutex.unlock();
+  return value;
+}
+
+MetricGauge* Metrics::getGauge(const string& name, const string& help, const string& labels) {
+  m_mutex.lock();
+  family_t* family = getFamily(name, "gauge", help);
+  MetricGauge*& gauge = family->gauges[labels];
+  if (!gauge) {
+    gauge = new MetricGauge();
+  }
+  m_mutex.unlock();
+  return gauge;
+}
+
+MetricHistogram* Metrics::getHistogram(const string& name, const string& help, const vector<uint64_t>& bounds,
+    const string& labels) {
+  m_mutex.lock();
+  family_t* family = getFamily(name, "histogram", help);
+  MetricHistogram*& histogram = family->histograms[labels];
+  if (!histogram) {
+    histogram = new MetricHistogram(bounds);
+  }
+  m_mutex.unlock();
+  return histogram;
+}
+
+void Metrics::format(ostream* output) {
+  m_mutex.lock();
+  for (const auto& it : m_families) {
+    const string& name = it.first;
+    const family_t& family = it.second;
+    *output << "# HELP " << name << " " << family.help << "\n"
+            << "# TYPE " << name << " " << family.type << "\n";
+    for (const auto& counter : family.counters) {
+      *output << name << (counter.first.empty() ? "" : "{" + counter.first + "}") << " " << counter.second->get()
+              << "\n";
+    }
+    for (const auto& gauge : family.gauges) {
+      *output << name << (gauge.first.empty() ? "" : "{" + gauge.first + "}") << " " << gauge.second->get() << "\n";
+    }
+    for (const auto& histogram : family.histograms) {
+      histogram.second->format(name, histogram.first, output);
+    }
+  }
+  m_mutex.unlock();
+}
+
+}  // namespace ebusd
@@ -0,0 +1,249 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_UTILS_METRICS_H_
+#define LIB_UTILS_METRICS_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "lib/utils/thread.h"
+
+namespace ebusd {
+
+/** \file lib/utils/metrics.h
+ * Lock free counters, gauges, and histograms for the hot paths together with a
+ * registry for formatting them in the Prometheus text exposition format.
+ */
+
+using std::atomic;
+using std::map;
+using std::ostream;
+using std::string;
+using std::vector;
+
+/**
+ * A monotonically increasing counter.
+ */
+class MetricCounter {
+ public:
+  /**
+   * Constructor.
+   */
+  MetricCounter() : m_value(0) {}
+
+  /**
+   * Increment the counter.
+   * @param value the value to add.
+   */
+  void add(uint64_t value = 1) { m_value.fetch_add(value, std::memory_order_relaxed); }
+
+  /**
+   * Get the current value.
+   * @return the current value.
+   */
+  uint64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+
+ private:
+  /** the current value. */
+  atomic<uint64_t> m_value;
+};
+
+
+/**
+ * A gauge holding the last set value.
+ */
+class MetricGauge {
+ public:
+  /**
+   * Constructor.
+   */
+  MetricGauge() : m_value(0) {}
+
+  /**
+   * Set the value.
+   * @param value the new value.
+   */
+  void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+
+  /**
+   * Get the current value.
+   * @return the current value.
+   */
+  int64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+
+ private:
+  /** the current value. */
+  atomic<int64_t> m_value;
+};
+
+
+/**
+ * A histogram of durations in microseconds with fixed bucket boundaries.
+ */
+class MetricHistogram {
+ public:
+  /**
+   * Constructor.
+   * @param bounds the inclusive upper bounds of the buckets in microseconds (ascending).
+   */
+  explicit MetricHistogram(const vector<uint64_t>& bounds);
+
+  /**
+   * Destructor.
+   */
+  ~MetricHistogram() { delete[] m_buckets; }
+
+  /**
+   * Add an observed duration.
+   * @param micros the duration in microseconds.
+   */
+  void observe(uint64_t micros);
+
+  /**
+   * Add the duration elapsed since the start time.
+   * @param start the start time from @a clockGettime().
+   */
+  void observeSince(const struct timespec& start);
+
+  /**
+   * Format the buckets, the sum, and the count.
+   * @param name the metric name.
+   * @param labels the optional labels without enclosing braces, or empty.
+   * @param output the @a ostream to append to.
+   */
+  void format(const string& name, const string& labels, ostream* output) const;
+
+
+ private:
+  /** the inclusive upper bounds of the buckets in microseconds. */
+  const vector<uint64_t> m_bounds;
+
+  /** the number of observations per bucket (not cumulative, the last one above all bounds). */
+  atomic<uint64_t>* m_buckets;
+
+  /** the sum of all observations in microseconds. */
+  atomic<uint64_t> m_sum;
+
+  /** the number of all observations. */
+  atomic<uint64_t> m_count;
+};
+
+
+/**
+ * The registry of all metrics.
+ * Metrics are created once (typically during construction of the instrumented class) and then updated without any
+ * locking.
+ */
+class Metrics {
+ public:
+  /**
+   * Get the singleton instance.
+   * @return the singleton @a Metrics instance.
+   */
+  static Metrics* getInstance();
+
+  /**
+   * Destructor.
+   */
+  ~Metrics();
+
+  /**
+   * Get or create a counter.
+   * @param name the metric name.
+   * @param help the help text.
+   * @param labels the optional labels without enclosing braces (e.g. "result=\"OK\""), or empty.
+   * @return the @a MetricCounter.
+   */
+  MetricCounter* getCounter(const string& name, const string& help, const string& labels = "");
+
+  /**
+   * Get the current value of a counter without creating it.
+   * @param name the metric name.
+   * @param labels the optional labels without enclosing braces, or empty.
+   * @return the counter value, or 0 if the counter does not exist.
+   */
+  uint64_t getCounterValue(const string& name, const string& labels = "");
+
+  /**
+   * Get or create a gauge.
+   * @param name the metric name.
+   * @param help the help text.
+   * @param labels the optional labels without enclosing braces, or empty.
+   * @return the @a MetricGauge.
+   */
+  MetricGauge* getGauge(const string& name, const string& help, const string& labels = "");
+
+  /**
+   * Get or create a histogram of durations.
+   * @param name the metric name (should end with "_seconds").
+   * @param help the help text.
+   * @param bounds the inclusive upper bounds of the buckets in microseconds (ascending).
+   * @param labels the optional labels without enclosing braces, or empty.
+   * @return the @a MetricHistogram.
+   */
+  MetricHistogram* getHistogram(const string& name, const string& help, const vector<uint64_t>& bounds,
+      const string& labels = "");
+
+  /**
+   * Format all metrics in the Prometheus text exposition format.
+   * @param output the @a ostream to append to.
+   */
+  void format(ostream* output);
+
+
+ private:
+  /**
+   * Private constructor for the singleton.
+   */
+  Metrics() {}
+
+  /** the metrics of a single family sharing name, type, and help. */
+  typedef struct {
+    const char* type;  //!< the metric type
+    string help;  //!< the help text
+    map<string, MetricCounter*> counters;  //!< the counters by labels
+    map<string, MetricGauge*> gauges;  //!< the gauges by labels
+    map<string, MetricHistogram*> histograms;  //!< the histograms by labels
+  } family_t;
+
+  /**
+   * Get or create a family.
+   * @param name the metric name.
+   * @param type the metric type.
+   * @param help the help text.
+   * @return the @a family_t.
+   */
+  family_t* getFamily(const string& name, const char* type, const string& help);
+
+  /** the @a Mutex for creating and formatting metrics. */
+  Mutex m_mutex;
+
+  /** the metric families by name. */
+  map<string, family_t> m_families;
+};
+
+}  // namespace ebusd
+
+#endif  // LIB_UTILS_METRICS_H_
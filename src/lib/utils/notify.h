@@ -21,20 +21,30 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <stdint.h>
+#ifdef HAVE_EVENTFD
+#  include <sys/eventfd.h>
+#endif
 
 namespace ebusd {
 
 /** \file lib/utils/notify.h */
 
 /**
- * class to notify other thread per pipe.
+ * class to notify other thread per eventfd (or pipe where not available).
  */
 class Notify {
  public:
   /**
    * constructs a new instance and do notifying.
    */
-  Notify() {
+  Notify() : m_recvfd(-1), m_sendfd(-1) {
+#ifdef HAVE_EVENTFD
+    m_recvfd = m_sendfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_recvfd >= 0) {
+      return;
+    }
+#endif
     int pipefd[2];
     int ret = pipe(pipefd);
 
@@ -43,13 +53,19 @@ class Notify {
       m_sendfd = pipefd[1];
 
       fcntl(m_sendfd, F_SETFL, O_NONBLOCK);
+      fcntl(m_recvfd, F_SETFL, O_NONBLOCK);
     }
   }
 
   /**
    * destructor.
    */
-  ~Notify() { close(m_sendfd); close(m_recvfd); }
+  ~Notify() {
+    close(m_sendfd);
+    if (m_recvfd != m_sendfd) {
+      close(m_recvfd);
+    }
+  }
 
   /**
    * file descriptor to watch for notify event.
@@ -61,7 +77,23 @@ class Notify {
    * write notify event to file descriptor.
    * @return result of writing notification.
    */
-  ssize_t notify() const { return write(m_sendfd, "1", 1); }
+  ssize_t notify() const {
+    if (m_recvfd == m_sendfd) {
+      uint64_t value = 1;  // eventfd counter increment
+      return write(m_sendfd, &value, sizeof(value));
+    }
+    return write(m_sendfd, "1", 1);
+  }
+
+  /**
+   * consume all pending notify events from the file descriptor.
+   */
+  void clear() const {
+    char buf[64];  // also large enough for reading and resetting the eventfd counter
+    while (read(m_recvfd, buf, sizeof(buf)) > 0) {
+      // nothing to do
+    }
+  }
 
  private:
   /** file descriptor to watch */
@@ -21,7 +21,10 @@
 
 #include <pthread.h>
 #include <errno.h>
+#include <stdint.h>
+#include <algorithm>
 #include <list>
+#include <vector>
 #include "lib/utils/clock.h"
 
 namespace ebusd {
@@ -29,6 +32,7 @@ namespace ebusd {
 /** \file lib/utils/queue.h */
 
 using std::list;
+using std::vector;
 
 /**
  * Thread safe template class for queuing items.
@@ -163,6 +167,517 @@ class Queue {
   pthread_cond_t m_cond;
 };
 
+/**
+ * Thread safe template class for queuing items by priority class with aging. An item queued for a while is treated
+ * like one of the next more urgent class, so that a steady flow of urgent items does not starve the others. Items
+ * with the same effective priority are handled in the order they were queued.
+ * @param T the item type.
+ */
+template <typename T>
+class PriorityQueue {
+ public:
+  /**
+   * Constructor.
+   * @param agingMillis the time in milliseconds after which a queued item is treated like one of the next more urgent
+   * priority class.
+   */
+  explicit PriorityQueue(unsigned int agingMillis)
+    : m_agingMillis(agingMillis) {
+    pthread_mutex_init(&m_mutex, nullptr);
+  }
+
+  /**
+   * Destructor.
+   */
+  ~PriorityQueue() {
+    pthread_mutex_destroy(&m_mutex);
+  }
+
+
+ private:
+  /**
+   * Hidden copy constructor.
+   * @param src the object to copy from.
+   */
+  PriorityQueue(const PriorityQueue& src);
+
+
+ public:
+  /**
+   * Add an item to the queue.
+   * @param item the item to add.
+   * @param priority the priority class of the item (0 for the most urgent one).
+   */
+  void push(T item, unsigned int priority) {
+    // the effective priority only depends on the time queued, so it can be calculated once as virtual deadline
+    uint64_t deadline = clockGetMillis() + (uint64_t)priority*m_agingMillis;
+    pthread_mutex_lock(&m_mutex);
+    auto it = m_queue.end();
+    while (it != m_queue.begin()) {
+      auto prev = it;
+      if ((--prev)->deadline <= deadline) {
+        break;
+      }
+      it = prev;
+    }
+    m_queue.insert(it, {item, deadline});
+    pthread_mutex_unlock(&m_mutex);
+  }
+
+  /**
+   * Remove the most urgent item from the queue.
+   * @return the item, or nullptr if no item is available.
+   */
+  T pop() {
+    T item;
+    pthread_mutex_lock(&m_mutex);
+    if (m_queue.empty()) {
+      item = nullptr;
+    } else {
+      item = m_queue.front().item;
+      m_queue.pop_front();
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return item;
+  }
+
+  /**
+   * Remove the specified item from the queue.
+   * @param item the item to remove.
+   * @return whether the item was removed.
+   */
+  bool remove(T item) {
+    bool result = false;
+    pthread_mutex_lock(&m_mutex);
+    for (auto it = m_queue.begin(); it != m_queue.end(); it++) {
+      if (it->item == item) {
+        m_queue.erase(it);
+        result = true;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return result;
+  }
+
+  /**
+   * Return the most urgent item in the queue without removing it.
+   * @return the item, or nullptr if no item is available.
+   */
+  T peek() {
+    T item;
+    pthread_mutex_lock(&m_mutex);
+    if (m_queue.empty()) {
+      item = nullptr;
+    } else {
+      item = m_queue.front().item;
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return item;
+  }
+
+
+ private:
+  /** a queued item. */
+  typedef struct {
+    T item;  //!< the item itself
+    uint64_t deadline;  //!< the time in milliseconds when queued plus the aging time for each priority class
+  } entry_t;
+
+  /** the time in milliseconds after which a queued item is treated like one of the next more urgent class. */
+  const unsigned int m_agingMillis;
+
+  /** the queue itself ordered by deadline */
+  list<entry_t> m_queue;
+
+  /** mutex variable for exclusive lock */
+  pthread_mutex_t m_mutex;
+};
+
+/**
+ * Thread safe template class for queuing items in a bounded ring buffer.
+ * In contrast to @a Queue, this does not allocate memory per item and only wakes up waiting threads when there are
+ * any. When the queue is full, @a push() blocks until space becomes available while @a tryPush() fails.
+ * @param T the item type.
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  /**
+   * Constructor.
+   * @param capacity the maximum number of queued items (rounded up to the next power of 2).
+   */
+  explicit BoundedQueue(size_t capacity = 64)
+    : m_head(0), m_count(0), m_waiters(0), m_pushWaiters(0), m_wakeUp(false) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    m_items.resize(size, nullptr);
+    m_mask = size - 1;
+    pthread_mutex_init(&m_mutex, nullptr);
+    pthread_cond_init(&m_cond, nullptr);
+    pthread_cond_init(&m_notFullCond, nullptr);
+  }
+
+  /**
+   * Destructor.
+   */
+  ~BoundedQueue() {
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+    pthread_cond_destroy(&m_notFullCond);
+  }
+
+
+ private:
+  /**
+   * Hidden copy constructor.
+   * @param src the object to copy from.
+   */
+  BoundedQueue(const BoundedQueue& src);
+
+
+ public:
+  /**
+   * Add an item to the end of queue, waiting for space to become available if the queue is full.
+   * @param item the item to add.
+   */
+  void push(T item) {
+    pthread_mutex_lock(&m_mutex);
+    while (m_count > m_mask) {
+      m_pushWaiters++;
+      pthread_cond_wait(&m_notFullCond, &m_mutex);
+      m_pushWaiters--;
+    }
+    m_items[(m_head + m_count) & m_mask] = item;
+    m_count++;
+    wakeWaiters();
+    pthread_mutex_unlock(&m_mutex);
+  }
+
+  /**
+   * Add an item to the end of queue if the queue is not full (without waiting).
+   * @param item the item to add.
+   * @return true when the item was added, false when the queue is full.
+   */
+  bool tryPush(T item) {
+    pthread_mutex_lock(&m_mutex);
+    if (m_count > m_mask) {
+      pthread_mutex_unlock(&m_mutex);
+      return false;
+    }
+    m_items[(m_head + m_count) & m_mask] = item;
+    m_count++;
+    wakeWaiters();
+    pthread_mutex_unlock(&m_mutex);
+    return true;
+  }
+
+  /**
+   * Remove the first item from the queue optionally waiting for the queue being non-empty.
+   * @param timeout the maximum time in seconds to wait for the queue being filled, or 0 for no wait.
+   * @return the item, or nullptr if no item is available within the specified time or @a wakeUp() was called.
+   */
+  T pop(int timeout = 0) {
+    T item;
+    pthread_mutex_lock(&m_mutex);
+    if (timeout > 0 && m_count == 0 && !m_wakeUp) {
+      struct timespec t;
+      clockGettime(&t);
+      t.tv_sec += timeout;
+      m_waiters++;
+      while (m_count == 0 && !m_wakeUp) {
+        if (pthread_cond_timedwait(&m_cond, &m_mutex, &t) != 0) {
+          break;
+        }
+      }
+      m_waiters--;
+    }
+    m_wakeUp = false;
+    if (m_count == 0) {
+      item = nullptr;
+    } else {
+      item = m_items[m_head];
+      m_items[m_head] = nullptr;
+      m_head = (m_head + 1) & m_mask;
+      m_count--;
+      if (m_pushWaiters > 0) {
+        pthread_cond_signal(&m_notFullCond);
+      }
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return item;
+  }
+
+  /**
+   * Let the current or next waiting @a pop() return without waiting for an item to be added.
+   */
+  void wakeUp() {
+    pthread_mutex_lock(&m_mutex);
+    m_wakeUp = true;
+    wakeWaiters();
+    pthread_mutex_unlock(&m_mutex);
+  }
+
+  /**
+   * Remove the specified item from the queue optionally waiting for it to appear in the queue.
+   * @param item the item to remove and optionally wait for.
+   * @param wait true to wait for the item to appear in the queue.
+   * @return whether the item was removed.
+   */
+  bool remove(T item, bool wait = false) {
+    bool result = false;
+    pthread_mutex_lock(&m_mutex);
+    struct timespec t;
+    while (true) {
+      clockGettime(&t);
+      t.tv_sec++;  // check thread death every second
+      size_t kept = 0;
+      for (size_t i = 0; i < m_count; i++) {
+        T other = m_items[(m_head + i) & m_mask];
+        if (other == item) {
+          continue;
+        }
+        m_items[(m_head + kept++) & m_mask] = other;
+      }
+      if (kept != m_count) {
+        for (size_t i = kept; i < m_count; i++) {
+          m_items[(m_head + i) & m_mask] = nullptr;
+        }
+        m_count = kept;
+        if (m_pushWaiters > 0) {
+          pthread_cond_broadcast(&m_notFullCond);
+        }
+        result = true;
+        break;
+      }
+      if (!wait) {
+        break;
+      }
+      m_waiters++;
+      int ret = pthread_cond_timedwait(&m_cond, &m_mutex, &t);
+      m_waiters--;
+      if (ret != 0 && ret != ETIMEDOUT) {
+        break;
+      }
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return result;
+  }
+
+  /**
+   * Return the first item in the queue without removing it.
+   * @return the item, or nullptr if no item is available.
+   */
+  T peek() {
+    T item;
+    pthread_mutex_lock(&m_mutex);
+    if (m_count == 0) {
+      item = nullptr;
+    } else {
+      item = m_items[m_head];
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return item;
+  }
+
+
+ private:
+  /**
+   * Wake up the threads waiting in @a pop() or @a remove() (only when there are any).
+   * Note: has to be called while holding the mutex.
+   */
+  void wakeWaiters() {
+    if (m_waiters == 1) {
+      pthread_cond_signal(&m_cond);
+    } else if (m_waiters > 1) {
+      // waiters in remove() might wait for a different item, so wake up all of them
+      pthread_cond_broadcast(&m_cond);
+    }
+  }
+
+  /** the ring buffer of items. */
+  vector<T> m_items;
+
+  /** the mask for the ring buffer index (capacity minus one). */
+  size_t m_mask;
+
+  /** the index of the first item in the ring buffer. */
+  size_t m_head;
+
+  /** the number of items in the ring buffer. */
+  size_t m_count;
+
+  /** the number of threads waiting in @a pop() or @a remove(). */
+  size_t m_waiters;
+
+  /** the number of threads waiting in @a push() for space. */
+  size_t m_pushWaiters;
+
+  /** whether the next waiting @a pop() shall return immediately. */
+  bool m_wakeUp;
+
+  /** mutex variable for exclusive lock */
+  pthread_mutex_t m_mutex;
+
+  /** condition variable for waiting on new items */
+  pthread_cond_t m_cond;
+
+  /** condition variable for waiting on space in the ring buffer */
+  pthread_cond_t m_notFullCond;
+};
+
+/**
+ * Thread safe template class for a ring buffer of items written once by the producer and read by any number of
+ * consumers with independent cursors. Items are never removed, but overwritten by the producer once the ring is
+ * full, so a consumer lagging behind more than the capacity loses the overwritten items.
+ * @param T the item type (reused for each write, so that its memory is allocated only once).
+ */
+template <typename T>
+class BroadcastRing {
+ public:
+  /**
+   * Constructor.
+   * @param capacity the number of items kept in the ring (rounded up to the next power of 2).
+   */
+  explicit BroadcastRing(size_t capacity = 256)
+    : m_head(0), m_waiters(0) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    m_items.resize(size);
+    m_mask = size - 1;
+    pthread_mutex_init(&m_mutex, nullptr);
+    pthread_cond_init(&m_cond, nullptr);
+  }
+
+  /**
+   * Destructor.
+   */
+  ~BroadcastRing() {
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+  }
+
+
+ private:
+  /**
+   * Hidden copy constructor.
+   * @param src the object to copy from.
+   */
+  BroadcastRing(const BroadcastRing& src);
+
+
+ public:
+  /**
+   * Get the sequence number of the next item to write, i.e. the cursor of a consumer interested in new items only.
+   * @return the sequence number of the next item to write.
+   */
+  uint64_t getHead() {
+    pthread_mutex_lock(&m_mutex);
+    uint64_t head = m_head;
+    pthread_mutex_unlock(&m_mutex);
+    return head;
+  }
+
+  /**
+   * Start writing the next item. The ring stays locked until @a endWrite() is called.
+   * @return the (previously used) item to overwrite in place.
+   */
+  T* beginWrite() {
+    pthread_mutex_lock(&m_mutex);
+    return &m_items[static_cast<size_t>(m_head & m_mask)];
+  }
+
+  /**
+   * Finish writing the item returned by @a beginWrite() and wake up waiting consumers.
+   */
+  void endWrite() {
+    m_head++;
+    if (m_waiters > 0) {
+      pthread_cond_broadcast(&m_cond);
+    }
+    pthread_mutex_unlock(&m_mutex);
+  }
+
+  /**
+   * Wait for an item after the cursor to become available.
+   * @param cursor the cursor of the consumer.
+   * @param timeout the maximum time in seconds to wait for a new item, or 0 for no wait.
+   * @return true when an item is available after the cursor.
+   */
+  bool wait(uint64_t cursor, int timeout) {
+    pthread_mutex_lock(&m_mutex);
+    if (timeout > 0 && m_head <= cursor) {
+      struct timespec t;
+      clockGettime(&t);
+      t.tv_sec += timeout;
+      m_waiters++;
+      while (m_head <= cursor) {
+        if (pthread_cond_timedwait(&m_cond, &m_mutex, &t) != 0) {
+          break;
+        }
+      }
+      m_waiters--;
+    }
+    bool available = m_head > cursor;
+    pthread_mutex_unlock(&m_mutex);
+    return available;
+  }
+
+  /**
+   * Pass copies of the items available after the cursor to the consumer function.
+   * Note: the items are copied while locked and consumed afterwards, so the producer is not blocked by the consumer.
+   * @param cursor the cursor of the consumer, advanced behind the consumed items.
+   * @param maxCount the maximum number of items to consume at once.
+   * @param consume the function called with each consumed item.
+   * @return the number of items overwritten before the consumer got to them.
+   */
+  template <typename F>
+  uint64_t read(uint64_t* cursor, size_t maxCount, F consume) {
+    vector<T> items;
+    pthread_mutex_lock(&m_mutex);
+    uint64_t lost = 0;
+    if (m_head > *cursor + m_mask + 1) {
+      lost = m_head - m_mask - 1 - *cursor;
+      *cursor += lost;
+    }
+    if (*cursor < m_head) {
+      items.reserve(static_cast<size_t>(std::min(static_cast<uint64_t>(maxCount), m_head - *cursor)));
+    }
+    for (size_t count = 0; count < maxCount && *cursor < m_head; count++, (*cursor)++) {
+      items.push_back(m_items[static_cast<size_t>(*cursor & m_mask)]);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    for (const auto& item : items) {
+      consume(item);
+    }
+    return lost;
+  }
+
+
+ private:
+  /** the ring buffer of items. */
+  vector<T> m_items;
+
+  /** the mask for the ring buffer index (capacity minus one). */
+  uint64_t m_mask;
+
+  /** the sequence number of the next item to write. */
+  uint64_t m_head;
+
+  /** the number of threads waiting in @a wait(). */
+  size_t m_waiters;
+
+  /** mutex variable for exclusive lock */
+  pthread_mutex_t m_mutex;
+
+  /** condition variable for waiting on new items */
+  pthread_cond_t m_cond;
+};
+
 }  // namespace ebusd
 
 #endif  // LIB_UTILS_QUEUE_H_
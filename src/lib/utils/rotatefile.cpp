@@ -16,40 +16,124 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
 #include "lib/utils/rotatefile.h"
 #include <sys/ioctl.h>
 #include <sys/file.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <string>
+#include <atomic>
 #include "lib/utils/clock.h"
 
 namespace ebusd {
 
 using std::streamsize;
 
-RotateFile::~RotateFile() {
-  if (m_stream) {
+/**
+ * The @a Thread closing and optionally compressing a rotated file with gzip.
+ */
+class RotatedFileThread : public Thread {
+ public:
+  /**
+   * Constructor.
+   * @param stream the @a FILE of the rotated file to close.
+   * @param sync whether to flush and sync the buffered data before closing.
+   * @param fileName the name of the rotated file.
+   * @param compress whether to compress the rotated file (replaced by the compressed file with ".gz" suffix).
+   */
+  RotatedFileThread(FILE* stream, bool sync, const string& fileName, bool compress)
+    : Thread(), m_stream(stream), m_sync(sync), m_fileName(fileName), m_compress(compress), m_done(false) {}
+
+  /**
+   * Return whether the rotated file was closed and compressed.
+   * @return whether the rotated file was closed and compressed.
+   */
+  bool isDone() const { return m_done; }
+
+
+ protected:
+  // @copydoc
+  void run() override {
+    if (m_sync) {
+      fflush(m_stream);
+      fdatasync(fileno(m_stream));
+    }
     fclose(m_stream);
-    m_stream = nullptr;
+    if (m_compress) {
+      char* const argv[] = {const_cast<char*>("gzip"), const_cast<char*>("-f"),
+        const_cast<char*>(m_fileName.c_str()), nullptr};
+      pid_t pid;
+      if (posix_spawnp(&pid, "gzip", nullptr, nullptr, argv, environ) == 0) {
+        waitpid(pid, nullptr, 0);
+      }
+    }
+    m_done = true;
+  }
+
+
+ private:
+  /** the @a FILE of the rotated file to close. */
+  FILE* m_stream;
+
+  /** whether to flush and sync the buffered data before closing. */
+  const bool m_sync;
+
+  /** the name of the rotated file. */
+  const string m_fileName;
+
+  /** whether to compress the rotated file. */
+  const bool m_compress;
+
+  /** set to true when the rotated file was closed and compressed. */
+  std::atomic<bool> m_done;
+};
+
+RotateFile::~RotateFile() {
+  m_mutex.lock();
+  close();
+  m_mutex.unlock();
+  if (m_rotateThread) {
+    m_rotateThread->join();
+    delete m_rotateThread;
+    m_rotateThread = nullptr;
   }
 }
 
 bool RotateFile::setEnabled(bool enabled) {
+  m_mutex.lock();
   if (enabled == m_enabled) {
+    m_mutex.unlock();
     return false;
   }
   m_enabled = enabled;
-  if (m_stream) {
-    fclose(m_stream);
-    m_stream = nullptr;
-  }
+  close();
   if (enabled) {
-    m_stream = fopen(m_fileName.c_str(), m_textMode ? "w" : "wb");
-    m_fileSize = 0;
+    open();
+  }
+  m_mutex.unlock();
+  return true;
+}
+
+void RotateFile::open() {
+  m_stream = fopen(m_fileName.c_str(), m_textMode ? "w" : "wb");
+  m_fileSize = 0;
+  m_flushSize = 0;
+  if (!m_stream) {
+    return;
+  }
+  if (m_flushInterval > 0) {
+    setvbuf(m_stream, nullptr, _IOFBF, m_flushBuffer);  // let stdio write in blocks only
+    time(&m_lastFlushTime);
+  }
 #ifdef FORWARD_RAW_TTY
     if (!m_textMode && isatty(fileno(m_stream)) == 1) {
       int fd = fileno(m_stream);
@@ -66,12 +150,72 @@ bool RotateFile::setEnabled(bool enabled) {
       tcsetattr(fd, TCSANOW, &newSettings);
     }
 #endif
+}
+
+void RotateFile::close() {
+  if (!m_stream) {
+    return;
+  }
+  if (m_flushInterval > 0) {
+    fflush(m_stream);
+    fdatasync(fileno(m_stream));
+  }
+  fclose(m_stream);
+  m_stream = nullptr;
+}
+
+void RotateFile::flush(bool force) {
+  if (m_flushInterval == 0 || !m_enabled) {
+    return;
+  }
+  time_t now;
+  time(&now);
+  m_mutex.lock();
+  if (m_stream && (force || now < m_lastFlushTime || now >= m_lastFlushTime + m_flushInterval)) {
+    fflush(m_stream);
+    fdatasync(fileno(m_stream));
+    m_lastFlushTime = now;
+  }
+  m_mutex.unlock();
+}
+
+void RotateFile::rotate() {
+  if (m_rotateThread) {
+    if (!m_rotateThread->isDone()) {
+      // the previous compression removes the uncompressed file when done: retry with the next write
+      return;
+    }
+    m_rotateThread->join();
+    delete m_rotateThread;
+    m_rotateThread = nullptr;
+  }
+  string oldfile = string(m_fileName)+".old";
+  if (rename(m_fileName.c_str(), oldfile.c_str()) != 0) {
+    return;
+  }
+  FILE* oldStream = m_stream;
+  m_stream = nullptr;
+  open();
+  if (!oldStream) {
+    return;
+  }
+  // sync, close, and compress in the background in order to not block the writing thread
+  auto thread = new RotatedFileThread(oldStream, m_flushInterval > 0, oldfile, m_compress);
+  if (thread->start("rotate")) {
+    m_rotateThread = thread;
+  } else {
+    delete thread;
+    fclose(oldStream);
   }
-  return true;
 }
 
 void RotateFile::write(const unsigned char* value, const size_t size, const bool received, const bool bytes) {
-  if (!m_enabled || !m_stream) {
+  if (!m_enabled) {
+    return;
+  }
+  m_mutex.lock();
+  if (!m_stream) {
+    m_mutex.unlock();
     return;
   }
   if (m_textMode) {
@@ -93,24 +237,24 @@ void RotateFile::write(const unsigned char* value, const size_t size, const bool
       m_fileSize += size+1;
     }
     fprintf(m_stream, "\n");
-    fflush(m_stream);
+    if (m_flushInterval == 0) {
+      fflush(m_stream);
+    }
   } else {
     fwrite(value, (streamsize)size, 1, m_stream);
     m_fileSize += size;
-    m_flushSize += size;
-    if (m_flushSize >= m_flushBuffer) {
-      fflush(m_stream);
-      m_flushSize = 0;
+    if (m_flushInterval == 0) {
+      m_flushSize += size;
+      if (m_flushSize >= m_flushBuffer) {
+        fflush(m_stream);
+        m_flushSize = 0;
+      }
     }
   }
   if (m_fileSize >= m_maxSize * 1024LL) {
-    string oldfile = string(m_fileName)+".old";
-    if (rename(m_fileName.c_str(), oldfile.c_str()) == 0) {
-      fclose(m_stream);
-      m_stream = fopen(m_fileName.c_str(), m_textMode ? "w" : "wb");
-      m_fileSize = 0;
-    }
+    rotate();
   }
+  m_mutex.unlock();
 }
 
 }  // namespace ebusd
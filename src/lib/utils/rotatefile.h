@@ -24,6 +24,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include "lib/utils/thread.h"
 
 namespace ebusd {
 
@@ -33,6 +34,8 @@ namespace ebusd {
 
 using std::string;
 
+class RotatedFileThread;
+
 /**
  * Helper class for writing to a rotating file with maximum size.
  */
@@ -43,12 +46,16 @@ class RotateFile {
    * @param fileName the name of the file write to.
    * @param maxSize the maximum size of the file to write to.
    * @param textMode whether to write each byte with prefixed timestamp and direction as text.
-   * @param flushBuffer the size of the flush buffer.
+   * @param flushBuffer the size of the flush buffer (the block size when buffered).
+   * @param flushInterval the maximum interval in seconds for flushing and syncing the buffered data (see @a flush()),
+   * or 0 for not buffering.
+   * @param compress whether to compress the rotated file in the background.
    */
   RotateFile(const string fileName, const unsigned int maxSize, const bool textMode = false,
-             const unsigned int flushBuffer = 16)
+             const unsigned int flushBuffer = 16, const unsigned int flushInterval = 0, const bool compress = false)
     : m_enabled(false), m_fileName(fileName), m_maxSize(maxSize), m_textMode(textMode), m_stream(), m_fileSize(0),
-      m_flushSize(0), m_flushBuffer(flushBuffer) {}
+      m_flushSize(0), m_flushBuffer(flushBuffer), m_flushInterval(flushInterval), m_compress(compress),
+      m_lastFlushTime(0), m_rotateThread(nullptr) {}
 
   /**
    * Destructor.
@@ -78,8 +85,33 @@ class RotateFile {
   void write(const unsigned char* value, const size_t size, const bool received = true,
       const bool bytes = true);
 
+  /**
+   * Flush and sync the buffered data to the file if the flush interval elapsed (only relevant when buffered).
+   * @param force true to flush regardless of the flush interval.
+   */
+  void flush(bool force = false);
+
 
  private:
+  /**
+   * Open the file for writing.
+   */
+  void open();
+
+  /**
+   * Close the file after flushing and syncing the data.
+   */
+  void close();
+
+  /**
+   * Rotate the file and start closing and compressing (if requested) the rotated file in the background.
+   * The rotation is postponed while the previously rotated file is still being compressed.
+   */
+  void rotate();
+
+  /** the @a Mutex for serializing the access to @a m_stream. */
+  Mutex m_mutex;
+
   /** whether writing to the file is enabled. */
   bool m_enabled;
 
@@ -101,8 +133,20 @@ class RotateFile {
   /** the number of bytes written to @a m_file since the last flush. */
   uint64_t m_flushSize;
 
-  /** the size of the flush buffer. */
+  /** the size of the flush buffer (the block size when buffered). */
   const unsigned int m_flushBuffer;
+
+  /** the maximum interval in seconds for flushing and syncing the buffered data, or 0 for not buffering. */
+  const unsigned int m_flushInterval;
+
+  /** whether to compress the rotated file in the background. */
+  const bool m_compress;
+
+  /** the system time of the last flush of the buffered data. */
+  time_t m_lastFlushTime;
+
+  /** the @a RotatedFileThread closing and compressing the rotated file, or nullptr. */
+  RotatedFileThread* m_rotateThread;
 };
 
 }  // namespace ebusd
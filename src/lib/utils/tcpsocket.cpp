@@ -27,6 +27,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <string.h>
 #include <errno.h>
 #ifdef HAVE_PPOLL
@@ -36,6 +38,11 @@
 namespace ebusd {
 
 TCPSocket::TCPSocket(int sfd, socketaddress* address) : m_sfd(sfd) {
+  if (address == nullptr) {
+    m_ip = "unix";
+    m_port = 0;
+    return;
+  }
   char ip[17];
   inet_ntop(AF_INET, (struct in_addr*)&(address->sin_addr.s_addr), ip, (socklen_t)sizeof(ip)-1);
   m_ip = ip;
@@ -196,11 +203,87 @@ TCPSocket* TCPSocket::connect(const string& server, const uint16_t& port, int ti
   return s;
 }
 
+/**
+ * Fill in the Unix domain socket address for the path.
+ * @param path the path of the Unix domain socket.
+ * @param address the @a sockaddr_un to fill in.
+ * @return true on success, false if the path is empty or too long.
+ */
+static bool unixAddress(const string& path, struct sockaddr_un* address) {
+  memset(address, 0, sizeof(*address));
+  if (path.empty() || path.length() >= sizeof(address->sun_path)) {
+    return false;
+  }
+  address->sun_family = AF_UNIX;
+  strncpy(address->sun_path, path.c_str(), sizeof(address->sun_path)-1);
+  return true;
+}
+
+TCPSocket* TCPSocket::connectUnix(const string& path, int timeout) {
+  struct sockaddr_un address;
+  if (!unixAddress(path, &address)) {
+    return nullptr;
+  }
+  int sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sfd < 0) {
+    return nullptr;
+  }
+  if (::connect(sfd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(sfd);
+    return nullptr;
+  }
+  TCPSocket* s = new TCPSocket(sfd, nullptr);
+  if (timeout > 0) {
+    s->setTimeout(timeout);
+  }
+  return s;
+}
+
+
+TCPServer::~TCPServer() {
+  if (m_lfd > 0) {
+    close(m_lfd);
+  }
+  if (m_listening && !m_path.empty()) {
+    unlink(m_path.c_str());
+  }
+}
 
 int TCPServer::start() {
   if (m_listening) {
     return 0;
   }
+  if (!m_path.empty()) {
+    struct sockaddr_un address;
+    if (!unixAddress(m_path, &address)) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    struct stat st;
+    if (lstat(m_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+      unlink(m_path.c_str());  // remove stale socket from previous run
+    }
+    m_lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_lfd < 0) {
+      return -1;
+    }
+    int result = bind(m_lfd, (struct sockaddr*)&address, sizeof(address));
+    if (result != 0) {
+      return result;
+    }
+    if (m_mode != 0 && chmod(m_path.c_str(), m_mode) != 0) {
+      result = -1;
+    }
+    if (result == 0) {
+      result = listen(m_lfd, 5);
+    }
+    if (result != 0) {
+      unlink(m_path.c_str());
+      return result;
+    }
+    m_listening = true;
+    return result;
+  }
   m_lfd = socket(AF_INET, SOCK_STREAM, 0);
   socketaddress address;
   memset(&address, 0, sizeof(address));
@@ -230,6 +313,13 @@ TCPSocket* TCPServer::newSocket() {
   if (!m_listening) {
     return nullptr;
   }
+  if (!m_path.empty()) {
+    int sfd = accept(m_lfd, nullptr, nullptr);
+    if (sfd < 0) {
+      return nullptr;
+    }
+    return new TCPSocket(sfd, nullptr);
+  }
   socketaddress address;
   socklen_t len = sizeof(address);
   memset(&address, 0, sizeof(address));
@@ -20,6 +20,7 @@
 #define LIB_UTILS_TCPSOCKET_H_
 
 #include <unistd.h>
+#include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/time.h>
@@ -65,7 +66,7 @@ class TCPSocket {
   /**
    * Constructor.
    * @param sfd the file descriptor of tcp socket.
-   * @param address struct which holds the ip address.
+   * @param address struct which holds the ip address, or nullptr for a Unix domain socket.
    */
   TCPSocket(int sfd, socketaddress* address);
 
@@ -84,6 +85,14 @@ class TCPSocket {
    */
   static TCPSocket* connect(const string& server, const uint16_t& port, int timeout = 0);
 
+  /**
+   * initiate a Unix domain socket connection to a listening server.
+   * @param path the path of the Unix domain socket.
+   * @param timeout the send and receive timeout in seconds, or 0.
+   * @return pointer to an opened socket, or nullptr on error.
+   */
+  static TCPSocket* connectUnix(const string& path, int timeout = 0);
+
   /**
    * Write bytes to opened file descriptor.
    * @param buffer data to send.
@@ -108,7 +117,7 @@ class TCPSocket {
 
   /**
    * Return the IP address.
-   * @return the IP address.
+   * @return the IP address, or "unix" for a Unix domain socket.
    */
   const string& getIP() const { return m_ip; }
 
@@ -158,12 +167,20 @@ class TCPServer {
    * @param address the ip address.
    */
   TCPServer(const uint16_t port, const string address)
-    : m_lfd(0), m_port(port), m_address(address), m_listening(false) {}
+    : m_lfd(0), m_port(port), m_address(address), m_mode(0), m_listening(false) {}
+
+  /**
+   * creates a new instance of a listening Unix domain socket server.
+   * @param path the path of the Unix domain socket.
+   * @param mode the permission mode to set on the socket file.
+   */
+  TCPServer(const string path, const mode_t mode)
+    : m_lfd(0), m_port(0), m_path(path), m_mode(mode), m_listening(false) {}
 
   /**
    * destructor.
    */
-  ~TCPServer() { if (m_lfd > 0) {close(m_lfd);} }
+  ~TCPServer();
 
   /**
    * start listening of tcp socket.
@@ -194,6 +211,12 @@ class TCPServer {
   /** listening tcp socket ip address */
   string m_address;
 
+  /** the path of the listening Unix domain socket, or empty for tcp */
+  string m_path;
+
+  /** the permission mode of the Unix domain socket file */
+  mode_t m_mode;
+
   /** true if object is already listening */
   bool m_listening;
 };
@@ -21,6 +21,9 @@
 #endif
 
 #include "lib/utils/thread.h"
+#include <sched.h>
+#include <errno.h>
+#include <stdlib.h>
 #include "lib/utils/clock.h"
 
 namespace ebusd {
@@ -51,6 +54,63 @@ bool Thread::start(const char* name) {
   return false;
 }
 
+int Thread::setScheduling(int priority, uint64_t cpus) {
+  if (!m_started) {
+    return ESRCH;
+  }
+  if (priority > 0) {
+    struct sched_param param = {};
+    param.sched_priority = priority;
+    int result = pthread_setschedparam(m_threadid, SCHED_FIFO, &param);
+    if (result != 0) {
+      return result;
+    }
+  }
+  if (cpus == 0) {
+    return 0;
+  }
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned int cpu = 0; cpu < 64; cpu++) {
+    if (cpus & (1ULL << cpu)) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return pthread_setaffinity_np(m_threadid, sizeof(set), &set);
+#else
+  return ENOTSUP;
+#endif
+}
+
+bool Thread::parseCpuList(const char* list, uint64_t* cpus) {
+  *cpus = 0;
+  const char* pos = list;
+  while (*pos) {
+    char* end = nullptr;
+    auto from = (unsigned int)strtoul(pos, &end, 10);
+    if (end == pos) {
+      return false;
+    }
+    unsigned int to = from;
+    if (*end == '-') {
+      pos = end + 1;
+      to = (unsigned int)strtoul(pos, &end, 10);
+      if (end == pos) {
+        return false;
+      }
+    }
+    if (from > to || to >= 64 || (*end != 0 && *end != ',')) {
+      return false;
+    }
+    for (unsigned int cpu = from; cpu <= to; cpu++) {
+      *cpus |= 1ULL << cpu;
+    }
+    pos = *end == ',' ? end + 1 : end;
+  }
+  return *cpus != 0;
+}
+
 bool Thread::join() {
   int result = -1;
   if (m_started) {
@@ -19,7 +19,10 @@
 #ifndef LIB_UTILS_THREAD_H_
 #define LIB_UTILS_THREAD_H_
 
+#include <stdint.h>
+#include <stddef.h>
 #include <pthread.h>
+#include <map>
 
 namespace ebusd {
 
@@ -77,6 +80,22 @@ class Thread {
    */
   pthread_t self() { return m_threadid; }
 
+  /**
+   * Set the scheduling policy and CPU affinity of the started thread.
+   * @param priority the real-time (SCHED_FIFO) priority from 1 to 99, or 0 to keep the default policy.
+   * @param cpus the bit mask of CPUs to pin the thread to (CPU 0 in the lowest bit), or 0 to keep the default.
+   * @return 0 on success, or the error number.
+   */
+  int setScheduling(int priority, uint64_t cpus);
+
+  /**
+   * Parse a list of CPU numbers and ranges.
+   * @param list the comma separated list of CPU numbers and ranges (e.g. "1,3-4").
+   * @param cpus the variable in which to store the bit mask of CPUs (CPU 0 in the lowest bit).
+   * @return true on success, false for an invalid list.
+   */
+  static bool parseCpuList(const char* list, uint64_t* cpus);
+
 
  protected:
   /**
@@ -215,6 +234,119 @@ class Mutex {
   pthread_mutex_t m_mutex;
 };
 
+/**
+ * A mutex allowing many simultaneous shared (reading) or a single exclusive (modifying) lock.
+ * Both locks are recursive and a thread holding the exclusive lock may also take the shared lock. A thread holding
+ * only the shared lock may not take the exclusive lock.
+ */
+class SharedMutex {
+ public:
+  /**
+   * Constructor.
+   */
+  inline SharedMutex() {
+    pthread_rwlock_init(&m_lock, nullptr);
+  }
+
+  /**
+   * Destructor.
+   */
+  virtual inline ~SharedMutex() {
+    pthread_rwlock_destroy(&m_lock);
+  }
+
+  /**
+   * Take the exclusive lock.
+   */
+  void inline lock() {
+    NestedCounts& counts = getNestedCounts();
+    if (counts.m_exclusive == 0) {
+      pthread_rwlock_wrlock(&m_lock);
+    }
+    counts.m_exclusive++;
+  }
+
+  /**
+   * Release the exclusive lock.
+   */
+  void inline unlock() {
+    NestedCounts& counts = getNestedCounts();
+    if (--counts.m_exclusive == 0) {
+      pthread_rwlock_unlock(&m_lock);
+      releaseNestedCounts();
+    }
+  }
+
+  /**
+   * Take the shared lock.
+   */
+  void inline lockShared() {
+    NestedCounts& counts = getNestedCounts();
+    if (counts.m_exclusive > 0) {
+      counts.m_exclusive++;  // nested within the exclusive lock
+      return;
+    }
+    if (counts.m_shared == 0) {
+      // only the outermost shared lock is taken as a nested read lock might block behind a waiting writer
+      pthread_rwlock_rdlock(&m_lock);
+    }
+    counts.m_shared++;
+  }
+
+  /**
+   * Release the shared lock.
+   */
+  void inline unlockShared() {
+    NestedCounts& counts = getNestedCounts();
+    if (counts.m_exclusive > 0) {
+      unlock();
+      return;
+    }
+    if (--counts.m_shared == 0) {
+      pthread_rwlock_unlock(&m_lock);
+      releaseNestedCounts();
+    }
+  }
+
+ private:
+  /**
+   * The number of nested locks held by a single thread.
+   */
+  struct NestedCounts {
+    /** the number of nested shared locks. */
+    size_t m_shared;
+
+    /** the number of nested exclusive (or shared within exclusive) locks. */
+    size_t m_exclusive;
+  };
+
+  /**
+   * @return the nested lock counts of the calling thread by instance. These are kept in a thread local map instead of
+   * a pthread key per instance, as the number of keys is limited by the system (PTHREAD_KEYS_MAX).
+   */
+  static inline std::map<const SharedMutex*, NestedCounts>& getThreadCounts() {
+    static thread_local std::map<const SharedMutex*, NestedCounts> counts;
+    return counts;
+  }
+
+  /**
+   * @return the @a NestedCounts of the calling thread for this instance (created with zero counts if not yet present).
+   */
+  inline NestedCounts& getNestedCounts() const {
+    return getThreadCounts()[this];
+  }
+
+  /**
+   * Drop the @a NestedCounts of the calling thread for this instance after the outermost lock was released.
+   */
+  inline void releaseNestedCounts() const {
+    getThreadCounts().erase(this);
+  }
+
+  /** the read/write lock. */
+  pthread_rwlock_t m_lock;
+};
+
 }  // namespace ebusd
 
 #endif  // LIB_UTILS_THREAD_H_
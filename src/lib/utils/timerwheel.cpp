@@ -0,0 +1,148 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "lib/utils/timerwheel.h"
+#include "lib/utils/clock.h"
+
+namespace ebusd {
+
+TimerWheel::TimerWheel(unsigned int tickMillis, size_t slotCount)
+  : m_tickMillis(tickMillis > 0 ? tickMillis : 1), m_slots(slotCount > 0 ? slotCount : 1) {
+  m_lastNow = clockGetMillis();
+  m_currentTick = m_lastNow / m_tickMillis;
+}
+
+void TimerWheel::add(int id, uint64_t due) {
+  uint64_t tick = due / m_tickMillis;
+  if (tick < m_currentTick) {
+    tick = m_currentTick;  // already overdue: check with the next call
+  }
+  size_t index = static_cast<size_t>(tick % m_slots.size());
+  list<entry_t>& slot = m_slots[index];
+  entry_t entry = {id, due};
+  m_entries[id] = {index, slot.insert(slot.end(), entry)};
+}
+
+void TimerWheel::schedule(int id, uint64_t dueMillis) {
+  cancel(id);
+  add(id, dueMillis);
+}
+
+void TimerWheel::scheduleIn(int id, uint64_t delayMillis) {
+  schedule(id, clockGetMillis() + delayMillis);
+}
+
+bool TimerWheel::cancel(int id) {
+  const auto it = m_entries.find(id);
+  if (it == m_entries.end()) {
+    return false;
+  }
+  m_slots[it->second.first].erase(it->second.second);
+  m_entries.erase(it);
+  return true;
+}
+
+void TimerWheel::checkClockSkew(uint64_t now) {
+  if (now + m_tickMillis >= m_lastNow) {
+    if (now > m_lastNow) {
+      m_lastNow = now;
+    }
+    return;
+  }
+  // clock went backwards: keep the remaining delays
+  uint64_t delta = m_lastNow - now;
+  vector<entry_t> entries;
+  for (auto& slot : m_slots) {
+    entries.insert(entries.end(), slot.begin(), slot.end());
+    slot.clear();
+  }
+  m_entries.clear();
+  m_currentTick = now / m_tickMillis;
+  m_lastNow = now;
+  for (const auto& entry : entries) {
+    add(entry.id, entry.due > delta ? entry.due - delta : 0);
+  }
+}
+
+int64_t TimerWheel::getMillisUntilNext(uint64_t now) {
+  if (m_entries.empty()) {
+    return -1;
+  }
+  checkClockSkew(now);
+  // check the slots of one rotation for a deadline belonging to it
+  size_t count = m_slots.size();
+  for (size_t offset = 0; offset < count; offset++) {
+    uint64_t tick = m_currentTick + offset;
+    uint64_t limit = (tick + 1) * m_tickMillis;
+    const list<entry_t>& slot = m_slots[static_cast<size_t>(tick % count)];
+    bool found = false;
+    uint64_t next = 0;
+    for (const auto& entry : slot) {
+      if (entry.due < limit && (!found || entry.due < next)) {
+        next = entry.due;
+        found = true;
+      }
+    }
+    if (found) {
+      return next <= now ? 0 : static_cast<int64_t>(next - now);
+    }
+  }
+  // all deadlines are further away than one rotation
+  uint64_t next = UINT64_MAX;
+  for (const auto& slot : m_slots) {
+    for (const auto& entry : slot) {
+      if (entry.due < next) {
+        next = entry.due;
+      }
+    }
+  }
+  return next <= now ? 0 : static_cast<int64_t>(next - now);
+}
+
+bool TimerWheel::popExpired(uint64_t now, int* id) {
+  if (m_entries.empty()) {
+    return false;
+  }
+  checkClockSkew(now);
+  uint64_t nowTick = now / m_tickMillis;
+  uint64_t count = m_slots.size();
+  if (nowTick >= m_currentTick + count) {
+    m_currentTick = nowTick - count + 1;  // each slot is visited within a single rotation anyway
+  }
+  while (true) {
+    list<entry_t>& slot = m_slots[static_cast<size_t>(m_currentTick % count)];
+    for (auto it = slot.begin(); it != slot.end(); ++it) {
+      if (it->due <= now) {
+        *id = it->id;
+        m_entries.erase(it->id);
+        slot.erase(it);
+        return true;
+      }
+    }
+    if (m_currentTick >= nowTick) {
+      return false;  // keep the current slot for deadlines due later within the same tick
+    }
+    m_currentTick++;
+  }
+}
+
+}  // namespace ebusd
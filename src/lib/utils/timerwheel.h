@@ -0,0 +1,141 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_UTILS_TIMERWHEEL_H_
+#define LIB_UTILS_TIMERWHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace ebusd {
+
+/** \file lib/utils/timerwheel.h
+ * A hashed timer wheel for cheaply keeping many deadlines of a single thread.
+ */
+
+using std::list;
+using std::map;
+using std::pair;
+using std::vector;
+
+/**
+ * A hashed timer wheel keeping deadlines identified by an ID in slots of a fixed tick duration.
+ * Scheduling, rescheduling, and cancelling are cheap, so that each subsystem (or even each message) may keep its own
+ * deadline. The owning thread determines the time to sleep via @a getMillisUntilNext() and fetches the expired IDs
+ * via @a popExpired(). The instance is not thread safe.
+ */
+class TimerWheel {
+ public:
+  /**
+   * Constructor.
+   * @param tickMillis the duration of a single slot in milliseconds.
+   * @param slotCount the number of slots (deadlines further away than one rotation are kept in their slot until due).
+   */
+  explicit TimerWheel(unsigned int tickMillis = 100, size_t slotCount = 256);
+
+  /**
+   * Schedule a deadline, replacing a previous one with the same ID.
+   * @param id the ID of the deadline.
+   * @param dueMillis the absolute due time in milliseconds since the Epoch (see @a clockGetMillis()).
+   */
+  void schedule(int id, uint64_t dueMillis);
+
+  /**
+   * Schedule a deadline relative to the current time, replacing a previous one with the same ID.
+   * @param id the ID of the deadline.
+   * @param delayMillis the delay from now in milliseconds.
+   */
+  void scheduleIn(int id, uint64_t delayMillis);
+
+  /**
+   * Cancel a deadline.
+   * @param id the ID of the deadline.
+   * @return true if the deadline was scheduled.
+   */
+  bool cancel(int id);
+
+  /**
+   * @param id the ID of the deadline.
+   * @return whether a deadline with the ID is scheduled.
+   */
+  bool isScheduled(int id) const { return m_entries.find(id) != m_entries.end(); }
+
+  /**
+   * @return the number of scheduled deadlines.
+   */
+  size_t size() const { return m_entries.size(); }
+
+  /**
+   * Get the time until the next deadline is due.
+   * @param now the current time in milliseconds since the Epoch.
+   * @return the milliseconds until the next deadline (0 if already due), or -1 if nothing is scheduled.
+   */
+  int64_t getMillisUntilNext(uint64_t now);
+
+  /**
+   * Remove the next expired deadline.
+   * @param now the current time in milliseconds since the Epoch.
+   * @param id the variable in which to store the ID of the expired deadline.
+   * @return true if an expired deadline was removed, false if none is due.
+   */
+  bool popExpired(uint64_t now, int* id);
+
+
+ private:
+  /** a single scheduled deadline. */
+  typedef struct {
+    int id;  //!< the ID of the deadline
+    uint64_t due;  //!< the absolute due time in milliseconds
+  } entry_t;
+
+  /**
+   * Add a deadline to the slot it belongs to.
+   * @param id the ID of the deadline.
+   * @param due the absolute due time in milliseconds.
+   */
+  void add(int id, uint64_t due);
+
+  /**
+   * Move all deadlines back when the system clock went backwards.
+   * @param now the current time in milliseconds since the Epoch.
+   */
+  void checkClockSkew(uint64_t now);
+
+  /** the duration of a single slot in milliseconds. */
+  const uint64_t m_tickMillis;
+
+  /** the slots with the deadlines. */
+  vector<list<entry_t>> m_slots;
+
+  /** the slot index and position of each scheduled deadline by ID. */
+  map<int, pair<size_t, list<entry_t>::iterator>> m_entries;
+
+  /** the tick of the slot to check next. */
+  uint64_t m_currentTick;
+
+  /** the last time seen in milliseconds for detecting clock skew. */
+  uint64_t m_lastNow;
+};
+
+}  // namespace ebusd
+
+#endif  // LIB_UTILS_TIMERWHEEL_H_
@@ -0,0 +1,183 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lib/utils/trace.h"
+#include <string.h>
+#include <vector>
+
+namespace ebusd {
+
+using std::vector;
+
+/** the names of the @a TraceLane values. */
+static const char* s_laneNames[] = {
+  "",
+  "bus state",
+  "arbitration",
+  "requests",
+};
+
+Tracer* Tracer::getInstance() {
+  static Tracer instance;
+  return &instance;
+}
+
+Tracer::~Tracer() {
+  if (m_events) {
+    delete[] m_events;
+    m_events = nullptr;
+  }
+}
+
+void Tracer::setCapacity(size_t capacity) {
+  m_mutex.lock();
+  if (m_events) {
+    delete[] m_events;
+    m_events = nullptr;
+  }
+  m_capacity = capacity;
+  if (capacity > 0) {
+    m_events = new traceEvent_t[capacity];
+  }
+  m_next = 0;
+  m_count = 0;
+  m_mutex.unlock();
+}
+
+traceEvent_t* Tracer::add(TraceLane lane, const char* name, char phase, const struct timespec& time,
+    const char* result, const char* detail) {
+  traceEvent_t* event = &m_events[m_next];
+  m_next = (m_next + 1) % m_capacity;
+  if (m_count < m_capacity) {
+    m_count++;
+  }
+  event->time = time;
+  event->duration = 0;
+  event->id = 0;
+  event->name = name;
+  event->result = result;
+  if (detail) {
+    strncpy(event->detail, detail, TRACE_DETAIL_SIZE-1);
+    event->detail[TRACE_DETAIL_SIZE-1] = 0;
+  } else {
+    event->detail[0] = 0;
+  }
+  event->lane = lane;
+  event->phase = phase;
+  return event;
+}
+
+void Tracer::complete(TraceLane lane, const char* name, const struct timespec& start, const struct timespec& end,
+    const char* result, const char* detail) {
+  if (!isEnabled()) {
+    return;
+  }
+  int64_t duration = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  m_mutex.lock();
+  if (m_events) {
+    add(lane, name, 'X', start, result, detail)->duration = duration > 0 ? static_cast<uint64_t>(duration) : 0;
+  }
+  m_mutex.unlock();
+}
+
+void Tracer::instant(TraceLane lane, const char* name, const struct timespec& time, const char* result) {
+  if (!isEnabled()) {
+    return;
+  }
+  m_mutex.lock();
+  if (m_events) {
+    add(lane, name, 'i', time, result, nullptr);
+  }
+  m_mutex.unlock();
+}
+
+void Tracer::async(TraceLane lane, const char* name, uint64_t id, bool begin, const struct timespec& time,
+    const char* result, const char* detail) {
+  if (!isEnabled()) {
+    return;
+  }
+  m_mutex.lock();
+  if (m_events) {
+    add(lane, name, begin ? 'b' : 'e', time, result, detail)->id = id;
+  }
+  m_mutex.unlock();
+}
+
+/**
+ * Append a string as JSON string value.
+ * @param str the string (only printable ASCII expected).
+ * @param output the @a ostream to append to.
+ */
+static void appendJsonString(const char* str, ostream* output) {
+  *output << '"';
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      *output << '\\';
+    }
+    *output << *str;
+  }
+  *output << '"';
+}
+
+void Tracer::format(ostream* output) {
+  *output << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (int lane = tl_state; lane <= tl_request; lane++) {
+    *output << (lane == tl_state ? "\n" : ",\n")
+            << " {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << lane
+            << ", \"args\": {\"name\": \"" << s_laneNames[lane] << "\"}}";
+  }
+  // copy the events in order to not block the bus thread while formatting
+  vector<traceEvent_t> events;
+  m_mutex.lock();
+  events.reserve(m_count);
+  size_t index = (m_next + m_capacity - m_count) % (m_capacity ? m_capacity : 1);
+  for (size_t pos = 0; pos < m_count; pos++, index = (index + 1) % m_capacity) {
+    events.push_back(m_events[index]);
+  }
+  m_mutex.unlock();
+  for (const auto& event : events) {
+    *output << ",\n {\"name\": ";
+    appendJsonString(event.name, output);
+    *output << ", \"cat\": \"" << s_laneNames[event.lane] << "\", \"ph\": \"" << event.phase
+            << "\", \"pid\": 1, \"tid\": " << event.lane
+            << ", \"ts\": " << (static_cast<uint64_t>(event.time.tv_sec) * 1000000
+                                + static_cast<uint64_t>(event.time.tv_nsec) / 1000);
+    if (event.phase == 'X') {
+      *output << ", \"dur\": " << event.duration;
+    } else if (event.phase == 'i') {
+      *output << ", \"s\": \"t\"";
+    } else {
+      *output << ", \"id\": " << event.id;
+    }
+    if (event.result || event.detail[0]) {
+      *output << ", \"args\": {";
+      if (event.result) {
+        *output << "\"result\": ";
+        appendJsonString(event.result, output);
+      }
+      if (event.detail[0]) {
+        *output << (event.result ? ", " : "") << "\"detail\": ";
+        appendJsonString(event.detail, output);
+      }
+      *output << "}";
+    }
+    *output << "}";
+  }
+  *output << "\n]}";
+}
+
+}  // namespace ebusd
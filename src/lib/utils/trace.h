@@ -0,0 +1,162 @@
+/*
+ * ebusd - daemon for communication with eBUS heating systems.
+ * Copyright (C) 2015-2023 John Baier <ebusd@ebusd.eu>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIB_UTILS_TRACE_H_
+#define LIB_UTILS_TRACE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <ostream>
+#include "lib/utils/thread.h"
+
+namespace ebusd {
+
+/** \file lib/utils/trace.h
+ * A low overhead recorder of timestamped events into a ring buffer that can be exported in the Chrome trace event
+ * JSON format (e.g. for loading into Perfetto or chrome://tracing).
+ */
+
+using std::ostream;
+
+/** the maximum length of the detail text of a @a traceEvent_t (including the terminator). */
+#define TRACE_DETAIL_SIZE 48
+
+/** the lanes to put the trace events into. */
+enum TraceLane {
+  tl_state = 1,   //!< bus state transitions
+  tl_arbitration,  //!< arbitration attempts
+  tl_request,     //!< request lifecycles
+};
+
+/** a single trace event. */
+typedef struct traceEvent {
+  struct timespec time;  //!< the (start) time of the event
+  uint64_t duration;  //!< the duration in microseconds (complete events only)
+  uint64_t id;  //!< the ID for matching begin and end (async events only)
+  const char* name;  //!< the name of the event (static string)
+  const char* result;  //!< the optional result (static string), or nullptr
+  char detail[TRACE_DETAIL_SIZE];  //!< the optional detail text, or empty
+  TraceLane lane;  //!< the @a TraceLane
+  char phase;  //!< the Chrome trace event phase ('X' complete, 'i' instant, 'b' async begin, 'e' async end)
+} traceEvent_t;
+
+/**
+ * The recorder of trace events.
+ */
+class Tracer {
+ public:
+  /**
+   * Get the singleton instance.
+   * @return the singleton @a Tracer instance.
+   */
+  static Tracer* getInstance();
+
+  /**
+   * Destructor.
+   */
+  ~Tracer();
+
+  /**
+   * Set the number of events to keep and clear all recorded events.
+   * @param capacity the number of events to keep, or 0 to disable tracing.
+   */
+  void setCapacity(size_t capacity);
+
+  /**
+   * @return whether tracing is enabled.
+   */
+  bool isEnabled() const { return m_capacity > 0; }
+
+  /**
+   * Record a complete event, i.e. one with a start time and duration.
+   * @param lane the @a TraceLane.
+   * @param name the name of the event (static string).
+   * @param start the start time.
+   * @param end the end time.
+   * @param result the optional result (static string), or nullptr.
+   * @param detail the optional detail text, or nullptr.
+   */
+  void complete(TraceLane lane, const char* name, const struct timespec& start, const struct timespec& end,
+      const char* result = nullptr, const char* detail = nullptr);
+
+  /**
+   * Record an instant event.
+   * @param lane the @a TraceLane.
+   * @param name the name of the event (static string).
+   * @param time the time of the event.
+   * @param result the optional result (static string), or nullptr.
+   */
+  void instant(TraceLane lane, const char* name, const struct timespec& time, const char* result = nullptr);
+
+  /**
+   * Record an async event spanning several other events (e.g. a request lifecycle).
+   * @param lane the @a TraceLane.
+   * @param name the name of the event (static string).
+   * @param id the ID for matching begin and end.
+   * @param begin true for the begin, false for the end of the event.
+   * @param time the time of the event.
+   * @param result the optional result (static string), or nullptr.
+   * @param detail the optional detail text, or nullptr.
+   */
+  void async(TraceLane lane, const char* name, uint64_t id, bool begin, const struct timespec& time,
+      const char* result = nullptr, const char* detail = nullptr);
+
+  /**
+   * Format all recorded events in Chrome trace event JSON format.
+   * @param output the @a ostream to append to.
+   */
+  void format(ostream* output);
+
+
+ private:
+  /**
+   * Constructor.
+   */
+  Tracer() : m_capacity(0), m_events(nullptr), m_next(0), m_count(0) {}
+
+  /**
+   * Get the next event to fill in (with @a m_mutex locked).
+   * @param lane the @a TraceLane.
+   * @param name the name of the event.
+   * @param phase the Chrome trace event phase.
+   * @param time the (start) time of the event.
+   * @param result the optional result, or nullptr.
+   * @param detail the optional detail text, or nullptr.
+   * @return the next @a traceEvent_t.
+   */
+  traceEvent_t* add(TraceLane lane, const char* name, char phase, const struct timespec& time,
+      const char* result, const char* detail);
+
+  /** the @a Mutex for accessing the events. */
+  Mutex m_mutex;
+
+  /** the number of events to keep, or 0 if disabled. */
+  size_t m_capacity;
+
+  /** the ring buffer of events. */
+  traceEvent_t* m_events;
+
+  /** the index of the next event to write in @a m_events. */
+  size_t m_next;
+
+  /** the number of recorded events in @a m_events. */
+  size_t m_count;
+};
+
+}  // namespace ebusd
+
+#endif  // LIB_UTILS_TRACE_H_
@@ -25,12 +25,18 @@
 #ifdef HAVE_PPOLL
 #  include <poll.h>
 #endif
+#include <time.h>
+#include <atomic>
 #include <cstdio>
+#include <deque>
+#include <fstream>
 #include <iostream>
 #include <cstdlib>
 #include <sstream>
 #include <string>
+#include <vector>
 #include "lib/utils/tcpsocket.h"
+#include "lib/utils/thread.h"
 
 namespace ebusd {
 
@@ -39,13 +45,23 @@ using std::cin;
 using std::cout;
 using std::string;
 using std::endl;
+using std::atomic;
+using std::deque;
+using std::ifstream;
+using std::istream;
+using std::vector;
 
 /** A structure holding all program options. */
 struct options {
   const char* server;     //!< ebusd server host (name or ip) [localhost]
   uint16_t port;          //!< ebusd server port [8888]
+  const char* socketPath;  //!< ebusd Unix domain socket path, or nullptr for using server and port
   uint16_t timeout;       //!< ebusd connect/send/receive timeout
   bool errorResponse;     //!< non-zero exit on error response
+  const char* batchFile;  //!< file to read the commands for batch mode from ("-" for stdin), or nullptr
+  unsigned int connections;  //!< number of parallel connections in batch mode [1]
+  unsigned int pipeline;  //!< maximum number of outstanding commands per connection in batch mode [16]
+  bool timing;            //!< write the timing of each command in batch mode to stderr
 
   char* const *args;      //!< arguments to pass to ebusd
   unsigned int argCount;  //!< number of arguments to pass to ebusd
@@ -55,8 +71,13 @@ struct options {
 static struct options opt = {
   "localhost",  // server
   8888,         // port
+  nullptr,      // socketPath
   60,           // timeout
   false,        // non-zero exit on error response
+  nullptr,      // batchFile
+  1,            // connections
+  16,           // pipeline
+  false,        // timing
 
   nullptr,      // args
   0             // argCount
@@ -70,10 +91,12 @@ const char *argp_program_bug_address = "" PACKAGE_BUGREPORT "";
 
 /** the documentation of the program. */
 static const char argpdoc[] =
-  "Client for acessing " PACKAGE " via TCP.\n"
+  "Client for acessing " PACKAGE " via TCP or a Unix domain socket.\n"
   "\v"
   "If given, send COMMAND together with CMDOPT options to " PACKAGE ".\n"
-  "Use 'help' as COMMAND for help on available " PACKAGE " commands.";
+  "Use 'help' as COMMAND for help on available " PACKAGE " commands.\n"
+  "In batch mode, the commands are read line by line from FILE and pipelined over the connections. The responses "
+  "are written in the order of the commands.";
 
 /** the description of the accepted arguments. */
 static char argpargsdoc[] = "\nCOMMAND [CMDOPT...]";
@@ -83,10 +106,17 @@ static const struct argp_option argpoptions[] = {
   {nullptr,     0, nullptr, 0, "Options:", 1 },
   {"server",  's', "HOST",  0, "Connect to " PACKAGE " on HOST (name or IP) [localhost]", 0 },
   {"port",    'p', "PORT",  0, "Connect to " PACKAGE " on PORT [8888]", 0 },
+  {"socket",  'S', "PATH",  0, "Connect to " PACKAGE " on Unix domain socket PATH instead of HOST and PORT", 0 },
   {"timeout", 't', "SECS",  0, "Timeout for connecting to/receiving from " PACKAGE
                                ", 0 for none [60]", 0 },
   {"error",   'e', nullptr, 0, "Exit non-zero if the connection was fine but the response indicates non-success", 0},
 
+  {nullptr,     0, nullptr, 0, "Batch options:", 2 },
+  {"batch",   'b', "FILE",  0, "Send the commands read from FILE (\"-\" for stdin) in batch mode", 0 },
+  {"connections", 'c', "COUNT", 0, "Use COUNT parallel connections in batch mode [1]", 0 },
+  {"pipeline", 'P', "COUNT", 0, "Send up to COUNT commands per connection before waiting for a response [16]", 0 },
+  {"timing",  'T', nullptr, 0, "Write the duration of each command and a summary to stderr in batch mode", 0 },
+
   {nullptr,     0, nullptr, 0, nullptr, 0 },
 };
 
@@ -117,6 +147,13 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
     }
     opt->port = (uint16_t)value;
     break;
+  case 'S':  // --socket=/var/run/ebusd.sock
+    if (arg == nullptr || arg[0] == 0) {
+      argp_error(state, "invalid socket");
+      return EINVAL;
+    }
+    opt->socketPath = arg;
+    break;
   case 't':  // --timeout=10
     value = strtoul(arg, &strEnd, 10);
     if (strEnd == nullptr || strEnd == arg || *strEnd != 0 || value > 3600) {
@@ -128,7 +165,37 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
   case 'e':  // --error
     opt->errorResponse = true;
     break;
+  case 'b':  // --batch=-
+    if (arg == nullptr || arg[0] == 0) {
+      argp_error(state, "invalid batch");
+      return EINVAL;
+    }
+    opt->batchFile = arg;
+    break;
+  case 'c':  // --connections=1
+    value = strtoul(arg, &strEnd, 10);
+    if (strEnd == nullptr || strEnd == arg || *strEnd != 0 || value < 1 || value > 64) {
+      argp_error(state, "invalid connections");
+      return EINVAL;
+    }
+    opt->connections = value;
+    break;
+  case 'P':  // --pipeline=16
+    value = strtoul(arg, &strEnd, 10);
+    if (strEnd == nullptr || strEnd == arg || *strEnd != 0 || value < 1 || value > 1024) {
+      argp_error(state, "invalid pipeline");
+      return EINVAL;
+    }
+    opt->pipeline = value;
+    break;
+  case 'T':  // --timing
+    opt->timing = true;
+    break;
   case ARGP_KEY_ARGS:
+    if (opt->batchFile) {
+      argp_error(state, "COMMAND not allowed in batch mode");
+      return EINVAL;
+    }
     opt->args = state->argv + state->next;
     opt->argCount = state->argc - state->next;
     break;
@@ -282,8 +349,10 @@ string fetchData(ebusd::TCPSocket* socket, bool &listening, uint16_t timeout, bo
   return ostream.str();
 }
 
-bool connect(const char* host, uint16_t port, uint16_t timeout, char* const *args, int argCount) {
-  TCPSocket* socket = TCPSocket::connect(host, port, timeout);
+bool connect(const char* host, uint16_t port, const char* socketPath, uint16_t timeout, char* const *args,
+    int argCount) {
+  TCPSocket* socket = socketPath ? TCPSocket::connectUnix(socketPath, timeout)
+    : TCPSocket::connect(host, port, timeout);
   bool ret;
 
   bool once = args != nullptr && argCount > 0;
@@ -295,7 +364,7 @@ bool connect(const char* host, uint16_t port, uint16_t timeout, char* const *arg
       bool listening = false;
 
       if (!once) {
-        cout << host << ": ";
+        cout << (socketPath ? socketPath : host) << ": ";
         getline(cin, message);
       } else {
         for (int i = 0; i < argCount; i++) {
@@ -348,6 +417,8 @@ bool connect(const char* host, uint16_t port, uint16_t timeout, char* const *arg
       }
     } while (!errored && !once && !cin.eof());
     delete socket;
+  } else if (socketPath) {
+    cout << "error connecting to " << socketPath << endl;
   } else {
     cout << "error connecting to " << host << ":" << port << endl;
   }
@@ -355,6 +426,222 @@ bool connect(const char* host, uint16_t port, uint16_t timeout, char* const *arg
 }
 
 
+/** a single command in batch mode. */
+typedef struct batchCommand {
+  string command;  //!< the command to send
+  string response;  //!< the received response including the terminating empty line
+  bool done;  //!< whether the response is complete (or the command was not sent)
+  struct timespec sent;  //!< the time the command was sent
+  int64_t micros;  //!< the number of microseconds from sending the command until the response was complete
+} batchCommand_t;
+
+/**
+ * Return the number of microseconds between two times.
+ * @param start the start time.
+ * @param end the end time.
+ * @return the number of microseconds.
+ */
+static int64_t elapsedMicros(const struct timespec& start, const struct timespec& end) {
+  return (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+/**
+ * A connection sending the commands of a batch pipelined to ebusd.
+ */
+class BatchConnection : public Thread {
+ public:
+  /**
+   * Constructor.
+   * @param commands the shared list of @a batchCommand_t.
+   * @param next the shared index of the next command to send.
+   */
+  BatchConnection(vector<batchCommand_t>* commands, atomic<size_t>* next)
+    : Thread(), m_commands(commands), m_next(next), m_failed(false) {}
+
+  /**
+   * Return whether the connection failed.
+   * @return true when the connection could not be established or was lost.
+   */
+  bool isFailed() const { return m_failed; }
+
+ protected:
+  // @copydoc
+  void run() override;
+
+ private:
+  /** the shared list of @a batchCommand_t. */
+  vector<batchCommand_t>* m_commands;
+
+  /** the shared index of the next command to send. */
+  atomic<size_t>* m_next;
+
+  /** whether the connection failed. */
+  bool m_failed;
+};
+
+void BatchConnection::run() {
+  TCPSocket* socket = opt.socketPath ? TCPSocket::connectUnix(opt.socketPath, opt.timeout)
+    : TCPSocket::connect(opt.server, opt.port, opt.timeout);
+  if (socket == nullptr) {
+    m_failed = true;
+    return;
+  }
+  deque<size_t> outstanding;
+  string received;
+  char data[4096];
+  while (true) {
+    // fill the pipeline
+    while (outstanding.size() < opt.pipeline) {
+      size_t index = (*m_next)++;
+      if (index >= m_commands->size()) {
+        break;
+      }
+      batchCommand_t& cmd = (*m_commands)[index];
+      if (cmd.done) {
+        continue;  // not to be sent
+      }
+      string sendmessage = cmd.command+'\n';
+      clock_gettime(CLOCK_MONOTONIC, &cmd.sent);
+      if (socket->send(sendmessage.c_str(), sendmessage.size()) < 0) {
+        perror("ebusctl send");
+        m_failed = true;
+        break;
+      }
+      outstanding.push_back(index);
+    }
+    if (m_failed || outstanding.empty()) {
+      break;
+    }
+    ssize_t datalen = socket->recv(data, sizeof(data));
+    if (datalen <= 0) {
+      if (datalen < 0) {
+        perror("ebusctl recv");
+      }
+      m_failed = true;
+      break;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    received.append(data, datalen);
+    // responses are terminated by an empty line and arrive in the order of the commands
+    size_t pos;
+    while (!outstanding.empty() && (pos=received.find("\n\n")) != string::npos) {
+      batchCommand_t& cmd = (*m_commands)[outstanding.front()];
+      outstanding.pop_front();
+      cmd.response = received.substr(0, pos+2);
+      received.erase(0, pos+2);
+      cmd.micros = elapsedMicros(cmd.sent, now);
+      cmd.done = true;
+    }
+  }
+  delete socket;
+}
+
+/**
+ * Send the commands read from the batch file pipelined over one or more connections and write the responses in order.
+ * @return true on success, false if a connection failed or a response was missing (or indicates non-success with
+ * @a options.errorResponse).
+ */
+bool runBatch() {
+  ifstream file;
+  istream* input = &cin;
+  if (strcmp(opt.batchFile, "-") != 0) {
+    file.open(opt.batchFile);
+    if (!file.is_open()) {
+      cout << "error reading " << opt.batchFile << endl;
+      return false;
+    }
+    input = &file;
+  }
+  vector<batchCommand_t> commands;
+  string line;
+  while (getline(*input, line)) {
+    if (!line.empty() && line[line.length()-1] == '\r') {
+      line.erase(line.length()-1);
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    batchCommand_t cmd;
+    cmd.command = line;
+    cmd.done = false;
+    cmd.micros = 0;
+    string verb = line.substr(0, line.find(' '));
+    if (strcasecmp(verb.c_str(), "L") == 0 || strcasecmp(verb.c_str(), "LISTEN") == 0
+    || strcasecmp(verb.c_str(), "Q") == 0 || strcasecmp(verb.c_str(), "QUIT") == 0
+    || strcasecmp(verb.c_str(), "STOP") == 0) {
+      cmd.response = "ERR: not supported in batch mode\n\n";
+      cmd.done = true;
+    }
+    commands.push_back(cmd);
+  }
+  atomic<size_t> next(0);
+  vector<BatchConnection*> connections;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int i = 0; i < opt.connections; i++) {
+    BatchConnection* connection = new BatchConnection(&commands, &next);
+    connection->start("batch");
+    connections.push_back(connection);
+  }
+  bool ret = true;
+  unsigned int failed = 0;
+  for (auto connection : connections) {
+    connection->join();
+    if (connection->isFailed()) {
+      failed++;
+    }
+    delete connection;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (failed > 0) {
+    cout << "error on " << failed << " of " << opt.connections << " connections" << endl;
+    ret = false;
+  }
+  size_t count = 0;
+  int64_t minMicros = 0, maxMicros = 0, sumMicros = 0;
+  for (size_t index = 0; index < commands.size(); index++) {
+    const batchCommand_t& cmd = commands[index];
+    if (!cmd.done) {
+      cout << "ERR: no response\n\n";
+      ret = false;
+      continue;
+    }
+    cout << cmd.response;
+    if (opt.errorResponse && cmd.response.substr(0, 4) == "ERR:") {
+      ret = false;
+    }
+    if (cmd.micros <= 0) {
+      continue;  // not sent
+    }
+    if (opt.timing) {
+      fprintf(stderr, "%zu\t%.3f ms\t%s\n", index+1, static_cast<double>(cmd.micros)/1000.0,
+          cmd.command.c_str());
+    }
+    if (count == 0 || cmd.micros < minMicros) {
+      minMicros = cmd.micros;
+    }
+    if (cmd.micros > maxMicros) {
+      maxMicros = cmd.micros;
+    }
+    sumMicros += cmd.micros;
+    count++;
+  }
+  cout.flush();
+  if (opt.timing) {
+    double seconds = static_cast<double>(elapsedMicros(start, end))/1000000.0;
+    fprintf(stderr, "%zu commands in %.3f s over %u connections: %.1f commands/s", count, seconds,
+        opt.connections, seconds > 0 ? static_cast<double>(count)/seconds : 0.0);
+    if (count > 0) {
+      fprintf(stderr, ", latency min %.3f ms, avg %.3f ms, max %.3f ms", static_cast<double>(minMicros)/1000.0,
+          static_cast<double>(sumMicros)/1000.0/static_cast<double>(count), static_cast<double>(maxMicros)/1000.0);
+    }
+    fprintf(stderr, "\n");
+  }
+  return ret;
+}
+
+
 /**
  * Main function.
  * @param argc the number of command line arguments.
@@ -367,7 +654,10 @@ int main(int argc, char* argv[]) {
   if (argp_parse(&argp, argc, argv, ARGP_IN_ORDER, nullptr, &opt) != 0) {
     return EINVAL;
   }
-  bool success = connect(opt.server, opt.port, opt.timeout, opt.args, opt.argCount);
+  if (opt.batchFile) {
+    exit(runBatch() ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  bool success = connect(opt.server, opt.port, opt.socketPath, opt.timeout, opt.args, opt.argCount);
 
   exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
 }
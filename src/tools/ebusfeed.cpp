@@ -29,6 +29,7 @@
 #include <iomanip>
 #include "lib/ebus/device.h"
 #include "lib/ebus/result.h"
+#include "lib/utils/clock.h"
 
 namespace ebusd {
 
@@ -38,6 +39,8 @@ using std::cout;
 using std::endl;
 using std::setw;
 using std::setfill;
+using std::fixed;
+using std::setprecision;
 using std::ios;
 using ebusd::result_t;
 using ebusd::Device;
@@ -46,6 +49,8 @@ using ebusd::Device;
 struct options {
   const char* device;  //!< device to write to [/dev/ttyUSB60]
   unsigned int time;  //!< delay between bytes in us [10000]
+  double speed;  //!< speed factor relative to the real bus speed, 0 for as fast as possible, or -1 for using time [-1]
+  bool quiet;  //!< whether to omit printing each byte
 
   const char* dumpFile;  //!< dump file to read
 };
@@ -54,6 +59,8 @@ struct options {
 static struct options opt = {
   "/dev/ttyUSB60",  // device
   10000,  // time
+  -1,  // speed
+  false,  // quiet
 
   "/tmp/ebus_dump.bin",  // dumpFile
 };
@@ -76,7 +83,11 @@ static const char argpdoc[] =
   "     'ln -s /dev/pts/2 /dev/ttyUSB60'\n"
   "     'ln -s /dev/pts/3 /dev/ttyUSB20'\n"
   "  3. start " PACKAGE ": '" PACKAGE " -f -d /dev/ttyUSB20 --nodevicecheck'\n"
-  "  4. start ebusfeed: 'ebusfeed /path/to/ebus_dump.bin'\n";
+  "  4. start ebusfeed: 'ebusfeed /path/to/ebus_dump.bin'\n"
+  "\n"
+  "For measuring the throughput end-to-end, replay with e.g. '-q -s 10' (ten times the\n"
+  "real bus speed) or '-q -s 0' (as fast as possible). Alternatively, " PACKAGE " can replay a\n"
+  "DUMPFILE in-process without any serial device using '-d replay:[FACTOR:]DUMPFILE'.\n";
 
 /** the description of the accepted arguments. */
 static char argpargsdoc[] = "[DUMPFILE]";
@@ -85,6 +96,9 @@ static char argpargsdoc[] = "[DUMPFILE]";
 static const struct argp_option argpoptions[] = {
   {"device", 'd', "DEV",     0, "Write to DEV (serial device) [/dev/ttyUSB60]", 0 },
   {"time",   't', "USEC",    0, "Delay each byte by USEC us [10000]", 0 },
+  {"speed",  's', "FACTOR",  0, "Replay at FACTOR times the real bus speed of 2400 Baud instead of using a fixed "
+   "delay, 0 for as fast as possible", 0 },
+  {"quiet",  'q', nullptr,   0, "Do not print each byte", 0 },
 
   {nullptr,    0, nullptr,   0, nullptr, 0 },
 };
@@ -114,6 +128,16 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
       return EINVAL;
     }
     break;
+  case 's':  // --speed=1
+    opt->speed = strtod(arg, &strEnd);
+    if (strEnd == nullptr || strEnd == arg || *strEnd != 0 || opt->speed < 0 || opt->speed > 100000) {
+      argp_error(state, "invalid speed");
+      return EINVAL;
+    }
+    break;
+  case 'q':  // --quiet
+    opt->quiet = true;
+    break;
   case ARGP_KEY_ARG:
     if (state->arg_num == 0) {
       if (arg == nullptr || arg[0] == 0 || strcmp("/", arg) == 0) {
@@ -159,17 +183,47 @@ int main(int argc, char* argv[]) {
     cout << "device opened" << endl;
     fstream file(opt.dumpFile, ios::in | ios::binary);
     if (file.is_open()) {
+      struct timespec start, now;
+      clockGettime(&start);
+      uint64_t symbols = 0, telegrams = 0;
+      symbol_t lastByte = SYN;
       while (true) {
         symbol_t byte = (symbol_t)file.get();
         if (file.eof()) {
           break;
         }
-        cout << hex << setw(2) << setfill('0')
-             << static_cast<unsigned>(byte) << endl;
+        if (!opt.quiet) {
+          cout << hex << setw(2) << setfill('0')
+               << static_cast<unsigned>(byte) << endl;
+        }
         device->send(byte);
-        usleep(opt.time);
+        symbols++;
+        if (lastByte == SYN && byte != SYN) {
+          telegrams++;
+        }
+        lastByte = byte;
+        if (opt.speed < 0) {
+          usleep(opt.time);
+        } else if (opt.speed > 0) {
+          // keep the pace relative to the start in order to not accumulate the overhead of each byte
+          clockGettime(&now);
+          int64_t elapsed = (now.tv_sec-start.tv_sec)*1000000 + (now.tv_nsec-start.tv_nsec)/1000;
+          int64_t due = static_cast<int64_t>(static_cast<double>(symbols)*NOMINAL_SYMBOL_MICROS/opt.speed);
+          if (due > elapsed) {
+            usleep(static_cast<useconds_t>(due-elapsed));
+          }
+        }
       }
       file.close();
+      clockGettime(&now);
+      double secs = static_cast<double>(now.tv_sec-start.tv_sec)
+                    + static_cast<double>(now.tv_nsec-start.tv_nsec)/1000000000;
+      if (secs <= 0) {
+        secs = 0.000001;
+      }
+      cout << std::dec << "fed " << symbols << " symbols and " << telegrams << " telegrams in " << fixed
+           << setprecision(3) << secs << " s (" << setprecision(0) << static_cast<double>(symbols)/secs
+           << " symbols/s, " << static_cast<double>(telegrams)/secs << " telegrams/s)" << endl;
     } else {
       cout << "error opening file " << opt.dumpFile << endl;
     }
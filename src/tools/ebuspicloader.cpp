@@ -21,6 +21,7 @@
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -36,6 +37,8 @@
 #include <iomanip>
 #include <string>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 #include "intelhex/intelhexclass.h"
 #include "lib/utils/tcpsocket.h"
 
@@ -54,9 +57,10 @@ static const char argpdoc[] =
     "/dev/ttyUSB0"
 #endif
     ") that also supports a trailing wildcard '*' for testing"
-    " multiple ports, or a network port as \"ip:port\" for use with e.g. socat or ebusd-esp in PIC pass-through mode.";
+    " multiple ports, or a network port as \"ip:port\" for use with e.g. socat or ebusd-esp in PIC pass-through mode."
+    " Several PORTs may be given for updating multiple devices in one go.";
 
-static const char argpargsdoc[] = "PORT";
+static const char argpargsdoc[] = "PORT [PORT...]";
 
 /** the definition of the known program arguments. */
 static const struct argp_option argpoptions[] = {
@@ -78,10 +82,13 @@ static const struct argp_option argpoptions[] = {
                                  " (lowercase to allow hardware jumpers, default \"u\""
                                  ", since firmware 20221206)", 0 },
     {"flash",   'f', "FILE",  0, "flash the FILE to the device", 0 },
+    {"update",  'u', nullptr, 0, "only flash the regions of the FILE that differ from the device (as determined by"
+                                 " reading back the flash)", 0 },
     {"reset",   'r', nullptr, 0, "reset the device at the end on success", 0 },
     {nullptr,     0, nullptr, 0, "Tool options:", 9 },
     {"verbose", 'v', nullptr, 0, "enable verbose output", 0 },
     {"slow",    's', nullptr, 0, "low speed mode for transfer (115kBd instead of 921kBd)", 0 },
+    {"parallel", 'P', nullptr, 0, "handle multiple PORTs in parallel instead of one after the other", 0 },
     {nullptr,          0,        nullptr,    0, nullptr, 0 },
 };
 
@@ -103,8 +110,10 @@ static bool setVariant = false;
 static uint8_t setVariantValue = 0;
 static bool setVariantForced = false;
 static char* flashFile = nullptr;
+static bool flashUpdate = false;
 static bool reset = false;
 static bool lowSpeed = false;
+static bool parallel = false;
 
 bool parseByte(const char *arg, uint8_t minValue, uint8_t maxValue, uint8_t *result) {
   char* strEnd = nullptr;
@@ -332,12 +341,18 @@ error_t parse_opt(int key, char *arg, struct argp_state *state) {
       }
       flashFile = arg;
       break;
+    case 'u':  // --update
+      flashUpdate = true;
+      break;
     case 'r':  // --reset
       reset = true;
       break;
     case 's':  // --slow
       lowSpeed = true;
       break;
+    case 'P':  // --parallel
+      parallel = true;
+      break;
     default:
       return ARGP_ERR_UNKNOWN;
   }
@@ -401,12 +416,15 @@ typedef union
 #define WAIT_BYTE_TRANSFERRED_MILLIS 200
 #define WAIT_BITRATE_DETECTION_MICROS 100
 #define WAIT_RESPONSE_TIMEOUT_MILLIS 100
+#define WAIT_TAIL_MILLIS 5
 // size of flash in bytes
 #define END_FLASH_BYTES (END_FLASH*2)
 // size of boot block in words
 #define END_BOOT 0x0400
 // size of boot block in bytes
 #define END_BOOT_BYTES (END_BOOT*2)
+// size of the flash regions compared in update mode in bytes (multiple of the erase block size)
+#define COMPARE_FLASH_BYTES (ERASE_FLASH_BLOCKSIZE*2*16)
 
 static bool isSerial = true;
 static int timeoutFactor = 1;
@@ -464,8 +482,22 @@ ssize_t waitRead(int fd, uint8_t *data, size_t len, int timeoutMillis) {
   return ret;
 }
 
+void drainInput(int fd, int timeoutMillis) {
+  uint8_t dummy[16];
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN | POLLERR | POLLHUP;
+  while (poll(&pfd, 1, timeoutMillis*timeoutFactor) > 0 && (pfd.revents & POLLIN)) {
+    if (read(fd, dummy, sizeof(dummy)) <= 0) {
+      break;
+    }
+  }
+}
+
 ssize_t sendReceiveFrame(int fd, frame_t& frame, size_t sendDataLen, ssize_t fixReceiveDataLen,
                          int responseTimeoutExtraMillis = 0, bool hideErrors = false) {
+  // drop a late tail of the previous answer
+  drainInput(fd, 0);
   // send 0x55 for auto baud detection in PIC
   unsigned char ch = STX;
   ssize_t cnt = waitWrite(fd, &ch, 1, WAIT_BYTE_TRANSFERRED_MILLIS);
@@ -502,6 +534,10 @@ ssize_t sendReceiveFrame(int fd, frame_t& frame, size_t sendDataLen, ssize_t fix
     pos += cnt;
   }
   cnt = waitRead(fd, &ch, 1, WAIT_RESPONSE_TIMEOUT_MILLIS + responseTimeoutExtraMillis);
+  // skip a late tail of the previous answer
+  for (int skip = 0; cnt == 1 && ch != STX && skip < 4; skip++) {
+    cnt = waitRead(fd, &ch, 1, WAIT_BYTE_TRANSFERRED_MILLIS);
+  }
   if (cnt < 0) {
     if (!hideErrors) {
       std::cerr << "read sync failed" << std::endl;
@@ -547,8 +583,7 @@ ssize_t sendReceiveFrame(int fd, frame_t& frame, size_t sendDataLen, ssize_t fix
       fixReceiveDataLen = 0;
     }
   }
-  uint8_t dummy[4];
-  waitRead(fd, dummy, 4, WAIT_BYTE_TRANSFERRED_MILLIS);  // read away potential nonsense tail
+  drainInput(fd, WAIT_TAIL_MILLIS);  // read away potential nonsense tail
   if (frame.command != writeCommand) {
     if (!hideErrors) {
       std::cerr << "unexpected answer" << std::endl;
@@ -697,6 +732,20 @@ int readFlash(int fd, uint16_t address, bool skipHigh = false, bool print = true
   return 0;
 }
 
+int compareFlash(int fd, unsigned long byteAddress, const uint8_t* data, size_t len) {
+  uint8_t flashData[0x10];
+  for (size_t pos = 0; pos < len; pos += 0x10) {
+    int ret = readFlash(fd, (byteAddress+pos)/2, false, false, flashData);
+    if (ret != 0) {
+      return ret < 0 ? ret : -1;
+    }
+    if (memcmp(flashData, data+pos, std::min(len-pos, (size_t)0x10)) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 int writeFlash(int fd, uint16_t address, uint16_t len, uint8_t* data, bool hideErrors = false) {
   frame_t frame;
   memset(frame.buffer, 0, FRAME_MAX_LEN);
@@ -935,49 +984,90 @@ bool flashPic(int fd) {
     return false;
   }
   ih.begin();
-  uint8_t buf[WRITE_FLASH_BLOCKSIZE];
   unsigned long nextAddr = ih.currentAddress();
   if (nextAddr != END_BOOT_BYTES) {
     std::cerr << "unexpected start address in file: 0x" << std::hex << std::setfill('0') << std::setw(4)
               << static_cast<unsigned>(nextAddr) << std::endl;
     return false;
   }
-  unsigned long blockStart = END_BOOT_BYTES;
+  // read all blocks up to the end address with gaps set to the erased value
+  size_t blockCount = (endAddr-END_BOOT_BYTES+WRITE_FLASH_BLOCKSIZE-1)/WRITE_FLASH_BLOCKSIZE;
+  std::vector<uint8_t> image(blockCount*WRITE_FLASH_BLOCKSIZE);
+  std::vector<bool> blankBlocks(blockCount, true);
   uint16_t checkSum = 0;
   uint16_t skipped = 0;
-  int eraseRes = eraseFlash(fd, blockStart/2, (endAddr-blockStart)/2);
-  if (eraseRes != 0) {
-    std::cerr << "erasing flash failed: " << static_cast<signed>(-eraseRes-1) << std::endl;
-    return false;
+  for (size_t pos = 0; pos < image.size(); pos++, nextAddr++) {
+    unsigned long addr = ih.currentAddress();
+    uint8_t value = (pos&0x1) == 1 ? 0x3f : 0xff;
+    if (addr == nextAddr && ih.getData(&value)) {
+      ih.incrementAddress();
+      blankBlocks[pos/WRITE_FLASH_BLOCKSIZE] = false;
+    } else {
+      skipped++;
+    }
+    image[pos] = value;
+    checkSum += ((uint16_t)value) << ((pos&0x1)*8);
+  }
+  if (nextAddr-END_BOOT_BYTES != ih.size()+skipped) {
+    std::cout << "unable to fully read file." << std::endl;
+  }
+  unsigned long blockStart = END_BOOT_BYTES+image.size();
+  if (flashUpdate) {
+    int fileSum = calcFileChecksum();
+    // the checksum is only a pre-filter as it can't detect reordered or offsetting changes
+    if (fileSum >= 0 && calcChecksum(fd, END_BOOT, END_FLASH_BYTES-END_BOOT_BYTES) == fileSum
+        && compareFlash(fd, END_BOOT_BYTES, image.data(), image.size()) == 0) {
+      std::cout << "firmware unchanged, flashing skipped." << std::endl;
+      return true;
+    }
+  } else {
+    int eraseRes = eraseFlash(fd, END_BOOT, (endAddr-END_BOOT_BYTES)/2);
+    if (eraseRes != 0) {
+      std::cerr << "erasing flash failed: " << static_cast<signed>(-eraseRes-1) << std::endl;
+      return false;
+    }
+    std::cout << "erasing flash: done." << std::endl;
   }
-  std::cout << "erasing flash: done." << std::endl;
-  std::cout << "flashing: 0x" << std::hex << std::setfill('0') << std::setw(4) << static_cast<unsigned>(nextAddr/2)
+  std::cout << "flashing: 0x" << std::hex << std::setfill('0') << std::setw(4) << static_cast<unsigned>(END_BOOT)
             << " - 0x" << static_cast<unsigned>(endAddr/2) << std::endl;
-  size_t blocks = 0;
-  while (blockStart < endAddr) {
-    bool blank = true;
-    for (int pos = 0; pos < WRITE_FLASH_BLOCKSIZE; pos++, nextAddr++) {
-      unsigned long addr = ih.currentAddress();
-      uint8_t value = (pos&0x1) == 1 ? 0x3f : 0xff;
-      if (addr == nextAddr && ih.getData(&value)) {
-        ih.incrementAddress();
-        blank = false;
-      } else {
-        skipped++;
+  size_t blocks = 0, unchanged = 0, regions = 0;
+  for (size_t regionPos = 0; regionPos < image.size(); regionPos += COMPARE_FLASH_BYTES, regions++) {
+    size_t regionEnd = std::min(regionPos+COMPARE_FLASH_BYTES, image.size());
+    unsigned long regionAddr = END_BOOT_BYTES+regionPos;
+    if (flashUpdate) {
+      // compare the region and erase it only if it differs (with the checksum as cheap pre-filter only)
+      uint16_t regionSum = 0;
+      for (size_t pos = regionPos; pos < regionEnd; pos++) {
+        regionSum += ((uint16_t)image[pos]) << ((pos&0x1)*8);
+      }
+      if (calcChecksum(fd, regionAddr/2, regionEnd-regionPos) == regionSum
+          && compareFlash(fd, regionAddr, image.data()+regionPos, regionEnd-regionPos) == 0) {
+        unchanged++;
+        continue;
+      }
+      int eraseRes = eraseFlash(fd, regionAddr/2, (regionEnd-regionPos)/2);
+      if (eraseRes != 0) {
+        std::cerr << "erasing flash at 0x" << std::hex << std::setfill('0') << std::setw(4)
+                  << static_cast<unsigned>(regionAddr/2) << " failed: " << std::dec
+                  << static_cast<signed>(-eraseRes-1) << std::endl;
+        return false;
       }
-      buf[pos] = value;
-      checkSum += ((uint16_t)value) << ((pos&0x1)*8);
     }
-    if (!blank) {
+    for (size_t blockPos = regionPos; blockPos < regionEnd; blockPos += WRITE_FLASH_BLOCKSIZE) {
+      if (blankBlocks[blockPos/WRITE_FLASH_BLOCKSIZE]) {
+        continue;
+      }
+      unsigned long blockAddr = END_BOOT_BYTES+blockPos;
       if (blocks == 0) {
         std::cout << std::endl << "0x" << std::hex << std::setfill('0') << std::setw(4)
-                  << static_cast<unsigned>(blockStart/2) << " ";
+                  << static_cast<unsigned>(blockAddr/2) << " ";
       }
-      if (writeFlash(fd, blockStart/2, WRITE_FLASH_BLOCKSIZE, buf, true) != 0) {
+      uint8_t* buf = image.data()+blockPos;
+      if (writeFlash(fd, blockAddr/2, WRITE_FLASH_BLOCKSIZE, buf, true) != 0) {
         // repeat once silently:
-        if (writeFlash(fd, blockStart/2, WRITE_FLASH_BLOCKSIZE, buf) != 0) {
+        if (writeFlash(fd, blockAddr/2, WRITE_FLASH_BLOCKSIZE, buf) != 0) {
           std::cerr << "unable to write flash at 0x" << std::hex << std::setfill('0') << std::setw(4)
-                    << static_cast<unsigned>(blockStart/2) << std::endl;
+                    << static_cast<unsigned>(blockAddr/2) << std::endl;
           return false;
         }
       }
@@ -987,11 +1077,16 @@ bool flashPic(int fd) {
       }
       std::cout.flush();
     }
-    blockStart += WRITE_FLASH_BLOCKSIZE;
+    if (flashUpdate && compareFlash(fd, regionAddr, image.data()+regionPos, regionEnd-regionPos) != 0) {
+      std::cerr << "verifying flash at 0x" << std::hex << std::setfill('0') << std::setw(4)
+                << static_cast<unsigned>(regionAddr/2) << " failed" << std::endl;
+      return false;
+    }
   }
   std::cout << std::endl << "flashing finished." << std::endl;
-  if (nextAddr-END_BOOT_BYTES != ih.size()+skipped) {
-    std::cout << "unable to fully read file." << std::endl;
+  if (flashUpdate) {
+    std::cout << "unchanged regions skipped: " << std::dec << static_cast<unsigned>(unchanged) << " of "
+              << static_cast<unsigned>(regions) << std::endl;
   }
   int picSum = calcChecksum(fd, startAddr/2, blockStart-startAddr);
   if (picSum < 0) {
@@ -1165,6 +1260,106 @@ bool writeSettings(int fd, uint8_t* currentData = nullptr) {
 
 int run(int fd);
 
+int openPort(const std::string& port) {
+  std::string::size_type pos = port.find(':');
+  if (pos == std::string::npos) {
+    isSerial = true;
+    timeoutFactor = 1;
+    timeoutAddend = 0;
+    return openSerial(port);
+  }
+  string host = port.substr(0, pos);
+  uint16_t portNum = 0;
+  if (!parseShort(port.substr(pos+1).c_str(), 1, 65535, &portNum)) {
+    std::cerr << "invalid port " << port << std::endl;
+    return -1;
+  }
+  isSerial = false;
+  timeoutFactor = 2;
+  timeoutAddend = 100;
+  return openNet(host, portNum);
+}
+
+/**
+ * Handle each of the ports in a separate child process and print their output line by line prefixed with the port.
+ * @param ports the ports to handle.
+ * @return the exit code (failure if any of the ports failed).
+ */
+int runParallel(const std::vector<std::string>& ports) {
+  std::vector<pid_t> pids;
+  std::vector<struct pollfd> pfds;
+  std::vector<std::string> pending;
+  std::cout.flush();
+  std::cerr.flush();
+  for (const auto& port : ports) {
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+      std::cerr << "unable to create pipe" << std::endl;
+      break;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      std::cerr << "unable to fork" << std::endl;
+      close(pipeFds[0]);
+      close(pipeFds[1]);
+      break;
+    }
+    if (pid == 0) {
+      // child: each process gets its own copy of the connection state
+      close(pipeFds[0]);
+      dup2(pipeFds[1], STDOUT_FILENO);
+      dup2(pipeFds[1], STDERR_FILENO);
+      close(pipeFds[1]);
+      int fd = openPort(port);
+      exit(fd < 0 ? EXIT_FAILURE : run(fd));
+    }
+    close(pipeFds[1]);
+    pids.push_back(pid);
+    struct pollfd pfd;
+    pfd.fd = pipeFds[0];
+    pfd.events = POLLIN;
+    pfds.push_back(pfd);
+    pending.push_back("");
+  }
+  size_t remaining = pfds.size();
+  char buf[256];
+  while (remaining > 0 && poll(pfds.data(), pfds.size(), -1) > 0) {
+    for (size_t idx = 0; idx < pfds.size(); idx++) {
+      if (pfds[idx].fd < 0 || !(pfds[idx].revents & (POLLIN | POLLERR | POLLHUP))) {
+        continue;
+      }
+      ssize_t len = read(pfds[idx].fd, buf, sizeof(buf));
+      if (len > 0) {
+        pending[idx].append(buf, len);
+      }
+      std::string::size_type lineEnd;
+      while ((lineEnd = pending[idx].find('\n')) != std::string::npos) {
+        std::cout << ports[idx] << ": " << pending[idx].substr(0, lineEnd) << std::endl;
+        pending[idx].erase(0, lineEnd+1);
+      }
+      if (len <= 0) {
+        if (!pending[idx].empty()) {
+          std::cout << ports[idx] << ": " << pending[idx] << std::endl;
+        }
+        close(pfds[idx].fd);
+        pfds[idx].fd = -1;
+        remaining--;
+      }
+    }
+  }
+  int failed = static_cast<int>(ports.size()-pids.size());
+  for (size_t idx = 0; idx < pids.size(); idx++) {
+    int status = 0;
+    if (waitpid(pids[idx], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      std::cerr << ports[idx] << ": failed" << std::endl;
+      failed++;
+    }
+  }
+  std::cout << "finished " << std::dec << static_cast<unsigned>(ports.size()-failed) << " of "
+            << static_cast<unsigned>(ports.size()) << " devices successfully." << std::endl;
+  return failed > 0 ? EXIT_FAILURE : 0;
+}
+
 int main(int argc, char* argv[]) {
   struct argp aargp = { argpoptions, parse_opt, argpargsdoc, argpdoc, nullptr, nullptr, nullptr };
   int arg_index = -1;
@@ -1188,55 +1383,62 @@ int main(int argc, char* argv[]) {
       exit(EXIT_FAILURE);
     }
   }
-  std::string port = argv[arg_index];
-  std::string::size_type pos = port.find('*');
-  if (pos == std::string::npos || pos != port.length()-1) {
-    int fd;
-    pos = port.find(':');
-    if (pos != std::string::npos) {
-      string host = port.substr(0, pos);
-      uint16_t portNum = 0;
-      if (!parseShort(port.substr(pos+1).c_str(), 1, 65535, &portNum)) {
-        exit(EXIT_FAILURE);
+  std::vector<std::string> ports;
+  bool wildcard = false;
+  for (; arg_index < argc; arg_index++) {
+    std::string port = argv[arg_index];
+    std::string::size_type pos = port.find('*');
+    if (pos == std::string::npos || pos != port.length()-1) {
+      ports.push_back(port);
+      continue;
+    }
+    wildcard = true;
+    std::string::size_type sep = port.find_last_of('/');
+    std::string base = sep == std::string::npos ? "" : port.substr(0, sep);
+    DIR* dir = opendir(base.c_str());
+    if (!dir) {
+      std::cerr << "Unable to open directory " << base << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::string prefix = sep == std::string::npos ? port.substr(0, pos) : port.substr(sep + 1, pos - 1 - sep);
+    struct dirent* ent;
+    while ((ent = readdir(dir))) {
+      if (std::string(ent->d_name).substr(0, prefix.length()) != prefix) {
+        continue;
       }
-      isSerial = false;
-      timeoutFactor = 2;
-      timeoutAddend = 100;
-      fd = openNet(host, portNum);
-    } else {
-      fd = openSerial(port);
+      ports.push_back(base + "/" + ent->d_name);
     }
+    closedir(dir);
+  }
+  if (ports.empty()) {
+    std::cerr << "No matching port found" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (ports.size() == 1 && !wildcard) {
+    int fd = openPort(ports[0]);
     if (fd < 0) {
       exit(EXIT_FAILURE);
     }
     return run(fd);
   }
-
-  std::string::size_type sep = port.find_last_of('/');
-  std::string base = sep == std::string::npos ? "" : port.substr(0, sep);
-  DIR* dir = opendir(base.c_str());
-  if (!dir) {
-    std::cerr << "Unable to open directory " << base << std::endl;
-    exit(EXIT_FAILURE);
+  if (parallel) {
+    return runParallel(ports);
   }
-
-  std::string prefix = sep == std::string::npos ? port.substr(0, pos) : port.substr(sep + 1, pos - 1 - sep);
-  struct dirent* ent;
-  while ((ent = readdir(dir))) {
-    if (std::string(ent->d_name).substr(0, prefix.length()) != prefix) {
-      continue;
-    }
-    std::string name = base + "/" + ent->d_name;
+  int failed = 0;
+  for (const auto& name : ports) {
     std::cout << "Trying " << name << "..." << std::endl;
-    int fd = openSerial(name);
+    int fd = openPort(name);
     if (fd < 0) {
       std::cerr << "Unable to open " << name << std::endl;
+      failed++;
       continue;
     }
-    run(fd);
+    if (run(fd) != 0) {
+      failed++;
+    }
     std::cout << std::endl;
   }
-  return 0;
+  return failed > 0 ? EXIT_FAILURE : 0;
 }
 
 int run(int fd) {
@@ -1319,5 +1521,5 @@ int run(int fd) {
   }
 
   closeConnection(fd);
-  return 0;
+  return success ? 0 : EXIT_FAILURE;
 }